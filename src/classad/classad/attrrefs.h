@@ -114,6 +114,8 @@ class AttributeReference : public ExprTree
 		ExprTree	*expr;
 		bool		absolute;
     	std::string attributeStr;
+
+		friend class CompiledExpr;
 };
 
 } // classad
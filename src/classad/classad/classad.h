@@ -49,6 +49,12 @@ void ClassAdLibraryVersion(std::string &version_string);
 void ClassAdSetExpressionCaching(bool do_caching);
 bool ClassAdGetExpressionCaching();
 
+// The regexp() family of functions keeps the most recently used compiled
+// patterns in a cache of this many entries, 0 disables the cache.
+// The default is 100.
+void ClassAdSetRegexCacheSize(int max_entries);
+void ClassAdGetRegexCacheStats(unsigned long &hits, unsigned long &misses, int &entries);
+
 // This flag is only meant for use in Condor, which is transitioning
 // from an older version of ClassAds with slightly different evaluation
 // semantics. It will be removed without warning in a future release.
@@ -753,6 +759,7 @@ class ClassAd : public ExprTree
 		friend 	class ExprTree;
 		friend 	class EvalState;
 		friend 	class ClassAdIterator;
+		friend 	class CompiledExpr;
 
 		bool _GetExternalReferences( const ExprTree *, const ClassAd *, 
 					EvalState &, References&, bool fullNames ) const;
@@ -0,0 +1,141 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef __CLASSAD_COMPILED_EXPR_H__
+#define __CLASSAD_COMPILED_EXPR_H__
+
+#include "classad/exprTree.h"
+#include "classad/operators.h"
+#include <vector>
+
+namespace classad {
+
+class AttributeReference;
+
+// Should the Requirements and Rank of ads prepared for matchmaking be
+// compiled to bytecode.  The default is false.
+void ClassAdSetExpressionCompiling(bool do_compiling);
+bool ClassAdGetExpressionCompiling();
+
+/** Compile an expression to bytecode, and attach the compiled form to
+	the expression so that Evaluate() will use it.  Only operator nodes
+	can carry a compiled form, for anything else this does nothing.
+	@param tree The expression to compile, it may be a cache envelope.
+	@return true if the expression now has a compiled form.
+*/
+bool CompileExpr( ExprTree *tree );
+
+/** Discard the compiled form of an expression, if it has one.
+	@param tree The expression, it may be a cache envelope.
+*/
+void DecompileExpr( ExprTree *tree );
+
+/** A flat, register based program that evaluates an expression tree.
+
+	Operator nodes become instructions that call the same operator
+	implementation as the tree walker, and the short circuit rules of
+	&&, || and ?: become conditional jumps, so a compiled expression
+	always produces the same value as the tree it was compiled from.
+	Subtrees that are not operators, attribute references or literals
+	(function calls, nested ads and lists) are evaluated by the tree
+	walker from inside the program.
+
+	Each distinct attribute reference in the expression is given a slot.
+	The first use of a slot in an evaluation resolves the reference to the
+	expression and scope it names, later uses of the slot in the same
+	evaluation reuse that, and the scope of a reference like TARGET is
+	resolved only once for all of the TARGET.x references.  The resolved
+	expression is still evaluated each time it is used.
+
+	A program never changes after it is built and keeps all of its per
+	evaluation state on the stack, so it may be evaluated by more than one
+	thread at a time.  It refers to nodes of the tree it was compiled
+	from, so it must be discarded when that tree is deleted or changed.
+*/
+class CompiledExpr
+{
+	public:
+		~CompiledExpr( );
+
+		/** Compile an operator expression.
+			@return The program, or NULL if the tree cannot be compiled.
+		*/
+		static CompiledExpr *Compile( const Operation *tree );
+
+		/** Evaluate the program, with the same result as evaluating the
+			tree it was compiled from.
+		*/
+		bool Evaluate( EvalState &state, Value &result ) const;
+
+		/// The number of instructions, for diagnostics
+		int Size( ) const { return (int)code.size( ); }
+		/// The number of attribute reference slots, for diagnostics
+		int NumSlots( ) const { return (int)slots.size( ); }
+
+	private:
+		enum OpCode {
+			LOAD_CONST,		// r[dst] = consts[arg]
+			LOAD_ATTR,		// r[dst] = value of slots[arg]
+			EVAL_TREE,		// r[dst] = trees[arg] evaluated by the tree walker
+			APPLY,			// r[dst] = op( r[a], r[b], r[c] )
+			AND_JUMP,		// if r[a] is false, r[dst] = false and pc = arg
+			OR_JUMP,		// if r[a] is true, r[dst] = true and pc = arg
+			ELSE_JUMP,		// if r[a] is false, pc = arg
+			THEN_JUMP,		// if r[a] is true, pc = arg
+			IF_RESULT		// if r[a] is not a boolean, r[dst] = r[a] ? r[dst] : r[dst]
+		};
+
+		struct Instruction {
+			unsigned char	code;		// OpCode
+			unsigned char	nargs;		// number of operands of APPLY
+			unsigned short	dst;
+			unsigned short	a, b, c;
+			int				arg;
+			Operation::OpKind	op;
+		};
+
+		struct Slot {
+			const AttributeReference *ref;
+			int	scope;		// slot of the scope expression, or -1
+		};
+
+		struct SlotState;
+		struct Frame;
+
+		CompiledExpr( );
+
+		bool compile( const ExprTree *tree, int dst, int next );
+		int  addSlot( const AttributeReference *ref );
+		int  emit( OpCode code, int dst, int arg = 0 );
+		int  allocRegister( int reg );
+
+		int  resolve( SlotState *frame, int slot, EvalState &state ) const;
+		bool loadSlot( SlotState *frame, int slot, EvalState &state, Value &val ) const;
+
+		std::vector<Instruction>		code;
+		std::vector<Value>				consts;
+		std::vector<Slot>				slots;
+		std::vector<const ExprTree *>	trees;
+		int								num_registers;
+};
+
+} // classad
+
+#endif//__CLASSAD_COMPILED_EXPR_H__
@@ -25,6 +25,8 @@
 
 namespace classad {
 
+class CompiledExpr;
+
 /** Represents a node of the expression tree which is an operation applied to
 	expression operands, like 3 + 2
 */
@@ -195,15 +197,30 @@ class Operation : public ExprTree
 #if defined(SCOPE_REFACTOR)
 		virtual const ClassAd *GetParentScope( ) const { return( parentScope ); }
 #endif
+
+		/** Compile the expression to bytecode, later evaluations use the
+			compiled form.  The expression must not be changed while it is
+			compiled.  Copies of the expression are not compiled.
+			@return true if the expression is compiled
+			@see CompiledExpr
+		*/
+		bool Compile( );
+
+		/// Discard the compiled form of the expression, if any.
+		void Decompile( );
+
+		/// Does the expression have a compiled form
+		bool IsCompiled( ) const { return compiled != NULL; }
+
 	protected:
 		/// Constructor
 #ifdef TJ_REFACTOR
 		Operation ();
 #else
 #if defined(SCOPE_REFACTOR)
-		Operation() : parentScope(NULL) {};
+		Operation() : parentScope(NULL), compiled(NULL) {};
 #else
-		Operation() {};
+		Operation() : compiled(NULL) {};
 #endif
 #endif
 
@@ -253,6 +270,9 @@ class Operation : public ExprTree
 #if defined(SCOPE_REFACTOR)
 		const ClassAd *parentScope;
 #endif
+		CompiledExpr *compiled;
+		friend class CompiledExpr;
+
 		// operation specific information
 #ifdef TJ_REFACTOR
 		OpKind		operation;
@@ -0,0 +1,306 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+// Micro-benchmark of matchmaking with the tree walker against compiled
+// (bytecode) Requirements and Rank.
+//
+// The job and machine ads are read from files in the long form printed by
+// condor_q -l and condor_status -l, so that the benchmark can be run on the
+// ads of a real pool.  Without files a small built in pool is used.  Every
+// job is matched against every machine, first with the tree walker and then
+// with compiled expressions, the results are checked to be the same, and
+// the time per match is reported.
+
+#include "classad/classad_distribution.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace classad;
+
+static void
+usage( const char *self )
+{
+	fprintf( stderr, "usage: %s [-iterations N] [-strict] [job-ads-file machine-ads-file]\n"
+		"  job-ads-file      ads in the form printed by condor_q -l\n"
+		"  machine-ads-file  ads in the form printed by condor_status -l\n"
+		"  -iterations N     times to evaluate each job/machine pair (default 100)\n"
+		"  -strict           use strict (new) ClassAd evaluation semantics\n", self );
+	exit( 1 );
+}
+
+	// read ads in long form: one attribute = value per line, and a blank
+	// line (or a line of dashes) between ads.
+static bool
+readAds( const char *filename, vector<ClassAd*> &ads )
+{
+	FILE *fp = fopen( filename, "r" );
+	if( !fp ) {
+		fprintf( stderr, "cannot open %s\n", filename );
+		return false;
+	}
+
+	ClassAdParser parser;
+	ClassAd *ad = NULL;
+	char line[64 * 1024];
+	while( fgets( line, sizeof(line), fp ) ) {
+		string str( line );
+		while( !str.empty() && ( str[str.size()-1] == '\n' || str[str.size()-1] == '\r' ) ) {
+			str.erase( str.size() - 1 );
+		}
+		size_t eq = str.find( '=' );
+		if( str.empty() || str[0] == '-' || eq == string::npos ) {
+			if( ad ) {
+				ads.push_back( ad );
+				ad = NULL;
+			}
+			continue;
+		}
+
+		string name = str.substr( 0, eq );
+		while( !name.empty() && name[name.size()-1] == ' ' ) {
+			name.erase( name.size() - 1 );
+		}
+		ExprTree *expr = parser.ParseExpression( str.substr( eq + 1 ) );
+		if( !expr ) {
+			fprintf( stderr, "%s: cannot parse: %s\n", filename, str.c_str() );
+			continue;
+		}
+		if( !ad ) {
+			ad = new ClassAd();
+		}
+		ad->Insert( name, expr );
+	}
+	if( ad ) {
+		ads.push_back( ad );
+	}
+	fclose( fp );
+	return true;
+}
+
+	// a small pool, made of the kinds of ads found in most pools.
+static void
+makeAds( vector<ClassAd*> &jobs, vector<ClassAd*> &machines )
+{
+	static const char * const arch[] = { "X86_64", "X86_64", "X86_64", "INTEL" };
+	static const char * const opsys[] = { "LINUX", "LINUX", "LINUX", "WINDOWS" };
+	ClassAdParser parser;
+	char buf[4096];
+
+	for( int ii = 0; ii < 400; ii++ ) {
+		snprintf( buf, sizeof(buf),
+			"[ MyType = \"Machine\"; Name = \"slot%d@exec%03d.example.org\";"
+			" Machine = \"exec%03d.example.org\"; Arch = \"%s\"; OpSys = \"%s\";"
+			" OpSysAndVer = \"%s7\"; Memory = %d; Disk = %d; Cpus = %d;"
+			" KFlops = %d; Mips = %d; LoadAvg = %g; KeyboardIdle = %d;"
+			" State = \"%s\"; Activity = \"Idle\"; HasFileTransfer = true;"
+			" HasJava = %s; FileSystemDomain = \"example.org\";"
+			" TotalSlots = 8; SlotType = \"Static\"; Department = \"%s\";"
+			" Start = KeyboardIdle > 15 * 60 && (LoadAvg - CondorLoadAvg) <= 0.3;"
+			" CondorLoadAvg = 0.0;"
+			" Requirements = START && (TARGET.RequestMemory <= Memory || TARGET.RequestMemory =?= undefined);"
+			" Rank = TARGET.Department =?= Department ? 10 : 0 ]",
+			ii % 8 + 1, ii / 8, ii / 8, arch[ii % 4], opsys[ii % 4], opsys[ii % 4],
+			1024 * ( 1 + ii % 16 ), 100000 * ( 1 + ii % 7 ), 1 + ii % 2,
+			1500000 + ii * 17, 20000 + ii * 3, ( ii % 10 ) * 0.1, 900 + 60 * ( ii % 30 ),
+			ii % 5 ? "Unclaimed" : "Claimed", ii % 3 ? "true" : "false",
+			ii % 2 ? "physics" : "chemistry" );
+		machines.push_back( parser.ParseClassAd( buf, true ) );
+	}
+
+	for( int ii = 0; ii < 50; ii++ ) {
+		snprintf( buf, sizeof(buf),
+			"[ MyType = \"Job\"; ClusterId = %d; ProcId = 0; Owner = \"user%d\";"
+			" RequestMemory = %d; RequestDisk = %d; RequestCpus = 1;"
+			" ImageSize = %d; DiskUsage = %d; JobUniverse = %d;"
+			" Department = \"%s\"; ShouldTransferFiles = \"YES\";"
+			" Requirements = (TARGET.Arch == \"X86_64\") && (TARGET.OpSys == \"LINUX\")"
+			" && (TARGET.Disk >= RequestDisk) && (TARGET.Memory >= RequestMemory)"
+			" && (TARGET.Cpus >= RequestCpus)"
+			" && ((TARGET.FileSystemDomain == MY.FileSystemDomain) || (TARGET.HasFileTransfer))%s;"
+			" FileSystemDomain = \"example.org\";"
+			" Rank = %s ]",
+			100 + ii, ii % 7, 512 * ( 1 + ii % 24 ), 50000 * ( 1 + ii % 9 ),
+			300000 + ii * 1000, 4000 + ii, ii % 6 ? 5 : 10,
+			ii % 2 ? "chemistry" : "physics",
+			ii % 6 ? "" : " && (TARGET.HasJava =?= true)",
+			ii % 3 ? "TARGET.KFlops / 1000 + (TARGET.Memory > 8192 ? 100 : 0)" : "TARGET.Mips" );
+		jobs.push_back( parser.ParseClassAd( buf, true ) );
+	}
+}
+
+static string
+unparse( const Value &val )
+{
+	ClassAdUnParser unparser;
+	string str;
+	unparser.Unparse( str, val );
+	return str;
+}
+
+	// match every job against every machine, iterations times per pair.
+	// returns the cpu seconds spent evaluating, and the results.
+static double
+matchAll( const vector<ClassAd*> &jobs, const vector<ClassAd*> &machines,
+	int iterations, vector<string> &results, int &matches )
+{
+	MatchClassAd mad;
+	double elapsed = 0;
+
+	results.clear();
+	matches = 0;
+	for( size_t jj = 0; jj < jobs.size(); jj++ ) {
+		mad.ReplaceLeftAd( jobs[jj] );
+		for( size_t mm = 0; mm < machines.size(); mm++ ) {
+			mad.ReplaceRightAd( machines[mm] );
+
+			bool matched = false;
+			Value rank;
+			clock_t start = clock();
+			for( int ii = 0; ii < iterations; ii++ ) {
+				matched = mad.symmetricMatch();
+				if( matched ) {
+					jobs[jj]->EvaluateAttr( ATTR_RANK, rank );
+				}
+			}
+			elapsed += (double)( clock() - start ) / CLOCKS_PER_SEC;
+
+			if( matched ) {
+				matches++;
+				results.push_back( unparse( rank ) );
+			} else {
+				results.push_back( "no match" );
+			}
+			mad.RemoveRightAd();
+		}
+		mad.RemoveLeftAd();
+	}
+	return elapsed;
+}
+
+static void
+compileAds( const vector<ClassAd*> &ads, bool compile, int &size )
+{
+	size = 0;
+	for( size_t ii = 0; ii < ads.size(); ii++ ) {
+		ExprTree *reqs = ads[ii]->Lookup( ATTR_REQUIREMENTS );
+		ExprTree *rank = ads[ii]->Lookup( ATTR_RANK );
+		if( compile ) {
+			CompileExpr( reqs );
+			CompileExpr( rank );
+		} else {
+			DecompileExpr( reqs );
+			DecompileExpr( rank );
+		}
+		if( reqs && reqs->GetKind() == ExprTree::OP_NODE && ((Operation*)reqs)->IsCompiled() ) {
+			size++;
+		}
+	}
+}
+
+int
+main( int argc, char **argv )
+{
+	int iterations = 100;
+	bool strict = false;
+	const char *job_file = NULL;
+	const char *machine_file = NULL;
+
+	for( int ii = 1; ii < argc; ii++ ) {
+		if( strcmp( argv[ii], "-iterations" ) == 0 && ii + 1 < argc ) {
+			iterations = atoi( argv[++ii] );
+		} else if( strcmp( argv[ii], "-strict" ) == 0 ) {
+			strict = true;
+		} else if( argv[ii][0] == '-' ) {
+			usage( argv[0] );
+		} else if( !job_file ) {
+			job_file = argv[ii];
+		} else if( !machine_file ) {
+			machine_file = argv[ii];
+		} else {
+			usage( argv[0] );
+		}
+	}
+	if( iterations < 1 || ( job_file && !machine_file ) ) {
+		usage( argv[0] );
+	}
+
+		// Condor uses the old semantics unless STRICT_CLASSAD_EVALUATION
+	SetOldClassAdSemantics( !strict );
+
+	vector<ClassAd*> jobs, machines;
+	if( job_file ) {
+		if( !readAds( job_file, jobs ) || !readAds( machine_file, machines ) ) {
+			return 1;
+		}
+	} else {
+		makeAds( jobs, machines );
+	}
+
+		// prepare the ads the way the negotiator does
+	string error;
+	for( size_t ii = 0; ii < jobs.size(); ii++ ) {
+		MatchClassAd::OptimizeLeftAdForMatchmaking( jobs[ii], &error );
+	}
+	for( size_t ii = 0; ii < machines.size(); ii++ ) {
+		MatchClassAd::OptimizeRightAdForMatchmaking( machines[ii], &error );
+	}
+
+	int compiled_jobs, compiled_machines;
+	compileAds( jobs, false, compiled_jobs );
+	compileAds( machines, false, compiled_machines );
+
+	vector<string> tree_results, compiled_results;
+	int tree_matches, compiled_matches;
+	double tree_time = matchAll( jobs, machines, iterations, tree_results, tree_matches );
+
+	compileAds( jobs, true, compiled_jobs );
+	compileAds( machines, true, compiled_machines );
+	double compiled_time = matchAll( jobs, machines, iterations, compiled_results, compiled_matches );
+
+	size_t mismatches = 0;
+	for( size_t ii = 0; ii < tree_results.size(); ii++ ) {
+		if( tree_results[ii] != compiled_results[ii] ) {
+			mismatches++;
+		}
+	}
+
+	double evals = (double)jobs.size() * machines.size() * iterations;
+	printf( "%d jobs (%d compiled), %d machines (%d compiled), %d matches, %d iterations\n",
+		(int)jobs.size(), compiled_jobs, (int)machines.size(), compiled_machines,
+		tree_matches, iterations );
+	printf( "tree walk: %.3f s, %.1f ns per match\n", tree_time, tree_time * 1e9 / evals );
+	printf( "compiled:  %.3f s, %.1f ns per match\n", compiled_time, compiled_time * 1e9 / evals );
+	if( compiled_time > 0 ) {
+		printf( "speedup:   %.2f\n", tree_time / compiled_time );
+	}
+	if( mismatches || tree_matches != compiled_matches ) {
+		printf( "ERROR: %d of %d results differ\n", (int)mismatches, (int)tree_results.size() );
+	}
+
+	for( size_t ii = 0; ii < jobs.size(); ii++ ) { delete jobs[ii]; }
+	for( size_t ii = 0; ii < machines.size(); ii++ ) { delete machines[ii]; }
+
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,512 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "classad/common.h"
+#include "classad/classad.h"
+#include "classad/classadCache.h"
+#include "classad/compiledExpr.h"
+
+#include <new>
+#include <string.h>
+
+using namespace std;
+
+namespace classad {
+
+static bool doExpressionCompiling = false;
+
+void ClassAdSetExpressionCompiling(bool do_compiling)
+{
+	doExpressionCompiling = do_compiling;
+}
+
+bool ClassAdGetExpressionCompiling()
+{
+	return doExpressionCompiling;
+}
+
+static Operation *
+compilableOperation( ExprTree *tree )
+{
+	if( tree && tree->GetKind( ) == ExprTree::EXPR_ENVELOPE ) {
+		tree = ((CachedExprEnvelope*)tree)->get( );
+	}
+	if( !tree || tree->GetKind( ) != ExprTree::OP_NODE ) {
+		return NULL;
+	}
+	return (Operation*)tree;
+}
+
+bool
+CompileExpr( ExprTree *tree )
+{
+	Operation *op = compilableOperation( tree );
+	return op ? op->Compile( ) : false;
+}
+
+void
+DecompileExpr( ExprTree *tree )
+{
+	Operation *op = compilableOperation( tree );
+	if( op ) {
+		op->Decompile( );
+	}
+}
+
+	// register numbers are stored in 16 bits
+static const int MAX_REGISTERS = 0xFFFF;
+
+	// a frame this size fits on the stack, larger ones go on the heap
+static const int LOCAL_REGISTERS = 32;
+static const int LOCAL_SLOTS = 64;
+
+struct CompiledExpr::SlotState {
+	bool			resolved;	// rc, tree and scope are valid
+	bool			is_scope;	// ad is the value of this reference
+	int				rc;			// EVAL_OK, EVAL_UNDEF, EVAL_ERROR or EVAL_FAIL
+	ExprTree		*tree;
+	const ClassAd	*scope;
+	const ClassAd	*ad;
+};
+
+CompiledExpr::
+CompiledExpr( ) : num_registers( 0 )
+{
+}
+
+CompiledExpr::
+~CompiledExpr( )
+{
+}
+
+CompiledExpr *CompiledExpr::
+Compile( const Operation *tree )
+{
+	if( !tree ) {
+		return NULL;
+	}
+	CompiledExpr *prog = new CompiledExpr( );
+		// if all there is to do is hand the whole tree to the tree walker,
+		// there is nothing to gain (and evaluating would recurse forever).
+	if( !prog->compile( tree, 0, 1 ) ||
+		( prog->code.size( ) == 1 && prog->code[0].code == EVAL_TREE ) )
+	{
+		delete prog;
+		return NULL;
+	}
+	return prog;
+}
+
+int CompiledExpr::
+allocRegister( int reg )
+{
+	if( reg >= MAX_REGISTERS ) {
+		return -1;
+	}
+	if( reg >= num_registers ) {
+		num_registers = reg + 1;
+	}
+	return reg;
+}
+
+int CompiledExpr::
+emit( OpCode opcode, int dst, int arg )
+{
+	Instruction ins;
+	ins.code = (unsigned char)opcode;
+	ins.nargs = 0;
+	ins.dst = (unsigned short)dst;
+	ins.a = ins.b = ins.c = 0;
+	ins.arg = arg;
+	ins.op = Operation::__NO_OP__;
+	code.push_back( ins );
+	return (int)code.size( ) - 1;
+}
+
+	// returns the slot for an attribute reference, references that are
+	// the same share a slot.
+int CompiledExpr::
+addSlot( const AttributeReference *ref )
+{
+	for( size_t i = 0; i < slots.size( ); i++ ) {
+		if( slots[i].ref->SameAs( ref ) ) {
+			return (int)i;
+		}
+	}
+
+		// when the reference is expr.attr, and expr is itself a reference,
+		// the scope that expr names gets a slot of its own, so that it is
+		// only resolved once no matter how many attributes are looked up
+		// in it.
+	int scope = -1;
+	if( ref->expr && ref->expr->GetKind( ) == ExprTree::ATTRREF_NODE ) {
+		scope = addSlot( (const AttributeReference*)ref->expr );
+	}
+
+	Slot slot;
+	slot.ref = ref;
+	slot.scope = scope;
+	slots.push_back( slot );
+	return (int)slots.size( ) - 1;
+}
+
+	// emit code to evaluate tree into register dst.  registers from next
+	// on are free for temporary values.
+bool CompiledExpr::
+compile( const ExprTree *tree, int dst, int next )
+{
+	if( allocRegister( dst ) < 0 ) {
+		return false;
+	}
+
+	switch( tree->GetKind( ) ) {
+	case ExprTree::LITERAL_NODE: {
+			// literals don't look at the state, so we can evaluate them
+			// once, here.
+		EvalState state;
+		Value val;
+		if( !tree->Evaluate( state, val ) ) {
+			break;
+		}
+		consts.push_back( val );
+		emit( LOAD_CONST, dst, (int)consts.size( ) - 1 );
+		return true;
+	}
+
+	case ExprTree::ATTRREF_NODE:
+		emit( LOAD_ATTR, dst, addSlot( (const AttributeReference*)tree ) );
+		return true;
+
+	case ExprTree::OP_NODE: {
+		Operation::OpKind op;
+		ExprTree *c1 = NULL, *c2 = NULL, *c3 = NULL;
+		((const Operation*)tree)->GetComponents( op, c1, c2, c3 );
+		if( !c1 ) {
+			break;
+		}
+
+		if( op == Operation::PARENTHESES_OP ) {
+			return compile( c1, dst, next );
+		}
+
+		if( op == Operation::TERNARY_OP ) {
+				// the a ?: b form evaluates its condition twice, leave it
+				// to the tree walker.
+			if( !c2 || !c3 ) {
+				break;
+			}
+			int cond = allocRegister( next );
+			if( cond < 0 || !compile( c1, cond, cond + 1 ) ) {
+				return false;
+			}
+			int else_jump = emit( ELSE_JUMP, dst );
+			code[else_jump].a = (unsigned short)cond;
+			if( !compile( c2, dst, cond + 1 ) ) {
+				return false;
+			}
+			int then_jump = emit( THEN_JUMP, dst );
+			code[then_jump].a = (unsigned short)cond;
+			code[else_jump].arg = (int)code.size( );
+				// if the condition is not a boolean, both branches are
+				// evaluated, but the result depends only on the condition.
+			if( !compile( c3, dst, cond + 1 ) ) {
+				return false;
+			}
+			int result = emit( IF_RESULT, dst );
+			code[result].a = (unsigned short)cond;
+			code[then_jump].arg = (int)code.size( );
+			return true;
+		}
+
+		int nargs = c3 ? 3 : ( c2 ? 2 : 1 );
+		int a = allocRegister( next );
+		if( a < 0 || !compile( c1, a, a + 1 ) ) {
+			return false;
+		}
+
+		int jump = -1;
+		if( op == Operation::LOGICAL_AND_OP || op == Operation::LOGICAL_OR_OP ) {
+			jump = emit( op == Operation::LOGICAL_AND_OP ? AND_JUMP : OR_JUMP, dst );
+			code[jump].a = (unsigned short)a;
+		}
+
+		int b = a, c = a;
+		if( nargs >= 2 ) {
+			b = allocRegister( a + 1 );
+			if( b < 0 || !compile( c2, b, b + 1 ) ) {
+				return false;
+			}
+		}
+		if( nargs >= 3 ) {
+			c = allocRegister( b + 1 );
+			if( c < 0 || !compile( c3, c, c + 1 ) ) {
+				return false;
+			}
+		}
+
+		int apply = emit( APPLY, dst );
+		code[apply].op = op;
+		code[apply].nargs = (unsigned char)nargs;
+		code[apply].a = (unsigned short)a;
+		code[apply].b = (unsigned short)b;
+		code[apply].c = (unsigned short)c;
+		if( jump >= 0 ) {
+			code[jump].arg = (int)code.size( );
+		}
+		return true;
+	}
+
+	default:
+		break;
+	}
+
+		// anything else is evaluated by the tree walker
+	trees.push_back( tree );
+	emit( EVAL_TREE, dst, (int)trees.size( ) - 1 );
+	return true;
+}
+
+	// resolve a slot to the expression and scope that it refers to, the
+	// same way as AttributeReference::FindExpr.
+int CompiledExpr::
+resolve( SlotState *frame, int slot, EvalState &state ) const
+{
+	SlotState &ss = frame[slot];
+	if( ss.resolved ) {
+		return ss.rc;
+	}
+
+	const AttributeReference *ref = slots[slot].ref;
+	const ClassAd *curAd = state.curAd;
+	ExprTree *tree = NULL;
+	int scope = slots[slot].scope;
+	int rc;
+
+	if( scope < 0 ) {
+		ExprTree *sig = NULL;
+		rc = ref->FindExpr( state, tree, sig, false );
+	} else {
+		SlotState &ss_scope = frame[scope];
+		if( !ss_scope.is_scope ) {
+			Value val;
+			if( !loadSlot( frame, scope, state, val ) ) {
+				rc = ExprTree::EVAL_FAIL;
+			} else if( val.IsUndefinedValue( ) ) {
+				rc = ExprTree::EVAL_UNDEF;
+			} else if( val.IsErrorValue( ) ) {
+				rc = ExprTree::EVAL_ERROR;
+			} else if( val.IsClassAdValue( ss_scope.ad ) ) {
+				ss_scope.is_scope = true;
+				rc = ExprTree::EVAL_OK;
+			} else if( val.IsListValue( ) ) {
+					// rare, let the reference deal with it
+				ExprTree *sig = NULL;
+				rc = ref->FindExpr( state, tree, sig, false );
+				scope = -1;
+			} else {
+				rc = ExprTree::EVAL_ERROR;
+			}
+		} else {
+			rc = ExprTree::EVAL_OK;
+		}
+
+		if( scope >= 0 && rc == ExprTree::EVAL_OK ) {
+			if( !ss_scope.ad ) {
+				rc = ExprTree::EVAL_UNDEF;
+			} else {
+				rc = ss_scope.ad->LookupInScope( ref->attributeStr, tree, state );
+			}
+		}
+	}
+
+	ss.resolved = true;
+	ss.rc = rc;
+	ss.tree = tree;
+	ss.scope = state.curAd;
+	state.curAd = curAd;
+	return rc;
+}
+
+	// evaluate the reference in a slot, the same way as
+	// AttributeReference::_Evaluate
+bool CompiledExpr::
+loadSlot( SlotState *frame, int slot, EvalState &state, Value &val ) const
+{
+	switch( resolve( frame, slot, state ) ) {
+		case ExprTree::EVAL_FAIL:
+			return false;
+
+		case ExprTree::EVAL_ERROR:
+			val.SetErrorValue( );
+			return true;
+
+		case ExprTree::EVAL_UNDEF:
+			val.SetUndefinedValue( );
+			return true;
+
+		case ExprTree::EVAL_OK:
+		{
+			if( state.depth_remaining <= 0 ) {
+				val.SetErrorValue( );
+				return false;
+			}
+			const ClassAd *curAd = state.curAd;
+			state.depth_remaining--;
+			state.curAd = frame[slot].scope;
+
+			bool rval = frame[slot].tree->Evaluate( state, val );
+
+			state.depth_remaining++;
+			state.curAd = curAd;
+			return rval;
+		}
+		default:  CLASSAD_EXCEPT( "ClassAd:  Should not reach here" );
+	}
+	return false;
+}
+
+	// the registers and slot states for one evaluation
+struct CompiledExpr::Frame {
+	Frame( int nregs, int nslots ) : regs( NULL ), slots( NULL ),
+		num_regs( nregs ), heap_regs( nregs > LOCAL_REGISTERS ),
+		heap_slots( nslots > LOCAL_SLOTS )
+	{
+		regs = heap_regs ? (Value*)::operator new( nregs * sizeof(Value) )
+			: (Value*)local_regs.buf;
+		for( int i = 0; i < nregs; i++ ) {
+			new( &regs[i] ) Value( );
+		}
+		slots = heap_slots ? new SlotState[nslots] : local_slots;
+		memset( slots, 0, nslots * sizeof(SlotState) );
+	}
+	~Frame( )
+	{
+		for( int i = 0; i < num_regs; i++ ) {
+			regs[i].~Value( );
+		}
+		if( heap_regs ) { ::operator delete( regs ); }
+		if( heap_slots ) { delete [] slots; }
+	}
+
+	Value		*regs;
+	SlotState	*slots;
+
+		// the registers are constructed in place, so that only as many
+		// as the program uses are constructed.
+	union {
+		double		align_d;
+		long long	align_ll;
+		void		*align_p;
+		char		buf[LOCAL_REGISTERS * sizeof(Value)];
+	} local_regs;
+	SlotState	local_slots[LOCAL_SLOTS];
+	int			num_regs;
+	bool		heap_regs;
+	bool		heap_slots;
+};
+
+bool CompiledExpr::
+Evaluate( EvalState &state, Value &result ) const
+{
+	Frame frame( num_registers, (int)slots.size( ) );
+	Value *r = frame.regs;
+	SlotState *ss = frame.slots;
+	Value none;
+	bool b;
+
+	size_t pc = 0;
+	while( pc < code.size( ) ) {
+		const Instruction &ins = code[pc++];
+		switch( ins.code ) {
+		case LOAD_CONST:
+			r[ins.dst].CopyFrom( consts[ins.arg] );
+			break;
+
+		case LOAD_ATTR:
+			if( !loadSlot( ss, ins.arg, state, r[ins.dst] ) ) {
+				result.SetErrorValue( );
+				return false;
+			}
+			break;
+
+		case EVAL_TREE:
+			if( !trees[ins.arg]->Evaluate( state, r[ins.dst] ) ) {
+				result.SetErrorValue( );
+				return false;
+			}
+			break;
+
+		case APPLY:
+			if( ins.nargs == 1 ) {
+				Value v2, v3;
+				Operation::_doOperation( ins.op, r[ins.a], v2, v3,
+					true, false, false, r[ins.dst], &state );
+			} else if( ins.nargs == 2 ) {
+				Operation::_doOperation( ins.op, r[ins.a], r[ins.b], none,
+					true, true, false, r[ins.dst], &state );
+			} else {
+				Operation::_doOperation( ins.op, r[ins.a], r[ins.b], r[ins.c],
+					true, true, true, r[ins.dst], &state );
+			}
+			break;
+
+		case AND_JUMP:
+			if( r[ins.a].IsBooleanValueEquiv( b ) && !b ) {
+				r[ins.dst].SetBooleanValue( false );
+				pc = ins.arg;
+			}
+			break;
+
+		case OR_JUMP:
+			if( r[ins.a].IsBooleanValueEquiv( b ) && b ) {
+				r[ins.dst].SetBooleanValue( true );
+				pc = ins.arg;
+			}
+			break;
+
+		case ELSE_JUMP:
+			if( r[ins.a].IsBooleanValueEquiv( b ) && !b ) {
+				pc = ins.arg;
+			}
+			break;
+
+		case THEN_JUMP:
+			if( r[ins.a].IsBooleanValueEquiv( b ) && b ) {
+				pc = ins.arg;
+			}
+			break;
+
+		case IF_RESULT:
+			if( !r[ins.a].IsBooleanValueEquiv( b ) ) {
+				Value val;
+				Operation::_doOperation( Operation::TERNARY_OP, r[ins.a],
+					r[ins.dst], r[ins.dst], true, true, true, val, &state );
+				r[ins.dst].CopyFrom( val );
+			}
+			break;
+
+		default:  CLASSAD_EXCEPT( "ClassAd:  Bad compiled instruction" );
+		}
+	}
+
+	result.CopyFrom( r[0] );
+	return true;
+}
+
+} // classad
@@ -55,6 +55,14 @@
 #include <dlfcn.h>
 #endif
 
+#if defined USE_POSIX_REGEX || defined USE_PCRE
+  #ifndef WIN32
+    #include <pthread.h>
+  #endif
+  #include <list>
+  #include <map>
+#endif
+
 using namespace std;
 
 namespace classad {
@@ -2820,6 +2828,184 @@ matchPatternMember( const char*,const ArgumentList &argList,EvalState &state,
     return true;
 }
 
+// A compiled pattern.  It is shared between the cache and the evaluations
+// that are using it, so it stays valid if it is evicted while in use.
+struct CompiledRegex {
+	CompiledRegex() : ok(false)
+#if defined (USE_PCRE)
+		, re(NULL), extra(NULL), group_count(0)
+#endif
+	{ }
+	~CompiledRegex() {
+#if defined (USE_POSIX_REGEX)
+		if( ok ) { regfree( &re ); }
+#elif defined (USE_PCRE)
+#ifdef PCRE_CONFIG_JIT
+		if( extra ) { pcre_free_study( extra ); }
+#else
+		if( extra ) { pcre_free( extra ); }
+#endif
+		if( re ) { pcre_free( re ); }
+#endif
+	}
+
+	bool		ok;		// false if the pattern did not compile
+#if defined (USE_POSIX_REGEX)
+	regex_t		re;
+#elif defined (USE_PCRE)
+	pcre		*re;
+	pcre_extra	*extra;
+	int			group_count;
+#endif
+
+private:
+	CompiledRegex(const CompiledRegex &);
+	CompiledRegex &operator=(const CompiledRegex &);
+};
+typedef classad_shared_ptr<CompiledRegex> CompiledRegexPtr;
+
+// A cache of the most recently used compiled patterns, keyed on the
+// pattern and the compile options.  Patterns that fail to compile are
+// cached too, so a bad pattern is not compiled on every evaluation.
+// Expressions may be evaluated on more than one thread, so the cache is
+// protected by a mutex, which is never held while a pattern is compiled.
+class RegexCache {
+public:
+	RegexCache() : max_entries(100), hits(0), misses(0) {
+#ifdef WIN32
+		InitializeCriticalSection(&mutex);
+#else
+		pthread_mutex_init(&mutex, NULL);
+#endif
+	}
+
+	CompiledRegexPtr get(const char *pattern, int options);
+	void setMaxEntries(int max);
+	void getStats(unsigned long &num_hits, unsigned long &num_misses, int &num_entries);
+
+private:
+	typedef std::list< std::pair<std::string, CompiledRegexPtr> > LruList;
+
+	void lock() {
+#ifdef WIN32
+		EnterCriticalSection(&mutex);
+#else
+		pthread_mutex_lock(&mutex);
+#endif
+	}
+	void unlock() {
+#ifdef WIN32
+		LeaveCriticalSection(&mutex);
+#else
+		pthread_mutex_unlock(&mutex);
+#endif
+	}
+	void trim();
+
+	LruList lru;	// most recently used first
+	std::map<std::string, LruList::iterator> index;
+	size_t max_entries;
+	unsigned long hits;
+	unsigned long misses;
+#ifdef WIN32
+	CRITICAL_SECTION mutex;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+static RegexCache regex_cache;
+
+static CompiledRegexPtr
+compile_regex(const char *pattern, int options)
+{
+	CompiledRegexPtr cre(new CompiledRegex());
+#if defined (USE_POSIX_REGEX)
+	cre->ok = ( regcomp( &cre->re, pattern, options ) == 0 );
+#elif defined (USE_PCRE)
+	const char *error_message = NULL;
+	int error_offset;
+	cre->re = pcre_compile( pattern, options, &error_message, &error_offset, NULL );
+	if( cre->re ) {
+			// the pattern will be used many times, so it is worth studying
+		cre->extra = pcre_study( cre->re, 0, &error_message );
+		pcre_fullinfo( cre->re, cre->extra, PCRE_INFO_CAPTURECOUNT, &cre->group_count );
+		cre->ok = true;
+	}
+#endif
+	return cre;
+}
+
+CompiledRegexPtr RegexCache::
+get(const char *pattern, int options)
+{
+	char buf[32];
+	snprintf( buf, sizeof(buf), "%d:", options );
+	std::string key( buf );
+	key += pattern;
+
+	lock();
+	std::map<std::string, LruList::iterator>::iterator it = index.find( key );
+	if( it != index.end() ) {
+		lru.splice( lru.begin(), lru, it->second );
+		CompiledRegexPtr cre = it->second->second;
+		hits++;
+		unlock();
+		return cre;
+	}
+	misses++;
+	unlock();
+
+	CompiledRegexPtr cre = compile_regex( pattern, options );
+
+	lock();
+	if( max_entries > 0 && index.find( key ) == index.end() ) {
+		lru.push_front( std::make_pair( key, cre ) );
+		index[key] = lru.begin();
+		trim();
+	}
+	unlock();
+	return cre;
+}
+
+void RegexCache::
+trim()
+{
+	while( lru.size() > max_entries ) {
+		index.erase( lru.back().first );
+		lru.pop_back();
+	}
+}
+
+void RegexCache::
+setMaxEntries(int max)
+{
+	lock();
+	max_entries = max > 0 ? max : 0;
+	trim();
+	unlock();
+}
+
+void RegexCache::
+getStats(unsigned long &num_hits, unsigned long &num_misses, int &num_entries)
+{
+	lock();
+	num_hits = hits;
+	num_misses = misses;
+	num_entries = (int)lru.size();
+	unlock();
+}
+
+void ClassAdSetRegexCacheSize(int max_entries)
+{
+	regex_cache.setMaxEntries( max_entries );
+}
+
+void ClassAdGetRegexCacheStats(unsigned long &hits, unsigned long &misses, int &entries)
+{
+	regex_cache.getStats( hits, misses, entries );
+}
+
 static bool regexp_helper(
     const char *pattern,
     const char *target,
@@ -2832,8 +3018,6 @@ static bool regexp_helper(
 	int			status;
 
 #if defined (USE_POSIX_REGEX)
-	regex_t		re;
-
 	const int MAX_REGEX_GROUPS=11;
 	regmatch_t pmatch[MAX_REGEX_GROUPS];
 	size_t      nmatch = MAX_REGEX_GROUPS;
@@ -2851,18 +3035,16 @@ static bool regexp_helper(
         }
     }
 
-		// compile the patern
-	if( regcomp( &re, pattern, options ) != 0 ) {
+		// compile the patern, or find it in the cache
+	CompiledRegexPtr cre = regex_cache.get( pattern, options );
+	if( !cre->ok ) {
 			// error in pattern
 		result.SetErrorValue( );
 		return( true );
 	}
 
 		// test the match
-	status = regexec( &re, target, nmatch, pmatch, 0 );
-
-		// dispose memory created by regcomp()
-	regfree( &re );
+	status = regexec( &cre->re, target, nmatch, pmatch, 0 );
 
 	if( status == 0 && replace ) {
 		string group_buffers[MAX_REGEX_GROUPS];
@@ -2930,10 +3112,6 @@ static bool regexp_helper(
 		return( true );
 	}
 #elif defined (USE_PCRE)
-    const char  *error_message;
-    int         error_offset;
-    pcre        *re;
-
     options     = 0;
     if( have_options ){
         // We look for the options we understand, and ignore
@@ -2953,19 +3131,21 @@ static bool regexp_helper(
         }
     }
 
-    re = pcre_compile( pattern, options, &error_message,
-                      &error_offset, NULL );
-    if ( re == NULL ){
+	CompiledRegexPtr cre = regex_cache.get( pattern, options );
+    if ( !cre->ok ){
 			// error in pattern
 		result.SetErrorValue( );
     } else {
-		int group_count;
-		pcre_fullinfo(re, NULL, PCRE_INFO_CAPTURECOUNT, &group_count);
-		int oveccount = 3 * (group_count + 1); // +1 for the string itself
-		int * ovector = (int *) malloc(oveccount * sizeof(int));
-
+			// most patterns have only a few groups, so use the stack
+		const int LOCAL_OVECCOUNT = 3 * 16;
+		int local_ovector[LOCAL_OVECCOUNT];
+		int oveccount = 3 * (cre->group_count + 1); // +1 for the string itself
+		int * ovector = local_ovector;
+		if( oveccount > LOCAL_OVECCOUNT ) {
+			ovector = (int *) malloc(oveccount * sizeof(int));
+		}
 
-        status = pcre_exec(re, NULL, target, (int)strlen(target),
+        status = pcre_exec(cre->re, cre->extra, target, (int)strlen(target),
                            0, 0, ovector, oveccount);
         if (status >= 0) {
             result.SetBooleanValue( true );
@@ -2973,8 +3153,6 @@ static bool regexp_helper(
             result.SetBooleanValue( false );
         }
 
-		pcre_free(re);
-
 		if( replace && status<0 ) {
 			result.SetStringValue( "" );
 		}
@@ -3018,12 +3196,26 @@ static bool regexp_helper(
 			}
 		}
 
-		free( ovector );
+		if( ovector != local_ovector ) {
+			free( ovector );
+		}
     }
     return true;
 #endif
 }
 
+#else
+
+void ClassAdSetRegexCacheSize(int)
+{
+}
+
+void ClassAdGetRegexCacheStats(unsigned long &hits, unsigned long &misses, int &entries)
+{
+	hits = misses = 0;
+	entries = 0;
+}
+
 #endif /* defined USE_POSIX_REGEX || defined USE_PCRE */
 
 static bool 
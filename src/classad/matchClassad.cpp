@@ -21,6 +21,7 @@
 #include "classad/common.h"
 #include "classad/source.h"
 #include "classad/matchClassad.h"
+#include "classad/compiledExpr.h"
 
 using namespace std;
 
@@ -362,6 +363,13 @@ OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg )
 	ad->Delete("other"); 
 	ad->Delete("target");
 
+		// Requirements and Rank are evaluated against every candidate,
+		// so they are worth compiling.
+	if( ClassAdGetExpressionCompiling() ) {
+		CompileExpr( ad->Lookup(ATTR_REQUIREMENTS) );
+		CompileExpr( ad->Lookup(ATTR_RANK) );
+	}
+
 	return true;
 }
 
@@ -19,6 +19,7 @@
 
 #include "classad/common.h"
 #include "classad/operators.h"
+#include "classad/compiledExpr.h"
 #include "classad/sink.h"
 #include "classad/util.h"
 
@@ -33,6 +34,7 @@ Operation ()
 #if defined(SCOPE_REFACTOR)
 	parentScope = NULL;
 #endif
+	compiled  = NULL;
 	operation = __NO_OP__;
 	child1    = NULL;
 	child2    = NULL;
@@ -44,6 +46,7 @@ Operation ()
 Operation::
 Operation(const Operation &op)
 {
+	compiled = NULL;
     CopyFrom(op);
     return;
 }
@@ -52,6 +55,7 @@ Operation(const Operation &op)
 Operation::
 ~Operation ()
 {
+	Decompile();
 #ifdef TJ_REFACTOR
 	if( child1 ) delete child1;
 	if( child2 ) delete child2;
@@ -123,6 +127,7 @@ CopyFrom(const Operation &op)
 #if defined(SCOPE_REFACTOR)
 	parentScope = op.parentScope;
 #endif
+	Decompile();
 	if( op.child1 && (child1 = op.child1->Copy()) == NULL){
         success = false;
     } else if( op.child2 && (child2 = op.child2->Copy()) == NULL ){
@@ -586,9 +591,31 @@ _doOperation (OpKind op, Value &val1, Value &val2, Value &val3,
 	return SIG_NONE;
 }
 
+bool Operation::
+Compile( )
+{
+	if( !compiled ) {
+		compiled = CompiledExpr::Compile( this );
+	}
+	return compiled != NULL;
+}
+
+void Operation::
+Decompile( )
+{
+	if( compiled ) {
+		delete compiled;
+		compiled = NULL;
+	}
+}
+
 bool Operation::
 _Evaluate (EvalState &state, Value &result) const
 {
+	if( compiled && !state.debug ) {
+		return compiled->Evaluate( state, result );
+	}
+
 	Value	val1, val2, val3;
 	bool	valid1, valid2, valid3;
 	int		rval;
@@ -45,6 +45,7 @@
 #include "condor_threads.h"
 
 #include "collector.h"
+#include "collector_query_threads.h"
 
 #if defined(HAVE_DLOPEN) && !defined(DARWIN)
 #include "CollectorPlugin.h"
@@ -79,6 +80,7 @@ int CollectorDaemon::__resultLimit__;
 int CollectorDaemon::__failed__;
 List<ClassAd>* CollectorDaemon::__ClassAdResultList__;
 std::string CollectorDaemon::__adType__;
+AdTypes CollectorDaemon::__whichAds__;
 ExprTree *CollectorDaemon::__filter__;
 
 TrackTotals* CollectorDaemon::normalTotals = NULL;
@@ -116,6 +118,9 @@ int CollectorDaemon::max_pending_query_workers = 50;
 int CollectorDaemon::max_query_worktime = 0;
 int CollectorDaemon::active_query_workers = 0;
 int CollectorDaemon::pending_query_workers = 0;
+bool CollectorDaemon::use_query_threads = false;
+CollectorQueryThreads *CollectorDaemon::query_threads = NULL;
+int CollectorDaemon::next_query_thread_id = 0;
 
 #ifdef TRACK_QUERIES_BY_SUBSYS
 bool CollectorDaemon::want_track_queries_by_subsys = false;
@@ -269,6 +274,8 @@ void CollectorDaemon::Init()
 
 	daemonCore->Register_CommandWithPayload(UPDATE_STARTD_AD,"UPDATE_STARTD_AD",
 		(CommandHandler)receive_update,"receive_update",NULL,ADVERTISE_STARTD_PERM);
+	daemonCore->Register_CommandWithPayload(UPDATE_STARTD_ADS_BATCH,"UPDATE_STARTD_ADS_BATCH",
+		(CommandHandler)receive_startd_batch,"receive_startd_batch",NULL,ADVERTISE_STARTD_PERM);
 	daemonCore->Register_CommandWithPayload(MERGE_STARTD_AD,"MERGE_STARTD_AD",
 		(CommandHandler)receive_update,"receive_update",NULL,NEGOTIATOR);
 	daemonCore->Register_CommandWithPayload(UPDATE_SCHEDD_AD,"UPDATE_SCHEDD_AD",
@@ -475,7 +482,20 @@ int CollectorDaemon::receive_query_cedar(Service* /*s*/,
 		// We want to immediately handle the query inline in this process.
 		// So in this case, we simply directly invoke our worker thread function.
 		dprintf(D_FULLDEBUG,"QueryWorker: about to handle query in-process\n");
-		return_status = receive_query_cedar_worker_thread((void *)query_entry,sock);
+		if (use_query_threads) {
+			// query threads may be reading the same ads, so use the thread
+			// safe query code, but run it right here. the query entry, ad
+			// and socket are still owned by this function.
+			query_thread_context_t *ctx = begin_threaded_query(query_entry, sock);
+			threaded_query_work(ctx);
+			return_status = ctx->return_status;
+			ctx->entry = NULL;
+			ctx->cad = NULL;
+			ctx->sock = NULL;
+			end_threaded_query(ctx);
+		} else {
+			return_status = receive_query_cedar_worker_thread((void *)query_entry,sock);
+		}
 	} else {
 		// Enqueue the query to ultimately run in a forked process created created with
 		// DaemonCore::Create_Thread().  
@@ -574,7 +594,7 @@ int CollectorDaemon::QueryReaper(Service *, int pid, int /* exit_status */ )
 {
 	if ( pid >= 0 ) {
 		dprintf(D_FULLDEBUG,
-			"QueryWorker: Child %d done\n", pid);
+			"QueryWorker: %s %d done\n", use_query_threads ? "Thread" : "Child", pid);
 		if (active_query_workers > 0 ) {
 			active_query_workers--;
 		}
@@ -661,6 +681,31 @@ int CollectorDaemon::QueryReaper(Service *, int pid, int /* exit_status */ )
 	Stream *sock = query_entry->sock;
 	query_entry->sock = NULL;
 	ClassAd *query_classad = query_entry->cad;
+
+	if (use_query_threads) {
+		// hand the query to one of our query threads.  the thread will
+		// post it back to us when it is done, and then we will call
+		// this function again with the worker id as the pid.
+		query_thread_context_t *ctx = begin_threaded_query(query_entry, sock);
+		ctx->high_prio = high_prio_query;
+		ctx->worker_id = ++next_query_thread_id;
+		if ( ! query_threads || ! query_threads->submit(ctx)) {
+			dprintf(D_ALWAYS,
+					"ERROR: failed to hand query to a QueryWorker thread!\n");
+			end_threaded_query(ctx);
+			return -1;
+		}
+
+		active_query_workers++;
+		collectorStats.global.ActiveQueryWorkers = active_query_workers;
+
+		dprintf(D_ALWAYS,
+				"QueryWorker: started %sthread worker with id %d ( max %d active %d pending %d )\n",
+				high_prio_query ? "high priority " : "", ctx->worker_id,
+				max_query_workers, active_query_workers, pending_query_workers);
+		return 1;
+	}
+
 	int tid = daemonCore->
 		Create_Thread((ThreadStartFunc)&CollectorDaemon::receive_query_cedar_worker_thread,
 		    (void *)query_entry, sock, ReaperId);
@@ -712,6 +757,10 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 	bool is_locate = query_entry->is_locate;
 	AdTypes whichAds = query_entry->whichAds;
 
+	if (whichAds != (AdTypes) -1 && cad->Lookup(ATTR_COLLECTOR_DELTA_COOKIE)) {
+		return process_delta_query(query_entry, sock);
+	}
+
 	// Perform the query
 
 	if (whichAds != (AdTypes) -1) {
@@ -837,6 +886,429 @@ END:
 	return return_status;
 }
 
+// Set up a query to be answered by threaded_query_work(). This does all of the
+// work that must be done on the main thread: rewriting the constraint, taking a
+// snapshot of the ads it could match, and building the statistics for the
+// collector's own ad.  The context takes ownership of the query entry, the
+// query ad and the socket.
+CollectorDaemon::query_thread_context_t *
+CollectorDaemon::begin_threaded_query(pending_query_entry_t *query_entry, Stream *sock)
+{
+	query_thread_context_t *ctx = new query_thread_context_t;
+	ctx->entry = query_entry;
+	ctx->sock = sock;
+	ctx->cad = query_entry->cad;
+	ctx->whichAds = query_entry->whichAds;
+	ctx->filter = NULL;
+	ctx->resultLimit = INT_MAX;
+	ctx->snapshot = 0;
+	ctx->has_snapshot = false;
+	ctx->projectionScope = NULL;
+	ctx->selfAd = NULL;
+	ctx->selfStatsAd = NULL;
+	ctx->delta = false;
+	ctx->deltaFull = false;
+	ctx->high_prio = false;
+	ctx->worker_id = 0;
+	ctx->return_status = TRUE;
+
+	if (ctx->whichAds != (AdTypes) -1) {
+		ctx->filter = prepare_query_filter(ctx->whichAds, ctx->cad, ctx->adType, ctx->resultLimit);
+	}
+	std::string cookie;
+	if (ctx->filter && ctx->cad->LookupString(ATTR_COLLECTOR_DELTA_COOKIE, cookie)) {
+		// a delta query.  the snapshot is only of the ads that changed.
+		ctx->filterString = ExprTreeToString(ctx->filter);
+		ctx->delta = true;
+		ctx->deltaFull = ! collector.changesSince(ctx->whichAds, cookie, ctx->ads, ctx->keys, ctx->removed);
+		ctx->deltaCookie = collector.deltaCookie();
+		ctx->snapshot = collector.holdSnapshot();
+		ctx->has_snapshot = true;
+	} else if (ctx->filter) {
+		ctx->filterString = ExprTreeToString(ctx->filter);
+		ctx->snapshot = collector.beginSnapshot(ctx->whichAds, ctx->filter, ctx->ads);
+		ctx->has_snapshot = true;
+	}
+
+	// a projection that is an expression is evaluated against each result ad,
+	// make a private copy of the query ad to do that in.
+	std::string projection;
+	if ( ! ctx->cad->LookupString(ATTR_PROJECTION, projection) && ctx->cad->Lookup(ATTR_PROJECTION)) {
+		ctx->projectionScope = new ClassAd(*ctx->cad);
+	}
+
+	// if querying collector ads, and the collectors own ad is in the snapshot,
+	// then we want to send current statistics with it.  see the comments in
+	// receive_query_cedar_worker_thread
+	if (ctx->whichAds == COLLECTOR_AD && ! ctx->delta) {
+		for (size_t ii = 0; ii < ctx->ads.size(); ++ii) {
+			if ( ! collector.isSelfAd(ctx->ads[ii])) continue;
+
+			MyString stats_config;
+			ctx->cad->LookupString("STATISTICS_TO_PUBLISH",stats_config);
+			if (stats_config != "stored") {
+				dprintf(D_ALWAYS,"Updating collector stats using a chained ad and config=%s\n", stats_config.Value());
+				ctx->selfAd = ctx->ads[ii];
+				ctx->selfStatsAd = new ClassAd();
+				daemonCore->dc_stats.Publish(*ctx->selfStatsAd, stats_config.Value());
+				daemonCore->monitor_data.ExportData(ctx->selfStatsAd, true);
+				collectorStats.publishGlobal(ctx->selfStatsAd, stats_config.Value());
+			}
+			break;
+		}
+	}
+
+	return ctx;
+}
+
+// Release everything held by a query context.  called on the main thread.
+void CollectorDaemon::end_threaded_query(query_thread_context_t *ctx)
+{
+	if (ctx->has_snapshot) {
+		collector.endSnapshot(ctx->snapshot);
+	}
+	delete ctx->projectionScope;
+	delete ctx->selfStatsAd;
+	delete ctx->sock;
+	delete ctx->cad;
+	free(ctx->entry);
+	delete ctx;
+}
+
+// Answer a query that was set up by begin_threaded_query().  This runs on a
+// query thread, so it must only read the ads in the snapshot and must not
+// modify anything that it does not own.
+void CollectorDaemon::threaded_query_work(void *in_ctx)
+{
+	query_thread_context_t *ctx = (query_thread_context_t *)in_ctx;
+	Stream *sock = ctx->sock;
+	UtcTime begin(true);
+
+	if (ctx->delta) {
+		int numAds = 0, numRemoved = 0;
+		ctx->return_status = send_delta_response(sock, ctx->projectionScope, ctx->cad,
+			ctx->filter, ctx->adType, ctx->ads, ctx->keys, ctx->removed,
+			ctx->deltaFull, ctx->deltaCookie, numAds, numRemoved);
+		UtcTime end_write(true);
+		dprintf (D_ALWAYS,
+				 "Delta query info: changed=%d; removed=%d; full=%d; candidates=%d; send_time=%f; type=%s; requirements={%s}; from=%s; peer=%s\n",
+				 numAds,
+				 numRemoved,
+				 (int)ctx->deltaFull,
+				 (int)ctx->ads.size(),
+				 end_write.difference(begin),
+				 AdTypeToString(ctx->whichAds),
+				 ctx->filterString.c_str(),
+				 ctx->entry->subsys,
+				 sock->peer_description());
+		return;
+	}
+
+	// Perform the query against the snapshot
+	std::vector<ClassAd*> results;
+	int numAds = 0;
+	int failed = 0;
+	if (ctx->filter) {
+		for (size_t ii = 0; ii < ctx->ads.size(); ++ii) {
+			ClassAd *cad = ctx->ads[ii];
+			if ( ! ctx->adType.empty()) {
+				std::string type;
+				cad->LookupString( ATTR_MY_TYPE, type );
+				if ( strcasecmp( type.c_str(), ctx->adType.c_str() ) != 0 ) {
+					continue;
+				}
+			}
+
+			classad::Value result;
+			bool val;
+			if ( EvalExprTree( ctx->filter, cad, NULL, result ) &&
+				 result.IsBooleanValueEquiv(val) && val ) {
+				results.push_back(cad);
+				if (++numAds >= ctx->resultLimit) {
+					break;
+				}
+			} else {
+				++failed;
+			}
+		}
+		dprintf (D_ALWAYS, "(Sending %d ads in response to query)\n", numAds);
+	}
+
+	UtcTime end_write, end_query(true);
+
+	// send the results via cedar
+	sock->timeout(QueryTimeout); // set up a network timeout of a longer duration
+	sock->encode();
+	int more = 1;
+
+		// See if query ad asks for server-side projection
+	std::string projection;
+	classad::References proj;
+	if (ctx->cad->LookupString(ATTR_PROJECTION, projection) && ! projection.empty()) {
+		StringTokenIterator list(projection);
+		const std::string * attr;
+		while ((attr = list.next_string())) { proj.insert(*attr); }
+	}
+
+	for (size_t ii = 0; ii < results.size(); ++ii)
+	{
+		ClassAd *curr_ad = results[ii];
+
+		if (ctx->projectionScope) {
+			// matching the query ad with curr_ad would change the scope of
+			// curr_ad, which other threads may be reading.  so instead evaluate
+			// the projection in our copy of the query ad, chained to curr_ad.
+			proj.clear();
+			projection.clear();
+			ctx->projectionScope->ChainToAd(curr_ad);
+			if (ctx->projectionScope->EvaluateAttrString(ATTR_PROJECTION, projection) && ! projection.empty()) {
+				StringTokenIterator list(projection);
+				const std::string * attr;
+				while ((attr = list.next_string())) { proj.insert(*attr); }
+			}
+			ctx->projectionScope->Unchain();
+		}
+
+		// send the stats ad chained to the self ad instead of the self ad.
+		if (ctx->selfStatsAd && curr_ad == ctx->selfAd) {
+			ctx->selfStatsAd->ChainToAd(curr_ad);
+			curr_ad = ctx->selfStatsAd;
+		}
+
+		bool send_failed = (!sock->code(more) || !putClassAd(sock, *curr_ad, 0, proj.empty() ? NULL : &proj));
+
+		if (curr_ad == ctx->selfStatsAd) {
+			ctx->selfStatsAd->Unchain();
+		}
+
+		if (send_failed)
+		{
+			dprintf (D_ALWAYS,
+					"Error sending query result to client -- aborting\n");
+			ctx->return_status = 0;
+			return;
+		}
+
+		if (sock->deadline_expired()) {
+			dprintf( D_ALWAYS,
+				"QueryWorker: max_worktime expired while sending query result to client -- aborting\n");
+			ctx->return_status = 0;
+			return;
+		}
+	}
+
+	// end of query response ...
+	more = 0;
+	if (!sock->code(more))
+	{
+		dprintf (D_ALWAYS, "Error sending EndOfResponse (0) to client\n");
+	}
+
+	// flush the output
+	if (!sock->end_of_message())
+	{
+		dprintf (D_ALWAYS, "Error flushing CEDAR socket\n");
+	}
+
+	end_write.getTime();
+
+	dprintf (D_ALWAYS,
+			 "Query info: matched=%d; skipped=%d; query_time=%f; send_time=%f; type=%s; requirements={%s}; locate=%d; limit=%d; from=%s; peer=%s; projection={%s}; snapshot=%d\n",
+			 numAds,
+			 failed,
+			 end_query.difference(begin),
+			 end_write.difference(end_query),
+			 AdTypeToString(ctx->whichAds),
+			 ctx->filterString.c_str(),
+			 ctx->entry->is_locate,
+			 (ctx->resultLimit == INT_MAX) ? 0 : ctx->resultLimit,
+			 ctx->entry->subsys,
+			 sock->peer_description(),
+			 projection.c_str(),
+			 (int)ctx->ads.size());
+}
+
+// Answer a delta query (one with a CollectorDeltaCookie) in-process or in a
+// forked worker.  See CollectorEngine::changesSince().
+int CollectorDaemon::process_delta_query(pending_query_entry_t *query_entry, Stream *sock)
+{
+	UtcTime begin(true);
+	ClassAd *cad = query_entry->cad;
+	AdTypes whichAds = query_entry->whichAds;
+
+	std::string adType;
+	int resultLimit;
+	ExprTree *filter = prepare_query_filter(whichAds, cad, adType, resultLimit);
+
+	std::string cookie;
+	cad->LookupString(ATTR_COLLECTOR_DELTA_COOKIE, cookie);
+	std::vector<ClassAd*> ads;
+	std::vector<std::string> keys, removed;
+	bool full = true;
+	if (filter) {
+		full = ! collector.changesSince(whichAds, cookie, ads, keys, removed);
+	}
+
+	ClassAd *projectionScope = NULL;
+	std::string projection;
+	if ( ! cad->LookupString(ATTR_PROJECTION, projection) && cad->Lookup(ATTR_PROJECTION)) {
+		projectionScope = new ClassAd(*cad);
+	}
+
+	int numAds = 0, numRemoved = 0;
+	int return_status = send_delta_response(sock, projectionScope, cad, filter, adType,
+		ads, keys, removed, full, collector.deltaCookie(), numAds, numRemoved);
+	delete projectionScope;
+
+	UtcTime end_write(true);
+	dprintf (D_ALWAYS,
+			 "Delta query info: changed=%d; removed=%d; full=%d; candidates=%d; send_time=%f; type=%s; requirements={%s}; from=%s; peer=%s\n",
+			 numAds,
+			 numRemoved,
+			 (int)full,
+			 (int)ads.size(),
+			 end_write.difference(begin),
+			 AdTypeToString(whichAds),
+			 filter ? ExprTreeToString(filter) : "",
+			 query_entry->subsys,
+			 sock->peer_description());
+
+	return return_status;
+}
+
+// Send the answer to a delta query: first an ad with the cookie for the
+// client's next query, then the changed ads that match the constraint, each
+// with its key in CollectorDeltaKey, and then an ad with the key of each
+// removed ad.  A changed ad that no longer matches the constraint is sent as
+// removed, since the client may have it from an earlier query.  When full is
+// true the ads are every ad there is, and the client should drop any ad it
+// has that is not sent.  This only reads the ads, so it is safe to call from a
+// query thread with ads in a snapshot.
+int CollectorDaemon::send_delta_response(Stream *sock, ClassAd *projectionScope, ClassAd *query,
+	ExprTree *filter, const std::string &adType,
+	const std::vector<ClassAd*> &ads, const std::vector<std::string> &keys,
+	const std::vector<std::string> &removed, bool full, const std::string &cookie,
+	int &numAds, int &numRemoved)
+{
+	numAds = 0;
+	numRemoved = 0;
+
+	sock->timeout(QueryTimeout); // set up a network timeout of a longer duration
+	sock->encode();
+	int more = 1;
+
+	ClassAd status;
+	SetMyTypeName(status, COLLECTOR_DELTA_ADTYPE);
+	status.Assign(ATTR_COLLECTOR_DELTA_COOKIE, cookie);
+	status.Assign(ATTR_COLLECTOR_DELTA_FULL, full);
+	if ( ! sock->code(more) || ! putClassAd(sock, status)) {
+		dprintf (D_ALWAYS, "Error sending query result to client -- aborting\n");
+		return 0;
+	}
+
+		// See if query ad asks for server-side projection
+	std::string projection;
+	classad::References proj;
+	if (query->LookupString(ATTR_PROJECTION, projection) && ! projection.empty()) {
+		StringTokenIterator list(projection);
+		const std::string * attr;
+		while ((attr = list.next_string())) { proj.insert(*attr); }
+		proj.insert(ATTR_COLLECTOR_DELTA_KEY);
+	}
+
+	std::vector<std::string> gone(removed);
+	for (size_t ii = 0; filter && ii < ads.size(); ++ii)
+	{
+		ClassAd *curr_ad = ads[ii];
+
+		bool matched = false;
+		std::string type;
+		if (adType.empty() ||
+			(curr_ad->LookupString(ATTR_MY_TYPE, type) && strcasecmp(type.c_str(), adType.c_str()) == 0))
+		{
+			classad::Value result;
+			bool val;
+			matched = EvalExprTree(filter, curr_ad, NULL, result) &&
+				result.IsBooleanValueEquiv(val) && val;
+		}
+		if ( ! matched) {
+			if ( ! full) { gone.push_back(keys[ii]); }
+			continue;
+		}
+
+		if (projectionScope) {
+			proj.clear();
+			projection.clear();
+			projectionScope->ChainToAd(curr_ad);
+			if (projectionScope->EvaluateAttrString(ATTR_PROJECTION, projection) && ! projection.empty()) {
+				StringTokenIterator list(projection);
+				const std::string * attr;
+				while ((attr = list.next_string())) { proj.insert(*attr); }
+				proj.insert(ATTR_COLLECTOR_DELTA_KEY);
+			}
+			projectionScope->Unchain();
+		}
+
+		// the key goes in an ad of its own, chained to the ad being sent,
+		// so that the ad in the table is not changed.
+		ClassAd keyed;
+		keyed.Assign(ATTR_COLLECTOR_DELTA_KEY, keys[ii]);
+		keyed.ChainToAd(curr_ad);
+		bool send_failed = (!sock->code(more) || !putClassAd(sock, keyed, 0, proj.empty() ? NULL : &proj));
+		keyed.Unchain();
+
+		if (send_failed) {
+			dprintf (D_ALWAYS, "Error sending query result to client -- aborting\n");
+			return 0;
+		}
+		if (sock->deadline_expired()) {
+			dprintf( D_ALWAYS,
+				"QueryWorker: max_worktime expired while sending query result to client -- aborting\n");
+			return 0;
+		}
+		++numAds;
+	}
+
+	for (size_t ii = 0; ii < gone.size(); ++ii) {
+		ClassAd tombstone;
+		SetMyTypeName(tombstone, COLLECTOR_DELTA_REMOVED_ADTYPE);
+		tombstone.Assign(ATTR_COLLECTOR_DELTA_KEY, gone[ii]);
+		if ( ! sock->code(more) || ! putClassAd(sock, tombstone)) {
+			dprintf (D_ALWAYS, "Error sending query result to client -- aborting\n");
+			return 0;
+		}
+		++numRemoved;
+	}
+
+	// end of query response ...
+	more = 0;
+	if (!sock->code(more))
+	{
+		dprintf (D_ALWAYS, "Error sending EndOfResponse (0) to client\n");
+	}
+
+	// flush the output
+	if (!sock->end_of_message())
+	{
+		dprintf (D_ALWAYS, "Error flushing CEDAR socket\n");
+	}
+
+	return TRUE;
+}
+
+// Called on the main thread (as DaemonCore pump work) when a query thread
+// has finished with a query.
+int CollectorDaemon::threaded_query_done(void * /*pool*/, void *in_ctx)
+{
+	query_thread_context_t *ctx = (query_thread_context_t *)in_ctx;
+	int worker_id = ctx->worker_id;
+	end_threaded_query(ctx);
+
+	// let the reaper account for the finished worker and start the next query
+	QueryReaper(NULL, worker_id, 0);
+	return 0;
+}
+
 AdTypes
 CollectorDaemon::receive_query_public( int command )
 {
@@ -1150,6 +1622,7 @@ int CollectorDaemon::receive_update(Service* /*s*/, int command, Stream* sock)
 
 	/* let the off-line plug-in have at it */
 	offline_plugin_.update ( command, *cad );
+	collector.reindexAd ( cad );
 
 #if defined(HAVE_DLOPEN) && !defined(DARWIN)
 	CollectorPluginManager::Update(command, *cad);
@@ -1178,6 +1651,71 @@ int CollectorDaemon::receive_update(Service* /*s*/, int command, Stream* sock)
 	return TRUE;
 }
 
+int CollectorDaemon::receive_startd_batch(Service* /*s*/, int command, Stream* sock)
+{
+	daemonCore->dc_stats.AddToAnyProbe("UpdatesReceived", 1);
+
+	sock->decode();
+
+		// Avoid lengthy blocking on communication with our peer.
+		// This command-handler should not get called until data
+		// is ready to read.
+	sock->timeout(1);
+
+	ClassAd batchAd;
+	ClassAd pvtBatchAd;
+	if( !getClassAd(sock, batchAd) ) {
+		dprintf(D_ALWAYS,"Command %d on Sock not followed by ClassAd (or timeout occured)\n",
+				command);
+		sock->end_of_message();
+		return FALSE;
+	}
+	bool havePvt = getClassAd(sock, pvtBatchAd);
+	if( !sock->end_of_message() ) {
+		dprintf(D_FULLDEBUG,"Warning: Command %d; maybe shedding data on eom\n",
+				command);
+	}
+
+	condor_sockaddr from = ((Sock*)sock)->peer_addr();
+
+	// the batch turns into an UPDATE_STARTD_AD for each of its slots
+	std::vector<ClassAd*> ads;
+	if (!collector.collectStartdBatch(&batchAd, havePvt ? &pvtBatchAd : NULL,
+									  from, (Sock*)sock, ads)) {
+		dprintf(D_ALWAYS, "Received malformed startd batch from %s. Ignoring.\n",
+				((Sock*)sock)->peer_description());
+		return FALSE;
+	}
+
+	for (size_t i = 0; i < ads.size(); i++) {
+		ClassAd *cad = ads[i];
+
+		/* let the off-line plug-in have at it */
+		offline_plugin_.update ( UPDATE_STARTD_AD, *cad );
+		collector.reindexAd ( cad );
+
+#if defined(HAVE_DLOPEN) && !defined(DARWIN)
+		CollectorPluginManager::Update(UPDATE_STARTD_AD, *cad);
+#endif
+
+		if (viewCollectorTypes) {
+			forward_classad_to_view_collector(UPDATE_STARTD_AD,
+											  ATTR_MY_TYPE,
+											  cad);
+		} else {
+			send_classad_to_sock(UPDATE_STARTD_AD, cad);
+		}
+	}
+
+	if( sock->type() == Stream::reli_sock ) {
+			// stash this socket for future updates...
+		return stashSocket( (ReliSock *)sock );
+	}
+
+	// let daemon core clean up the socket
+	return TRUE;
+}
+
 int CollectorDaemon::receive_update_expect_ack( Service* /*s*/,
 												int command,
 												Stream *stream )
@@ -1285,8 +1823,10 @@ int CollectorDaemon::receive_update_expect_ack( Service* /*s*/,
     }
 
     /* let the off-line plug-in have at it */
-	if(cad)
-    offline_plugin_.update ( command, *cad );
+	if(cad) {
+		offline_plugin_.update ( command, *cad );
+		collector.reindexAd ( cad );
+	}
 
 #if defined(HAVE_DLOPEN) && !defined(DARWIN)
     CollectorPluginManager::Update ( command, *cad );
@@ -1367,38 +1907,36 @@ int CollectorDaemon::query_scanFunc (ClassAd *cad)
 }
 
 
-void CollectorDaemon::process_query_public (AdTypes whichAds,
+// Set up the constraint for a query, rewriting the Requirements of the query
+// ad as needed.  Returns the constraint, or NULL if the query has none.
+ExprTree * CollectorDaemon::prepare_query_filter (AdTypes whichAds,
 											ClassAd *query,
-											List<ClassAd>* results)
+											std::string &adType,
+											int &resultLimit)
 {
 #if defined(ADD_TARGET_SCOPING)
 	RemoveExplicitTargetRefs( *query );
 #endif
-	// set up for hashtable scan
-	__query__ = query;
-	__numAds__ = 0;
-	__failed__ = 0;
-	__ClassAdResultList__ = results;
 	// An empty adType means don't check the MyType of the ads.
 	// This means either the command indicates we're only checking one
 	// type of ad, or the query's TargetType is "Any" (match all ad types).
-	__adType__ = "";
+	adType = "";
 	if ( whichAds == GENERIC_AD || whichAds == ANY_AD ) {
-		query->LookupString( ATTR_TARGET_TYPE, __adType__ );
-		if ( strcasecmp( __adType__.c_str(), "any" ) == 0 ) {
-			__adType__ = "";
+		query->LookupString( ATTR_TARGET_TYPE, adType );
+		if ( strcasecmp( adType.c_str(), "any" ) == 0 ) {
+			adType = "";
 		}
 	}
 
-	__filter__ = query->LookupExpr( ATTR_REQUIREMENTS );
-	if ( __filter__ == NULL ) {
+	ExprTree *filter = query->LookupExpr( ATTR_REQUIREMENTS );
+	if ( filter == NULL ) {
 		dprintf (D_ALWAYS, "Query missing %s\n", ATTR_REQUIREMENTS );
-		return;
+		return NULL;
 	}
 
-	__resultLimit__ = INT_MAX; // no limit
-	if ( ! query->LookupInteger(ATTR_LIMIT_RESULTS, __resultLimit__) || __resultLimit__ <= 0) {
-		__resultLimit__ = INT_MAX; // no limit
+	resultLimit = INT_MAX; // no limit
+	if ( ! query->LookupInteger(ATTR_LIMIT_RESULTS, resultLimit) || resultLimit <= 0) {
+		resultLimit = INT_MAX; // no limit
 	}
 
 	// See if we should exclude Collector Ads from generic queries.  Still
@@ -1410,13 +1948,13 @@ void CollectorDaemon::process_query_public (AdTypes whichAds,
 		dprintf(D_FULLDEBUG, "Received query with generic type; filtering collector ads\n");
 		MyString modified_filter;
 		modified_filter.formatstr("(%s) && (MyType =!= \"Collector\")",
-			ExprTreeToString(__filter__));
+			ExprTreeToString(filter));
 		query->AssignExpr(ATTR_REQUIREMENTS,modified_filter.Value());
-		__filter__ = query->LookupExpr(ATTR_REQUIREMENTS);
-		if ( __filter__ == NULL ) {
+		filter = query->LookupExpr(ATTR_REQUIREMENTS);
+		if ( filter == NULL ) {
 			dprintf (D_ALWAYS, "Failed to parse modified filter: %s\n", 
 				modified_filter.Value());
-			return;
+			return NULL;
 		}
 		dprintf(D_FULLDEBUG,"Query after modification: *%s*\n",modified_filter.Value());
 	}
@@ -1432,19 +1970,45 @@ void CollectorDaemon::process_query_public (AdTypes whichAds,
 		if (!checks_absent) {
 			MyString modified_filter;
 			modified_filter.formatstr("(%s) && (%s =!= True)",
-				ExprTreeToString(__filter__),ATTR_ABSENT);
+				ExprTreeToString(filter),ATTR_ABSENT);
 			query->AssignExpr(ATTR_REQUIREMENTS,modified_filter.Value());
-			__filter__ = query->LookupExpr(ATTR_REQUIREMENTS);
-			if ( __filter__ == NULL ) {
+			filter = query->LookupExpr(ATTR_REQUIREMENTS);
+			if ( filter == NULL ) {
 				dprintf (D_ALWAYS, "Failed to parse modified filter: %s\n", 
 					modified_filter.Value());
-				return;
+				return NULL;
 			}
 			dprintf(D_FULLDEBUG,"Query after modification: *%s*\n",modified_filter.Value());
 		}
 	}
 
-	if (!collector.walkHashTable (whichAds, query_scanFunc))
+	return filter;
+}
+
+void CollectorDaemon::process_query_public (AdTypes whichAds,
+											ClassAd *query,
+											List<ClassAd>* results)
+{
+	// set up for hashtable scan
+	__query__ = query;
+	__numAds__ = 0;
+	__failed__ = 0;
+	__ClassAdResultList__ = results;
+
+	__filter__ = prepare_query_filter( whichAds, query, __adType__, __resultLimit__ );
+	if ( __filter__ == NULL ) {
+		return;
+	}
+
+	// If the query constraint can be answered (at least in part) by one of
+	// the attribute indexes, only evaluate it against the candidate ads,
+	// otherwise we have to look at every ad in the table.
+	int candidates = 0;
+	if (collector.walkIndexedAds (whichAds, __filter__, query_scanFunc, candidates))
+	{
+		dprintf (D_FULLDEBUG, "Query used attribute index, %d candidate ads\n", candidates);
+	}
+	else if (!collector.walkHashTable (whichAds, query_scanFunc))
 	{
 		dprintf (D_ALWAYS, "Error sending query response\n");
 	}
@@ -1484,6 +2048,8 @@ int CollectorDaemon::setAttrLastHeardFrom (ClassAd* cad, unsigned long time)
 	if ( EvalExprTree( __filter__, cad, NULL, result ) &&
 		 result.IsBooleanValueEquiv(val) && val ) {
 
+		// if query threads are reading the ad, this gives us a copy
+		cad = collector.getWritableAd( __whichAds__, cad );
 		cad->Assign( ATTR_LAST_HEARD_FROM, time );
         __numAds__++;
     }
@@ -1516,6 +2082,7 @@ void CollectorDaemon::process_invalidation (AdTypes whichAds, ClassAd &query, St
 
 		// set up for hashtable scan
 		__query__ = &query;
+		__whichAds__ = whichAds;
 		__filter__ = query.LookupExpr( ATTR_REQUIREMENTS );
 		// An empty adType means don't check the MyType of the ads.
 		// This means either the command indicates we're only checking
@@ -1836,6 +2403,19 @@ void CollectorDaemon::Config()
 	// This it temporary (for 8.7.0) just in case we need to turn off the new getClassAdEx options
 	collector.m_get_ad_options = param_integer("COLLECTOR_GETAD_OPTIONS", GET_CLASSAD_FAST | GET_CLASSAD_LAZY_PARSE);
 	collector.m_get_ad_options &= (GET_CLASSAD_LAZY_PARSE | GET_CLASSAD_FAST | GET_CLASSAD_NO_CACHE);
+	if ( ! query_threads) {
+		// switching between forked and threaded query workers requires a restart
+		use_query_threads = param_boolean("COLLECTOR_QUERY_WORKERS_USE_THREADS", false);
+		if (use_query_threads && ! CollectorQueryThreads::supported()) {
+			dprintf(D_ALWAYS, "COLLECTOR_QUERY_WORKERS_USE_THREADS is not supported on this platform, using forked query workers\n");
+			use_query_threads = false;
+		}
+	}
+	if (use_query_threads) {
+		// a lazy parsed ad is modified the first time it is evaluated,
+		// which is not safe while query threads may be reading it.
+		collector.m_get_ad_options &= ~GET_CLASSAD_LAZY_PARSE;
+	}
 	MyString opts;
 	if (collector.m_get_ad_options & GET_CLASSAD_FAST) { opts += "fast "; }
 	if (collector.m_get_ad_options & GET_CLASSAD_NO_CACHE) { opts += "no-cache "; }
@@ -1856,6 +2436,12 @@ void CollectorDaemon::Config()
 		tmp = NULL;
 	}
 
+	std::string index_attrs;
+	param(index_attrs, "COLLECTOR_QUERY_INDEX_ATTRS");
+	collector.configureIndexes( index_attrs.c_str() );
+
+	collector.setDeltaLogLength( param_integer("COLLECTOR_DELTA_LOG_LENGTH", 100000, 0) );
+
 	init_classad(i);
 
     // set the appropriate parameters in the collector engine
@@ -1958,6 +2544,14 @@ void CollectorDaemon::Config()
 	want_track_queries_by_subsys = param_boolean("COLLECTOR_TRACK_QUERY_BY_SUBSYS",true);
 #endif
 
+	if (use_query_threads) {
+		if ( ! query_threads) {
+			query_threads = new CollectorQueryThreads(threaded_query_work, threaded_query_done);
+		}
+		int num_threads = query_threads->grow(max_query_workers);
+		dprintf(D_ALWAYS, "QueryWorker: using %d query threads\n", num_threads);
+	}
+
 	bool ccb_server_enabled = param_boolean("ENABLE_CCB_SERVER",true);
 	if( ccb_server_enabled ) {
 		if( !m_ccb_server ) {
@@ -1997,6 +2591,10 @@ void CollectorDaemon::Exit()
 		daemonCore->Cancel_Timer(UpdateTimerId);
 		UpdateTimerId = -1;
 	}
+	// wait for the query threads to finish, they may be reading ads.
+	if ( query_threads ) {
+		query_threads->shutdown();
+	}
 	free( CollectorName );
 	delete ad;
 	delete collectorsToUpdate;
@@ -2020,6 +2618,10 @@ void CollectorDaemon::Shutdown()
 		daemonCore->Cancel_Timer(UpdateTimerId);
 		UpdateTimerId = -1;
 	}
+	// wait for the query threads to finish, they may be reading ads.
+	if ( query_threads ) {
+		query_threads->shutdown();
+	}
 	free( CollectorName );
 	delete ad;
 	delete collectorsToUpdate;
@@ -103,8 +103,15 @@ public:
 	static int receive_invalidation(Service*, int, Stream*);
 	static int receive_update(Service*, int, Stream*);
     static int receive_update_expect_ack(Service*, int, Stream*);
+	static int receive_startd_batch(Service*, int, Stream*);
 
 	static void process_query_public(AdTypes, ClassAd*, List<ClassAd>*);
+	static ExprTree * prepare_query_filter(AdTypes, ClassAd*, std::string &adType, int &resultLimit);
+	static int send_delta_response(Stream *sock, ClassAd *projectionScope, ClassAd *query,
+			ExprTree *filter, const std::string &adType,
+			const std::vector<ClassAd*> &ads, const std::vector<std::string> &keys,
+			const std::vector<std::string> &removed, bool full, const std::string &cookie,
+			int &numAds, int &numRemoved);
 	static ClassAd * process_global_query( const char *constraint, void *arg );
 	static int select_by_match( ClassAd *cad );
 	static void process_invalidation(AdTypes, ClassAd&, Stream*);
@@ -166,6 +173,44 @@ public:
 	static int active_query_workers;
 	static int pending_query_workers;
 
+	// When COLLECTOR_QUERY_WORKERS_USE_THREADS is true, queries are answered
+	// by a pool of threads rather than by forked workers. Everything a query
+	// thread needs is set up on the main thread and kept in this context,
+	// and the thread only reads ads from a snapshot of the collector tables.
+	typedef struct query_thread_context {
+		pending_query_entry_t *entry;
+		Stream *sock;
+		ClassAd *cad;
+		AdTypes whichAds;
+		ExprTree *filter;          // the query constraint, owned by cad
+		std::string filterString;  // the constraint, for logging
+		std::string adType;        // empty means any MyType
+		int resultLimit;
+		std::vector<ClassAd*> ads; // the snapshot
+		unsigned long snapshot;    // token for CollectorEngine::endSnapshot
+		bool has_snapshot;
+		ClassAd *projectionScope;  // copy of cad to evaluate a Projection expression in
+		ClassAd *selfAd;           // the collector's own ad, if it is in the snapshot
+		ClassAd *selfStatsAd;      // current statistics to chain to selfAd
+		bool delta;                // a delta query, ads are the changed ads
+		bool deltaFull;            // the delta is every ad, the cookie was too old
+		std::string deltaCookie;   // the cookie to send back to the client
+		std::vector<std::string> keys;    // the delta key of each ad
+		std::vector<std::string> removed; // keys of the removed ads
+		bool high_prio;
+		int worker_id;
+		int return_status;
+	} query_thread_context_t;
+
+	static bool use_query_threads;  // from config file, only read at startup
+	static class CollectorQueryThreads *query_threads;
+	static int next_query_thread_id;
+	static query_thread_context_t * begin_threaded_query(pending_query_entry_t *query_entry, Stream *sock);
+	static void end_threaded_query(query_thread_context_t *ctx);
+	static void threaded_query_work(void *ctx);
+	static int threaded_query_done(void *pool, void *ctx);
+	static int process_delta_query(pending_query_entry_t *query_entry, Stream *sock);
+
 #ifdef TRACK_QUERIES_BY_SUBSYS
 	static bool want_track_queries_by_subsys;
 #endif
@@ -188,6 +233,7 @@ protected:
 	static int __resultLimit__;
 	static int __failed__;
 	static std::string __adType__;
+	static AdTypes __whichAds__;
 	static ExprTree *__filter__;
 
 	static TrackTotals* normalTotals;
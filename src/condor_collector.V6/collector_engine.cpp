@@ -36,6 +36,10 @@ extern "C" void event_mgr (void);
 #include "condor_daemon_core.h"
 #include "file_sql.h"
 #include "classad_merge.h"
+#include "daemon.h"
+#include "dc_message.h"
+
+#include <set>
 
 extern FILESQL *FILEObj;
 
@@ -46,7 +50,6 @@ extern FILESQL *FILEObj;
 
 static void killHashTable (CollectorHashTable &);
 static int killGenericHashTable(CollectorHashTable *);
-static void purgeHashTable (CollectorHashTable &);
 
 int 	engine_clientTimeoutHandler (Service *);
 int 	engine_housekeepingHandler  (Service *);
@@ -74,8 +77,13 @@ CollectorEngine::CollectorEngine (CollectorStats *stats ) :
 	LeaseManagerAds(LESSER_TABLE_SIZE , &adNameHashFunction),
 	GridAds       (LESSER_TABLE_SIZE , &adNameHashFunction),
 	GenericAds    (LESSER_TABLE_SIZE , &stringHashFunction),
+	m_epoch(0),
+	m_generation(0),
+	m_oldestGeneration(0),
+	m_deltaLogLength(0),
 	__self_ad__(0)
 {
+	formatstr(m_instance, "%d.%ld", (int)getpid(), (long)time(NULL));
 	clientTimeout = 20;
 	machineUpdateInterval = 30;
 	m_forwardInterval = machineUpdateInterval / 3;
@@ -114,6 +122,16 @@ CollectorEngine::
 	killHashTable (GridAds);
 	GenericAds.walk(killGenericHashTable);
 
+	for (std::map<CollectorHashTable*, CollectorAdIndex*>::iterator it = m_indexes.begin(); it != m_indexes.end(); ++it) {
+		delete it->second;
+	}
+	m_indexes.clear();
+
+	while ( ! m_retired.empty()) {
+		delete m_retired.front().second;
+		m_retired.pop_front();
+	}
+
 	if(m_collector_requirements) {
 		delete m_collector_requirements;
 		m_collector_requirements = NULL;
@@ -242,9 +260,19 @@ CollectorEngine::invalidateAds(AdTypes adType, ClassAd &query)
 	ClassAd  *ad;
 	AdNameHashKey  hk;
 	MyString hkString;
+	CollectorAdIndex *index = indexFor(*table);
 	(*table).startIterations();
 	while ((*table).iterate (ad)) {
-		if (IsAHalfMatch(&query, ad)) {
+		// matching sets the scope of the ad being matched, so when query
+		// threads may be reading the ad we match a copy of it instead.
+		bool matched;
+		if (hasSnapshots()) {
+			ClassAd copy(*ad);
+			matched = IsAHalfMatch(&query, &copy);
+		} else {
+			matched = IsAHalfMatch(&query, ad);
+		}
+		if (matched) {
 			(*table).getCurrentKey(hk);
 			hk.sprint(hkString);
 			if ((*table).remove(hk) == -1) {
@@ -255,7 +283,9 @@ CollectorEngine::invalidateAds(AdTypes adType, ClassAd &query)
 				dprintf(D_ALWAYS,
 						"\t\t**** Invalidating ad: \"%s\"\n",
 						hkString.Value());
-				delete ad;
+				if (index) { index->remove(ad); }
+				noteChange(*table, hk, ad);
+				releaseAd(ad);
 				count++;
 			}
 		}
@@ -335,6 +365,378 @@ walkHashTable (AdTypes adType, int (*scanFunction)(ClassAd *))
 	return 1;
 }
 
+bool CollectorEngine::
+walkIndexedAds (AdTypes adType, classad::ExprTree *constraint, int (*scanFunction)(ClassAd *), int &candidates)
+{
+	candidates = 0;
+
+	CollectorHashTable *table;
+	CollectorEngine::HashFunc func;
+	if (!LookupByAdType(adType, table, func)) {
+		return false;
+	}
+	CollectorAdIndex *index = indexFor(*table);
+	if (!index) {
+		return false;
+	}
+
+	std::vector<ClassAd*> ads;
+	if (!index->lookup(constraint, ads)) {
+		return false;
+	}
+
+	candidates = (int)ads.size();
+	for (size_t ii = 0; ii < ads.size(); ++ii) {
+		if (!scanFunction(ads[ii])) {
+			break;
+		}
+	}
+	return true;
+}
+
+void CollectorEngine::
+configureIndexes (const char *attrs)
+{
+	std::string attr_list(attrs ? attrs : "");
+	if (attr_list == m_indexAttrs && !m_indexes.empty()) {
+		return;
+	}
+	m_indexAttrs = attr_list;
+
+	std::vector<std::string> index_attrs;
+	StringTokenIterator it(attr_list);
+	const std::string *attr;
+	while ((attr = it.next_string())) {
+		index_attrs.push_back(*attr);
+	}
+
+	// the fixed tables that we index, the generic tables are not indexed
+	static const AdTypes indexed_types[] = {
+		STARTD_AD, STARTD_PVT_AD, SCHEDD_AD, SUBMITTOR_AD, LICENSE_AD,
+		MASTER_AD, CKPT_SRVR_AD, COLLECTOR_AD, STORAGE_AD, ACCOUNTING_AD,
+		NEGOTIATOR_AD, HAD_AD, GRID_AD, XFER_SERVICE_AD, LEASE_MANAGER_AD,
+#ifdef WANT_QUILL
+		QUILL_AD,
+#endif
+	};
+
+	for (size_t ii = 0; ii < COUNTOF(indexed_types); ++ii) {
+		CollectorHashTable *table;
+		CollectorEngine::HashFunc func;
+		if (!LookupByAdType(indexed_types[ii], table, func)) {
+			continue;
+		}
+		CollectorAdIndex *&index = m_indexes[table];
+		if (!index) { index = new CollectorAdIndex(); }
+		index->setAttributes(index_attrs);
+
+		// populate the index from ads we already have.
+		if (index->isEnabled()) {
+			ClassAd *ad;
+			table->startIterations();
+			while (table->iterate(ad)) {
+				index->insert(ad);
+			}
+		}
+	}
+
+	dprintf(D_ALWAYS, "Collector query indexes %s%s\n",
+		index_attrs.empty() ? "disabled" : "enabled on ",
+		index_attrs.empty() ? "" : attr_list.c_str());
+}
+
+void CollectorEngine::
+reindexAd (ClassAd *ad)
+{
+	for (std::map<CollectorHashTable*, CollectorAdIndex*>::iterator it = m_indexes.begin(); it != m_indexes.end(); ++it) {
+		if (it->second->contains(ad)) {
+			it->second->update(ad);
+			return;
+		}
+	}
+}
+
+CollectorAdIndex *CollectorEngine::
+indexFor (CollectorHashTable &table)
+{
+	std::map<CollectorHashTable*, CollectorAdIndex*>::iterator it = m_indexes.find(&table);
+	if (it == m_indexes.end() || !it->second->isEnabled()) {
+		return NULL;
+	}
+	return it->second;
+}
+
+// the walk functions only take a plain function pointer, so beginSnapshot
+// uses this to collect the ads.
+static std::vector<ClassAd*> *snapshotAds = NULL;
+
+static int
+snapshotScanFunc (ClassAd *ad)
+{
+	snapshotAds->push_back(ad);
+	return 1;
+}
+
+unsigned long CollectorEngine::
+beginSnapshot (AdTypes adType, classad::ExprTree *constraint, std::vector<ClassAd*> &ads)
+{
+	ads.clear();
+	snapshotAds = &ads;
+	int candidates = 0;
+	if ( ! constraint || ! walkIndexedAds(adType, constraint, snapshotScanFunc, candidates)) {
+		walkHashTable(adType, snapshotScanFunc);
+	}
+	snapshotAds = NULL;
+
+	return holdSnapshot();
+}
+
+unsigned long CollectorEngine::
+holdSnapshot ()
+{
+	m_snapshots[m_epoch] += 1;
+	return m_epoch;
+}
+
+void CollectorEngine::
+endSnapshot (unsigned long token)
+{
+	std::map<unsigned long, int>::iterator it = m_snapshots.find(token);
+	if (it == m_snapshots.end()) {
+		dprintf(D_ALWAYS | D_FAILURE, "endSnapshot called for unknown snapshot %lu\n", token);
+		return;
+	}
+	if (--(it->second) <= 0) {
+		m_snapshots.erase(it);
+	}
+	reclaimAds();
+}
+
+// delete an ad that has been removed from the tables, or save it for later
+// if there are open snapshots that might still be reading it.
+void CollectorEngine::
+releaseAd (ClassAd *ad)
+{
+	if (m_snapshots.empty()) {
+		delete ad;
+		return;
+	}
+	// snapshots that begin after this see a later epoch, and so can't refer to ad.
+	m_retired.push_back(std::make_pair(m_epoch, ad));
+	++m_epoch;
+}
+
+void CollectorEngine::
+reclaimAds ()
+{
+	// an ad retired in an epoch before the oldest open snapshot
+	// was already gone from the tables when that snapshot began.
+	unsigned long oldest = m_snapshots.empty() ? m_epoch : m_snapshots.begin()->first;
+	while ( ! m_retired.empty() && m_retired.front().first < oldest) {
+		delete m_retired.front().second;
+		m_retired.pop_front();
+	}
+}
+
+ClassAd *CollectorEngine::
+writableAd (CollectorHashTable &table, AdNameHashKey &hk, ClassAd *ad)
+{
+		// callers change the ad they get back
+	noteChange(table, hk, ad);
+
+	if (m_snapshots.empty()) {
+		return ad;
+	}
+
+	ClassAd **slot = NULL;
+	if (table.lookup(hk, slot) == -1 || *slot != ad) {
+		return ad;
+	}
+
+	// swap the copy into the table in place, so that this is safe to do
+	// from inside of a walk of the table.
+	ClassAd *copy = new ClassAd(*ad);
+	*slot = copy;
+
+	CollectorAdIndex *index = indexFor(table);
+	if (index) {
+		index->remove(ad);
+		index->insert(copy);
+	}
+	if (isSelfAd(ad)) { __self_ad__ = copy; }
+
+	releaseAd(ad);
+	return copy;
+}
+
+ClassAd *CollectorEngine::
+getWritableAd (AdTypes adType, ClassAd *ad)
+{
+	if (m_snapshots.empty()) {
+		return ad;
+	}
+
+	CollectorHashTable *table = NULL;
+	CollectorEngine::HashFunc makeKey;
+	if ( ! LookupByAdType(adType, table, makeKey)) {
+		// the generic tables are keyed by the MyType of the ads in them
+		MyString type(GetMyTypeName(*ad));
+		if (adType != GENERIC_AD || GenericAds.lookup(type, table) == -1) {
+			return ad;
+		}
+		makeKey = makeGenericAdHashKey;
+	}
+
+	AdNameHashKey hk;
+	if ( ! (*makeKey)(hk, ad)) {
+		return ad;
+	}
+	return writableAd(*table, hk, ad);
+}
+
+void CollectorEngine::
+setDeltaLogLength (int length)
+{
+	m_deltaLogLength = length > 0 ? (size_t)length : 0;
+	while (m_changes.size() > m_deltaLogLength) {
+		m_oldestGeneration = m_changes.front().generation;
+		m_changes.pop_front();
+	}
+	if (m_deltaLogLength == 0) {
+		m_oldestGeneration = m_generation;
+	}
+}
+
+std::string CollectorEngine::
+deltaCookie () const
+{
+	std::string cookie;
+	formatstr(cookie, "%s:%lld", m_instance.c_str(), m_generation);
+	return cookie;
+}
+
+// record that the ad with the given key in the table was inserted, changed
+// or removed.  the key given to clients is the MyType and the hash key,
+// since ads of different types can have the same hash key.
+void CollectorEngine::
+noteChange (CollectorHashTable &table, AdNameHashKey &hk, ClassAd *ad)
+{
+	++m_generation;
+	if (m_deltaLogLength == 0) {
+		m_oldestGeneration = m_generation;
+		return;
+	}
+
+	MyString hkString;
+	hk.sprint(hkString);
+
+	m_changes.push_back(ChangeRecord());
+	ChangeRecord &change = m_changes.back();
+	change.generation = m_generation;
+	change.table = &table;
+	change.hk = hk;
+	change.key = GetMyTypeName(*ad);
+	change.key += " ";
+	change.key += hkString.Value();
+
+	if (m_changes.size() > m_deltaLogLength) {
+		m_oldestGeneration = m_changes.front().generation;
+		m_changes.pop_front();
+	}
+}
+
+// the tables that a query of the given type looks in, the same ones
+// that walkHashTable() walks.
+void CollectorEngine::
+tablesFor (AdTypes adType, std::vector<CollectorHashTable*> &tables)
+{
+	tables.clear();
+	if (ANY_AD == adType) {
+		CollectorHashTable *any[] = {
+			&AccountingAds, &StorageAds, &CkptServerAds, &LicenseAds,
+			&CollectorAds, &StartdAds, &ScheddAds, &MasterAds, &SubmittorAds,
+			&NegotiatorAds,
+#ifdef HAVE_EXT_POSTGRESQL
+			&QuillAds,
+#endif
+			&HadAds, &GridAds, &XferServiceAds, &LeaseManagerAds,
+		};
+		tables.assign(any, any + COUNTOF(any));
+	}
+	if (ANY_AD == adType || GENERIC_AD == adType) {
+		CollectorHashTable *table;
+		GenericAds.startIterations();
+		while (GenericAds.iterate(table)) {
+			tables.push_back(table);
+		}
+		return;
+	}
+
+	CollectorHashTable *table;
+	CollectorEngine::HashFunc func;
+	if (LookupByAdType(adType, table, func)) {
+		tables.push_back(table);
+	}
+}
+
+bool CollectorEngine::
+changesSince (AdTypes adType, const std::string &cookie, std::vector<ClassAd*> &ads,
+	std::vector<std::string> &keys, std::vector<std::string> &removed)
+{
+	ads.clear();
+	keys.clear();
+	removed.clear();
+
+	std::vector<CollectorHashTable*> tables;
+	tablesFor(adType, tables);
+
+	long long since = -1;
+	size_t colon = cookie.rfind(':');
+	if (colon != std::string::npos && cookie.compare(0, colon, m_instance) == 0) {
+		since = strtoll(cookie.c_str() + colon + 1, NULL, 10);
+	}
+
+	if (since < m_oldestGeneration || since > m_generation) {
+			// we can't tell what changed, so send everything.
+		ClassAd *ad;
+		AdNameHashKey hk;
+		MyString hkString;
+		for (size_t ii = 0; ii < tables.size(); ++ii) {
+			tables[ii]->startIterations();
+			while (tables[ii]->iterate(hk, ad)) {
+				hk.sprint(hkString);
+				ads.push_back(ad);
+				keys.push_back(std::string(GetMyTypeName(*ad)) + " " + hkString.Value());
+			}
+		}
+		return false;
+	}
+
+		// walk back through the changes after the cookie, newest first, so
+		// that only the current state of an ad that changed more than once
+		// is sent.
+	std::set<CollectorHashTable*> wanted(tables.begin(), tables.end());
+	std::set<std::string> seen;
+	for (std::deque<ChangeRecord>::reverse_iterator it = m_changes.rbegin();
+		 it != m_changes.rend() && it->generation > since; ++it)
+	{
+		if (wanted.find(it->table) == wanted.end()) {
+			continue;
+		}
+		if ( ! seen.insert(it->key).second) {
+			continue;
+		}
+		ClassAd *ad = NULL;
+		if (it->table->lookup(it->hk, ad) == -1 || ! ad) {
+			removed.push_back(it->key);
+		} else {
+			ads.push_back(ad);
+			keys.push_back(it->key);
+		}
+	}
+	return true;
+}
+
 CollectorHashTable *CollectorEngine::findOrCreateTable(MyString &type)
 {
 	CollectorHashTable *table=0;
@@ -530,10 +932,9 @@ bool CollectorEngine::ValidateClassAd(int command,ClassAd *clientAd,Sock *sock)
 bool   last_updateClassAd_was_insert;
 
 ClassAd *CollectorEngine::
-collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,Sock *sock)
+collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,Sock *sock,ClassAd *pvtAd)
 {
 	ClassAd		*retVal;
-	ClassAd		*pvtAd;
 	int		insPvt;
 	AdNameHashKey		hk;
 	HashString	hashString;
@@ -581,18 +982,21 @@ collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,S
 		} else { CollectorEngine_rucc_updateAd_runtime.Add(rt.tick(rt_last)); }
 
 		// if we want to store private ads
-		if (!sock)
+		if (!sock && !pvtAd)
 		{
 			dprintf (D_ALWAYS, "Want private ads, but no socket given!\n");
 			break;
 		}
 		else
 		{
-			if (!(pvtAd = new ClassAd))
+			if (pvtAd) {
+				// the caller already has it (i.e. from a batch)
+			}
+			else if (!(pvtAd = new ClassAd))
 			{
 				EXCEPT ("Memory error!");
 			}
-			if( !getClassAd(sock, *pvtAd) )
+			else if( !getClassAd(sock, *pvtAd) )
 			{
 				dprintf(D_FULLDEBUG,"\t(Could not get startd's private ad)\n");
 				delete pvtAd;
@@ -947,6 +1351,219 @@ collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,S
 	return retVal;
 }
 
+bool CollectorEngine::
+collectStartdBatch (ClassAd *batchAd, ClassAd *pvtBatchAd, const condor_sockaddr& from,
+					Sock *sock, std::vector<ClassAd*> &collected)
+{
+	// take the slot ads out of the batch; what is left at the top of the
+	// batch is what all of the slots have in common
+	classad::ExprTree *slotList = batchAd->Remove(ATTR_STARTD_BATCH_SLOT_ADS);
+	if (!slotList || SkipExprEnvelope(slotList)->GetKind() != classad::ExprTree::EXPR_LIST_NODE) {
+		dprintf (D_ALWAYS, "Startd batch has no list of slot ads --- ignoring it\n");
+		delete slotList;
+		return false;
+	}
+	std::vector<classad::ExprTree*> slotAds;
+	((classad::ExprList*)SkipExprEnvelope(slotList))->GetComponents(slotAds);
+
+	classad::ExprTree *pvtList = NULL;
+	std::vector<classad::ExprTree*> pvtAds;
+	if (pvtBatchAd) {
+		pvtList = pvtBatchAd->Remove(ATTR_STARTD_BATCH_PRIVATE_ADS);
+		if (pvtList && SkipExprEnvelope(pvtList)->GetKind() == classad::ExprTree::EXPR_LIST_NODE) {
+			((classad::ExprList*)SkipExprEnvelope(pvtList))->GetComponents(pvtAds);
+		}
+	}
+
+	classad::ClassAd *sharedChanges = NULL;
+	classad::ExprTree *sharedTree = batchAd->Remove(ATTR_STARTD_BATCH_SHARED_CHANGES);
+	if (sharedTree && SkipExprEnvelope(sharedTree)->GetKind() == classad::ExprTree::CLASSAD_NODE) {
+		sharedChanges = (classad::ClassAd*)SkipExprEnvelope(sharedTree);
+	}
+
+	std::string address;
+	long long sequence = 0;
+	long long base = 0;
+	batchAd->LookupString(ATTR_MY_ADDRESS, address);
+	batchAd->LookupInteger(ATTR_STARTD_BATCH_SEQUENCE, sequence);
+	batchAd->LookupInteger(ATTR_STARTD_BATCH_BASE_SEQUENCE, base);
+	batchAd->Delete(ATTR_STARTD_BATCH_SEQUENCE);
+	batchAd->Delete(ATTR_STARTD_BATCH_BASE_SEQUENCE);
+
+	// changes can only be applied to the ads of the batch they were made
+	// against.  if we missed that one (a lost update, or we restarted),
+	// the changed slots stay as they are until the startd's next full
+	// batch, which we ask for rather than wait for UPDATE_INTERVAL
+	bool haveBase = false;
+	if (base != 0 && !address.empty()) {
+		StartdBatchState &state = m_startdBatches[address];
+		haveBase = (state.sequence == base);
+		if (!haveBase) {
+			dprintf (D_FULLDEBUG, "Startd batch %lld from %s has changes to batch %lld, "
+					 "which we don't have; ignoring the changes\n",
+					 sequence, address.c_str(), base);
+			requestFullStartdBatch(address, state, sequence);
+		}
+	}
+
+	// insert the authenticated user into the ads, as for a single update
+	const char* authn_user = sock ? sock->getFullyQualifiedUser() : NULL;
+	if (authn_user) {
+		batchAd->Assign("AuthenticatedIdentity", authn_user);
+		batchAd->Assign("AuthenticationMethod", sock->getAuthenticationMethodUsed());
+	} else {
+		batchAd->Delete("AuthenticatedIdentity");
+		batchAd->Delete("AuthenticationMethod");
+	}
+
+	int numSkipped = 0;
+	for (size_t i = 0; i < slotAds.size(); i++) {
+		classad::ExprTree *expr = SkipExprEnvelope(slotAds[i]);
+		if (expr->GetKind() != classad::ExprTree::CLASSAD_NODE) {
+			dprintf (D_ALWAYS, "Startd batch from %s has a slot that is not an ad --- ignoring it\n",
+					 address.c_str());
+			numSkipped++;
+			continue;
+		}
+		classad::ClassAd *slotAd = (classad::ClassAd*)expr;
+
+		bool full = (base == 0);
+		if (!full) {
+			slotAd->EvaluateAttrBool(ATTR_STARTD_BATCH_FULL, full);
+		}
+
+		ClassAd *ad = NULL;
+		if (full) {
+			ad = new ClassAd(*batchAd);
+		} else {
+			if (!haveBase) {
+				numSkipped++;
+				continue;
+			}
+
+			// start from the ad we have for this slot
+			ClassAd keyAd;
+			AdNameHashKey hk;
+			ClassAd *old_ad = NULL;
+			keyAd.CopyAttribute(ATTR_NAME, slotAd);
+			keyAd.CopyAttribute(ATTR_MY_ADDRESS, batchAd);
+			if (makeStartdAdHashKey(hk, &keyAd)) {
+				old_ad = lookup(STARTD_AD, hk);
+			}
+			if (!old_ad) {
+				dprintf (D_FULLDEBUG, "Startd batch from %s has changes to a slot we "
+						 "don't have --- ignoring them\n", address.c_str());
+				numSkipped++;
+				continue;
+			}
+			ad = new ClassAd(*old_ad);
+			ad->Delete(ATTR_LAST_HEARD_FROM);
+			ad->Update(*batchAd);
+			if (sharedChanges) {
+				ad->Update(*sharedChanges);
+			}
+		}
+		ad->Update(*slotAd);
+
+		std::string removed;
+		if (ad->LookupString(ATTR_STARTD_BATCH_REMOVED_ATTRS, removed)) {
+			StringList attrs(removed.c_str());
+			const char *attr;
+			attrs.rewind();
+			while ((attr = attrs.next())) {
+				ad->Delete(attr);
+			}
+		}
+		ad->Delete(ATTR_STARTD_BATCH_REMOVED_ATTRS);
+		ad->Delete(ATTR_STARTD_BATCH_FULL);
+
+		ClassAd *pvtAd = NULL;
+		if (i < pvtAds.size()) {
+			expr = SkipExprEnvelope(pvtAds[i]);
+			if (expr->GetKind() == classad::ExprTree::CLASSAD_NODE) {
+				pvtAd = new ClassAd(*pvtBatchAd);
+				pvtAd->Update(*(classad::ClassAd*)expr);
+			}
+		}
+
+		int insert = -3;
+		ClassAd *cad = collect(UPDATE_STARTD_AD, ad, from, insert, NULL, pvtAd);
+		if (!cad) {
+			delete ad;
+			delete pvtAd;
+			numSkipped++;
+			continue;
+		}
+		collected.push_back(cad);
+	}
+
+	if (base == 0 || haveBase) {
+		StartdBatchState &state = m_startdBatches[address];
+		state.sequence = sequence;
+		if (base == 0) {
+			state.fullRequested = 0;
+		}
+	}
+
+	dprintf (D_FULLDEBUG, "Startd batch %lld from %s: %d slot ads collected, %d skipped\n",
+			 sequence, address.c_str(), (int)collected.size(), numSkipped);
+
+	delete slotList;
+	delete pvtList;
+	delete sharedTree;
+	return true;
+}
+
+// ask a startd for a full batch.  the request may be lost, or the full
+// batch that answers it, so ask again if we are still missing changes a
+// minute later; the batches in between don't each need their own request.
+void CollectorEngine::
+requestFullStartdBatch (const std::string &address, StartdBatchState &state, long long sequence)
+{
+	time_t now = time(NULL);
+	if (state.fullRequested && now - state.fullRequested < 60) {
+		return;
+	}
+	state.fullRequested = now;
+
+	dprintf (D_FULLDEBUG, "Asking startd %s for a full batch\n", address.c_str());
+	ClassAd requestAd;
+	requestAd.Assign(ATTR_STARTD_BATCH_SEQUENCE, sequence);
+	classy_counted_ptr<Daemon> startd = new Daemon(DT_STARTD, address.c_str());
+	classy_counted_ptr<ClassAdMsg> msg = new ClassAdMsg(REQUEST_FULL_STARTD_BATCH, requestAd);
+	msg->setSuccessDebugLevel(D_FULLDEBUG);
+	msg->setTimeout(20);
+	startd->sendMsg(msg.get());
+}
+
+// forget the batch sequences of startds whose ads have all expired
+void CollectorEngine::
+pruneStartdBatches ()
+{
+	if (m_startdBatches.empty()) {
+		return;
+	}
+
+	std::set<std::string> addresses;
+	ClassAd *ad;
+	StartdAds.startIterations();
+	while (StartdAds.iterate(ad)) {
+		std::string address;
+		if (ad->LookupString(ATTR_MY_ADDRESS, address)) {
+			addresses.insert(address);
+		}
+	}
+
+	std::map<std::string, StartdBatchState>::iterator it = m_startdBatches.begin();
+	while (it != m_startdBatches.end()) {
+		if (addresses.count(it->first)) {
+			++it;
+		} else {
+			m_startdBatches.erase(it++);
+		}
+	}
+}
+
 ClassAd *CollectorEngine::
 lookup (AdTypes adType, AdNameHashKey &hk)
 {
@@ -990,7 +1607,10 @@ int CollectorEngine::remove (AdTypes t_AddType, const ClassAd & c_query, bool *q
 				hk.sprint( hkString );
 				iRet = !table->remove(hk);
 				dprintf (D_ALWAYS,"\t\t**** Removed(%d) ad(s): \"%s\"\n", iRet, hkString.Value() );
-				delete pAd;
+				CollectorAdIndex *index = indexFor(*table);
+				if (index) { index->remove(pAd); }
+				noteChange(*table, hk, pAd);
+				releaseAd(pAd);
 			}
 		}
 	}
@@ -1011,9 +1631,12 @@ int CollectorEngine::expire( AdTypes adType, const ClassAd & query, bool * query
 
             ClassAd * cAd = NULL;
             if( hTable->lookup( hKey, cAd ) != -1 ) {
+                cAd = writableAd( *hTable, hKey, cAd );
                 cAd->Assign( ATTR_LAST_HEARD_FROM, 1 );
-                
+
+                CollectorAdIndex *index = indexFor( *hTable );
                 if( CollectorDaemon::offline_plugin_.expire( * cAd ) == true ) {
+                    if( index ) { index->update( cAd ); }
                     return rVal;
                 }
                 
@@ -1028,7 +1651,9 @@ int CollectorEngine::expire( AdTypes adType, const ClassAd & query, bool * query
                 hKey.sprint( hkString );                
                 dprintf( D_ALWAYS, "\t\t**** Removed(%d) stale ad(s): \"%s\"\n", rVal, hkString.Value() );
 
-                delete cAd;
+                if( index ) { index->remove( cAd ); }
+                noteChange( *hTable, hKey, cAd );
+                releaseAd( cAd );
             }
         }
     }
@@ -1044,6 +1669,12 @@ remove (AdTypes adType, AdNameHashKey &hk)
 	if (!LookupByAdType(adType, table, func)) {
 		return 0;
 	}
+	CollectorAdIndex *index = indexFor(*table);
+	ClassAd *ad = NULL;
+	if (table->lookup(hk, ad) != -1) {
+		if (index) { index->remove(ad); }
+		noteChange(*table, hk, ad);
+	}
 	return !table->remove(hk);
 }
 
@@ -1086,6 +1717,8 @@ updateClassAd (CollectorHashTable &hashTable,
 	new_ad = ad;
 	last_updateClassAd_was_insert = false;
 
+	CollectorAdIndex *index = indexFor(hashTable);
+
 	// check if it already exists in the hash table ...
 	if ( hashTable.lookup (hk, old_ad) == -1)
 	{
@@ -1110,6 +1743,9 @@ updateClassAd (CollectorHashTable &hashTable,
 			new_ad->Assign( ATTR_LAST_FORWARDED, (int)time(NULL) );
 		}
 
+		if (index) { index->insert(new_ad); }
+		noteChange(hashTable, hk, new_ad);
+
 		return new_ad;
 	}
 	else
@@ -1157,9 +1793,15 @@ updateClassAd (CollectorHashTable &hashTable,
 			new_ad->Assign( ATTR_LAST_FORWARDED, forward ? (int)time(NULL) : last_forwarded );
 		}
 
+		if (index) {
+			index->remove(old_ad);
+			index->insert(new_ad);
+		}
+
 		if (isSelfAd(old_ad)) { __self_ad__ = new_ad; }
+		noteChange(hashTable, hk, new_ad);
 
-		delete old_ad;
+		releaseAd(old_ad);
 
 		insert = 0;
 		return new_ad;
@@ -1202,7 +1844,11 @@ mergeClassAd (CollectorHashTable &hashTable,
 		new_ad_copy.Delete(ATTR_TARGET_TYPE);
 
 		// Now, finally, merge the new ClassAd into the old one
+		old_ad = writableAd(hashTable, hk, old_ad);
 		MergeClassAds(old_ad,&new_ad_copy,true);
+
+		CollectorAdIndex *index = indexFor(hashTable);
+		if (index) { index->update(old_ad); }
 	}
 	delete new_ad;
 	return old_ad;
@@ -1227,6 +1873,7 @@ housekeeper()
 
 	dprintf (D_ALWAYS, "\tCleaning StartdAds ...\n");
 	cleanHashTable (StartdAds, now, makeStartdAdHashKey);
+	pruneStartdBatches ();
 
 	dprintf (D_ALWAYS, "\tCleaning StartdPrivateAds ...\n");
 	cleanHashTable (StartdPrivateAds, now, makeStartdAdHashKey);
@@ -1297,6 +1944,7 @@ cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey)
 	AdNameHashKey  hk;
 	double   timeDiff;
 	MyString	hkString;
+	CollectorAdIndex *index = indexFor(hashTable);
 
 	hashTable.startIterations ();
 	while (hashTable.iterate (ad))
@@ -1329,8 +1977,10 @@ cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey)
 				   potentially mark the ad absent. if expire() returns false, then delete
 				   the ad as planned; if it return true, it was likely marked as absent,
 				   so then this ad should NOT be deleted. */
+				ad = writableAd(hashTable, hk, ad);
 				if ( CollectorDaemon::offline_plugin_.expire( *ad ) == true ) {
 					// plugin say to not delete this ad, so continue
+					if (index) { index->update(ad); }
 					continue;
 				} else {
 					dprintf (D_ALWAYS,"\t\t**** Removing stale ad: \"%s\"\n", hkString.Value() );
@@ -1340,7 +1990,9 @@ cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey)
 			{
 				dprintf (D_ALWAYS, "\t\tError while removing ad\n");
 			}
-			delete ad;
+			if (index) { index->remove(ad); }
+			noteChange(hashTable, hk, ad);
+			releaseAd(ad);
 		}
 	}
 }
@@ -1427,9 +2079,10 @@ CollectorEngine::LookupByAdType(AdTypes adType,
 }
 
 
-static void
+void CollectorEngine::
 purgeHashTable( CollectorHashTable &table )
 {
+	CollectorAdIndex *index = indexFor(table);
 	ClassAd* ad;
 	AdNameHashKey hk;
 	table.startIterations();
@@ -1437,7 +2090,9 @@ purgeHashTable( CollectorHashTable &table )
 		if( table.remove(hk) == -1 ) {
 			dprintf( D_ALWAYS, "\t\tError while removing ad\n" );
 		}		
-		delete ad;
+		if( index ) { index->remove(ad); }
+		noteChange(table, hk, ad);
+		releaseAd(ad);
 	}
 }
 
@@ -26,6 +26,12 @@
 #include "condor_collector.h"
 #include "collector_stats.h"
 #include "hashkey.h"
+#include "collector_index.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
 
 class CollectorEngine : public Service
 {
@@ -41,9 +47,19 @@ class CollectorEngine : public Service
 	int invokeHousekeeper (AdTypes);
 	int invalidateAds(AdTypes, ClassAd &);
 
-	// perform the collect operation of the given command
+	// perform the collect operation of the given command.  for startd
+	// updates, the private ad is read from the socket unless it is given;
+	// a given private ad belongs to the engine if the public ad was collected
 	ClassAd *collect (int, Sock *, const condor_sockaddr&, int &);
-	ClassAd *collect (int, ClassAd *, const condor_sockaddr&, int &, Sock* = NULL);
+	ClassAd *collect (int, ClassAd *, const condor_sockaddr&, int &, Sock* = NULL, ClassAd *pvtAd = NULL);
+
+	// perform an UPDATE_STARTD_ADS_BATCH: rebuild the ads of each slot in
+	// the batch, from the batch alone or by applying the changes it carries
+	// to the ads we have, and collect them as UPDATE_STARTD_AD.  the slot
+	// ads that were collected are appended to the given vector.  returns
+	// false if the batch is malformed.
+	bool collectStartdBatch (ClassAd *batchAd, ClassAd *pvtBatchAd, const condor_sockaddr&,
+			Sock *, std::vector<ClassAd*> &collected);
 
 	// lookup classad in the specified table with the given hashkey
 	ClassAd *lookup (AdTypes, AdNameHashKey &);
@@ -72,6 +88,56 @@ class CollectorEngine : public Service
 	// walk specified hash table with the given visit procedure
 	int walkHashTable (AdTypes, int (*)(ClassAd *));
 
+	// walk only those ads in the specified table that the attribute indexes
+	// cannot rule out for the given constraint.  returns false (without
+	// walking anything) if the constraint cannot be answered from an index,
+	// in which case the caller should fall back to walkHashTable.
+	bool walkIndexedAds (AdTypes, classad::ExprTree *constraint, int (*)(ClassAd *), int &candidates);
+
+	// set the attributes to index (COLLECTOR_QUERY_INDEX_ATTRS) and rebuild
+	// the indexes if the list changed.
+	void configureIndexes (const char *attrs);
+
+	// refresh the index entries of an ad that was modified in place
+	// after it was inserted (i.e. by the offline plugin)
+	void reindexAd (ClassAd *ad);
+
+	// Snapshots let query threads read ads while the main thread goes on
+	// updating the tables.  beginSnapshot() fills in the ads in the given
+	// table that the constraint could match (using the attribute indexes
+	// when it can), and returns a token that must be passed to endSnapshot()
+	// when the reader is done with them.  While any snapshot is open, ads
+	// are never modified in place: they are copied and the copy replaces the
+	// original in the table, and ads that are removed are not deleted until
+	// every snapshot that might refer to them has ended.
+	// These must only be called on the main thread.
+	unsigned long beginSnapshot (AdTypes, classad::ExprTree *constraint, std::vector<ClassAd*> &ads);
+	void endSnapshot (unsigned long token);
+	bool hasSnapshots () const { return ! m_snapshots.empty(); }
+	size_t retiredAdCount () const { return m_retired.size(); }
+
+	// returns an ad that can be modified in place; when snapshots are open
+	// this is a copy of the given ad that has taken its place in the table.
+	ClassAd *getWritableAd (AdTypes, ClassAd *ad);
+
+	// open a snapshot of ads that the caller has already collected.
+	unsigned long holdSnapshot ();
+
+	// Delta queries let a client that keeps the ads between queries ask
+	// for only the ads that were added, changed or removed since its last
+	// query.  Every change to a table is recorded, with an increasing
+	// generation number, in a log of the last COLLECTOR_DELTA_LOG_LENGTH
+	// changes.  A client passes back the cookie from its last query;
+	// changesSince() fills in the ads of the given type that changed since
+	// then, with the keys that identify them to the client, and the keys of
+	// the ads that were removed.  If the cookie is from another collector
+	// (or an earlier run of this one), or the changes after it have dropped
+	// out of the log, it returns false and every ad of the type instead.
+	void setDeltaLogLength (int length);
+	std::string deltaCookie () const;
+	bool changesSince (AdTypes, const std::string &cookie, std::vector<ClassAd*> &ads,
+			std::vector<std::string> &keys, std::vector<std::string> &removed);
+
 	// register the collector's own ad pointer, and check to see if a given ad is that ad.
 	// this is used to allow us to recognise the collector ad during iteration and automatically
 	// insert fresh stats into it when it is fetched.
@@ -137,6 +203,7 @@ class CollectorEngine : public Service
 	void  housekeeper ();
 	int  housekeeperTimerID;
 	void cleanHashTable (CollectorHashTable &, time_t, HashFunc);
+	void purgeHashTable (CollectorHashTable &);
 	ClassAd* updateClassAd(CollectorHashTable&,const char*, const char *,
 						   ClassAd*,AdNameHashKey&, const MyString &, int &, 
 						   const condor_sockaddr& );
@@ -153,8 +220,55 @@ class CollectorEngine : public Service
 	// support for dynamically created tables
 	CollectorHashTable *findOrCreateTable(MyString &str);
 
+	// secondary indexes, keyed by the table they index. only the
+	// fixed tables are indexed, not the generic ones.
+	std::map<CollectorHashTable*, CollectorAdIndex*> m_indexes;
+	std::string m_indexAttrs;
+	CollectorAdIndex *indexFor(CollectorHashTable &table);
+
 	bool ValidateClassAd(int command,ClassAd *clientAd,Sock *sock);
 
+	// epoch based reclamation of ads for snapshots.  m_snapshots is the
+	// number of open snapshots that began in each epoch, m_retired is the
+	// ads that have been removed from the tables while snapshots were open,
+	// tagged with the epoch in which they were removed.
+	unsigned long m_epoch;
+	std::map<unsigned long, int> m_snapshots;
+	std::deque<std::pair<unsigned long, ClassAd*> > m_retired;
+	void releaseAd (ClassAd *ad);
+	void reclaimAds ();
+	ClassAd *writableAd (CollectorHashTable &table, AdNameHashKey &hk, ClassAd *ad);
+
+	// for each startd (by address) that sends batched updates, the sequence
+	// number of the last batch we applied (a batch of changes is only
+	// applied on top of the batch it was made against), and when we last
+	// asked it for a full batch because we couldn't.  an entry goes when
+	// the last of the startd's ads does.
+	struct StartdBatchState {
+		long long sequence;
+		time_t fullRequested;
+		StartdBatchState() : sequence(0), fullRequested(0) {}
+	};
+	std::map<std::string, StartdBatchState> m_startdBatches;
+	void requestFullStartdBatch (const std::string &address, StartdBatchState &state, long long sequence);
+	void pruneStartdBatches ();
+
+	// the log of changes for delta queries.  m_oldestGeneration is the
+	// generation after which every change is still in the log.
+	struct ChangeRecord {
+		long long generation;
+		CollectorHashTable *table;
+		AdNameHashKey hk;
+		std::string key;
+	};
+	std::deque<ChangeRecord> m_changes;
+	long long m_generation;
+	long long m_oldestGeneration;
+	size_t m_deltaLogLength;
+	std::string m_instance;
+	void noteChange (CollectorHashTable &table, AdNameHashKey &hk, ClassAd *ad);
+	void tablesFor (AdTypes, std::vector<CollectorHashTable*> &tables);
+
 	void* __self_ad__; // contains address of last Ad for this collector added to the hashtable, do NOT free from here
 					   // this pointer is only used to recognise this collector's ad during a condor_status query
 					   // so it's harmless if this pointer is out of date.
@@ -0,0 +1,235 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_classad.h"
+#include "condor_debug.h"
+#include "stl_string_utils.h"
+
+#include "collector_index.h"
+
+#include <algorithm>
+#include <iterator>
+
+// m_keys uses these for ads that don't have a bucket for a given attribute
+static const char * const KEY_ABSENT = "";
+static const char * const KEY_UNINDEXED = "?";
+
+void
+CollectorAdIndex::setAttributes(const std::vector<std::string> & attrs)
+{
+	clear();
+	m_attrs.clear();
+	for (size_t ii = 0; ii < attrs.size(); ++ii) {
+		if (attrs[ii].empty() || findAttr(attrs[ii]) >= 0) continue;
+		m_attrs.push_back(AttrIndex());
+		m_attrs.back().attr = attrs[ii];
+	}
+}
+
+void
+CollectorAdIndex::clear()
+{
+	for (size_t ii = 0; ii < m_attrs.size(); ++ii) {
+		m_attrs[ii].values.clear();
+		m_attrs[ii].unindexed.clear();
+	}
+	m_keys.clear();
+}
+
+int
+CollectorAdIndex::findAttr(const std::string & attr) const
+{
+	for (size_t ii = 0; ii < m_attrs.size(); ++ii) {
+		if (strcasecmp(m_attrs[ii].attr.c_str(), attr.c_str()) == 0) {
+			return (int)ii;
+		}
+	}
+	return -1;
+}
+
+// build the bucket key for a literal value, returns false if the value is
+// not of a type that we bucket.
+bool
+CollectorAdIndex::makeKey(const classad::Value & val, std::string & key)
+{
+	bool bval;
+	if (val.IsStringValue(key)) {
+		lower_case(key);
+		key.insert(0, "s");
+		return true;
+	}
+	if (val.IsBooleanValue(bval)) {
+		key = bval ? "b1" : "b0";
+		return true;
+	}
+	return false;
+}
+
+void
+CollectorAdIndex::insert(ClassAd * ad)
+{
+	if ( ! ad || m_attrs.empty()) return;
+	if (contains(ad)) { remove(ad); }
+
+	std::vector<std::string> & keys = m_keys[ad];
+	keys.resize(m_attrs.size());
+	for (size_t ii = 0; ii < m_attrs.size(); ++ii) {
+		AttrIndex & ix = m_attrs[ii];
+		classad::ExprTree * expr = ad->Lookup(ix.attr);
+		classad::Value val;
+		if ( ! expr) {
+			keys[ii] = KEY_ABSENT;
+		} else if (ExprTreeIsLiteral(expr, val) && makeKey(val, keys[ii])) {
+			ix.values[keys[ii]].insert(ad);
+		} else {
+			keys[ii] = KEY_UNINDEXED;
+			ix.unindexed.insert(ad);
+		}
+	}
+}
+
+void
+CollectorAdIndex::remove(ClassAd * ad)
+{
+	std::map<ClassAd*, std::vector<std::string> >::iterator it = m_keys.find(ad);
+	if (it == m_keys.end()) return;
+
+	const std::vector<std::string> & keys = it->second;
+	for (size_t ii = 0; ii < m_attrs.size() && ii < keys.size(); ++ii) {
+		AttrIndex & ix = m_attrs[ii];
+		if (keys[ii] == KEY_ABSENT) {
+			continue;
+		} else if (keys[ii] == KEY_UNINDEXED) {
+			ix.unindexed.erase(ad);
+		} else {
+			std::map<std::string, AdSet>::iterator vit = ix.values.find(keys[ii]);
+			if (vit != ix.values.end()) {
+				vit->second.erase(ad);
+				if (vit->second.empty()) { ix.values.erase(vit); }
+			}
+		}
+	}
+	m_keys.erase(it);
+}
+
+// returns true if the left and right operands of == or =?= are an indexed
+// attribute and a constant (in either order), and fills in the candidates.
+bool
+CollectorAdIndex::planEquality(classad::ExprTree * left, classad::ExprTree * right, AdSet & out) const
+{
+	std::string attr;
+	bool absolute = false;
+	classad::Value val;
+
+	left = SkipExprParens(left);
+	right = SkipExprParens(right);
+	if ( ! ExprTreeIsAttrRef(left, attr, &absolute)) {
+		std::swap(left, right);
+		if ( ! ExprTreeIsAttrRef(left, attr, &absolute)) {
+			return false;
+		}
+	}
+	if (absolute || ! ExprTreeIsLiteral(right, val)) {
+		return false;
+	}
+
+	int ix = findAttr(attr);
+	std::string key;
+	if (ix < 0 || ! makeKey(val, key)) {
+		return false;
+	}
+
+	const AttrIndex & index = m_attrs[ix];
+	out = index.unindexed;
+	std::map<std::string, AdSet>::const_iterator it = index.values.find(key);
+	if (it != index.values.end()) {
+		out.insert(it->second.begin(), it->second.end());
+	}
+	return true;
+}
+
+bool
+CollectorAdIndex::plan(classad::ExprTree * tree, AdSet & out) const
+{
+	tree = SkipExprParens(tree);
+	if ( ! tree || tree->GetKind() != classad::ExprTree::OP_NODE) {
+		return false;
+	}
+
+	classad::Operation::OpKind op;
+	classad::ExprTree *e1 = NULL, *e2 = NULL, *e3 = NULL;
+	((classad::Operation*)tree)->GetComponents(op, e1, e2, e3);
+
+	switch (op) {
+	case classad::Operation::EQUAL_OP:
+	case classad::Operation::META_EQUAL_OP:
+		return planEquality(e1, e2, out);
+
+	case classad::Operation::LOGICAL_AND_OP: {
+		// a conjunction can be answered if either side can be answered,
+		// when both can, the candidates are the intersection.
+		AdSet left, right;
+		bool has_left = plan(e1, left);
+		bool has_right = plan(e2, right);
+		if (has_left && has_right) {
+			out.clear();
+			std::set_intersection(left.begin(), left.end(), right.begin(), right.end(),
+				std::inserter(out, out.begin()));
+		} else if (has_left) {
+			out.swap(left);
+		} else if (has_right) {
+			out.swap(right);
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	case classad::Operation::LOGICAL_OR_OP: {
+		// a disjunction can only be answered if both sides can be.
+		AdSet right;
+		if ( ! plan(e1, out) || ! plan(e2, right)) {
+			return false;
+		}
+		out.insert(right.begin(), right.end());
+		return true;
+	}
+
+	default:
+		break;
+	}
+	return false;
+}
+
+bool
+CollectorAdIndex::lookup(classad::ExprTree * constraint, std::vector<ClassAd*> & candidates) const
+{
+	candidates.clear();
+	if (m_attrs.empty() || ! constraint) {
+		return false;
+	}
+
+	AdSet ads;
+	if ( ! plan(constraint, ads)) {
+		return false;
+	}
+	candidates.assign(ads.begin(), ads.end());
+	return true;
+}
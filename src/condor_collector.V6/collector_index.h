@@ -0,0 +1,85 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __COLLECTOR_INDEX_H__
+#define __COLLECTOR_INDEX_H__
+
+#include "condor_classad.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// A secondary index over the ads in one of the collector's hash tables.
+//
+// For each configured attribute, ads are bucketed by the literal value of
+// that attribute. Only string and boolean literals are bucketed, strings are
+// folded to lower case so that a bucket is a superset of the ads that can
+// match either == or =?= against a constant.  Ads where the attribute is an
+// expression, or a literal of some other type, go into a per-attribute
+// 'unindexed' set that is always included in the candidates for that attribute.
+//
+// The index only narrows the set of ads that a query must look at, the caller
+// is still expected to evaluate the full query constraint against every
+// candidate that lookup() returns.
+//
+class CollectorAdIndex
+{
+  public:
+	CollectorAdIndex() {};
+	~CollectorAdIndex() {};
+
+	// set the list of attributes to index, this also clears the index.
+	void setAttributes(const std::vector<std::string> & attrs);
+	bool isEnabled() const { return ! m_attrs.empty(); }
+
+	void insert(ClassAd * ad);
+	void remove(ClassAd * ad);
+	void update(ClassAd * ad) { remove(ad); insert(ad); }
+	bool contains(ClassAd * ad) const { return m_keys.find(ad) != m_keys.end(); }
+	void clear();
+	size_t size() const { return m_keys.size(); }
+
+	// If the constraint is an equality test of an indexed attribute against a
+	// string or boolean constant, or an && or || of such tests, fill in the
+	// candidate list and return true.  returns false if the index can't be used.
+	bool lookup(classad::ExprTree * constraint, std::vector<ClassAd*> & candidates) const;
+
+  private:
+	typedef std::set<ClassAd*> AdSet;
+
+	struct AttrIndex {
+		std::string attr;
+		std::map<std::string, AdSet> values;
+		AdSet unindexed;
+	};
+
+	int  findAttr(const std::string & attr) const;
+	bool plan(classad::ExprTree * tree, AdSet & out) const;
+	bool planEquality(classad::ExprTree * left, classad::ExprTree * right, AdSet & out) const;
+	static bool makeKey(const classad::Value & val, std::string & key);
+
+	std::vector<AttrIndex> m_attrs;
+	// the key each ad was indexed under for each attribute, so that we can
+	// remove an ad even after it has been modified in place.
+	std::map<ClassAd*, std::vector<std::string> > m_keys;
+};
+
+#endif // __COLLECTOR_INDEX_H__
@@ -0,0 +1,159 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_daemon_core.h"
+
+#include "collector_query_threads.h"
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+
+CollectorQueryThreads::CollectorQueryThreads(WorkFunc work, PumpWorkCallback done)
+	: m_work(work)
+	, m_done(done)
+	, m_stopping(false)
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_cond, NULL);
+}
+
+CollectorQueryThreads::~CollectorQueryThreads()
+{
+	shutdown();
+	pthread_cond_destroy(&m_cond);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+bool
+CollectorQueryThreads::supported()
+{
+	return true;
+}
+
+int
+CollectorQueryThreads::size() const
+{
+	return (int)m_threads.size();
+}
+
+int
+CollectorQueryThreads::grow(int num_threads)
+{
+	if (m_stopping) {
+		return size();
+	}
+
+	// from here on, dprintf may be called from more than one thread.
+	dprintf_make_thread_safe();
+
+	while ((int)m_threads.size() < num_threads) {
+		// the query threads should never see a signal, so block them all
+		// while we create the thread, it will inherit our signal mask.
+		sigset_t all_signals, old_mask;
+		sigfillset(&all_signals);
+		pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+
+		pthread_t thread;
+		int rval = pthread_create(&thread, NULL, threadMain, this);
+
+		pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+		if (rval != 0) {
+			dprintf(D_ALWAYS | D_FAILURE, "QueryWorker: failed to create query thread: %s (%d)\n",
+				strerror(rval), rval);
+			break;
+		}
+		m_threads.push_back(thread);
+	}
+	return size();
+}
+
+bool
+CollectorQueryThreads::submit(void * item)
+{
+	if (m_threads.empty() || m_stopping) {
+		return false;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_queue.push_back(item);
+	pthread_cond_signal(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+	return true;
+}
+
+void
+CollectorQueryThreads::shutdown()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stopping = true;
+	m_queue.clear();
+	pthread_cond_broadcast(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+
+	for (size_t ii = 0; ii < m_threads.size(); ++ii) {
+		pthread_join(m_threads[ii], NULL);
+	}
+	m_threads.clear();
+}
+
+void *
+CollectorQueryThreads::threadMain(void * arg)
+{
+	CollectorQueryThreads * pool = (CollectorQueryThreads *)arg;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->m_mutex);
+		while (pool->m_queue.empty() && ! pool->m_stopping) {
+			pthread_cond_wait(&pool->m_cond, &pool->m_mutex);
+		}
+		if (pool->m_stopping) {
+			pthread_mutex_unlock(&pool->m_mutex);
+			break;
+		}
+		void * item = pool->m_queue.front();
+		pool->m_queue.pop_front();
+		pthread_mutex_unlock(&pool->m_mutex);
+
+		pool->m_work(item);
+		daemonCore->Register_PumpWork_TS(pool->m_done, pool, item);
+	}
+	return NULL;
+}
+
+#else // no pthreads
+
+CollectorQueryThreads::CollectorQueryThreads(WorkFunc work, PumpWorkCallback done)
+	: m_work(work)
+	, m_done(done)
+{
+}
+
+CollectorQueryThreads::~CollectorQueryThreads()
+{
+}
+
+bool CollectorQueryThreads::supported() { return false; }
+int  CollectorQueryThreads::size() const { return 0; }
+int  CollectorQueryThreads::grow(int) { return 0; }
+bool CollectorQueryThreads::submit(void *) { return false; }
+void CollectorQueryThreads::shutdown() { }
+
+#endif
@@ -0,0 +1,79 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __COLLECTOR_QUERY_THREADS_H__
+#define __COLLECTOR_QUERY_THREADS_H__
+
+#include "condor_daemon_core.h"
+
+#include <deque>
+#include <vector>
+
+// A pool of threads for answering collector queries without forking.
+//
+// The main thread hands work items to the pool with submit().  A pool
+// thread calls the work function on the item, and then hands the item back
+// to the main thread by registering the done function as DaemonCore pump
+// work.  The pool does not limit how many items are in progress, the caller
+// is expected to do that (the collector uses the same worker limits as it
+// does for forked query workers).
+//
+// The work function must only do things that are safe to do off of the
+// main thread; in particular it must not call back into DaemonCore.
+//
+class CollectorQueryThreads
+{
+  public:
+	typedef void (*WorkFunc)(void * item);
+
+	CollectorQueryThreads(WorkFunc work, PumpWorkCallback done);
+	~CollectorQueryThreads();
+
+	// returns true if threads are supported on this platform
+	static bool supported();
+
+	// start more threads if there are fewer than num_threads. threads
+	// are never stopped until shutdown(), extra threads just sit idle.
+	int  grow(int num_threads);
+	int  size() const;
+
+	// queue an item for a pool thread, returns false if there are no threads.
+	bool submit(void * item);
+
+	// stop taking work, and wait for all of the threads to finish the item
+	// they are working on.  items still in the queue are not run, and are not
+	// handed back.
+	void shutdown();
+
+  private:
+	WorkFunc m_work;
+	PumpWorkCallback m_done;
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	static void * threadMain(void * arg);
+
+	pthread_mutex_t m_mutex;
+	pthread_cond_t  m_cond;
+	std::deque<void*> m_queue;
+	std::vector<pthread_t> m_threads;
+	bool m_stopping;
+#endif
+};
+
+#endif // __COLLECTOR_QUERY_THREADS_H__
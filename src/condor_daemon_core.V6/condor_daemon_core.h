@@ -64,12 +64,21 @@
 #include "counted_ptr.h"
 #include "daemon_keep_alive.h"
 #include <vector>
+#include <map>
 
 #include "../condor_procd/proc_family_io.h"
 class ProcFamilyInterface;
+class Selector;
 
 #if defined(WIN32)
 #include "pipe.WINDOWS.h"
+#elif defined(HAVE_PTHREADS)
+#include <pthread.h>
+#include <deque>
+#endif
+
+#ifdef CONDOR_HAVE_EPOLL
+#include <sys/epoll.h>
 #endif
 
 #define DEBUG_SETTABLE_ATTR_LISTS 0
@@ -150,6 +159,10 @@ typedef int		(*ThreadStartFunc)(void *,Stream*);
 ///
 typedef int     (*PumpWorkCallback)(void* cls, void* data);
 
+/// Register with Register_SelectWaitCallback. Called on the main thread with
+/// true just before DaemonCore waits in select(), and with false just after.
+typedef void    (*SelectWaitFunc)(bool waiting);
+
 /// Register with RegisterTimeSkipCallback. Call when clock skips.  First
 //variable is opaque data pointer passed to RegisterTimeSkipCallback.  Second
 //variable is the _rough_ unexpected change in time (negative for backwards).
@@ -995,6 +1008,12 @@ class DaemonCore : public Service
         void* cls, // intended to be the 'this' pointer when registering a static method in a class
         void* data); // intended for use as the data pointer
 
+    // register a function to call on the main thread just before and just after DaemonCore
+    // waits in select().  A daemon that has other threads reading its state can use this to
+    // let them do so while the main thread is idle.  There is only one such callback, pass
+    // NULL to remove it.
+    void Register_SelectWaitCallback(SelectWaitFunc func) { m_select_wait_func = func; }
+
     /** Not_Yet_Documented
         @param deltawhen       Not_Yet_Documented
         @param period          Not_Yet_Documented
@@ -1584,6 +1603,7 @@ class DaemonCore : public Service
 	   stats_entry_recent<double> TimerRuntime;   //  total time spent handling timers
 	   stats_entry_recent<double> SocketRuntime;  //  total time spent handling socket messages
 	   stats_entry_recent<double> PipeRuntime;    //  total time spent handling pipe messages
+	   stats_entry_recent<double> LoopOverhead;   //  total time spent finding the sockets and pipes that are ready
 
 	   stats_entry_recent<int> Signals;        //  number of signals handlers called
 	   stats_entry_recent<int> TimersFired;    //  number of timer handlers called
@@ -1924,6 +1944,36 @@ class DaemonCore : public Service
     int               nPipe;      // number of pipe handlers used
     ExtArray<PipeEnt> *pipeTable; // pipe table; grows dynamically if needed
 
+#ifdef CONDOR_HAVE_EPOLL
+	// When the Driver uses epoll, sockets and pipes stay in the epoll set from
+	// Register_Socket/Register_Pipe until Cancel_Socket/Cancel_Pipe, and each
+	// pass of the Driver only looks at the entries that epoll says are ready.
+	// Entries are tagged with EPOLL_TAG_SOCK + sockTable slot or
+	// EPOLL_TAG_PIPE + pipeHandleTable index.
+	int               m_epoll_fd;       // -1 when the Driver is using a Selector
+	pid_t             m_epoll_pid;      // process that created m_epoll_fd
+	std::map<int, std::pair<unsigned int, unsigned int> > m_epoll_fds; // fd -> (tag, events)
+	std::map<unsigned int, int> m_epoll_tags;      // tag -> fd
+	std::map<int, int> m_epoll_pipe_slots;         // pipeHandleTable index -> pipeTable slot
+	time_t            m_epoll_deadline_scan;       // time of the last socket deadline scan
+	time_t            m_epoll_min_deadline;        // earliest socket deadline at that time
+	bool              EpollInit();
+	void              EpollClose();
+	bool              EpollActive();
+	void              EpollWatch(unsigned int tag, int fd, unsigned int events);
+	void              EpollSyncSocket(int i);
+	void              EpollSyncPipe(int i);
+	void              EpollForgetPipe(int index);
+	std::vector<struct epoll_event> m_epoll_events; // filled in by epoll_wait
+	time_t            EpollMinDeadline(time_t now, time_t &timeout);
+	void              EpollFindReady(int nready, time_t now, time_t min_deadline,
+	                                 std::vector<int> &ready_socks, std::vector<int> &ready_pipes);
+#endif
+	bool              SockReadyToCall(int i, bool readable, bool writable,
+	                                  time_t now, bool superuser_command_arrived);
+	void              DispatchPipeHandler(int i, bool &recheck_status, Selector &selector, double &runtime);
+	void              DispatchSockHandler(int i, bool &recheck_status, Selector &selector, double &runtime);
+
     struct ReapEnt
     {
         int             num;
@@ -2021,11 +2071,22 @@ class DaemonCore : public Service
 
     __declspec(align(MEMORY_ALLOCATION_ALIGNMENT))
     SLIST_HEADER        PumpWorkHead; // list head for async PumpWorkCallback items.
-#else
-    // implement for non windows?
+#elif defined(HAVE_PTHREADS)
+    // PumpWorkItem is an item in the PumpWorkCallback queue.
+    // items can be added by any thread, so the queue is protected by PumpWorkMutex
+    struct PumpWorkItem
+    {
+        PumpWorkCallback callback;
+        void *           cls;
+        void *           data;
+    };
 
+    pthread_mutex_t          PumpWorkMutex;
+    std::deque<PumpWorkItem> PumpWorkQueue; // async PumpWorkCallback items, in FIFO order
+    pthread_t                dcmainThread;  // the thread running the main daemon core
 #endif
     int  DoPumpWork(); // call on main thread to handle all of work in the PumpWork list, returns number of callbacks handled
+    SelectWaitFunc m_select_wait_func; // see Register_SelectWaitCallback
             
     TimerManager &t;
     void                DumpTimerList(int, const char* = NULL);
@@ -40,6 +40,9 @@
 #include <sys/time.h>
 #endif
 
+#include <map>
+#include <vector>
+
 const   int     STAR = -1;
 
 //-----------------------------------------------------------------------------
@@ -84,7 +87,8 @@ struct tagTimer {
     /** Not_Yet_Documented */ TimerHandler             handler;
     /** Not_Yet_Documented */ TimerHandlercpp          handlercpp;
     /** Not_Yet_Documented */ class Service*    service; 
-    /** Not_Yet_Documented */ struct tagTimer*  next;
+    /** Position of this timer in the TimerManager's heap */ size_t heap_index;
+    /** Order in which timers with the same when were inserted */ unsigned long insert_seq;
     /** Not_Yet_Documented */ char*             event_descrip;
     /** Not_Yet_Documented */ void*             data_ptr;
     /** Not_Yet_Documented */ Timeslice *       timeslice;
@@ -247,19 +251,29 @@ class TimerManager
                   unsigned   period          =  0,
 				  const Timeslice *timeslice = NULL);
 
-	void RemoveTimer( Timer *timer, Timer *prev );
+	void RemoveTimer( Timer *timer );
 	void InsertTimer( Timer *new_timer );
 	void DeleteTimer( Timer *timer );
 
 	/*
 	  @param id The id of the timer to find
-	  @param prev If not NULL, this will be set to previous timer in list
 	  @return pointer to timer with specified id or NULL if not found
 	 */
-	Timer *GetTimer( int id, Timer **prev );
-
-    Timer*  timer_list;
-	Timer*  list_tail;
+	Timer *GetTimer( int id );
+
+	// helpers for the timer heap
+	static bool TimerBefore( const Timer *a, const Timer *b );
+	void HeapPlace( size_t ix, Timer *timer );
+	void HeapSiftUp( size_t ix );
+	void HeapSiftDown( size_t ix );
+
+	// pending timers as a binary min-heap ordered on when, with ties going
+	// to the timer that was inserted first.  timer_heap[0] is the next timer
+	// to fire.  each timer knows its own position, so removing one is
+	// O(log n) and does not require a search.
+	std::vector<Timer*> timer_heap;
+	std::map<int, Timer*> timers_by_id;
+	unsigned long timer_insert_seq;
     int     timer_ids;
     Timer*  in_timeout;
     bool    did_reset;
@@ -108,6 +108,8 @@ CRITICAL_SECTION Big_fat_mutex; // coarse grained mutex for debugging purposes
 #include "daemon_command.h"
 #include "condor_sockfunc.h"
 
+#include <algorithm>
+
 #if defined ( HAVE_SCHED_SETAFFINITY ) && !defined ( WIN32 )
 #include <sched.h>
 #endif
@@ -279,6 +281,16 @@ DaemonCore::DaemonCore(int PidSize, int ComSize,int SigSize,
 	InitializeSListHead(&PumpWorkHead);
 #else
 	mypid = ::getpid();
+#ifdef HAVE_PTHREADS
+	pthread_mutex_init(&PumpWorkMutex, NULL);
+	dcmainThread = pthread_self();
+#endif
+#endif
+#ifdef CONDOR_HAVE_EPOLL
+	m_epoll_fd = -1;
+	m_epoll_pid = 0;
+	m_epoll_deadline_scan = 0;
+	m_epoll_min_deadline = 0;
 #endif
 
 	// our pointer to the ProcFamilyInterface object is initially NULL. the
@@ -401,6 +413,7 @@ DaemonCore::DaemonCore(int PidSize, int ComSize,int SigSize,
 	m_super_dc_port = -1;
 	m_iMaxReapsPerCycle = 1;
     m_iMaxAcceptsPerCycle = 1;
+	m_select_wait_func = NULL;
 
 	m_MaxTimeSkip = 60 * 20;  // 20 minutes
 
@@ -489,6 +502,10 @@ DaemonCore::~DaemonCore()
 		m_shared_port_endpoint = NULL;
 	}
 
+#ifdef CONDOR_HAVE_EPOLL
+	EpollClose();
+#endif
+
 #ifndef WIN32
 	close(async_pipe[1]);
 	close(async_pipe[0]);
@@ -880,8 +897,21 @@ int DaemonCore::Register_PumpWork_TS(PumpWorkCallback handler, void* cls, void*
 		Do_Wake_up_select();
 	}
 	return 1;
+#elif defined(HAVE_PTHREADS)
+	PumpWorkItem work;
+	work.callback = handler;
+	work.cls = cls;
+	work.data = data;
+
+	pthread_mutex_lock(&PumpWorkMutex);
+	PumpWorkQueue.push_back(work);
+	pthread_mutex_unlock(&PumpWorkMutex);
+
+	if ( ! pthread_equal(pthread_self(), dcmainThread)) {
+		Do_Wake_up_select();
+	}
+	return 1;
 #else
-	// implement for non-windows?
 	dprintf(D_ALWAYS|D_FAILURE, "Register_PumpWork_TS(%p, %p, %p) called, but has not (yet) been implemented on this platform\n",
 			handler, cls, data);
 	return -1;
@@ -920,8 +950,22 @@ int DaemonCore::DoPumpWork() {
 		_aligned_free(last);
 	}
 	return citems;
+#elif defined(HAVE_PTHREADS)
+	// take the whole queue at once so that we don't hold the mutex while
+	// the callbacks run, work registered by the callbacks will be handled
+	// the next time around.
+	std::deque<PumpWorkItem> work;
+	pthread_mutex_lock(&PumpWorkMutex);
+	work.swap(PumpWorkQueue);
+	pthread_mutex_unlock(&PumpWorkMutex);
+
+	int citems = 0;
+	for (std::deque<PumpWorkItem>::iterator it = work.begin(); it != work.end(); ++it) {
+		it->callback(it->cls, it->data);
+		++citems;
+	}
+	return citems;
 #else
-	// implement for non-windows?
 	return 0;
 #endif
 }
@@ -1827,6 +1871,10 @@ int DaemonCore::Register_Socket(Stream *iosock, const char* iosock_descrip,
 	// Update curr_regdataptr for SetDataPtr()
 	curr_regdataptr = &((*sockTable)[i].data_ptr);
 
+#ifdef CONDOR_HAVE_EPOLL
+	EpollSyncSocket(i);
+#endif
+
 	// Conditionally dump what our table looks like
 	DumpSocketTable(D_FULLDEBUG | D_DAEMONCORE);
 
@@ -1906,6 +1954,10 @@ int DaemonCore::Cancel_Socket( Stream* insock, void *prev_entry)
 	if ( !prev_entry ) {
 		nRegisteredSocks--;		// decrement count of active sockets
 	}
+
+#ifdef CONDOR_HAVE_EPOLL
+	EpollSyncSocket(i);
+#endif
 	
 	DumpSocketTable(D_FULLDEBUG | D_DAEMONCORE);
 
@@ -2203,6 +2255,10 @@ int DaemonCore::Register_Pipe(int pipe_end, const char* pipe_descrip,
 	// Increment the counter of total number of entries
 	nPipe++;
 
+#ifdef CONDOR_HAVE_EPOLL
+	EpollSyncPipe(i);
+#endif
+
 	// Update curr_regdataptr for SetDataPtr()
 	curr_regdataptr = &((*pipeTable)[i].data_ptr);
 
@@ -2277,6 +2333,10 @@ int DaemonCore::Cancel_Pipe( int pipe_end )
 			"Cancel_Pipe: cancelled pipe end %d <%s> (entry=%d)\n",
 			pipe_end,(*pipeTable)[i].pipe_descrip, i );
 
+#ifdef CONDOR_HAVE_EPOLL
+	EpollForgetPipe(index);
+#endif
+
 	// Remove entry, move the last one in the list into this spot
 	(*pipeTable)[i].index = -1;
 	free( (*pipeTable)[i].pipe_descrip );
@@ -2324,6 +2384,13 @@ int DaemonCore::Cancel_Pipe( int pipe_end )
 	}
 	nPipe--;
 
+#ifdef CONDOR_HAVE_EPOLL
+	if ( i < nPipe ) {
+		// the last entry in the table was just moved into slot i
+		EpollSyncPipe(i);
+	}
+#endif
+
 #ifndef WIN32
 	// On Unix, pipe fds are passed into select.  So
 	// if we are a worker thread, wake up select in the main thread
@@ -3355,6 +3422,14 @@ void DaemonCore::Driver()
 		dprintf( D_ALWAYS, "Done with stdout & stderr tests\n" );
 	}
 
+#ifdef CONDOR_HAVE_EPOLL
+	// the sockets and pipes that were ready on the current pass
+	std::vector<int> ready_socks, ready_pipes;
+	if ( param_boolean( "DAEMON_CORE_USE_EPOLL", true ) ) {
+		EpollInit();
+	}
+#endif
+
 	double runtime = _condor_debug_get_time_double();
 	double group_runtime = runtime;
     double pump_cycle_begin_time = runtime;
@@ -3451,59 +3526,105 @@ void DaemonCore::Driver()
 		// Setup what socket descriptors to select on.  We recompute this
 		// every time because 1) some timeout handler may have removed/added
 		// sockets, and 2) it ain't that expensive....
-		selector.reset();
-		min_deadline = 0;
-		for (i = 0; i < nSock; i++) {
-				// NOTE: keep the following logic for building the
-				// fdset in sync with DaemonCore::ServiceCommandSocket()
-
-				// if a valid entry not already being serviced, add to select
-			if ( (*sockTable)[i].iosock && 
-				 (*sockTable)[i].servicing_tid==0 &&
-				 (*sockTable)[i].remove_asap == false ) {	
-					// Setup our fdsets
-				if ( (*sockTable)[i].is_reverse_connect_pending ) {
-					// nothing to do; we are just allowing this socket
-					// to be registered so that it behaves like a socket
-					// that is doing a non-blocking connect
-					// CCBClient will eventually ensure that the
-					// socket's registered callback function is called
-					// We want to ignore the socket's deadline (below)
-					// because that is all taken care of by CCBClient.
-					continue;
-				}
-				else if ( (*sockTable)[i].is_connect_pending ) {
-						// we want to be woken when a non-blocking
-						// connect is ready to write.  when connect
-						// is ready, select will set the writefd set
-						// on success, or the exceptfd set on failure.
-					selector.add_fd( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_WRITE );
-					selector.add_fd( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_EXCEPT );
-				} else {
-					int sockfd = (*sockTable)[i].iosock->get_file_desc();
-					switch( (*sockTable)[i].handler_type ) {
+		// When using epoll, the sockets and pipes are already in the epoll
+		// set, so all we need from the socket table is the earliest deadline.
+		bool use_epoll = false;
+#ifdef CONDOR_HAVE_EPOLL
+		use_epoll = EpollActive();
+		if ( use_epoll ) {
+			min_deadline = EpollMinDeadline(time(NULL), timeout);
+		}
+#endif
+		if ( ! use_epoll ) {
+			selector.reset();
+			min_deadline = 0;
+			for (i = 0; i < nSock; i++) {
+					// NOTE: keep the following logic for building the
+					// fdset in sync with DaemonCore::ServiceCommandSocket()
+
+					// if a valid entry not already being serviced, add to select
+				if ( (*sockTable)[i].iosock && 
+					 (*sockTable)[i].servicing_tid==0 &&
+					 (*sockTable)[i].remove_asap == false ) {	
+						// Setup our fdsets
+					if ( (*sockTable)[i].is_reverse_connect_pending ) {
+						// nothing to do; we are just allowing this socket
+						// to be registered so that it behaves like a socket
+						// that is doing a non-blocking connect
+						// CCBClient will eventually ensure that the
+						// socket's registered callback function is called
+						// We want to ignore the socket's deadline (below)
+						// because that is all taken care of by CCBClient.
+						continue;
+					}
+					else if ( (*sockTable)[i].is_connect_pending ) {
+							// we want to be woken when a non-blocking
+							// connect is ready to write.  when connect
+							// is ready, select will set the writefd set
+							// on success, or the exceptfd set on failure.
+						selector.add_fd( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_WRITE );
+						selector.add_fd( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_EXCEPT );
+					} else {
+						int sockfd = (*sockTable)[i].iosock->get_file_desc();
+						switch( (*sockTable)[i].handler_type ) {
+						case HANDLE_READ:
+							selector.add_fd( sockfd, Selector::IO_READ );
+							break;
+						case HANDLE_WRITE:
+							selector.add_fd( sockfd, Selector::IO_WRITE );
+							break;
+						case HANDLE_READ_WRITE:
+							selector.add_fd( sockfd, Selector::IO_READ );
+							selector.add_fd( sockfd, Selector::IO_WRITE );
+							break;
+						}
+					}
+
+						// If this socket times out sooner than
+						// our select timeout, adjust the select timeout.
+					time_t deadline = (*sockTable)[i].iosock->get_deadline();
+					if(deadline) { // If non-zero, there is a timeout.
+						if(min_deadline == 0 || min_deadline > deadline) {
+							min_deadline = deadline;
+						}
+					}
+	            }
+			}
+
+#if !defined(WIN32)
+			// Add the registered pipe fds into the list of descriptors to
+			// select on.
+			for (i = 0; i < nPipe; i++) {
+				if ( (*pipeTable)[i].index != -1 ) {	// if a valid entry....
+					int pipefd = (*pipeHandleTable)[(*pipeTable)[i].index];
+					switch( (*pipeTable)[i].handler_type ) {
 					case HANDLE_READ:
-						selector.add_fd( sockfd, Selector::IO_READ );
+						selector.add_fd( pipefd, Selector::IO_READ );
 						break;
 					case HANDLE_WRITE:
-						selector.add_fd( sockfd, Selector::IO_WRITE );
+						selector.add_fd( pipefd, Selector::IO_WRITE );
 						break;
 					case HANDLE_READ_WRITE:
-						selector.add_fd( sockfd, Selector::IO_READ );
-						selector.add_fd( sockfd, Selector::IO_WRITE );
+						selector.add_fd( pipefd, Selector::IO_READ );
+						selector.add_fd( pipefd, Selector::IO_WRITE );
 						break;
 					}
 				}
+	        }
+#endif
 
-					// If this socket times out sooner than
-					// our select timeout, adjust the select timeout.
-				time_t deadline = (*sockTable)[i].iosock->get_deadline();
-				if(deadline) { // If non-zero, there is a timeout.
-					if(min_deadline == 0 || min_deadline > deadline) {
-						min_deadline = deadline;
-					}
-				}
-            }
+
+			// Add the read side of async_pipe to the list of file descriptors to
+			// select on.  We write to async_pipe if a unix async signal
+			// is delivered after we unblock signals and before we block on select.
+#ifdef WIN32
+			if ( ! async_pipe[0].is_connected()) {
+				EXCEPT("DaemonCore:: async_pipe has been unexpectedly closed!");
+			} 
+			selector.add_fd( async_pipe[0].get_file_desc() , Selector::IO_READ );
+#else
+			selector.add_fd( async_pipe[0], Selector::IO_READ );
+#endif
 		}
 
 		if( min_deadline ) {
@@ -3514,43 +3635,13 @@ void DaemonCore::Driver()
 			}
 		}
 
-#if !defined(WIN32)
-		// Add the registered pipe fds into the list of descriptors to
-		// select on.
-		for (i = 0; i < nPipe; i++) {
-			if ( (*pipeTable)[i].index != -1 ) {	// if a valid entry....
-				int pipefd = (*pipeHandleTable)[(*pipeTable)[i].index];
-				switch( (*pipeTable)[i].handler_type ) {
-				case HANDLE_READ:
-					selector.add_fd( pipefd, Selector::IO_READ );
-					break;
-				case HANDLE_WRITE:
-					selector.add_fd( pipefd, Selector::IO_WRITE );
-					break;
-				case HANDLE_READ_WRITE:
-					selector.add_fd( pipefd, Selector::IO_READ );
-					selector.add_fd( pipefd, Selector::IO_WRITE );
-					break;
-				}
-			}
-        }
-#endif
-
-
-		// Add the read side of async_pipe to the list of file descriptors to
-		// select on.  We write to async_pipe if a unix async signal
-		// is delivered after we unblock signals and before we block on select.
-#ifdef WIN32
-		if ( ! async_pipe[0].is_connected()) {
-			EXCEPT("DaemonCore:: async_pipe has been unexpectedly closed!");
-		} 
-		selector.add_fd( async_pipe[0].get_file_desc() , Selector::IO_READ );
-#else
-		selector.add_fd( async_pipe[0], Selector::IO_READ );
-#endif
+		runtime = _condor_debug_get_time_double();
+		dc_stats.LoopOverhead += (runtime - group_runtime);
+		group_runtime = runtime;
 
 		// Let other threads run while we are waiting on select
 		CondorThreads::enable_parallel(true);
+		if (m_select_wait_func) { m_select_wait_func(true); }
 
 #if !defined(WIN32)
 		// Set aync_sigs_unblocked flag to true so that Send_Signal()
@@ -3567,8 +3658,6 @@ void DaemonCore::Driver()
 		LeaveCriticalSection(&Big_fat_mutex);
 #endif
 
-		selector.set_timeout( timeout );
-
 		errno = 0;
 		time_t time_before = time(NULL);
 		time_t okay_delta = timeout;
@@ -3580,7 +3669,19 @@ void DaemonCore::Driver()
 			dprintf(D_ALWAYS, "PERF: entering select\n");
 		}
 
-		selector.execute();
+		int epoll_nready = 0;
+		if ( use_epoll ) {
+#ifdef CONDOR_HAVE_EPOLL
+			int timeout_ms = -1;
+			if ( timeout < INT_MAX / 1000 ) {
+				timeout_ms = (int)timeout * 1000;
+			}
+			epoll_nready = epoll_wait( m_epoll_fd, &m_epoll_events[0], (int)m_epoll_events.size(), timeout_ms );
+#endif
+		} else {
+			selector.set_timeout( timeout );
+			selector.execute();
+		}
 
 		// update statistics on time spent waiting in select.
 		runtime = _condor_debug_get_time_double();
@@ -3603,7 +3704,14 @@ void DaemonCore::Driver()
 		// set it to FALSE after we block the signals again.
 		async_sigs_unblocked = FALSE;
 
-		if ( selector.failed() ) {
+		if ( use_epoll ) {
+			if ( epoll_nready < 0 && tmpErrno != EINTR ) {
+				dprintf(D_ALWAYS,"Socket Table:\n");
+				DumpSocketTable( D_ALWAYS );
+				EXCEPT("DaemonCore: epoll_wait() returned an unexpected error: %d (%s)",tmpErrno,strerror(tmpErrno));
+			}
+		}
+		else if ( selector.failed() ) {
 			// not just interrupted by a signal...
 				dprintf(D_ALWAYS,"Socket Table:\n");
         		DumpSocketTable( D_ALWAYS );
@@ -3649,17 +3757,24 @@ void DaemonCore::Driver()
 			// have questions ask matt.
 		if (IsDebugLevel(D_PERF_TRACE)) {
 			dprintf(D_ALWAYS, "PERF: leaving select\n");
-			selector.display();
+			if ( use_epoll ) {
+				dprintf(D_ALWAYS, "PERF: epoll_wait returned %d\n", epoll_nready);
+			} else {
+				selector.display();
+			}
 		}
 
 		// For now, do not let other threads run while we are processing
 		// in the main loop.
+		if (m_select_wait_func) { m_select_wait_func(false); }
 		CondorThreads::enable_parallel(false);
 
 		runtime = group_runtime = _condor_debug_get_time_double();
 
-		if ( selector.has_ready() ||
-			 ( selector.timed_out() && 
+		bool fds_ready = use_epoll ? (epoll_nready > 0) : selector.has_ready();
+		bool wait_timed_out = use_epoll ? (epoll_nready == 0) : selector.timed_out();
+		if ( fds_ready ||
+			 ( wait_timed_out && 
 			   min_deadline && min_deadline < time(NULL) ) )
 		{
 			// Either socket activity has happened or a socket
@@ -3673,303 +3788,695 @@ void DaemonCore::Driver()
 			bool recheck_status = false;
 			//bool call_soap_handler = false;
 
-			// If a command came in on the super-user command socket, then
-			// set a flag so in the loop below we only schedule command callbacks
-			// from this one socket for this daemoncore cycle.
-			bool superuser_command_arrived = false;
-			if (super_dc_rsock &&
-				selector.fd_ready(super_dc_rsock->get_file_desc(), Selector::IO_READ))
-			{
-				superuser_command_arrived = true;
-			}
-			if (super_dc_ssock &&
-				selector.fd_ready(super_dc_ssock->get_file_desc(), Selector::IO_READ))
-			{
-				superuser_command_arrived = true;
-			}
-			if ( superuser_command_arrived ) {
-				dprintf(D_ALWAYS,"Received a superuser command\n");
-			}
-
-			// scan through the socket table to find which ones select() set
-			for(i = 0; i < nSock; i++) {
-				if ( (*sockTable)[i].iosock && 
-					 (*sockTable)[i].servicing_tid==0 &&
-					 (*sockTable)[i].remove_asap == false ) 
-				{	// if a valid entry...
-					// figure out if we should call a handler.  to do this,
-					// if the socket was doing a connect(), we check the
-					// writefds and excepfds.  otherwise, check readfds.
-					(*sockTable)[i].call_handler = false;
-					time_t deadline = (*sockTable)[i].iosock->get_deadline();
-					bool sock_timed_out = ( deadline && deadline < now );
-
-					if ( superuser_command_arrived &&
-						 ((*sockTable)[i].iosock != super_dc_rsock &&
-						  (*sockTable)[i].iosock != super_dc_ssock) )
-					{
-						// do nothing for now, because we know there is a request pending
-						// on the suerperuser command socket, and this is not the
-						// superuser command socket.
-					}
-					else if ( (*sockTable)[i].is_reverse_connect_pending ) {
-						// nothing to do
-					}
-					else if ( (*sockTable)[i].is_connect_pending ) {
+			if ( use_epoll ) {
+#ifdef CONDOR_HAVE_EPOLL
+				// only the entries that epoll says are ready (or that
+				// have timed out) get their call_handler flag set.
+				EpollFindReady(epoll_nready, now, min_deadline, ready_socks, ready_pipes);
+#endif
+			} else {
+				// If a command came in on the super-user command socket, then
+				// set a flag so in the loop below we only schedule command callbacks
+				// from this one socket for this daemoncore cycle.
+				bool superuser_command_arrived = false;
+				if (super_dc_rsock &&
+					selector.fd_ready(super_dc_rsock->get_file_desc(), Selector::IO_READ))
+				{
+					superuser_command_arrived = true;
+				}
+				if (super_dc_ssock &&
+					selector.fd_ready(super_dc_ssock->get_file_desc(), Selector::IO_READ))
+				{
+					superuser_command_arrived = true;
+				}
+				if ( superuser_command_arrived ) {
+					dprintf(D_ALWAYS,"Received a superuser command\n");
+				}
 
-						if ( selector.fd_ready( (*sockTable)[i].iosock->get_file_desc(),
-												Selector::IO_WRITE ) ||
-							 selector.fd_ready( (*sockTable)[i].iosock->get_file_desc(),
-												Selector::IO_EXCEPT ) ||
-							 sock_timed_out )
+				// scan through the socket table to find which ones select() set
+				for(i = 0; i < nSock; i++) {
+					if ( (*sockTable)[i].iosock && 
+						 (*sockTable)[i].servicing_tid==0 &&
+						 (*sockTable)[i].remove_asap == false ) 
+					{	// if a valid entry...
+						// figure out if we should call a handler.  to do this,
+						// if the socket was doing a connect(), we check the
+						// writefds and excepfds.  otherwise, check readfds.
+						int sockfd = (*sockTable)[i].iosock->get_file_desc();
+						bool readable = selector.fd_ready( sockfd, Selector::IO_READ );
+						bool writable = selector.fd_ready( sockfd, Selector::IO_WRITE ) ||
+						                selector.fd_ready( sockfd, Selector::IO_EXCEPT );
+						(*sockTable)[i].call_handler =
+							SockReadyToCall( i, readable, writable, now, superuser_command_arrived );
+					}	// end of if valid sock entry
+				}	// end of for loop through all sock entries
+
+				// scan through the pipe table to find which ones select() set
+				for(i = 0; i < nPipe; i++) {
+					if ( (*pipeTable)[i].index != -1 ) {	// if a valid entry...
+						// figure out if we should call a handler.
+						(*pipeTable)[i].call_handler = false;
+#ifdef WIN32
+						// For Windows, check if our pidwatcher thread set the flag
+						ASSERT( (*pipeTable)[i].pentry );
+						if (InterlockedExchange(&((*pipeTable)[i].pentry->pipeReady),0L))
 						{
-							// A connection pending socket has been
-							// set or the connection attempt has timed out.
-							// Only call handler if CEDAR confirms the
-							// connect algorithm has completed.
-
-							if ( ((Sock *)(*sockTable)[i].iosock)->
-							      do_connect_finish() != CEDAR_EWOULDBLOCK)
-							{
-								(*sockTable)[i].call_handler = true;
-							}
+							// pipeReady flag was set by the pidwatcher thread.
+							(*pipeTable)[i].call_handler = true;
 						}
-					} else if ((*sockTable)[i].handler_type == HANDLE_READ || (*sockTable)[i].handler_type == HANDLE_READ_WRITE) {
-						if ( (selector.fd_ready( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_READ ) ) ||
-							 sock_timed_out )
+#else
+						// For Unix, check if select set the bit
+						int pipefd = (*pipeHandleTable)[(*pipeTable)[i].index];
+						if ( selector.fd_ready( pipefd, Selector::IO_READ ) )
 						{
-							(*sockTable)[i].call_handler = true;
+							(*pipeTable)[i].call_handler = true;
 						}
-					} else if ((*sockTable)[i].handler_type == HANDLE_WRITE || (*sockTable)[i].handler_type == HANDLE_READ_WRITE) {
-						if ( (selector.fd_ready( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_WRITE ) ) ||
-							 sock_timed_out )
+						if ( selector.fd_ready( pipefd, Selector::IO_WRITE ) )
 						{
-							(*sockTable)[i].call_handler = true;
+							(*pipeTable)[i].call_handler = true;
 						}
-					}
-				}	// end of if valid sock entry
-			}	// end of for loop through all sock entries
+#endif
+					}	// end of if valid pipe entry
+				}	// end of for loop through all pipe entries
+			}
 
 			runtime = _condor_debug_get_time_double();
-			dc_stats.SocketRuntime += (runtime - group_runtime);
+			dc_stats.LoopOverhead += (runtime - group_runtime);
 			group_runtime = runtime;
 
-			// scan through the pipe table to find which ones select() set
-			for(i = 0; i < nPipe; i++) {
-				if ( (*pipeTable)[i].index != -1 ) {	// if a valid entry...
-					// figure out if we should call a handler.
-					(*pipeTable)[i].call_handler = false;
-#ifdef WIN32
-					// For Windows, check if our pidwatcher thread set the flag
-					ASSERT( (*pipeTable)[i].pentry );
-					if (InterlockedExchange(&((*pipeTable)[i].pentry->pipeReady),0L))
-					{
-						// pipeReady flag was set by the pidwatcher thread.
-						(*pipeTable)[i].call_handler = true;
+			// Now loop through all pipe entries, calling handlers if required.
+			if ( use_epoll ) {
+#ifdef CONDOR_HAVE_EPOLL
+				// ready_pipes holds pipe handle indexes rather than pipeTable
+				// slots, because Cancel_Pipe moves entries around in the table.
+				for (size_t k = 0; k < ready_pipes.size(); k++) {
+					std::map<int,int>::iterator it = m_epoll_pipe_slots.find(ready_pipes[k]);
+					if ( it != m_epoll_pipe_slots.end() && (*pipeTable)[it->second].call_handler ) {
+						DispatchPipeHandler( it->second, recheck_status, selector, runtime );
 					}
-#else
-					// For Unix, check if select set the bit
-					int pipefd = (*pipeHandleTable)[(*pipeTable)[i].index];
-					if ( selector.fd_ready( pipefd, Selector::IO_READ ) )
+				}
+#endif
+			} else {
+				for(i = 0; i < nPipe; i++) {
+					if ( (*pipeTable)[i].index != -1 &&	// if a valid entry...
+						 (*pipeTable)[i].call_handler )
 					{
-						(*pipeTable)[i].call_handler = true;
+						DispatchPipeHandler( i, recheck_status, selector, runtime );
+
+						if ( (*pipeTable)[i].call_handler == true ) {
+							// looks like the handler called Cancel_Pipe(),
+							// and now entry i no longer points to what we
+							// think it points to.  Decrement i now, so when
+							// we loop back we do not miss calling a handler.
+							i--;
+						}
 					}
-					if ( selector.fd_ready( pipefd, Selector::IO_WRITE ) )
+				}
+			}
+
+			runtime = _condor_debug_get_time_double();
+			dc_stats.PipeRuntime += (runtime - group_runtime);
+			group_runtime = runtime;
+
+			// Now loop through all sock entries, calling handlers if required.
+			if ( use_epoll ) {
+#ifdef CONDOR_HAVE_EPOLL
+				for (size_t k = 0; k < ready_socks.size(); k++) {
+					i = ready_socks[k];
+					if ( i < nSock && (*sockTable)[i].iosock && (*sockTable)[i].call_handler ) {
+						DispatchSockHandler( i, recheck_status, selector, runtime );
+					}
+				}
+#endif
+			} else {
+				for(i = 0; i < nSock; i++) {
+					if ( (*sockTable)[i].iosock &&	// if a valid entry...
+						 (*sockTable)[i].call_handler )
 					{
-						(*pipeTable)[i].call_handler = true;
+						DispatchSockHandler( i, recheck_status, selector, runtime );
 					}
+				}
+			}
+
+			runtime = _condor_debug_get_time_double();
+			dc_stats.SocketRuntime += (runtime - group_runtime);
+			group_runtime = runtime;
+
+
+		}	// if rv > 0
+
+		dc_stats.PumpCycle += (runtime - pump_cycle_begin_time);
+		pump_cycle_begin_time = runtime;
+
+	}	// end of infinite for loop
+}
+
+#ifdef CONDOR_HAVE_EPOLL
+// Each entry in the epoll set is tagged with what it is and the fd that it
+// was added for.  The low 30 bits of the tag are the sockTable slot or the
+// pipeHandleTable index.
+static const unsigned int EPOLL_TAG_KEY   = 0x3fffffff;
+static const unsigned int EPOLL_TAG_KIND  = 0xc0000000;
+static const unsigned int EPOLL_TAG_ASYNC = 0x00000000;
+static const unsigned int EPOLL_TAG_SOCK  = 0x40000000;
+static const unsigned int EPOLL_TAG_PIPE  = 0x80000000;
+
+// most ready fds that we take from the kernel on one pass of the Driver,
+// any others are still ready on the next pass.
+static const size_t EPOLL_MAX_EVENTS = 1024;
 #endif
-				}	// end of if valid pipe entry
-			}	// end of for loop through all pipe entries
 
+// Decide whether the handler for sockTable entry i should be called, given
+// whether the socket is readable and writable (or in error).  A socket whose
+// deadline has passed is treated as ready.
+bool
+DaemonCore::SockReadyToCall( int i, bool readable, bool writable,
+                             time_t now, bool superuser_command_arrived )
+{
+	SockEnt & ent = (*sockTable)[i];
+	if ( ! ent.iosock || ent.servicing_tid != 0 || ent.remove_asap ) {
+		return false;
+	}
 
-			// Now loop through all pipe entries, calling handlers if required.
-			runtime = _condor_debug_get_time_double();
-			for(i = 0; i < nPipe; i++) {
-				if ( (*pipeTable)[i].index != -1 ) {	// if a valid entry...
+	time_t deadline = ent.iosock->get_deadline();
+	bool sock_timed_out = ( deadline && deadline < now );
 
-					if ( (*pipeTable)[i].call_handler ) {
+	if ( superuser_command_arrived &&
+		 (ent.iosock != super_dc_rsock && ent.iosock != super_dc_ssock) )
+	{
+		// do nothing for now, because we know there is a request pending
+		// on the suerperuser command socket, and this is not the
+		// superuser command socket.
+		return false;
+	}
+	if ( ent.is_reverse_connect_pending ) {
+		// nothing to do
+		return false;
+	}
+	if ( ent.is_connect_pending ) {
+		if ( writable || sock_timed_out ) {
+			// A connection pending socket has been
+			// set or the connection attempt has timed out.
+			// Only call handler if CEDAR confirms the
+			// connect algorithm has completed.
+			int rval = ent.iosock->do_connect_finish();
+#ifdef CONDOR_HAVE_EPOLL
+			if ( rval == CEDAR_EWOULDBLOCK ) {
+				// CEDAR retries a failed connect on a new socket, which
+				// may or may not have the same fd as the old one.
+				EpollWatch(EPOLL_TAG_SOCK | (unsigned int)i, -1, 0);
+				EpollSyncSocket(i);
+			}
+#endif
+			return rval != CEDAR_EWOULDBLOCK;
+		}
+		return false;
+	}
+	if ( ent.handler_type == HANDLE_READ || ent.handler_type == HANDLE_READ_WRITE ) {
+		return readable || sock_timed_out;
+	}
+	if ( ent.handler_type == HANDLE_WRITE ) {
+		return writable || sock_timed_out;
+	}
+	return false;
+}
 
-						(*pipeTable)[i].call_handler = false;
+// Call the handler for pipeTable entry i, which the Driver has marked with
+// call_handler.
+void
+DaemonCore::DispatchPipeHandler( int i, bool & recheck_status, Selector & selector, double & runtime )
+{
+	(*pipeTable)[i].call_handler = false;
 
-                        dc_stats.PipeMessages += 1;
-
-						// save the pentry on the stack, since we'd otherwise lose it
-						// if the user's handler call Cancel_Pipe().
-						PidEntry* saved_pentry = (*pipeTable)[i].pentry;
-
-						if ( recheck_status || saved_pentry ) {
-							// we have already called at least one callback handler.  what
-							// if this handler drained this registed pipe, so that another
-							// read on the pipe could block?  to prevent this, we need
-							// to check one more time to make certain the pipe is ready
-							// for reading.
-							// NOTE: we also enter this code if saved_pentry != NULL.
-							//       why?  because that means we are on Windows, and
-							//       on Windows we need to check because pipes are
-							//       signalled not by select() but by our pidwatcher
-							//       thread, which may have signaled this pipe ready
-							//       when were in a timer handler or whatever.
+	dc_stats.PipeMessages += 1;
+
+	// save the pentry on the stack, since we'd otherwise lose it
+	// if the user's handler call Cancel_Pipe().
+	PidEntry* saved_pentry = (*pipeTable)[i].pentry;
+
+	if ( recheck_status || saved_pentry ) {
+		// we have already called at least one callback handler.  what
+		// if this handler drained this registed pipe, so that another
+		// read on the pipe could block?  to prevent this, we need
+		// to check one more time to make certain the pipe is ready
+		// for reading.
+		// NOTE: we also enter this code if saved_pentry != NULL.
+		//       why?  because that means we are on Windows, and
+		//       on Windows we need to check because pipes are
+		//       signalled not by select() but by our pidwatcher
+		//       thread, which may have signaled this pipe ready
+		//       when were in a timer handler or whatever.
 #ifdef WIN32
-							// WINDOWS
-							if (!saved_pentry->pipeEnd->io_ready()) {
-								// hand this pipe end back to the PID-watcher thread
-								WatchPid(saved_pentry);
-								continue;
-							}
+		// WINDOWS
+		if (!saved_pentry->pipeEnd->io_ready()) {
+			// hand this pipe end back to the PID-watcher thread
+			WatchPid(saved_pentry);
+			return;
+		}
 
 #else
-							// UNIX
-							int pipefd = (*pipeHandleTable)[(*pipeTable)[i].index];
-							selector.reset();
-							selector.set_timeout( 0 );
-							selector.add_fd( pipefd, Selector::IO_READ );
-							selector.execute();
-							if ( selector.timed_out() ) {
-								// nothing available, try the next entry...
-								continue;
-							}
+		// UNIX
+		int pipefd = (*pipeHandleTable)[(*pipeTable)[i].index];
+		selector.reset();
+		selector.set_timeout( 0 );
+		selector.add_fd( pipefd, Selector::IO_READ );
+		selector.execute();
+		if ( selector.timed_out() ) {
+			// nothing available, try the next entry...
+			return;
+		}
 #endif
-						}	// end of if ( recheck_status || saved_pentry )
+	}	// end of if ( recheck_status || saved_pentry )
 
-						(*pipeTable)[i].in_handler = true;
+	(*pipeTable)[i].in_handler = true;
 
-						// log a message
-						int pipe_end = (*pipeTable)[i].index + PIPE_INDEX_OFFSET;
-						dprintf(D_COMMAND,"Calling pipe Handler <%s> for Pipe end=%d <%s>\n",
-									(*pipeTable)[i].handler_descrip,
-									pipe_end,
-									(*pipeTable)[i].pipe_descrip);
+	// log a message
+	int pipe_end = (*pipeTable)[i].index + PIPE_INDEX_OFFSET;
+	dprintf(D_COMMAND,"Calling pipe Handler <%s> for Pipe end=%d <%s>\n",
+				(*pipeTable)[i].handler_descrip,
+				pipe_end,
+				(*pipeTable)[i].pipe_descrip);
 
-						// Update curr_dataptr for GetDataPtr()
-						curr_dataptr = &( (*pipeTable)[i].data_ptr);
-						recheck_status = true;
-						if ( (*pipeTable)[i].handler )
-							// a C handler
-							(*( (*pipeTable)[i].handler))( (*pipeTable)[i].service, pipe_end);
-						else
-						if ( (*pipeTable)[i].handlercpp )
-							// a C++ handler
-							((*pipeTable)[i].service->*( (*pipeTable)[i].handlercpp))(pipe_end);
-						else
-						{
-							// no handler registered
-							EXCEPT("No pipe handler callback");
-						}
+	// Update curr_dataptr for GetDataPtr()
+	curr_dataptr = &( (*pipeTable)[i].data_ptr);
+	recheck_status = true;
+	if ( (*pipeTable)[i].handler )
+		// a C handler
+		(*( (*pipeTable)[i].handler))( (*pipeTable)[i].service, pipe_end);
+	else
+	if ( (*pipeTable)[i].handlercpp )
+		// a C++ handler
+		((*pipeTable)[i].service->*( (*pipeTable)[i].handlercpp))(pipe_end);
+	else
+	{
+		// no handler registered
+		EXCEPT("No pipe handler callback");
+	}
 
-						dprintf(D_COMMAND,"Return from pipe Handler\n");
+	dprintf(D_COMMAND,"Return from pipe Handler\n");
 
-						(*pipeTable)[i].in_handler = false;
+	(*pipeTable)[i].in_handler = false;
 
-						// Make sure we didn't leak our priv state
-						CheckPrivState();
+	// Make sure we didn't leak our priv state
+	CheckPrivState();
 
-						// Clear curr_dataptr
-						curr_dataptr = NULL;
+	// Clear curr_dataptr
+	curr_dataptr = NULL;
 
 #ifdef WIN32
-						// Ask a pid watcher thread to watch over this pipe
-						// handle.  Note that if Cancel_Pipe() was called by the
-						// handler above, pipeEnd will be NULL, so we stop
-						// watching
-						MSC_SUPPRESS_WARNING(6011) // can't sure sure that save_pentry is not NULL
-						if ( saved_pentry->pipeEnd ) {
-							WatchPid(saved_pentry);
-						}
+	// Ask a pid watcher thread to watch over this pipe
+	// handle.  Note that if Cancel_Pipe() was called by the
+	// handler above, pipeEnd will be NULL, so we stop
+	// watching
+	MSC_SUPPRESS_WARNING(6011) // can't sure sure that save_pentry is not NULL
+	if ( saved_pentry->pipeEnd ) {
+		WatchPid(saved_pentry);
+	}
 #endif
 
-						// update per-handler runtime statistics
-						runtime = dc_stats.AddRuntime((*pipeTable)[i].handler_descrip, runtime);
+	// update per-handler runtime statistics
+	runtime = dc_stats.AddRuntime((*pipeTable)[i].handler_descrip, runtime);
+}
 
-						if ( (*pipeTable)[i].call_handler == true ) {
-							// looks like the handler called Cancel_Pipe(),
-							// and now entry i no longer points to what we
-							// think it points to.  Decrement i now, so when
-							// we loop back we do not miss calling a handler.
-							i--;
-						}
+// Call the handler for sockTable entry i, which the Driver has marked with
+// call_handler.
+void
+DaemonCore::DispatchSockHandler( int i, bool & recheck_status, Selector & selector, double & runtime )
+{
+	(*sockTable)[i].call_handler = false;
 
-					}	// if call_handler is True
-				}	// if valid entry in pipeTable
-			}	// for 0 thru nPipe checking if call_handler is true
+	dc_stats.SockMessages += 1;
 
+	if ( recheck_status && ((*sockTable)[i].handler_type == HANDLE_READ) &&
+		 ((*sockTable)[i].is_connect_pending == false) )
+	{
+		// we have already called at least one callback handler.  what
+		// if this handler drained this registed pipe, so that another
+		// read on the pipe could block?  to prevent this, we need
+		// to check one more time to make certain the pipe is ready
+		// for reading.
+		selector.reset();
+		selector.set_timeout( 0 );// set timeout for a poll
+		selector.add_fd( (*sockTable)[i].iosock->get_file_desc(),
+						 Selector::IO_READ );
 
-			runtime = _condor_debug_get_time_double();
-			dc_stats.PipeRuntime += (runtime - group_runtime);
-			group_runtime = runtime;
+		selector.execute();
+		if ( selector.timed_out() ) {
+			// nothing available, try the next entry...
+			return;
+		}
+	}
 
-			// Now loop through all sock entries, calling handlers if required.
-			for(i = 0; i < nSock; i++) {
-				if ( (*sockTable)[i].iosock ) {	// if a valid entry...
+	// ok, select says this socket table entry has new data.
+
+	// if this sock is a safe_sock, then call the method
+	// to enqueue this packet into the buffers.  if a complete
+	// message is not yet ready, then do not yet call a handler.
+	if ( (*sockTable)[i].iosock->type() == Stream::safe_sock )
+	{
+		SafeSock* ss = (SafeSock *)(*sockTable)[i].iosock;
+		// call handle_incoming_packet to consume the packet.
+		// it returns true if there is a complete message ready,
+		// otherwise it returns false.
+		if ( !(ss->handle_incoming_packet()) ) {
+			// there is not yet a complete message ready.
+			// so go back to the outer for loop - do not
+			// call the user handler yet.
+			return;
+		}
+	}
 
-					if ( (*sockTable)[i].call_handler ) {
+	recheck_status = true;
+	CallSocketHandler( i, true );
 
-						(*sockTable)[i].call_handler = false;
+	// update per-handler runtime statistics
+	runtime = dc_stats.AddRuntime((*sockTable)[i].handler_descrip, runtime);
+}
 
-                        dc_stats.SockMessages += 1;
+#ifdef CONDOR_HAVE_EPOLL
 
-						if ( recheck_status && ((*sockTable)[i].handler_type == HANDLE_READ) &&
-							 ((*sockTable)[i].is_connect_pending == false) )
-						{
-							// we have already called at least one callback handler.  what
-							// if this handler drained this registed pipe, so that another
-							// read on the pipe could block?  to prevent this, we need
-							// to check one more time to make certain the pipe is ready
-							// for reading.
-							selector.reset();
-							selector.set_timeout( 0 );// set timeout for a poll
-							selector.add_fd( (*sockTable)[i].iosock->get_file_desc(),
-											 Selector::IO_READ );
-
-							selector.execute();
-							if ( selector.timed_out() ) {
-								// nothing available, try the next entry...
-								continue;
-							}
-						}
+bool
+DaemonCore::EpollInit()
+{
+	EpollClose();
 
-						// ok, select says this socket table entry has new data.
+	m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if ( m_epoll_fd == -1 ) {
+		dprintf(D_ALWAYS, "DaemonCore: epoll_create1 failed, will use select instead: %s (errno=%d)\n",
+				strerror(errno), errno);
+		return false;
+	}
+	m_epoll_pid = ::getpid();
+	m_epoll_deadline_scan = 0;
+	m_epoll_min_deadline = 0;
+	m_epoll_events.resize(EPOLL_MAX_EVENTS);
 
-						// if this sock is a safe_sock, then call the method
-						// to enqueue this packet into the buffers.  if a complete
-						// message is not yet ready, then do not yet call a handler.
-						if ( (*sockTable)[i].iosock->type() == Stream::safe_sock )
-						{
-							SafeSock* ss = (SafeSock *)(*sockTable)[i].iosock;
-							// call handle_incoming_packet to consume the packet.
-							// it returns true if there is a complete message ready,
-							// otherwise it returns false.
-							if ( !(ss->handle_incoming_packet()) ) {
-								// there is not yet a complete message ready.
-								// so go back to the outer for loop - do not
-								// call the user handler yet.
-								continue;
-							}
-						}
+	EpollWatch(EPOLL_TAG_ASYNC, async_pipe[0], EPOLLIN);
+	for (int i = 0; i < nSock; i++) {
+		EpollSyncSocket(i);
+	}
+	for (int i = 0; i < nPipe; i++) {
+		EpollSyncPipe(i);
+	}
 
-						recheck_status = true;
-						CallSocketHandler( i, true );
+	// EpollWatch closes the epoll fd if the kernel won't watch something
+	if ( m_epoll_fd == -1 ) {
+		return false;
+	}
+	dprintf(D_DAEMONCORE, "DaemonCore: using epoll for %d sockets and %d pipes\n", nSock, nPipe);
+	return true;
+}
 
-						// update per-handler runtime statistics
-						runtime = dc_stats.AddRuntime((*sockTable)[i].handler_descrip, runtime);
+void
+DaemonCore::EpollClose()
+{
+	if ( m_epoll_fd != -1 ) {
+		close(m_epoll_fd);
+		m_epoll_fd = -1;
+	}
+	m_epoll_fds.clear();
+	m_epoll_tags.clear();
+	m_epoll_pipe_slots.clear();
+}
 
-					}	// if call_handler is True
-				}	// if valid entry in sockTable
-			}	// for 0 thru nSock checking if call_handler is true
+bool
+DaemonCore::EpollActive()
+{
+	if ( m_epoll_fd == -1 ) {
+		return false;
+	}
+	if ( m_epoll_pid != ::getpid() ) {
+		// we are a forked child, the epoll set belongs to our parent.
+		EpollClose();
+		return false;
+	}
+	// the condor thread pool changes servicing_tid and remove_asap
+	// without telling us, so use a Selector when it is in use.
+	return CondorThreads_pool_size() == 0;
+}
 
-			runtime = _condor_debug_get_time_double();
-			dc_stats.SocketRuntime += (runtime - group_runtime);
-			group_runtime = runtime;
+// Make the epoll set watch fd for events on behalf of tag, replacing whatever
+// was watched for tag before.  an fd of -1 or no events stops watching.
+void
+DaemonCore::EpollWatch(unsigned int tag, int fd, unsigned int events)
+{
+	if ( m_epoll_fd == -1 ) {
+		return;
+	}
+	if ( m_epoll_pid != ::getpid() ) {
+		// a forked child shares the epoll set with its parent, so
+		// any change we made here would also change it for the parent.
+		EpollClose();
+		return;
+	}
 
+	std::map<unsigned int, int>::iterator tit = m_epoll_tags.find(tag);
+	if ( tit != m_epoll_tags.end() && (tit->second != fd || ! events) ) {
+		int old_fd = tit->second;
+		m_epoll_tags.erase(tit);
+		std::map<int, std::pair<unsigned int, unsigned int> >::iterator fit = m_epoll_fds.find(old_fd);
+		if ( fit != m_epoll_fds.end() && fit->second.first == tag ) {
+			m_epoll_fds.erase(fit);
+			// this fails if the fd has already been closed, which is
+			// fine since closing it also took it out of the epoll set.
+			epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, old_fd, NULL);
+		}
+	}
+	if ( fd < 0 || ! events ) {
+		return;
+	}
 
-		}	// if rv > 0
+	int op = EPOLL_CTL_ADD;
+	std::map<int, std::pair<unsigned int, unsigned int> >::iterator fit = m_epoll_fds.find(fd);
+	if ( fit != m_epoll_fds.end() ) {
+		if ( fit->second.first == tag && fit->second.second == events ) {
+			return;
+		}
+		if ( fit->second.first != tag ) {
+			// the fd was closed and reused without the old owner being cancelled.
+			m_epoll_tags.erase(fit->second.first);
+		}
+		op = EPOLL_CTL_MOD;
+	}
 
-		dc_stats.PumpCycle += (runtime - pump_cycle_begin_time);
-		pump_cycle_begin_time = runtime;
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.u64 = ((uint64_t)(unsigned int)fd << 32) | tag;
+	int rval = epoll_ctl(m_epoll_fd, op, fd, &ev);
+	if ( rval < 0 && op == EPOLL_CTL_MOD && errno == ENOENT ) {
+		rval = epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	} else if ( rval < 0 && op == EPOLL_CTL_ADD && errno == EEXIST ) {
+		rval = epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+	if ( rval < 0 ) {
+		dprintf(D_ALWAYS, "DaemonCore: epoll_ctl failed for fd %d, will use select instead: %s (errno=%d)\n",
+				fd, strerror(errno), errno);
+		EpollClose();
+		return;
+	}
+	m_epoll_fds[fd] = std::make_pair(tag, events);
+	m_epoll_tags[tag] = fd;
+}
 
-	}	// end of infinite for loop
+// make the epoll set agree with sockTable entry i.  keep this in sync with
+// the Selector setup in Driver()
+void
+DaemonCore::EpollSyncSocket(int i)
+{
+	if ( m_epoll_fd == -1 ) {
+		return;
+	}
+
+	int fd = -1;
+	unsigned int events = 0;
+	SockEnt & ent = (*sockTable)[i];
+	if ( ent.iosock && ! ent.remove_asap && ! ent.is_reverse_connect_pending ) {
+		fd = ent.iosock->get_file_desc();
+		if ( ent.is_connect_pending ) {
+			// connect failures are reported as EPOLLERR, which
+			// epoll always reports.
+			events = EPOLLOUT;
+		} else {
+			switch ( ent.handler_type ) {
+			case HANDLE_READ: events = EPOLLIN; break;
+			case HANDLE_WRITE: events = EPOLLOUT; break;
+			case HANDLE_READ_WRITE: events = EPOLLIN | EPOLLOUT; break;
+			}
+		}
+	}
+	EpollWatch(EPOLL_TAG_SOCK | (unsigned int)i, fd, events);
+}
+
+// make the epoll set agree with pipeTable entry i, and remember the slot
+// so that the Driver can find the entry from the pipe handle index.
+void
+DaemonCore::EpollSyncPipe(int i)
+{
+	if ( m_epoll_fd == -1 ) {
+		return;
+	}
+
+	PipeEnt & ent = (*pipeTable)[i];
+	if ( ent.index == -1 ) {
+		return;
+	}
+	m_epoll_pipe_slots[ent.index] = i;
+
+	unsigned int events = 0;
+	switch ( ent.handler_type ) {
+	case HANDLE_READ: events = EPOLLIN; break;
+	case HANDLE_WRITE: events = EPOLLOUT; break;
+	case HANDLE_READ_WRITE: events = EPOLLIN | EPOLLOUT; break;
+	}
+	EpollWatch(EPOLL_TAG_PIPE | (unsigned int)ent.index, (*pipeHandleTable)[ent.index], events);
 }
 
+void
+DaemonCore::EpollForgetPipe(int index)
+{
+	if ( m_epoll_fd == -1 ) {
+		return;
+	}
+	m_epoll_pipe_slots.erase(index);
+	EpollWatch(EPOLL_TAG_PIPE | (unsigned int)index, -1, 0);
+}
+
+// Returns the earliest socket deadline.  Code can change a socket's deadline
+// at any time without telling DaemonCore, so this has to look at every
+// socket.  We do that at most once a second, and when we skip it we limit the
+// timeout to a second so that a deadline set since the last look is noticed.
+time_t
+DaemonCore::EpollMinDeadline(time_t now, time_t & timeout)
+{
+	if ( now == m_epoll_deadline_scan ) {
+		if ( timeout > 1 ) {
+			timeout = 1;
+		}
+		return m_epoll_min_deadline;
+	}
+
+	m_epoll_deadline_scan = now;
+	m_epoll_min_deadline = 0;
+	for (int i = 0; i < nSock; i++) {
+		SockEnt & ent = (*sockTable)[i];
+		if ( ! ent.iosock || ent.remove_asap || ent.is_reverse_connect_pending ) {
+			continue;
+		}
+		time_t deadline = ent.iosock->get_deadline();
+		if ( deadline && (m_epoll_min_deadline == 0 || deadline < m_epoll_min_deadline) ) {
+			m_epoll_min_deadline = deadline;
+		}
+	}
+	return m_epoll_min_deadline;
+}
+
+// Set call_handler for the entries that epoll_wait said were ready, and for
+// sockets that have timed out.  Fills ready_socks with sockTable slots in
+// table order and ready_pipes with pipeHandleTable indexes.
+void
+DaemonCore::EpollFindReady(int nready, time_t now, time_t min_deadline,
+                           std::vector<int> & ready_socks, std::vector<int> & ready_pipes)
+{
+	ready_socks.clear();
+	ready_pipes.clear();
+
+	// throw out events for fds that we no longer watch under that tag,
+	// and look for a command on the super-user command socket. if there is
+	// one, we only schedule command callbacks from that socket this cycle.
+	bool superuser_command_arrived = false;
+	bool stale = false;
+	for (int k = 0; k < nready; k++) {
+		struct epoll_event & ev = m_epoll_events[k];
+		unsigned int tag = (unsigned int)(ev.data.u64 & 0xffffffff);
+		int fd = (int)(ev.data.u64 >> 32);
+		std::map<unsigned int, int>::iterator it = m_epoll_tags.find(tag);
+		if ( it == m_epoll_tags.end() || it->second != fd ) {
+			stale = true;
+			ev.events = 0;
+			continue;
+		}
+		if ( (tag & EPOLL_TAG_KIND) == EPOLL_TAG_SOCK && (ev.events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ) {
+			Sock * sock = (*sockTable)[tag & EPOLL_TAG_KEY].iosock;
+			if ( sock && (sock == super_dc_rsock || sock == super_dc_ssock) ) {
+				superuser_command_arrived = true;
+			}
+		}
+	}
+	if ( superuser_command_arrived ) {
+		dprintf(D_ALWAYS,"Received a superuser command\n");
+	}
+
+	std::vector<int> event_socks;
+	for (int k = 0; k < nready; k++) {
+		const struct epoll_event & ev = m_epoll_events[k];
+		if ( ! ev.events ) {
+			continue;
+		}
+		unsigned int tag = (unsigned int)(ev.data.u64 & 0xffffffff);
+		int key = (int)(tag & EPOLL_TAG_KEY);
+		// like select(), report errors and hangups as both readable and writable
+		bool readable = (ev.events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0;
+		bool writable = (ev.events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0;
+
+		switch ( tag & EPOLL_TAG_KIND ) {
+		case EPOLL_TAG_SOCK:
+			if ( key < nSock ) {
+				event_socks.push_back(key);
+				if ( SockReadyToCall(key, readable, writable, now, superuser_command_arrived) ) {
+					(*sockTable)[key].call_handler = true;
+					ready_socks.push_back(key);
+				}
+			}
+			break;
+		case EPOLL_TAG_PIPE: {
+			std::map<int, int>::iterator it = m_epoll_pipe_slots.find(key);
+			if ( it != m_epoll_pipe_slots.end() && (readable || writable) ) {
+				(*pipeTable)[it->second].call_handler = true;
+				ready_pipes.push_back(key);
+			}
+			break;
+		}
+		default:
+			// the async pipe, the Driver drains it at the top of the loop
+			break;
+		}
+	}
+
+	// if the earliest deadline has passed, look for all of the sockets that
+	// have timed out.  the sockets with events have already been checked.
+	if ( min_deadline && min_deadline < now ) {
+		std::sort(event_socks.begin(), event_socks.end());
+		for (int i = 0; i < nSock; i++) {
+			if ( ! (*sockTable)[i].iosock ||
+				 std::binary_search(event_socks.begin(), event_socks.end(), i) ) {
+				continue;
+			}
+			time_t deadline = (*sockTable)[i].iosock->get_deadline();
+			if ( deadline && deadline < now &&
+				 SockReadyToCall(i, false, false, now, superuser_command_arrived) ) {
+				(*sockTable)[i].call_handler = true;
+				ready_socks.push_back(i);
+			}
+		}
+		// some of these handlers are likely to change deadlines
+		m_epoll_deadline_scan = 0;
+	}
+
+	// call the socket handlers in table order, the same as select() would
+	std::sort(ready_socks.begin(), ready_socks.end());
+
+	if ( stale ) {
+		// something closed an fd without cancelling it first, while some
+		// other process still has it open.  the only way to get it out of
+		// the epoll set is to start over.
+		dprintf(D_ALWAYS, "DaemonCore: epoll reported events for a cancelled socket or pipe, rebuilding the epoll set\n");
+		EpollInit();
+	}
+}
+
+#endif // CONDOR_HAVE_EPOLL
+
 bool
 DaemonCore::SocketIsRegistered( Stream *sock )
 {
@@ -227,6 +227,7 @@ void DaemonCore::Stats::Init(bool enable)
    DC_STATS_ADD_RECENT(Pool, TimerRuntime,    IF_BASICPUB);
    DC_STATS_ADD_RECENT(Pool, SocketRuntime,   IF_BASICPUB);
    DC_STATS_ADD_RECENT(Pool, PipeRuntime,     IF_BASICPUB);
+   DC_STATS_ADD_RECENT(Pool, LoopOverhead,    IF_BASICPUB);
    DC_STATS_ADD_RECENT(Pool, Signals,       IF_BASICPUB);
    DC_STATS_ADD_RECENT(Pool, TimersFired,   IF_BASICPUB);
    DC_STATS_ADD_RECENT(Pool, SockMessages,  IF_BASICPUB);
@@ -281,6 +282,7 @@ void DaemonCore::Stats::Init(bool enable)
    DC_STATS_PUB_DEBUG(Pool, TimerRuntime,    IF_BASICPUB);
    DC_STATS_PUB_DEBUG(Pool, SocketRuntime,   IF_BASICPUB);
    DC_STATS_PUB_DEBUG(Pool, PipeRuntime,     IF_BASICPUB);
+   DC_STATS_PUB_DEBUG(Pool, LoopOverhead,    IF_BASICPUB);
    DC_STATS_PUB_DEBUG(Pool, Signals,       IF_BASICPUB);
    DC_STATS_PUB_DEBUG(Pool, TimersFired,   IF_BASICPUB);
    DC_STATS_PUB_DEBUG(Pool, SockMessages,  IF_BASICPUB);
@@ -353,6 +355,18 @@ void DaemonCore::Stats::Publish(ClassAd & ad, int flags) const
    }
    ad.Assign("RecentDaemonCoreDutyCycle", dDutyCycle);
 
+   // the ClassAd library keeps a cache of compiled regular expressions
+   unsigned long regex_hits = 0, regex_misses = 0;
+   int regex_entries = 0;
+   classad::ClassAdGetRegexCacheStats(regex_hits, regex_misses, regex_entries);
+   if (regex_hits || regex_misses) {
+      ad.Assign("DCRegexCacheHits", (long long)regex_hits);
+      ad.Assign("DCRegexCacheMisses", (long long)regex_misses);
+      if (flags & IF_VERBOSEPUB) {
+         ad.Assign("DCRegexCacheEntries", regex_entries);
+      }
+   }
+
    Pool.Publish(ad, flags);
 }
 
@@ -365,6 +379,9 @@ void DaemonCore::Stats::Unpublish(ClassAd & ad) const
    ad.Delete("DCRecentWindowMax");
    ad.Delete("DaemonCoreDutyCycle");
    ad.Delete("RecentDaemonCoreDutyCycle");
+   ad.Delete("DCRegexCacheHits");
+   ad.Delete("DCRegexCacheMisses");
+   ad.Delete("DCRegexCacheEntries");
    Pool.Unpublish(ad);
 }
 
@@ -24,6 +24,8 @@
 #include "condor_debug.h"
 #include "condor_daemon_core.h"
 
+#include <algorithm>
+
 static const char* DEFAULT_INDENT = "DaemonCore--> ";
 
 static	TimerManager*	_t = NULL;
@@ -60,8 +62,7 @@ TimerManager::TimerManager()
 	{
 		EXCEPT("TimerManager object exists!");
 	}
-	timer_list = NULL;
-	list_tail = NULL;
+	timer_insert_seq = 0;
 	timer_ids = 0;
 	in_timeout = NULL;
 	_t = this; 
@@ -184,7 +185,7 @@ bool TimerManager::ResetTimerTimeslice(int id, Timeslice const &new_timeslice)
 
 bool TimerManager::GetTimerTimeslice(int id, Timeslice &timeslice)
 {
-	Timer *timer_ptr = GetTimer( id, NULL );
+	Timer *timer_ptr = GetTimer( id );
 	if( !timer_ptr || !timer_ptr->timeslice ) {
 		return false;
 	}
@@ -194,7 +195,7 @@ bool TimerManager::GetTimerTimeslice(int id, Timeslice &timeslice)
 
 time_t TimerManager::GetNextRuntime(int id)
 {
-	Timer *timer_ptr = GetTimer( id, NULL );
+	Timer *timer_ptr = GetTimer( id );
 	if (!timer_ptr) { return false; }
 
 	return timer_ptr->when;
@@ -204,22 +205,15 @@ int TimerManager::ResetTimer(int id, unsigned when, unsigned period,
 							 Timeslice const *new_timeslice)
 {
 	Timer*			timer_ptr;
-	Timer*			trail_ptr;
 
 	dprintf( D_DAEMONCORE,
 			 "In reset_timer(), id=%d, time=%d, period=%d\n",id,when,period);
-	if (timer_list == NULL) {
+	if (timers_by_id.empty()) {
 		dprintf( D_DAEMONCORE, "Reseting Timer from empty list!\n");
 		return -1;
 	}
 
-	timer_ptr = timer_list;
-	trail_ptr = NULL;
-	while ( timer_ptr && timer_ptr->id != id ) {
-		trail_ptr = timer_ptr;
-		timer_ptr = timer_ptr->next;
-	}
-
+	timer_ptr = GetTimer( id );
 	if ( timer_ptr == NULL ) {
 		dprintf( D_ALWAYS, "Timer %d not found\n",id );
 		return -1;
@@ -277,7 +271,7 @@ int TimerManager::ResetTimer(int id, unsigned when, unsigned period,
 	}
 	timer_ptr->period = period;
 
-	RemoveTimer( timer_ptr, trail_ptr );
+	RemoveTimer( timer_ptr );
 	InsertTimer( timer_ptr );
 
 	if ( in_timeout == timer_ptr ) {
@@ -292,27 +286,20 @@ int TimerManager::ResetTimer(int id, unsigned when, unsigned period,
 int TimerManager::CancelTimer(int id)
 {
 	Timer*		timer_ptr;
-	Timer*		trail_ptr;
 
 	dprintf( D_DAEMONCORE, "In cancel_timer(), id=%d\n",id);
-	if (timer_list == NULL) {
+	if (timers_by_id.empty()) {
 		dprintf( D_DAEMONCORE, "Removing Timer from empty list!\n");
 		return -1;
 	}
 
-	timer_ptr = timer_list;
-	trail_ptr = NULL;
-	while ( timer_ptr && timer_ptr->id != id ) {
-		trail_ptr = timer_ptr;
-		timer_ptr = timer_ptr->next;
-	}
-
+	timer_ptr = GetTimer( id );
 	if ( timer_ptr == NULL ) {
 		dprintf( D_ALWAYS, "Timer %d not found\n",id );
 		return -1;
 	}
 
-	RemoveTimer( timer_ptr, trail_ptr );
+	RemoveTimer( timer_ptr );
 
 	if ( in_timeout == timer_ptr ) {
 		// We're inside the handler for this timer. Don't delete it,
@@ -328,11 +315,12 @@ int TimerManager::CancelTimer(int id)
 
 void TimerManager::CancelAllTimers()
 {
-	Timer		*timer_ptr;
+	std::vector<Timer*> timers;
+	timers.swap( timer_heap );
+	timers_by_id.clear();
 
-	while( timer_list != NULL ) {
-		timer_ptr = timer_list;
-		timer_list = timer_list->next;
+	for( size_t ix = 0; ix < timers.size(); ix++ ) {
+		Timer *timer_ptr = timers[ix];
 		if( in_timeout == timer_ptr ) {
 				// We get here if somebody calls exit from inside a timer.
 			did_cancel = true;
@@ -341,8 +329,6 @@ void TimerManager::CancelAllTimers()
 			DeleteTimer( timer_ptr );
 		}
 	}
-	timer_list = NULL;
-	list_tail = NULL;
 }
 
 // Timeout() is called when a select() time out.  Returns number of seconds
@@ -360,10 +346,10 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 
 	if ( in_timeout != NULL ) {
 		dprintf(D_DAEMONCORE,"DaemonCore Timeout() called and in_timeout is non-NULL\n");
-		if ( timer_list == NULL ) {
+		if ( timer_heap.empty() ) {
 			result = 0;
 		} else {
-			result = (timer_list->when) - time(NULL);
+			result = (timer_heap[0]->when) - time(NULL);
 		}
 		if ( result < 0 ) {
 			result = 0;
@@ -373,7 +359,7 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 		
 	dprintf( D_DAEMONCORE, "In DaemonCore Timeout()\n");
 
-	if (timer_list == NULL) {
+	if (timer_heap.empty()) {
 		dprintf( D_DAEMONCORE, "Empty timer list, nothing to do\n" );
 	}
 
@@ -384,18 +370,18 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 
 	// loop until all handlers that should have been called by now or before
 	// are invoked and renewed if periodic.  Remember that NewTimer and CancelTimer
-	// keep the timer_list happily sorted on "when" for us.  We use "now" as a 
+	// keep timer_heap[0] the timer with the smallest "when" for us.  We use "now" as a 
 	// variable so that if some of these handler functions run for a long time,
 	// we do not sit in this loop forever.
 	// we make certain we do not call more than "max_fires" handlers in a 
 	// single timeout --- this ensures that timers don't starve out the rest
 	// of daemonCore if a timer handler resets itself to 0.
-	while( (timer_list != NULL) && (timer_list->when <= now ) && 
+	while( ( ! timer_heap.empty()) && (timer_heap[0]->when <= now ) && 
 		   (num_fires++ < MAX_FIRES_PER_TIMEOUT)) 
 	{
 		// DumpTimerList(D_DAEMONCORE | D_FULLDEBUG);
 
-		in_timeout = timer_list;
+		in_timeout = timer_heap[0];
 
 		// In some cases, resuming from a suspend can cause the system
 		// clock to become temporarily skewed, causing crazy things to 
@@ -489,12 +475,10 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 			// If a new timer was added at a time in the past
 			// (possible when resetting a timeslice timer), then
 			// it may have landed before the timer we just processed,
-			// meaning that we cannot assume prev==NULL in the call
-			// to RemoveTimer() below.
+			// so it is not necessarily at the top of the heap any more.
 
-			Timer *prev = NULL;
-			ASSERT( GetTimer(in_timeout->id,&prev) == in_timeout );
-			RemoveTimer( in_timeout, prev );
+			ASSERT( GetTimer(in_timeout->id) == in_timeout );
+			RemoveTimer( in_timeout );
 
 			if ( in_timeout->period > 0 || in_timeout->timeslice ) {
 				in_timeout->period_started = time(NULL);
@@ -520,13 +504,13 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 
 	// set result to number of seconds until next event.  get an update on the
 	// time from time() in case the handlers we called above took significant time.
-	if ( timer_list == NULL ) {
+	if ( timer_heap.empty() ) {
 		// we set result to be -1 so that we do not busy poll.
 		// a -1 return value will tell the DaemonCore:Driver to use select with
 		// no timeout.
 		result = -1;
 	} else {
-		result = (timer_list->when) - time(NULL);
+		result = (timer_heap[0]->when) - time(NULL);
 		if (result < 0)
 			result = 0;
 	}
@@ -556,11 +540,17 @@ void TimerManager::DumpTimerList(int flag, const char* indent)
 	if ( indent == NULL) 
 		indent = DEFAULT_INDENT;
 
+	// the heap is only partly ordered, so sort a copy to list the
+	// timers in the order they will fire.
+	std::vector<Timer*> timers( timer_heap );
+	std::sort( timers.begin(), timers.end(), TimerBefore );
+
 	dprintf(flag, "\n");
 	dprintf(flag, "%sTimers\n", indent);
 	dprintf(flag, "%s~~~~~~\n", indent);
-	for(timer_ptr = timer_list; timer_ptr != NULL; timer_ptr = timer_ptr->next)
+	for( size_t ix = 0; ix < timers.size(); ix++ )
 	{
+		timer_ptr = timers[ix];
 		if ( timer_ptr->event_descrip )
 			ptmp = timer_ptr->event_descrip;
 		else
@@ -627,68 +617,93 @@ void TimerManager::Start()
 	}
 }
 
-void TimerManager::RemoveTimer( Timer *timer, Timer *prev )
+// returns true if timer a should fire before timer b. when timers are due
+// at the same time, the one inserted first goes first.  this makes certain
+// we "round-robin" across timers that constantly reset themselves to zero.
+bool TimerManager::TimerBefore( const Timer *a, const Timer *b )
 {
-	if ( timer == NULL || ( prev && prev->next != timer ) ||
-		 ( !prev && timer != timer_list ) ) {
-		EXCEPT( "Bad call to TimerManager::RemoveTimer()!" );
+	if ( a->when != b->when ) {
+		return a->when < b->when;
 	}
+	return a->insert_seq < b->insert_seq;
+}
 
-	if ( timer == timer_list ) {
-		timer_list = timer_list->next;
+void TimerManager::HeapPlace( size_t ix, Timer *timer )
+{
+	timer_heap[ix] = timer;
+	timer->heap_index = ix;
+}
+
+void TimerManager::HeapSiftUp( size_t ix )
+{
+	Timer *timer = timer_heap[ix];
+	while ( ix > 0 ) {
+		size_t parent = (ix - 1) / 2;
+		if ( ! TimerBefore( timer, timer_heap[parent] ) ) {
+			break;
+		}
+		HeapPlace( ix, timer_heap[parent] );
+		ix = parent;
 	}
-	if ( timer == list_tail ) {
-		list_tail = prev;
+	HeapPlace( ix, timer );
+}
+
+void TimerManager::HeapSiftDown( size_t ix )
+{
+	Timer *timer = timer_heap[ix];
+	size_t count = timer_heap.size();
+	for (;;) {
+		size_t child = 2 * ix + 1;
+		if ( child >= count ) {
+			break;
+		}
+		if ( child + 1 < count && TimerBefore( timer_heap[child + 1], timer_heap[child] ) ) {
+			child++;
+		}
+		if ( ! TimerBefore( timer_heap[child], timer ) ) {
+			break;
+		}
+		HeapPlace( ix, timer_heap[child] );
+		ix = child;
 	}
-	if ( prev ) {
-		prev->next = timer->next;
+	HeapPlace( ix, timer );
+}
+
+void TimerManager::RemoveTimer( Timer *timer )
+{
+	if ( timer == NULL || timer->heap_index >= timer_heap.size() ||
+		 timer_heap[timer->heap_index] != timer ) {
+		EXCEPT( "Bad call to TimerManager::RemoveTimer()!" );
+	}
+
+	timers_by_id.erase( timer->id );
+
+	// move the last timer into the hole and let it find its place
+	size_t ix = timer->heap_index;
+	Timer *last = timer_heap.back();
+	timer_heap.pop_back();
+	if ( last != timer ) {
+		HeapPlace( ix, last );
+		if ( ix > 0 && TimerBefore( last, timer_heap[(ix - 1) / 2] ) ) {
+			HeapSiftUp( ix );
+		} else {
+			HeapSiftDown( ix );
+		}
 	}
+	timer->heap_index = (size_t)-1;
 }
 
 void TimerManager::InsertTimer( Timer *new_timer )
 {
-	if ( timer_list == NULL ) {
-		// list is empty, place ours in front
-		timer_list = new_timer;
-		list_tail = new_timer;
-		new_timer->next = NULL;
+	new_timer->insert_seq = timer_insert_seq++;
+	timers_by_id[new_timer->id] = new_timer;
+
+	timer_heap.push_back( new_timer );
+	HeapSiftUp( timer_heap.size() - 1 );
+
+	if ( timer_heap[0] == new_timer ) {
 			// since we have a new first timer, we must wake up select
 		daemonCore->Wake_up_select();
-	} else {
-		// list is not empty, so keep timer_list ordered from soonest to
-		// farthest (i.e. sorted on "when").
-		// Note: when doing the comparisons, we always use "<" instead
-		// of "<=" -- this makes certain we "round-robin" across 
-		// timers that constantly reset themselves to zero.
-		if ( new_timer->when < timer_list->when ) {
-			// make the this new timer first in line
-			new_timer->next = timer_list;
-			timer_list = new_timer;
-			// since we have a new first timer, we must wake up select
-			daemonCore->Wake_up_select();
-		} else if ( new_timer->when == TIME_T_NEVER ) {
-			// Our new timer goes to the very back of the list.
-			new_timer->next = NULL;
-			list_tail->next = new_timer;
-			list_tail = new_timer;
-		} else {
-			Timer* timer_ptr;
-			Timer* trail_ptr = NULL;
-			for (timer_ptr = timer_list; timer_ptr != NULL; 
-				 timer_ptr = timer_ptr->next ) 
-			{
-				if (new_timer->when < timer_ptr->when) {
-					break;
-				}
-				trail_ptr = timer_ptr;
-			}
-			ASSERT( trail_ptr );
-			new_timer->next = timer_ptr;
-			trail_ptr->next = new_timer;
-			if ( trail_ptr == list_tail ) {
-				list_tail = new_timer;
-			}
-		}
 	}
 }
 
@@ -714,18 +729,11 @@ void TimerManager::DeleteTimer( Timer *timer )
 	delete timer;
 }
 
-Timer *TimerManager::GetTimer( int id, Timer **prev )
+Timer *TimerManager::GetTimer( int id )
 {
-	Timer *timer_ptr = timer_list;
-	if( prev ) {
-		*prev = NULL;
+	std::map<int, Timer*>::iterator it = timers_by_id.find( id );
+	if ( it == timers_by_id.end() ) {
+		return NULL;
 	}
-	while ( timer_ptr && timer_ptr->id != id ) {
-		if( prev ) {
-			*prev = timer_ptr;
-		}
-		timer_ptr = timer_ptr->next;
-	}
-
-	return timer_ptr;
+	return it->second;
 }
@@ -52,6 +52,8 @@
 #define CLUSTER_ADTYPE	 		"Cluster"
 #define GRID_ADTYPE			"Grid"
 #define BOGUS_ADTYPE		"Bogus"
+#define COLLECTOR_DELTA_ADTYPE		"CollectorDeltaStatus"
+#define COLLECTOR_DELTA_REMOVED_ADTYPE	"CollectorDeltaRemoved"
 
 // Enumerated list of ad types (for the query object)
 enum AdTypes
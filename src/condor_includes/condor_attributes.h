@@ -76,6 +76,9 @@
 #define ATTR_CLAIM_STARTD  "ClaimStartd"
 #define ATTR_COD_CLAIMS  "CODClaims"
 #define ATTR_COLLECTOR_HOST  "CollectorHost"
+#define ATTR_COLLECTOR_DELTA_COOKIE  "CollectorDeltaCookie"
+#define ATTR_COLLECTOR_DELTA_FULL  "CollectorDeltaFull"
+#define ATTR_COLLECTOR_DELTA_KEY  "CollectorDeltaKey"
 #define ATTR_COMMAND  "Command"
 #define ATTR_COMPRESS_FILES  "CompressFiles"
 #define ATTR_REQUESTED_CAPACITY  "RequestedCapacity"
@@ -594,6 +597,13 @@
 #define ATTR_START  "Start"
 #define ATTR_START_LOCAL_UNIVERSE  "StartLocalUniverse"
 #define ATTR_START_SCHEDULER_UNIVERSE  "StartSchedulerUniverse"
+#define ATTR_STARTD_BATCH_BASE_SEQUENCE  "StartdBatchBaseSequence"
+#define ATTR_STARTD_BATCH_FULL  "StartdBatchFull"
+#define ATTR_STARTD_BATCH_PRIVATE_ADS  "StartdBatchPrivateAds"
+#define ATTR_STARTD_BATCH_REMOVED_ATTRS  "StartdBatchRemovedAttrs"
+#define ATTR_STARTD_BATCH_SEQUENCE  "StartdBatchSequence"
+#define ATTR_STARTD_BATCH_SHARED_CHANGES  "StartdBatchSharedChanges"
+#define ATTR_STARTD_BATCH_SLOT_ADS  "StartdBatchSlotAds"
 #define ATTR_STARTD_IP_ADDR  "StartdIpAddr"
 #define ATTR_STARTD_PRINCIPAL  "StartdPrincipal"
 #define ATTR_STARTD_SENDS_ALIVES  "StartdSendsAlives"
@@ -729,6 +739,7 @@
 #define ATTR_WANT_REMOTE_UPDATES "WantRemoteUpdates"
 #define ATTR_WANT_DELAYED_UPDATES "WantDelayedUpdates"
 #define ATTR_WANT_MATCH_DIAGNOSTICS  "WantMatchDiagnostics"
+#define ATTR_WANT_PARALLEL_SCHEDULING  "WantParallelScheduling"
 #define ATTR_WANT_PARALLEL_SCHEDULING_GROUPS  "WantParallelSchedulingGroups"
 #define ATTR_WANT_CHECKPOINT_SIGNAL  "WantCheckpointSignal"
 #define ATTR_WANT_PSLOT_PREEMPTION  "WantPslotPreemption"
@@ -1044,6 +1055,10 @@ extern const char ATTR_SEC_AUTHENTICATED_USER [];
 #define ATTR_LAST_NEGOTIATION_CYCLE_ACTIVE_SUBMITTER_COUNT  "LastNegotiationCycleActiveSubmitterCount"
 #define ATTR_LAST_NEGOTIATION_CYCLE_MATCH_RATE  "LastNegotiationCycleMatchRate"
 #define ATTR_LAST_NEGOTIATION_CYCLE_MATCH_RATE_SUSTAINED  "LastNegotiationCycleMatchRateSustained"
+#define ATTR_LAST_NEGOTIATION_CYCLE_MATCH_THREADS  "LastNegotiationCycleMatchThreads"
+#define ATTR_LAST_NEGOTIATION_CYCLE_MATCH_SPEEDUP  "LastNegotiationCycleMatchSpeedup"
+#define ATTR_LAST_NEGOTIATION_CYCLE_MATCH_CACHE_HITS  "LastNegotiationCycleMatchCacheHits"
+#define ATTR_LAST_NEGOTIATION_CYCLE_MATCH_CACHE_MISSES  "LastNegotiationCycleMatchCacheMisses"
 #define ATTR_LAST_NEGOTIATION_CYCLE_PIES  "LastNegotiationCyclePies"
 #define ATTR_LAST_NEGOTIATION_CYCLE_PIE_SPINS  "LastNegotiationCyclePieSpins"
 #define ATTR_LAST_NEGOTIATION_CYCLE_PREFETCH_DURATION  "LastNegotiationCyclePrefetchDuration"
@@ -1088,6 +1103,13 @@ extern const char ATTR_SEC_AUTHENTICATED_USER [];
 #define ATTR_FILE_TRANSFER_DISK_THROTTLE_LIMIT "FileTransferDiskThrottleLimit"
 #define ATTR_FILE_TRANSFER_DISK_THROTTLE_EXCESS "FileTransferDiskThrottleExcess"
 #define ATTR_FILE_TRANSFER_DISK_THROTTLE_SHORTFALL "FileTransferDiskThrottleShortfall"
+#define ATTR_SANDBOX_CACHE_HITS "SandboxCacheHits"
+#define ATTR_SANDBOX_CACHE_MISSES "SandboxCacheMisses"
+#define ATTR_SANDBOX_CACHE_HIT_RATIO "SandboxCacheHitRatio"
+#define ATTR_SANDBOX_CACHE_HIT_MB "SandboxCacheHitMB"
+#define ATTR_SANDBOX_CACHE_MB "SandboxCacheMB"
+#define ATTR_SANDBOX_CACHE_FILES "SandboxCacheFiles"
+#define ATTR_SANDBOX_CACHE_EVICTIONS "SandboxCacheEvictions"
 #define ATTR_MACHINE_MAX_VACATE_TIME  "MachineMaxVacateTime"
 #define ATTR_JOB_MAX_VACATE_TIME  "JobMaxVacateTime"
 #define ATTR_WANT_GRACEFUL_REMOVAL  "WantGracefulRemoval"
@@ -179,6 +179,7 @@ NAMETABLE_DIRECTIVE:TABLE:DCTranslation
 #define SEND_RESOURCE_REQUEST_LIST	(SCHED_VERS+118)     // used in negotiation protocol
 #define QUERY_JOB_ADS_WITH_AUTH (SCHED_VERS+119) // Same as QUERY_JOB_ADS but requires authentication
 #define FETCH_PROXY_DELEGATION (SCHED_VERS+120)
+#define REQUEST_FULL_STARTD_BATCH (SCHED_VERS+121) // startd: collector couldn't apply a batch of changes
 
 // values used for "HowFast" in the draining request
 #define DRAIN_GRACEFUL 0
@@ -336,6 +337,8 @@ const int UPDATE_ACCOUNTING_AD = 77;
 const int QUERY_ACCOUNTING_ADS = 78;
 const int INVALIDATE_ACCOUNTING_ADS = 79;
 
+const int UPDATE_STARTD_ADS_BATCH = 80;
+
 
 /* these comments are used to control command_table_generator.pl
 NAMETABLE_DIRECTIVE:END_SECTION:collector
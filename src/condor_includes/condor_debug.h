@@ -211,6 +211,11 @@ void dprintf_touch_log(void);
 /* write dprintf contribution to the daemon header */
 void dprintf_print_daemon_header(void);
 
+/* serialize dprintf callers even when no condor_threads pool is running.
+ * call this on the main thread before starting any other threads that may
+ * call dprintf. */
+void dprintf_make_thread_safe(void);
+
 /* reset statistics about delays acquiring the debug file lock */
 void dprintf_reset_lock_delay(void);
 
@@ -302,6 +302,13 @@ protected:
 	*/
 
 	int prepare_for_nobuffering( stream_coding = stream_unknown);
+#if defined(LINUX)
+		// zero-copy helpers for put_file() and get_file()
+	int put_file_sendfile( int fd, filesize_t offset, filesize_t bytes_to_send,
+						   filesize_t &total, class DCTransferQueue *xfer_q );
+	int get_file_splice( int fd, filesize_t bytes_to_receive, filesize_t &total,
+						 int &write_errno, class DCTransferQueue *xfer_q );
+#endif
 	int perform_authenticate( bool with_key, KeyInfo *& key, 
 							  const char* methods, CondorError* errstack,
 							  int auth_timeout, bool non_blocking, char **method_used );
@@ -29,6 +29,8 @@
 #include "condor_ver_info.h"
 #include "classy_counted_ptr.h"
 
+class ClassAdWireNames;
+
 enum CONDOR_MD_MODE {
     MD_OFF        = 0,         // off
     MD_ALWAYS_ON,              // always on, condor will check MAC automatically
@@ -576,6 +578,11 @@ public:
 	/// Set the peer's version.
 	void set_peer_version(CondorVersionInfo const *version);
 
+	/// The attribute names sent or received in binary ClassAds in the
+	/// current message (see classad_wire.h).  Forgotten at end of message.
+	ClassAdWireNames &classad_wire_names();
+	void reset_classad_wire_names();
+
 	/** Get this stream's type.
         @return the type of this stream
     */
@@ -660,6 +667,7 @@ protected:
 	int decrypt_buf_len;
 	char *m_peer_description_str;
 	CondorVersionInfo *m_peer_version;
+	ClassAdWireNames *m_classad_wire_names;
 
 	time_t m_deadline_time;
 	static int timeout_multiplier;
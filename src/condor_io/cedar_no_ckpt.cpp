@@ -50,12 +50,33 @@
 #include <mswsock.h>	// For TransmitFile()
 #endif
 
+#if defined(LINUX)
+#include <sys/sendfile.h>
+#include "selector.h"
+#endif
+
 const unsigned int PUT_FILE_EOM_NUM = 666;
 
 // This special file descriptor number must not be a valid fd number.
 // It is used to make get_file() consume transferred data without writing it.
 const int GET_FILE_NULL_FD = -10;
 
+// Encryption makes a copy of every buffer we hand to put_bytes_nobuffer()
+// or get from get_bytes_nobuffer(), so when it is on we move the file in
+// bigger pieces than the usual 64k to cut down on the per-call overhead.
+const int ENCRYPTED_FILE_BUF_SIZE = 1024 * 1024;
+
+#if defined(LINUX)
+// Most we hand to one sendfile() call, so that the transfer queue still
+// gets regular progress reports.
+const size_t SENDFILE_CHUNK_SIZE = 4 * 1024 * 1024;
+
+// Size we ask for on the pipe that get_file() splices through.  An
+// unprivileged process may not get more than 1MB by default; if we can't
+// have it, the pipe keeps its default size.
+const int SPLICE_PIPE_SIZE = 1024 * 1024;
+#endif
+
 int
 ReliSock::get_file( filesize_t *size, const char *destination,
 					bool flush_buffers, bool append, filesize_t max_bytes,
@@ -134,12 +155,16 @@ ReliSock::get_file( filesize_t *size, int fd,
 					bool flush_buffers, bool append, filesize_t max_bytes,
 					DCTransferQueue *xfer_q)
 {
-	char buf[65536];
+	char stack_buf[65536];
+	std::vector<char> big_buf;
+	char *buf = stack_buf;
+	int buf_size = sizeof(stack_buf);
 	filesize_t filesize, bytes_to_receive;
 	unsigned int eom_num;
 	filesize_t total = 0;
 	int retval = 0;
 	int saved_errno = 0;
+	bool receive_failed = false;
 
 		// NOTE: the caller may pass fd=GET_FILE_NULL_FD, in which
 		// case we just read but do not write the data.
@@ -169,15 +194,53 @@ ReliSock::get_file( filesize_t *size, int fd,
 		  RSC in the syscall library.  this code isn't like that.
 		*/
 
+#if defined(LINUX)
+		// Without encryption or MACs the file comes over the wire as-is,
+		// so let the kernel move it from the socket into the file.  We
+		// leave the max_bytes case to the loop below, which knows how
+		// to stop part way.
+	if ( bytes_to_receive > 0 && fd != GET_FILE_NULL_FD &&
+		 !get_encryption() && !isOutgoing_MD5_on() &&
+		 ( max_bytes < 0 || bytes_to_receive <= max_bytes ) )
+	{
+		int write_errno = 0;
+		int rc = -1;
+		this->decode();
+		if ( prepare_for_nobuffering(stream_decode) ) {
+			rc = get_file_splice( fd, bytes_to_receive, total, write_errno, xfer_q );
+		}
+		if ( write_errno ) {
+			dprintf( D_ALWAYS,
+					 "ReliSock::get_file: write() failed: %s (errno=%d)\n",
+					 strerror(write_errno), write_errno );
+
+				// Continue reading data, but throw it all away, as
+				// below.
+			saved_errno = write_errno;
+			fd = GET_FILE_NULL_FD;
+			retval = GET_FILE_WRITE_FAILED;
+		}
+		if ( rc < 0 ) {
+			receive_failed = true;
+		}
+	}
+#endif
+
+	if ( get_encryption() && bytes_to_receive - total > buf_size ) {
+		big_buf.resize( ENCRYPTED_FILE_BUF_SIZE );
+		buf = &big_buf[0];
+		buf_size = ENCRYPTED_FILE_BUF_SIZE;
+	}
+
 	// Now, read it all in & save it
-	while( total < bytes_to_receive ) {
+	while( !receive_failed && total < bytes_to_receive ) {
 		UtcTime t1,t2;
 		if( xfer_q ) {
 			t1.getTime();
 		}
 
 		int	iosize =
-			(int) MIN( (filesize_t) sizeof(buf), bytes_to_receive - total );
+			(int) MIN( (filesize_t) buf_size, bytes_to_receive - total );
 		int	nbytes = get_bytes_nobuffer( buf, iosize, 0 );
 
 		if( xfer_q ) {
@@ -475,12 +538,40 @@ ReliSock::put_file( filesize_t *size, int fd, filesize_t offset, filesize_t max_
 		}
 #endif
 
-		char buf[65536];
+#if defined(LINUX)
+		// On Linux, if we need neither encryption nor MACs, let the
+		// kernel send the file straight from the page cache with
+		// sendfile().  If it can't for this file, fall back to the
+		// code below.
+		if ( !get_encryption() && !isOutgoing_MD5_on() ) {
+
+			// First drain outgoing buffers
+			if ( !prepare_for_nobuffering(stream_encode) ) {
+				dprintf(D_ALWAYS,
+						"ReliSock: put_file: failed to drain buffers!\n");
+				return -1;
+			}
+
+			if ( put_file_sendfile( fd, offset, bytes_to_send, total, xfer_q ) < 0 ) {
+				return -1;
+			}
+		}
+#endif
+
+		char stack_buf[65536];
+		std::vector<char> big_buf;
+		char *buf = stack_buf;
+		int buf_size = sizeof(stack_buf);
 		int nbytes, nrd;
 
-		// On Unix, always send the file using put_bytes_nobuffer().
-		// Note that on Win32, we use this method as well if encryption 
-		// is required.
+		if ( get_encryption() && bytes_to_send - total > buf_size ) {
+			big_buf.resize( ENCRYPTED_FILE_BUF_SIZE );
+			buf = &big_buf[0];
+			buf_size = ENCRYPTED_FILE_BUF_SIZE;
+		}
+
+		// Unless the file was already sent above, send it using
+		// put_bytes_nobuffer().
 		while (total < bytes_to_send) {
 			UtcTime t1;
 			UtcTime t2;
@@ -489,7 +580,7 @@ ReliSock::put_file( filesize_t *size, int fd, filesize_t offset, filesize_t max_
 			}
 
 			// Be very careful about where the cast to size_t happens; see gt#4150
-			nrd = ::read(fd, buf, (size_t)((bytes_to_send-total) < (int)sizeof(buf) ? bytes_to_send-total : sizeof(buf)));
+			nrd = ::read(fd, buf, (size_t)((bytes_to_send-total) < buf_size ? bytes_to_send-total : buf_size));
 
 			if( xfer_q ) {
 				t2.getTime();
@@ -539,7 +630,9 @@ ReliSock::put_file( filesize_t *size, int fd, filesize_t offset, filesize_t max_
 	}
 
 	if ( max_bytes_exceeded ) {
-		dprintf(D_ALWAYS,
+			// Callers also use max_bytes to send a piece of a file,
+			// and those that treat this as an error say so themselves.
+		dprintf(D_FULLDEBUG,
 				"ReliSock: put_file: only sent " FILESIZE_T_FORMAT 
 				" bytes out of " FILESIZE_T_FORMAT
 				" because maximum upload bytes was exceeded.\n",
@@ -557,6 +650,310 @@ ReliSock::put_file( filesize_t *size, int fd, filesize_t offset, filesize_t max_
 }
 MSC_RESTORE_WARNING(6262) // function uses 64k of stack
 
+#if defined(LINUX)
+
+// Wait for the socket to become ready for the given kind of i/o.  Gives
+// up and returns false after timeout seconds (if timeout is positive).
+static bool
+wait_for_socket( char const *peer_description, int sock,
+				 Selector::IO_FUNC interest, int timeout )
+{
+	Selector selector;
+	selector.add_fd( sock, interest );
+	if ( timeout > 0 ) {
+		selector.set_timeout( timeout );
+	}
+
+	for (;;) {
+		selector.execute();
+		if ( selector.signalled() ) {
+			continue;
+		}
+		if ( selector.timed_out() ) {
+			dprintf( D_ALWAYS, "ReliSock: timed out waiting for %s\n",
+					 peer_description );
+			return false;
+		}
+		if ( selector.failed() ) {
+			dprintf( D_ALWAYS, "ReliSock: select() failed: %s (errno=%d)\n",
+					 strerror(selector.select_errno()), selector.select_errno() );
+			return false;
+		}
+		return true;
+	}
+}
+
+// Read len bytes that are waiting in a pipe and write them to fd.  If the
+// write fails, the rest is still read out of the pipe and thrown away.
+// Returns 0, or the errno of the failure.
+static int
+copy_from_pipe( int pipe_fd, int fd, ssize_t len )
+{
+	char buf[65536];
+	int write_errno = 0;
+
+	while ( len > 0 ) {
+		ssize_t nrd = ::read( pipe_fd, buf, MIN( (ssize_t)sizeof(buf), len ) );
+		if ( nrd < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( nrd <= 0 ) {
+			return nrd < 0 ? errno : EIO;
+		}
+		len -= nrd;
+
+		for ( ssize_t written = 0; !write_errno && written < nrd; ) {
+			ssize_t rval = ::write( fd, &buf[written], nrd - written );
+			if ( rval < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( rval <= 0 ) {
+				write_errno = rval < 0 ? errno : EIO;
+				break;
+			}
+			written += rval;
+		}
+	}
+	return write_errno;
+}
+
+// Send bytes_to_send bytes of fd, starting at offset, with sendfile().
+// Returns 0 on success, -1 on failure, and 1 if sendfile() doesn't work
+// for this file or socket, in which case nothing has been sent and the
+// caller should send the file the ordinary way.
+int
+ReliSock::put_file_sendfile( int fd, filesize_t offset, filesize_t bytes_to_send,
+							 filesize_t &total, DCTransferQueue *xfer_q )
+{
+		// The socket is normally blocking, and we time out with
+		// select() like condor_write() does, so we need it non-blocking
+		// while we are in here.
+	int fcntl_flags = fcntl( _sock, F_GETFL );
+	if ( fcntl_flags < 0 ) {
+		return 1;
+	}
+	if ( (fcntl_flags & O_NONBLOCK) == 0 &&
+		 fcntl( _sock, F_SETFL, fcntl_flags | O_NONBLOCK ) < 0 ) {
+		return 1;
+	}
+
+	int result = 0;
+	off_t file_offset = offset;
+	while ( total < bytes_to_send ) {
+		UtcTime t1;
+		UtcTime t2;
+		if( xfer_q ) {
+			t1.getTime();
+		}
+
+		size_t chunk = (size_t)MIN( (filesize_t)SENDFILE_CHUNK_SIZE, bytes_to_send - total );
+		ssize_t nbytes = sendfile( _sock, fd, &file_offset, chunk );
+		int the_errno = errno;
+
+		if( xfer_q ) {
+			t2.getTime();
+				// We don't know how much of the time was spent reading
+				// from disk vs. writing to the network, so we just report
+				// it all as network i/o time.
+			xfer_q->AddUsecNetWrite(t2.difference_usec(t1));
+		}
+
+		if ( nbytes > 0 ) {
+			total += nbytes;
+			_bytes_sent += nbytes;
+			if( xfer_q ) {
+				xfer_q->AddBytesSent(nbytes);
+				xfer_q->ConsiderSendingReport(t2.seconds());
+			}
+			continue;
+		}
+
+		if ( nbytes == 0 ) {
+			dprintf( D_ALWAYS, "ReliSock: put_file: file ended after "
+					 FILESIZE_T_FORMAT " of " FILESIZE_T_FORMAT " bytes\n",
+					 total, bytes_to_send );
+			result = -1;
+			break;
+		}
+		if ( the_errno == EINTR ) {
+			continue;
+		}
+		if ( the_errno == EAGAIN || the_errno == EWOULDBLOCK ) {
+			bool ready = wait_for_socket( peer_description(), _sock, Selector::IO_WRITE, _timeout );
+			if( xfer_q ) {
+				t1.getTime();
+				xfer_q->AddUsecNetWrite(t1.difference_usec(t2));
+			}
+			if ( !ready ) {
+				result = -1;
+				break;
+			}
+			continue;
+		}
+		if ( total == 0 && (the_errno == EINVAL || the_errno == ENOSYS) ) {
+			dprintf( D_FULLDEBUG, "ReliSock: put_file: sendfile() not "
+					 "supported here (%s), using buffered i/o\n",
+					 strerror(the_errno) );
+			result = 1;
+			break;
+		}
+
+		dprintf( D_ALWAYS, "ReliSock: put_file: sendfile() failed after "
+				 FILESIZE_T_FORMAT " bytes: %s (errno=%d)\n",
+				 total, strerror(the_errno), the_errno );
+		result = -1;
+		break;
+	}
+
+	if ( (fcntl_flags & O_NONBLOCK) == 0 ) {
+		fcntl( _sock, F_SETFL, fcntl_flags );
+	}
+	return result;
+}
+
+// Receive bytes_to_receive bytes into fd by splicing them from the socket
+// through a pipe.  Returns 0 on success and -1 if receiving fails.  If
+// splice() doesn't work for this file or socket, or writing the file
+// fails, this returns 1 with total saying how much was consumed so far,
+// and the caller must read the rest of the file the ordinary way; in
+// the latter case, write_errno is set.
+int
+ReliSock::get_file_splice( int fd, filesize_t bytes_to_receive, filesize_t &total,
+						   int &write_errno, DCTransferQueue *xfer_q )
+{
+	write_errno = 0;
+
+		// splice() refuses to write to files opened for appending
+	int file_flags = fcntl( fd, F_GETFL );
+	if ( file_flags < 0 || (file_flags & O_APPEND) ) {
+		return 1;
+	}
+
+	int pipe_fds[2];
+	if ( pipe( pipe_fds ) < 0 ) {
+		dprintf( D_FULLDEBUG, "ReliSock: get_file: pipe() failed (%s), "
+				 "using buffered i/o\n", strerror(errno) );
+		return 1;
+	}
+	int pipe_size = 65536;
+#ifdef F_SETPIPE_SZ
+	if ( fcntl( pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE ) >= 0 ) {
+		pipe_size = SPLICE_PIPE_SIZE;
+	}
+#endif
+
+		// as in put_file_sendfile()
+	int fcntl_flags = fcntl( _sock, F_GETFL );
+	if ( fcntl_flags < 0 ||
+		 ( (fcntl_flags & O_NONBLOCK) == 0 &&
+		   fcntl( _sock, F_SETFL, fcntl_flags | O_NONBLOCK ) < 0 ) )
+	{
+		::close( pipe_fds[0] );
+		::close( pipe_fds[1] );
+		return 1;
+	}
+
+	int result = 0;
+	while ( total < bytes_to_receive ) {
+		UtcTime t1;
+		UtcTime t2;
+		if( xfer_q ) {
+			t1.getTime();
+		}
+
+		size_t want = (size_t)MIN( (filesize_t)pipe_size, bytes_to_receive - total );
+		ssize_t nbytes = splice( _sock, NULL, pipe_fds[1], NULL, want,
+								 SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+		int the_errno = errno;
+
+		if( xfer_q ) {
+			t2.getTime();
+			xfer_q->AddUsecNetRead(t2.difference_usec(t1));
+		}
+
+		if ( nbytes < 0 ) {
+			if ( the_errno == EINTR ) {
+				continue;
+			}
+			if ( the_errno == EAGAIN || the_errno == EWOULDBLOCK ) {
+				bool ready = wait_for_socket( peer_description(), _sock, Selector::IO_READ, _timeout );
+				if( xfer_q ) {
+					t1.getTime();
+					xfer_q->AddUsecNetRead(t1.difference_usec(t2));
+				}
+				if ( !ready ) {
+					result = -1;
+					break;
+				}
+				continue;
+			}
+			if ( total == 0 && (the_errno == EINVAL || the_errno == ENOSYS) ) {
+				dprintf( D_FULLDEBUG, "ReliSock: get_file: splice() not "
+						 "supported here (%s), using buffered i/o\n",
+						 strerror(the_errno) );
+				result = 1;
+				break;
+			}
+			dprintf( D_ALWAYS, "ReliSock: get_file: splice() from %s failed "
+					 "after " FILESIZE_T_FORMAT " bytes: %s (errno=%d)\n",
+					 peer_description(), total, strerror(the_errno), the_errno );
+			result = -1;
+			break;
+		}
+		if ( nbytes == 0 ) {
+			dprintf( D_ALWAYS, "ReliSock: get_file: connection to %s closed "
+					 "after " FILESIZE_T_FORMAT " of " FILESIZE_T_FORMAT " bytes\n",
+					 peer_description(), total, bytes_to_receive );
+			result = -1;
+			break;
+		}
+		_bytes_recvd += nbytes;
+		total += nbytes;
+
+			// Now move it out of the pipe into the file.
+		ssize_t left = nbytes;
+		while ( left > 0 ) {
+			ssize_t nwr = splice( pipe_fds[0], NULL, fd, NULL, left, SPLICE_F_MOVE );
+			if ( nwr < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( nwr <= 0 ) {
+				break;
+			}
+			left -= nwr;
+		}
+		if ( left > 0 ) {
+				// Either this file system can't be spliced to, or the
+				// write failed.  Write what is still in the pipe the
+				// ordinary way, which tells us which it was, and leave
+				// the rest to our caller.
+			write_errno = copy_from_pipe( pipe_fds[0], fd, left );
+			result = 1;
+		}
+
+		if( xfer_q ) {
+			t1.getTime();
+				// reuse t2 above as start time for file write
+			xfer_q->AddUsecFileWrite(t1.difference_usec(t2));
+			xfer_q->AddBytesReceived(nbytes);
+			xfer_q->ConsiderSendingReport(t1.seconds());
+		}
+
+		if ( result != 0 ) {
+			break;
+		}
+	}
+
+	if ( (fcntl_flags & O_NONBLOCK) == 0 ) {
+		fcntl( _sock, F_SETFL, fcntl_flags );
+	}
+	::close( pipe_fds[0] );
+	::close( pipe_fds[1] );
+	return result;
+}
+
+#endif
+
 int
 ReliSock::get_file_with_permissions( filesize_t *size, 
 									 const char *destination,
@@ -516,6 +516,7 @@ ReliSock::end_of_message_internal()
 	int ret_val = FALSE;
 
     resetCrypto();
+	reset_classad_wire_names();
 	switch(_coding){
 		case stream_encode:
 			if ( ignore_next_encode_eom == TRUE ) {
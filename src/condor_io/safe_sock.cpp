@@ -201,6 +201,7 @@ int SafeSock::end_of_message()
 	int sent;
         unsigned char * md = 0;
 
+	reset_classad_wire_names();
 	switch(_coding){
 		case stream_encode:
                     if (mdChecker_) {
@@ -1894,6 +1894,9 @@ int Sock::close()
 	setFullyQualifiedUser(NULL);
 	setTriedAuthentication(false);
 
+	// and the attribute names of binary ClassAds sent on the connection
+	reset_classad_wire_names();
+
 	return TRUE;
 }
 
@@ -25,6 +25,7 @@
 #include "condor_debug.h"
 #include "MyString.h"
 #include "utilfns.h"
+#include "classad_wire.h"
 
 /* The macro definition and file was added for debugging purposes */
 
@@ -72,6 +73,7 @@ Stream :: Stream(stream_code c) :
 	decrypt_buf_len(0),
 	m_peer_description_str(NULL),
 	m_peer_version(NULL),
+	m_classad_wire_names(NULL),
 	m_deadline_time(0),
 	ignore_timeout_multiplier(false)
 {
@@ -105,6 +107,7 @@ Stream :: ~Stream()
 	if( m_peer_version ) {
 		delete m_peer_version;
 	}
+	delete m_classad_wire_names;
 }
 
 int 
@@ -2176,6 +2179,23 @@ Stream::set_peer_version(CondorVersionInfo const *version)
 	}
 }
 
+ClassAdWireNames &
+Stream::classad_wire_names()
+{
+	if( !m_classad_wire_names ) {
+		m_classad_wire_names = new ClassAdWireNames;
+	}
+	return *m_classad_wire_names;
+}
+
+void
+Stream::reset_classad_wire_names()
+{
+	if( m_classad_wire_names ) {
+		m_classad_wire_names->clear();
+	}
+}
+
 void
 Stream::set_deadline_timeout(int t)
 {
@@ -0,0 +1,178 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "condor_adtypes.h"
+#include "stl_string_utils.h"
+
+#include "collector_delta.h"
+
+CollectorDeltaQuery::CollectorDeltaQuery()
+	: m_gotStatus(false)
+	, m_full(false)
+	, m_numChanged(0)
+	, m_numRemoved(0)
+	, m_wasDelta(false)
+{
+}
+
+CollectorDeltaQuery::~CollectorDeltaQuery()
+{
+	resetResponse();
+	clear();
+}
+
+void
+CollectorDeltaQuery::clear()
+{
+	std::map<std::string, ClassAd *>::iterator it;
+	for (it = m_ads.begin(); it != m_ads.end(); ++it) {
+		delete it->second;
+	}
+	m_ads.clear();
+	m_cookie.clear();
+	m_query.clear();
+}
+
+void
+CollectorDeltaQuery::resetResponse()
+{
+	for (size_t i = 0; i < m_changed.size(); i++) {
+		delete m_changed[i].second;
+	}
+	for (size_t i = 0; i < m_plain.size(); i++) {
+		delete m_plain[i];
+	}
+	m_changed.clear();
+	m_removed.clear();
+	m_plain.clear();
+	m_newCookie.clear();
+	m_gotStatus = false;
+	m_full = false;
+}
+
+// callback for CollectorList::query(), returns false if it kept the ad.
+bool
+CollectorDeltaQuery::receiveAd(void *pv, ClassAd *ad)
+{
+	CollectorDeltaQuery *self = (CollectorDeltaQuery *)pv;
+	const char *type = GetMyTypeName(*ad);
+
+	if (strcasecmp(type, COLLECTOR_DELTA_ADTYPE) == 0) {
+			// the start of a response.  if we already got part of one,
+			// the query failed over to another collector part way through.
+		self->resetResponse();
+		self->m_gotStatus = true;
+		ad->LookupString(ATTR_COLLECTOR_DELTA_COOKIE, self->m_newCookie);
+		ad->LookupBool(ATTR_COLLECTOR_DELTA_FULL, self->m_full);
+		return true;
+	}
+
+	std::string key;
+	if (self->m_gotStatus && ad->LookupString(ATTR_COLLECTOR_DELTA_KEY, key)) {
+		if (strcasecmp(type, COLLECTOR_DELTA_REMOVED_ADTYPE) == 0) {
+			self->m_removed.push_back(key);
+			return true;
+		}
+		ad->Delete(ATTR_COLLECTOR_DELTA_KEY);
+		self->m_changed.push_back(std::make_pair(key, ad));
+		return false;
+	}
+
+	self->m_plain.push_back(ad);
+	return false;
+}
+
+QueryResult
+CollectorDeltaQuery::fetch(CollectorList *collectors, CondorQuery &query,
+	ClassAdList &ads, CondorError *errstack)
+{
+	m_numChanged = 0;
+	m_numRemoved = 0;
+	m_wasDelta = false;
+
+	ClassAd queryAd;
+	QueryResult result = query.getQueryAd(queryAd);
+	if (result != Q_OK) {
+		return result;
+	}
+	std::string queryString;
+	sPrintAd(queryString, queryAd);
+	if (queryString != m_query) {
+			// the kept ads are the answer to another question
+		clear();
+		m_query = queryString;
+	}
+
+	std::string cookie;
+	formatstr(cookie, "%s = \"%s\"", ATTR_COLLECTOR_DELTA_COOKIE, m_cookie.c_str());
+	query.addExtraAttribute(cookie.c_str());
+
+	resetResponse();
+	result = collectors->query(query, receiveAd, this, errstack);
+	if (result != Q_OK) {
+		resetResponse();
+		return result;
+	}
+
+	if ( ! m_gotStatus) {
+			// the collector doesn't do delta queries, so this is the
+			// whole answer and there is nothing to keep.
+		clear();
+		for (size_t i = 0; i < m_plain.size(); i++) {
+			ads.Insert(m_plain[i]);
+		}
+		m_numChanged = (int)m_plain.size();
+		m_plain.clear();
+		return Q_OK;
+	}
+
+	if (m_full) {
+		std::string query_for = m_query;
+		clear();
+		m_query = query_for;
+	}
+	for (size_t i = 0; i < m_removed.size(); i++) {
+		std::map<std::string, ClassAd *>::iterator it = m_ads.find(m_removed[i]);
+		if (it != m_ads.end()) {
+			delete it->second;
+			m_ads.erase(it);
+		}
+	}
+	for (size_t i = 0; i < m_changed.size(); i++) {
+		ClassAd *&kept = m_ads[m_changed[i].first];
+		delete kept;
+		kept = m_changed[i].second;
+	}
+	m_numChanged = (int)m_changed.size();
+	m_numRemoved = (int)m_removed.size();
+	m_wasDelta = ! m_full;
+	m_cookie = m_newCookie;
+	m_changed.clear();
+	resetResponse();
+
+		// the negotiator changes the ads it is given, so it gets copies
+	std::map<std::string, ClassAd *>::iterator it;
+	for (it = m_ads.begin(); it != m_ads.end(); ++it) {
+		ads.Insert(new ClassAd(*it->second));
+	}
+	return Q_OK;
+}
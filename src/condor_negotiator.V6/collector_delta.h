@@ -0,0 +1,83 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __COLLECTOR_DELTA_H__
+#define __COLLECTOR_DELTA_H__
+
+#include "condor_classad.h"
+#include "condor_query.h"
+#include "daemon_list.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Keeps the result of a collector query between negotiation cycles, and
+// asks the collector for only the ads that were added, changed or removed
+// since the last query (see CollectorEngine::changesSince()).
+//
+// The collector only knows which ads changed, not which ads would now match
+// the query, so the constraint of the query must not depend on anything but
+// the ads themselves (CurrentTime in particular).  If the query changes, or
+// the collector can't send a delta (it is another collector, it restarted,
+// or too many ads changed), the collector sends every ad and the kept ads
+// are replaced.  A collector that does not know about delta queries just
+// answers the query, and then nothing is kept.
+//
+class CollectorDeltaQuery
+{
+  public:
+	CollectorDeltaQuery();
+	~CollectorDeltaQuery();
+
+	// forget the kept ads.
+	void clear();
+
+	// query the collectors, and put a copy of every ad in the result into
+	// ads.  on failure the kept ads are not changed.
+	QueryResult fetch(CollectorList *collectors, CondorQuery &query,
+			ClassAdList &ads, CondorError *errstack = NULL);
+
+	// what the last fetch() received
+	int changed() const { return m_numChanged; }
+	int removed() const { return m_numRemoved; }
+	bool wasDelta() const { return m_wasDelta; }
+
+  private:
+	static bool receiveAd(void *pv, ClassAd *ad);
+	void resetResponse();
+
+	std::map<std::string, ClassAd *> m_ads; // by delta key
+	std::string m_cookie;                   // from the last response
+	std::string m_query;                    // the query the ads are for
+
+		// the response being received
+	bool m_gotStatus;
+	bool m_full;
+	std::string m_newCookie;
+	std::vector<std::pair<std::string, ClassAd *> > m_changed;
+	std::vector<std::string> m_removed;
+	std::vector<ClassAd *> m_plain; // from a collector without delta queries
+
+	int m_numChanged;
+	int m_numRemoved;
+	bool m_wasDelta;
+};
+
+#endif // __COLLECTOR_DELTA_H__
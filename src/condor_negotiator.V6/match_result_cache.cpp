@@ -0,0 +1,316 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "consumption_policy.h"
+
+#include "match_result_cache.h"
+
+// attributes that the negotiator puts into the job and slot ads, whose
+// values change from cycle to cycle (or during a cycle) without a new
+// job signature or slot ad.  a match that depends on any of them cannot
+// be cached.  the Remote ones are also matched as a suffix, to catch the
+// slotN_ copies published by NEGOTIATOR_CROSS_SLOT_PRIOS.
+static const char * const volatile_attrs[] = {
+	ATTR_CURRENT_TIME,
+	ATTR_SUBMITTOR_PRIO,
+	ATTR_SUBMITTER_USER_PRIO,
+	ATTR_SUBMITTER_USER_RESOURCES_IN_USE,
+	ATTR_SUBMITTER_GROUP,
+	ATTR_SUBMITTER_GROUP_RESOURCES_IN_USE,
+	ATTR_SUBMITTER_GROUP_QUOTA,
+	ATTR_SUBMITTER_NEGOTIATING_GROUP,
+	ATTR_SUBMITTER_AUTOREGROUP,
+	NULL
+};
+static const char * const volatile_suffixes[] = {
+	ATTR_REMOTE_USER_PRIO,
+	ATTR_REMOTE_USER_RESOURCES_IN_USE,
+	ATTR_REMOTE_GROUP,
+	ATTR_REMOTE_GROUP_RESOURCES_IN_USE,
+	ATTR_REMOTE_GROUP_QUOTA,
+	NULL
+};
+
+static bool
+isVolatileAttr(const char * attr)
+{
+	for (int i = 0; volatile_attrs[i]; i++) {
+		if (strcasecmp(attr, volatile_attrs[i]) == 0) {
+			return true;
+		}
+	}
+	size_t len = strlen(attr);
+	for (int i = 0; volatile_suffixes[i]; i++) {
+		size_t slen = strlen(volatile_suffixes[i]);
+		if (len >= slen && strcasecmp(attr + len - slen, volatile_suffixes[i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+listHasVolatileAttr(StringList & list)
+{
+	const char * attr;
+	list.rewind();
+	while ((attr = list.next())) {
+		if (isVolatileAttr(attr)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// the same identity the negotiator uses for stashed startd ads
+static bool
+slotID(const ClassAd * ad, std::string & id)
+{
+	std::string name;
+	if ( ! ad->LookupString(ATTR_NAME, name)) {
+		return false;
+	}
+	if ( ! ad->LookupString(ATTR_STARTD_IP_ADDR, id)) {
+		id = "<No Address>";
+	}
+	id += " ";
+	id += name;
+	return true;
+}
+
+MatchResultCache::MatchResultCache()
+	: m_generation(0)
+	, m_hits(0)
+	, m_misses(0)
+{
+}
+
+void
+MatchResultCache::clear()
+{
+	m_slots.clear();
+	m_signatures.clear();
+	m_current.clear();
+}
+
+bool
+MatchResultCache::refersToVolatileAttrs(ClassAd & ad)
+{
+	StringList internal_refs;
+	StringList external_refs;
+	ad.GetReferences(ATTR_REQUIREMENTS, &internal_refs, &external_refs);
+	return listHasVolatileAttr(internal_refs) || listHasVolatileAttr(external_refs);
+}
+
+void
+MatchResultCache::beginCycle(ClassAdListDoesNotDeleteAds & slots)
+{
+	m_current.clear();
+	m_hits = 0;
+	m_misses = 0;
+	m_generation++;
+
+	compactSignatures();
+
+	int changed = 0;
+	std::string id;
+	ClassAd * ad;
+	slots.Open();
+	while ((ad = slots.Next())) {
+		if ( ! slotID(ad, id)) {
+			continue;
+		}
+		int sequence = -1;
+		int start_time = -1;
+		ad->LookupInteger(ATTR_UPDATE_SEQUENCE_NUMBER, sequence);
+		ad->LookupInteger(ATTR_DAEMON_START_TIME, start_time);
+
+		SlotEntry & entry = m_slots[id];
+		if (entry.last_seen == m_generation) {
+			// two ads with the same name and address; trust neither.
+			entry.cacheable = false;
+			entry.results.clear();
+			continue;
+		}
+		entry.last_seen = m_generation;
+		if (sequence < 0 || entry.sequence != sequence || entry.start_time != start_time) {
+			changed++;
+			entry.sequence = sequence;
+			entry.start_time = start_time;
+			entry.results.clear();
+
+			bool reevaluate = false;
+			ad->LookupBool(ATTR_WANT_AD_REVAULATE, reevaluate);
+				// old startds (and ads restored from the stash) have no
+				// sequence number, so we cannot tell when they change.
+			entry.cacheable = sequence >= 0 &&
+				! reevaluate &&
+				! cp_supports_policy(*ad) &&
+				! refersToVolatileAttrs(*ad);
+		}
+		if (entry.cacheable) {
+			m_current[ad] = &entry;
+		}
+	}
+	slots.Close();
+
+		// forget slots that have gone away
+	std::map<std::string, SlotEntry>::iterator it = m_slots.begin();
+	while (it != m_slots.end()) {
+		if (it->second.last_seen != m_generation) {
+			m_slots.erase(it++);
+		} else {
+			++it;
+		}
+	}
+
+	dprintf(D_FULLDEBUG, "Match result cache: %d of %d slots changed, %d cacheable, %d job signatures\n",
+		changed, (int)m_slots.size(), (int)m_current.size(), (int)m_signatures.size());
+}
+
+void
+MatchResultCache::endCycle()
+{
+	m_current.clear();
+}
+
+// drop the signatures that were not used in the previous cycle, and
+// renumber the rest so the result vectors of the slots stay dense.  the
+// survivors are renumbered in the order of their old ids, so that when
+// nothing was dropped every id, and so every result, stays where it is.
+void
+MatchResultCache::compactSignatures()
+{
+	std::vector<Signature *> by_id;
+	std::map<std::string, Signature>::iterator it = m_signatures.begin();
+	while (it != m_signatures.end()) {
+		int old_id = it->second.id;
+		if ((int)by_id.size() <= old_id) {
+			by_id.resize(old_id + 1, NULL);
+		}
+		if (it->second.last_used + 1 < m_generation) {
+			m_signatures.erase(it++);
+		} else {
+			by_id[old_id] = &it->second;
+			++it;
+		}
+	}
+
+	std::vector<int> new_ids(by_id.size(), -1);
+	int next_id = 0;
+	for (size_t i = 0; i < by_id.size(); i++) {
+		if (by_id[i]) {
+			new_ids[i] = next_id;
+			by_id[i]->id = next_id++;
+		}
+	}
+	if (next_id == (int)new_ids.size()) {
+		return; // nothing was dropped
+	}
+
+	std::map<std::string, SlotEntry>::iterator sit;
+	for (sit = m_slots.begin(); sit != m_slots.end(); ++sit) {
+		std::vector<signed char> & results = sit->second.results;
+		std::vector<signed char> compacted(next_id, (signed char)UNKNOWN);
+		for (size_t i = 0; i < results.size() && i < new_ids.size(); i++) {
+			if (new_ids[i] >= 0) {
+				compacted[new_ids[i]] = results[i];
+			}
+		}
+		results.swap(compacted);
+	}
+}
+
+int
+MatchResultCache::signature(ClassAd & request)
+{
+	std::string attrs;
+	if ( ! request.LookupString(ATTR_AUTO_CLUSTER_ATTRS, attrs)) {
+		return -1;
+	}
+
+		// the signature is the list of attributes and their values, which
+		// is what the schedd puts jobs into autoclusters by.  the
+		// autocluster id itself is not used, it is only unique within one
+		// schedd and may be reused after the autocluster goes away.
+	std::string sig;
+	classad::ClassAdUnParser unparser;
+	StringList attr_list(attrs.c_str());
+	attr_list.append(ATTR_REQUIREMENTS);
+	const char * attr;
+	attr_list.rewind();
+	while ((attr = attr_list.next())) {
+		sig += attr;
+		sig += '=';
+		classad::ExprTree * expr = request.LookupExpr(attr);
+		if (expr) {
+			unparser.Unparse(sig, expr);
+		}
+		sig += '\n';
+	}
+
+	std::map<std::string, Signature>::iterator it = m_signatures.find(sig);
+	if (it == m_signatures.end()) {
+		Signature entry;
+		entry.id = (int)m_signatures.size();
+		entry.cacheable = ! refersToVolatileAttrs(request);
+		it = m_signatures.insert(std::make_pair(sig, entry)).first;
+	}
+	it->second.last_used = m_generation;
+	return it->second.cacheable ? it->second.id : -1;
+}
+
+int
+MatchResultCache::lookup(int sig, const ClassAd * slot)
+{
+	if (sig < 0) {
+		return UNKNOWN;
+	}
+	std::map<const ClassAd *, SlotEntry *>::const_iterator it = m_current.find(slot);
+	if (it == m_current.end()) {
+		return UNKNOWN;
+	}
+	const std::vector<signed char> & results = it->second->results;
+	if ((size_t)sig < results.size() && results[sig] != UNKNOWN) {
+		m_hits++;
+		return results[sig];
+	}
+	return UNKNOWN;
+}
+
+void
+MatchResultCache::store(int sig, const ClassAd * slot, bool matched)
+{
+	if (sig < 0) {
+		return;
+	}
+	std::map<const ClassAd *, SlotEntry *>::iterator it = m_current.find(slot);
+	if (it == m_current.end()) {
+		return;
+	}
+	std::vector<signed char> & results = it->second->results;
+	if ((size_t)sig >= results.size()) {
+		results.resize(sig + 1, (signed char)UNKNOWN);
+	}
+	results[sig] = matched ? MATCH : NO_MATCH;
+	m_misses++;
+}
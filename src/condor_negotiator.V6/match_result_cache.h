@@ -0,0 +1,106 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __MATCH_RESULT_CACHE_H__
+#define __MATCH_RESULT_CACHE_H__
+
+#include "condor_classad.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Remembers whether a job signature matched a slot, across negotiation
+// cycles, so that a job is only matched against the slots that changed
+// since the last time a job with the same signature was matched.
+//
+// A job signature is the value of each of the job's autocluster
+// (significant) attributes.  A slot is identified by its name and address,
+// and its version by the UpdateSequenceNumber and DaemonStartTime the
+// startd put in the ad; any change to the slot ad comes with a new
+// sequence number.  A job or slot whose Requirements refer to one of the
+// attributes that the negotiator itself changes from cycle to cycle (user
+// priorities, resources in use, CurrentTime) is never cached, and neither
+// is a slot that the negotiator changes during the cycle (slots with a
+// consumption policy, or that want their ad re-evaluated after a match).
+//
+// Only the symmetric match of Requirements is cached; ranks and the
+// preemption policy are evaluated as before for the slots that match.
+//
+class MatchResultCache
+{
+  public:
+	enum { UNKNOWN = -1, NO_MATCH = 0, MATCH = 1 };
+
+	MatchResultCache();
+
+	// forget everything, for example on reconfig.
+	void clear();
+
+	// start a negotiation cycle with the given slot ads.  slots whose
+	// version changed lose their results, and slots and signatures that
+	// were not seen in the previous cycle are forgotten.  the ads must not
+	// be modified or deleted until endCycle().
+	void beginCycle(ClassAdListDoesNotDeleteAds & slots);
+	void endCycle();
+
+	// the signature of a job, or -1 if matches of the job cannot be cached.
+	int signature(ClassAd & request);
+
+	// the cached match of the job signature with the slot, or UNKNOWN.
+	int lookup(int sig, const ClassAd * slot);
+
+	// remember the match of the job signature with the slot.
+	void store(int sig, const ClassAd * slot, bool matched);
+
+	// matches of the current cycle that were taken from the cache, and
+	// that were evaluated and stored.
+	int hits() const { return m_hits; }
+	int misses() const { return m_misses; }
+	int numSlots() const { return (int)m_slots.size(); }
+	int numSignatures() const { return (int)m_signatures.size(); }
+
+  private:
+	struct SlotEntry {
+		SlotEntry() : sequence(-1), start_time(-1), cacheable(false), last_seen(0) {}
+		int sequence;
+		int start_time;
+		bool cacheable;
+		unsigned int last_seen;
+		std::vector<signed char> results; // indexed by signature, UNKNOWN if not yet matched
+	};
+	struct Signature {
+		Signature() : id(0), cacheable(false), last_used(0) {}
+		int id;
+		bool cacheable;
+		unsigned int last_used;
+	};
+
+	static bool refersToVolatileAttrs(ClassAd & ad);
+	void compactSignatures();
+
+	std::map<std::string, SlotEntry> m_slots;      // by MachineAdID
+	std::map<std::string, Signature> m_signatures; // by signature string
+	std::map<const ClassAd *, SlotEntry *> m_current; // slot ads of this cycle
+	unsigned int m_generation;
+	int m_hits;
+	int m_misses;
+};
+
+#endif // __MATCH_RESULT_CACHE_H__
@@ -0,0 +1,173 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_classad.h"
+#include "condor_attributes.h"
+
+#include "match_result_cache.h"
+
+int fail_count = 0;
+
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed %5d: %s\n", __LINE__, #condition ); \
+		++fail_count; \
+	}
+
+// a slot ad that the cache will keep results for
+static void
+make_slot( ClassAd & slot, const char * name )
+{
+	slot.Assign( ATTR_NAME, name );
+	slot.Assign( ATTR_STARTD_IP_ADDR, "<127.0.0.1:9618>" );
+	slot.Assign( ATTR_UPDATE_SEQUENCE_NUMBER, 1 );
+	slot.Assign( ATTR_DAEMON_START_TIME, 1000 );
+	slot.AssignExpr( ATTR_REQUIREMENTS, "true" );
+}
+
+// a job whose signature is its owner
+static void
+make_job( ClassAd & job, const char * owner )
+{
+	job.Assign( ATTR_OWNER, owner );
+	job.Assign( ATTR_AUTO_CLUSTER_ATTRS, ATTR_OWNER );
+	job.AssignExpr( ATTR_REQUIREMENTS, "true" );
+}
+
+// signatures are kept by their text, but numbered in the order they
+// were first seen.  "b" sorts after "a" but is seen first, so a cycle
+// that renumbers by text instead of by age would swap their results.
+static void
+test_signature_order_kept_when_nothing_dropped()
+{
+	MatchResultCache cache;
+	ClassAd slot1, slot2, job_a, job_b;
+	make_slot( slot1, "slot1@host" );
+	make_slot( slot2, "slot2@host" );
+	make_job( job_a, "a" );
+	make_job( job_b, "b" );
+
+	ClassAdListDoesNotDeleteAds slots;
+	slots.Insert( &slot1 );
+	slots.Insert( &slot2 );
+
+	cache.beginCycle( slots );
+	int sig_b = cache.signature( job_b );
+	int sig_a = cache.signature( job_a );
+	REQUIRE( sig_b >= 0 );
+	REQUIRE( sig_a >= 0 );
+	REQUIRE( sig_a != sig_b );
+	cache.store( sig_b, &slot1, true );
+	cache.store( sig_b, &slot2, false );
+	cache.store( sig_a, &slot1, false );
+	cache.store( sig_a, &slot2, true );
+	cache.endCycle();
+
+		// both signatures were used, so none is dropped
+	cache.beginCycle( slots );
+	REQUIRE( cache.numSignatures() == 2 );
+	sig_b = cache.signature( job_b );
+	sig_a = cache.signature( job_a );
+	REQUIRE( cache.lookup( sig_b, &slot1 ) == MatchResultCache::MATCH );
+	REQUIRE( cache.lookup( sig_b, &slot2 ) == MatchResultCache::NO_MATCH );
+	REQUIRE( cache.lookup( sig_a, &slot1 ) == MatchResultCache::NO_MATCH );
+	REQUIRE( cache.lookup( sig_a, &slot2 ) == MatchResultCache::MATCH );
+	REQUIRE( cache.hits() == 4 );
+	cache.endCycle();
+}
+
+// the same, but with a signature in front of them that is dropped, so
+// the survivors move down
+static void
+test_signature_order_kept_when_one_dropped()
+{
+	MatchResultCache cache;
+	ClassAd slot1, job_a, job_b, job_c;
+	make_slot( slot1, "slot1@host" );
+	make_job( job_a, "a" );
+	make_job( job_b, "b" );
+	make_job( job_c, "c" );
+
+	ClassAdListDoesNotDeleteAds slots;
+	slots.Insert( &slot1 );
+
+	cache.beginCycle( slots );
+	int sig_c = cache.signature( job_c );
+	int sig_b = cache.signature( job_b );
+	int sig_a = cache.signature( job_a );
+	cache.store( sig_c, &slot1, true );
+	cache.store( sig_b, &slot1, true );
+	cache.store( sig_a, &slot1, false );
+	cache.endCycle();
+
+		// c is not used this cycle
+	cache.beginCycle( slots );
+	sig_b = cache.signature( job_b );
+	sig_a = cache.signature( job_a );
+	cache.endCycle();
+
+		// so now it is gone
+	cache.beginCycle( slots );
+	REQUIRE( cache.numSignatures() == 2 );
+	sig_b = cache.signature( job_b );
+	sig_a = cache.signature( job_a );
+	REQUIRE( cache.lookup( sig_b, &slot1 ) == MatchResultCache::MATCH );
+	REQUIRE( cache.lookup( sig_a, &slot1 ) == MatchResultCache::NO_MATCH );
+	cache.endCycle();
+
+		// and a new c starts out unknown
+	cache.beginCycle( slots );
+	sig_c = cache.signature( job_c );
+	REQUIRE( sig_c >= 0 );
+	REQUIRE( cache.lookup( sig_c, &slot1 ) == MatchResultCache::UNKNOWN );
+	cache.endCycle();
+}
+
+// a slot with a new sequence number loses its results
+static void
+test_changed_slot_forgotten()
+{
+	MatchResultCache cache;
+	ClassAd slot1, job_a;
+	make_slot( slot1, "slot1@host" );
+	make_job( job_a, "a" );
+
+	ClassAdListDoesNotDeleteAds slots;
+	slots.Insert( &slot1 );
+
+	cache.beginCycle( slots );
+	int sig_a = cache.signature( job_a );
+	cache.store( sig_a, &slot1, true );
+	cache.endCycle();
+
+	slot1.Assign( ATTR_UPDATE_SEQUENCE_NUMBER, 2 );
+	cache.beginCycle( slots );
+	sig_a = cache.signature( job_a );
+	REQUIRE( cache.lookup( sig_a, &slot1 ) == MatchResultCache::UNKNOWN );
+	cache.endCycle();
+}
+
+int main( int /*argc*/, const char ** /*argv*/) {
+
+	test_signature_order_kept_when_nothing_dropped();
+	test_signature_order_kept_when_one_dropped();
+	test_changed_slot_forgotten();
+	return fail_count;
+}
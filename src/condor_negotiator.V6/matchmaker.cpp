@@ -119,6 +119,15 @@ public:
     int pies;
     int pie_spins;
 
+    // matching done by the ParallelMatcher
+    int match_threads;
+    double match_wall_time;
+    double match_work_time;
+
+    // lookups in the cross-cycle MatchResultCache
+    int match_cache_hits;
+    int match_cache_misses;
+
     // set of unique active schedd, id by sinful strings:
     std::set<std::string> active_schedds;
 
@@ -156,6 +165,11 @@ NegotiationCycleStats::NegotiationCycleStats():
 	rejections(0),
     pies(0),
     pie_spins(0),
+    match_threads(0),
+    match_wall_time(0.0),
+    match_work_time(0.0),
+    match_cache_hits(0),
+    match_cache_misses(0),
     active_schedds(),
     active_submitters(),
     submitters_share_limit(),
@@ -402,6 +416,9 @@ Matchmaker ()
 	ConsiderPreemption = true;
 	ConsiderEarlyPreemption = false;
 	want_nonblocking_startd_contact = true;
+	NegotiatorNumThreads = 1;
+	want_match_result_caching = false;
+	want_delta_queries = false;
 
 	completedLastCycleTime = (time_t) 0;
 
@@ -877,6 +894,28 @@ reinitialize ()
 
 	m_staticRanks = param_boolean("NEGOTIATOR_IGNORE_JOB_RANKS", false);
 
+	NegotiatorNumThreads = param_integer("NEGOTIATOR_NUM_THREADS", 1, 1, 256);
+	if (NegotiatorNumThreads > 1) {
+		if (m_parallel_matcher.size() != NegotiatorNumThreads) {
+			m_parallel_matcher.shutdown();
+			if (m_parallel_matcher.grow(NegotiatorNumThreads) < NegotiatorNumThreads) {
+				dprintf(D_ALWAYS, "NEGOTIATOR_NUM_THREADS = %d, but only %d match threads could be started\n",
+					NegotiatorNumThreads, m_parallel_matcher.size());
+			}
+		}
+		m_parallel_matcher.setRankExprs(NegotiatorPreJobRank, NegotiatorPostJobRank);
+	} else {
+		m_parallel_matcher.shutdown();
+	}
+
+		// the cached results may depend on the old configuration
+	want_match_result_caching = param_boolean("NEGOTIATOR_MATCH_RESULT_CACHE", false);
+	m_match_cache.clear();
+
+	want_delta_queries = param_boolean("NEGOTIATOR_DELTA_QUERIES", false);
+	m_public_ads.clear();
+	m_private_ads.clear();
+
 	if( first_time ) {
 		first_time = false;
 	} else { 
@@ -1530,6 +1569,10 @@ negotiationTime ()
 	// available during matchmaking
 	addRemoteUserPrios( startdAds );
 
+	if (want_match_result_caching) {
+		m_match_cache.beginCycle( startdAds );
+	}
+
     if (hgq_groups.size() <= 1) {
         // If there is only one group (the root group) we are in traditional non-HGQ mode.
         // It seems cleanest to take the traditional case separately for maximum backward-compatible behavior.
@@ -1899,6 +1942,12 @@ negotiationTime ()
     // ----- Done with the negotiation cycle
     dprintf( D_ALWAYS, "---------- Finished Negotiation Cycle ----------\n" );
 
+	if (want_match_result_caching) {
+		negotiation_cycle_stats[0]->match_cache_hits = m_match_cache.hits();
+		negotiation_cycle_stats[0]->match_cache_misses = m_match_cache.misses();
+		m_match_cache.endCycle();
+	}
+
     completedLastCycleTime = time(NULL);
 
     negotiation_cycle_stats[0]->end_time = completedLastCycleTime;
@@ -3488,21 +3537,39 @@ obtainAdsFromCollector (
 
 	dprintf(D_ALWAYS,"  Getting startd private ads ...\n");
 	ClassAdList startdPvtAdList;
-	result = collects->query (privateQuery, startdPvtAdList);
+	if (want_delta_queries) {
+		result = m_private_ads.fetch (collects, privateQuery, startdPvtAdList);
+	} else {
+		result = collects->query (privateQuery, startdPvtAdList);
+	}
 	if( result!=Q_OK ) {
 		dprintf(D_ALWAYS, "Couldn't fetch ads: %s\n", getStrQueryResult(result));
 		return false;
 	}
+	if (want_delta_queries) {
+		dprintf(D_ALWAYS, "  Got %s of %d changed and %d removed startd private ads\n",
+				m_private_ads.wasDelta() ? "delta" : "full result",
+				m_private_ads.changed(), m_private_ads.removed());
+	}
 
     CondorError errstack;
 	dprintf(D_ALWAYS, "  Getting Scheduler, Submitter and Machine ads ...\n");
-	result = collects->query (publicQuery, allAds, &errstack);
+	if (want_delta_queries) {
+		result = m_public_ads.fetch (collects, publicQuery, allAds, &errstack);
+	} else {
+		result = collects->query (publicQuery, allAds, &errstack);
+	}
 	if( result!=Q_OK ) {
 		dprintf(D_ALWAYS, "Couldn't fetch ads: %s\n", 
            errstack.code() ? errstack.getFullText(false).c_str() : getStrQueryResult(result)
            );
 		return false;
 	}
+	if (want_delta_queries) {
+		dprintf(D_ALWAYS, "  Got %s of %d changed and %d removed ads\n",
+				m_public_ads.wasDelta() ? "delta" : "full result",
+				m_public_ads.changed(), m_public_ads.removed());
+	}
 
 	dprintf(D_ALWAYS, "  Sorting %d ads ...\n",allAds.MyLength());
 
@@ -5070,19 +5137,41 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 
 	bool allow_pslot_preemption = param_boolean("ALLOW_PSLOT_PREEMPTION", false);
 	double allocatedWeight = 0.0;
-		// Set up for parallel matchmaking, if enabled
+		// Set up for parallel matchmaking, if enabled.  The match threads
+		// evaluate Requirements and the ranks for every candidate up front,
+		// the loop below then applies the preemption and limit policy
+		// in the usual order, using the precomputed values.
 	std::vector<compat_classad::ClassAd *> par_candidates;
-	std::vector<compat_classad::ClassAd *> par_matches;
+	std::vector<ParallelMatchResult> par_results;
+	std::vector<int> par_cached;
+	size_t par_index = 0;
+
+		// Matches of this job's signature against slots that have not
+		// changed since an earlier cycle are taken from the match cache.
+	int match_sig = want_match_result_caching ? m_match_cache.signature(request) : -1;
 
-	int num_threads =  param_integer("NEGOTIATOR_NUM_THREADS", 1);
-	if (num_threads > 1) {
+	bool use_parallel = NegotiatorNumThreads > 1 && m_parallel_matcher.size() > 1;
+	if (use_parallel) {
 		startdAds.Open();
 		par_candidates.reserve(startdAds.Length());
 		while ((candidate = startdAds.Next())) {
-			par_candidates.push_back(candidate);
+				// slots with a consumption policy temporarily rewrite the
+				// request before matching, so they must be matched serially.
+				// slots with a cached result need not be matched at all.
+			int cached = m_match_cache.lookup(match_sig, candidate);
+			par_cached.push_back(cached);
+			if (cp_supports_policy(*candidate) || cached != MatchResultCache::UNKNOWN) {
+				par_candidates.push_back(NULL);
+			} else {
+				par_candidates.push_back(candidate);
+			}
 		}
 		startdAds.Close();
-		ParallelIsAMatch(&request, par_candidates, par_matches, num_threads, false);
+		m_parallel_matcher.match(request, par_candidates, par_results);
+
+		negotiation_cycle_stats[0]->match_threads = m_parallel_matcher.size();
+		negotiation_cycle_stats[0]->match_wall_time += m_parallel_matcher.lastWallTime();
+		negotiation_cycle_stats[0]->match_work_time += m_parallel_matcher.lastWorkTime();
 	}
 
 	// scan the offer ads
@@ -5094,6 +5183,15 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 	getSinfulStringProtocolBools( true, true, scheddAddr, isIPv4, isIPv6 );
 
 	while ((candidate = startdAds.Next ())) {
+		const ParallelMatchResult *par_result = NULL;
+		int cached_match = MatchResultCache::UNKNOWN;
+		if (use_parallel) {
+			ASSERT( par_index < par_results.size() );
+			cached_match = par_cached[par_index];
+			par_result = &par_results[par_index++];
+			if ( ! par_result->evaluated) { par_result = NULL; }
+		}
+
 		bool v4 = false;
 		bool v6 = false;
 		candidate->LookupString( "MyAddress", machineAddr );
@@ -5136,12 +5234,19 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
         // requested via consumption policy must also be available from
         // the resource
 		bool is_a_match = false;
-		if (num_threads > 1) {
-			is_a_match = cp_sufficient && 
-				(par_matches.end() != 
-					std::find(par_matches.begin(), par_matches.end(), candidate));
-		} else {
-			is_a_match = cp_sufficient && IsAMatch(&request, candidate);
+		if ( ! use_parallel) {
+			cached_match = m_match_cache.lookup(match_sig, candidate);
+		}
+		if (cached_match != MatchResultCache::UNKNOWN) {
+			is_a_match = cp_sufficient && cached_match == MatchResultCache::MATCH;
+		} else if (par_result) {
+			is_a_match = cp_sufficient && par_result->matched;
+			m_match_cache.store(match_sig, candidate, par_result->matched);
+		} else if (cp_sufficient) {
+			is_a_match = IsAMatch(&request, candidate);
+			if ( ! has_cp) {
+				m_match_cache.store(match_sig, candidate, is_a_match);
+			}
 		}
 
         if (has_cp) {
@@ -5302,7 +5407,7 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 			}
 		}
 
-		calculateRanks(request, candidate, candidatePreemptState, candidateRankValue, candidatePreJobRankValue, candidatePostJobRankValue, candidatePreemptRankValue);
+		calculateRanks(request, candidate, candidatePreemptState, candidateRankValue, candidatePreJobRankValue, candidatePostJobRankValue, candidatePreemptRankValue, par_result);
 
 		if ( MatchList ) {
 			MatchList->add_candidate(
@@ -5522,7 +5627,8 @@ calculateRanks(ClassAd &request,
                double &candidateRankValue,
                double &candidatePreJobRankValue,
                double &candidatePostJobRankValue,
-               double &candidatePreemptRankValue
+               double &candidatePreemptRankValue,
+               const ParallelMatchResult *precomputed
               )
 {
 	if (m_staticRanks) {
@@ -5539,20 +5645,27 @@ calculateRanks(ClassAd &request,
 		} 
 	}
 
-	candidatePreJobRankValue = EvalNegotiatorMatchRank(
-		"NEGOTIATOR_PRE_JOB_RANK",NegotiatorPreJobRank,
-		request, candidate);
+	if (precomputed && precomputed->matched) {
+		// the match threads already evaluated these
+		candidatePreJobRankValue = precomputed->pre_job_rank;
+		candidateRankValue = precomputed->rank;
+		candidatePostJobRankValue = precomputed->post_job_rank;
+	} else {
+		candidatePreJobRankValue = EvalNegotiatorMatchRank(
+			"NEGOTIATOR_PRE_JOB_RANK",NegotiatorPreJobRank,
+			request, candidate);
 
-	// calculate the request's rank of the candidate
-	double tmp;
-	if(!request.EvalFloat(ATTR_RANK, candidate, tmp)) {
-		tmp = 0.0;
-	}
-	candidateRankValue = tmp;
+		// calculate the request's rank of the candidate
+		double tmp;
+		if(!request.EvalFloat(ATTR_RANK, candidate, tmp)) {
+			tmp = 0.0;
+		}
+		candidateRankValue = tmp;
 
-	candidatePostJobRankValue = EvalNegotiatorMatchRank(
-		"NEGOTIATOR_POST_JOB_RANK",NegotiatorPostJobRank,
-		request, candidate);
+		candidatePostJobRankValue = EvalNegotiatorMatchRank(
+			"NEGOTIATOR_POST_JOB_RANK",NegotiatorPostJobRank,
+			request, candidate);
+	}
 
 	candidatePreemptRankValue = -(FLT_MAX);
 	if(candidatePreemptState != NO_PREEMPTION) {
@@ -6878,7 +6991,11 @@ Matchmaker::publishNegotiationCycleStats( ClassAd *ad )
         ATTR_LAST_NEGOTIATION_CYCLE_SUBMITTERS_SHARE_LIMIT,
         ATTR_LAST_NEGOTIATION_CYCLE_ACTIVE_SUBMITTER_COUNT,
         ATTR_LAST_NEGOTIATION_CYCLE_MATCH_RATE,
-        ATTR_LAST_NEGOTIATION_CYCLE_MATCH_RATE_SUSTAINED
+        ATTR_LAST_NEGOTIATION_CYCLE_MATCH_RATE_SUSTAINED,
+        ATTR_LAST_NEGOTIATION_CYCLE_MATCH_THREADS,
+        ATTR_LAST_NEGOTIATION_CYCLE_MATCH_SPEEDUP,
+        ATTR_LAST_NEGOTIATION_CYCLE_MATCH_CACHE_HITS,
+        ATTR_LAST_NEGOTIATION_CYCLE_MATCH_CACHE_MISSES
     };
     const int nattrs = sizeof(attrs)/sizeof(*attrs);
 
@@ -6931,6 +7048,14 @@ Matchmaker::publishNegotiationCycleStats( ClassAd *ad )
 		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_SUBMITTERS_FAILED, i, s->submitters_failed);
 		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_SUBMITTERS_OUT_OF_TIME, i, s->submitters_out_of_time);
         SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_SUBMITTERS_SHARE_LIMIT, i, s->submitters_share_limit);
+		if (s->match_threads > 1) {
+			SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_MATCH_THREADS, i, s->match_threads );
+			SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_MATCH_SPEEDUP, i, (s->match_wall_time > 0) ? s->match_work_time/s->match_wall_time : double(1.0));
+		}
+		if (s->match_cache_hits || s->match_cache_misses) {
+			SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_MATCH_CACHE_HITS, i, s->match_cache_hits );
+			SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_MATCH_CACHE_MISSES, i, s->match_cache_misses );
+		}
 	}
 }
 
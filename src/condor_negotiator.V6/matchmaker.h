@@ -28,6 +28,9 @@
 #include "dc_collector.h"
 #include "condor_ver_info.h"
 #include "matchmaker_negotiate.h"
+#include "parallel_match.h"
+#include "match_result_cache.h"
+#include "collector_delta.h"
 
 #include <vector>
 #include <string>
@@ -148,7 +151,7 @@ class Matchmaker : public Service
 		void forwardAccountingData(std::set<std::string> &names);
 		void forwardGroupAccounting(DCCollector &collector, GroupEntry *ge);
 
-		void calculateRanks(ClassAd &request, ClassAd *offer, PreemptState candidatePreemptState, double &candidateRankValue, double &candidatePreJobRankValue, double &candidatePostJobRankValue, double &candidatePreemptRankValue);
+		void calculateRanks(ClassAd &request, ClassAd *offer, PreemptState candidatePreemptState, double &candidateRankValue, double &candidatePreJobRankValue, double &candidatePostJobRankValue, double &candidatePreemptRankValue, const ParallelMatchResult *precomputed = NULL);
 
     protected:
 		char * NegotiatorName;
@@ -384,6 +387,15 @@ class Matchmaker : public Service
 
 		bool m_staticRanks;
 
+		int NegotiatorNumThreads;	// value of knob NEGOTIATOR_NUM_THREADS
+		ParallelMatcher m_parallel_matcher; // evaluates matches on NegotiatorNumThreads threads
+
+		bool want_match_result_caching;	// value of knob NEGOTIATOR_MATCH_RESULT_CACHE
+		MatchResultCache m_match_cache;	// match results kept across negotiation cycles
+		bool want_delta_queries;	// value of knob NEGOTIATOR_DELTA_QUERIES
+		CollectorDeltaQuery m_public_ads;	// ads kept across cycles for delta queries
+		CollectorDeltaQuery m_private_ads;
+
 		StringList NegotiatorMatchExprNames;
 		StringList NegotiatorMatchExprValues;
 
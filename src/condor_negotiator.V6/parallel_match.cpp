@@ -0,0 +1,419 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "utc_time.h"
+#include <float.h>
+
+#include "parallel_match.h"
+
+// everything one thread needs to evaluate matches without touching
+// anything that another thread might be using.
+struct ParallelMatcher::Context {
+	Context(ParallelMatcher * owner);
+	~Context();
+	void setRankExprs(classad::ExprTree * pre, classad::ExprTree * post, int generation);
+
+	ParallelMatcher * owner;
+	classad::MatchClassAd mad;
+	ClassAd request;   // empty ad chained to the job
+	ClassAd candidate; // empty ad chained to the slot being matched
+	classad::ExprTree * pre_job_rank;
+	classad::ExprTree * post_job_rank;
+	int rank_generation;
+	unsigned long batch; // the last batch this context's thread worked on
+	double work_time;
+};
+
+ParallelMatcher::Context::Context(ParallelMatcher * own)
+	: owner(own)
+	, pre_job_rank(NULL)
+	, post_job_rank(NULL)
+	, rank_generation(-1)
+	, batch(0)
+	, work_time(0.0)
+{
+	// the chained ads stay in the match ad for the life of the context,
+	// we only re-chain them for each job and candidate.
+	mad.ReplaceLeftAd(&request);
+	mad.ReplaceRightAd(&candidate);
+	if ( ! ClassAd::m_strictEvaluation) {
+		request.alternateScope = &candidate;
+		candidate.alternateScope = &request;
+	}
+}
+
+ParallelMatcher::Context::~Context()
+{
+	// the match ad would delete the left and right ads, but they are ours.
+	mad.RemoveLeftAd();
+	mad.RemoveRightAd();
+	request.alternateScope = NULL;
+	candidate.alternateScope = NULL;
+	request.Unchain();
+	candidate.Unchain();
+	delete pre_job_rank;
+	delete post_job_rank;
+}
+
+void
+ParallelMatcher::Context::setRankExprs(classad::ExprTree * pre, classad::ExprTree * post, int generation)
+{
+	delete pre_job_rank;
+	delete post_job_rank;
+	pre_job_rank = pre ? pre->Copy() : NULL;
+	post_job_rank = post ? post->Copy() : NULL;
+	// the negotiator ranks are evaluated with the slot as MY
+	if (pre_job_rank) { pre_job_rank->SetParentScope(&candidate); }
+	if (post_job_rank) { post_job_rank->SetParentScope(&candidate); }
+	rank_generation = generation;
+}
+
+// evaluate a NEGOTIATOR_*_JOB_RANK expression the same way that
+// Matchmaker::EvalNegotiatorMatchRank does.
+static double
+evalNegotiatorRank(const char * expr_name, classad::ExprTree * expr, ClassAd & scope)
+{
+	float rank = -(FLT_MAX);
+	if ( ! expr) {
+		return rank;
+	}
+
+	classad::Value result;
+	double val;
+	if ( ! scope.EvaluateExpr(expr, result)) {
+		dprintf(D_ALWAYS, "Failed to evaluate %s expression.\n", expr_name);
+	} else if (result.IsNumber(val)) {
+		rank = (float)val;
+	} else {
+		dprintf(D_ALWAYS, "Failed to evaluate %s expression to a float.\n", expr_name);
+	}
+	return rank;
+}
+
+// evaluate the job's Rank the same way that ClassAd::EvalFloat does when
+// given a target ad, returns 0.0 if it does not evaluate to a number.
+static double
+evalJobRank(ClassAd & request, ClassAd & candidate)
+{
+	classad::Value val;
+	bool ok = false;
+	if (request.Lookup(ATTR_RANK)) {
+		ok = request.EvaluateAttr(ATTR_RANK, val);
+	} else if (candidate.Lookup(ATTR_RANK)) {
+		ok = candidate.EvaluateAttr(ATTR_RANK, val);
+	}
+
+	double rank = 0.0;
+	long long ival;
+	bool bval;
+	if ( ! ok) {
+		return 0.0;
+	} else if (val.IsRealValue(rank)) {
+		return rank;
+	} else if (val.IsIntegerValue(ival)) {
+		return (double)ival;
+	} else if (val.IsBooleanValue(bval)) {
+		return bval ? 1.0 : 0.0;
+	}
+	return 0.0;
+}
+
+ParallelMatcher::ParallelMatcher()
+	: m_pre_job_rank(NULL)
+	, m_post_job_rank(NULL)
+	, m_rank_generation(0)
+	, m_request(NULL)
+	, m_candidates(NULL)
+	, m_results(NULL)
+	, m_next(0)
+	, m_chunk(1)
+	, m_wall_time(0.0)
+	, m_work_time(0.0)
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	, m_batch(0)
+	, m_busy(0)
+	, m_stopping(false)
+#endif
+{
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_start_cond, NULL);
+	pthread_cond_init(&m_done_cond, NULL);
+#endif
+}
+
+ParallelMatcher::~ParallelMatcher()
+{
+	shutdown();
+	delete m_pre_job_rank;
+	delete m_post_job_rank;
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_cond_destroy(&m_done_cond);
+	pthread_cond_destroy(&m_start_cond);
+	pthread_mutex_destroy(&m_mutex);
+#endif
+}
+
+void
+ParallelMatcher::setRankExprs(classad::ExprTree * pre_job_rank, classad::ExprTree * post_job_rank)
+{
+	delete m_pre_job_rank;
+	delete m_post_job_rank;
+	m_pre_job_rank = pre_job_rank ? pre_job_rank->Copy() : NULL;
+	m_post_job_rank = post_job_rank ? post_job_rank->Copy() : NULL;
+	// each context makes its own copy at the start of the next batch
+	m_rank_generation++;
+}
+
+bool
+ParallelMatcher::claim(size_t & begin, size_t & end)
+{
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_mutex_lock(&m_mutex);
+#endif
+	begin = m_next;
+	end = std::min(begin + m_chunk, m_candidates->size());
+	m_next = end;
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_mutex_unlock(&m_mutex);
+#endif
+	return begin < end;
+}
+
+void
+ParallelMatcher::evaluate(Context * ctx, ClassAd * candidate, ParallelMatchResult & result)
+{
+	result.evaluated = false;
+	result.matched = false;
+	result.rank = 0.0;
+	result.pre_job_rank = -(FLT_MAX);
+	result.post_job_rank = -(FLT_MAX);
+	if ( ! candidate) {
+		return;
+	}
+
+	ctx->candidate.ChainToAd(candidate);
+	result.evaluated = true;
+	result.matched = ctx->mad.symmetricMatch();
+	if (result.matched) {
+		result.pre_job_rank = evalNegotiatorRank("NEGOTIATOR_PRE_JOB_RANK", ctx->pre_job_rank, ctx->candidate);
+		result.rank = evalJobRank(ctx->request, ctx->candidate);
+		result.post_job_rank = evalNegotiatorRank("NEGOTIATOR_POST_JOB_RANK", ctx->post_job_rank, ctx->candidate);
+	}
+	ctx->candidate.Unchain();
+}
+
+void
+ParallelMatcher::runBatch(Context * ctx)
+{
+	double start = UtcTime::getTimeDouble();
+
+	if (ctx->rank_generation != m_rank_generation) {
+		ctx->setRankExprs(m_pre_job_rank, m_post_job_rank, m_rank_generation);
+	}
+	ctx->request.ChainToAd(m_request);
+
+	size_t begin, end;
+	while (claim(begin, end)) {
+		for (size_t ix = begin; ix < end; ++ix) {
+			evaluate(ctx, (*m_candidates)[ix], (*m_results)[ix]);
+		}
+	}
+
+	ctx->request.Unchain();
+	ctx->work_time = UtcTime::getTimeDouble() - start;
+}
+
+void
+ParallelMatcher::match(ClassAd & request, const std::vector<ClassAd*> & candidates,
+	std::vector<ParallelMatchResult> & results)
+{
+	double start = UtcTime::getTimeDouble();
+
+	results.resize(candidates.size());
+	if (m_contexts.empty()) {
+		grow(1);
+	}
+
+	m_request = &request;
+	m_candidates = &candidates;
+	m_results = &results;
+	m_next = 0;
+	// hand out work in small chunks so that threads that get cheap
+	// candidates don't sit idle while others are still busy.
+	m_chunk = std::max((size_t)1, candidates.size() / (m_contexts.size() * 8));
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	if ( ! m_threads.empty()) {
+		pthread_mutex_lock(&m_mutex);
+		m_busy = (int)m_threads.size();
+		m_batch++;
+		pthread_cond_broadcast(&m_start_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+#endif
+
+	runBatch(m_contexts[0]);
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	if ( ! m_threads.empty()) {
+		pthread_mutex_lock(&m_mutex);
+		while (m_busy > 0) {
+			pthread_cond_wait(&m_done_cond, &m_mutex);
+		}
+		pthread_mutex_unlock(&m_mutex);
+	}
+#endif
+
+	m_work_time = 0.0;
+	for (size_t ii = 0; ii < m_contexts.size(); ++ii) {
+		m_work_time += m_contexts[ii]->work_time;
+		m_contexts[ii]->work_time = 0.0;
+	}
+	m_wall_time = UtcTime::getTimeDouble() - start;
+
+	m_request = NULL;
+	m_candidates = NULL;
+	m_results = NULL;
+}
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+
+bool
+ParallelMatcher::supported()
+{
+	return true;
+}
+
+int
+ParallelMatcher::grow(int num_threads)
+{
+	if (m_contexts.empty()) {
+		// context 0 belongs to the thread that calls match()
+		m_contexts.push_back(new Context(this));
+	}
+
+	if (num_threads > 1) {
+		// from here on, dprintf may be called from more than one thread.
+		dprintf_make_thread_safe();
+	}
+
+	while ((int)m_contexts.size() < num_threads) {
+		Context * ctx = new Context(this);
+		ctx->batch = m_batch;
+
+		// the match threads should never see a signal, so block them all
+		// while we create the thread, it will inherit our signal mask.
+		sigset_t all_signals, old_mask;
+		sigfillset(&all_signals);
+		pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+
+		pthread_t thread;
+		int rval = pthread_create(&thread, NULL, threadMain, ctx);
+
+		pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+		if (rval != 0) {
+			dprintf(D_ALWAYS | D_FAILURE, "ParallelMatcher: failed to create match thread: %s (%d)\n",
+				strerror(rval), rval);
+			delete ctx;
+			break;
+		}
+		// the thread won't touch its context until the next batch starts,
+		// which can't happen until we return.
+		m_contexts.push_back(ctx);
+		m_threads.push_back(thread);
+	}
+	return size();
+}
+
+void
+ParallelMatcher::shutdown()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stopping = true;
+	pthread_cond_broadcast(&m_start_cond);
+	pthread_mutex_unlock(&m_mutex);
+
+	for (size_t ii = 0; ii < m_threads.size(); ++ii) {
+		pthread_join(m_threads[ii], NULL);
+	}
+	m_threads.clear();
+	m_stopping = false;
+
+	for (size_t ii = 0; ii < m_contexts.size(); ++ii) {
+		delete m_contexts[ii];
+	}
+	m_contexts.clear();
+}
+
+void *
+ParallelMatcher::threadMain(void * arg)
+{
+	Context * ctx = (Context *)arg;
+	ParallelMatcher * pool = ctx->owner;
+
+	pthread_mutex_lock(&pool->m_mutex);
+	for (;;) {
+		while (pool->m_batch == ctx->batch && ! pool->m_stopping) {
+			pthread_cond_wait(&pool->m_start_cond, &pool->m_mutex);
+		}
+		if (pool->m_stopping) {
+			break;
+		}
+		ctx->batch = pool->m_batch;
+		pthread_mutex_unlock(&pool->m_mutex);
+
+		pool->runBatch(ctx);
+
+		pthread_mutex_lock(&pool->m_mutex);
+		if (--pool->m_busy == 0) {
+			pthread_cond_signal(&pool->m_done_cond);
+		}
+	}
+	pthread_mutex_unlock(&pool->m_mutex);
+	return NULL;
+}
+
+#else // no pthreads
+
+bool ParallelMatcher::supported() { return false; }
+
+int
+ParallelMatcher::grow(int /*num_threads*/)
+{
+	if (m_contexts.empty()) {
+		m_contexts.push_back(new Context(this));
+	}
+	return size();
+}
+
+void
+ParallelMatcher::shutdown()
+{
+	for (size_t ii = 0; ii < m_contexts.size(); ++ii) {
+		delete m_contexts[ii];
+	}
+	m_contexts.clear();
+}
+
+#endif
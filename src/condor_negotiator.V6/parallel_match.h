@@ -0,0 +1,118 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __PARALLEL_MATCH_H__
+#define __PARALLEL_MATCH_H__
+
+#include "condor_classad.h"
+
+#include <vector>
+
+// What the parallel matcher learned about one candidate slot.  The ranks
+// are only filled in when the candidate matched.
+struct ParallelMatchResult {
+	bool evaluated;       // false if the candidate must be matched serially
+	bool matched;         // symmetric match of Requirements
+	double rank;          // the job's Rank of the slot
+	double pre_job_rank;  // NEGOTIATOR_PRE_JOB_RANK
+	double post_job_rank; // NEGOTIATOR_POST_JOB_RANK
+};
+
+// Matches one job against many slots on a persistent pool of threads.
+//
+// Each thread has its own MatchClassAd and its own pair of empty ads that
+// are chained to the job and to the current candidate, so evaluation only
+// ever writes to thread private ads; the job and slot ads are not modified
+// and can be shared by all of the threads.  The thread that calls match()
+// does a share of the work, so a pool of size 1 has no extra threads.
+//
+// match() must not be called from more than one thread at a time, and
+// nothing else may modify the job, the candidates or the configured rank
+// expressions while it runs.
+//
+class ParallelMatcher
+{
+  public:
+	ParallelMatcher();
+	~ParallelMatcher();
+
+	// returns true if threads are supported on this platform
+	static bool supported();
+
+	// make sure there are at least num_threads evaluation contexts
+	// (including the calling thread).  returns the number there are.
+	int  grow(int num_threads);
+	int  size() const { return (int)m_contexts.size(); }
+
+	// stop and join the threads, and free all of the contexts.
+	void shutdown();
+
+	// set the NEGOTIATOR_PRE_JOB_RANK and NEGOTIATOR_POST_JOB_RANK expressions
+	// to evaluate for candidates that match.  either may be NULL.  the
+	// matcher keeps private copies.
+	void setRankExprs(classad::ExprTree * pre_job_rank, classad::ExprTree * post_job_rank);
+
+	// evaluate the request against each candidate.  results is resized to
+	// match candidates, a NULL candidate is skipped and its result is
+	// marked as not evaluated.
+	void match(ClassAd & request, const std::vector<ClassAd*> & candidates,
+		std::vector<ParallelMatchResult> & results);
+
+	// timing of the most recent call to match().  work_time is the sum of
+	// the time each thread spent evaluating, so work_time / wall_time is the
+	// speedup over evaluating on a single thread.
+	double lastWallTime() const { return m_wall_time; }
+	double lastWorkTime() const { return m_work_time; }
+
+  private:
+	struct Context;
+
+	void runBatch(Context * ctx);
+	void evaluate(Context * ctx, ClassAd * candidate, ParallelMatchResult & result);
+	bool claim(size_t & begin, size_t & end);
+
+	std::vector<Context*> m_contexts;
+	classad::ExprTree * m_pre_job_rank;
+	classad::ExprTree * m_post_job_rank;
+	int m_rank_generation;
+
+	// the batch in progress
+	ClassAd * m_request;
+	const std::vector<ClassAd*> * m_candidates;
+	std::vector<ParallelMatchResult> * m_results;
+	size_t m_next;
+	size_t m_chunk;
+
+	double m_wall_time;
+	double m_work_time;
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	static void * threadMain(void * arg);
+
+	pthread_mutex_t m_mutex;
+	pthread_cond_t  m_start_cond;
+	pthread_cond_t  m_done_cond;
+	std::vector<pthread_t> m_threads;
+	unsigned long m_batch;
+	int  m_busy;
+	bool m_stopping;
+#endif
+};
+
+#endif // __PARALLEL_MATCH_H__
@@ -91,8 +91,12 @@ LocalServer::set_client_principal(const char*)
 }
 
 bool
-LocalServer::accept_connection(int timeout, bool& ready)
+LocalServer::accept_connection(int timeout, bool& ready, int, bool* event_ready)
 {
+	if (event_ready != NULL) {
+		*event_ready = false;
+	}
+
 	// initiate a nonblocking "accept", if one isn't already pending
 	//
 	if (m_accept_overlapped == NULL) {
@@ -56,9 +56,11 @@ public:
 
 	// wait up to the specified number of seconds to receive a client
 	// connection; second param is set to true if one is received,
-	// false otherwise
+	// false otherwise. if an event fd is given, we also return early
+	// when it becomes readable, setting the last param to true (the
+	// event fd is only supported on UNIX)
 	//
-	bool accept_connection(int, bool&);
+	bool accept_connection(int, bool&, int event_fd = -1, bool* event_ready = NULL);
 
 	// close a connection, making it possible to accept another one
 	// via the accept_connection method
@@ -144,7 +144,7 @@ NamedPipeReader::read_data(void* buffer, int len)
 }
 
 bool
-NamedPipeReader::poll(int timeout, bool& ready)
+NamedPipeReader::poll(int timeout, bool& ready, int other_fd, bool* other_ready)
 {
 	// TODO: select on the watchdog pipe, if we have one. this
 	// currently isn't a big deal since we only use poll() on
@@ -154,8 +154,15 @@ NamedPipeReader::poll(int timeout, bool& ready)
 
 	assert(timeout >= -1);
 
+	if (other_ready != NULL) {
+		*other_ready = false;
+	}
+
 	Selector selector;
 	selector.add_fd( m_pipe, Selector::IO_READ );
+	if (other_fd != -1) {
+		selector.add_fd( other_fd, Selector::IO_READ );
+	}
 
 	if (timeout != -1) {
 		selector.set_timeout( timeout );
@@ -179,6 +186,9 @@ NamedPipeReader::poll(int timeout, bool& ready)
 	}
 
 	ready = selector.fd_ready( m_pipe, Selector::IO_READ );
+	if ((other_fd != -1) && (other_ready != NULL)) {
+		*other_ready = selector.fd_ready( other_fd, Selector::IO_READ );
+	}
 
 	return true;
 }
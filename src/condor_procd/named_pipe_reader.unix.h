@@ -62,9 +62,11 @@ public:
 
 	// second parameter is set to true if the named pipe
 	// becomes ready for reading within the given timeout
-	// period, otherwise it's set to false
+	// period, otherwise it's set to false. if another fd is
+	// given, we also stop waiting when it becomes readable,
+	// and set the last parameter to say whether it did
 	//
-	bool poll(int, bool&);
+	bool poll(int, bool&, int other_fd = -1, bool* other_ready = NULL);
 
 	// Determine if the named pipe on the disk is the actual named pipe that
 	// was initially opened. In practice it means that the dev and inode fields
@@ -0,0 +1,230 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "proc_connector.linux.h"
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+// how much the kernel may queue for us between reads
+//
+static const int PROC_CONNECTOR_RCVBUF = 8 * 1024 * 1024;
+
+ProcConnector::ProcConnector() :
+	m_fd(-1),
+	m_lost(false),
+	m_num_forks(0),
+	m_num_execs(0),
+	m_num_exits(0)
+{
+}
+
+ProcConnector::~ProcConnector()
+{
+	if (m_fd != -1) {
+		close(m_fd);
+	}
+}
+
+bool
+ProcConnector::initialize()
+{
+	ASSERT(m_fd == -1);
+
+	int fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR);
+	if (fd == -1) {
+		dprintf(D_ALWAYS,
+		        "ProcConnector: socket error: %s (%d)\n",
+		        strerror(errno),
+		        errno);
+		return false;
+	}
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 ||
+	    fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+	{
+		dprintf(D_ALWAYS,
+		        "ProcConnector: fcntl error: %s (%d)\n",
+		        strerror(errno),
+		        errno);
+		close(fd);
+		return false;
+	}
+
+	// a big receive buffer makes it less likely that the kernel drops
+	// events during a burst of forks. SO_RCVBUFFORCE ignores rmem_max,
+	// but only works as root
+	//
+	int rcvbuf = PROC_CONNECTOR_RCVBUF;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1) {
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	}
+
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = CN_IDX_PROC;
+	addr.nl_pid = 0; // let the kernel pick our port id
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		dprintf(D_ALWAYS,
+		        "ProcConnector: bind error: %s (%d)\n",
+		        strerror(errno),
+		        errno);
+		close(fd);
+		return false;
+	}
+
+	// ask the kernel to start sending us events
+	//
+	const size_t req_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+	char req[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))] __attribute__((aligned(NLMSG_ALIGNTO)));
+	memset(req, 0, sizeof(req));
+	struct nlmsghdr* hdr = (struct nlmsghdr*)req;
+	hdr->nlmsg_len = req_len;
+	hdr->nlmsg_type = NLMSG_DONE;
+	hdr->nlmsg_pid = 0;
+	struct cn_msg* msg = (struct cn_msg*)NLMSG_DATA(hdr);
+	msg->id.idx = CN_IDX_PROC;
+	msg->id.val = CN_VAL_PROC;
+	msg->len = sizeof(enum proc_cn_mcast_op);
+	enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+	memcpy(msg->data, &op, sizeof(op));
+	if (send(fd, req, req_len, 0) == -1) {
+		dprintf(D_ALWAYS,
+		        "ProcConnector: error subscribing to process events: %s (%d)\n",
+		        strerror(errno),
+		        errno);
+		close(fd);
+		return false;
+	}
+
+	m_fd = fd;
+	return true;
+}
+
+void
+ProcConnector::read_events()
+{
+	ASSERT(m_fd != -1);
+
+	char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+	for (;;) {
+		struct sockaddr_nl from;
+		socklen_t from_len = sizeof(from);
+		ssize_t len = recvfrom(m_fd, buf, sizeof(buf), 0, (struct sockaddr*)&from, &from_len);
+		if (len == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == ENOBUFS) {
+				// the kernel had to throw events away. keep reading,
+				// but our caller will have to look at every process
+				//
+				if (!m_lost) {
+					dprintf(D_ALWAYS, "ProcConnector: process events were lost\n");
+				}
+				m_lost = true;
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				dprintf(D_ALWAYS,
+				        "ProcConnector: recv error: %s (%d)\n",
+				        strerror(errno),
+				        errno);
+				m_lost = true;
+			}
+			break;
+		}
+
+		// only believe messages from the kernel
+		//
+		if (from.nl_pid != 0) {
+			continue;
+		}
+
+		int remaining = (int)len;
+		for (struct nlmsghdr* hdr = (struct nlmsghdr*)buf;
+		     NLMSG_OK(hdr, remaining);
+		     hdr = NLMSG_NEXT(hdr, remaining))
+		{
+			if (hdr->nlmsg_type == NLMSG_ERROR || hdr->nlmsg_type == NLMSG_NOOP) {
+				continue;
+			}
+			struct cn_msg* msg = (struct cn_msg*)NLMSG_DATA(hdr);
+			if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC) {
+				continue;
+			}
+			struct proc_event* ev = (struct proc_event*)msg->data;
+			switch (ev->what) {
+
+				// a new thread also gets a fork event; we only want
+				// the new processes (thread group leaders)
+				//
+				case proc_event::PROC_EVENT_FORK:
+					if (ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid) {
+						m_created.push_back(ev->event_data.fork.child_pid);
+						m_num_forks++;
+					}
+					break;
+
+				// family membership is decided when a process is first
+				// seen and not revisited on exec, same as with snapshots
+				//
+				case proc_event::PROC_EVENT_EXEC:
+					m_num_execs++;
+					break;
+
+				case proc_event::PROC_EVENT_EXIT:
+					if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid) {
+						m_exited.insert(ev->event_data.exit.process_pid);
+						m_num_exits++;
+					}
+					break;
+
+				default:
+					break;
+			}
+		}
+	}
+}
+
+void
+ProcConnector::take_events(std::vector<pid_t>& created,
+                           std::set<pid_t>& exited,
+                           bool& lost)
+{
+	dprintf(D_FULLDEBUG,
+	        "ProcConnector: %lu forks, %lu execs, %lu exits since last update\n",
+	        m_num_forks,
+	        m_num_execs,
+	        m_num_exits);
+
+	created.swap(m_created);
+	exited.swap(m_exited);
+	lost = m_lost;
+
+	m_created.clear();
+	m_exited.clear();
+	m_lost = false;
+	m_num_forks = m_num_execs = m_num_exits = 0;
+}
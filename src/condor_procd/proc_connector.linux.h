@@ -0,0 +1,82 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef _PROC_CONNECTOR_H
+#define _PROC_CONNECTOR_H
+
+#include "condor_common.h"
+
+#include <set>
+#include <vector>
+
+// listens to the kernel's process events (the netlink "proc connector"),
+// so that the ProcFamilyMonitor can keep its families up to date by
+// looking at the processes that were created since its last update
+// instead of at every process on the system. this needs root (or
+// CAP_NET_ADMIN) and a kernel built with CONFIG_PROC_EVENTS
+//
+class ProcConnector {
+
+public:
+
+	ProcConnector();
+
+	~ProcConnector();
+
+	// open the netlink socket and ask the kernel for process
+	// events; returns false if we can't get them
+	//
+	bool initialize();
+
+	// the socket to select on for events to read
+	//
+	int get_fd() { return m_fd; }
+
+	// read the events that are waiting on the socket, without
+	// blocking. this should be called whenever the socket is readable
+	// so that the kernel doesn't have to drop events
+	//
+	void read_events();
+
+	// hand over the processes created and exited since the last call.
+	// created is in the order the processes were created. lost is set
+	// if the kernel dropped events, in which case the caller can't
+	// rely on these lists and needs to look at every process
+	//
+	void take_events(std::vector<pid_t>& created,
+	                 std::set<pid_t>& exited,
+	                 bool& lost);
+
+private:
+
+	int m_fd;
+
+	std::vector<pid_t> m_created;
+	std::set<pid_t>    m_exited;
+	bool               m_lost;
+
+	// for logging
+	//
+	unsigned long m_num_forks;
+	unsigned long m_num_execs;
+	unsigned long m_num_exits;
+};
+
+#endif
@@ -924,6 +924,34 @@ ProcFamily::remove_exited_processes()
 	}
 }
 
+void
+ProcFamily::refresh_members(bool read_procs, const std::set<pid_t>& gone)
+{
+	ProcFamilyMember* member = m_member_list;
+	while (member != NULL) {
+		pid_t pid = member->m_proc_info->pid;
+		if (read_procs) {
+			// a process we can't read, or whose pid now belongs to
+			// a different process, has exited
+			//
+			procInfo* pi = NULL;
+			int status;
+			if ((ProcAPI::getProcInfo(pid, pi, status) == PROCAPI_SUCCESS) &&
+			    (pi->birthday == member->m_proc_info->birthday))
+			{
+				member->still_alive(pi);
+			}
+			else {
+				delete pi;
+			}
+		}
+		else if (gone.find(pid) == gone.end()) {
+			member->m_still_alive = true;
+		}
+		member = member->m_next;
+	}
+}
+
 void
 ProcFamily::fold_into_parent(ProcFamily* parent)
 {
@@ -25,6 +25,8 @@
 #include "proc_family_member.h"
 #include "proc_family_io.h"
 
+#include <set>
+
 #if defined(HAVE_EXT_LIBCGROUP)
 #include "../condor_starter.V6.1/cgroup.linux.h"
 #endif
@@ -105,6 +107,15 @@ public:
 	//
 	void remove_exited_processes();
 
+	// used by our monitor in between snapshots, when it is tracking
+	// processes via kernel events: mark our members that are still
+	// alive, so that remove_exited_processes gets rid of the rest. if
+	// read_procs is true each member is read from the system (updating
+	// its usage); otherwise members are taken to be alive unless their
+	// pid is in the given set
+	//
+	void refresh_members(bool read_procs, const std::set<pid_t>& gone);
+
 	// our monitor is about to delete us, so we need to offload any
 	// members we have in our list to our parent (passed in)
 	//
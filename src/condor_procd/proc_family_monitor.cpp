@@ -31,6 +31,7 @@
 
 #if defined(LINUX)
 #include "group_tracker.linux.h"
+#include "proc_connector.linux.h"
 #endif
 
 #if defined(HAVE_EXT_LIBCGROUP)
@@ -58,6 +59,9 @@ ProcFamilyMonitor::ProcFamilyMonitor(pid_t pid,
 	ASSERT(m_pid_tracker != NULL);
 #if defined(LINUX)
 	m_group_tracker = NULL;
+	m_proc_connector = NULL;
+	m_reconcile_interval = 0;
+	m_last_full_snapshot = 0;
 #endif
 #if defined(HAVE_EXT_LIBCGROUP)
 	m_cgroup_tracker = NULL;
@@ -123,6 +127,9 @@ ProcFamilyMonitor::~ProcFamilyMonitor()
 	if (m_group_tracker != NULL) {
 		delete m_group_tracker;
 	}
+	if (m_proc_connector != NULL) {
+		delete m_proc_connector;
+	}
 #endif
 #if defined(HAVE_EXT_LIBCGROUP)
 	if (m_cgroup_tracker != NULL) {
@@ -147,6 +154,58 @@ ProcFamilyMonitor::enable_group_tracking(gid_t min_tracking_gid,
 }
 #endif
 
+#if defined(LINUX)
+bool
+ProcFamilyMonitor::enable_proc_connector(int reconcile_interval)
+{
+	ASSERT(m_proc_connector == NULL);
+	m_proc_connector = new ProcConnector;
+	ASSERT(m_proc_connector != NULL);
+	if (!m_proc_connector->initialize()) {
+		dprintf(D_ALWAYS,
+		        "process events not available; "
+		            "taking full snapshots instead\n");
+		delete m_proc_connector;
+		m_proc_connector = NULL;
+		return false;
+	}
+	m_reconcile_interval = reconcile_interval;
+
+	// processes may have come and gone between our initial snapshot
+	// and subscribing to events, so start over with a full one
+	//
+	m_last_full_snapshot = 0;
+	snapshot();
+
+	dprintf(D_ALWAYS,
+	        "tracking processes via process events; "
+	            "full snapshot every %d seconds\n",
+	        reconcile_interval);
+	return true;
+}
+#endif
+
+int
+ProcFamilyMonitor::get_event_fd()
+{
+#if defined(LINUX)
+	if (m_proc_connector != NULL) {
+		return m_proc_connector->get_fd();
+	}
+#endif
+	return -1;
+}
+
+void
+ProcFamilyMonitor::read_events()
+{
+#if defined(LINUX)
+	if (m_proc_connector != NULL) {
+		m_proc_connector->read_events();
+	}
+#endif
+}
+
 #if defined(HAVE_EXT_LIBCGROUP)
 void
 ProcFamilyMonitor::enable_cgroup_tracking()
@@ -538,6 +597,26 @@ ProcFamilyMonitor::get_family_usage(pid_t pid, ProcFamilyUsage* usage)
 void
 ProcFamilyMonitor::snapshot()
 {
+#if defined(LINUX)
+	if (m_proc_connector != NULL) {
+		time_t now = time(NULL);
+		if ((now - m_last_full_snapshot < m_reconcile_interval) &&
+		    snapshot_from_events())
+		{
+			return;
+		}
+		m_last_full_snapshot = now;
+
+		// events received before this snapshot are covered by it
+		//
+		std::vector<pid_t> created;
+		std::set<pid_t> exited;
+		bool lost;
+		m_proc_connector->read_events();
+		m_proc_connector->take_events(created, exited, lost);
+	}
+#endif
+
 	dprintf(D_ALWAYS, "taking a snapshot...\n");
 
 	// get a snapshot of all processes on the system
@@ -611,6 +690,93 @@ ProcFamilyMonitor::snapshot()
 	remove_exited_processes(m_tree);
 	m_everybody_else->remove_exited_processes();
 
+	place_new_processes(pi_list);
+
+	dprintf(D_ALWAYS, "...snapshot complete\n");
+}
+
+#if defined(LINUX)
+bool
+ProcFamilyMonitor::snapshot_from_events()
+{
+	std::vector<pid_t> created;
+	std::set<pid_t> exited;
+	bool lost;
+	m_proc_connector->read_events();
+	m_proc_connector->take_events(created, exited, lost);
+	if (lost) {
+		return false;
+	}
+
+	dprintf(D_ALWAYS,
+	        "taking a snapshot from process events "
+	            "(%d created, %d exited)...\n",
+	        (int)created.size(),
+	        (int)exited.size());
+
+	// the members of our families are read individually, which updates
+	// their usage and tells us which have exited. processes not in our
+	// families are only dropped when they exit; a pid that was just
+	// created can't still belong to the process we knew by that pid
+	//
+	refresh_members(m_tree);
+	std::set<pid_t> gone(exited);
+	gone.insert(created.begin(), created.end());
+	m_everybody_else->refresh_members(false, gone);
+
+	remove_exited_processes(m_tree);
+	m_everybody_else->remove_exited_processes();
+
+	// read the new processes that are still around and that we don't
+	// know about yet (a full snapshot may already have found them),
+	// keeping them in the order they were created so that parents come
+	// before their children
+	//
+	procInfo* pi_list = NULL;
+	procInfo** tail = &pi_list;
+	std::set<pid_t> seen;
+	for (size_t i = 0; i < created.size(); i++) {
+		pid_t pid = created[i];
+		if (!seen.insert(pid).second || (lookup_member(pid) != NULL)) {
+			continue;
+		}
+		procInfo* pi = NULL;
+		int status;
+		if (ProcAPI::getProcInfo(pid, pi, status) != PROCAPI_SUCCESS) {
+			delete pi;
+			continue;
+		}
+		*tail = pi;
+		tail = &pi->next;
+	}
+
+	place_new_processes(pi_list);
+
+	dprintf(D_ALWAYS, "...snapshot complete\n");
+	return true;
+}
+
+void
+ProcFamilyMonitor::refresh_members(Tree<ProcFamily*>* tree)
+{
+	// refresh the members of the current tree node
+	//
+	std::set<pid_t> none;
+	tree->get_data()->refresh_members(true, none);
+
+	// recurse on children
+	//
+	Tree<ProcFamily*>* child = tree->get_child();
+	while (child != NULL) {
+		refresh_members(child);
+		child = child->get_sibling();
+	}
+}
+#endif
+
+void
+ProcFamilyMonitor::place_new_processes(procInfo* pi_list)
+{
 	// we've now handled all processes that we've seen
 	// in previous calls to snapshot(). now we have to handle the
 	// rest by determining whether they belong in any of the families we're
@@ -643,7 +809,7 @@ ProcFamilyMonitor::snapshot()
 	// (b) don't belong in the family tree. we'll now add all such processes
 	// to m_everybody_else
 	//
-	curr = pi_list;
+	procInfo* curr = pi_list;
 	while (curr != NULL) {
 		ProcFamilyMember* pfm;
 		int ret = m_member_table.lookup(curr->pid, pfm);
@@ -664,8 +830,6 @@ ProcFamilyMonitor::snapshot()
 	// bookkeeping
 	//
 	update_max_image_sizes(m_tree);
-
-	dprintf(D_ALWAYS, "...snapshot complete\n");
 }
 
 void
@@ -31,6 +31,7 @@
 class PIDTracker;
 #if defined(LINUX)
 class GroupTracker;
+class ProcConnector;
 #endif
 #if defined(HAVE_EXT_LIBCGROUP)
 class CGroupTracker;
@@ -127,8 +128,27 @@ public:
 	//
 	int get_snapshot_interval();
 
+#if defined(LINUX)
+	// follow process creation and exit through the kernel's process
+	// events instead of looking at all processes on the system for
+	// every snapshot. a full snapshot is still taken every
+	// reconcile_interval seconds (and whenever events are lost).
+	// returns false if the events are not available
+	//
+	bool enable_proc_connector(int reconcile_interval);
+#endif
+
+	// a descriptor that is readable when there are process events for
+	// read_events to handle, or -1 if we are not using process events
+	//
+	int get_event_fd();
+	void read_events();
+
 	// use a snapshot of all processes on the system (from ProcAPI)
-	// to update the families we are tracking
+	// to update the families we are tracking. with process events,
+	// only the processes created since the last snapshot and the
+	// members of our families are looked at, unless it is time for
+	// a full snapshot
 	//
 	void snapshot();
 
@@ -185,6 +205,31 @@ private:
 	EnvironmentTracker* m_environment_tracker;
 	ParentTracker*      m_parent_tracker;
 
+#if defined(LINUX)
+	// source of process events, if enabled, and when we last looked
+	// at every process on the system
+	//
+	ProcConnector*      m_proc_connector;
+	int                 m_reconcile_interval;
+	time_t              m_last_full_snapshot;
+
+	// update our families from the process events received since the
+	// last snapshot (returns false if that can't be done and a full
+	// snapshot is needed)
+	//
+	bool snapshot_from_events();
+
+	// call refresh_members on all ProcFamily objects we're managing
+	//
+	void refresh_members(Tree<ProcFamily*>*);
+#endif
+
+	// the part of a snapshot that puts the processes we haven't seen
+	// before into families, and then does the bookkeeping that follows
+	// a change in membership
+	//
+	void place_new_processes(procInfo* pi_list);
+
 	// find the minimum of all the ProcFamilys' requested "maximum
 	// snapshot intervals"
 	//
@@ -405,10 +405,36 @@ ProcFamilyServer::wait_loop()
 	
 		time_t time_before = time(NULL);
 		bool command_ready;
-		bool ok = m_server->accept_connection(snapshot_countdown,
-		                                      command_ready);
-		if (!ok) {
-			EXCEPT("ProcFamilyServer: failed trying to accept client");
+
+		// if we're getting process events from the kernel, wake up to
+		// read them as they arrive (so the kernel doesn't drop any),
+		// then go back to waiting for a command for whatever is left
+		// of the countdown
+		//
+		int event_fd = m_monitor.get_event_fd();
+		for (;;) {
+			int timeout = snapshot_countdown;
+			if (timeout != -1) {
+				timeout -= (time(NULL) - time_before);
+				if (timeout < 0) {
+					timeout = 0;
+				}
+			}
+			bool events_ready;
+			bool ok = m_server->accept_connection(timeout,
+			                                      command_ready,
+			                                      event_fd,
+			                                      &events_ready);
+			if (!ok) {
+				EXCEPT("ProcFamilyServer: failed trying to accept client");
+			}
+			if (!events_ready) {
+				break;
+			}
+			m_monitor.read_events();
+			if (command_ready || (timeout == 0)) {
+				break;
+			}
 		}
 		if (!command_ready) {
 			// timeout; make sure we execute the timer handler
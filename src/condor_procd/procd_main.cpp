@@ -64,6 +64,12 @@ static int max_snapshot_interval = 60;
 //
 static gid_t min_tracking_gid = 0;
 static gid_t max_tracking_gid = 0;
+
+// if nonzero, keep our families up to date from the kernel's process
+// events, and only look at every process once per this many seconds
+// (set with the "-N" option)
+//
+static int proc_connector_reconcile_interval = 0;
 #endif
 
 #if defined(WIN32)
@@ -122,6 +128,8 @@ usage(void)
 	"                         If -E is specified then procd_ctl must be used\n"
 	"                         to allocate gids which must then be in this\n"
 	"                         range.\n"
+	"  -N <seconds>           Track processes using kernel process events,\n"
+	"                         with a full process snapshot at this interval.\n"
 	"  -I <glexec-kill-path> <glexec-path> <glexec-retries> <glexec-retry-delay>\n"
 	"                         Specify the binary which will send a signal\n"
 	"                         to a pid and the glexec binary which will run\n"
@@ -266,6 +274,16 @@ parse_command_line(int argc, char* argv[])
 				index++;
 				max_tracking_gid = (gid_t)atoi(argv[index]);
 				break;
+
+			// track processes using kernel process events
+			//
+			case 'N':
+				if (index + 1 >= argc) {
+					fail_option_args("-N", 1);
+				}
+				index++;
+				proc_connector_reconcile_interval = atoi(argv[index]);
+				break;
 #endif
 
 #if defined(WIN32)
@@ -523,6 +541,15 @@ main(int argc, char* argv[])
 	monitor.enable_cgroup_tracking();
 #endif
 
+#if defined(LINUX)
+	// if a "-N" option was given, try to use the kernel's process
+	// events; if we can't get them we fall back to snapshots
+	//
+	if (proc_connector_reconcile_interval > 0) {
+		monitor.enable_proc_connector(proc_connector_reconcile_interval);
+	}
+#endif
+
 	// initialize the server for accepting requests from clients
 	//
 	ProcFamilyServer server(monitor, local_server_address);
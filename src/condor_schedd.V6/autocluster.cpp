@@ -46,7 +46,8 @@ private:
 };
 
 JobCluster::JobCluster()
-	: next_id(1)
+	: sig_table_used(0)
+	, next_id(1)
 	, significant_attrs(NULL)
 #ifdef USE_AUTOCLUSTER_TO_JOBID_MAP
 	, keep_job_ids(false)
@@ -63,7 +64,12 @@ JobCluster::~JobCluster()
 
 void JobCluster::clear()
 {
+	for (JobSigidMap::iterator it = cluster_map.begin(); it != cluster_map.end(); ++it) {
+		delete it->second;
+	}
 	cluster_map.clear();
+	sig_table.clear();
+	sig_table_used = 0;
 #ifdef USE_AUTOCLUSTER_TO_JOBID_MAP
 	cluster_use.clear();
 	cluster_gone.clear();
@@ -178,10 +184,10 @@ void JobCluster::collect_garbage(bool brute_force) // free the deleted clusters
 	// scan the cluster collection, checking to see if there are no longer any referring jobs.
 	JobSigidMap::iterator it;
 	for (it = cluster_map.begin(); it != cluster_map.end(); /*advance at bottom of loop!*/) {
-		bool gone = cluster_gone.find(it->second) != cluster_gone.end();
+		bool gone = cluster_gone.find(it->first) != cluster_gone.end();
 		if (brute_force || gone) {
 			// found a deleted cluster. but we should double check to see that it's really unused.
-			JobIdSetMap::iterator jit = cluster_use.find(it->second);
+			JobIdSetMap::iterator jit = cluster_use.find(it->first);
 			if (jit != cluster_use.end()) {
 				gone = false;
 				if (brute_force) {
@@ -200,7 +206,7 @@ void JobCluster::collect_garbage(bool brute_force) // free the deleted clusters
 		}
 		// advance here so that we can erase the previous entry if needed.
 		JobSigidMap::iterator last = it++;
-		if (gone) { cluster_map.erase(last); }
+		if (gone) { eraseSig(last); }
 	}
 	cluster_gone.clear();
 }
@@ -209,16 +215,274 @@ void JobCluster::collect_garbage(bool brute_force) // free the deleted clusters
 
 extern int    last_autocluster_classad_cache_hit;
 
+JobClusterSig::~JobClusterSig()
+{
+	for (size_t ix = 0; ix < values.size(); ++ix) {
+		delete values[ix];
+	}
+	values.clear();
+}
+
+// true if this signature has the same values as sigset, and the same expanded attributes.
+// the values must be the same expressions, which is what the hash is computed from.
+bool JobClusterSig::matches(const std::vector<classad::ExprTree*> & sigset, const classad::References & refs) const
+{
+	if (sigset.size() != values.size() || refs.size() != exattrs.size()) {
+		return false;
+	}
+	size_t ix = 0;
+	for (classad::References::const_iterator it = refs.begin(); it != refs.end(); ++it, ++ix) {
+		if (strcasecmp(it->c_str(), exattrs[ix].c_str()) != MATCH) {
+			return false;
+		}
+	}
+	for (ix = 0; ix < values.size(); ++ix) {
+		const classad::ExprTree * tree = sigset[ix];
+		if ( ! tree || ! values[ix]) {
+			if (tree != values[ix]) return false;
+		} else if ( ! values[ix]->SameAs(tree)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// computes a JobSigHash from the structure of the significant attribute values.
+// expressions that are SameAs() each other must hash the same, so attribute names in
+// ClassAd values are hashed without case, and the attributes of a ClassAd in any order.
+class JobSigHasher {
+public:
+	JobSigHasher() : lo(0xcbf29ce484222325ULL), hi(0x6a09e667f3bcc908ULL) {}
+
+	void bytes(const void * pv, size_t cb) {
+		const unsigned char * p = (const unsigned char *)pv;
+		for (size_t ix = 0; ix < cb; ++ix) {
+			lo = (lo ^ p[ix]) * 0x100000001b3ULL;         // FNV-1a
+			hi = (hi + p[ix]) * 0x9e3779b97f4a7c15ULL;
+			hi ^= hi >> 29;
+		}
+	}
+	void num(uint64_t val) { bytes(&val, sizeof(val)); }
+	void str(const char * psz, size_t cch) { num(cch); bytes(psz, cch); }
+	void str(const std::string & s) { str(s.data(), s.size()); }
+	void nocase(const std::string & s) {
+		num(s.size());
+		for (size_t ix = 0; ix < s.size(); ++ix) {
+			unsigned char ch = tolower((unsigned char)s[ix]);
+			bytes(&ch, 1);
+		}
+	}
+	void tree(const classad::ExprTree * expr);
+	void value(const classad::Value & val);
+
+	JobSigHash result() const {
+		JobSigHash hash;
+		hash.lo = mix(lo ^ (hi >> 32));
+		hash.hi = mix(hi + lo);
+		return hash;
+	}
+
+private:
+	static uint64_t mix(uint64_t h) { // the murmur3 finalizer
+		h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+	void hashAd(const classad::ClassAd * ad);
+
+	uint64_t lo, hi;
+};
+
+void JobSigHasher::value(const classad::Value & val)
+{
+	classad::Value::ValueType vt = val.GetType();
+	num(vt);
+	switch (vt) {
+	case classad::Value::BOOLEAN_VALUE: {
+		bool b = false; val.IsBooleanValue(b);
+		num(b ? 1 : 0);
+	} break;
+	case classad::Value::INTEGER_VALUE: {
+		long long i = 0; val.IsIntegerValue(i);
+		num((uint64_t)i);
+	} break;
+	case classad::Value::REAL_VALUE: {
+		double r = 0; val.IsRealValue(r);
+		if (r == 0) r = 0; // -0.0 is the same as 0.0
+		bytes(&r, sizeof(r));
+	} break;
+	case classad::Value::STRING_VALUE: {
+		const char * psz = NULL; val.IsStringValue(psz);
+		str(psz, psz ? strlen(psz) : 0);
+	} break;
+	case classad::Value::RELATIVE_TIME_VALUE: {
+		double secs = 0; val.IsRelativeTimeValue(secs);
+		if (secs == 0) secs = 0;
+		bytes(&secs, sizeof(secs));
+	} break;
+	case classad::Value::ABSOLUTE_TIME_VALUE: {
+		classad::abstime_t at; at.secs = 0; at.offset = 0; val.IsAbsoluteTimeValue(at);
+		num((uint64_t)at.secs); num((uint64_t)at.offset);
+	} break;
+	case classad::Value::LIST_VALUE:
+	case classad::Value::SLIST_VALUE: {
+		const classad::ExprList * list = NULL; val.IsListValue(list);
+		tree(list);
+	} break;
+	case classad::Value::CLASSAD_VALUE: {
+		const classad::ClassAd * ad = NULL; val.IsClassAdValue(ad);
+		tree(ad);
+	} break;
+	default:
+		break;
+	}
+}
+
+void JobSigHasher::hashAd(const classad::ClassAd * ad)
+{
+	// sum the hashes of the attributes so that their order doesn't matter
+	uint64_t sum_lo = 0, sum_hi = 0, count = 0;
+	for (classad::ClassAd::const_iterator it = ad->begin(); it != ad->end(); ++it) {
+		JobSigHasher attr;
+		attr.nocase(it->first);
+		attr.tree(it->second);
+		JobSigHash hash = attr.result();
+		sum_lo += hash.lo;
+		sum_hi += hash.hi;
+		++count;
+	}
+	num(count); num(sum_lo); num(sum_hi);
+}
+
+void JobSigHasher::tree(const classad::ExprTree * expr)
+{
+	if ( ! expr) {
+		num(0);
+		return;
+	}
+	expr = expr->self(); // look through a CachedExprEnvelope
+	classad::ExprTree::NodeKind kind = expr->GetKind();
+	num(kind + 1);
+	switch (kind) {
+	case classad::ExprTree::LITERAL_NODE: {
+		classad::Value val;
+		classad::Value::NumberFactor factor;
+		((const classad::Literal*)expr)->GetComponents(val, factor);
+		num(factor);
+		value(val);
+	} break;
+
+	case classad::ExprTree::ATTRREF_NODE: {
+		classad::ExprTree * scope = NULL;
+		std::string name;
+		bool absolute = false;
+		((const classad::AttributeReference*)expr)->GetComponents(scope, name, absolute);
+		num(absolute ? 1 : 0);
+		str(name);
+		tree(scope);
+	} break;
+
+	case classad::ExprTree::OP_NODE: {
+		classad::Operation::OpKind op;
+		classad::ExprTree *t1 = NULL, *t2 = NULL, *t3 = NULL;
+		((const classad::Operation*)expr)->GetComponents(op, t1, t2, t3);
+		num(op);
+		tree(t1); tree(t2); tree(t3);
+	} break;
+
+	case classad::ExprTree::FN_CALL_NODE: {
+		std::string name;
+		std::vector<classad::ExprTree*> args;
+		((const classad::FunctionCall*)expr)->GetComponents(name, args);
+		str(name);
+		num(args.size());
+		for (size_t ix = 0; ix < args.size(); ++ix) { tree(args[ix]); }
+	} break;
+
+	case classad::ExprTree::EXPR_LIST_NODE: {
+		std::vector<classad::ExprTree*> items;
+		((const classad::ExprList*)expr)->GetComponents(items);
+		num(items.size());
+		for (size_t ix = 0; ix < items.size(); ++ix) { tree(items[ix]); }
+	} break;
+
+	case classad::ExprTree::CLASSAD_NODE:
+		hashAd((const classad::ClassAd*)expr);
+		break;
+
+	default:
+		break;
+	}
+}
+
+// marks a deleted slot in sig_table
+static char deleted_sig_slot;
+static JobClusterSig * const deleted_sig = (JobClusterSig *)&deleted_sig_slot;
+
+JobClusterSig * JobCluster::findSig(const JobSigHash & hash, const std::vector<ExprTree*> & sigset, const classad::References & exattrs)
+{
+	if (sig_table.empty()) return NULL;
+	size_t mask = sig_table.size() - 1;
+	for (size_t ix = hash.lo & mask; ; ix = (ix + 1) & mask) {
+		JobClusterSig * sig = sig_table[ix];
+		if ( ! sig) return NULL;
+		if (sig != deleted_sig && sig->hash == hash && sig->matches(sigset, exattrs)) {
+			return sig;
+		}
+	}
+}
+
+void JobCluster::insertSig(JobClusterSig * sig)
+{
+	// keep the table at most half full, counting deleted slots, so that probes are short
+	// and there is always an empty slot to end them.
+	if ((sig_table_used + 1) * 2 > sig_table.size()) {
+		size_t cslots = 64;
+		while (cslots < (cluster_map.size() + 1) * 4) { cslots *= 2; }
+		sig_table.assign(cslots, NULL);
+		sig_table_used = 0;
+		size_t mask = cslots - 1;
+		for (JobSigidMap::iterator it = cluster_map.begin(); it != cluster_map.end(); ++it) {
+			if (it->second == sig) continue;
+			size_t ix = it->second->hash.lo & mask;
+			while (sig_table[ix]) { ix = (ix + 1) & mask; }
+			sig_table[ix] = it->second;
+			++sig_table_used;
+		}
+	}
+
+	size_t mask = sig_table.size() - 1;
+	size_t ix = sig->hash.lo & mask;
+	while (sig_table[ix] && sig_table[ix] != deleted_sig) { ix = (ix + 1) & mask; }
+	if ( ! sig_table[ix]) ++sig_table_used;
+	sig_table[ix] = sig;
+}
+
+void JobCluster::eraseSig(JobSigidMap::iterator it)
+{
+	JobClusterSig * sig = it->second;
+	if ( ! sig_table.empty()) {
+		size_t mask = sig_table.size() - 1;
+		for (size_t ix = sig->hash.lo & mask; sig_table[ix]; ix = (ix + 1) & mask) {
+			if (sig_table[ix] == sig) { sig_table[ix] = deleted_sig; break; }
+		}
+	}
+	cluster_map.erase(it);
+	delete sig;
+}
+
 int JobCluster::getClusterid(JobQueueJob & job, bool expand_refs, std::string * final_list)
 {
 	int cur_id = -1;
 
-	// we want to summarize job into a string "signature"
-	// the signature will consist of "key1=val1\nkey2=val2\n"
-	// for each of the keys in the significant_attrs list and (if expand_refs is true)
-	// the keys that the significant_attrs values refer to that are internal references.
+	// we want to summarize job into a signature, which is the values of each of the keys in the
+	// significant_attrs list and (if expand_refs is true) the keys that the significant_attrs
+	// values refer to that are internal references.
 	// the order of the keys in the signature will be the same as the order specified in significant_attrs
 	// followed by the expanded keys in case-insensitive alpha order.
+	// jobs with the same signature are in the same autocluster, to find it we hash the values
+	// and then compare them with the values of the autoclusters that have the same hash.
 
 	// first put build a set of class ad values, one for each significant attribute
 	//
@@ -257,58 +521,50 @@ int JobCluster::getClusterid(JobQueueJob & job, bool expand_refs, std::string *
 	}
 
 	// sigset now contains the values of all the attributes we need,
-	// significant attibutes are first, followed by expanded attributes
-	// we build a signature essentially by printing it all out in one big string
-	//
-	bool need_sep = false; // true after the first item, (when we need to print separators)
-	std::string signature;
-	signature.reserve(strlen(significant_attrs) + exattrs.size()*20 + sigset.size()*20); // make a guess as to how much space the signature will take.
-
-	classad::ClassAdUnParser unp;
-	unp.SetOldClassAd( true, true );
+	// significant attibutes are first, followed by expanded attributes.
+	// the significant attribute names are the same for every job, so only the
+	// names of the expanded attributes need to go into the hash.
+	JobSigHasher hasher;
+	for (size_t ix = 0; ix < sigset.size(); ++ix) {
+		hasher.tree(sigset[ix]);
+	}
+	hasher.num(exattrs.size());
+	for (classad::References::iterator it = exattrs.begin(); it != exattrs.end(); ++it) {
+		hasher.nocase(*it);
+	}
+	JobSigHash hash = hasher.result();
 
-	// first put the pre-defined significant attrs in the sig
-	list.rewind();
-	int ix = 0;
-	while ((attr = list.next_string())) {
-		ExprTree * tree = sigset[ix];
-		signature += *attr;
-		signature += " = ";
-		if (tree) { unp.Unparse(signature, tree); }
-		signature += '\n';
-		if (final_list) {
+	if (final_list) {
+		bool need_sep = false; // true after the first item, (when we need to print separators)
+		list.rewind();
+		while ((attr = list.next_string())) {
 			if (need_sep) { (*final_list) += ','; }
 			final_list->append(*attr);
 			need_sep = true;
 		}
-		++ix;
-	}
-
-	// now put out the expanded attribs (if any)
-	for (classad::References::iterator it = exattrs.begin(); it != exattrs.end(); ++it) {
-		ExprTree * tree = sigset[ix];
-		signature += *it;
-		signature += " = ";
-		if (tree) { unp.Unparse(signature, tree); }
-		signature += '\n';
-		if (final_list) {
+		for (classad::References::iterator it = exattrs.begin(); it != exattrs.end(); ++it) {
 			if (need_sep) { (*final_list) += ','; }
 			final_list->append(*it);
 			need_sep = true;
 		}
-		++ix;
 	}
 
-	// now check the signature against the current cluster map
+	// now check the signature against the current clusters
 	// and either return the matching cluster id, or a new cluster id.
-	JobSigidMap::iterator it;
-	it = cluster_map.find(signature);
-	if (it != cluster_map.end()) {
-		cur_id = it->second;
+	JobClusterSig * sig = findSig(hash, sigset, exattrs);
+	if (sig) {
+		cur_id = sig->id;
 	}
 	else {
 		cur_id = next_id++;
-		cluster_map.insert(JobSigidMap::value_type(signature,cur_id));
+		sig = new JobClusterSig(cur_id, hash);
+		sig->exattrs.assign(exattrs.begin(), exattrs.end());
+		sig->values.reserve(sigset.size());
+		for (size_t ix = 0; ix < sigset.size(); ++ix) {
+			sig->values.push_back(sigset[ix] ? sigset[ix]->Copy() : NULL);
+		}
+		cluster_map[cur_id] = sig;
+		insertSig(sig);
 	}
 
 #ifdef USE_AUTOCLUSTER_TO_JOBID_MAP
@@ -535,13 +791,13 @@ void AutoCluster::sweep()
 		next = it;
 		next++; // avoid invalid iterator if we delete this element
 
-		int id = it->second;
+		int id = it->first;
 		JobClusterIDs::iterator in_use;
 		in_use = cluster_in_use.find(id);
 		if (in_use == cluster_in_use.end()) {
 				// found an entry to remove.
 			dprintf(D_FULLDEBUG,"removing auto cluster id %d\n",id);
-			cluster_map.erase( it );
+			eraseSig( it );
 		}
 	}
 }
@@ -708,7 +964,7 @@ bool JobAggregationResults::compute()
 bool JobAggregationResults::rewind()
 {
 	results_returned = 0;
-	pause_position.clear();
+	pause_position = 0;
 	it = jc.cluster_map.begin();
 	return it != jc.cluster_map.end();
 }
@@ -717,7 +973,7 @@ bool JobAggregationResults::rewind()
 // we will pick back up at that point.
 void JobAggregationResults::pause()
 {
-	pause_position.clear();
+	pause_position = 0;
 	if (it != jc.cluster_map.end()) {
 		pause_position = it->first;
 	}
@@ -732,9 +988,9 @@ ClassAd * JobAggregationResults::next()
 
 	// if we are resuming from a paused state, we don't have a valid iterator
 	// so we have to find the the element we paused at or the first one after it.
-	if ( ! pause_position.empty()) {
+	if (pause_position) {
 		it = jc.cluster_map.lower_bound(pause_position);
-		pause_position.clear();
+		pause_position = 0;
 	}
 
 	// in case we never enter the loop, clear our 'current' ad here.
@@ -745,21 +1001,28 @@ ClassAd * JobAggregationResults::next()
 
 		ad.Clear();
 
-		// the autocluster key (or signature), is a string containing key value
-		// pairs separated by \n. So we can easily turn it into a classad.
-		StringTokenIterator iter(it->first, 100, "\n");
-		const char * line;
-		while ((line = iter.next())) {
-			ad.Insert(line);
+		// the autocluster signature holds the values of the significant attributes
+		// followed by the expanded attributes, so we can easily turn it into a classad.
+		const JobClusterSig * sig = it->second;
+		StringTokenIterator list(jc.significant_attrs);
+		const std::string * attr;
+		size_t ix = 0;
+		while ((attr = list.next_string()) && ix < sig->values.size()) {
+			ExprTree * tree = sig->values[ix++];
+			if (tree) { tree = tree->Copy(); ad.Insert(*attr, tree); }
+		}
+		for (size_t jx = 0; jx < sig->exattrs.size() && ix < sig->values.size(); ++jx) {
+			ExprTree * tree = sig->values[ix++];
+			if (tree) { tree = tree->Copy(); ad.Insert(sig->exattrs[jx], tree); }
 		}
 		if (this->is_def_autocluster) {
-			ad.Assign(ATTR_AUTO_CLUSTER_ID,it->second);
+			ad.Assign(ATTR_AUTO_CLUSTER_ID,it->first);
 		} else {
-			ad.Assign("Id",it->second);
+			ad.Assign("Id",it->first);
 		}
 	#ifdef USE_AUTOCLUSTER_TO_JOBID_MAP
 		int cJobs = 0;
-		JobCluster::JobIdSetMap::iterator jit = jc.cluster_use.find(it->second);
+		JobCluster::JobIdSetMap::iterator jit = jc.cluster_use.find(it->first);
 		if (jit != jc.cluster_use.end()) {
 			JobIdSet & jids = jit->second;
 			cJobs = jids.count();
@@ -31,6 +31,27 @@ class JobIdSet;
 class JobAggregationResults;
 class JobQueueJob;
 
+// a 128 bit hash of the values of the significant attributes of a job
+struct JobSigHash {
+	uint64_t lo, hi;
+	bool operator==(const JobSigHash & rhs) const { return lo == rhs.lo && hi == rhs.hi; }
+};
+
+// the signature of an autocluster: copies of the values of the significant attributes
+// followed by the values of the expanded attributes, NULL for attributes the jobs don't have.
+// the values are compared when hashes match, so a hash collision can't merge two autoclusters.
+class JobClusterSig {
+public:
+	JobClusterSig(int id_, const JobSigHash & hash_) : id(id_), hash(hash_) {}
+	~JobClusterSig();
+	bool matches(const std::vector<classad::ExprTree*> & sigset, const classad::References & exattrs) const;
+
+	int id;
+	JobSigHash hash;
+	std::vector<std::string> exattrs;      // names of the expanded attributes
+	std::vector<classad::ExprTree*> values; // significant then expanded attribute values
+};
+
 class JobCluster {
 public:
 	JobCluster();
@@ -50,8 +71,14 @@ public:
 
 protected:
 	friend class JobAggregationResults;
-	typedef std::map<std::string,int> JobSigidMap;
-	JobSigidMap cluster_map;  // map of signature to a cluster id
+	typedef std::map<int, JobClusterSig*> JobSigidMap;
+	JobSigidMap cluster_map;  // map of cluster id to signature
+	// open addressed hash table of the signatures in cluster_map, keyed by JobClusterSig::hash
+	std::vector<JobClusterSig*> sig_table;
+	size_t sig_table_used; // slots that are in use or were deleted
+	JobClusterSig * findSig(const JobSigHash & hash, const std::vector<classad::ExprTree*> & sigset, const classad::References & exattrs);
+	void insertSig(JobClusterSig * sig);
+	void eraseSig(JobSigidMap::iterator it); // remove from cluster_map and the table, and free
 #ifdef USE_AUTOCLUSTER_TO_JOBID_MAP
 	typedef std::map<int, JobIdSet> JobIdSetMap;
 	JobIdSetMap cluster_use; // map clusterId to a set of jobIds
@@ -159,7 +186,7 @@ protected:
 class JobAggregationResults {
 public:
 	JobAggregationResults(JobCluster& jc_, const char * proj_, int limit_, classad::ExprTree * constraint_=NULL, bool is_def_=false)
-		: jc(jc_), projection(proj_?proj_:""), constraint(NULL), is_def_autocluster(is_def_), return_jobid_limit(0), result_limit(limit_), results_returned(0)
+		: jc(jc_), projection(proj_?proj_:""), constraint(NULL), is_def_autocluster(is_def_), return_jobid_limit(0), result_limit(limit_), results_returned(0), pause_position(0)
 	{
 		if (constraint_) constraint = constraint_->Copy();
 	}
@@ -186,7 +213,7 @@ protected:
 	int  results_returned;
 	ClassAd ad;
 	JobCluster::JobSigidMap::iterator it;
-	std::string pause_position; // holds the key that the iterator was pointing to before we paused.
+	int pause_position; // holds the key that the iterator was pointing to before we paused, 0 if none.
 };
 
 
@@ -32,6 +32,9 @@
 #include "HashTable.h"
 #include "condor_uid.h"
 #include "condor_email.h"
+#include "scheduler.h"
+
+extern Scheduler scheduler;
 
 // Initialize static data members
 const int GridUniverseLogic::job_added_delay = 3;
@@ -184,6 +187,8 @@ GridUniverseLogic::SendAddSignal()
 
 	// Signal the gridmanager
 	if ( node->pid ) {
+		// the events it writes for the new jobs must come after ours
+		scheduler.FlushUserLogs();
 		daemonCore->Send_Signal(node->pid,GRIDMAN_ADD_JOBS);
 	}
 }
@@ -579,6 +584,8 @@ GridUniverseLogic::StartOrFindGManager(const char* owner, const char* domain,
 		dprintf(D_FULLDEBUG,"Really Execing %s\n",args_string.Value());
 	}
 
+	scheduler.FlushUserLogs();
+
 	pid = daemonCore->Create_Process( 
 		gman_binary,			// Program to exec
 		args,					// Command-line args
@@ -8,6 +8,8 @@
 #include "condor_daemon_core.h"
 #include "historyFileFinder.h"
 #include "backward_file_reader.h"
+#include "history_index.h"
+#include "history_archive.h"
 #include "condor_config.h"
 #include "classad_oldnew.h"
 
@@ -46,6 +48,8 @@ setError(int code, std::string message)
 
 // Sigh - mostly copy/paste from history.cpp
 
+static void printJob(compat_classad::ClassAd & ad, classad::ExprTree *constraintExpr);
+
 static void printJob(std::vector<std::string> & exprs, classad::ExprTree *constraintExpr)
 {
 	if (!exprs.size())
@@ -62,6 +66,11 @@ static void printJob(std::vector<std::string> & exprs, classad::ExprTree *constr
 			return;
 		}
 	}
+	printJob(ad, constraintExpr);
+}
+
+static void printJob(compat_classad::ClassAd & ad, classad::ExprTree *constraintExpr)
+{
 	adCount++;
 
 	classad::Value result;
@@ -90,6 +99,47 @@ static void printJob(std::vector<std::string> & exprs, classad::ExprTree *constr
 	}
 }
 
+// read a history archive newest first, skipping the blocks and ads that can't
+// match, and reading only the projected attributes.
+static void
+readHistoryFromArchive(const char *filename, classad::ExprTree *constraintExpr)
+{
+	HistoryArchiveReader reader;
+	std::string errmsg;
+	if (!reader.open(filename, errmsg))
+	{
+		setError(5, "Error opening history file");
+	}
+
+	HistoryIndexFilter filter;
+	filter.init(constraintExpr);
+	reader.setFilter(&filter);
+	if (!whitelist.empty())
+	{
+		for (classad::References::const_iterator it = whitelist.begin(); it != whitelist.end(); ++it)
+		{
+			reader.project(it->c_str());
+		}
+		reader.projectReferences(constraintExpr);
+	}
+
+	compat_classad::ClassAd ad;
+	int skipped;
+	for (;;)
+	{
+		bool more = reader.nextAd(ad, skipped);
+		adCount += skipped;
+		if ((maxAds > 0) && (adCount > maxAds))
+			adCount = maxAds;
+		if (!more)
+			break;
+		if (((maxAds > 0) && (adCount >= maxAds)) || ((specifiedMatch > 0) && (matchCount >= specifiedMatch)))
+			break;
+		printJob(ad, constraintExpr);
+	}
+	reader.close();
+}
+
 static void
 readHistoryFromFileEx(const char *filename, classad::ExprTree *constraintExpr)
 {
@@ -100,6 +150,12 @@ readHistoryFromFileEx(const char *filename, classad::ExprTree *constraintExpr)
 		return;
 	}
 
+	if (IsHistoryArchive(filename))
+	{
+		readHistoryFromArchive(filename, constraintExpr);
+		return;
+	}
+
 	// do backwards reading.
 	BackwardFileReader reader(filename, O_RDONLY);
 	if (reader.LastError())
@@ -153,6 +209,46 @@ readHistoryFromFileEx(const char *filename, classad::ExprTree *constraintExpr)
 	reader.Close();
 }
 
+// read the history files newest first, using the index of each file to skip
+// the ads that can't match.  files without a usable index are read as above.
+static void
+readHistoryFromFilesIndexed(const char * const * files, int numFiles, classad::ExprTree *constraintExpr)
+{
+	HistoryIndexFilter filter;
+	filter.init(constraintExpr);
+
+	HistoryIndexReader reader(files, numFiles, filter);
+	const char * filename;
+	bool indexed;
+	while (reader.nextFile(filename, indexed))
+	{
+		if (!indexed)
+		{
+			readHistoryFromFileEx(filename, constraintExpr);
+			continue;
+		}
+
+		std::string text;
+		std::vector<std::string> exprs;
+		int skipped;
+		for (;;)
+		{
+			bool more = reader.nextAd(text, skipped);
+			adCount += skipped;
+			if ((maxAds > 0) && (adCount > maxAds))
+				adCount = maxAds;
+			if (!more)
+				break;
+			if (((maxAds > 0) && (adCount >= maxAds)) || ((specifiedMatch > 0) && (matchCount >= specifiedMatch)))
+				break;
+			HistoryIndexReader::adLines(text, exprs);
+			printJob(exprs, constraintExpr);
+		}
+		if (((maxAds > 0) && (adCount >= maxAds)) || ((specifiedMatch > 0) && (matchCount >= specifiedMatch)))
+			break;
+	}
+}
+
 void
 main_init(int argc, char *argv[])
 {
@@ -228,10 +324,7 @@ main_init(int argc, char *argv[])
 		setError(8, "Error: No history file is defined\n");
 	}
 	if (historyFiles && numHistoryFiles > 0) {
-		int fileIndex;
-		for(fileIndex = numHistoryFiles - 1; fileIndex >= 0; fileIndex--) {
-			readHistoryFromFileEx(historyFiles[fileIndex], requirements);
-		}
+		readHistoryFromFilesIndexed(historyFiles, numHistoryFiles, requirements);
 	}
 	freeHistoryFilesList(historyFiles);
 
@@ -0,0 +1,203 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "proc.h"
+#include "prio_rec.h"
+
+void
+PrioRecIndex::update(const prio_rec & rec)
+{
+	std::map<JOB_ID_KEY, prio_rec>::iterator it = m_recs.find(rec.id);
+	if (it == m_recs.end()) {
+		it = m_recs.insert(std::make_pair(JOB_ID_KEY(rec.id), rec)).first;
+	} else {
+		// the position of a record in the sets depends on its contents,
+		// so take it out before changing it.
+		unlink(&it->second);
+		it->second = rec;
+	}
+	link(&it->second);
+}
+
+void
+PrioRecIndex::remove(const PROC_ID & id)
+{
+	std::map<JOB_ID_KEY, prio_rec>::iterator it = m_recs.find(id);
+	if (it != m_recs.end()) {
+		unlink(&it->second);
+		m_recs.erase(it);
+	}
+}
+
+void
+PrioRecIndex::clear()
+{
+	m_submitters.clear();
+	m_all.clear();
+	m_recs.clear();
+}
+
+const prio_rec *
+PrioRecIndex::lookup(const PROC_ID & id) const
+{
+	std::map<JOB_ID_KEY, prio_rec>::const_iterator it = m_recs.find(id);
+	if (it == m_recs.end()) {
+		return NULL;
+	}
+	return &it->second;
+}
+
+const PrioRecIndex::Submitter *
+PrioRecIndex::submitter(const char * owner) const
+{
+	Submitters::const_iterator it = m_submitters.find(owner);
+	if (it == m_submitters.end()) {
+		return NULL;
+	}
+	return &it->second;
+}
+
+void
+PrioRecIndex::link(const prio_rec * rec)
+{
+	m_all.insert(rec);
+	Submitter & sub = m_submitters[rec->owner];
+	sub.jobs.insert(rec);
+	sub.autoclusters[rec->auto_cluster_id].insert(rec);
+}
+
+void
+PrioRecIndex::unlink(const prio_rec * rec)
+{
+	m_all.erase(rec);
+	Submitters::iterator sit = m_submitters.find(rec->owner);
+	if (sit == m_submitters.end()) {
+		return;
+	}
+	Submitter & sub = sit->second;
+	sub.jobs.erase(rec);
+	AutoClusters::iterator ait = sub.autoclusters.find(rec->auto_cluster_id);
+	if (ait != sub.autoclusters.end()) {
+		ait->second.erase(rec);
+		if (ait->second.empty()) {
+			sub.autoclusters.erase(ait);
+		}
+	}
+	if (sub.jobs.empty()) {
+		m_submitters.erase(sit);
+	}
+}
+
+// a record that goes before every other record of its group
+static void
+group_start(int group, prio_rec & probe)
+{
+	probe.pre_job_prio1 = (group & 1) ? INT_MAX : INT_MIN;
+	probe.pre_job_prio2 = (group & 2) ? INT_MAX : INT_MIN;
+	probe.post_job_prio1 = (group & 4) ? INT_MAX : INT_MIN;
+	probe.post_job_prio2 = (group & 8) ? INT_MAX : INT_MIN;
+	probe.job_prio = INT_MAX;
+	probe.qdate = INT_MIN;
+	probe.id.cluster = INT_MIN;
+	probe.id.proc = INT_MIN;
+}
+
+void
+PrioRecQueue::add(const PrioRecIndex::Order & order)
+{
+	Cursor cur;
+	cur.it = order.begin();
+	while (cur.it != order.end()) {
+		int group = prio_rec_group(*cur.it);
+		if (group + 1 < PRIO_REC_GROUPS) {
+			prio_rec probe;
+			group_start(group + 1, probe);
+			cur.end = order.lower_bound(&probe);
+		} else {
+			cur.end = order.end();
+		}
+		m_groups[group].push(cur);
+		cur.it = cur.end;
+	}
+}
+
+void
+PrioRecQueue::push(const Cursor & cur)
+{
+	if (cur.it != cur.end) {
+		m_groups[prio_rec_group(*cur.it)].push(cur);
+	}
+}
+
+bool
+PrioRecQueue::empty() const
+{
+	return best() < 0;
+}
+
+const PrioRecQueue::Cursor &
+PrioRecQueue::top() const
+{
+	int group = best();
+	ASSERT(group >= 0);
+	return m_groups[group].top();
+}
+
+void
+PrioRecQueue::pop()
+{
+	int group = best();
+	ASSERT(group >= 0);
+	m_groups[group].pop();
+}
+
+const prio_rec *
+PrioRecQueue::next()
+{
+	int group = best();
+	if (group < 0) {
+		return NULL;
+	}
+	Cursor cur = m_groups[group].top();
+	m_groups[group].pop();
+	const prio_rec * rec = *cur.it;
+	++cur.it;
+	push(cur);
+	return rec;
+}
+
+// the group whose top is best as prio_compar() has it, or -1 if all are empty
+int
+PrioRecQueue::best() const
+{
+	int best_group = -1;
+	for (int group = 0; group < PRIO_REC_GROUPS; group++) {
+		if (m_groups[group].empty()) {
+			continue;
+		}
+		if (best_group < 0 ||
+			prio_compar(*m_groups[group].top().it, *m_groups[best_group].top().it) < 0)
+		{
+			best_group = group;
+		}
+	}
+	return best_group;
+}
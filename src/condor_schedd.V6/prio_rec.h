@@ -26,7 +26,11 @@
 #ifndef _PRIO_REC_H_
 #define _PRIO_REC_H_
 
-const 	int		INITIAL_MAX_PRIO_REC = 2048;
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
 
 /* this record contains all the parameters required for
  * assigning priorities to all jobs */
@@ -55,4 +59,106 @@ public:
 	}
 };
 
+extern "C" int prio_compar(const prio_rec*, const prio_rec*);
+
+/* prio_compar() only compares a pre or post priority when both jobs have it,
+ * which is not a consistent ordering when some jobs have it and some don't.
+ * So the sets order the jobs by which of those priorities they have first,
+ * and prio_compar() within each of those groups, where it is consistent.
+ * Use a PrioRecQueue to get the jobs of a set in prio_compar() order.
+ */
+#define PRIO_REC_GROUPS 16
+
+inline int prio_rec_group(const prio_rec * rec)
+{
+	return (rec->pre_job_prio1 > INT_MIN ? 1 : 0) |
+		(rec->pre_job_prio2 > INT_MIN ? 2 : 0) |
+		(rec->post_job_prio1 > INT_MIN ? 4 : 0) |
+		(rec->post_job_prio2 > INT_MIN ? 8 : 0);
+}
+
+struct prio_rec_less {
+	bool operator()(const prio_rec * a, const prio_rec * b) const {
+		int group_a = prio_rec_group(a);
+		int group_b = prio_rec_group(b);
+		if (group_a != group_b) {
+			return group_a < group_b;
+		}
+		return prio_compar(a, b) < 0;
+	}
+};
+
+/* The records of the runnable jobs, in priority order, and in priority order
+ * by submitter and by autocluster within each submitter.  The records are
+ * updated as jobs change (see UpdateJobPrioRec() in qmgmt.cpp) rather than
+ * rebuilt and sorted each time they are needed.
+ */
+
+class PrioRecIndex {
+public:
+	typedef std::set<const prio_rec*, prio_rec_less> Order;
+	typedef std::map<int, Order> AutoClusters; // by autocluster id
+	struct Submitter {
+		Order jobs;
+		AutoClusters autoclusters;
+	};
+	typedef std::map<std::string, Submitter> Submitters; // by prio_rec::owner
+
+	// add the record of a job, or replace the one it has
+	void update(const prio_rec & rec);
+	void remove(const PROC_ID & id);
+	void clear();
+
+	int size() const { return (int)m_recs.size(); }
+	const prio_rec * lookup(const PROC_ID & id) const;
+	const Order & all() const { return m_all; }
+	const Submitters & submitters() const { return m_submitters; }
+	// the submitter with the given owner, or NULL if it has no runnable jobs
+	const Submitter * submitter(const char * owner) const;
+
+private:
+	void link(const prio_rec * rec);
+	void unlink(const prio_rec * rec);
+
+	std::map<JOB_ID_KEY, prio_rec> m_recs;
+	Order m_all;
+	Submitters m_submitters;
+};
+
+/* The records of one or more sets of a PrioRecIndex, best first as
+ * prio_compar() has it.  Each group of a set (see prio_rec_less) is a
+ * cursor, and the cursors of a group are kept in a heap, so the best
+ * record is the best of the tops of the heaps.
+ */
+
+class PrioRecQueue {
+public:
+	struct Cursor {
+		PrioRecIndex::Order::const_iterator it;
+		PrioRecIndex::Order::const_iterator end;
+	};
+
+	// add the records of a set
+	void add(const PrioRecIndex::Order & order);
+	// add a cursor, if there is anything left in it
+	void push(const Cursor & cur);
+	bool empty() const;
+	// the cursor that has the best record
+	const Cursor & top() const;
+	void pop();
+	// the best record, which is then skipped, or NULL if there are no more
+	const prio_rec * next();
+
+private:
+	struct CursorLess {
+		// std::priority_queue puts the largest first
+		bool operator()(const Cursor & a, const Cursor & b) const { return prio_rec_less()(*b.it, *a.it); }
+	};
+	typedef std::priority_queue<Cursor, std::vector<Cursor>, CursorLess> Heap;
+
+	int best() const;
+
+	Heap m_groups[PRIO_REC_GROUPS];
+};
+
 #endif
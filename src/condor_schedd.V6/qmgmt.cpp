@@ -151,10 +151,6 @@ extern char *Name;
 extern Scheduler scheduler;
 extern DedicatedScheduler dedicated_scheduler;
 
-extern "C" {
-	int	prio_compar(prio_rec*, prio_rec*);
-}
-
 extern  void    cleanup_ckpt_files(int, int, const char*);
 extern	bool	service_this_universe(int, ClassAd *);
 extern	bool	jobExternallyManaged(ClassAd * ad);
@@ -205,13 +201,12 @@ bool        PrioRecArrayIsDirty = true;
 const double PrioRecRebuildMaxTimeSlice = 0.05;
 const double PrioRecRebuildMaxTimeSliceWhenNoMatchFound = 0.1;
 const double PrioRecRebuildMaxInterval = 20 * 60;
+// the records are kept up to date as jobs change, but are rebuilt at least this often,
+// which is when the autoclusters that no job is in any more are cleaned up.
+const time_t PrioRecGarbageCollectInterval = 60 * 60;
 Timeslice   PrioRecArrayTimeslice;
-prio_rec	PrioRecArray[INITIAL_MAX_PRIO_REC];
-prio_rec	* PrioRec = &PrioRecArray[0];
-int			N_PrioRecs = 0;
-HashTable<int,int> *PrioRecAutoClusterRejected = NULL;
-
-static int 	MAX_PRIO_REC=INITIAL_MAX_PRIO_REC ;	// INITIAL_MAX_* in prio_rec.h
+time_t      PrioRecLastRebuild = 0;
+PrioRecIndex PrioRecs;
 
 JOB_ID_KEY_BUF HeaderKey(0,0);
 
@@ -238,7 +233,14 @@ static classad::References immutable_attrs, protected_attrs, secure_attrs;
 static int flush_job_queue_log_timer_id = -1;
 static int dirty_notice_timer_id = -1;
 static int flush_job_queue_log_delay = 0;
+static bool job_queue_log_snapshots = false;
 static void HandleFlushJobQueueLogTimer();
+static bool job_queue_log_group_commit = false;
+static int group_commit_window = 0;
+static long long group_commit_max_bytes = 0;
+static int group_commit_timer_id = -1;
+static void ScheduleJobQueueLogSync();
+static void SyncJobQueueLog();
 static int dirty_notice_interval = 0;
 static void PeriodicDirtyAttributeNotification();
 static void ScheduleJobQueueLogFlush();
@@ -269,6 +271,55 @@ GetJobQueueIteratorEnd()
 	return JobQueue->GetIteratorEnd();
 }
 
+// job queue snapshots, see BeginJobQueueSnapshot in qmgmt.h
+static unsigned long jobQueueEpoch = 0;
+static std::map<unsigned long, int> jobQueueSnapshots; // open snapshots by the epoch they began in
+static std::deque< std::pair<unsigned long, JobQueueJob*> > retiredJobAds; // by the epoch they were retired in
+
+unsigned long
+BeginJobQueueSnapshot(std::vector<JobQueueJob*> & jobs, int iter_opts)
+{
+	jobs.clear();
+	if (JobQueue) {
+		HashTable<JobQueueKey,JobQueueJob*> * table = JobQueue->Table();
+		jobs.reserve(table->getNumElements());
+		HashIterator<JobQueueKey,JobQueueJob*> end = table->end();
+		for (HashIterator<JobQueueKey,JobQueueJob*> it = table->begin(); !(it == end); it.advance()) {
+			JobQueueJob * job = (*it).second;
+			if ( ! job) continue;
+			// same as the filter_iterator, we want job ads, and cluster ads only if asked for.
+			if ( ! job->IsJob()) {
+				if ( ! (iter_opts & JOB_QUEUE_ITERATOR_OPT_INCLUDE_CLUSTERS) || ! job->IsCluster()) continue;
+			}
+			jobs.push_back(job);
+		}
+	}
+
+	jobQueueSnapshots[jobQueueEpoch] += 1;
+	return jobQueueEpoch;
+}
+
+void
+EndJobQueueSnapshot(unsigned long token)
+{
+	std::map<unsigned long, int>::iterator it = jobQueueSnapshots.find(token);
+	if (it == jobQueueSnapshots.end()) {
+		dprintf(D_ALWAYS | D_FAILURE, "EndJobQueueSnapshot called for unknown snapshot %lu\n", token);
+		return;
+	}
+	if (--(it->second) <= 0) {
+		jobQueueSnapshots.erase(it);
+	}
+
+	// an ad retired in an epoch before the oldest open snapshot
+	// was already gone from the job queue when that snapshot began.
+	unsigned long oldest = jobQueueSnapshots.empty() ? jobQueueEpoch : jobQueueSnapshots.begin()->first;
+	while ( ! retiredJobAds.empty() && retiredJobAds.front().first < oldest) {
+		delete retiredJobAds.front().second;
+		retiredJobAds.pop_front();
+	}
+}
+
 static inline
 void
 DeadIdToStr(int cluster, int proc, char *buf)
@@ -350,12 +401,23 @@ ConstructClassAdLogTableEntry<JobQueueJob*>::Delete(ClassAd* &ad) const
 			// in which case the actual destruction would be delayed until the transaction commit. i.e. here...
 			IncrementLiveJobCounter(scheduler.liveJobCounts, job->Universe(), job->Status(), -1);
 			if (job->ownerinfo) { IncrementLiveJobCounter(job->ownerinfo->live, job->Universe(), job->Status(), -1); }
+			scheduler.untallyJob(job);
+			PrioRecs.remove(job->jid);
 
 			if (job->Cluster()) {
 				job->Cluster()->DetachJob(job);
 			}
 		}
 	}
+
+	// a query thread may still be reading the ad, so just mark it retired
+	// and let EndJobQueueSnapshot free it.
+	if ( ! jobQueueSnapshots.empty()) {
+		job->retired = true;
+		retiredJobAds.push_back(std::make_pair(jobQueueEpoch, job));
+		++jobQueueEpoch;
+		return;
+	}
 	delete job;
 }
 
@@ -1050,6 +1112,20 @@ InitQmgmt()
     cluster_maximum_val = param_integer("SCHEDD_CLUSTER_MAXIMUM_VALUE",0,0);
 
 	flush_job_queue_log_delay = param_integer("SCHEDD_JOB_QUEUE_LOG_FLUSH_DELAY",5,0);
+	job_queue_log_snapshots = param_boolean("JOB_QUEUE_LOG_SNAPSHOTS", false);
+	if (JobQueue) {
+		JobQueue->SetBinarySnapshots(job_queue_log_snapshots);
+	}
+	job_queue_log_group_commit = param_boolean("JOB_QUEUE_LOG_GROUP_COMMIT", false);
+	group_commit_window = param_integer("JOB_QUEUE_LOG_GROUP_COMMIT_WINDOW", 0, 0);
+	group_commit_max_bytes = param_integer("JOB_QUEUE_LOG_GROUP_COMMIT_MAX_BYTES", 1024*1024, 0);
+	if (JobQueue) {
+		if ( ! job_queue_log_group_commit) {
+			// answer anyone still waiting before turning it off
+			SyncJobQueueLog();
+		}
+		JobQueue->SetGroupCommit(job_queue_log_group_commit);
+	}
 	dirty_notice_interval = param_integer("SCHEDD_JOB_QUEUE_NOTIFY_UPDATES",30,0);
 }
 
@@ -1350,6 +1426,8 @@ InitJobQueue(const char *job_queue_name,int max_historical_logs)
 	CheckSpoolVersion(spool.Value(),SPOOL_MIN_VERSION_SCHEDD_SUPPORTS,SPOOL_CUR_VERSION_SCHEDD_SUPPORTS,spool_min_version,spool_cur_version);
 
 	JobQueue = new JobQueueType(new ConstructClassAdLogTableEntry<JobQueuePayload>(),job_queue_name,max_historical_logs);
+	JobQueue->SetBinarySnapshots(job_queue_log_snapshots);
+	JobQueue->SetGroupCommit(job_queue_log_group_commit);
 	ClusterSizeHashTable = new ClusterSizeHashTable_t(37,compute_clustersize_hash);
 	TotalJobsCount = 0;
 	jobs_added_this_transaction = 0;
@@ -1583,6 +1661,7 @@ InitJobQueue(const char *job_queue_name,int max_historical_logs)
 				// Add the job to various runtime indexes for quick lookups
 				//
 			scheduler.indexAJob(ad, true);
+			scheduler.tallyJob(ad);
 
 				// If input files are going to be spooled, rewrite
 				// the paths in the job ad to point at our spool area.
@@ -1742,6 +1821,7 @@ DestroyJobQueue( void )
 		CleanJobQueue();
 	}
 	ASSERT( JobQueueDirty == false );
+	SyncJobQueueLog();
 	delete JobQueue;
 	JobQueue = NULL;
 
@@ -1902,40 +1982,6 @@ int QmgmtHandleSetJobFactory(int cluster_id, const char* filename, const char *
 }
 
 
-int
-grow_prio_recs( int newsize )
-{
-	int i;
-	prio_rec *tmp;
-
-	// just return if PrioRec already equal/larger than the size requested
-	if ( MAX_PRIO_REC >= newsize ) {
-		return 0;
-	}
-
-	dprintf(D_FULLDEBUG,"Dynamically growing PrioRec to %d\n",newsize);
-
-	tmp = new prio_rec[newsize];
-	if ( tmp == NULL ) {
-		EXCEPT( "grow_prio_recs: out of memory" );
-	}
-
-	/* copy old PrioRecs over */
-	for (i=0;i<N_PrioRecs;i++)
-		tmp[i] = PrioRec[i];
-
-	/* delete old too-small space, but only if we new-ed it; the
-	 * first space came from the heap, so check and don't try to 
-	 * delete that */
-	if ( &PrioRec[0] != &PrioRecArray[0] )
-		delete [] PrioRec;
-
-	/* replace with spanky new big one */
-	PrioRec = tmp;
-	MAX_PRIO_REC = newsize;
-	return 0;
-}
-
 
 bool
 isQueueSuperUser( const char* user )
@@ -2304,34 +2350,59 @@ unsetQSock()
 }
 
 
-int
-handle_q(Service *, int, Stream *sock)
+// A qmgmt connection whose reply to CommitTransaction is waiting for the
+// group commit of the job queue log.  Once the log is synced, the reply is
+// sent, and the rest of the connection is handled as its requests arrive.
+class QmgmtCommitWaiter : public Service
 {
-	int	rval;
-	bool all_good;
+public:
+	QmgmtCommitWaiter(QmgmtPeer * peer) : m_peer(peer) {}
+	~QmgmtCommitWaiter();
 
-	all_good = setQSock((ReliSock*)sock);
+	void committed();
+	int resume(Stream * sock);
 
-		// if setQSock failed, unset it to purge any old/stale
-		// connection that was never cleaned up, and try again.
-	if ( !all_good ) {
-		unsetQSock();
-		all_good = setQSock((ReliSock*)sock);
-	}
-	if (!all_good && sock) {
-		// should never happen
-		EXCEPT("handle_q: Unable to setQSock!!");
-	}
-	ASSERT(Q_SOCK);
+private:
+	QmgmtPeer * m_peer;
+};
 
-	BeginTransaction();
+static std::vector<QmgmtCommitWaiter*> group_commit_waiters;
+
+static bool
+send_commit_reply(ReliSock * sock)
+{
+	int rval = 0;
+	sock->encode();
+	return sock->code(rval) && sock->end_of_message();
+}
 
+// handle requests on the current qmgmt connection (Q_SOCK) until it is
+// closed.  returns KEEP_STREAM if the connection is waiting for a group
+// commit, in which case it now belongs to a QmgmtCommitWaiter.
+static int
+handle_q_requests()
+{
+	int rval;
 	bool may_fork = false;
 	ForkStatus fork_status = FORK_FAILED;
 	do {
 		/* Probably should wrap a timer around this */
 		rval = do_Q_request( Q_SOCK->getReliSock(), may_fork );
 
+		if( rval == QMGMT_AWAIT_GROUP_COMMIT ) {
+			if( fork_status == FORK_CHILD ) {
+					// the parent owns the log, nothing to wait for here
+				if( !send_commit_reply( Q_SOCK->getReliSock() ) ) {
+					rval = -1;
+				}
+			}
+			else {
+				group_commit_waiters.push_back( new QmgmtCommitWaiter( getQmgmtConnectionInfo() ) );
+				ScheduleJobQueueLogSync();
+				return KEEP_STREAM;
+			}
+		}
+
 		if( may_fork && fork_status == FORK_FAILED ) {
 			fork_status = schedd_forker.NewJob();
 
@@ -2363,6 +2434,78 @@ handle_q(Service *, int, Stream *sock)
 	return 0;
 }
 
+QmgmtCommitWaiter::~QmgmtCommitWaiter()
+{
+	if( m_peer ) {
+		ReliSock * sock = m_peer->getReliSock();
+		delete m_peer;
+		delete sock;
+	}
+}
+
+// the commit is durable, tell the client and go back to waiting for
+// its next request.
+void
+QmgmtCommitWaiter::committed()
+{
+	ReliSock * sock = m_peer->getReliSock();
+	if( !send_commit_reply( sock ) ) {
+		dprintf( D_ALWAYS, "QMGR failed to send the reply to a group commit to %s\n", sock->peer_description() );
+		delete this;
+		return;
+	}
+	int rc = daemonCore->Register_Socket( sock, "QMGMT connection",
+			(SocketHandlercpp)&QmgmtCommitWaiter::resume,
+			"QmgmtCommitWaiter::resume", this, ALLOW );
+	if( rc < 0 ) {
+		delete this;
+	}
+}
+
+int
+QmgmtCommitWaiter::resume(Stream * sock)
+{
+	daemonCore->Cancel_Socket( sock );
+
+	if( Q_SOCK || !setQmgmtConnectionInfo( m_peer ) ) {
+		dprintf( D_ALWAYS, "QMGR unable to resume connection from %s\n", sock->peer_description() );
+		delete this;
+		return KEEP_STREAM;
+	}
+	m_peer = NULL;
+
+	if( handle_q_requests() != KEEP_STREAM ) {
+			// the connection is closed, and the socket is ours to delete
+		delete sock;
+	}
+	delete this;
+	return KEEP_STREAM;
+}
+
+int
+handle_q(Service *, int, Stream *sock)
+{
+	bool all_good;
+
+	all_good = setQSock((ReliSock*)sock);
+
+		// if setQSock failed, unset it to purge any old/stale
+		// connection that was never cleaned up, and try again.
+	if ( !all_good ) {
+		unsetQSock();
+		all_good = setQSock((ReliSock*)sock);
+	}
+	if (!all_good && sock) {
+		// should never happen
+		EXCEPT("handle_q: Unable to setQSock!!");
+	}
+	ASSERT(Q_SOCK);
+
+	BeginTransaction();
+
+	return handle_q_requests();
+}
+
 int GetMyProxyPassword (int, int, char **);
 
 int get_myproxy_password_handler(Service * /*service*/, int /*i*/, Stream *socket) {
@@ -3183,6 +3326,22 @@ enum {
 	idATTR_JOB_MATERIALIZE_PAUSED,
 	idATTR_HOLD_REASON,
 	idATTR_HOLD_REASON_CODE,
+	idATTR_CURRENT_HOSTS,
+	idATTR_GRID_JOB_ID,
+	idATTR_GRID_RESOURCE,
+	idATTR_JOB_NOOP,
+	idATTR_JOB_MANAGED,
+	idATTR_MAX_HOSTS,
+	idATTR_REQUEST_CPUS,
+	idATTR_REQUEST_DISK,
+	idATTR_REQUEST_MEMORY,
+	idATTR_WANT_MATCHING,
+	idATTR_WANT_PARALLEL_SCHEDULING,
+	idATTR_POST_JOB_PRIO1,
+	idATTR_POST_JOB_PRIO2,
+	idATTR_PRE_JOB_PRIO1,
+	idATTR_PRE_JOB_PRIO2,
+	idATTR_Q_DATE,
 };
 
 enum {
@@ -3191,12 +3350,14 @@ enum {
 	catJobId        = 0x0002, // cluster & proc id
 	catCron         = 0x0004, // attributes that tell us this is a crondor job
 	catStatus       = 0x0008, // job status changed, need to adjust the counts of running/idle/held/etc jobs.
-	catDirtyPrioRec = 0x0010,
+	catDirtyPrioRec = 0x0010,    // the record of the job in the PrioRecIndex must be updated, see UpdateJobPrioRec()
 	catTargetScope  = 0x0020,
 	catSubmitterIdent = 0x0040,
 	catNewMaterialize = 0x0080,  // attributes that control the job factory
 	catMaterializeState = 0x0100, // change in state of job factory
 	catSpoolingHold = 0x0200,    // hold reason was set to CONDOR_HOLD_CODE_SpoolingInput
+	catJobCounts    = 0x0400,    // the job must be tallied again, see Scheduler::tallyJob()
+	catPeriodicExpr = 0x0800,    // periodic policy of the job refers to this, see Scheduler::PeriodicExprHandler()
 	catCallbackTrigger = 0x1000, // indicates that a callback should happen on commit of this attribute
 	catCallbackNow = 0x20000,    // indicates that a callback should happen when setAttribute is called
 };
@@ -3216,28 +3377,44 @@ typedef struct attr_ident_pair {
 // NOTE: !!!
 #define FILL(attr,cat) { attr, id##attr, cat }
 static const ATTR_IDENT_PAIR aSpecialSetAttrs[] = {
-	FILL(ATTR_ACCOUNTING_GROUP,   catDirtyPrioRec | catSubmitterIdent),
+	FILL(ATTR_ACCOUNTING_GROUP,   catDirtyPrioRec | catSubmitterIdent | catJobCounts | catCallbackTrigger),
 	FILL(ATTR_CLUSTER_ID,         catJobId),
 	FILL(ATTR_CRON_DAYS_OF_MONTH, catCron),
 	FILL(ATTR_CRON_DAYS_OF_WEEK,  catCron),
 	FILL(ATTR_CRON_HOURS,         catCron),
 	FILL(ATTR_CRON_MINUTES,       catCron),
 	FILL(ATTR_CRON_MONTHS,        catCron),
+	FILL(ATTR_CURRENT_HOSTS,      catDirtyPrioRec | catJobCounts | catCallbackTrigger),
+	FILL(ATTR_GRID_JOB_ID,        catJobCounts | catCallbackTrigger),
+	FILL(ATTR_GRID_RESOURCE,      catDirtyPrioRec | catJobCounts | catCallbackTrigger),
 	FILL(ATTR_HOLD_REASON,        0), // used to detect submit of jobs with the magic 'hold for spooling' hold code
 	FILL(ATTR_HOLD_REASON_CODE,   0), // used to detect submit of jobs with the magic 'hold for spooling' hold code
+	FILL(ATTR_JOB_NOOP,           catJobCounts | catCallbackTrigger),
 	FILL(ATTR_JOB_MATERIALIZE_DIGEST_FILE, catNewMaterialize | catCallbackTrigger),
 	FILL(ATTR_JOB_MATERIALIZE_ITEMS_FILE, catNewMaterialize | catCallbackTrigger),
 	FILL(ATTR_JOB_MATERIALIZE_LIMIT, catMaterializeState | catCallbackTrigger),
 	FILL(ATTR_JOB_MATERIALIZE_PAUSED, catMaterializeState | catCallbackTrigger),
-	FILL(ATTR_JOB_PRIO,           catDirtyPrioRec),
-	FILL(ATTR_JOB_STATUS,         catStatus | catCallbackTrigger),
-	FILL(ATTR_JOB_UNIVERSE,       catJobObj),
-	FILL(ATTR_NICE_USER,          catSubmitterIdent),
+	FILL(ATTR_JOB_PRIO,           catDirtyPrioRec | catJobCounts | catCallbackTrigger),
+	FILL(ATTR_JOB_STATUS,         catStatus | catDirtyPrioRec | catJobCounts | catCallbackTrigger),
+	FILL(ATTR_JOB_UNIVERSE,       catJobObj | catDirtyPrioRec | catJobCounts | catCallbackTrigger),
+	FILL(ATTR_JOB_MANAGED,        catDirtyPrioRec | catJobCounts | catCallbackTrigger),
+	FILL(ATTR_MAX_HOSTS,          catDirtyPrioRec | catJobCounts | catCallbackTrigger),
+	FILL(ATTR_NICE_USER,          catDirtyPrioRec | catSubmitterIdent | catJobCounts | catCallbackTrigger),
 	FILL(ATTR_NUM_JOB_RECONNECTS, 0),
-	FILL(ATTR_OWNER,              0),
+	FILL(ATTR_OWNER,              catDirtyPrioRec | catJobCounts | catCallbackTrigger),
+	FILL(ATTR_POST_JOB_PRIO1,     catDirtyPrioRec | catCallbackTrigger),
+	FILL(ATTR_POST_JOB_PRIO2,     catDirtyPrioRec | catCallbackTrigger),
+	FILL(ATTR_PRE_JOB_PRIO1,      catDirtyPrioRec | catCallbackTrigger),
+	FILL(ATTR_PRE_JOB_PRIO2,      catDirtyPrioRec | catCallbackTrigger),
 	FILL(ATTR_PROC_ID,            catJobId),
+	FILL(ATTR_Q_DATE,             catDirtyPrioRec | catCallbackTrigger),
 	FILL(ATTR_RANK,               catTargetScope),
+	FILL(ATTR_REQUEST_CPUS,       catJobCounts | catCallbackTrigger),
+	FILL(ATTR_REQUEST_DISK,       catJobCounts | catCallbackTrigger),
+	FILL(ATTR_REQUEST_MEMORY,     catJobCounts | catCallbackTrigger),
 	FILL(ATTR_REQUIREMENTS,       catTargetScope),
+	FILL(ATTR_WANT_MATCHING,      catDirtyPrioRec | catJobCounts | catCallbackTrigger),
+	FILL(ATTR_WANT_PARALLEL_SCHEDULING, catJobCounts | catCallbackTrigger),
 
 
 };
@@ -3458,6 +3635,9 @@ SetAttribute(int cluster_id, int proc_id, const char *attr_name,
 
 	int attr_category;
 	int attr_id = IsSpecialSetAttribute(attr_name, &attr_category);
+	if (scheduler.isPeriodicExprInput(attr_name)) {
+		attr_category |= catPeriodicExpr | catCallbackTrigger;
+	}
 
 	// A few special attributes have additional access checks
 	// but for most, we have already decided whether or not we can change this attribute
@@ -3725,7 +3905,12 @@ SetAttribute(int cluster_id, int proc_id, const char *attr_name,
 	// give the autocluster code a chance to invalidate (or rebuild)
 	// based on the changed attribute.
 	if (job) {
+		int autocluster_id = job->autocluster_id;
 		scheduler.autocluster.preSetAttribute(*job, attr_name, attr_value, flags);
+		if (job->autocluster_id != autocluster_id) {
+			// the job will be in a different autocluster
+			attr_category |= catDirtyPrioRec | catCallbackTrigger;
+		}
 	}
 
 	// This block handles rounding of attributes.
@@ -3837,21 +4022,6 @@ SetAttribute(int cluster_id, int proc_id, const char *attr_name,
 	}
 	free( round_param );
 
-	if( !PrioRecArrayIsDirty ) {
-		if (attr_category & catDirtyPrioRec) {
-			DirtyPrioRecArray();
-		} else if(attr_id == idATTR_JOB_STATUS) {
-			if( atoi(attr_value) == IDLE ) {
-				DirtyPrioRecArray();
-			}
-		}
-		if(PrioRecArrayIsDirty) {
-			dprintf(D_FULLDEBUG,
-					"Prioritized runnable job list will be rebuilt, because "
-					"ClassAd attribute %s=%s changed\n",
-					attr_name,attr_value);
-		}
-	}
 	if (attr_category & catSubmitterIdent) {
 		if (job) { job->dirty_flags |= JQJ_CACHE_DIRTY_SUBMITTERDATA; }
 	}
@@ -3973,6 +4143,61 @@ void DoSetAttributeCallbacks(const std::set<std::string> &jobids, int triggers)
 		}
 	}
 
+	if (triggers & catJobCounts) {
+		for (auto it = jobids.begin(); it != jobids.end(); ++it) {
+			if ( ! job_id.set(it->c_str()) || job_id.cluster <= 0) continue; // ignore the header ad
+
+			if (job_id.proc >= 0) {
+				JobQueueJob * job = NULL;
+				if ( ! JobQueue->Lookup(job_id, job)) continue; // Ignore if no job ad (yet).
+				if (triggers & catSubmitterIdent) { job->dirty_flags |= JQJ_CACHE_DIRTY_SUBMITTERDATA; }
+				scheduler.tallyJob(job);
+			} else {
+				// the jobs in the cluster see the cluster ad attributes, so tally all of them again.
+				JobQueueCluster * cad = GetClusterAd(job_id);
+				if ( ! cad) continue;
+				for (JobQueueJob * job = cad->FirstJob(); job; job = cad->NextJob(job)) {
+					if (triggers & catSubmitterIdent) { job->dirty_flags |= JQJ_CACHE_DIRTY_SUBMITTERDATA; }
+					scheduler.tallyJob(job);
+				}
+			}
+		}
+	}
+
+	if (triggers & catDirtyPrioRec) {
+		for (auto it = jobids.begin(); it != jobids.end(); ++it) {
+			if ( ! job_id.set(it->c_str()) || job_id.cluster <= 0) continue; // ignore the header ad
+
+			if (job_id.proc >= 0) {
+				JobQueueJob * job = NULL;
+				if ( ! JobQueue->Lookup(job_id, job)) continue; // Ignore if no job ad (yet).
+				UpdateJobPrioRec(job);
+			} else {
+				JobQueueCluster * cad = GetClusterAd(job_id);
+				if ( ! cad) continue;
+				for (JobQueueJob * job = cad->FirstJob(); job; job = cad->NextJob(job)) {
+					UpdateJobPrioRec(job);
+				}
+			}
+		}
+	}
+
+	if (triggers & catPeriodicExpr) {
+		for (auto it = jobids.begin(); it != jobids.end(); ++it) {
+			if ( ! job_id.set(it->c_str()) || job_id.cluster <= 0) continue; // ignore the header ad
+
+			if (job_id.proc >= 0) {
+				scheduler.markPeriodicExprDirty(job_id);
+			} else {
+				JobQueueCluster * cad = GetClusterAd(job_id);
+				if ( ! cad) continue;
+				for (JobQueueJob * job = cad->FirstJob(); job; job = cad->NextJob(job)) {
+					scheduler.markPeriodicExprDirty(job->jid);
+				}
+			}
+		}
+	}
+
 	// note, catNewMaterialize trigger handling for new cluster
 	// is done elsewhere because it needs to happen later than where this function is called.
 	if (scheduler.getAllowLateMaterialize()) {
@@ -4083,6 +4308,53 @@ HandleFlushJobQueueLogTimer()
 	JobQueue->FlushLog();
 }
 
+bool
+JobQueueCommitAwaitsSync()
+{
+	return JobQueue && JobQueue->UnsyncedCommits() > 0;
+}
+
+static void
+HandleJobQueueLogSyncTimer()
+{
+	group_commit_timer_id = -1;
+	SyncJobQueueLog();
+}
+
+static void
+ScheduleJobQueueLogSync()
+{
+		// Sync the log once the commits that arrive in the window (or in
+		// this pass through the event loop, if the window is 0) are in it.
+	if( group_commit_timer_id == -1 ) {
+		group_commit_timer_id = daemonCore->Register_Timer(
+			group_commit_window,
+			HandleJobQueueLogSyncTimer,
+			"HandleJobQueueLogSyncTimer");
+	}
+}
+
+static void
+SyncJobQueueLog()
+{
+	if( JobQueue ) {
+		double begin = _condor_debug_get_time_double();
+		int commits = JobQueue->SyncLog();
+		if( commits ) {
+			scheduler.stats.JobQueueLogSyncBatch += commits;
+			scheduler.stats.JobQueueLogSyncTime += _condor_debug_get_time_double() - begin;
+		}
+	}
+
+		// everything committed so far is durable, so answer the
+		// clients that are waiting for it.
+	std::vector<QmgmtCommitWaiter*> waiters;
+	waiters.swap( group_commit_waiters );
+	for( std::vector<QmgmtCommitWaiter*>::iterator it = waiters.begin(); it != waiters.end(); ++it ) {
+		(*it)->committed();
+	}
+}
+
 int
 SetTimerAttribute( int cluster, int proc, const char *attr_name, int dur )
 {
@@ -4588,6 +4860,13 @@ CommitTransaction(SetAttributeFlags_t flags /* = 0 */,
 	}
 	else {
 		JobQueue->CommitTransaction();
+		if (JobQueue->UnsyncedCommits()) {
+			if ((long long)JobQueue->UnsyncedBytes() >= group_commit_max_bytes) {
+				SyncJobQueueLog();
+			} else {
+				ScheduleJobQueueLogSync();
+			}
+		}
 	}
 
 	// If the commit failed, we should never get here.
@@ -4700,6 +4979,8 @@ CommitTransaction(SetAttributeFlags_t flags /* = 0 */,
 
 					// Add the job to various runtime indexes for quick lookups
 				scheduler.indexAJob(procad, false);
+				scheduler.tallyJob(procad);
+				UpdateJobPrioRec(procad);
 
 				PostCommitJobFactoryProc(clusterad, procad);
 
@@ -5103,6 +5384,16 @@ DeleteAttribute(int cluster_id, int proc_id, const char *attr_name)
 
 	JobQueue->DeleteAttribute(key.c_str(), attr_name);
 
+	if (scheduler.isPeriodicExprInput(attr_name)) {
+		if (proc_id >= 0) {
+			scheduler.markPeriodicExprDirty(JOB_ID_KEY(cluster_id, proc_id));
+		} else if (JobQueueCluster * cad = GetClusterAd(cluster_id)) {
+			for (JobQueueJob * job = cad->FirstJob(); job; job = cad->NextJob(job)) {
+				scheduler.markPeriodicExprDirty(job->jid);
+			}
+		}
+	}
+
 	JobQueueDirty = true;
 
 	return 1;
@@ -6317,10 +6608,9 @@ int    last_autocluster_type=0;
 int    last_autocluster_classad_cache_hit=0;
 stats_entry_abs<int> SCGetAutoClusterType;
 
-// Returns cur_hosts so that another function in the scheduler can
-// update JobsRunning and keep the scheduler and queue manager
-// seperate. 
-int get_job_prio(JobQueueJob *job, const JOB_ID_KEY & jid, void *)
+// Fills in the priority record of the job, and returns false if the job
+// is not runnable, in which case it has no record.
+static bool get_job_prio_rec(JobQueueJob *job, const JOB_ID_KEY & jid, prio_rec & rec, int & cur_hosts)
 {
     int     job_prio, 
             pre_job_prio1, 
@@ -6330,7 +6620,6 @@ int get_job_prio(JobQueueJob *job, const JOB_ID_KEY & jid, void *)
     int     job_status;
     int     q_date;
     char    owner[100];
-    int     cur_hosts;
     int     max_hosts;
     int     niceUser;
     int     universe;
@@ -6384,10 +6673,10 @@ int get_job_prio(JobQueueJob *job, const JOB_ID_KEY & jid, void *)
 			job_status==REMOVED || job_status==COMPLETED ||
 			!service_this_universe(universe,job)) 
 	{
-        return cur_hosts;
+        return false;
 	}
 
-	// --- Insert this job into the PrioRec array ---
+	// --- Fill in the record of this job ---
 
        // If pre/post prios are not defined as forced attributes, set them to INT_MIN
 	// to flag priocompare routine to not use them.
@@ -6425,30 +6714,54 @@ int get_job_prio(JobQueueJob *job, const JOB_ID_KEY & jid, void *)
 		job->LookupString(ATTR_OWNER, powner, cremain);
 	}
 
-    PrioRec[N_PrioRecs].id             = jid;
-    PrioRec[N_PrioRecs].job_prio       = job_prio;
-    PrioRec[N_PrioRecs].pre_job_prio1  = pre_job_prio1;
-    PrioRec[N_PrioRecs].pre_job_prio2  = pre_job_prio2;
-    PrioRec[N_PrioRecs].post_job_prio1 = post_job_prio1;
-    PrioRec[N_PrioRecs].post_job_prio2 = post_job_prio2;
-    PrioRec[N_PrioRecs].status         = job_status;
-    PrioRec[N_PrioRecs].qdate          = q_date;
+    rec.id             = jid;
+    rec.job_prio       = job_prio;
+    rec.pre_job_prio1  = pre_job_prio1;
+    rec.pre_job_prio2  = pre_job_prio2;
+    rec.post_job_prio1 = post_job_prio1;
+    rec.post_job_prio2 = post_job_prio2;
+    rec.status         = job_status;
+    rec.qdate          = q_date;
 	if ( auto_id == -1 ) {
-		PrioRec[N_PrioRecs].auto_cluster_id = jid.cluster;
+		rec.auto_cluster_id = jid.cluster;
 	} else {
-		PrioRec[N_PrioRecs].auto_cluster_id = auto_id;
+		rec.auto_cluster_id = auto_id;
 	}
 
-	strcpy(PrioRec[N_PrioRecs].owner,owner);
+	strcpy(rec.owner,owner);
 
-    N_PrioRecs += 1;
-	if ( N_PrioRecs == MAX_PRIO_REC ) {
-		grow_prio_recs( 2 * N_PrioRecs );
-	}
+	return true;
+}
 
+// Returns cur_hosts so that another function in the scheduler can
+// update JobsRunning and keep the scheduler and queue manager
+// seperate. 
+int get_job_prio(JobQueueJob *job, const JOB_ID_KEY & jid, void *)
+{
+	prio_rec rec;
+	int cur_hosts = 0;
+	if (get_job_prio_rec(job, jid, rec, cur_hosts)) {
+		PrioRecs.update(rec);
+	}
 	return cur_hosts;
 }
 
+// Called when a job may have changed whether it is runnable, or its priority,
+// owner or autocluster.  Adds, moves or removes the record of the job in PrioRecs.
+void UpdateJobPrioRec(JobQueueJob *job)
+{
+	if ( ! job || job->jid.cluster <= 0 || job->jid.proc < 0) {
+		return;
+	}
+	prio_rec rec;
+	int cur_hosts = 0;
+	if (get_job_prio_rec(job, job->jid, rec, cur_hosts)) {
+		PrioRecs.update(rec);
+	} else {
+		PrioRecs.remove(job->jid);
+	}
+}
+
 bool
 jobLeaseIsValid( ClassAd* job, int cluster, int proc )
 {
@@ -6777,8 +7090,10 @@ void load_job_factories()
 
 
 void DirtyPrioRecArray() {
-		// Mark the PrioRecArray as stale. This will trigger a rebuild,
-		// though possibly not immediately.
+		// Mark the PrioRecs as stale. This will trigger a rebuild,
+		// though possibly not immediately.  This is only needed when
+		// something that UpdateJobPrioRec() does not see has changed,
+		// such as the attributes the autoclusters are made from.
 	PrioRecArrayIsDirty = true;
 }
 
@@ -6787,7 +7102,6 @@ void DirtyPrioRecArray() {
 schedd_runtime_probe BuildPrioRec_runtime;
 schedd_runtime_probe BuildPrioRec_mark_runtime;
 schedd_runtime_probe BuildPrioRec_walk_runtime;
-schedd_runtime_probe BuildPrioRec_sort_runtime;
 schedd_runtime_probe BuildPrioRec_sweep_runtime;
 
 static void DoBuildPrioRecArray() {
@@ -6796,22 +7110,10 @@ static void DoBuildPrioRecArray() {
 	scheduler.autocluster.mark();
 	BuildPrioRec_mark_runtime += rt.tick(now);
 
-	N_PrioRecs = 0;
+	PrioRecs.clear();
 	WalkJobQueue(get_job_prio);
 	BuildPrioRec_walk_runtime += rt.tick(now);
 
-		// N_PrioRecs might be 0, if we have no jobs to run at the
-		// moment.  If so, we don't want to call qsort(), since that's
-		// bad.  We can still try to find the owner in the Owners
-		// array, since that's not that expensive, and we need it for
-		// all the flocking logic at the end of this function.
-		// Discovered by Derek Wright and insure-- on 2/28/01
-	if( N_PrioRecs ) {
-		qsort( (char *)PrioRec, N_PrioRecs, sizeof(PrioRec[0]),
-			   (int(*)(const void*, const void*))prio_compar );
-		BuildPrioRec_sort_runtime += rt.tick(now);
-	}
-
 	scheduler.autocluster.sweep();
 	BuildPrioRec_sweep_runtime += rt.tick(now);
 
@@ -6821,33 +7123,23 @@ static void DoBuildPrioRecArray() {
 }
 
 /*
- * Build an array of runnable jobs sorted by priority.  If there are
- * a lot of jobs in the queue, this can be expensive, so avoid building
- * the array too often.
+ * Rebuild the index of runnable jobs sorted by priority, if it needs it.
+ * The index is kept up to date as jobs change, so it needs it only when
+ * DirtyPrioRecArray() was called, or every PrioRecGarbageCollectInterval
+ * so that the autoclusters no job is in are cleaned up.  If there are
+ * a lot of jobs in the queue, this can be expensive, so avoid rebuilding
+ * it too often.
  * Arguments:
  *   no_match_found - caller can't find a runnable job matching
  *                    the requirements of an available startd, so
  *                    consider rebuilding the list sooner
  * Returns:
- *   true if the array was rebuilt; false otherwise
+ *   true if the index was rebuilt; false otherwise
  */
 bool BuildPrioRecArray(bool no_match_found /*default false*/) {
 
-		// caller expects PrioRecAutoClusterRejected to be instantiated
-		// (and cleared)
-	int hash_size = TotalJobsCount/4+1000;
-	if( PrioRecAutoClusterRejected &&
-	    PrioRecAutoClusterRejected->getTableSize() < 0.8*hash_size )
-	{
-		delete PrioRecAutoClusterRejected;
-		PrioRecAutoClusterRejected = NULL;
-	}
-	if( ! PrioRecAutoClusterRejected ) {
-		PrioRecAutoClusterRejected = new HashTable<int,int>(hash_size,hashFuncInt,rejectDuplicateKeys);
-		ASSERT( PrioRecAutoClusterRejected );
-	}
-	else {
-		PrioRecAutoClusterRejected->clear();
+	if( !PrioRecArrayIsDirty && time(NULL) - PrioRecLastRebuild >= PrioRecGarbageCollectInterval ) {
+		PrioRecArrayIsDirty = true;
 	}
 
 	if( !PrioRecArrayIsDirty ) {
@@ -6878,6 +7170,7 @@ bool BuildPrioRecArray(bool no_match_found /*default false*/) {
 
 	PrioRecArrayTimeslice.setStartTimeNow();
 	PrioRecArrayIsDirty = false;
+	PrioRecLastRebuild = time(NULL);
 
 	DoBuildPrioRecArray();
 
@@ -6890,6 +7183,13 @@ bool BuildPrioRecArray(bool no_match_found /*default false*/) {
 	return true;
 }
 
+static void AddPrioRecCursors(const PrioRecIndex::Submitter & sub, PrioRecQueue & cursors)
+{
+	for (PrioRecIndex::AutoClusters::const_iterator it = sub.autoclusters.begin(); it != sub.autoclusters.end(); ++it) {
+		cursors.add(it->second);
+	}
+}
+
 /*
  * Find the job with the highest priority that matches with
  * my_match_ad (which is a startd ad).  If user is NULL, get a job for
@@ -6898,7 +7198,7 @@ bool BuildPrioRecArray(bool no_match_found /*default false*/) {
 void FindRunnableJob(PROC_ID & jobid, ClassAd* my_match_ad, 
 					 char const * user)
 {
-	ClassAd				*ad;
+	JobQueueJob			*ad;
 
 	if (user && (strlen(user) == 0)) {
 		user = NULL;
@@ -6914,7 +7214,6 @@ void FindRunnableJob(PROC_ID & jobid, ClassAd* my_match_ad,
 
 	MyString owner = user;
 	int at_sign_pos;
-	int i;
 
 		// We have been passed user, which is owner@uid.  We want just
 		// owner, place a NULL at the '@'.
@@ -6926,60 +7225,69 @@ void FindRunnableJob(PROC_ID & jobid, ClassAd* my_match_ad,
 
 	bool rebuilt_prio_rec_array = BuildPrioRecArray();
 
-		// Iterate through the most recently constructed list of
-		// jobs, nicely pre-sorted in priority order.
-
 	do {
-		for (i=0; i < N_PrioRecs; i++) {
-
-			if ( PrioRec[i].owner[0] == '\0' ) {
-					// This record has been disabled, because it is no longer
-					// runnable.
-				continue;
+			// Start with the best job of each autocluster, and try the
+			// best of those.  A job that can't be used is replaced by the
+			// next job in its autocluster, but when a job doesn't match
+			// the machine, we assume that none of the other jobs in its
+			// autocluster will match either, and drop the autocluster.
+		PrioRecQueue cursors;
+		std::set<int> rejected_autoclusters;
+		if ( match_any_user ) {
+			const PrioRecIndex::Submitters & subs = PrioRecs.submitters();
+			for (PrioRecIndex::Submitters::const_iterator it = subs.begin(); it != subs.end(); ++it) {
+				AddPrioRecCursors(it->second, cursors);
+			}
+		} else {
+			const PrioRecIndex::Submitter * sub = PrioRecs.submitter(owner.Value());
+			if (sub) {
+				AddPrioRecCursors(*sub, cursors);
 			}
+		}
+
+		while ( ! cursors.empty()) {
 
-			if ( !match_any_user && strcmp(PrioRec[i].owner,owner.Value()) != 0 ) {
-					// Owner doesn't match.
+			PrioRecQueue::Cursor next = cursors.top();
+			cursors.pop();
+			PROC_ID id = (*next.it)->id;
+			int auto_cluster_id = (*next.it)->auto_cluster_id;
+
+			if ( rejected_autoclusters.count(auto_cluster_id) ) {
+					// We have already failed to match a job from this same
+					// autocluster (of another user) with this machine.
 				continue;
 			}
 
-			ad = GetJobAd( PrioRec[i].id.cluster, PrioRec[i].id.proc );
+				// the next job in this autocluster, to try if this one
+				// can't be used for some reason other than not matching.
+				// the cursor is put back before the record of this job
+				// is changed, which can't remove the autocluster since
+				// there are more jobs in it.
+			bool more_in_autocluster = ++next.it != next.end;
+
+			ad = GetJobAd( id.cluster, id.proc );
 			if (!ad) {
-					// This ad must have been deleted since we last built
-					// runnable job list.
+					// This ad must have been deleted since its record
+					// was last updated.
+				if (more_in_autocluster) { cursors.push(next); }
+				PrioRecs.remove(id);
 				continue;
 			}	
 
-			int junk; // don't care about the value
-			if ( PrioRecAutoClusterRejected->lookup( PrioRec[i].auto_cluster_id, junk ) == 0 ) {
-					// We have already failed to match a job from this same
-					// autocluster with this machine.  Skip it.
-				continue;
-			}
-
-			int isRunnable = Runnable(&PrioRec[i].id);
-			int isMatched = scheduler.AlreadyMatched(&PrioRec[i].id);
+			int isRunnable = Runnable(&id);
+			int isMatched = scheduler.AlreadyMatched(&id);
 			if( !isRunnable || isMatched ) {
-					// This job's status must have changed since the
-					// time it was added to the runnable job list.
-					// Prevent this job from being considered in any
-					// future iterations through the list.
-				PrioRec[i].owner[0] = '\0';
+					// This job's status must have changed since its
+					// record was last updated, or it is already matched,
+					// which can change without the job changing, so it
+					// keeps its record.
+				if (more_in_autocluster) { cursors.push(next); }
 				dprintf(D_FULLDEBUG,
-						"record for job %d.%d skipped until PrioRec rebuild (%s)\n",
-						jobid.cluster, jobid.proc, isRunnable ? "already matched" : "no longer runnable");
-
-					// Ensure that PrioRecArray is rebuilt
-					// eventually, because changes in the status
-					// of AlreadyMatched() can happen without
-					// changes to the status of the job, (not the
-					// normal case, but still possible) so the
-					// dirty flag may not get set when the job
-					// is no longer AlreadyMatched() unless we
-					// set it here and keep rebuilding the array.
-				DirtyPrioRecArray();
-
-					// Move along to the next job in the prio rec array
+						"record for job %d.%d skipped (%s)\n",
+						id.cluster, id.proc, isRunnable ? "already matched" : "no longer runnable");
+				if ( ! isRunnable) {
+					UpdateJobPrioRec(ad);
+				}
 				continue;
 			}
 
@@ -6992,8 +7300,7 @@ void FindRunnableJob(PROC_ID & jobid, ClassAd* my_match_ad,
 					// THIS IS A DANGEROUS ASSUMPTION - what if this job is no longer
 					// part of this autocluster?  TODO perhaps we should verify this
 					// job is still part of this autocluster here.
-				PrioRecAutoClusterRejected->insert( PrioRec[i].auto_cluster_id, 1 );
-					// Move along to the next job in the prio rec array
+				rejected_autoclusters.insert( auto_cluster_id );
 				continue;
 			}
 
@@ -7013,6 +7320,7 @@ void FindRunnableJob(PROC_ID & jobid, ClassAd* my_match_ad,
 				if( my_match_ad->EvalFloat(ATTR_RANK, ad, new_startd_rank) )
 				{
 					if( new_startd_rank < current_startd_rank ) {
+						if (more_in_autocluster) { cursors.push(next); }
 						continue;
 					}
 				}
@@ -7044,16 +7352,15 @@ void FindRunnableJob(PROC_ID & jobid, ClassAd* my_match_ad,
 					dprintf(D_FULLDEBUG,
 							"ConcurrencyLimits do not match, cannot "
 							"reuse claim\n");
-					PrioRecAutoClusterRejected->
-						insert(PrioRec[i].auto_cluster_id, 1);
+					rejected_autoclusters.insert( auto_cluster_id );
 					continue;
 				}
 			}
 
-			jobid = PrioRec[i].id; // success!
+			jobid = id; // success!
 			return;
 
-		}	// end of for loop through PrioRec array
+		}	// end of loop through the autoclusters
 
 		if(rebuilt_prio_rec_array) {
 				// We found nothing, and we had a freshly built job list.
@@ -7140,43 +7447,17 @@ int Runnable(PROC_ID* id)
 // use the function prio_compar. By runnable I mean that its status is IDLE.
 void FindPrioJob(PROC_ID & job_id)
 {
-	int			i;								// iterator over all prio rec
-	int			flag = FALSE;
-
-	// Compare each job in the priority record list with the first job in the
-	// list. If the first job is of lower priority, replace the first job with
-	// the job it is compared against.
-	if(!Runnable(&PrioRec[0].id))
-	{
-		for(i = 1; i < N_PrioRecs; i++)
-		{
-			if(Runnable(&PrioRec[i].id))
-			{
-				PrioRec[0] = PrioRec[i];
-				flag = TRUE;
-				break;
-			}
-		}
-		if(!flag)
-		{
-			job_id.proc = -1;
+	PrioRecQueue prio_queue;
+	prio_queue.add(PrioRecs.all());
+	const prio_rec * prec;
+	while ((prec = prio_queue.next())) {
+		PROC_ID id = prec->id;
+		if (Runnable(&id)) {
+			job_id = id;
 			return;
 		}
 	}
-	for(i = 1; i < N_PrioRecs; i++)
-	{
-		if( (PrioRec[0].id.proc == PrioRec[i].id.proc) &&
-			(PrioRec[0].id.cluster == PrioRec[i].id.cluster) )
-		{
-			continue;
-		}
-		if(prio_compar(&PrioRec[0], &PrioRec[i])!=-1&&Runnable(&PrioRec[i].id))
-		{
-			PrioRec[0] = PrioRec[i];
-		}
-	}
-	job_id.proc = PrioRec[0].id.proc;
-	job_id.cluster = PrioRec[0].id.cluster;
+	job_id.proc = -1;
 }
 
 void
@@ -126,6 +126,42 @@ private:
 };
 	
 
+// what a job adds to the job counts of the schedd, its owner and its submitter.
+// Scheduler::tallyJob() takes the old tally of a job out of the counts and puts
+// the new one in whenever an attribute that the counts depend on is committed.
+struct JobTally {
+	struct OwnerInfo * ownerinfo;
+	struct SubmitterData * submitterdata;
+	bool counted;      // false if the job is not counted at all (no owner, no status or a no-op job)
+	bool revisit;      // count_jobs() must still look at this job, see count_a_job_extras()
+	bool has_prio;     // job wants a match, so prio goes into the submitter's PrioSet
+	int  prio;
+	int  idle;         // schedd wide JobsIdle, JobsRunning, JobsHeld & JobsRemoved
+	int  running;
+	int  held;
+	int  removed;
+	int  sched_idle;   // scheduler universe jobs (by host)
+	int  sched_running;
+	int  local_idle;   // local universe jobs (by host)
+	int  local_running;
+	int  user_idle;    // owner & submitter JobsIdle, only for jobs this schedd services
+	int  user_held;
+	int  weighted_idle;
+	JobTally() { clear(); }
+	void clear() { memset(this, 0, sizeof(*this)); }
+	bool operator==(const JobTally & rhs) const {
+		return ownerinfo == rhs.ownerinfo && submitterdata == rhs.submitterdata
+			&& counted == rhs.counted && revisit == rhs.revisit
+			&& has_prio == rhs.has_prio && (prio == rhs.prio || ! has_prio)
+			&& idle == rhs.idle && running == rhs.running
+			&& held == rhs.held && removed == rhs.removed
+			&& sched_idle == rhs.sched_idle && sched_running == rhs.sched_running
+			&& local_idle == rhs.local_idle && local_running == rhs.local_running
+			&& user_idle == rhs.user_idle && user_held == rhs.user_held
+			&& weighted_idle == rhs.weighted_idle;
+	}
+};
+
 // used to store a ClassAd + runtime information in a condor hashtable.
 class JobQueueJob : public ClassAd {
 public:
@@ -136,6 +172,7 @@ protected:
 	char has_noop_attr; // 1 if job has ATTR_JOB_NOOP
 	char status;        // this is in sync with committed job status and used when tracking job counts by state
 public:
+	char retired;       // removed from the job queue, but not yet freed because a job queue snapshot may refer to it
 	int dirty_flags;	// one or more of JQJ_CHACHE_DIRTY_ flags indicating that the job ad differs from the JobQueueJob 
 	int spare;
 	int autocluster_id;
@@ -144,6 +181,7 @@ public:
 	// DO NOT FREE FROM HERE!
 	struct SubmitterData * submitterdata;
 	struct OwnerInfo * ownerinfo;
+	JobTally tally; // what this job currently adds to the job counts, see Scheduler::tallyJob()
 protected:
 	JobQueueCluster * parent; // job pointer back to the 
 	qelm qe;
@@ -155,6 +193,7 @@ public:
 		, universe(0)
 		, has_noop_attr(2) // value of 2 forces IsNoopJob() to populate this field
 		, status(0) // JOB_STATUS_MIN
+		, retired(0)
 		, dirty_flags(0)
 		, spare(0)
 		, autocluster_id(0)
@@ -229,6 +268,9 @@ public:
 		job->parent = NULL;
 	}
 	bool HasAttachedJobs() { return ! qe.empty(); }
+	// iterate the jobs attached to this cluster
+	JobQueueJob * FirstJob() { return (qe.next() == &qe) ? NULL : qe.next()->as<JobQueueJob>(); }
+	JobQueueJob * NextJob(JobQueueJob * job) { return (job->qe.next() == &qe) ? NULL : job->qe.next()->as<JobQueueJob>(); }
 	void DetachAllJobs(); // When you absolutely positively need to free this class...
 };
 
@@ -264,6 +306,12 @@ void SetMaxHistoricalLogs(int max_historical_logs);
 time_t GetOriginalJobQueueBirthdate();
 void DestroyJobQueue( void );
 int handle_q(Service *, int, Stream *sock);
+
+// returned by do_Q_request() when a durable commit succeeded, but the reply
+// has to wait for the group commit of the job queue log.  handle_q sends it.
+#define QMGMT_AWAIT_GROUP_COMMIT 1
+// true if the last commit is waiting for the group commit of the log
+bool JobQueueCommitAwaitsSync();
 void dirtyJobQueue( void );
 bool SendDirtyJobAdNotification(const PROC_ID& job_id);
 
@@ -416,6 +464,13 @@ typedef ClassAdLog<JOB_ID_KEY, const char*,JobQueueJob*> JobQueueLogType;
 JobQueueLogType::filter_iterator GetJobQueueIterator(const classad::ExprTree &requirements, int timeslice_ms);
 JobQueueLogType::filter_iterator GetJobQueueIteratorEnd();
 
+// A job queue snapshot is the list of job ads (and cluster ads, if asked for) in the queue
+// when it was taken, for the query threads to read.  Ads that are removed from the job queue
+// while snapshots are open are marked retired and not freed until the last snapshot that
+// could refer to them has ended.  Begin and end are called on the main thread.
+unsigned long BeginJobQueueSnapshot(std::vector<JobQueueJob*> & jobs, int iter_opts);
+void EndJobQueueSnapshot(unsigned long token);
+
 
 class schedd_runtime_probe;
 typedef int (*queue_classad_scan_func)(ClassAd *ad, void* user);
@@ -446,10 +501,8 @@ bool OwnerCheck(int,int);
 
 
 // priority records
-extern prio_rec *PrioRec;
-extern int N_PrioRecs;
-extern HashTable<int,int> *PrioRecAutoClusterRejected;
-extern int grow_prio_recs(int);
+extern PrioRecIndex PrioRecs;
+extern void UpdateJobPrioRec(JobQueueJob * job);
 
 extern void	FindRunnableJob(PROC_ID & jobid, ClassAd* my_match_ad, char const * user);
 extern int Runnable(PROC_ID*);
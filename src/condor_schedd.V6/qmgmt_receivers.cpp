@@ -611,6 +611,12 @@ do_Q_request(ReliSock *syscall_sock,bool &may_fork)
 		terrno = errno;
 		dprintf( D_SYSCALLS, "\tflags = %d, rval = %d, errno = %d\n", flags, rval, terrno );
 
+		if( rval >= 0 && !(flags & NONDURABLE) && JobQueueCommitAwaitsSync() ) {
+				// the transaction is in the log, but not yet synced.
+				// handle_q sends the reply once it is.
+			return QMGMT_AWAIT_GROUP_COMMIT;
+		}
+
 		syscall_sock->encode();
 		assert( syscall_sock->code(rval) );
 		if( rval < 0 ) {
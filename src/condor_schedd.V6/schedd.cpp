@@ -110,6 +110,7 @@ char const * const HOME_POOL_SUBMITTER_TAG = "";
 extern GridUniverseLogic* _gridlogic;
 
 #include "qmgmt.h"
+#include "schedd_query_threads.h"
 #include "condor_qmgr.h"
 #include "condor_vm_universe_types.h"
 #include "enum_utils.h"
@@ -122,7 +123,6 @@ extern "C"
 	int FileExists(const char *, const char *);
 	int getdtablesize();
 */
-	int prio_compar(prio_rec*, prio_rec*);
 }
 
 extern char* Spool;
@@ -147,9 +147,7 @@ extern DedicatedScheduler dedicated_scheduler;
 extern FILESQL *FILEObj;
 
 // priority records
-extern prio_rec *PrioRec;
-extern int N_PrioRecs;
-extern int grow_prio_recs(int);
+extern PrioRecIndex PrioRecs;
 
 // These functions are defined in qmgmt.cpp.
 // We don't have a good schedd-internal header file, so we declare them
@@ -177,12 +175,15 @@ bool jobCleanupNeedsThread( int cluster, int proc );
 bool jobExternallyManaged(ClassAd * ad);
 bool jobManagedDone(ClassAd * ad);
 int  count_a_job( JobQueueJob *job, const JOB_ID_KEY& jid, void* user);
+int  count_a_job_extras( JobQueueJob *job, const JOB_ID_KEY& jid, void* user);
+void tally_a_job( JobQueueJob *job, JobTally & tally );
 void mark_jobs_idle();
 void load_job_factories();
 static void WriteCompletionVisa(ClassAd* ad);
 
 schedd_runtime_probe WalkJobQ_check_for_spool_zombies_runtime;
 schedd_runtime_probe WalkJobQ_count_a_job_runtime;
+schedd_runtime_probe WalkJobQ_count_a_job_extras_runtime;
 schedd_runtime_probe WalkJobQ_PeriodicExprEval_runtime;
 schedd_runtime_probe WalkJobQ_clear_autocluster_id_runtime;
 schedd_runtime_probe WalkJobQ_find_idle_local_jobs_runtime;
@@ -654,6 +655,9 @@ Scheduler::Scheduler() :
 
 	NumSubmitters = 0;
 	NegotiationRequestTime = 0;
+	jobTalliesAuditDue = true;
+	lastJobTalliesAudit = 0;
+	JobCountsAuditInterval = 0;
 
 		//gotiator = NULL;
 	CondorAdministrator = NULL;
@@ -679,6 +683,8 @@ Scheduler::Scheduler() :
 	timeoutid = -1;
 	startjobsid = -1;
 	periodicid = -1;
+	m_periodicExprUseDeps = false;
+	m_periodicExprFullSweep = true;
 
 #ifdef HAVE_EXT_POSTGRESQL
 	quill_enabled = FALSE;
@@ -717,6 +723,11 @@ Scheduler::Scheduler() :
     m_userlog_file_cache_clear_last = time(NULL);
     m_userlog_file_cache_clear_interval = 60;
 
+	m_userlog_batch_enabled = false;
+	m_userlog_batch_window = 0;
+	m_userlog_batch_max_bytes = 0;
+	m_userlog_batch_tid = -1;
+
 	jobThrottleNextJobDelay = 0;
 #ifdef HAVE_EXT_POSTGRESQL
 	prevLHF = 0;
@@ -830,6 +841,10 @@ Scheduler::~Scheduler()
 		free(m_unparsed_gridman_selection_expr);
 	}
 
+	if ( m_userlog_batch_tid != -1 && daemonCore ) {
+		daemonCore->Cancel_Timer(m_userlog_batch_tid);
+	}
+	m_userlog_batch.flush();
     userlog_file_cache_clear(true);
 
 		//
@@ -1167,6 +1182,28 @@ void Scheduler::userlog_file_cache_clear(bool force) {
 }
 
 
+void Scheduler::userlogBatchTimer() {
+	m_userlog_batch_tid = -1;
+	FlushUserLogs();
+}
+
+
+void Scheduler::FlushUserLogs() {
+	if (m_userlog_batch_tid != -1) {
+		daemonCore->Cancel_Timer(m_userlog_batch_tid);
+		m_userlog_batch_tid = -1;
+	}
+	if (m_userlog_batch.empty()) return;
+
+	double begin = _condor_debug_get_time_double();
+	double max_wait = 0.0;
+	int events = m_userlog_batch.flush(&max_wait);
+	stats.UserLogBatchEvents += events;
+	stats.UserLogBatchWait += max_wait;
+	stats.UserLogBatchFlushTime += _condor_debug_get_time_double() - begin;
+}
+
+
 void Scheduler::userlog_file_cache_erase(const int& cluster, const int& proc) {
     // only if caching is turned on
     if (m_userlog_file_cache_max <= 0) return;
@@ -1216,32 +1253,47 @@ Scheduler::count_jobs()
 	time_t AbsentSubmitterUpdateRate = param_integer("ABSENT_SUBMITTER_UPDATE_RATE", 60*5); // 5 min
 	time_t AbsentOwnerLifetime = param_integer("ABSENT_OWNER_LIFETIME", 60*5);
 
-	JobsRunning = 0;
-	JobsIdle = 0;
-	JobsHeld = 0;
-	JobsTotalAds = 0;
+	time_t current_time = time(0);
+
+		// the job counts are kept up to date by tallyJob() as jobs change,
+		// so we walk the job queue only now and then to audit them.
+	if (jobTalliesAuditDue || JobCountsAuditInterval <= 0 ||
+		current_time - lastJobTalliesAudit >= JobCountsAuditInterval) {
+		auditJobTallies();
+	}
+
+	JobsRunning = jobTallies.JobsRunning;
+	JobsIdle = jobTallies.JobsIdle;
+	JobsHeld = jobTallies.JobsHeld;
+	JobsTotalAds = jobTallies.JobsTotalAds;
 	JobsFlocked = 0;
-	JobsRemoved = 0;
-	SchedUniverseJobsIdle = 0;
-	SchedUniverseJobsRunning = 0;
-	LocalUniverseJobsIdle = 0;
-	LocalUniverseJobsRunning = 0;
+	JobsRemoved = jobTallies.JobsRemoved;
+	SchedUniverseJobsIdle = jobTallies.SchedUniverseJobsIdle;
+	SchedUniverseJobsRunning = jobTallies.SchedUniverseJobsRunning;
+	LocalUniverseJobsIdle = jobTallies.LocalUniverseJobsIdle;
+	LocalUniverseJobsRunning = jobTallies.LocalUniverseJobsRunning;
 	stats.JobsRunning = 0;
 	stats.JobsRunningRuntimes = 0;
 	stats.JobsRunningSizes = 0;
 	scheduler.OtherPoolStats.ResetJobsRunning();
 
-	time_t current_time = time(0);
-
 	for (OwnerInfoMap::iterator it = OwnersInfo.begin(); it != OwnersInfo.end(); ++it) {
 		OwnerInfo & Owner = it->second;
-		Owner.num.clear_counters();	// clear the jobs counters 
+		Owner.num = Owner.tallied;	// reset the jobs counters to the tallied counts
+		if (Owner.num.Hits > 0) Owner.LastHitTime = current_time;
 	}
 
+	bool use_global_job_prios = param_boolean("USE_GLOBAL_JOB_PRIOS",false);
 	for (SubmitterDataMap::iterator it = Submitters.begin(); it != Submitters.end(); ++it) {
 		SubmitterData & SubDat = it->second;
-		SubDat.num.clear_job_counters();	// clear the jobs counters 
+		SubDat.num = SubDat.tallied;	// reset the jobs counters to the tallied counts
+		if (SubDat.num.Hits > 0) SubDat.LastHitTime = current_time;
 		SubDat.PrioSet.clear();
+		if (use_global_job_prios) {
+			for (std::map<int,int>::const_iterator pit = SubDat.PrioCounts.begin(); pit != SubDat.PrioCounts.end(); ++pit) {
+				SubDat.PrioSet.insert(pit->first);
+			}
+		}
 	}
 
 	GridJobOwners.clear();
@@ -1250,9 +1302,19 @@ Scheduler::count_jobs()
 		// job cluster ids, since we're about to re-create it.
 	dedicated_scheduler.clearDedicatedClusters();
 
-		// inserts/finds an entry in Owners for each job
-		// updates SubmitterCounters: Hits, JobsIdle, WeightedJobsIdle & JobsHeld
-	WalkJobQueue(count_a_job);
+		// finish no-op jobs, and count the things that can't be tallied:
+		// running job statistics, grid jobs and idle dedicated clusters.
+		// only the jobs that are marked for a revisit need this, unless
+		// some of the other pool stats have to look at every job.
+	if (OtherPoolStats.AnyEnabled()) {
+		WalkJobQueue(count_a_job_extras);
+	} else {
+		// copy the set, since finishing a no-op job changes it.
+		std::vector<JOB_ID_KEY> revisit(jobsToRevisit.begin(), jobsToRevisit.end());
+		for (std::vector<JOB_ID_KEY>::const_iterator it = revisit.begin(); it != revisit.end(); ++it) {
+			count_a_job_extras(GetJobAd(it->cluster, it->proc), *it, NULL);
+		}
+	}
 
 	if( dedicated_scheduler.hasDedicatedClusters() ) {
 			// We found some dedicated clusters to service.  Wake up
@@ -1372,13 +1434,6 @@ Scheduler::count_jobs()
 	dprintf( D_FULLDEBUG, "MaxJobsRunning = %d\n", MaxJobsRunning );
 	dprintf( D_FULLDEBUG, "MaxRunningSchedulerJobsPerOwner = %d\n", MaxRunningSchedulerJobsPerOwner );
 
-	// later when we compute job priorities, we will need PrioRec
-	// to have as many elements as there are jobs in the queue.  since
-	// we just counted the jobs, lets make certain that PrioRec is 
-	// large enough.  this keeps us from guessing to small and constantly
-	// growing PrioRec... Add 5 just to be sure... :^) -Todd 8/97
-	grow_prio_recs( JobsRunning + JobsIdle + 5 );
-	
 	cad->Assign(ATTR_NUM_USERS, NumSubmitters);
 	cad->Assign(ATTR_NUM_OWNERS, NumUniqueOwners);
 	cad->Assign(ATTR_MAX_JOBS_RUNNING, MaxJobsRunning);
@@ -2081,7 +2136,7 @@ void LiveJobCounters::publish(ClassAd & ad, const char * prefix)
 }
 
 static bool
-sendDone(Stream *stream, bool send_job_counts, LiveJobCounters* query_counts, const char * myname, LiveJobCounters* my_counts)
+sendDone(Stream *stream, bool send_job_counts, LiveJobCounters* query_counts, const char * myname, LiveJobCounters* my_counts, LiveJobCounters* all_counts=NULL)
 {
 	ClassAd ad;
 	ad.Assign(ATTR_OWNER, 0);
@@ -2089,7 +2144,9 @@ sendDone(Stream *stream, bool send_job_counts, LiveJobCounters* query_counts, co
 
 	if (send_job_counts) {
 		ad.Assign(ATTR_MY_TYPE, "Summary");
-		scheduler.liveJobCounts.publish(ad, "Allusers");
+		// all_counts is the counts as of a job queue snapshot, for the query threads
+		if (all_counts) { all_counts->publish(ad, "Allusers"); }
+		else { scheduler.liveJobCounts.publish(ad, "Allusers"); }
 		if (query_counts) { query_counts->publish(ad, NULL); }
 		if (my_counts) { my_counts->publish(ad, "My"); }
 	}
@@ -2239,6 +2296,231 @@ QueryJobAdsContinuation::finish(Stream *stream) {
 	return KEEP_STREAM;
 }
 
+// When SCHEDD_QUERY_WORKERS_USE_THREADS is true, job queries are answered by
+// query threads instead of forked query workers.  The main thread takes a
+// snapshot of the job queue and hands it to a query thread, which evaluates
+// the requirements and copies the ads that match while the main thread waits
+// in select (see schedd_query_threads.h), and then sends the copies.
+struct QueryJobAdsThreadContext {
+	ReliSock * sock;
+	classad::ExprTree * requirements; // a private copy, safe to evaluate on the query thread
+	classad::References projection;
+	LiveJobCounters query_job_counts;
+	LiveJobCounters all_job_counts;
+	LiveJobCounters my_job_counts;
+	std::string my_name;
+	std::vector<JobQueueJob*> jobs;
+	unsigned long snapshot;
+	int match_limit;
+	bool summary_only;
+	int return_status;
+};
+
+static bool use_query_threads = false;  // from config file, only read at startup
+static ScheddQueryThreads * query_threads = NULL;
+static int active_query_threads = 0;
+static int query_thread_slice_ms = 10;
+
+// make a copy of an expression that does not share anything with the original,
+// the copies made by the ClassAd cache share the cache entry, which is not thread safe.
+static classad::ExprTree * copy_expr_for_thread(classad::ExprTree * tree)
+{
+	return SkipExprEnvelope(tree)->Copy();
+}
+
+// copy the attributes of a job that the query will send. called on a query thread
+// between JobQueueReadBegin() and JobQueueReadEnd().  whitelist is set to the
+// projection plus the attributes it refers to, as putClassAd would do.
+static ClassAd * copy_job_for_query(JobQueueJob * job, const classad::References & projection, classad::References & whitelist)
+{
+	ClassAd * ad = new ClassAd();
+	whitelist.clear();
+	if (projection.empty()) {
+		classad::ClassAd * parent = job->GetChainedParentAd();
+		if (parent) {
+			for (classad::ClassAd::iterator it = parent->begin(); it != parent->end(); ++it) {
+				ad->classad::ClassAd::Insert(it->first, copy_expr_for_thread(it->second));
+			}
+		}
+		for (classad::ClassAd::iterator it = job->begin(); it != job->end(); ++it) {
+			ad->classad::ClassAd::Insert(it->first, copy_expr_for_thread(it->second));
+		}
+		return ad;
+	}
+
+	for (classad::References::const_iterator attr = projection.begin(); attr != projection.end(); ++attr) {
+		classad::ExprTree * tree = job->Lookup(*attr);
+		if (tree) {
+			whitelist.insert(*attr);
+			if (tree->GetKind() != classad::ExprTree::LITERAL_NODE) {
+				job->GetInternalReferences(tree, whitelist, false);
+			}
+		}
+	}
+	for (classad::References::const_iterator attr = whitelist.begin(); attr != whitelist.end(); ++attr) {
+		classad::ExprTree * tree = job->Lookup(*attr);
+		if (tree) { ad->classad::ClassAd::Insert(*attr, copy_expr_for_thread(tree)); }
+	}
+	// these are sent after the attributes, whether projected or not
+	const char * types[] = { ATTR_MY_TYPE, ATTR_TARGET_TYPE };
+	for (size_t ii = 0; ii < COUNTOF(types); ++ii) {
+		classad::ExprTree * tree = job->Lookup(types[ii]);
+		if (tree) { ad->classad::ClassAd::Insert(types[ii], copy_expr_for_thread(tree)); }
+	}
+	return ad;
+}
+
+// same test as the job queue filter_iterator
+static bool threaded_query_match(classad::ExprTree * requirements, JobQueueJob * job)
+{
+	const classad::ClassAd * old_scope = requirements->GetParentScope();
+	requirements->SetParentScope(job);
+	classad::Value result;
+	int retval = requirements->Evaluate(result);
+	requirements->SetParentScope(old_scope);
+	if ( ! retval) {
+		return false;
+	}
+	bool boolVal;
+	int intVal;
+	return (result.IsBooleanValue(boolVal) && boolVal) || (result.IsIntegerValue(intVal) && intVal);
+}
+
+// Answer a job query on a query thread.  the ads are read in batches, each
+// batch holds the job queue for at most SCHEDD_QUERY_THREAD_SLICE milliseconds,
+// and is sent after letting go of it.
+static void threaded_query_work(void * in_ctx)
+{
+	QueryJobAdsThreadContext * ctx = (QueryJobAdsThreadContext *)in_ctx;
+	ReliSock * sock = ctx->sock;
+
+	std::vector<ClassAd*> batch;
+	std::vector<classad::References> whitelists;
+	size_t ix = 0;
+	int match_count = 0;
+	bool failed = false;
+
+	while ( ! failed && ix < ctx->jobs.size()) {
+		if (ctx->match_limit >= 0 && match_count >= ctx->match_limit) {
+			break;
+		}
+		if (query_threads->stopping()) {
+			ctx->return_status = FALSE;
+			return;
+		}
+
+		JobQueueReadBegin();
+		Stopwatch sw;
+		sw.start();
+		int num_seen = 0;
+		while (ix < ctx->jobs.size()) {
+			if ((++num_seen % 100 == 0) && (sw.get_ms() > query_thread_slice_ms)) {
+				break;
+			}
+			JobQueueJob * job = ctx->jobs[ix++];
+			if (job->retired || ! threaded_query_match(ctx->requirements, job)) {
+				continue;
+			}
+			IncrementLiveJobCounter(ctx->query_job_counts, job->Universe(), job->Status(), 1);
+			if ( ! ctx->summary_only) {
+				whitelists.resize(batch.size() + 1);
+				batch.push_back(copy_job_for_query(job, ctx->projection, whitelists.back()));
+			}
+			match_count++;
+			if (ctx->match_limit >= 0 && match_count >= ctx->match_limit) {
+				break;
+			}
+		}
+		JobQueueReadEnd();
+
+		for (size_t ii = 0; ii < batch.size(); ++ii) {
+			if ( ! failed) {
+				const classad::References * proj = ctx->projection.empty() ? NULL : &whitelists[ii];
+				if ( ! putClassAd(sock, *batch[ii], PUT_CLASSAD_NO_PRIVATE | PUT_CLASSAD_NO_EXPAND_WHITELIST, proj) ||
+					! sock->end_of_message()) {
+					failed = true;
+				}
+			}
+			delete batch[ii];
+		}
+		batch.clear();
+		whitelists.clear();
+	}
+
+	if (failed) {
+		ctx->return_status = sendJobErrorAd(sock, 4, "Failed to write ClassAd to wire");
+		return;
+	}
+
+	const char * me = NULL;
+	LiveJobCounters * mine = NULL;
+	if ( ! ctx->my_name.empty()) { me = ctx->my_name.c_str(); mine = &ctx->my_job_counts; }
+	ctx->return_status = sendDone(sock, true, &ctx->query_job_counts, me, mine, &ctx->all_job_counts);
+}
+
+static void end_threaded_query(QueryJobAdsThreadContext * ctx)
+{
+	EndJobQueueSnapshot(ctx->snapshot);
+	delete ctx->requirements;
+	delete ctx->sock;
+	delete ctx;
+}
+
+// Called on the main thread (as DaemonCore pump work) when a query thread
+// has finished with a query.
+static int threaded_query_done(void * /*pool*/, void * in_ctx)
+{
+	QueryJobAdsThreadContext * ctx = (QueryJobAdsThreadContext *)in_ctx;
+	end_threaded_query(ctx);
+	--active_query_threads;
+	return 0;
+}
+
+// Set up a job query for a query thread, using the query that was set up for
+// the inline continuation.  returns false if there is no query thread free.
+static bool begin_threaded_query(QueryJobAdsContinuation * continuation, Stream * stream, int iter_options)
+{
+	if ( ! query_threads || active_query_threads >= schedd_forker.getMaxWorkers()) {
+		return false;
+	}
+
+	// the query thread can't use the requirements as parsed, because they may
+	// share parts with the ClassAd cache, so parse a private copy.
+	classad::ClassAdParser parser;
+	classad::ExprTree * requirements = parser.ParseExpression(ExprTreeToString(continuation->requirements.get()));
+	if ( ! requirements) {
+		return false;
+	}
+
+	QueryJobAdsThreadContext * ctx = new QueryJobAdsThreadContext;
+	ctx->sock = static_cast<ReliSock*>(stream);
+	ctx->requirements = requirements;
+	ctx->projection = continuation->projection;
+	ctx->query_job_counts.clear_counters();
+	ctx->all_job_counts = scheduler.liveJobCounts;
+	ctx->my_job_counts = continuation->my_job_counts;
+	ctx->my_name = continuation->my_name;
+	ctx->match_limit = continuation->match_limit;
+	ctx->summary_only = continuation->summary_only;
+	ctx->return_status = TRUE;
+	ctx->snapshot = BeginJobQueueSnapshot(ctx->jobs, iter_options);
+
+	if ( ! query_threads->submit(ctx)) {
+		ctx->sock = NULL; // still belongs to the caller
+		end_threaded_query(ctx);
+		return false;
+	}
+	++active_query_threads;
+	return true;
+}
+
+static void shutdown_query_threads()
+{
+	if (query_threads) {
+		query_threads->shutdown();
+	}
+}
+
 int Scheduler::command_query_job_ads(int cmd, Stream* stream)
 {
 	ClassAd queryAd;
@@ -2392,6 +2674,16 @@ int Scheduler::command_query_job_ads(int cmd, Stream* stream)
 		continuation->summary_only = true;
 	}
 
+	if (use_query_threads) {
+		// hand the query to a query thread if one is free, otherwise answer it
+		// here, as we would if we could not fork.
+		if (begin_threaded_query(continuation, stream, iter_options)) {
+			delete continuation;
+			return KEEP_STREAM;
+		}
+		return continuation->finish(stream);
+	}
+
 	ForkStatus fork_status = schedd_forker.NewJob();
 	if (fork_status == FORK_PARENT)
 	{ // Successfully forked a child - as far as the schedd cares, this worked.
@@ -2735,57 +3027,38 @@ int Scheduler::guessJobSlotWeight(JobQueueJob * job)
 	return job_weight;
 }
 
-int
-count_a_job(JobQueueJob* job, const JOB_ID_KEY& /*jid*/, void*)
+// work out what a job adds to the job counts of the schedd, its owner and its submitter.
+// this must not change the job or the counts, Scheduler::tallyJob() and count_a_job()
+// apply the result.
+void
+tally_a_job(JobQueueJob* job, JobTally & tally)
 {
 	int		status;
-#if 1  // cache ownerdata pointer in job object
-#else
-	int		niceUser;
-	MyString owner_buf;
-	char const*	owner;
-	MyString domain;
-#endif
 	int		cur_hosts;
 	int		max_hosts;
 	int		universe;
 
+	tally.clear();
+
 		// we may get passed a NULL job ad if, for instance, the job ad was
 		// removed via condor_rm -f when some function didn't expect it.
 		// So check for it here before continuing onward...
 	if ( job == NULL ) {  
-		return 0;
+		return;
 	}
 
 	if (job->LookupInteger(ATTR_JOB_STATUS, status) == 0) {
 		dprintf(D_ALWAYS, "Job has no %s attribute.  Ignoring...\n",
 				ATTR_JOB_STATUS);
-		return 0;
+		return;
 	}
 
 	int noop = 0;
 	job->LookupBool(ATTR_JOB_NOOP, noop);
 	if (noop && status != COMPLETED) {
-		int cluster = 0;
-		int proc = 0;
-		int noop_status = 0;
-		int temp = 0;
-		PROC_ID job_id;
-		if(job->LookupInteger(ATTR_JOB_NOOP_EXIT_SIGNAL, temp) != 0) {
-			noop_status = generate_exit_signal(temp);
-		}	
-		if(job->LookupInteger(ATTR_JOB_NOOP_EXIT_CODE, temp) != 0) {
-			noop_status = generate_exit_code(temp);
-		}	
-		job->LookupInteger(ATTR_CLUSTER_ID, cluster);
-		job->LookupInteger(ATTR_PROC_ID, proc);
-		dprintf(D_FULLDEBUG, "Job %d.%d is a no-op with status %d\n",
-				cluster,proc,noop_status);
-		job_id.cluster = cluster;
-		job_id.proc = proc;
-		set_job_status(cluster, proc, COMPLETED);
-		scheduler.WriteTerminateToUserLog( job_id, noop_status );
-		return 0;
+			// count_a_job_extras() will complete the job.
+		tally.revisit = true;
+		return;
 	}
 
 	if (job->LookupInteger(ATTR_CURRENT_HOSTS, cur_hosts) == 0) {
@@ -2808,29 +3081,18 @@ count_a_job(JobQueueJob* job, const JOB_ID_KEY& /*jid*/, void*)
 		request_cpus = 1;
 	}
 	
-
-	// because we set job->ownerdata to NULL above, this will refresh
-	// the job->ownerdata pointer. we do this in case the accounting group
+	// this will refresh the job->submitterdata pointer if the accounting group
 	// or niceness has been queue-edited or otherwise changed.
 	SubmitterData * SubData = NULL;
 	OwnerInfo * OwnInfo = scheduler.get_submitter_and_owner(job, SubData);
-	if ( ! OwnInfo) {
+	if ( ! OwnInfo || ! SubData) {
 		dprintf(D_ALWAYS, "Job has no %s attribute.  Ignoring...\n", ATTR_OWNER);
-		return 0;
+		return;
 	}
 
-	// increment our count of the number of job ads in the queue
-	scheduler.JobsTotalAds++;
-
-    time_t now = time(NULL);
-    OwnInfo->LastHitTime = now;
-    SubData->LastHitTime = now;
-
-    ScheddOtherStats * other_stats = NULL;
-    if (scheduler.OtherPoolStats.AnyEnabled()) {
-        other_stats = scheduler.OtherPoolStats.Matches(*job, now);
-    }
-    #define OTHER for (ScheddOtherStats * po = other_stats; po; po = po->next) (po->stats)
+	tally.counted = true;
+	tally.ownerinfo = OwnInfo;
+	tally.submitterdata = SubData;
 
     if (status == IDLE || status == RUNNING || status == TRANSFERRING_OUTPUT) {
         /*
@@ -2839,52 +3101,27 @@ count_a_job(JobQueueJob* job, const JOB_ID_KEY& /*jid*/, void*)
          */
         if ((status == RUNNING || status == TRANSFERRING_OUTPUT) && !cur_hosts)
         {
-                scheduler.JobsRunning += 1;
+                tally.running = 1;
         }
         else if ((status == IDLE) && !max_hosts)
         {
-                scheduler.JobsIdle += 1;
+                tally.idle = 1;
         }
         else
         {
-                scheduler.JobsRunning += cur_hosts;
-                scheduler.JobsIdle += (max_hosts - cur_hosts);
+                tally.running = cur_hosts;
+                tally.idle = (max_hosts - cur_hosts);
         }
 
-            // if job is not idle, then update statistics for running jobs
+            // the statistics for running jobs are added up by count_a_job_extras()
         if (status == RUNNING || status == TRANSFERRING_OUTPUT) {
-            scheduler.stats.JobsRunning += 1;
-            OTHER.JobsRunning += 1;
-
-            int job_image_size = 0;
-            job->LookupInteger("ImageSize_RAW", job_image_size);
-            scheduler.stats.JobsRunningSizes += (int64_t)job_image_size * 1024;
-            OTHER.JobsRunningSizes += (int64_t)job_image_size * 1024;
-
-            int job_start_date = 0;
-            int job_running_time = 0;
-            if (job->LookupInteger(ATTR_JOB_START_DATE, job_start_date))
-                job_running_time = (now - job_start_date);
-            scheduler.stats.JobsRunningRuntimes += job_running_time;
-            OTHER.JobsRunningRuntimes += job_running_time;
+            tally.revisit = true;
         }
     } else if (status == HELD) {
-        scheduler.JobsHeld++;
+        tally.held = 1;
     } else if (status == REMOVED) {
-        scheduler.JobsRemoved++;
+        tally.removed = 1;
     }
-    #undef OTHER
-
-	// update per-submitter and per-owner counters
-	SubmitterCounters * Counters = &SubData->num;
-	RealOwnerCounters * OwnerCounts = &OwnInfo->num;
-
-	// Hits also counts matchrecs, which aren't jobs. (hits is sort of a reference count)
-	Counters->Hits += 1;
-	Counters->JobsCounted += 1;
-	
-	OwnerCounts->Hits += 1;
-	OwnerCounts->JobsCounted += 1;
 
 	if ( (universe != CONDOR_UNIVERSE_GRID) &&	// handle Globus below...
 		 (!service_this_universe(universe,job))  )
@@ -2895,24 +3132,323 @@ count_a_job(JobQueueJob* job, const JOB_ID_KEY& /*jid*/, void*)
 		{
 			// Count REMOVED or HELD jobs that are in the process of being
 			// killed. cur_hosts tells us which these are.
-			scheduler.SchedUniverseJobsRunning += cur_hosts;
-			scheduler.SchedUniverseJobsIdle += (max_hosts - cur_hosts);
-			OwnerCounts->SchedulerJobsRunning += cur_hosts;
-			OwnerCounts->SchedulerJobsIdle += (max_hosts - cur_hosts);
-			Counters->SchedulerJobsRunning += cur_hosts;
-			Counters->SchedulerJobsIdle += (max_hosts - cur_hosts);
+			tally.sched_running = cur_hosts;
+			tally.sched_idle = (max_hosts - cur_hosts);
 		}
 		if (universe == CONDOR_UNIVERSE_LOCAL)
 		{
 			// Count REMOVED or HELD jobs that are in the process of being
 			// killed. cur_hosts tells us which these are.
-			scheduler.LocalUniverseJobsRunning += cur_hosts;
-			scheduler.LocalUniverseJobsIdle += (max_hosts - cur_hosts);
-			OwnerCounts->LocalJobsRunning += cur_hosts;
-			OwnerCounts->LocalJobsIdle += (max_hosts - cur_hosts);
-			Counters->LocalJobsRunning += cur_hosts;
-			Counters->LocalJobsIdle += (max_hosts - cur_hosts);
+			tally.local_running = cur_hosts;
+			tally.local_idle = (max_hosts - cur_hosts);
 		}
+			// count_a_job_extras() records the cluster id of all idle
+			// MPI and parallel jobs
+		int sendToDS = 0;
+		job->LookupBool("WantParallelScheduling", sendToDS);
+		if( (sendToDS || universe == CONDOR_UNIVERSE_MPI ||
+			 universe == CONDOR_UNIVERSE_PARALLEL) && status == IDLE &&
+			max_hosts > cur_hosts && job->jid.proc == 0 ) {
+			tally.revisit = true;
+		}
+
+		// bailout now, since all the crud below is only for jobs
+		// which the schedd needs to service
+		return;
+	} 
+
+	if ( universe == CONDOR_UNIVERSE_GRID ) {
+			// the grid job counts are made by count_a_job_extras()
+		tally.revisit = true;
+			// If we do not need to do matchmaking on this job (i.e.
+			// service this globus universe job), than we can bailout now.
+		if ( ! service_this_universe(universe,job)) {
+			return;
+		}
+	}
+
+	if (status == IDLE || status == RUNNING || status == TRANSFERRING_OUTPUT) {
+
+			// Remember the prio of jobs that are looking for more matches
+			// (max-hosts - cur_hosts) for the submitter's PrioSet, which
+			// count_jobs() makes iff knob USE_GLOBAL_JOB_PRIOS is true
+		if ((max_hosts - cur_hosts) > 0) {
+			int job_prio;
+			if ( job->LookupInteger(ATTR_JOB_PRIO,job_prio) ) {
+				tally.has_prio = true;
+				tally.prio = job_prio;
+			}
+		}
+			// Update Owners array JobsIdle
+		tally.user_idle = (max_hosts - cur_hosts);
+
+			// If we're biasing by slot weight, and the job is idle, and everything parsed...
+		if (scheduler.m_use_slot_weights && (max_hosts > cur_hosts)) {
+				// if we're biasing idle jobs by SCHEDD_SLOT_WEIGHT, eval that here
+			int job_weight = request_cpus;
+			if (scheduler.slotWeightOfJob) {
+				classad::Value value;
+				int rval = EvalExprTree(scheduler.slotWeightOfJob, job, NULL, value);
+				if ( ! rval || ! value.IsNumber(job_weight)) {
+					job_weight = request_cpus; // fall back if slot weight doesn't evaluate
+				}
+			} else {
+				job_weight = scheduler.guessJobSlotWeight(job);
+			}
+			tally.weighted_idle = job_weight * (max_hosts - cur_hosts);
+		} else {
+			// here: either max_hosts == cur_hosts || !scheduler.m_use_slot_weights
+			tally.weighted_idle = request_cpus * (max_hosts - cur_hosts);
+		}
+
+			// Don't update scheduler.Owners[name].JobsRunning here.
+			// We do it in Scheduler::count_jobs().
+
+	} else if (status == HELD) {
+		tally.user_held = 1;
+	}
+}
+
+// add (sign = 1) or remove (sign = -1) the tally of a job to/from the job counts
+void
+Scheduler::addJobTally(const JobTally & tally, int sign)
+{
+	if ( ! tally.counted) {
+		return;
+	}
+
+	jobTallies.JobsTotalAds += sign;
+	jobTallies.JobsIdle += sign * tally.idle;
+	jobTallies.JobsRunning += sign * tally.running;
+	jobTallies.JobsHeld += sign * tally.held;
+	jobTallies.JobsRemoved += sign * tally.removed;
+	jobTallies.SchedUniverseJobsIdle += sign * tally.sched_idle;
+	jobTallies.SchedUniverseJobsRunning += sign * tally.sched_running;
+	jobTallies.LocalUniverseJobsIdle += sign * tally.local_idle;
+	jobTallies.LocalUniverseJobsRunning += sign * tally.local_running;
+
+	// Hits also counts matchrecs, which aren't jobs. (hits is sort of a reference count)
+	// count_jobs() adds those after it copies these counts.
+	RealOwnerCounters & OwnerCounts = tally.ownerinfo->tallied;
+	OwnerCounts.Hits += sign;
+	OwnerCounts.JobsCounted += sign;
+	OwnerCounts.JobsIdle += sign * tally.user_idle;
+	OwnerCounts.JobsHeld += sign * tally.user_held;
+	OwnerCounts.SchedulerJobsIdle += sign * tally.sched_idle;
+	OwnerCounts.SchedulerJobsRunning += sign * tally.sched_running;
+	OwnerCounts.LocalJobsIdle += sign * tally.local_idle;
+	OwnerCounts.LocalJobsRunning += sign * tally.local_running;
+
+	SubmitterCounters & Counters = tally.submitterdata->tallied;
+	Counters.Hits += sign;
+	Counters.JobsCounted += sign;
+	Counters.JobsIdle += sign * tally.user_idle;
+	Counters.WeightedJobsIdle += sign * tally.weighted_idle;
+	Counters.JobsHeld += sign * tally.user_held;
+	Counters.SchedulerJobsIdle += sign * tally.sched_idle;
+	Counters.SchedulerJobsRunning += sign * tally.sched_running;
+	Counters.LocalJobsIdle += sign * tally.local_idle;
+	Counters.LocalJobsRunning += sign * tally.local_running;
+
+	if (tally.has_prio) {
+		std::map<int,int> & prios = tally.submitterdata->PrioCounts;
+		int & num = prios[tally.prio];
+		num += sign;
+		if (num <= 0) {
+			prios.erase(tally.prio);
+		}
+	}
+}
+
+// take the old tally of the job out of the job counts and put the current one in.
+// this is called when a job is added to the queue, and when an attribute that
+// the counts depend on is committed.
+void
+Scheduler::tallyJob(JobQueueJob * job)
+{
+	if ( ! job || job->jid.proc < 0) {
+		return;
+	}
+
+	JobTally tally;
+	tally_a_job(job, tally);
+	addJobTally(job->tally, -1);
+	addJobTally(tally, 1);
+	job->tally = tally;
+
+	if (tally.revisit) {
+		jobsToRevisit.insert(job->jid);
+	} else {
+		jobsToRevisit.erase(job->jid);
+	}
+}
+
+// take the tally of a job that is leaving the queue out of the job counts.
+void
+Scheduler::untallyJob(JobQueueJob * job)
+{
+	if ( ! job || job->jid.proc < 0) {
+		return;
+	}
+
+	addJobTally(job->tally, -1);
+	job->tally.clear();
+	jobsToRevisit.erase(job->jid);
+}
+
+// re-tally every job in the queue and rebuild the job counts from the tallies.
+// returns the number of jobs whose tally was wrong.  that should not happen except
+// when SCHEDD_SLOT_WEIGHT refers to job attributes that do not cause a job to be
+// tallied again when they change.
+int
+Scheduler::auditJobTallies()
+{
+	ScheddJobCounts old_counts = jobTallies;
+
+	jobTallies.clear_counters();
+	jobsToRevisit.clear();
+	for (OwnerInfoMap::iterator it = OwnersInfo.begin(); it != OwnersInfo.end(); ++it) {
+		it->second.tallied.clear_counters();
+	}
+	for (SubmitterDataMap::iterator it = Submitters.begin(); it != Submitters.end(); ++it) {
+		it->second.tallied.clear_job_counters();
+		it->second.PrioCounts.clear();
+	}
+
+	int num_wrong = 0;
+	WalkJobQueue2(count_a_job, &num_wrong);
+
+	if (num_wrong ||
+		old_counts.JobsTotalAds != jobTallies.JobsTotalAds ||
+		old_counts.JobsIdle != jobTallies.JobsIdle ||
+		old_counts.JobsRunning != jobTallies.JobsRunning ||
+		old_counts.JobsHeld != jobTallies.JobsHeld ||
+		old_counts.JobsRemoved != jobTallies.JobsRemoved) {
+		dprintf(jobTalliesAuditDue ? D_FULLDEBUG : D_ALWAYS,
+				"Job count audit corrected %d jobs. JobsTotalAds %d -> %d, JobsIdle %d -> %d, JobsRunning %d -> %d, JobsHeld %d -> %d, JobsRemoved %d -> %d\n",
+				num_wrong,
+				old_counts.JobsTotalAds, jobTallies.JobsTotalAds,
+				old_counts.JobsIdle, jobTallies.JobsIdle,
+				old_counts.JobsRunning, jobTallies.JobsRunning,
+				old_counts.JobsHeld, jobTallies.JobsHeld,
+				old_counts.JobsRemoved, jobTallies.JobsRemoved);
+	}
+
+	jobTalliesAuditDue = false;
+	lastJobTalliesAudit = time(NULL);
+	return num_wrong;
+}
+
+// re-tally a job for auditJobTallies(), pv is a pointer to the count of wrong tallies
+int
+count_a_job(JobQueueJob* job, const JOB_ID_KEY& jid, void* pv)
+{
+	if ( job == NULL ) {
+		return 0;
+	}
+
+	JobTally tally;
+	tally_a_job(job, tally);
+	if ( ! (tally == job->tally)) {
+		int * num_wrong = (int*)pv;
+		if (num_wrong) { *num_wrong += 1; }
+	}
+	job->tally = tally;
+	scheduler.addJobTally(tally, 1);
+	if (tally.revisit) {
+		scheduler.jobsToRevisit.insert(jid);
+	}
+	return 0;
+}
+
+// the part of counting a job that can't be tallied. finish no-op jobs, add up
+// the statistics of running jobs, and count grid jobs and idle dedicated clusters.
+// count_jobs() calls this for the jobs whose tally says to revisit them.
+int
+count_a_job_extras(JobQueueJob* job, const JOB_ID_KEY& /*jid*/, void*)
+{
+	int		status;
+	int		cur_hosts;
+	int		max_hosts;
+	int		universe;
+
+	if ( job == NULL ) {  
+		return 0;
+	}
+
+	if (job->LookupInteger(ATTR_JOB_STATUS, status) == 0) {
+		return 0;
+	}
+
+	int noop = 0;
+	job->LookupBool(ATTR_JOB_NOOP, noop);
+	if (noop && status != COMPLETED) {
+		int cluster = 0;
+		int proc = 0;
+		int noop_status = 0;
+		int temp = 0;
+		PROC_ID job_id;
+		if(job->LookupInteger(ATTR_JOB_NOOP_EXIT_SIGNAL, temp) != 0) {
+			noop_status = generate_exit_signal(temp);
+		}	
+		if(job->LookupInteger(ATTR_JOB_NOOP_EXIT_CODE, temp) != 0) {
+			noop_status = generate_exit_code(temp);
+		}	
+		job->LookupInteger(ATTR_CLUSTER_ID, cluster);
+		job->LookupInteger(ATTR_PROC_ID, proc);
+		dprintf(D_FULLDEBUG, "Job %d.%d is a no-op with status %d\n",
+				cluster,proc,noop_status);
+		job_id.cluster = cluster;
+		job_id.proc = proc;
+		set_job_status(cluster, proc, COMPLETED);
+		scheduler.WriteTerminateToUserLog( job_id, noop_status );
+		return 0;
+	}
+
+	// jobs with no owner are not counted
+	if ( ! job->tally.counted) {
+		return 0;
+	}
+
+	if (job->LookupInteger(ATTR_CURRENT_HOSTS, cur_hosts) == 0) {
+		cur_hosts = ((status == RUNNING || status == TRANSFERRING_OUTPUT) ? 1 : 0);
+	}
+	if (job->LookupInteger(ATTR_MAX_HOSTS, max_hosts) == 0) {
+		max_hosts = ((status == IDLE) ? 1 : 0);
+	}
+	if (job->LookupInteger(ATTR_JOB_UNIVERSE, universe) == 0) {
+		universe = CONDOR_UNIVERSE_STANDARD;
+	}
+
+    time_t now = time(NULL);
+    ScheddOtherStats * other_stats = NULL;
+    if (scheduler.OtherPoolStats.AnyEnabled()) {
+        other_stats = scheduler.OtherPoolStats.Matches(*job, now);
+    }
+    #define OTHER for (ScheddOtherStats * po = other_stats; po; po = po->next) (po->stats)
+
+        // if job is not idle, then update statistics for running jobs
+    if (status == RUNNING || status == TRANSFERRING_OUTPUT) {
+        scheduler.stats.JobsRunning += 1;
+        OTHER.JobsRunning += 1;
+
+        int job_image_size = 0;
+        job->LookupInteger("ImageSize_RAW", job_image_size);
+        scheduler.stats.JobsRunningSizes += (int64_t)job_image_size * 1024;
+        OTHER.JobsRunningSizes += (int64_t)job_image_size * 1024;
+
+        int job_start_date = 0;
+        int job_running_time = 0;
+        if (job->LookupInteger(ATTR_JOB_START_DATE, job_start_date))
+            job_running_time = (now - job_start_date);
+        scheduler.stats.JobsRunningRuntimes += job_running_time;
+        OTHER.JobsRunningRuntimes += job_running_time;
+    }
+    #undef OTHER
+
+	if ( (universe != CONDOR_UNIVERSE_GRID) &&	// handle Globus below...
+		 (!service_this_universe(universe,job))  )
+	{
 			// We want to record the cluster id of all idle MPI and parallel
 		    // jobs
 
@@ -2932,9 +3468,6 @@ count_a_job(JobQueueJob* job, const JOB_ID_KEY& /*jid*/, void*)
 				}
 			}
 		}
-
-		// bailout now, since all the crud below is only for jobs
-		// which the schedd needs to service
 		return 0;
 	} 
 
@@ -2942,7 +3475,6 @@ count_a_job(JobQueueJob* job, const JOB_ID_KEY& /*jid*/, void*)
 		// for Globus, count jobs in UNSUBMITTED state by owner.
 		// later we make certain there is a grid manager daemon
 		// per owner.
-		int real_status = status;
 		bool want_service = service_this_universe(universe,job);
 		bool job_managed = jobExternallyManaged(job);
 		bool job_managed_done = jobManagedDone(job);
@@ -2992,55 +3524,6 @@ count_a_job(JobQueueJob* job, const JOB_ID_KEY& /*jid*/, void*)
 			gridcounts->UnmanagedGridJobs++;
 		}
 			// If we do not need to do matchmaking on this job (i.e.
-			// service this globus universe job), than we can bailout now.
-		if (!want_service) {
-			return 0;
-		}
-		status = real_status;	// set status back for below logic...
-	}
-
-	if (status == IDLE || status == RUNNING || status == TRANSFERRING_OUTPUT) {
-
-			// Update Owner array PrioSet iff knob USE_GLOBAL_JOB_PRIOS is true
-			// and iff job is looking for more matches (max-hosts - cur_hosts)
-		if ( param_boolean("USE_GLOBAL_JOB_PRIOS",false) &&
-			 ((max_hosts - cur_hosts) > 0) )
-		{
-			int job_prio;
-			if ( job->LookupInteger(ATTR_JOB_PRIO,job_prio) ) {
-				SubData->PrioSet.insert( job_prio );
-			}
-		}
-			// Update Owners array JobsIdle
-		OwnerCounts->JobsIdle += (max_hosts - cur_hosts);
-		Counters->JobsIdle += (max_hosts - cur_hosts);
-
-
-			// If we're biasing by slot weight, and the job is idle, and everything parsed...
-		if (scheduler.m_use_slot_weights && (max_hosts > cur_hosts)) {
-				// if we're biasing idle jobs by SCHEDD_SLOT_WEIGHT, eval that here
-			int job_weight = request_cpus;
-			if (scheduler.slotWeightOfJob) {
-				classad::Value value;
-				int rval = EvalExprTree(scheduler.slotWeightOfJob, job, NULL, value);
-				if ( ! rval || ! value.IsNumber(job_weight)) {
-					job_weight = request_cpus; // fall back if slot weight doesn't evaluate
-				}
-			} else {
-				job_weight = scheduler.guessJobSlotWeight(job);
-			}
-			Counters->WeightedJobsIdle += job_weight * (max_hosts - cur_hosts);
-		} else {
-			// here: either max_hosts == cur_hosts || !scheduler.m_use_slot_weights
-			Counters->WeightedJobsIdle += request_cpus * (max_hosts - cur_hosts);
-		}
-
-			// Don't update scheduler.Owners[name].JobsRunning here.
-			// We do it in Scheduler::count_jobs().
-
-	} else if (status == HELD) {
-		OwnerCounts->JobsHeld++;
-		Counters->JobsHeld++;
 	}
 
 	return 0;
@@ -3674,7 +4157,16 @@ PeriodicExprEval(JobQueueJob *jobad, const JOB_ID_KEY & /*jid*/, void *)
 #endif
 {
 	int status=-1;
-	if(!ResponsibleForPeriodicExprs(jobad, status)) return 1;
+	if(!ResponsibleForPeriodicExprs(jobad, status)) {
+#ifdef USE_NON_MUTATING_USERPOLICY
+		// a removed job becomes our responsibility when its shadow goes away,
+		// which does not change any attribute of the job, so look at it again later.
+		if (status == REMOVED) {
+			scheduler.markPeriodicExprDirty(jobad->jid);
+		}
+#endif
+		return 1;
+	}
 
 	int cluster = jobad->jid.cluster;
 	int proc = jobad->jid.proc;
@@ -3691,6 +4183,7 @@ PeriodicExprEval(JobQueueJob *jobad, const JOB_ID_KEY & /*jid*/, void *)
 
 	policy.ResetTriggers();
 	int action = policy.AnalyzePolicy(*jobad, PERIODIC_ONLY);
+	scheduler.notePeriodicExprInputs(jobad, policy);
 #else
 	UserPolicy policy;
 	policy.Init(jobad);
@@ -3744,9 +4237,39 @@ PeriodicExprEval(JobQueueJob *jobad, const JOB_ID_KEY & /*jid*/, void *)
 	return 1;
 }
 
+/*
+Remember which attributes the periodic policy of a job refers to, so that
+we evaluate it again when one of them changes, and whether we have to
+evaluate it again anyway because it depends on the time.
+*/
+
+void
+Scheduler::notePeriodicExprInputs(JobQueueJob * job, UserPolicy & policy)
+{
+	if ( ! m_periodicExprUseDeps) {
+		return;
+	}
+
+	if (policy.PeriodicPolicyReferences(*job, m_periodicExprInputs)) {
+		m_periodicExprAlways.insert(job->jid);
+	} else {
+		m_periodicExprAlways.erase(job->jid);
+	}
+
+	// TimerRemove is the one time dependent policy that we know the
+	// time of, the job is removed once it is less than the current time.
+	int timer_remove = -1;
+	if (job->LookupInteger(ATTR_TIMER_REMOVE_CHECK, timer_remove) && timer_remove >= 0) {
+		m_periodicExprTimers.insert(std::make_pair((time_t)timer_remove + 1, job->jid));
+	}
+}
+
 /*
 For all of the jobs in the queue, evaluate the 
-periodic user policy expressions.
+periodic user policy expressions.  Unless PERIODIC_EXPR_USE_DEPENDENCIES
+is false, only the jobs that need it are evaluated; those whose policy
+inputs changed since the last run, those whose policy depends on the time,
+and those whose TimerRemove has come due.
 */
 
 void
@@ -3757,8 +4280,39 @@ Scheduler::PeriodicExprHandler( void )
 	UserPolicy policy;
 #ifdef USE_NON_MUTATING_USERPOLICY
 	policy.Init();
-#endif
+
+	// when the system policy depends on the time, every job has to be evaluated
+	// anyway, and a walk of the queue is cheaper than keeping the sets.
+	if ( ! m_periodicExprUseDeps || m_periodicExprFullSweep || policy.SystemPeriodicPolicyDependsOnTime()) {
+		m_periodicExprFullSweep = false;
+		m_periodicExprDirty.clear();
+		m_periodicExprAlways.clear();
+		m_periodicExprTimers.clear();
+		WalkJobQueue2(PeriodicExprEval, &policy);
+	} else {
+		std::set<JOB_ID_KEY> jobs;
+		jobs.swap(m_periodicExprDirty);
+		jobs.insert(m_periodicExprAlways.begin(), m_periodicExprAlways.end());
+		time_t now = time(NULL);
+		while ( ! m_periodicExprTimers.empty() && m_periodicExprTimers.begin()->first <= now) {
+			jobs.insert(m_periodicExprTimers.begin()->second);
+			m_periodicExprTimers.erase(m_periodicExprTimers.begin());
+		}
+
+		for (std::set<JOB_ID_KEY>::const_iterator it = jobs.begin(); it != jobs.end(); ++it) {
+			JobQueueJob * job = GetJobAd(it->cluster, it->proc);
+			if ( ! job) {
+				m_periodicExprAlways.erase(*it);
+				continue;
+			}
+			PeriodicExprEval(job, *it, &policy);
+		}
+		dprintf(D_FULLDEBUG, "Evaluated periodic expressions of %d jobs (%d depend on the time)\n",
+			(int)jobs.size(), (int)m_periodicExprAlways.size());
+	}
+#else
 	WalkJobQueue2(PeriodicExprEval, &policy);
+#endif
 
 	PeriodicExprInterval.setFinishTimeNow();
 
@@ -4185,6 +4739,21 @@ Scheduler::InitializeUserLog( PROC_ID job_id )
         ULog->setLogFileCache(&m_userlog_file_cache);
     }
 
+	if (m_userlog_batch_enabled) {
+		if ((long long)m_userlog_batch.pendingBytes() >= m_userlog_batch_max_bytes) {
+			FlushUserLogs();
+		}
+		ULog->setBatch(&m_userlog_batch);
+			// write the events queued in the window (or in this pass
+			// through the event loop, if the window is 0) together.
+		if (m_userlog_batch_tid == -1) {
+			m_userlog_batch_tid = daemonCore->Register_Timer(
+				m_userlog_batch_window,
+				(TimerHandlercpp)&Scheduler::userlogBatchTimer,
+				"Scheduler::userlogBatchTimer", this);
+		}
+	}
+
 	if (ULog->initialize(owner.Value(), domain.Value(), logfiles,
 			job_id.cluster, job_id.proc, 0, gjid.Value())) {
 		if(logfiles.size() > 1) {
@@ -6821,7 +7390,6 @@ Scheduler::negotiationFinished( char const *owner, char const *remote_pool, bool
 int
 Scheduler::negotiate(int command, Stream* s)
 {
-	int		job_index;
 	int		jobs;						// # of jobs that CAN be negotiated
 	int		which_negotiator = 0; 		// >0 implies flocking
 	MyString remote_pool_buf;
@@ -7091,13 +7659,19 @@ Scheduler::negotiate(int command, Stream* s)
 	}
 
 	BuildPrioRecArray();
-	jobs = N_PrioRecs;
 
 	JobsStarted = 0;
 
 	// find owner in the Owners array
 	char *at_sign = strchr(owner, '@');
 	if (at_sign) *at_sign = '\0';
+
+	// the runnable jobs of this owner, in priority order
+	static const PrioRecIndex::Order no_prio_recs;
+	const PrioRecIndex::Submitter * submitter_prio_recs = PrioRecs.submitter(owner);
+	const PrioRecIndex::Order & prio_recs = submitter_prio_recs ? submitter_prio_recs->jobs : no_prio_recs;
+	jobs = (int)prio_recs.size();
+
 	SubmitterData * Owner = find_submitter(owner);
 	if ( ! Owner) {
 		dprintf(D_ALWAYS, "Can't find owner %s in Owners array!\n", owner);
@@ -7114,15 +7688,10 @@ Scheduler::negotiate(int command, Stream* s)
 	ResourceRequestCluster *cluster = NULL;
 	int next_cluster = 0;
 
-	for(job_index = 0; job_index < N_PrioRecs && !skip_negotiation; job_index++) {
-		prio_rec *prec = &PrioRec[job_index];
-
-		// make sure owner matches what negotiator wants
-		if(strcmp(owner,prec->owner)!=0)
-		{
-			jobs--;
-			continue;
-		}
+	PrioRecQueue prio_queue;
+	prio_queue.add(prio_recs);
+	const prio_rec *prec;
+	while( !skip_negotiation && (prec = prio_queue.next()) ) {
 
 		// make sure jobprio is in the range the negotiator wants
 		if ( consider_jobprio_min > prec->job_prio ||
@@ -9196,6 +9765,10 @@ Scheduler::spawnJobHandlerRaw( shadow_rec* srec, const char* path,
 		fi.max_snapshot_interval = 15;
 	}
 	
+		// the events the handler writes to the user log must come after
+		// the ones we have written for the job
+	FlushUserLogs();
+
 	/* For now, we should create the handler as PRIV_ROOT so it can do
 	   priv switching between PRIV_USER (for handling syscalls, moving
 	   files, etc), and PRIV_CONDOR (for writing to log files).
@@ -11187,7 +11760,6 @@ Scheduler::swap_space_exhausted()
 int
 Scheduler::shadow_prio_recs_consistent()
 {
-	int		i;
 	struct shadow_rec	*srp;
 	int		status, universe;
 
@@ -11195,8 +11767,10 @@ Scheduler::shadow_prio_recs_consistent()
 	BadCluster = -1;
 	BadProc = -1;
 
-	for( i=0; i<N_PrioRecs; i++ ) {
-		if( (srp=find_shadow_rec(&PrioRec[i].id)) ) {
+	const PrioRecIndex::Order & prio_recs = PrioRecs.all();
+	for( PrioRecIndex::Order::const_iterator it = prio_recs.begin(); it != prio_recs.end(); ++it ) {
+		PROC_ID job_id = (*it)->id;
+		if( (srp=find_shadow_rec(&job_id)) ) {
 			BadCluster = srp->job_id.cluster;
 			BadProc = srp->job_id.proc;
 			universe = srp->universe;
@@ -11205,8 +11779,7 @@ Scheduler::shadow_prio_recs_consistent()
 				universe!=CONDOR_UNIVERSE_MPI &&
 				universe!=CONDOR_UNIVERSE_PARALLEL) {
 				// display_shadow_recs();
-				// dprintf(D_FULLDEBUG,"shadow_prio_recs_consistent(): PrioRec %d - id = %d.%d, owner = %s\n",i,PrioRec[i].id.cluster,PrioRec[i].id.proc,PrioRec[i].owner);
-				dprintf( D_ALWAYS, "ERROR: Found a consistency problem in the PrioRec array for job %d.%d !!!\n", PrioRec[i].id.cluster,PrioRec[i].id.proc );
+				dprintf( D_ALWAYS, "ERROR: Found a consistency problem in the PrioRec index for job %d.%d !!!\n", job_id.cluster, job_id.proc );
 				return FALSE;
 			}
 		}
@@ -11544,12 +12117,16 @@ Scheduler::child_exit(int pid, int status)
 
 		//
 		// If the job was a local universe job, we will want to
-		// call count on it so that it can be marked idle again
+		// count it again so that it can be marked idle again
 		// if need be.
 		//
 	if ( srec_was_local_universe == true ) {
 		JobQueueJob *job_ad = GetJobAd(job_id);
-		count_a_job( job_ad, job_ad->jid, NULL);
+		if (job_ad) {
+			tallyJob(job_ad);
+		}
+		LocalUniverseJobsIdle = jobTallies.LocalUniverseJobsIdle;
+		LocalUniverseJobsRunning = jobTallies.LocalUniverseJobsRunning;
 	}
 
 		// If we're not trying to shutdown, now that either an agent
@@ -12816,6 +13393,16 @@ Scheduler::Init()
 
 	PeriodicExprInterval.setTimeslice( param_double("PERIODIC_EXPR_TIMESLICE", 0.01,0,1) );
 
+	m_periodicExprUseDeps = param_boolean("PERIODIC_EXPR_USE_DEPENDENCIES", true);
+		// the system periodic policy may have changed, so evaluate every job
+		// on the next run, which also finds the attributes the policy refers to again.
+	m_periodicExprFullSweep = true;
+	m_periodicExprInputs.clear();
+	m_periodicExprInputs.insert(ATTR_JOB_STATUS);
+	m_periodicExprInputs.insert(ATTR_HOLD_REASON_CODE);
+	m_periodicExprInputs.insert(ATTR_JOB_MANAGED);
+	m_periodicExprInputs.insert(ATTR_JOB_UNIVERSE);
+
 	RequestClaimTimeout = param_integer("REQUEST_CLAIM_TIMEOUT",60*30);
 
 #ifdef HAVE_EXT_POSTGRESQL
@@ -12908,6 +13495,23 @@ Scheduler::Init()
 
 	InitQmgmt();
 
+	if ( ! query_threads) {
+		// switching between forked and threaded query workers requires a restart
+		use_query_threads = param_boolean("SCHEDD_QUERY_WORKERS_USE_THREADS", false);
+		if (use_query_threads && ! ScheddQueryThreads::supported()) {
+			dprintf(D_ALWAYS, "SCHEDD_QUERY_WORKERS_USE_THREADS is not supported on this platform, using forked query workers\n");
+			use_query_threads = false;
+		}
+	}
+	if (use_query_threads) {
+		query_thread_slice_ms = param_integer("SCHEDD_QUERY_THREAD_SLICE", 10, 1);
+		if ( ! query_threads) {
+			query_threads = new ScheddQueryThreads(threaded_query_work, threaded_query_done);
+		}
+		int num_threads = query_threads->grow(schedd_forker.getMaxWorkers());
+		dprintf(D_ALWAYS, "QueryWorker: using %d query threads\n", num_threads);
+	}
+
 
 		//////////////////////////////////////////////////////////////
 		// Initialize our classad
@@ -13109,6 +13713,17 @@ Scheduler::Init()
     m_userlog_file_cache_max = param_integer("USERLOG_FILE_CACHE_MAX", 0, 0);
     m_userlog_file_cache_clear_interval = param_integer("USERLOG_FILE_CACHE_CLEAR_INTERVAL", 60, 0);
 
+	m_userlog_batch_enabled = param_boolean("USERLOG_BATCH", false);
+	m_userlog_batch_window = param_integer("USERLOG_BATCH_WINDOW", 0, 0);
+	m_userlog_batch_max_bytes = param_integer("USERLOG_BATCH_MAX_BYTES", 1024*1024, 0);
+	if ( ! m_userlog_batch_enabled) {
+		FlushUserLogs();
+	}
+
+	JobCountsAuditInterval = param_integer("SCHEDD_JOB_COUNTS_AUDIT_INTERVAL", 3600, 0);
+		// the slot weight of idle jobs may change, so tally all of the jobs again
+	jobTalliesAuditDue = true;
+
 	if (slotWeightOfJob) {
 		delete slotWeightOfJob;
 		slotWeightOfJob = NULL;
@@ -13497,7 +14112,7 @@ Scheduler::RegisterTimers()
 
 extern "C" {
 int
-prio_compar(prio_rec* a, prio_rec* b)
+prio_compar(const prio_rec* a, const prio_rec* b)
 {
 	 /* compare submitted job preprio's: higher values have more priority */
 	 /* Typically used to prioritize entire DAG jobs over other DAG jobs */
@@ -13697,6 +14312,9 @@ Scheduler::shutdown_fast()
 		CronJobMgr->Shutdown( true );
 	}
 
+	// the query threads must be done reading the job queue before we destroy it
+	shutdown_query_threads();
+
 	DestroyJobQueue();
 		// Since this is just sending a bunch of UDP updates, we can
 		// still invalidate our classads, even on a fast shutdown.
@@ -13707,6 +14325,8 @@ Scheduler::shutdown_fast()
 	ClassAdLogPluginManager::Shutdown();
 #endif
 
+	FlushUserLogs();
+
 	dprintf( D_ALWAYS, "All shadows have been killed, exiting.\n" );
 	DC_Exit(0);
 }
@@ -13723,6 +14343,10 @@ Scheduler::schedd_exit()
 		CronJobMgr = NULL;
 	}
 
+		// the query threads must be done reading the job queue
+		// before we rewrite it
+	shutdown_query_threads();
+
 		// write a clean job queue on graceful shutdown so we can
 		// quickly recover on restart
 	CleanJobQueue();
@@ -13740,6 +14364,8 @@ Scheduler::schedd_exit()
 	ClassAdLogPluginManager::Shutdown();
 #endif
 
+	FlushUserLogs();
+
 	dprintf( D_ALWAYS, "All shadows are gone, exiting.\n" );
 	DC_Exit(0);
 }
@@ -0,0 +1,246 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_daemon_core.h"
+
+#include "schedd_query_threads.h"
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+
+// The job queue gate.  The main thread holds it all of the time except while
+// it is waiting in select(), and query threads share it while they read the
+// job queue.  When the main thread comes out of select() it waits for the
+// readers to leave, and readers that were already waiting when the main thread
+// went into select() are let in ahead of it (granted), so that neither side
+// can keep the other out.
+static pthread_mutex_t gate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  gate_readers_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  gate_main_cond = PTHREAD_COND_INITIALIZER;
+static bool gate_enabled = false;
+static bool gate_main_has = true;
+static bool gate_main_waiting = false;
+static int  gate_readers_active = 0;
+static int  gate_readers_waiting = 0;
+static int  gate_granted = 0;
+
+static void
+JobQueueGateSelectWait(bool waiting)
+{
+	pthread_mutex_lock(&gate_mutex);
+	if ( ! gate_enabled) {
+		// shut down, the readers are on their own
+	} else if (waiting) {
+		gate_main_has = false;
+		gate_granted = gate_readers_waiting;
+		pthread_cond_broadcast(&gate_readers_cond);
+	} else {
+		gate_main_waiting = true;
+		while (gate_readers_active > 0 || gate_granted > 0) {
+			pthread_cond_wait(&gate_main_cond, &gate_mutex);
+		}
+		gate_main_waiting = false;
+		gate_main_has = true;
+	}
+	pthread_mutex_unlock(&gate_mutex);
+}
+
+void
+JobQueueReadBegin()
+{
+	pthread_mutex_lock(&gate_mutex);
+	++gate_readers_waiting;
+	while (gate_enabled && (gate_main_has || (gate_main_waiting && gate_granted == 0))) {
+		pthread_cond_wait(&gate_readers_cond, &gate_mutex);
+	}
+	--gate_readers_waiting;
+	if (gate_granted > 0) { --gate_granted; }
+	++gate_readers_active;
+	pthread_mutex_unlock(&gate_mutex);
+}
+
+void
+JobQueueReadEnd()
+{
+	pthread_mutex_lock(&gate_mutex);
+	--gate_readers_active;
+	if (gate_readers_active == 0) {
+		pthread_cond_signal(&gate_main_cond);
+	}
+	pthread_mutex_unlock(&gate_mutex);
+}
+
+ScheddQueryThreads::ScheddQueryThreads(WorkFunc work, PumpWorkCallback done)
+	: m_work(work)
+	, m_done(done)
+	, m_stopping(false)
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_cond, NULL);
+}
+
+ScheddQueryThreads::~ScheddQueryThreads()
+{
+	shutdown();
+	pthread_cond_destroy(&m_cond);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+bool
+ScheddQueryThreads::supported()
+{
+	return true;
+}
+
+int
+ScheddQueryThreads::size() const
+{
+	return (int)m_threads.size();
+}
+
+int
+ScheddQueryThreads::grow(int num_threads)
+{
+	if (m_stopping) {
+		return size();
+	}
+
+	// from here on, dprintf may be called from more than one thread.
+	dprintf_make_thread_safe();
+
+	// the main thread holds the job queue from now on, except while it waits in select
+	if ( ! gate_enabled) {
+		pthread_mutex_lock(&gate_mutex);
+		gate_enabled = true;
+		gate_main_has = true;
+		pthread_mutex_unlock(&gate_mutex);
+		daemonCore->Register_SelectWaitCallback(JobQueueGateSelectWait);
+	}
+
+	while ((int)m_threads.size() < num_threads) {
+		// the query threads should never see a signal, so block them all
+		// while we create the thread, it will inherit our signal mask.
+		sigset_t all_signals, old_mask;
+		sigfillset(&all_signals);
+		pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+
+		pthread_t thread;
+		int rval = pthread_create(&thread, NULL, threadMain, this);
+
+		pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+		if (rval != 0) {
+			dprintf(D_ALWAYS | D_FAILURE, "QueryWorker: failed to create query thread: %s (%d)\n",
+				strerror(rval), rval);
+			break;
+		}
+		m_threads.push_back(thread);
+	}
+	return size();
+}
+
+bool
+ScheddQueryThreads::submit(void * item)
+{
+	if (m_threads.empty() || m_stopping) {
+		return false;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_queue.push_back(item);
+	pthread_cond_signal(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+	return true;
+}
+
+void
+ScheddQueryThreads::shutdown()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stopping = true;
+	m_queue.clear();
+	pthread_cond_broadcast(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+
+	// open the gate for good, so that threads waiting on it can see that we
+	// are stopping.  the main thread must not change the job queue after this.
+	pthread_mutex_lock(&gate_mutex);
+	if (gate_enabled) {
+		gate_enabled = false;
+		gate_main_has = false;
+		pthread_cond_broadcast(&gate_readers_cond);
+	}
+	pthread_mutex_unlock(&gate_mutex);
+
+	for (size_t ii = 0; ii < m_threads.size(); ++ii) {
+		pthread_join(m_threads[ii], NULL);
+	}
+	m_threads.clear();
+}
+
+void *
+ScheddQueryThreads::threadMain(void * arg)
+{
+	ScheddQueryThreads * pool = (ScheddQueryThreads *)arg;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->m_mutex);
+		while (pool->m_queue.empty() && ! pool->m_stopping) {
+			pthread_cond_wait(&pool->m_cond, &pool->m_mutex);
+		}
+		if (pool->m_stopping) {
+			pthread_mutex_unlock(&pool->m_mutex);
+			break;
+		}
+		void * item = pool->m_queue.front();
+		pool->m_queue.pop_front();
+		pthread_mutex_unlock(&pool->m_mutex);
+
+		pool->m_work(item);
+		if ( ! pool->m_stopping) {
+			daemonCore->Register_PumpWork_TS(pool->m_done, pool, item);
+		}
+	}
+	return NULL;
+}
+
+#else // no pthreads
+
+void JobQueueReadBegin() { }
+void JobQueueReadEnd() { }
+
+ScheddQueryThreads::ScheddQueryThreads(WorkFunc work, PumpWorkCallback done)
+	: m_work(work)
+	, m_done(done)
+	, m_stopping(false)
+{
+}
+
+ScheddQueryThreads::~ScheddQueryThreads()
+{
+}
+
+bool ScheddQueryThreads::supported() { return false; }
+int  ScheddQueryThreads::size() const { return 0; }
+int  ScheddQueryThreads::grow(int) { return 0; }
+bool ScheddQueryThreads::submit(void *) { return false; }
+void ScheddQueryThreads::shutdown() { }
+
+#endif
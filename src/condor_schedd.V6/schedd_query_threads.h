@@ -0,0 +1,91 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __SCHEDD_QUERY_THREADS_H__
+#define __SCHEDD_QUERY_THREADS_H__
+
+#include "condor_daemon_core.h"
+
+#include <deque>
+#include <vector>
+
+// A pool of threads for answering job queries without forking.
+//
+// The main thread hands work items to the pool with submit().  A pool
+// thread calls the work function on the item, and then hands the item back
+// to the main thread by registering the done function as DaemonCore pump
+// work.  The pool does not limit how many items are in progress, the caller
+// is expected to do that (the schedd uses the SCHEDD_QUERY_WORKERS limit it
+// uses for forked query workers).
+//
+// The main thread is the only thread that changes the job queue.  A pool
+// thread may read the job queue only between JobQueueReadBegin() and
+// JobQueueReadEnd(), which wait until the main thread is waiting in select().
+// The main thread waits for the pool threads that are reading to call
+// JobQueueReadEnd() when it comes out of select(), so they should hold the
+// job queue only for a short time.
+//
+class ScheddQueryThreads
+{
+  public:
+	typedef void (*WorkFunc)(void * item);
+
+	ScheddQueryThreads(WorkFunc work, PumpWorkCallback done);
+	~ScheddQueryThreads();
+
+	// returns true if threads are supported on this platform
+	static bool supported();
+
+	// start more threads if there are fewer than num_threads. threads
+	// are never stopped until shutdown(), extra threads just sit idle.
+	int  grow(int num_threads);
+	int  size() const;
+
+	// queue an item for a pool thread, returns false if there are no threads.
+	bool submit(void * item);
+
+	// true once shutdown() has begun, work functions should check this
+	// between batches and give up early.
+	bool stopping() const { return m_stopping; }
+
+	// stop taking work, and wait for all of the threads to finish the item
+	// they are working on.  items still in the queue are not run, and are not
+	// handed back.  call this on the main thread.
+	void shutdown();
+
+  private:
+	WorkFunc m_work;
+	PumpWorkCallback m_done;
+	volatile bool m_stopping;
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	static void * threadMain(void * arg);
+
+	pthread_mutex_t m_mutex;
+	pthread_cond_t  m_cond;
+	std::deque<void*> m_queue;
+	std::vector<pthread_t> m_threads;
+#endif
+};
+
+// called by the pool threads around reading the job queue
+void JobQueueReadBegin();
+void JobQueueReadEnd();
+
+#endif // __SCHEDD_QUERY_THREADS_H__
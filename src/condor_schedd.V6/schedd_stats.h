@@ -131,6 +131,15 @@ typedef struct ScheddStatistics : public ScheddJobCounters {
    //stats_entry_recent<int> ShadowExceptions;     // number of times shadows have excepted
    stats_entry_recent<int> ShadowsReconnections; // number of times shadows have reconnected
 
+   // group commit of the job queue log
+   stats_entry_recent<Probe> JobQueueLogSyncBatch; // transactions made durable by each fsync of the log
+   stats_entry_recent<Probe> JobQueueLogSyncTime;  // seconds spent in each fsync of the log
+
+   // batched writes of user log events
+   stats_entry_recent<Probe> UserLogBatchEvents;    // events written by each flush of the batch
+   stats_entry_recent<Probe> UserLogBatchWait;      // seconds the oldest event in each flush waited
+   stats_entry_recent<Probe> UserLogBatchFlushTime; // seconds spent writing and syncing each flush
+
 
    // non-published values
    time_t InitTime;            // last time we init'ed the structure
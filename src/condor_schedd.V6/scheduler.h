@@ -81,6 +81,8 @@ void AuditLogNewConnection( int cmd, Sock &sock, bool failure );
 // with new compilers (gcc 4.1+)
 //
 class JobQueueJob;
+struct JobTally;
+class UserPolicy;
 extern int updateSchedDInterval( JobQueueJob*, const JOB_ID_KEY&, void* );
 
 typedef std::set<JOB_ID_KEY> JOB_ID_SET;
@@ -204,6 +206,8 @@ struct SubmitterData {
   bool isOwnerName; // the name of this submitter record is the same as the name of an owner record.
   bool absentUpdateSent;
   std::set<int> PrioSet; // Set of job priorities, used for JobPrioArray attr
+  SubmitterCounters tallied; // sum of the JobTally of this submitter's jobs, copied into num by count_jobs
+  std::map<int,int> PrioCounts; // number of jobs wanting a match at each JobPrio, PrioSet is made from this
   SubmitterData() : LastHitTime(0), FlockLevel(0), OldFlockLevel(0), NegotiationTimestamp(0)
       , lastUpdateTime(0), isOwnerName(false), absentUpdateSent(false)  { }
 };
@@ -253,12 +257,36 @@ struct OwnerInfo {
   bool empty() const { return name.empty(); }
   RealOwnerCounters num; // job counts by OWNER rather than by submitter
   LiveJobCounters live; // job counts that are always up-to-date with the committed job state
+  RealOwnerCounters tallied; // sum of the JobTally of this owner's jobs, copied into num by count_jobs
   time_t LastHitTime; // records the last time we incremented num.Hit, use to expire OwnerInfo
   OwnerInfo() : LastHitTime(0) { }
 };
 
 typedef std::map<std::string, OwnerInfo> OwnerInfoMap;
 
+// schedd wide job counts, this is the sum of the JobTally of all of the jobs in the queue.
+struct ScheddJobCounts {
+  int JobsTotalAds;
+  int JobsIdle;
+  int JobsRunning;
+  int JobsHeld;
+  int JobsRemoved;
+  int SchedUniverseJobsIdle;
+  int SchedUniverseJobsRunning;
+  int LocalUniverseJobsIdle;
+  int LocalUniverseJobsRunning;
+  void clear_counters() { memset(this, 0, sizeof(*this)); }
+  ScheddJobCounts()
+	: JobsTotalAds(0)
+	, JobsIdle(0)
+	, JobsRunning(0)
+	, JobsHeld(0)
+	, JobsRemoved(0)
+	, SchedUniverseJobsIdle(0), SchedUniverseJobsRunning(0)
+	, LocalUniverseJobsIdle(0), LocalUniverseJobsRunning(0)
+  {}
+};
+
 
 class match_rec: public ClaimIdParser
 {
@@ -474,6 +502,8 @@ class Scheduler : public Service
 	JobTransforms	jobTransforms;
 	friend	int		NewProc(int cluster_id);
 	friend	int		count_a_job(JobQueueJob*, const JOB_ID_KEY&, void* );
+	friend	int		count_a_job_extras(JobQueueJob*, const JOB_ID_KEY&, void* );
+	friend	void	tally_a_job(JobQueueJob*, JobTally &);
 //	friend	void	job_prio(ClassAd *);
 	friend  int		find_idle_local_jobs(JobQueueJob *, const JOB_ID_KEY&, void*);
 	friend	int		updateSchedDInterval(JobQueueJob*, const JOB_ID_KEY&, void* );
@@ -495,6 +525,17 @@ class Scheduler : public Service
 	void			addCronTabClusterId( int );
 	void			indexAJob(JobQueueJob* job, bool loading_job_queue=false);
 	void			removeJobFromIndexes(const JOB_ID_KEY& job_id);
+	// keep the job counts up to date as jobs are added, change or leave the queue.
+	void			tallyJob(JobQueueJob* job);
+	void			untallyJob(JobQueueJob* job);
+	// periodic policy is evaluated only for jobs whose policy inputs changed, see PeriodicExprHandler()
+	bool			isPeriodicExprInput(const char * attr) const {
+		return m_periodicExprUseDeps && m_periodicExprInputs.find(attr) != m_periodicExprInputs.end();
+	}
+	void			markPeriodicExprDirty(const JOB_ID_KEY & jid) {
+		if (m_periodicExprUseDeps) { m_periodicExprDirty.insert(jid); }
+	}
+	void			notePeriodicExprInputs(JobQueueJob* job, UserPolicy & policy);
 	int				RecycleShadow(int cmd, Stream *stream);
 	void			finishRecycleShadow(shadow_rec *srec);
 
@@ -546,6 +587,8 @@ class Scheduler : public Service
 	bool			WriteTerminateToUserLog( PROC_ID job_id, int status );
 	bool			WriteRequeueToUserLog( PROC_ID job_id, int status, const char * reason );
 	bool			WriteAttrChangeToUserLog( const char* job_id_str, const char* attr, const char* attr_value, const char* old_value);
+		// write the user log events waiting in the batch
+	void			FlushUserLogs();
 	int				receive_startd_alive(int cmd, Stream *s);
 	void			InsertMachineAttrs( int cluster, int proc, ClassAd *machine );
 		// Public startd socket management functions
@@ -730,6 +773,12 @@ private:
 	Timeslice       SchedDInterval;
 	Timeslice       PeriodicExprInterval;
 	int             periodicid;
+	bool            m_periodicExprUseDeps;     // PERIODIC_EXPR_USE_DEPENDENCIES
+	bool            m_periodicExprFullSweep;   // evaluate every job on the next run
+	classad::References m_periodicExprInputs;  // attributes that periodic policy refers to
+	std::set<JOB_ID_KEY> m_periodicExprDirty;  // jobs whose policy inputs changed
+	std::set<JOB_ID_KEY> m_periodicExprAlways; // jobs whose policy can change with the time alone
+	std::set< std::pair<time_t, JOB_ID_KEY> > m_periodicExprTimers; // jobs by when their TimerRemove fires
 	int				QueueCleanInterval;
 	int             RequestClaimTimeout;
 	int				JobStartDelay;
@@ -776,6 +825,17 @@ private:
 
 	//JOB_ID_SET      LocalJobIds;  // set of jobid's of local and scheduler universe jobs.
 	HashTable<UserIdentity, GridJobCounts> GridJobOwners;
+
+	// job counts kept up to date by tallyJob() and untallyJob(), count_jobs() uses these
+	// rather than walking the job queue, and walks the queue only to audit them.
+	ScheddJobCounts jobTallies;
+	std::set<JOB_ID_KEY> jobsToRevisit; // jobs that count_jobs() must still look at, see JobTally::revisit
+	bool			jobTalliesAuditDue;
+	time_t			lastJobTalliesAudit;
+	int				JobCountsAuditInterval;
+	void			addJobTally(const JobTally & tally, int sign);
+	int				auditJobTallies();
+
 	time_t			NegotiationRequestTime;
 	int				ExitWhenDone;  // Flag set for graceful shutdown
 	Queue<shadow_rec*> RunnableJobQueue;
@@ -1010,6 +1070,14 @@ private:
     void userlog_file_cache_clear(bool force = false);
     void userlog_file_cache_erase(const int& cluster, const int& proc);
 
+	// batch of user log events, see USERLOG_BATCH
+	WriteUserLogBatch m_userlog_batch;
+	bool m_userlog_batch_enabled;
+	int m_userlog_batch_window;
+	long long m_userlog_batch_max_bytes;
+	int m_userlog_batch_tid;
+	void userlogBatchTimer();
+
 	// State for the history helper queue.
 	std::vector<HistoryHelperState> m_history_helper_queue;
 	unsigned m_history_helper_max;
@@ -33,6 +33,12 @@
 
 #include "strcasestr.h"
 
+#if defined(WANT_CONTRIB) && defined(WITH_MANAGEMENT)
+#if defined(HAVE_DLOPEN) || defined(WIN32)
+#include "StartdPlugin.h"
+#endif
+#endif
+
 ResMgr::ResMgr() : extras_classad( NULL )
 {
 	totals_classad = NULL;
@@ -40,6 +46,10 @@ ResMgr::ResMgr() : extras_classad( NULL )
 	up_tid = -1;
 	poll_tid = -1;
 	m_cred_sweep_tid = -1;
+	m_batch_update_tid = -1;
+	m_batch_seq = 0;
+	m_last_full_batch = 0;
+	m_batch_want_full = false;
 
 	draining = false;
 	draining_is_graceful = false;
@@ -152,6 +162,14 @@ ResMgr::~ResMgr()
 	if( id_disp ) delete id_disp;
 	delete m_attr;
 
+	if( m_batch_update_tid != -1 ) {
+		daemonCore->Cancel_Timer( m_batch_update_tid );
+	}
+	for( std::map<std::string, ClassAd*>::iterator it = m_batch_sent.begin();
+		 it != m_batch_sent.end(); ++it ) {
+		delete it->second;
+	}
+
 #if HAVE_BACKFILL
 	if( m_backfill_mgr ) {
 		delete m_backfill_mgr;
@@ -1091,6 +1109,207 @@ ResMgr::send_update( int cmd, ClassAd* public_ad, ClassAd* private_ad,
 }
 
 
+void
+ResMgr::queue_batch_update( void )
+{
+		// As in Resource::update(), wait a few seconds before sending
+		// so that the changes to all of the slots go out together.
+	if( m_batch_update_tid == -1 ) {
+		m_batch_update_tid = daemonCore->Register_Timer( 3,
+						(TimerHandlercpp)&ResMgr::do_batch_update,
+						"do_batch_update",
+						this );
+	}
+
+	if( m_batch_update_tid < 0 ) {
+		// Somehow, the timer could not be set.  Ick!
+		m_batch_update_tid = -1;
+	}
+}
+
+
+void
+ResMgr::request_full_batch( void )
+{
+	m_batch_want_full = true;
+	queue_batch_update();
+}
+
+
+	// Move the attributes that have the same value in all of the given
+	// ads out of the ads and into shared.  The Name of each slot, and
+	// the list of attributes removed from it, always stay with the slot.
+static void
+factor_shared_attrs( std::vector<classad::ClassAd*> &ads, classad::ClassAd &shared )
+{
+	if( ads.size() < 2 ) {
+		return;
+	}
+
+	std::vector<std::string> names;
+	for( classad::ClassAd::iterator it = ads[0]->begin(); it != ads[0]->end(); ++it ) {
+		if( strcasecmp( it->first.c_str(), ATTR_NAME ) == 0 ||
+			strcasecmp( it->first.c_str(), ATTR_STARTD_BATCH_REMOVED_ATTRS ) == 0 ||
+			strcasecmp( it->first.c_str(), ATTR_STARTD_BATCH_FULL ) == 0 ) {
+			continue;
+		}
+		bool same = true;
+		for( size_t i = 1; i < ads.size() && same; i++ ) {
+			classad::ExprTree *expr = ads[i]->Lookup( it->first );
+			same = expr && expr->SameAs( it->second );
+		}
+		if( same ) {
+			names.push_back( it->first );
+		}
+	}
+
+	for( size_t n = 0; n < names.size(); n++ ) {
+		shared.Insert( names[n], ads[0]->Lookup( names[n] )->Copy() );
+		for( size_t i = 0; i < ads.size(); i++ ) {
+			ads[i]->Delete( names[n] );
+		}
+	}
+}
+
+
+void
+ResMgr::do_batch_update( void )
+{
+		// We _must_ reset m_batch_update_tid first, so that changes
+		// from here on queue the next batch.
+	m_batch_update_tid = -1;
+
+	if( ! resources ) {
+		return;
+	}
+
+	time_t now = time( NULL );
+	bool full = ( m_batch_seq == 0 ) || m_batch_want_full ||
+		( now - m_last_full_batch >= update_interval );
+
+	ClassAd batch_ad;
+	ClassAd private_batch_ad;
+	std::vector<classad::ExprTree*> slot_records;
+	std::vector<classad::ExprTree*> private_records;
+	std::vector<classad::ClassAd*> whole_records;
+	std::vector<classad::ClassAd*> change_records;
+	std::map<std::string, ClassAd*> sent;
+
+	for( int i = 0; i < nresources; i++ ) {
+		Resource* rip = resources[i];
+		if( rip->r_no_collector_updates ) {
+			continue;
+		}
+
+		ClassAd* public_ad = new ClassAd;
+		ClassAd private_ad;
+		rip->publish_for_update( public_ad, &private_ad );
+
+#if defined(WANT_CONTRIB) && defined(WITH_MANAGEMENT)
+#if defined(HAVE_DLOPEN) || defined(WIN32)
+		StartdPluginManager::Update( public_ad, &private_ad );
+#endif
+#endif
+
+		if( slot_records.empty() ) {
+			batch_ad.CopyAttribute( ATTR_MY_TYPE, public_ad );
+			batch_ad.CopyAttribute( ATTR_MACHINE, public_ad );
+			batch_ad.CopyAttribute( ATTR_MY_ADDRESS, public_ad );
+		}
+
+			// The whole slot, or what changed since the last batch
+		classad::ClassAd* record = new classad::ClassAd;
+		std::map<std::string, ClassAd*>::iterator last = m_batch_sent.find( rip->r_name );
+		if( full || last == m_batch_sent.end() ) {
+			record->Update( *public_ad );
+			if( ! full ) {
+				record->InsertAttr( ATTR_STARTD_BATCH_FULL, true );
+			}
+			whole_records.push_back( record );
+		} else {
+			ClassAd* last_ad = last->second;
+			classad::ClassAd::iterator it;
+			for( it = public_ad->begin(); it != public_ad->end(); ++it ) {
+				classad::ExprTree* last_expr = last_ad->Lookup( it->first );
+				if( ! last_expr || ! last_expr->SameAs( it->second ) ) {
+					record->Insert( it->first, it->second->Copy() );
+				}
+			}
+			StringList removed;
+			for( it = last_ad->begin(); it != last_ad->end(); ++it ) {
+				if( ! public_ad->Lookup( it->first ) ) {
+					removed.append( it->first.c_str() );
+				}
+			}
+			if( ! removed.isEmpty() ) {
+				char* str = removed.print_to_string();
+				record->InsertAttr( ATTR_STARTD_BATCH_REMOVED_ATTRS, str );
+				free( str );
+			}
+			record->InsertAttr( ATTR_NAME, rip->r_name );
+			change_records.push_back( record );
+		}
+		slot_records.push_back( record );
+		private_records.push_back( new classad::ClassAd( private_ad ) );
+
+		delete sent[rip->r_name];
+		sent[rip->r_name] = public_ad;
+	}
+
+	if( slot_records.empty() ) {
+		return;
+	}
+
+		// What all of the slots have in common is only sent once: at
+		// the top of a full batch, and in a batch of changes, as the
+		// changes shared by every changed slot.
+	if( full ) {
+		factor_shared_attrs( whole_records, batch_ad );
+	} else {
+		classad::ClassAd* shared_changes = new classad::ClassAd;
+		factor_shared_attrs( change_records, *shared_changes );
+		if( shared_changes->size() > 0 ) {
+			classad::ExprTree* tree = shared_changes;
+			batch_ad.Insert( ATTR_STARTD_BATCH_SHARED_CHANGES, tree );
+		} else {
+			delete shared_changes;
+		}
+	}
+
+	long long seq = m_batch_seq + 1;
+	batch_ad.Assign( ATTR_STARTD_BATCH_SEQUENCE, seq );
+	batch_ad.Assign( ATTR_STARTD_BATCH_BASE_SEQUENCE, full ? 0LL : m_batch_seq );
+
+	classad::ExprTree* tree = new classad::ExprList( slot_records );
+	batch_ad.Insert( ATTR_STARTD_BATCH_SLOT_ADS, tree );
+	tree = new classad::ExprList( private_records );
+	private_batch_ad.Insert( ATTR_STARTD_BATCH_PRIVATE_ADS, tree );
+
+	int rval = send_update( UPDATE_STARTD_ADS_BATCH, &batch_ad,
+							&private_batch_ad, true );
+	if( rval ) {
+		dprintf( D_FULLDEBUG, "Sent %s batch %lld of %d slot(s) to %d collector(s)\n",
+				 full ? "full" : "changes", seq, (int)slot_records.size(), rval );
+	} else {
+		dprintf( D_ALWAYS, "Error sending update to collector(s)\n" );
+	}
+
+		// A collector that didn't get this batch can't apply the
+		// changes in the next one, so send everything again.
+	m_batch_want_full = ( rval < daemonCore->getCollectorList()->number() );
+
+	m_batch_seq = seq;
+	if( full ) {
+		m_last_full_batch = now;
+	}
+	for( std::map<std::string, ClassAd*>::iterator it = m_batch_sent.begin();
+		 it != m_batch_sent.end(); ++it ) {
+		delete it->second;
+	}
+	m_batch_sent.swap( sent );
+}
+
+
 void
 ResMgr::update_all( void )
 {
@@ -1269,6 +1488,7 @@ ResMgr::publish( ClassAd* cp, amask_t how_much )
 
 	starter_mgr.publish( cp, how_much );
 	m_vmuniverse_mgr.publish(cp, how_much);
+	m_sandbox_cache_mgr.publish(cp, how_much);
 	startd_stats.pool.Publish(*cp, 0);
 	startd_stats.Tick(time(0));
 
@@ -1698,6 +1918,14 @@ ResMgr::removeResource( Resource* rip )
 		}
 	}
 
+		// Forget what we last sent for it, so if a new slot
+		// comes along with the same name it will be sent whole.
+	std::map<std::string, ClassAd*>::iterator sent = m_batch_sent.find( rip->r_name );
+	if( sent != m_batch_sent.end() ) {
+		delete sent->second;
+		m_batch_sent.erase( sent );
+	}
+
 		// Remove this rip from our destroy_list.
 	destroy_list.Rewind();
 	while( destroy_list.Next(rip2) ) {
@@ -36,6 +36,7 @@
 #include "claim.h"
 #include "starter_mgr.h"
 #include "vmuniverse_mgr.h"
+#include "sandbox_cache_mgr.h"
 
 #if HAVE_HIBERNATION
 #  include "hibernation_manager.h"
@@ -54,6 +55,9 @@
 
 #include "generic_stats.h"
 
+#include <map>
+#include <string>
+
 #ifndef NUM_ELEMENTS
 #define NUM_ELEMENTS(_ary)   (sizeof(_ary) / sizeof((_ary)[0]))
 #endif
@@ -145,6 +149,15 @@ public:
 
 	int		send_update( int, ClassAd*, ClassAd*, bool nonblocking );
 	void	final_update( void );
+
+		// With STARTD_BATCH_UPDATES, the slots don't update the
+		// collector(s) themselves; they ask for a batch instead, and
+		// the ads of all of the slots are sent in one message.
+	void	queue_batch_update( void );
+
+		// Make the next batch a full one, for a collector that
+		// couldn't apply our last batch of changes.
+	void	request_full_batch( void );
 	
 		// Evaluate the state of all resources.
 	void	eval_all( void );
@@ -234,6 +247,7 @@ public:
 	StarterMgr starter_mgr;
 
 	VMUniverseMgr m_vmuniverse_mgr;
+	SandboxCacheMgr m_sandbox_cache_mgr;
 
 #if HAVE_BACKFILL
 	BackfillMgr* m_backfill_mgr;
@@ -317,6 +331,20 @@ private:
 
 	int		num_updates;
 	int		up_tid;		// DaemonCore timer id for update timer
+
+		// Batched updates: every batch has a sequence number, and
+		// carries only what changed in each slot since the last batch,
+		// except that every slot is sent whole at least once per
+		// UPDATE_INTERVAL (so a collector that missed a batch catches
+		// up), and a slot that wasn't in the last batch is always sent
+		// whole.  The batch after one that some collector didn't get,
+		// or that a collector asked for, is a full one too.
+	void	do_batch_update( void );
+	int		m_batch_update_tid;
+	long long	m_batch_seq;		// sequence number of the last batch
+	time_t	m_last_full_batch;
+	bool	m_batch_want_full;	// next batch must be a full one
+	std::map<std::string, ClassAd*>	m_batch_sent;	// public ad of each slot in the last batch
 	int		poll_tid;	// DaemonCore timer id for polling timer
 	int		m_cred_sweep_tid;	// DaemonCore timer id for polling timer
 	time_t	startTime;		// Time that we started
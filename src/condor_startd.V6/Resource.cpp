@@ -1263,6 +1263,13 @@ Resource::update( void )
 	if (r_no_collector_updates)
 		return;
 
+		// With batched updates, the ResMgr sends this slot's ad
+		// along with all of the others.
+	if( startd_batch_updates ) {
+		resmgr->queue_batch_update();
+		return;
+	}
+
 	// If we haven't already queued an update, queue one.  Wait three
 	// seconds before sending an update to allow the startd's state
 	// to quiesce; we'll implicitly coalesce the updates.
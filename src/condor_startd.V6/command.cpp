@@ -2670,3 +2670,29 @@ command_cancel_drain_jobs( Service*, int /*dc_cmd*/, Stream* s )
 
 	return TRUE;
 }
+
+int
+command_request_full_batch( Service*, int /*dc_cmd*/, Stream* s )
+{
+	ClassAd ad;
+
+	s->decode();
+	if( !getClassAd(s, ad) ) {
+		dprintf(D_ALWAYS,"command_request_full_batch: failed to read classad from %s\n",s->peer_description());
+		return FALSE;
+	}
+	if( !s->end_of_message() ) {
+		dprintf(D_ALWAYS,"command_request_full_batch: failed to read end of message from %s\n",s->peer_description());
+		return FALSE;
+	}
+
+	long long sequence = 0;
+	ad.LookupInteger(ATTR_STARTD_BATCH_SEQUENCE,sequence);
+	dprintf(D_FULLDEBUG,"Collector %s couldn't apply batch %lld, will send a full batch\n",
+			s->peer_description(),sequence);
+
+	if( startd_batch_updates ) {
+		resmgr->request_full_batch();
+	}
+	return TRUE;
+}
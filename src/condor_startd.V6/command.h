@@ -129,4 +129,7 @@ int command_drain_jobs( Service*, int dc_cmd, Stream* s );
 // Cancel prior request to drain jobs
 int command_cancel_drain_jobs( Service*, int dc_cmd, Stream* s );
 
+// A collector wants all of our slots in the next batched update
+int command_request_full_batch( Service*, int dc_cmd, Stream* s );
+
 #endif /* _STARTD_COMMAND_H */
@@ -0,0 +1,141 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "condor_common.h"
+#include "condor_classad.h"
+#include "condor_debug.h"
+#include "condor_daemon_core.h"
+#include "condor_attributes.h"
+#include "condor_config.h"
+#include "startd.h"
+#include "sandbox_cache.h"
+#include "sandbox_cache_mgr.h"
+
+SandboxCacheMgr::SandboxCacheMgr() :
+	m_max_bytes(0),
+	m_clean_interval(0),
+	m_clean_tid(-1),
+	m_hits(0),
+	m_misses(0),
+	m_hit_bytes(0),
+	m_evictions(0),
+	m_cache_bytes(0),
+	m_cache_files(0)
+{
+}
+
+SandboxCacheMgr::~SandboxCacheMgr()
+{
+	if( m_clean_tid != -1 && daemonCore ) {
+		daemonCore->Cancel_Timer( m_clean_tid );
+	}
+}
+
+void
+SandboxCacheMgr::init( void )
+{
+	std::string dir;
+#if defined(LINUX)
+	param( dir, "SANDBOX_CACHE_DIR" );
+#endif
+
+	if( dir.empty() ) {
+		if( m_clean_tid != -1 ) {
+			daemonCore->Cancel_Timer( m_clean_tid );
+			m_clean_tid = -1;
+		}
+		m_dir.clear();
+		return;
+	}
+
+	if( dir != m_dir ) {
+			// the starters only create the per-user directories
+		priv_state saved_priv = set_condor_priv();
+		if( mkdir( dir.c_str(), 0700 ) == -1 && errno != EEXIST ) {
+			dprintf( D_ALWAYS, "SandboxCacheMgr: failed to create %s: %s (%d)\n",
+					 dir.c_str(), strerror(errno), errno );
+		}
+		set_priv( saved_priv );
+
+		m_dir = dir;
+		m_cache_bytes = 0;
+		m_cache_files = 0;
+	}
+
+	m_max_bytes = (filesize_t)param_integer( "SANDBOX_CACHE_MAX_MB", 10240, 0 ) * 1024 * 1024;
+
+	int interval = param_integer( "SANDBOX_CACHE_CLEAN_INTERVAL", 300, 1 );
+	if( m_clean_tid == -1 ) {
+		m_clean_tid = daemonCore->Register_Timer( 0, interval,
+			(TimerHandlercpp)&SandboxCacheMgr::clean,
+			"SandboxCacheMgr::clean", this );
+	}
+	else if( interval != m_clean_interval ) {
+		daemonCore->Reset_Timer( m_clean_tid, 0, interval );
+	}
+	m_clean_interval = interval;
+}
+
+void
+SandboxCacheMgr::clean( void )
+{
+	if( m_dir.empty() ) {
+		return;
+	}
+
+	long hits, misses;
+	filesize_t hit_bytes;
+	SandboxCache::ReadStats( m_dir.c_str(), hits, misses, hit_bytes );
+	m_hits += hits;
+	m_misses += misses;
+	m_hit_bytes += hit_bytes;
+
+	int evicted = 0;
+	SandboxCache::Clean( m_dir.c_str(), m_max_bytes, m_cache_bytes, m_cache_files, evicted );
+	m_evictions += evicted;
+
+	if( evicted ) {
+		dprintf( D_ALWAYS, "SandboxCacheMgr: evicted %d files from %s, "
+				 "leaving %d files, " FILESIZE_T_FORMAT " bytes\n",
+				 evicted, m_dir.c_str(), m_cache_files, m_cache_bytes );
+	}
+	if( m_cache_bytes > m_max_bytes ) {
+		dprintf( D_FULLDEBUG, "SandboxCacheMgr: %s is over its limit, "
+				 "but the rest of its files are in use\n", m_dir.c_str() );
+	}
+}
+
+void
+SandboxCacheMgr::publish( ClassAd* ad, amask_t mask )
+{
+	if( m_dir.empty() || !IS_UPDATE(mask) || !IS_PUBLIC(mask) ) {
+		return;
+	}
+
+	ad->Assign( ATTR_SANDBOX_CACHE_HITS, m_hits );
+	ad->Assign( ATTR_SANDBOX_CACHE_MISSES, m_misses );
+	if( m_hits + m_misses > 0 ) {
+		ad->Assign( ATTR_SANDBOX_CACHE_HIT_RATIO, (double)m_hits / (m_hits + m_misses) );
+	}
+	ad->Assign( ATTR_SANDBOX_CACHE_HIT_MB, (long long)(m_hit_bytes / (1024 * 1024)) );
+	ad->Assign( ATTR_SANDBOX_CACHE_MB, (long long)(m_cache_bytes / (1024 * 1024)) );
+	ad->Assign( ATTR_SANDBOX_CACHE_FILES, m_cache_files );
+	ad->Assign( ATTR_SANDBOX_CACHE_EVICTIONS, m_evictions );
+}
@@ -0,0 +1,60 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef _CONDOR_SANDBOX_CACHE_MGR_H
+#define _CONDOR_SANDBOX_CACHE_MGR_H
+
+#include "condor_common.h"
+#include "condor_classad.h"
+
+// Looks after the cache of job input files our starters share (see
+// SANDBOX_CACHE_DIR and sandbox_cache.h): keeps it under
+// SANDBOX_CACHE_MAX_MB and publishes how well it is doing.
+//
+class SandboxCacheMgr : public Service {
+public:
+	SandboxCacheMgr();
+	~SandboxCacheMgr();
+
+	// (re)read our configuration
+	void init( void );
+
+	void publish( ClassAd* ad, amask_t mask );
+
+private:
+	void clean( void );
+
+	std::string m_dir;
+	filesize_t  m_max_bytes;
+	int         m_clean_interval;
+	int         m_clean_tid;
+
+	// since we started
+	long        m_hits;
+	long        m_misses;
+	filesize_t  m_hit_bytes;
+	long        m_evictions;
+
+	// as of the last clean()
+	filesize_t  m_cache_bytes;
+	int         m_cache_files;
+};
+
+#endif /* _CONDOR_SANDBOX_CACHE_MGR_H */
@@ -129,6 +129,7 @@ extern	char*	Name;			// The startd's name
 extern	bool	compute_avail_stats;
 	// should the startd compute slot availability statistics; currently
 	// false by default
+extern	bool	startd_batch_updates;	// Send the ads of all slots in one update
 
 extern	int		pid_snapshot_interval;	
     // How often do we take snapshots of the pid families? 
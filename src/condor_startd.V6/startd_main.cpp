@@ -89,6 +89,10 @@ bool	compute_avail_stats = false;
 	// should the startd compute slot availability statistics; currently 
 	// false by default
 
+bool	startd_batch_updates = false;
+	// should the startd send the ads of all slots to the collector in
+	// one batch (STARTD_BATCH_UPDATES)
+
 char* Name = NULL;
 
 #define DEFAULT_PID_SNAPSHOT_INTERVAL 15
@@ -219,6 +223,9 @@ main_init( int, char* argv[] )
 	bench_job_mgr = new StartdBenchJobMgr( );
 	bench_job_mgr->Initialize( "benchmarks" );
 
+		// Start looking after the starters' cache of input files
+	resmgr->m_sandbox_cache_mgr.init();
+
 		// Now that we have our classads, we can compute things that
 		// need to be evaluated
 	resmgr->walk( &Resource::compute, A_EVALUATED );
@@ -387,6 +394,10 @@ main_init( int, char* argv[] )
 								  "CANCEL_DRAIN_JOBS",
 								  (CommandHandler)command_cancel_drain_jobs,
 								  "command_cancel_drain_jobs", 0, ADMINISTRATOR);
+	daemonCore->Register_Command( REQUEST_FULL_STARTD_BATCH,
+								  "REQUEST_FULL_STARTD_BATCH",
+								  (CommandHandler)command_request_full_batch,
+								  "command_request_full_batch", 0, DAEMON );
 
 		//////////////////////////////////////////////////
 		// Reapers 
@@ -462,6 +473,7 @@ finish_main_config( void )
 	cron_job_mgr->Reconfig(  );
 	bench_job_mgr->Reconfig(  );
 	resmgr->starter_mgr.init();
+	resmgr->m_sandbox_cache_mgr.init();
 
 #if HAVE_HIBERNATION
 	resmgr->updateHibernateConfiguration();
@@ -563,6 +575,8 @@ init_params( int /* first_time */)
 	compute_avail_stats = false;
 	compute_avail_stats = param_boolean( "STARTD_COMPUTE_AVAIL_STATS", false );
 
+	startd_batch_updates = param_boolean( "STARTD_BATCH_UPDATES", false );
+
 	auto_free_ptr tmp(param("STARTD_NAME"));
 	if (tmp) {
 		if( Name ) {
@@ -2332,6 +2332,16 @@ JICShadow::beginFileTransfer( void )
 			filetrans->setPeerVersion( *shadow_version );
 		}
 
+#if defined(LINUX)
+			// the cache links files by descriptor, through
+			// /proc/self/fd (see sandbox_cache.h)
+		std::string cache_dir;
+		if( param(cache_dir, "SANDBOX_CACHE_DIR") ) {
+			filesize_t min_file_size = param_integer("SANDBOX_CACHE_MIN_FILE_MB", 1, 0);
+			filetrans->setSandboxCache(cache_dir.c_str(), min_file_size * 1024 * 1024);
+		}
+#endif
+
 		if( ! filetrans->DownloadFiles(false) ) { // do not block
 				// Error starting the non-blocking file transfer.  For
 				// now, consider this a fatal error
@@ -0,0 +1,169 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+// Converts a ClassAd log (the job queue log in particular) between the
+// text form and the form that keeps the ads in a binary snapshot.  The
+// schedd must not be running on the log being converted.
+
+#include "condor_common.h"
+#include "condor_config.h"
+#include "condor_debug.h"
+#include "condor_distribution.h"
+#include "subsystem_info.h"
+#include "basename.h"
+#include "classad_log.h"
+#include "classad_log_snapshot.h"
+
+static const char * MyName = "condor_convert_job_queue";
+
+static void
+usage(FILE * out)
+{
+	fprintf(out,
+		"Usage: %s [-help] -binary | -text <log> [<new log>]\n"
+		"    -binary    write the ads to a binary snapshot next to the new log\n"
+		"    -text      write the ads to the new log as text\n"
+		"  With no <new log>, the log is replaced, and the original is\n"
+		"  renamed to end in '.oldver'.\n",
+		MyName);
+}
+
+int
+main(int argc, const char * argv[])
+{
+	MyName = condor_basename(argv[0]);
+	set_mySubSystem("TOOL", SUBSYSTEM_TYPE_TOOL);
+	myDistro->Init(argc, argv);
+	config();
+
+	int binary = -1;
+	const char * log_name = NULL;
+	const char * new_log_name = NULL;
+	for (int ii = 1; ii < argc; ++ii) {
+		if (strcmp(argv[ii], "-help") == 0) {
+			usage(stdout);
+			return 0;
+		} else if (strcmp(argv[ii], "-binary") == 0) {
+			binary = 1;
+		} else if (strcmp(argv[ii], "-text") == 0) {
+			binary = 0;
+		} else if (argv[ii][0] == '-') {
+			fprintf(stderr, "%s: unknown option %s\n", MyName, argv[ii]);
+			usage(stderr);
+			return 1;
+		} else if ( ! log_name) {
+			log_name = argv[ii];
+		} else if ( ! new_log_name) {
+			new_log_name = argv[ii];
+		} else {
+			usage(stderr);
+			return 1;
+		}
+	}
+	if (binary < 0 || ! log_name) {
+		usage(stderr);
+		return 1;
+	}
+	bool in_place = ! new_log_name;
+	if (in_place) {
+		new_log_name = log_name;
+	}
+
+	struct stat st;
+	if (stat(log_name, &st) < 0) {
+		fprintf(stderr, "%s: can't read %s: %s\n", MyName, log_name, strerror(errno));
+		return 1;
+	}
+
+	HashTable<HashKey, ClassAd*> table(CLASSAD_LOG_HASHTABLE_SIZE, HashKey::hash);
+	ClassAdLogTable<HashKey, ClassAd*> la(table);
+	unsigned long sequence_number = 0;
+	time_t birthdate = 0;
+	bool is_clean = true, requires_successful_cleaning = false, loaded_snapshot = false;
+	MyString errmsg;
+
+	FILE * log_fp = LoadClassAdLog(log_name, la, DefaultMakeClassAdLogTableEntry,
+		sequence_number, birthdate,
+		is_clean, requires_successful_cleaning, loaded_snapshot, errmsg);
+	if ( ! log_fp) {
+		fprintf(stderr, "%s: failed to read %s: %s\n", MyName, log_name, errmsg.Value());
+		return 1;
+	}
+	fclose(log_fp);
+	if ( ! errmsg.empty()) {
+		fprintf(stderr, "%s: %s has the following issues: %s\n", MyName, log_name, errmsg.Value());
+	}
+	if (requires_successful_cleaning) {
+		fprintf(stderr, "%s: the incomplete transaction at the end of %s was dropped\n", MyName, log_name);
+	}
+
+	MyString tmp_name;
+	tmp_name.formatstr("%s.new", new_log_name);
+	FILE * new_fp = safe_fopen_wrapper_follow(tmp_name.Value(), "w");
+	if ( ! new_fp) {
+		fprintf(stderr, "%s: can't create %s: %s\n", MyName, tmp_name.Value(), strerror(errno));
+		return 1;
+	}
+
+	errmsg.clear();
+	bool ok;
+	if (binary) {
+		ok = WriteClassAdLogSnapshotState(new_fp, tmp_name.Value(), new_log_name,
+			sequence_number, birthdate, la, errmsg);
+	} else {
+		ok = WriteClassAdLogState(new_fp, tmp_name.Value(),
+			sequence_number, birthdate, la, DefaultMakeClassAdLogTableEntry, errmsg);
+	}
+	if (fclose(new_fp) != 0) {
+		ok = false;
+	}
+	if ( ! ok) {
+		fprintf(stderr, "%s: failed to write %s: %s\n", MyName, tmp_name.Value(), errmsg.Value());
+		unlink(tmp_name.Value());
+		return 1;
+	}
+
+	if (in_place) {
+		MyString old_name;
+		old_name.formatstr("%s.oldver", log_name);
+		if (rename(log_name, old_name.Value()) < 0) {
+			fprintf(stderr, "%s: failed to rename %s to %s: %s\n", MyName, log_name, old_name.Value(), strerror(errno));
+			unlink(tmp_name.Value());
+			return 1;
+		}
+		printf("The original log was renamed to %s\n", old_name.Value());
+	}
+	if (rename(tmp_name.Value(), new_log_name) < 0) {
+		fprintf(stderr, "%s: failed to rename %s to %s: %s\n", MyName, tmp_name.Value(), new_log_name, strerror(errno));
+		return 1;
+	}
+
+	int num_ads = table.getNumElements();
+	printf("Wrote %d ads from %s%s to %s%s\n", num_ads,
+		log_name, loaded_snapshot ? " (binary)" : "",
+		new_log_name, binary ? " (binary)" : "");
+
+	ClassAd * ad;
+	HashKey key;
+	table.startIterations();
+	while (table.iterate(key, ad) == 1) {
+		delete ad;
+	}
+	return 0;
+}
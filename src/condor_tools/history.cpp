@@ -46,6 +46,8 @@
 #include "classad_helpers.h" // for initStringListFromAttrs
 #include "history_utils.h"
 #include "backward_file_reader.h"
+#include "history_index.h"
+#include "history_archive.h"
 #include <fcntl.h>  // for O_BINARY
 
 #ifdef HAVE_EXT_POSTGRESQL
@@ -123,6 +125,8 @@ static void readHistoryRemote(classad::ExprTree *constraintExpr);
 static void readHistoryFromFiles(bool fileisuserlog, const char *JobHistoryFileName, const char* constraint, ExprTree *constraintExpr);
 static void readHistoryFromFileOld(const char *JobHistoryFileName, const char* constraint, ExprTree *constraintExpr);
 static void readHistoryFromFileEx(const char *JobHistoryFileName, const char* constraint, ExprTree *constraintExpr, bool read_backwards);
+static void readHistoryFromFilesIndexed(const char * const * files, int numFiles, const char* constraint, ExprTree *constraintExpr);
+static void readHistoryFromArchive(const char *JobHistoryFileName, const char* constraint, ExprTree *constraintExpr, bool read_backwards);
 static void printJobAds(ClassAdList & jobs);
 static void printJob(ClassAd & ad);
 
@@ -1274,8 +1278,10 @@ static void readHistoryFromFiles(bool fileisuserlog, const char *JobHistoryFileN
             }
             printJobAds(jobs);
             jobs.Clear();
-        } else {
+        } else if (backwards) {
             // If the user specified the name of the file to read, we read that file only.
+            readHistoryFromFilesIndexed(&JobHistoryFileName, 1, constraint, constraintExpr);
+        } else {
             readHistoryFromFileEx(JobHistoryFileName, constraint, constraintExpr, backwards);
         }
     } else {
@@ -1298,9 +1304,7 @@ static void readHistoryFromFiles(bool fileisuserlog, const char *JobHistoryFileN
         if (historyFiles && numHistoryFiles > 0) {
             int fileIndex;
             if (backwards) { // Reverse reading of history files array
-                for(fileIndex = numHistoryFiles - 1; fileIndex >= 0; fileIndex--) {
-                    readHistoryFromFileEx(historyFiles[fileIndex], constraint, constraintExpr, backwards);
-                }
+                readHistoryFromFilesIndexed(historyFiles, numHistoryFiles, constraint, constraintExpr);
             }
             else {
                 for (fileIndex = 0; fileIndex < numHistoryFiles; fileIndex++) {
@@ -1644,6 +1648,8 @@ static void printJob(ClassAd & ad)
 
 // convert list of expressions into a classad
 //
+static void printJobIfConstraint(ClassAd & ad, const char* constraint, ExprTree *constraintExpr);
+
 static void printJobIfConstraint(std::vector<std::string> & exprs, const char* constraint, ExprTree *constraintExpr)
 {
 	if ( ! exprs.size())
@@ -1665,6 +1671,12 @@ static void printJobIfConstraint(std::vector<std::string> & exprs, const char* c
 		}
 		exprs.pop_back();
 	}
+
+	printJobIfConstraint(ad, constraint, constraintExpr);
+}
+
+static void printJobIfConstraint(ClassAd & ad, const char* constraint, ExprTree *constraintExpr)
+{
 	++adCount;
 
 	if (sinceExpr && EvalBool(&ad, sinceExpr)) {
@@ -1713,6 +1725,11 @@ static void readHistoryFromFileEx(const char *JobHistoryFileName, const char* co
 		return;
 	}
 
+	if (IsHistoryArchive(JobHistoryFileName)) {
+		readHistoryFromArchive(JobHistoryFileName, constraint, constraintExpr, read_backwards);
+		return;
+	}
+
 	// the old function doesn't work for backwards, but it does work for forwards so go ahead and call it.
 	//
 	if ( ! read_backwards) {
@@ -1809,6 +1826,146 @@ static void readHistoryFromFileEx(const char *JobHistoryFileName, const char* co
 	reader.Close();
 }
 
+// the part of the constraint that the history index or archive can check.
+static void initHistoryFilter(HistoryIndexFilter & filter, const char* constraint, ExprTree *constraintExpr)
+{
+	// the ads that stop the scan have to be read even if they don't match.
+	if (constraint && constraint[0] && constraintExpr) {
+		if (sinceExpr) {
+			ExprTree * tree = JoinExprTreeCopiesWithOp(classad::Operation::LOGICAL_OR_OP, constraintExpr, sinceExpr);
+			filter.init(tree);
+			delete tree;
+		} else {
+			filter.init(constraintExpr);
+		}
+	}
+}
+
+// Read history files backwards, newest first, using the index of each file
+// to skip the ads that can't match.  Files without a usable index are read
+// by readHistoryFromFileEx.
+static void readHistoryFromFilesIndexed(const char * const * files, int numFiles, const char* constraint, ExprTree *constraintExpr)
+{
+	HistoryIndexFilter filter;
+	initHistoryFilter(filter, constraint, constraintExpr);
+
+	HistoryIndexReader reader(files, numFiles, filter);
+	const char * filename;
+	bool indexed;
+	while (reader.nextFile(filename, indexed)) {
+		if ( ! indexed) {
+			readHistoryFromFileEx(filename, constraint, constraintExpr, true);
+			continue;
+		}
+		if ((specifiedMatch > 0 && matchCount >= specifiedMatch) || (maxAds > 0 && adCount >= maxAds) || abort_transfer) {
+			break;
+		}
+
+		if(longformat && use_xml) {
+			std::string out;
+			AddClassAdXMLFileHeader(out);
+			printf("%s\n", out.c_str());
+		} else if( use_json ) {
+			printf( "[\n" );
+		}
+
+		std::string text;
+		std::vector<std::string> exprs;
+		int skipped;
+		for (;;) {
+			bool more = reader.nextAd(text, skipped);
+			// the ads the index skipped count against the scan limit.
+			adCount += skipped;
+			if (maxAds > 0 && adCount > maxAds) {
+				adCount = maxAds;
+			}
+			if ( ! more)
+				break;
+			if ((specifiedMatch > 0 && matchCount >= specifiedMatch) || (maxAds > 0 && adCount >= maxAds))
+				break;
+			if (abort_transfer)
+				break;
+			HistoryIndexReader::adLines(text, exprs);
+			printJobIfConstraint(exprs, constraint, constraintExpr);
+		}
+
+		if(longformat && use_xml) {
+			std::string out;
+			AddClassAdXMLFileFooter(out);
+			printf("%s\n", out.c_str());
+		} else if( use_json ) {
+			printf( "]\n" );
+		}
+	}
+}
+
+// Read a history archive, skipping the blocks and ads that can't match the
+// constraint.  When the output is whole ads, only the projected attributes
+// (and the ones the constraint needs) are read.
+static void readHistoryFromArchive(const char *JobHistoryFileName, const char* constraint, ExprTree *constraintExpr, bool read_backwards)
+{
+	HistoryArchiveReader reader;
+	std::string errmsg;
+	if ( ! reader.open(JobHistoryFileName, errmsg)) {
+		fprintf(stderr,"Error opening history file %s: %s\n", JobHistoryFileName, errmsg.c_str());
+		exit(1);
+	}
+
+	HistoryIndexFilter filter;
+	initHistoryFilter(filter, constraint, constraintExpr);
+	reader.setFilter(&filter);
+	reader.setBackwards(read_backwards);
+
+	// the custom formats may refer to attributes that are not in the projection,
+	// so only whole ads are projected.
+	if (longformat && ! projection.isEmpty()) {
+		for (const char * attr = projection.first(); attr != NULL; attr = projection.next()) {
+			reader.project(attr);
+		}
+		if (constraint && constraint[0] && constraintExpr) {
+			reader.projectReferences(constraintExpr);
+		}
+		if (sinceExpr) {
+			reader.projectReferences(sinceExpr);
+		}
+	}
+
+	if(longformat && use_xml) {
+		std::string out;
+		AddClassAdXMLFileHeader(out);
+		printf("%s\n", out.c_str());
+	} else if( use_json ) {
+		printf( "[\n" );
+	}
+
+	ClassAd ad;
+	int skipped;
+	for (;;) {
+		bool more = reader.nextAd(ad, skipped);
+		// the ads the archive skipped count against the scan limit.
+		adCount += skipped;
+		if (maxAds > 0 && adCount > maxAds) {
+			adCount = maxAds;
+		}
+		if ( ! more)
+			break;
+		if ((specifiedMatch > 0 && matchCount >= specifiedMatch) || (maxAds > 0 && adCount >= maxAds))
+			break;
+		if (abort_transfer)
+			break;
+		printJobIfConstraint(ad, constraint, constraintExpr);
+	}
+
+	if(longformat && use_xml) {
+		std::string out;
+		AddClassAdXMLFileFooter(out);
+		printf("%s\n", out.c_str());
+	} else if( use_json ) {
+		printf( "]\n" );
+	}
+	reader.close();
+}
+
 // !!! ENTRIES IN THIS TABLE MUST BE SORTED BY THE FIRST FIELD !!
 static const CustomFormatFnTableItem LocalPrintFormats[] = {
 	{ "DATE",            ATTR_Q_DATE, 0, format_int_date, NULL },
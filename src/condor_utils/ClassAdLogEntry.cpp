@@ -179,6 +179,7 @@ ClassAdLogEntry::equal(ClassAdLogEntry* caLogEntry)
 			return 1;
 			break;
 		case CondorLogOp_LogHistoricalSequenceNumber: // key, value
+		case CondorLogOp_Snapshot: // key, value
 			if (valcmp(caLogEntry->key, key) == 0 &&
 				valcmp(caLogEntry->value, value) == 0) {
 				return 1;
@@ -43,6 +43,9 @@
 //! Definition of End Transaction Command Type Constant
 #define CondorLogOp_LogHistoricalSequenceNumber	107
 
+//! Definition of Snapshot Command Type Constant
+#define CondorLogOp_Snapshot			108
+
 
 //! ClassAdLogEntry
 /*! \brief this models each ClassAd Log Entry
@@ -29,6 +29,7 @@ const char *EMPTY_CLASSAD_TYPE_NAME = "(empty)"; // normally in classad_log.h/cp
 #else
 #include "condor_common.h"
 #include "condor_io.h"
+#include "classad_log_snapshot.h"
 extern const char *EMPTY_CLASSAD_TYPE_NAME; // defined in classad_log.cpp
 #endif
 
@@ -61,11 +62,17 @@ ClassAdLogParser::ClassAdLogParser()
 	m_close_fp = true;
 	nextOffset = 0;
 	job_queue_name[0] = '\0';
+	expand_snapshots = false;
+	snapshot = NULL;
+	snapshot_key = NULL;
 }
 
 ClassAdLogParser::~ClassAdLogParser()
 {
 	closeFile();
+#ifndef _NO_CONDOR_
+	closeSnapshot();
+#endif
 }
 
 
@@ -105,6 +112,10 @@ ClassAdLogParser::setNextOffset(long offset)
 	}
 	else {
 		nextOffset = offset;
+#ifndef _NO_CONDOR_
+			// starting over, so forget the rest of a snapshot
+		closeSnapshot();
+#endif
 	}
 }
 
@@ -158,6 +169,12 @@ ClassAdLogParser::readLogEntry(int &op_type)
 {
 	int	rval;
 
+#ifndef _NO_CONDOR_
+	if (snapshot) {
+		return readSnapshotEntry(op_type);
+	}
+#endif
+
     // move to the current offset
     if (log_fp && fseek(log_fp, nextOffset, SEEK_SET) != 0) {
         closeFile();
@@ -203,6 +220,9 @@ ClassAdLogParser::readLogEntry(int &op_type)
 			case CondorLogOp_EndTransaction:
 		    rval = readEndTransactionBody(log_fp);
 				break;
+			case CondorLogOp_Snapshot:
+		    rval = readSnapshotBody(log_fp);
+				break;
 		    default:
 		    closeFile();
 			    return FILE_READ_ERROR;
@@ -283,9 +303,88 @@ ClassAdLogParser::readLogEntry(int &op_type)
 
 	curCALogEntry.next_offset = nextOffset;
 
+#ifndef _NO_CONDOR_
+	if (op_type == CondorLogOp_Snapshot && expand_snapshots) {
+		return openSnapshot(op_type);
+	}
+#endif
+
 	return FILE_READ_SUCCESS;
 }
 
+#ifndef _NO_CONDOR_
+FileOpErrCode
+ClassAdLogParser::openSnapshot(int &op_type)
+{
+	std::string path = ClassAdLogSnapshotPath(job_queue_name, curCALogEntry.key);
+	std::string errmsg;
+	snapshot = new ClassAdLogSnapshotReader();
+	if ( ! snapshot->open(path.c_str(), errmsg)) {
+		dprintf(D_ALWAYS, "Failed to read snapshot of %s: %s\n", job_queue_name, errmsg.c_str());
+		closeSnapshot();
+		closeFile();
+		return FILE_READ_ERROR;
+	}
+
+		// the ads come before the Snapshot command, which is returned last
+		// so that the last entry is one that is really in the log.
+	snapshotCALogEntry.init(curCALogEntry.op_type);
+	snapshotCALogEntry = curCALogEntry;
+	curCALogEntry.init(lastCALogEntry.op_type);
+	curCALogEntry = lastCALogEntry;
+	return readSnapshotEntry(op_type);
+}
+
+FileOpErrCode
+ClassAdLogParser::readSnapshotEntry(int &op_type)
+{
+	lastCALogEntry.init(curCALogEntry.op_type);
+	lastCALogEntry = curCALogEntry;
+
+	std::string key, mytype, targettype, name, value, errmsg;
+	if (snapshot->nextAttribute(name, value, errmsg)) {
+		op_type = CondorLogOp_SetAttribute;
+		curCALogEntry.init(op_type);
+		curCALogEntry.key = strdup(snapshot_key);
+		curCALogEntry.name = strdup(name.c_str());
+		curCALogEntry.value = strdup(value.c_str());
+	} else if (errmsg.empty() && snapshot->nextAd(key, mytype, targettype, errmsg)) {
+		op_type = CondorLogOp_NewClassAd;
+		curCALogEntry.init(op_type);
+		curCALogEntry.key = strdup(key.c_str());
+		curCALogEntry.mytype = strdup(mytype.c_str());
+		curCALogEntry.targettype = strdup(targettype.c_str());
+		free(snapshot_key);
+		snapshot_key = strdup(key.c_str());
+	} else if (errmsg.empty()) {
+		op_type = CondorLogOp_Snapshot;
+		curCALogEntry.init(op_type);
+		curCALogEntry = snapshotCALogEntry;
+		closeSnapshot();
+		return FILE_READ_SUCCESS;
+	} else {
+		dprintf(D_ALWAYS, "Failed to read snapshot %s of %s: %s\n",
+				snapshotCALogEntry.key, job_queue_name, errmsg.c_str());
+		closeSnapshot();
+		closeFile();
+		return FILE_READ_ERROR;
+	}
+
+	curCALogEntry.offset = snapshotCALogEntry.offset;
+	curCALogEntry.next_offset = snapshotCALogEntry.offset;
+	return FILE_READ_SUCCESS;
+}
+
+void
+ClassAdLogParser::closeSnapshot()
+{
+	delete snapshot;
+	snapshot = NULL;
+	free(snapshot_key);
+	snapshot_key = NULL;
+}
+#endif
+
 /*!
 	\warning each pointer must be freed by a calling funtion
 */
@@ -494,6 +593,27 @@ ClassAdLogParser::readEndTransactionBody(FILE *fp)
 	return( 1 );
 }
 
+int
+ClassAdLogParser::readSnapshotBody(FILE *fp)
+{
+	curCALogEntry.init(CondorLogOp_Snapshot);
+
+		// This code part is borrowed from LogSnapshot::ReadBody
+		// in classad_log.cpp
+	int rval, rval1;
+
+	rval1 = readword(fp, curCALogEntry.key);
+	if (rval1 < 0) {
+		return rval1;
+	}
+
+	rval = readline(fp, curCALogEntry.value);
+	if (rval < 0) {
+		return rval;
+	}
+	return rval + rval1;
+}
+
 int
 ClassAdLogParser::readLogHistoricalSNBody(FILE *fp)
 {
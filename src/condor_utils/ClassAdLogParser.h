@@ -43,6 +43,8 @@ enum FileOpErrCode {    FILE_OPEN_ERROR,
 //used to distinguish between first and successive calls
 #define IMPOSSIBLE_OFFSET -10000
 
+class ClassAdLogSnapshotReader;
+
 //! ClassAdLogParser
 /*! \brief Parser for ClassAd Log file
  *
@@ -97,6 +99,14 @@ public:
 	//!	get the body of a historical sequence number command
 	ParserErrCode	getLogHistoricalSNBody(char*& seqnum, char*& timestamp);
 
+#ifndef _NO_CONDOR_
+	//! read the ads in the snapshot named by a Snapshot command, as
+	//! New ClassAd and Set Attribute commands at the offset of the
+	//! Snapshot command, before the Snapshot command itself.  otherwise
+	//! the Snapshot command is returned, and the ads are not seen.
+	void	setExpandSnapshots(bool expand) { expand_snapshots = expand; }
+#endif
+
 	//! read a classad log entry in the current offset of a file
 	FileOpErrCode readLogEntry(int &op_type);
 
@@ -121,6 +131,13 @@ private:
 	int 	readDeleteAttributeBody(FILE *fp);
 	int 	readBeginTransactionBody(FILE *fp);
 	int 	readEndTransactionBody(FILE *fp);
+	int 	readSnapshotBody(FILE *fp);
+
+#ifndef _NO_CONDOR_
+	FileOpErrCode	openSnapshot(int &op_type);
+	FileOpErrCode	readSnapshotEntry(int &op_type);
+	void	closeSnapshot();
+#endif
 		
 		//
 		// data
@@ -133,6 +150,11 @@ private:
 
 	FILE 	*log_fp;
 	bool	m_close_fp;	// are we responsible for closing log_fp?
+
+	bool	expand_snapshots;
+	ClassAdLogSnapshotReader *snapshot;	//!< snapshot being expanded
+	ClassAdLogEntry	snapshotCALogEntry;	//!< the Snapshot command
+	char	*snapshot_key;	//!< key of the ad being expanded
 };
 
 #endif /* _CLASSADLOGPARSER_H_ */
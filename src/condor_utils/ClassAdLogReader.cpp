@@ -46,6 +46,9 @@ ClassAdLogIterator::ClassAdLogIterator(const std::string &fname) :
 	m_eof(true)
 {
 	m_parser->setJobQueueName(fname.c_str());
+#ifndef _NO_CONDOR_
+	m_parser->setExpandSnapshots(true);
+#endif
 	Next();
 }
 
@@ -236,6 +239,11 @@ ClassAdLogIterator::Process(const ClassAdLogEntry &log_entry)
 	case CondorLogOp_EndTransaction:
 	case CondorLogOp_LogHistoricalSequenceNumber:
 		return false;
+#ifndef _NO_CONDOR_
+	case CondorLogOp_Snapshot:
+		// the parser has already given us the ads in the snapshot
+		return false;
+#endif
 	default:
 		dprintf(D_ALWAYS, "error reading %s: Unsupported Job Queue Command\n", m_fname.c_str());
 		m_current.reset(new ClassAdLogIterEntry(ClassAdLogIterEntry::ET_ERR));
@@ -247,6 +255,9 @@ ClassAdLogReader::ClassAdLogReader(ClassAdLogConsumer *consumer):
 	m_consumer(consumer)
 {
 	m_consumer->SetClassAdLogReader(this);
+#ifndef _NO_CONDOR_
+	parser.setExpandSnapshots(true);
+#endif
 }
 
 ClassAdLogReader::~ClassAdLogReader()
@@ -393,6 +404,11 @@ ClassAdLogReader::ProcessLogEntry(ClassAdLogEntry *log_entry,
 		break;
 	case CondorLogOp_LogHistoricalSequenceNumber:
 		break;
+#ifndef _NO_CONDOR_
+	case CondorLogOp_Snapshot:
+		// the parser has already given us the ads in the snapshot
+		break;
+#endif
 	default:
 #ifdef _NO_CONDOR_
 		syslog(LOG_ERR,
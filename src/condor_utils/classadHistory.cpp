@@ -29,9 +29,16 @@
 #include "condor_email.h"
 
 #include "classadHistory.h"
+#include "history_index.h"
+#include "history_archive.h"
+#include "condor_daemon_core.h"
+
+#include <map>
+#include <string>
 
 static FILE *HistoryFile_fp = NULL;
 static int HistoryFile_RefCount = 0;
+static HistoryIndexWriter HistoryIndex;
 
 char* JobHistoryFileName = NULL;
 bool        DoHistoryRotation = true;
@@ -39,6 +46,8 @@ bool        DoDailyHistoryRotation = true;
 bool        DoMonthlyHistoryRotation = true;
 filesize_t  MaxHistoryFileSize = 20 * 1024 * 1024; // 20MB;
 int         NumberBackupHistoryFiles = 2;
+bool        DoHistoryIndex = true;
+bool        DoHistoryArchive = false;
 char*       PerJobHistoryDir = NULL;
 
 static void MaybeRotateHistory(int size_to_append);
@@ -46,6 +55,9 @@ static void RemoveExtraHistoryFiles(void);
 static int MaybeDeleteOneHistoryBackup(void);
 static bool IsHistoryFilename(const char *filename, time_t *backup_time);
 static void RotateHistory(void);
+static void StartArchiveRotatedHistory(const char *filename);
+static void CancelArchiveRotatedHistory(const char *filename);
+static bool ArchiveRotatedHistory(const char *filename);
 static int findHistoryOffset(FILE *LogFile);
 static FILE* OpenHistoryFile();
 static void CloseJobHistoryFile();
@@ -75,6 +87,8 @@ InitJobHistoryFile(const char *history_param, const char *per_job_history_param)
     NumberBackupHistoryFiles = param_integer("MAX_HISTORY_ROTATIONS", 
                                           2,  // default
                                           1); // minimum
+    DoHistoryIndex = param_boolean("ENABLE_HISTORY_INDEX", true);
+    DoHistoryArchive = param_boolean("ROTATE_HISTORY_TO_ARCHIVE", false);
 
     if (DoHistoryRotation) {
         dprintf(D_ALWAYS, "History file rotation is enabled.\n");
@@ -137,6 +151,7 @@ AppendHistory(ClassAd* ad)
 	  failed = true;
   } else {
 	  int offset = findHistoryOffset(LogFile);
+	  long ad_start = ftell(LogFile);
 	  if (!fPrintAd(LogFile, *ad)) {
 		  dprintf(D_ALWAYS, 
 				  "ERROR: failed to write job class ad to history file %s\n",
@@ -162,6 +177,10 @@ AppendHistory(ClassAd* ad)
                       "*** Offset = %d ClusterId = %d ProcId = %d Owner = \"%s\" CompletionDate = %d\n",
 				  offset, cluster, proc, owner.Value(), completion);
 		  fflush( LogFile );
+
+		  if (HistoryIndex.isOpen() && ad_start >= 0) {
+			  HistoryIndex.append(*ad, ad_start, ftell(LogFile) - ad_start);
+		  }
       }
   }
 
@@ -304,6 +323,15 @@ OpenHistoryFile() {
 			close(fd);
 			return NULL;
 		}
+		if (DoHistoryIndex) {
+			struct stat st;
+			if (fstat(fd, &st) == 0) {
+				HistoryIndex.open(JobHistoryFileName, st.st_size);
+			}
+		} else {
+				// don't leave an index that will no longer be kept up to date
+			RemoveHistoryIndex(JobHistoryFileName);
+		}
 	}
 	HistoryFile_RefCount++;
 	return HistoryFile_fp;
@@ -324,6 +352,7 @@ CloseJobHistoryFile() {
 		fclose( HistoryFile_fp );
 		HistoryFile_fp = NULL;
 	}
+	HistoryIndex.close();
 }
 
 // --------------------------------------------------------------------------
@@ -477,10 +506,16 @@ MaybeDeleteOneHistoryBackup(void)
                     oldest_history_filename);
             num_backups--;
 
+            MyString oldest_path;
+            oldest_path.formatstr("%s%c%s", history_dir, DIR_DELIM_CHAR, oldest_history_filename);
+            CancelArchiveRotatedHistory(oldest_path.Value());
+
             if (dir.Find_Named_Entry(oldest_history_filename)) {
                 if (!dir.Remove_Current_File()) {
                     dprintf(D_ALWAYS, "Failed to delete %s\n", oldest_history_filename);
                     num_backups = 0; // prevent looping forever
+                } else {
+                    RemoveHistoryIndex(oldest_path.Value());
                 }
             } else {
                 dprintf(D_ALWAYS, "Failed to find/delete %s\n", oldest_history_filename);
@@ -563,11 +598,123 @@ RotateHistory(void)
         dprintf(D_ALWAYS, "Failed to rotate history file to %s\n",
                 rotated_history_name.Value());
         dprintf(D_ALWAYS, "Because rotation failed, the history file may get very large.\n");
+    } else {
+        RenameHistoryIndex(JobHistoryFileName, rotated_history_name.Value());
+        if (DoHistoryArchive) {
+            StartArchiveRotatedHistory(rotated_history_name.Value());
+        }
     }
 
     return;
 }
 
+// --------------------------------------------------------------------------
+// Rewriting a rotated history file takes a while, so it is done in a child
+// process (a thread on Windows), and the file stays text until the child
+// renames the archive into place. A rotated file that is about to be deleted
+// while its child is still at it has the child killed first, so that the
+// child can't put the file back.
+// --------------------------------------------------------------------------
+static std::map<int, std::string> ArchiveThreads; // the file each child archives, by tid
+static std::string ArchivingFile; // the file of the child being created
+
+static std::string
+ArchiveTmpName(const char *filename)
+{
+    MyString tmp_name(filename);
+    tmp_name.setChar(condor_basename(filename) - filename, '\0');
+    tmp_name.formatstr_cat(".%s.tmp", condor_basename(filename));
+    return tmp_name.Value();
+}
+
+static int
+ArchiveHistoryThread(void *, Stream *)
+{
+    return ArchiveRotatedHistory(ArchivingFile.c_str()) ? 0 : 1;
+}
+
+static int
+ArchiveHistoryReaper(Service *, int tid, int exit_status)
+{
+    std::map<int, std::string>::iterator it = ArchiveThreads.find(tid);
+    if (it == ArchiveThreads.end()) {
+        return 0;
+    }
+    if (exit_status != 0) {
+        dprintf(D_ALWAYS, "Archiving history file %s failed (status %d), leaving it as text\n",
+                it->second.c_str(), exit_status);
+            // in case the child was killed before it could clean up
+        unlink(ArchiveTmpName(it->second.c_str()).c_str());
+    }
+    ArchiveThreads.erase(it);
+    return 0;
+}
+
+static void
+StartArchiveRotatedHistory(const char *filename)
+{
+    if (!daemonCore) {
+        ArchiveRotatedHistory(filename);
+        return;
+    }
+
+    static int reaper_id = -1;
+    if (reaper_id < 0) {
+        reaper_id = daemonCore->Register_Reaper("ArchiveHistoryReaper",
+                ArchiveHistoryReaper, "ArchiveHistoryReaper");
+    }
+
+    ArchivingFile = filename;
+    int tid = daemonCore->Create_Thread(ArchiveHistoryThread, NULL, NULL, reaper_id);
+    if (!tid) {
+        dprintf(D_ALWAYS, "Failed to start archiving history file %s, leaving it as text\n",
+                filename);
+        return;
+    }
+    ArchiveThreads[tid] = filename;
+}
+
+static void
+CancelArchiveRotatedHistory(const char *filename)
+{
+    std::map<int, std::string>::iterator it;
+    for (it = ArchiveThreads.begin(); it != ArchiveThreads.end(); ++it) {
+        if (it->second == filename) {
+            dprintf(D_ALWAYS, "Stopping the archiving of history file %s\n", filename);
+            daemonCore->Kill_Thread(it->first);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Rewrite a rotated history file as a columnar archive, under the same name
+// so that it is found and removed like any other rotated history file.
+// --------------------------------------------------------------------------
+static bool
+ArchiveRotatedHistory(const char *filename)
+{
+    std::string tmp_name = ArchiveTmpName(filename);
+
+    int num_ads = 0;
+    std::string errmsg;
+    if (!WriteHistoryArchive(filename, tmp_name.c_str(), num_ads, errmsg)) {
+        dprintf(D_ALWAYS, "Failed to archive history file %s: %s\n",
+                filename, errmsg.c_str());
+        unlink(tmp_name.c_str());
+        return false;
+    }
+    if (rename(tmp_name.c_str(), filename) < 0) {
+        dprintf(D_ALWAYS, "Failed to rename %s to %s: %s\n",
+                tmp_name.c_str(), filename, strerror(errno));
+        unlink(tmp_name.c_str());
+        return false;
+    }
+        // the index is for the text file
+    RemoveHistoryIndex(filename);
+    dprintf(D_ALWAYS, "Archived %d ads in history file %s\n", num_ads, filename);
+    return true;
+}
+
 // --------------------------------------------------------------------------
 // Figure out how far from the end the beginning of the last line in the
 // history file is. We assume that the file is open. We reset the file pointer
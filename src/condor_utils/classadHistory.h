@@ -27,6 +27,8 @@ extern bool        DoDailyHistoryRotation;
 extern bool        DoMonthlyHistoryRotation;
 extern filesize_t  MaxHistoryFileSize;
 extern int         NumberBackupHistoryFiles;
+extern bool        DoHistoryIndex;
+extern bool        DoHistoryArchive;
 extern char*       PerJobHistoryDir;
 extern char* JobHistoryFileName;
 
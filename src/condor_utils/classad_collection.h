@@ -151,6 +151,13 @@ public:
 		// This means doing both a flush and fsync.
   void ForceLog() { ClassAdLog<K,AltK,AD>::ForceLog(); }
 
+		// Group commit: durable commits are not synced until SyncLog().
+		// See ClassAdLog::SetGroupCommit().
+  void SetGroupCommit(bool enable) { ClassAdLog<K,AltK,AD>::SetGroupCommit(enable); }
+  int UnsyncedCommits() { return ClassAdLog<K,AltK,AD>::UnsyncedCommits(); }
+  size_t UnsyncedBytes() { return ClassAdLog<K,AltK,AD>::UnsyncedBytes(); }
+  int SyncLog() { return ClassAdLog<K,AltK,AD>::SyncLog(); }
+
   ///
   Transaction* getActiveTransaction() { return ClassAdLog<K,AltK,AD>::getActiveTransaction(); }
   ///
@@ -181,6 +188,8 @@ public:
   void SetMaxHistoricalLogs(int max) { ClassAdLog<K,AltK,AD>::SetMaxHistoricalLogs(max); }
   int GetMaxHistoricalLogs() { return ClassAdLog<K,AltK,AD>::GetMaxHistoricalLogs(); }
 
+  void SetBinarySnapshots(bool enable) { ClassAdLog<K,AltK,AD>::SetBinarySnapshots(enable); }
+
   time_t GetOrigLogBirthdate() { return ClassAdLog<K,AltK,AD>::GetOrigLogBirthdate(); }
 
   //@}
@@ -25,6 +25,7 @@
 #include "basename.h"
 #include "condor_common.h"
 #include "classad_log.h"
+#include "classad_log_snapshot.h"
 #include "condor_debug.h"
 #include "util_lib_proto.h"
 #include "classad_merge.h"
@@ -74,6 +75,7 @@ FILE* LoadClassAdLog(
 	time_t & m_original_log_birthdate,
 	bool & is_clean,
 	bool & requires_successful_cleaning,
+	bool & loaded_snapshot,
 	MyString & errmsg)
 {
 	FILE* log_fp = NULL;
@@ -97,6 +99,7 @@ FILE* LoadClassAdLog(
 
 	is_clean = true; // was cleanly closed (until we find out otherwise)
 	requires_successful_cleaning = false;
+	loaded_snapshot = false;
 
 	// Read all of the log records
 	LogRecord		*log_rec;
@@ -145,6 +148,33 @@ FILE* LoadClassAdLog(
 			m_original_log_birthdate = ((LogHistoricalSequenceNumber *)log_rec)->get_timestamp();
 			delete log_rec;
 			break;
+		case CondorLogOp_Snapshot: {
+			// the ads that were in the log when it was rotated
+			LogSnapshot *snap = (LogSnapshot *)log_rec;
+			if (active_transaction || loaded_snapshot) {
+				errmsg.formatstr("ERROR: in log %s snapshot record %lu is in a transaction or follows another snapshot\n", filename, count);
+				fclose(log_fp);
+				delete active_transaction;
+				delete log_rec;
+				return NULL;
+			}
+			std::string snapshot_path = ClassAdLogSnapshotPath(filename, snap->get_name());
+			unsigned long num_ads = 0;
+			MyString snap_errmsg;
+			if ( ! LoadClassAdLogSnapshot(snapshot_path.c_str(), la, maker, num_ads, snap_errmsg)) {
+				errmsg.formatstr("ERROR: in log %s failed to load snapshot: %s\n", filename, snap_errmsg.Value());
+				fclose(log_fp);
+				delete log_rec;
+				return NULL;
+			}
+			if (num_ads != snap->get_num_ads()) {
+				errmsg.formatstr_cat("Warning: snapshot %s has %lu ads, but the log expected %lu\n",
+					snapshot_path.c_str(), num_ads, snap->get_num_ads());
+			}
+			loaded_snapshot = true;
+			delete log_rec;
+			break;
+		}
 		default:
 			if (active_transaction) {
 				active_transaction->AppendLog(log_rec);
@@ -260,6 +290,8 @@ bool TruncateClassAdLog(
 	FILE* &log_fp,                  // in,out
 	unsigned long & historical_sequence_number, // in,out
 	time_t & m_original_log_birthdate, // in,out
+	bool write_snapshot, // in
+	unsigned long max_historical_logs, // in
 	MyString & errmsg) // out
 {
 	MyString	tmp_log_filename;
@@ -287,9 +319,17 @@ bool TruncateClassAdLog(
 
 	// flush our current state into the temp file,
 	// with a future value for sequence number
-	bool success = WriteClassAdLogState(new_log_fp, tmp_log_filename.Value(),
-		future_sequence_number, m_original_log_birthdate,
-		la, maker, errmsg);
+	bool success;
+	if (write_snapshot) {
+		success = WriteClassAdLogSnapshotState(new_log_fp, tmp_log_filename.Value(), filename,
+			future_sequence_number, m_original_log_birthdate,
+			la, errmsg);
+	} else {
+		success = WriteClassAdLogState(new_log_fp, tmp_log_filename.Value(),
+			future_sequence_number, m_original_log_birthdate,
+			la, maker, errmsg);
+	}
+	std::string new_snapshot = ClassAdLogSnapshotPath(filename, ClassAdLogSnapshotName(filename, future_sequence_number).c_str());
 
 	fclose(log_fp);
 	log_fp = NULL;
@@ -300,12 +340,14 @@ bool TruncateClassAdLog(
 	// functions just EXCEPT'ed rather than returning errors.
 	if ( ! success) {
 		fclose(new_log_fp);
+		if (write_snapshot) { unlink(new_snapshot.c_str()); }
 		return false;
 	}
 
 	fclose(new_log_fp);	// avoid sharing violation on move
 	if (rotate_file(tmp_log_filename.Value(), filename) < 0) {
 		errmsg.formatstr("failed to rotate job queue log!\n");
+		if (write_snapshot) { unlink(new_snapshot.c_str()); }
 
 		int log_fd = safe_open_wrapper_follow(filename, O_RDWR | O_APPEND | O_LARGEFILE | _O_NOINHERIT, 0600);
 		if (log_fd < 0) {
@@ -323,6 +365,18 @@ bool TruncateClassAdLog(
 	// we successfully wrote and rotated, so we can update our sequence number
 	historical_sequence_number = future_sequence_number;
 
+	// the snapshot of the log before the oldest saved historical log is no
+	// longer used by anything.  it is ok if there wasn't one.
+	if (future_sequence_number > max_historical_logs + 1) {
+		std::string old_snapshot = ClassAdLogSnapshotPath(filename,
+			ClassAdLogSnapshotName(filename, future_sequence_number - 1 - max_historical_logs).c_str());
+		if (unlink(old_snapshot.c_str()) == 0) {
+			dprintf(D_FULLDEBUG, "Removed snapshot %s.\n", old_snapshot.c_str());
+		} else if (errno != ENOENT) {
+			dprintf(D_ALWAYS, "WARNING: failed to remove '%s': %s\n", old_snapshot.c_str(), strerror(errno));
+		}
+	}
+
 #ifndef WIN32
 	// POSIX does not provide any durability guarantees for rename().  Instead, we must
 	// open the parent directory and invoke fsync there.
@@ -564,6 +618,49 @@ bool WriteClassAdLogState(
 	return true;
 }
 
+bool WriteClassAdLogSnapshotState(
+	FILE *fp, // in
+	const char * filename,
+	const char * log_filename,
+	unsigned long historical_sequence_number, // in
+	time_t m_original_log_birthdate, // in
+	LoggableClassAdTable & la,
+	MyString & errmsg)
+{
+	std::string snapshot_name = ClassAdLogSnapshotName(log_filename, historical_sequence_number);
+	std::string snapshot_path = ClassAdLogSnapshotPath(log_filename, snapshot_name.c_str());
+	unsigned long num_ads = 0;
+	if ( ! WriteClassAdLogSnapshot(snapshot_path.c_str(), historical_sequence_number,
+			m_original_log_birthdate, la, num_ads, errmsg)) {
+		return false;
+	}
+
+	// This must always be the first entry in the log.
+	LogRecord *log = new LogHistoricalSequenceNumber( historical_sequence_number, m_original_log_birthdate );
+	if (log->Write(fp) < 0) {
+		errmsg.formatstr("write to %s failed, errno = %d", filename, errno);
+		delete log;
+		return false;
+	}
+	delete log;
+
+	log = new LogSnapshot(snapshot_name.c_str(), num_ads);
+	if (log->Write(fp) < 0) {
+		errmsg.formatstr("write to %s failed, errno = %d", filename, errno);
+		delete log;
+		return false;
+	}
+	delete log;
+
+	if (fflush(fp) !=0){
+		errmsg.formatstr("fflush of %s failed, errno = %d", filename, errno);
+	}
+	if (condor_fdatasync(fileno(fp)) < 0) {
+		errmsg.formatstr("fsync of %s failed, errno = %d", filename, errno);
+	}
+	return true;
+}
+
 LogHistoricalSequenceNumber::LogHistoricalSequenceNumber(unsigned long historical_sequence_number_arg,time_t timestamp_arg)
 {
 	op_type = CondorLogOp_LogHistoricalSequenceNumber;
@@ -615,6 +712,51 @@ LogHistoricalSequenceNumber::WriteBody(FILE *fp)
 	return (fwrite(buf, 1, len, fp) < (unsigned)len) ? -1: len;
 }
 
+LogSnapshot::LogSnapshot(const char *name_arg, unsigned long num_ads_arg)
+{
+	op_type = CondorLogOp_Snapshot;
+	name = strdup(name_arg);
+	num_ads = num_ads_arg;
+}
+
+LogSnapshot::~LogSnapshot()
+{
+	free(name);
+}
+
+int
+LogSnapshot::Play(void *  /*data_structure*/)
+{
+	// The snapshot is named relative to the log, which we don't know
+	// here, so LoadClassAdLog loads it when it reads this record.
+	return 1;
+}
+
+int
+LogSnapshot::ReadBody(FILE *fp)
+{
+	int rval, rval1;
+	free(name);
+	rval = readword(fp, name);
+	if (rval < 0) return rval;
+
+	char *buf = NULL;
+	rval1 = readword(fp, buf);
+	if (rval1 < 0) return rval1;
+	num_ads = strtoul(buf, NULL, 10);
+	free(buf);
+	return rval + rval1;
+}
+
+int
+LogSnapshot::WriteBody(FILE *fp)
+{
+	MyString buf;
+	buf.formatstr("%s %lu", name, num_ads);
+	int len = buf.Length();
+	return (fwrite(buf.Value(), 1, len, fp) < (unsigned)len) ? -1: len;
+}
+
 LogNewClassAd::LogNewClassAd(const char *k, const char *m, const char *t, const ConstructLogEntry & c) : ctor(c)
 {
 	op_type = CondorLogOp_NewClassAd;
@@ -1036,6 +1178,9 @@ InstantiateLogEntry(FILE *fp, unsigned long recnum, int type, const ConstructLog
 		case CondorLogOp_LogHistoricalSequenceNumber:
 			log_rec = new LogHistoricalSequenceNumber(0,0);
 			break;
+		case CondorLogOp_Snapshot:
+			log_rec = new LogSnapshot("", 0);
+			break;
 	    default:
 		    return NULL;
 			break;
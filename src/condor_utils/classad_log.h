@@ -208,6 +208,28 @@ public:
 
 	time_t GetOrigLogBirthdate() {return m_original_log_birthdate;}
 
+	// When the log is truncated, write the ads to a binary snapshot
+	// (see classad_log_snapshot.h) rather than to the log as text.
+	// A log that was loaded from a snapshot keeps writing them.
+	void SetBinarySnapshots(bool enable) { m_binary_snapshots = enable; }
+	bool GetBinarySnapshots() { return m_binary_snapshots; }
+
+	// Group commit.  When enabled, a durable commit of a transaction is
+	// written to the log but not synced, and becomes durable at the next
+	// SyncLog() (or ForceLog()), so that the commits made between two
+	// calls share one fsync.  Changes made outside of a transaction are
+	// still synced as they are made.  The caller is responsible for calling
+	// SyncLog() soon, and for not telling anyone that a commit is durable
+	// until it has.
+	void SetGroupCommit(bool enable);
+	bool GetGroupCommit() { return m_group_commit; }
+		// durable commits (and bytes) written since the last sync
+	int UnsyncedCommits() { return m_unsynced_commits; }
+	size_t UnsyncedBytes() { return m_unsynced_bytes; }
+		// flush and fsync the log if there are unsynced commits,
+		// returns the number of commits that were made durable.
+	int SyncLog();
+
 protected:
 	/** Returns handle to active transaction.  Upon return of this
 		method, any active transaction is forgotten.  It is the caller's
@@ -243,6 +265,10 @@ private:
 	unsigned long historical_sequence_number;
 	time_t m_original_log_birthdate;
 	int m_nondurable_level;
+	bool m_binary_snapshots;
+	bool m_group_commit;
+	int m_unsynced_commits;
+	size_t m_unsynced_bytes;
 
 	bool SaveHistoricalLogs();
 };
@@ -267,6 +293,27 @@ private:
 					  // regardless of how many times the log has rotated
 };
 
+// the log holds the ads in a snapshot file of the given name, which
+// LoadClassAdLog reads in place of this record.
+class LogSnapshot : public LogRecord {
+public:
+	LogSnapshot(const char *name, unsigned long num_ads);
+	virtual ~LogSnapshot();
+	int Play(void *data_structure);
+
+	char const *get_name() { return name; }
+	unsigned long get_num_ads() { return num_ads; }
+
+private:
+	virtual int WriteBody(FILE *fp);
+	virtual int ReadBody(FILE *fp);
+
+	virtual char const *get_key() {return NULL;}
+
+	char *name;
+	unsigned long num_ads;
+};
+
 // this class is the interface that is consumed by classes in this file that are derived from LogRecord
 class LoggableClassAdTable {
 public:
@@ -423,6 +470,8 @@ bool TruncateClassAdLog(
 	FILE* &log_fp,                  // in,out
 	unsigned long & historical_sequence_number, // in,out
 	time_t & m_original_log_birthdate, // in,out
+	bool write_snapshot,            // in: write the ads to a binary snapshot
+	unsigned long max_historical_logs, // in: for removing old snapshots
 	MyString & errmsg);             // out
 
 bool WriteClassAdLogState(
@@ -434,6 +483,17 @@ bool WriteClassAdLogState(
 	const ConstructLogEntry& maker, // in
 	MyString & errmsg);             // out
 
+// like WriteClassAdLogState, but writes the ads to a snapshot next to
+// log_filename and a record that refers to it to fp.
+bool WriteClassAdLogSnapshotState(
+	FILE *fp,                       // in
+	const char * filename,          // in: used for error messages
+	const char * log_filename,      // in: the name the log will have
+	unsigned long sequence_number,  // in
+	time_t original_log_birthdate,  // in
+	LoggableClassAdTable & la,      // in
+	MyString & errmsg);             // out
+
 FILE* LoadClassAdLog(
 	const char *filename,           // in
 	LoggableClassAdTable & table,   // in
@@ -442,6 +502,7 @@ FILE* LoadClassAdLog(
 	time_t & m_original_log_birthdate, // in,out
 	bool & is_clean,  // out: true if log was shutdown cleanly
 	bool & requires_successful_cleaning, // out: true if log must be cleaned (i.e rotated) before it can be written to again.
+	bool & loaded_snapshot,         // out: true if the ads came from a binary snapshot
 	MyString & errmsg);             // out, contains error or warning messages
 
 int FlushClassAdLog(FILE* fp, bool force);
@@ -483,6 +544,10 @@ ClassAdLog<K,AltK,AD>::ClassAdLog(const char *filename,int max_historical_logs_a
 	log_filename_buf = filename;
 	active_transaction = NULL;
 	m_nondurable_level = 0;
+	m_binary_snapshots = false;
+	m_group_commit = false;
+	m_unsynced_commits = 0;
+	m_unsynced_bytes = 0;
 
 	bool open_read_only = max_historical_logs_arg < 0;
 	if (open_read_only) { max_historical_logs_arg = -max_historical_logs_arg; }
@@ -497,7 +562,7 @@ ClassAdLog<K,AltK,AD>::ClassAdLog(const char *filename,int max_historical_logs_a
 	log_fp = LoadClassAdLog(filename,
 		la, this->GetTableEntryMaker(),
 		historical_sequence_number, m_original_log_birthdate,
-		is_clean, requires_successful_cleaning, errmsg);
+		is_clean, requires_successful_cleaning, m_binary_snapshots, errmsg);
 
 	if ( ! log_fp) {
 		EXCEPT("%s", errmsg.Value());
@@ -522,6 +587,10 @@ ClassAdLog<K,AltK,AD>::ClassAdLog(const ConstructLogEntry* maker)
 	active_transaction = NULL;
 	log_fp = NULL;
 	m_nondurable_level = 0;
+	m_binary_snapshots = false;
+	m_group_commit = false;
+	m_unsynced_commits = 0;
+	m_unsynced_bytes = 0;
 	max_historical_logs = 0;
 	historical_sequence_number = 0;
 }
@@ -531,6 +600,11 @@ ClassAdLog<K,AltK,AD>::~ClassAdLog()
 {
 	if (active_transaction) delete active_transaction;
 
+	// don't leave group commits behind in the page cache
+	if (m_unsynced_commits) {
+		FlushClassAdLog(log_fp, true);
+	}
+
 	// cache the effective table entry maker for use in the loop.
 	const ConstructLogEntry & dtor = this->GetTableEntryMaker();
 
@@ -596,6 +670,30 @@ ClassAdLog<K,AltK,AD>::ForceLog()
 	if (err) {
 		EXCEPT("fsync of %s failed, errno = %d", logFilename(), err);
 	}
+	m_unsynced_commits = 0;
+	m_unsynced_bytes = 0;
+}
+
+template <typename K, typename AltK, typename AD>
+void
+ClassAdLog<K,AltK,AD>::SetGroupCommit(bool enable)
+{
+	// commits made while group commit was on must not be left unsynced
+	if ( ! enable) {
+		SyncLog();
+	}
+	m_group_commit = enable;
+}
+
+template <typename K, typename AltK, typename AD>
+int
+ClassAdLog<K,AltK,AD>::SyncLog()
+{
+	int commits = m_unsynced_commits;
+	if (commits) {
+		ForceLog();
+	}
+	return commits;
 }
 
 template <typename K, typename AltK, typename AD>
@@ -621,11 +719,16 @@ ClassAdLog<K,AltK,AD>::TruncLog()
 	bool rotated = TruncateClassAdLog(logFilename(),
 		la, this->GetTableEntryMaker(),
 		log_fp, historical_sequence_number, m_original_log_birthdate,
-		errmsg);
+		m_binary_snapshots, max_historical_logs, errmsg);
 	if ( ! log_fp) {
 		// if after rotation, the log is no longer open, the the failure is fatal, and we must except
 		EXCEPT("%s", errmsg.Value());
 	}
+	if (rotated) {
+		// the new log was synced, and has everything that was in the old one
+		m_unsynced_commits = 0;
+		m_unsynced_bytes = 0;
+	}
 	if ( ! errmsg.empty()) {
 		dprintf(D_ALWAYS, "%s", errmsg.Value());
 	}
@@ -699,8 +802,13 @@ ClassAdLog<K,AltK,AD>::CommitTransaction()
 		LogEndTransaction *log = new LogEndTransaction;
 		active_transaction->AppendLog(log);
 		bool nondurable = m_nondurable_level > 0;
+		bool grouped = ! nondurable && m_group_commit && log_fp;
 		ClassAdLogTable<K,AD> la(table);
-		active_transaction->Commit(log_fp, logFilename(), &la, nondurable );
+		size_t len = active_transaction->Commit(log_fp, logFilename(), &la, nondurable || grouped);
+		if (grouped) {
+			++m_unsynced_commits;
+			m_unsynced_bytes += len;
+		}
 	}
 	delete active_transaction;
 	active_transaction = NULL;
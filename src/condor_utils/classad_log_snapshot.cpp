@@ -0,0 +1,723 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_config.h"
+#include "condor_fsync.h"
+#include "basename.h"
+#include "util_lib_proto.h"
+#include "sysapi.h"
+#include "stl_string_utils.h"
+#include "classad_log_snapshot.h"
+#include "classad_wire.h"
+#include "classad/classadCache.h"
+
+#if defined(HAVE_DLOPEN)
+#include "ClassAdLogPlugin.h"
+#endif
+
+#if ! defined(WIN32)
+#include <sys/mman.h>
+#endif
+
+#include <vector>
+
+#define SNAPSHOT_MAGIC       "CADLSNAP"
+#define SNAPSHOT_VERSION     1
+#define SNAPSHOT_HEADER_SIZE 48
+#define SNAPSHOT_INDEX_ENTRY 24
+
+// ads per chunk.  more chunks spread the work of loading more evenly,
+// but each chunk repeats the names of the attributes.
+#define SNAPSHOT_CHUNK_ADS   2000
+
+static void put_u32(std::string & buf, unsigned int val)
+{
+	for (int ii = 0; ii < 4; ++ii) { buf += (char)((val >> (8*ii)) & 0xFF); }
+}
+
+static void put_u64(std::string & buf, unsigned long long val)
+{
+	for (int ii = 0; ii < 8; ++ii) { buf += (char)((val >> (8*ii)) & 0xFF); }
+}
+
+static unsigned int get_u32(const char * p)
+{
+	const unsigned char * u = (const unsigned char *)p;
+	unsigned int val = 0;
+	for (int ii = 3; ii >= 0; --ii) { val = (val << 8) | u[ii]; }
+	return val;
+}
+
+static unsigned long long get_u64(const char * p)
+{
+	const unsigned char * u = (const unsigned char *)p;
+	unsigned long long val = 0;
+	for (int ii = 7; ii >= 0; --ii) { val = (val << 8) | u[ii]; }
+	return val;
+}
+
+// FNV-1a, to catch a torn or damaged chunk
+static unsigned int chunk_checksum(const char * data, size_t len)
+{
+	unsigned int hash = 2166136261u;
+	for (size_t ii = 0; ii < len; ++ii) {
+		hash ^= (unsigned char)data[ii];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+std::string
+ClassAdLogSnapshotName(const char * log_filename, unsigned long sequence_number)
+{
+	std::string name;
+	formatstr(name, "%s.snapshot.%lu", condor_basename(log_filename), sequence_number);
+	return name;
+}
+
+std::string
+ClassAdLogSnapshotPath(const char * log_filename, const char * snapshot_name)
+{
+	std::string path(log_filename, condor_basename(log_filename) - log_filename);
+	path += snapshot_name;
+	return path;
+}
+
+// A snapshot file, mapped into memory, with its header checked.
+class ClassAdLogSnapshotFile
+{
+public:
+	struct Chunk {
+		unsigned long long offset;
+		unsigned long long length;
+		unsigned int num_ads;
+		unsigned int checksum;
+	};
+
+	ClassAdLogSnapshotFile() : m_data(NULL), m_size(0), m_mapped(false), m_num_ads(0) {}
+	~ClassAdLogSnapshotFile() { close(); }
+
+	bool open(const char * filename, std::string & errmsg);
+	void close();
+
+	unsigned long long numAds() const { return m_num_ads; }
+	size_t numChunks() const { return m_chunks.size(); }
+	const Chunk & chunk(size_t ix) const { return m_chunks[ix]; }
+	const char * data(const Chunk & ck) const { return m_data + ck.offset; }
+	bool verify(const Chunk & ck) const {
+		return chunk_checksum(data(ck), (size_t)ck.length) == ck.checksum;
+	}
+
+private:
+	const char * m_data;
+	size_t m_size;
+	bool m_mapped;
+	unsigned long long m_num_ads;
+	std::vector<Chunk> m_chunks;
+};
+
+bool
+ClassAdLogSnapshotFile::open(const char * filename, std::string & errmsg)
+{
+	close();
+
+	int fd = safe_open_wrapper_follow(filename, O_RDONLY | O_LARGEFILE | _O_NOINHERIT | _O_BINARY);
+	if (fd < 0) {
+		formatstr(errmsg, "failed to open snapshot %s, errno = %d", filename, errno);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		formatstr(errmsg, "failed to stat snapshot %s, errno = %d", filename, errno);
+		::close(fd);
+		return false;
+	}
+	if (st.st_size < SNAPSHOT_HEADER_SIZE) {
+		formatstr(errmsg, "snapshot %s is truncated", filename);
+		::close(fd);
+		return false;
+	}
+	m_size = (size_t)st.st_size;
+
+#if defined(WIN32)
+	char * buf = (char *)malloc(m_size);
+	if ( ! buf || full_read(fd, buf, m_size) != (ssize_t)m_size) {
+		formatstr(errmsg, "failed to read snapshot %s, errno = %d", filename, errno);
+		free(buf);
+		::close(fd);
+		return false;
+	}
+	m_data = buf;
+#else
+	void * map = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		formatstr(errmsg, "failed to mmap snapshot %s, errno = %d", filename, errno);
+		::close(fd);
+		return false;
+	}
+	madvise(map, m_size, MADV_WILLNEED);
+	m_data = (const char *)map;
+	m_mapped = true;
+#endif
+	::close(fd);
+
+	const char * hdr = m_data;
+	if (memcmp(hdr, SNAPSHOT_MAGIC, 8) != 0) {
+		formatstr(errmsg, "%s is not a ClassAd log snapshot", filename);
+		close();
+		return false;
+	}
+	unsigned int version = get_u32(hdr + 8);
+	if (version != SNAPSHOT_VERSION) {
+		formatstr(errmsg, "snapshot %s has version %u, which is not supported", filename, version);
+		close();
+		return false;
+	}
+	unsigned int num_chunks = get_u32(hdr + 12);
+	m_num_ads = get_u64(hdr + 32);
+	unsigned long long index_offset = get_u64(hdr + 40);
+	if (index_offset < SNAPSHOT_HEADER_SIZE || index_offset > m_size ||
+		(m_size - index_offset) != (unsigned long long)num_chunks * SNAPSHOT_INDEX_ENTRY) {
+		formatstr(errmsg, "snapshot %s is truncated or has a bad index", filename);
+		close();
+		return false;
+	}
+
+	unsigned long long total = 0;
+	m_chunks.resize(num_chunks);
+	for (unsigned int ii = 0; ii < num_chunks; ++ii) {
+		const char * ent = m_data + index_offset + (size_t)ii * SNAPSHOT_INDEX_ENTRY;
+		Chunk & ck = m_chunks[ii];
+		ck.offset = get_u64(ent);
+		ck.length = get_u64(ent + 8);
+		ck.num_ads = get_u32(ent + 16);
+		ck.checksum = get_u32(ent + 20);
+		if (ck.offset < SNAPSHOT_HEADER_SIZE || ck.offset > index_offset ||
+			ck.length > index_offset - ck.offset) {
+			formatstr(errmsg, "snapshot %s has a bad index entry for chunk %u", filename, ii);
+			close();
+			return false;
+		}
+		total += ck.num_ads;
+	}
+	if (total != m_num_ads) {
+		formatstr(errmsg, "snapshot %s has %llu ads in its chunks, but %llu in its header", filename, total, m_num_ads);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void
+ClassAdLogSnapshotFile::close()
+{
+	if (m_data) {
+#if defined(WIN32)
+		free((void *)m_data);
+#else
+		if (m_mapped) { munmap((void *)m_data, m_size); }
+#endif
+	}
+	m_data = NULL;
+	m_size = 0;
+	m_mapped = false;
+	m_num_ads = 0;
+	m_chunks.clear();
+}
+
+
+bool
+WriteClassAdLogSnapshot(
+	const char * filename,
+	unsigned long sequence_number,
+	time_t original_log_birthdate,
+	LoggableClassAdTable & la,
+	unsigned long & num_ads,
+	MyString & errmsg)
+{
+	num_ads = 0;
+
+	MyString tmp_filename;
+	tmp_filename.formatstr("%s.tmp", filename);
+	int fd = safe_open_wrapper_follow(tmp_filename.Value(), O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE | _O_NOINHERIT | _O_BINARY, 0600);
+	if (fd < 0) {
+		errmsg.formatstr("failed to create snapshot %s, errno = %d", tmp_filename.Value(), errno);
+		return false;
+	}
+
+		// the header is written again at the end, when we know what goes in it
+	std::string index;
+	std::string buf(SNAPSHOT_HEADER_SIZE, '\0');
+	unsigned long long offset = SNAPSHOT_HEADER_SIZE;
+	bool ok = full_write(fd, buf.data(), buf.size()) == (ssize_t)buf.size();
+
+	ClassAdWireNames names;
+	ClassAdWireWriter writer(names);
+	unsigned int chunk_ads = 0;
+	unsigned int num_chunks = 0;
+
+	const char * key;
+	ClassAd * ad;
+	la.startIterations();
+	bool more = la.nextIteration(key, ad);
+	while (ok && (more || chunk_ads > 0)) {
+		if (more) {
+			writer.str(key);
+			writer.str(GetMyTypeName(*ad));
+			writer.str(GetTargetTypeName(*ad));
+			writer.uvarint(ad->size());
+				// just this ad's attributes, not the ones of its chained parent
+			for (classad::ClassAd::const_iterator it = ad->begin(); it != ad->end(); ++it) {
+				writer.attribute(it->first, it->second);
+			}
+			++chunk_ads;
+			++num_ads;
+			more = la.nextIteration(key, ad);
+		}
+		if (chunk_ads >= SNAPSHOT_CHUNK_ADS || ( ! more && chunk_ads > 0)) {
+			const std::string & chunk = writer.buffer();
+			put_u64(index, offset);
+			put_u64(index, chunk.size());
+			put_u32(index, chunk_ads);
+			put_u32(index, chunk_checksum(chunk.data(), chunk.size()));
+			ok = full_write(fd, chunk.data(), chunk.size()) == (ssize_t)chunk.size();
+			offset += chunk.size();
+			++num_chunks;
+				// each chunk can be read on its own
+			writer.clear();
+			names.clear();
+			chunk_ads = 0;
+		}
+	}
+
+	if (ok) {
+		ok = full_write(fd, index.data(), index.size()) == (ssize_t)index.size();
+	}
+	if (ok) {
+		buf.assign(SNAPSHOT_MAGIC);
+		put_u32(buf, SNAPSHOT_VERSION);
+		put_u32(buf, num_chunks);
+		put_u64(buf, sequence_number);
+		put_u64(buf, (unsigned long long)original_log_birthdate);
+		put_u64(buf, num_ads);
+		put_u64(buf, offset);
+		ok = lseek(fd, 0, SEEK_SET) == 0 && full_write(fd, buf.data(), buf.size()) == (ssize_t)buf.size();
+	}
+	if ( ! ok) {
+		errmsg.formatstr("write to %s failed, errno = %d", tmp_filename.Value(), errno);
+	} else if (condor_fsync(fd) < 0) {
+		errmsg.formatstr("fsync of %s failed, errno = %d", tmp_filename.Value(), errno);
+		ok = false;
+	}
+	close(fd);
+
+		// the caller syncs the directory after it renames the log that
+		// refers to this snapshot, which also makes this rename durable.
+	if (ok && rotate_file(tmp_filename.Value(), filename) < 0) {
+		errmsg.formatstr("failed to rename %s to %s", tmp_filename.Value(), filename);
+		ok = false;
+	}
+	if ( ! ok) {
+		unlink(tmp_filename.Value());
+	}
+	return ok;
+}
+
+
+// an attribute that a worker decoded enough to find it is not a literal.
+// it is put in the ClassAd cache by the main thread.
+struct SnapshotDeferredAttr {
+	size_t ad;
+	std::string name;
+	const char * value;
+	size_t value_len;
+};
+
+struct SnapshotChunkJob {
+	const ClassAdLogSnapshotFile * file;
+	const ClassAdLogSnapshotFile::Chunk * chunk;
+	const ConstructLogEntry * maker;
+	bool use_cache;
+
+	std::vector<std::pair<std::string, ClassAd *> > ads;
+	std::vector<SnapshotDeferredAttr> deferred;
+	std::string error;
+};
+
+// build the ads in one chunk.  this runs in a worker thread, so it must not
+// touch anything but the job, and not the ClassAd cache in particular.
+static bool
+decode_snapshot_chunk(SnapshotChunkJob & job)
+{
+	const ClassAdLogSnapshotFile::Chunk & ck = *job.chunk;
+	if ( ! job.file->verify(ck)) {
+		job.error = "checksum mismatch";
+		return false;
+	}
+
+	ClassAdWireNames names;
+	ClassAdWireReader reader(names, job.file->data(ck), (size_t)ck.length);
+	std::string key, mytype, targettype, attr;
+	job.ads.reserve(ck.num_ads);
+	for (unsigned int ii = 0; ii < ck.num_ads; ++ii) {
+		unsigned long long num_attrs = 0;
+		if ( ! reader.str(key) || ! reader.str(mytype) || ! reader.str(targettype) || ! reader.uvarint(num_attrs)) {
+			formatstr(job.error, "bad header for ad %u", ii);
+			return false;
+		}
+		ClassAd * ad = job.maker->New(key.c_str(), mytype.c_str());
+		job.ads.push_back(std::make_pair(key, ad));
+		SetMyTypeName(*ad, mytype.c_str());
+		SetTargetTypeName(*ad, targettype.c_str());
+
+		for (unsigned long long jj = 0; jj < num_attrs; ++jj) {
+			const char * value = NULL;
+			size_t value_len = 0;
+			if ( ! reader.attribute(attr, value, value_len)) {
+				formatstr(job.error, "bad attribute in ad %s", key.c_str());
+				return false;
+			}
+			bool literal = ClassAdWireReader::isLiteral(value, value_len);
+			if ( ! literal && job.use_cache && attr[0] != '\'') {
+				SnapshotDeferredAttr def;
+				def.ad = job.ads.size() - 1;
+				def.name = attr;
+				def.value = value;
+				def.value_len = value_len;
+				job.deferred.push_back(def);
+				continue;
+			}
+			classad::ExprTree * tree = reader.decode(value, value_len);
+			bool inserted;
+			if ( ! tree) {
+				inserted = false;
+			} else if (literal) {
+				inserted = ad->InsertLiteral(attr, static_cast<classad::Literal*>(tree));
+			} else {
+				inserted = ad->Insert(attr, tree);
+			}
+			if ( ! inserted) {
+				formatstr(job.error, "bad value for attribute %s of ad %s", attr.c_str(), key.c_str());
+				return false;
+			}
+		}
+	}
+	if ( ! reader.atEnd()) {
+		job.error = "extra bytes after the last ad";
+		return false;
+	}
+	return true;
+}
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+struct SnapshotLoadQueue {
+	pthread_mutex_t mutex;
+	std::vector<SnapshotChunkJob> * jobs;
+	size_t next;
+};
+
+static void *
+snapshot_load_thread(void * arg)
+{
+	SnapshotLoadQueue * queue = (SnapshotLoadQueue *)arg;
+	for (;;) {
+		pthread_mutex_lock(&queue->mutex);
+		size_t ix = queue->next++;
+		pthread_mutex_unlock(&queue->mutex);
+		if (ix >= queue->jobs->size()) {
+			break;
+		}
+		decode_snapshot_chunk((*queue->jobs)[ix]);
+	}
+	return NULL;
+}
+#endif
+
+// decode all of the chunks, on as many threads as we are allowed.
+static void
+decode_snapshot_chunks(std::vector<SnapshotChunkJob> & jobs)
+{
+	int num_threads = param_integer("CLASSAD_LOG_SNAPSHOT_LOAD_THREADS", 0, 0);
+	if (num_threads == 0) {
+		int num_cpus = 0, num_hyperthread_cpus = 0;
+		sysapi_ncpus_raw(&num_cpus, &num_hyperthread_cpus);
+		num_threads = num_hyperthread_cpus;
+	}
+	if (num_threads > (int)jobs.size()) {
+		num_threads = (int)jobs.size();
+	}
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	if (num_threads > 1) {
+			// things the ClassAd library sets up the first time they are used
+		ClassAd primer;
+		classad::ExprTree * tree = NULL;
+		ParseClassAdRvalExpr("time()", tree);
+		delete tree;
+
+		SnapshotLoadQueue queue;
+		pthread_mutex_init(&queue.mutex, NULL);
+		queue.jobs = &jobs;
+		queue.next = 0;
+
+		std::vector<pthread_t> threads;
+		sigset_t all_signals, old_mask;
+		sigfillset(&all_signals);
+		pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+		for (int ii = 0; ii < num_threads; ++ii) {
+			pthread_t thread;
+			int rval = pthread_create(&thread, NULL, snapshot_load_thread, &queue);
+			if (rval != 0) {
+				dprintf(D_ALWAYS, "Failed to create snapshot load thread: %s (%d), using %d\n",
+					strerror(rval), rval, (int)threads.size());
+				break;
+			}
+			threads.push_back(thread);
+		}
+		pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+			// this thread does its share, and all of it if no threads started
+		snapshot_load_thread(&queue);
+		for (size_t ii = 0; ii < threads.size(); ++ii) {
+			pthread_join(threads[ii], NULL);
+		}
+		pthread_mutex_destroy(&queue.mutex);
+		return;
+	}
+#endif
+
+	for (size_t ii = 0; ii < jobs.size(); ++ii) {
+		decode_snapshot_chunk(jobs[ii]);
+	}
+}
+
+bool
+LoadClassAdLogSnapshot(
+	const char * filename,
+	LoggableClassAdTable & la,
+	const ConstructLogEntry& maker,
+	unsigned long & num_ads,
+	MyString & errmsg)
+{
+	num_ads = 0;
+
+	ClassAdLogSnapshotFile file;
+	std::string err;
+	if ( ! file.open(filename, err)) {
+		errmsg = err.c_str();
+		return false;
+	}
+
+	std::vector<SnapshotChunkJob> jobs(file.numChunks());
+	for (size_t ii = 0; ii < jobs.size(); ++ii) {
+		jobs[ii].file = &file;
+		jobs[ii].chunk = &file.chunk(ii);
+		jobs[ii].maker = &maker;
+		jobs[ii].use_cache = classad::ClassAdGetExpressionCaching();
+	}
+
+	decode_snapshot_chunks(jobs);
+
+#if defined(HAVE_DLOPEN)
+	bool have_plugins = ClassAdLogPluginManager::getPlugins().Number() > 0;
+	std::string unparsed;
+#endif
+
+	bool ok = true;
+	std::string cache_key;
+	for (size_t ii = 0; ii < jobs.size(); ++ii) {
+		SnapshotChunkJob & job = jobs[ii];
+		if (ok && ! job.error.empty()) {
+			errmsg.formatstr("snapshot %s is corrupt in chunk %d: %s", filename, (int)ii, job.error.c_str());
+			ok = false;
+		}
+		if (ok) {
+				// the expressions that go in the ClassAd cache, as in getClassAd()
+			ClassAdWireNames names;
+			ClassAdWireReader reader(names, NULL, 0);
+			for (size_t jj = 0; jj < job.deferred.size(); ++jj) {
+				SnapshotDeferredAttr & def = job.deferred[jj];
+				cache_key.assign(1, '\x01');
+				cache_key.append(def.value, def.value_len);
+				classad::ExprTree * tree = classad::CachedExprEnvelope::check_hit(def.name, cache_key);
+				if ( ! tree) {
+					tree = reader.decode(def.value, def.value_len);
+					if (tree) {
+						tree = classad::CachedExprEnvelope::cache(def.name, tree, cache_key);
+					}
+				}
+				if ( ! tree || ! job.ads[def.ad].second->Insert(def.name, tree)) {
+					errmsg.formatstr("snapshot %s has a bad value for attribute %s of ad %s",
+						filename, def.name.c_str(), job.ads[def.ad].first.c_str());
+					ok = false;
+					break;
+				}
+			}
+		}
+		for (size_t jj = 0; jj < job.ads.size(); ++jj) {
+			const char * key = job.ads[jj].first.c_str();
+			ClassAd * ad = job.ads[jj].second;
+			if (ok) {
+					// the ads are as if they had been read from the log
+				ad->EnableDirtyTracking();
+				if ( ! la.insert(key, ad)) {
+					errmsg.formatstr("snapshot %s has more than one ad with key %s", filename, key);
+					ok = false;
+				}
+			}
+			if ( ! ok) {
+				maker.Delete(ad);
+				continue;
+			}
+			++num_ads;
+#if defined(HAVE_DLOPEN)
+			if (have_plugins) {
+				ClassAdLogPluginManager::NewClassAd(key);
+				for (classad::ClassAd::const_iterator it = ad->begin(); it != ad->end(); ++it) {
+					unparsed.clear();
+					ExprTreeToString(it->second, unparsed);
+					ClassAdLogPluginManager::SetAttribute(key, it->first.c_str(), unparsed.c_str());
+				}
+			}
+#endif
+		}
+		job.ads.clear();
+		job.deferred.clear();
+	}
+
+	if (ok && num_ads != file.numAds()) {
+		errmsg.formatstr("snapshot %s has %lu ads, expected %llu", filename, num_ads, file.numAds());
+		ok = false;
+	}
+	return ok;
+}
+
+
+ClassAdLogSnapshotReader::ClassAdLogSnapshotReader()
+	: m_file(NULL)
+	, m_names(NULL)
+	, m_reader(NULL)
+	, m_chunk(0)
+	, m_ads(0)
+	, m_attrs(0)
+{
+}
+
+ClassAdLogSnapshotReader::~ClassAdLogSnapshotReader()
+{
+	close();
+}
+
+bool
+ClassAdLogSnapshotReader::open(const char * filename, std::string & errmsg)
+{
+	close();
+	m_file = new ClassAdLogSnapshotFile();
+	if ( ! m_file->open(filename, errmsg)) {
+		close();
+		return false;
+	}
+	m_names = new ClassAdWireNames();
+	return true;
+}
+
+void
+ClassAdLogSnapshotReader::close()
+{
+	delete m_reader;
+	m_reader = NULL;
+	delete m_names;
+	m_names = NULL;
+	delete m_file;
+	m_file = NULL;
+	m_chunk = 0;
+	m_ads = 0;
+	m_attrs = 0;
+}
+
+bool
+ClassAdLogSnapshotReader::nextAd(std::string & key, std::string & mytype, std::string & targettype, std::string & errmsg)
+{
+	if ( ! m_file) {
+		return false;
+	}
+		// skip what is left of the last ad
+	std::string name, value;
+	while (m_attrs > 0) {
+		if ( ! nextAttribute(name, value, errmsg)) {
+			return false;
+		}
+	}
+
+	while (m_ads == 0) {
+		if (m_reader && ! m_reader->atEnd()) {
+			errmsg = "extra bytes after the last ad of a chunk";
+			return false;
+		}
+		delete m_reader;
+		m_reader = NULL;
+		if (m_chunk >= m_file->numChunks()) {
+			return false;
+		}
+		const ClassAdLogSnapshotFile::Chunk & ck = m_file->chunk(m_chunk++);
+		if ( ! m_file->verify(ck)) {
+			formatstr(errmsg, "checksum mismatch in chunk %d", (int)m_chunk - 1);
+			return false;
+		}
+		m_names->clear();
+		m_reader = new ClassAdWireReader(*m_names, m_file->data(ck), (size_t)ck.length);
+		m_ads = ck.num_ads;
+	}
+
+	if ( ! m_reader->str(key) || ! m_reader->str(mytype) || ! m_reader->str(targettype) || ! m_reader->uvarint(m_attrs)) {
+		errmsg = "bad ad header";
+		m_ads = 0;
+		m_attrs = 0;
+		return false;
+	}
+	--m_ads;
+	return true;
+}
+
+bool
+ClassAdLogSnapshotReader::nextAttribute(std::string & name, std::string & value, std::string & errmsg)
+{
+	if ( ! m_reader || m_attrs == 0) {
+		return false;
+	}
+	--m_attrs;
+
+	const char * data = NULL;
+	size_t len = 0;
+	classad::ExprTree * tree = NULL;
+	if (m_reader->attribute(name, data, len)) {
+		tree = m_reader->decode(data, len);
+	}
+	if ( ! tree) {
+		errmsg = "bad attribute";
+		m_attrs = 0;
+		return false;
+	}
+	value.clear();
+	ExprTreeToString(tree, value);
+	delete tree;
+	return true;
+}
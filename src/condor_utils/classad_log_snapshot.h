@@ -0,0 +1,109 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _CLASSAD_LOG_SNAPSHOT_H
+#define _CLASSAD_LOG_SNAPSHOT_H
+
+/*
+  Binary snapshots of the ads in a ClassAdLog.
+
+  When a ClassAdLog with snapshots enabled is rotated, the ads are written
+  to a snapshot file next to the log, named for the historical sequence
+  number of the new log, and the new log holds only the sequence number
+  and a CondorLogOp_Snapshot record that names the snapshot.  Later changes
+  are appended to the log as text, as always.  A reader that does not know
+  about snapshots fails on the unknown record rather than missing the ads.
+
+  A snapshot is a header, the chunks, and an index of the chunks.  Each
+  chunk holds a few thousand ads in the binary ClassAd encoding (see
+  classad_wire.h) with its own table of attribute names, so the chunks of
+  a snapshot can be decoded by several threads at once.  All numbers in the
+  header and the index are little endian.
+
+      header:  "CADLSNAP", version (4), number of chunks (4),
+               sequence number (8), log birthdate (8), number of ads (8),
+               offset of the index (8)
+      chunk:   for each ad, key, MyType, TargetType, number of attributes,
+               then the attributes
+      index:   for each chunk, offset (8), length (8), number of ads (4),
+               checksum of the chunk (4)
+*/
+
+#include "classad_log.h"
+
+#include <string>
+
+// the name of the snapshot for the log with the given sequence number
+std::string ClassAdLogSnapshotName(const char * log_filename, unsigned long sequence_number);
+
+// the path of a snapshot named in a log, which is in the log's directory
+std::string ClassAdLogSnapshotPath(const char * log_filename, const char * snapshot_name);
+
+// write the ads in the table to a snapshot file.
+bool WriteClassAdLogSnapshot(
+	const char * filename,          // in
+	unsigned long sequence_number,  // in
+	time_t original_log_birthdate,  // in
+	LoggableClassAdTable & la,      // in
+	unsigned long & num_ads,        // out
+	MyString & errmsg);             // out
+
+// read the ads in a snapshot file into the table.  the ads are decoded by
+// CLASSAD_LOG_SNAPSHOT_LOAD_THREADS threads, and put in the table (and in
+// the ClassAd cache) by this thread.
+bool LoadClassAdLogSnapshot(
+	const char * filename,          // in
+	LoggableClassAdTable & la,      // in,out
+	const ConstructLogEntry& maker, // in
+	unsigned long & num_ads,        // out
+	MyString & errmsg);             // out
+
+class ClassAdLogSnapshotFile;
+class ClassAdWireNames;
+class ClassAdWireReader;
+
+// Reads a snapshot one ad and one unparsed attribute at a time, for
+// followers of a log (see ClassAdLogParser) that want text.
+class ClassAdLogSnapshotReader
+{
+public:
+	ClassAdLogSnapshotReader();
+	~ClassAdLogSnapshotReader();
+
+	bool open(const char * filename, std::string & errmsg);
+	void close();
+
+	// the next ad.  returns false at the end of the snapshot, or if it is
+	// corrupt, in which case errmsg is set.
+	bool nextAd(std::string & key, std::string & mytype, std::string & targettype, std::string & errmsg);
+
+	// the next attribute of the current ad.  returns false after the last
+	// one, or if the snapshot is corrupt, in which case errmsg is set.
+	bool nextAttribute(std::string & name, std::string & value, std::string & errmsg);
+
+private:
+	ClassAdLogSnapshotFile * m_file;
+	ClassAdWireNames * m_names;
+	ClassAdWireReader * m_reader;
+	size_t m_chunk;         // the chunk being read
+	unsigned int m_ads;     // ads left in the chunk
+	unsigned long long m_attrs; // attributes left in the ad
+};
+
+#endif
@@ -24,6 +24,7 @@
 #include "condor_attributes.h"
 #include "my_hostname.h"
 #include "string_list.h"
+#include "condor_config.h"
 
 using namespace std;
 
@@ -32,6 +33,8 @@ using namespace std;
 
 #include "classad/classad_distribution.h"
 #include "classad_oldnew.h"
+#include "classad_wire.h"
+#include "classad/classadCache.h"
 #include "compat_classad.h"
 
 // local helper functions, options are one or more of PUT_CLASSAD_* flags
@@ -55,6 +58,116 @@ void AttrList_setPublishServerTimeMangled( bool publish)
 
 static const char *SECRET_MARKER = "ZKM"; // "it's a Zecret Klassad, Mon!"
 
+// Read the rest of a binary ad (see classad_wire.h), after the marker that
+// was read in place of the attribute count.  options are GET_CLASSAD_* flags,
+// the caller has already cleared the ad if it should be cleared.
+static bool
+_getClassAdBinary( Stream *sock, classad::ClassAd& ad, int options, bool rename_limits = false )
+{
+	bool use_cache = (options & GET_CLASSAD_NO_CACHE) == 0 && classad::ClassAdGetExpressionCaching();
+
+	int numExprs = 0, numSecrets = 0, cb = 0;
+	if ( ! sock->code(numExprs) || ! sock->code(numSecrets) || ! sock->code(cb)) {
+		dprintf(D_FULLDEBUG, "getClassAd FAILED to get binary ClassAd header\n");
+		return false;
+	}
+	if (numExprs < 0 || numSecrets < 0 || cb < 0 || numExprs > cb) {
+		dprintf(D_ALWAYS, "getClassAd got a bad binary ClassAd header (%d,%d,%d)\n", numExprs, numSecrets, cb);
+		return false;
+	}
+
+	std::string blob;
+	blob.resize(cb);
+	if (cb > 0 && ! sock->code_bytes(&blob[0], cb)) {
+		dprintf(D_FULLDEBUG, "getClassAd FAILED to get binary ClassAd\n");
+		return false;
+	}
+
+	if ( ! (options & GET_CLASSAD_NO_CLEAR)) {
+		ad.rehash(numExprs + numSecrets + 2 + 7);
+	}
+
+	ClassAdWireReader reader(sock->classad_wire_names(), blob.data(), blob.size());
+	std::string attr, key;
+	for (int ii = 0; ii < numExprs; ++ii) {
+		const char * value = NULL;
+		size_t value_len = 0;
+		if ( ! reader.attribute(attr, value, value_len)) {
+			dprintf(D_ALWAYS, "getClassAd FAILED to read binary attribute %d of %d\n", ii, numExprs);
+			return false;
+		}
+		if (rename_limits && strncmp(attr.c_str(), "ConcurrencyLimit.", 17) == 0) {
+			attr[16] = '_';
+		}
+
+		bool inserted = false;
+		classad::ExprTree * tree = NULL;
+		if (ClassAdWireReader::isLiteral(value, value_len)) {
+				// literals are as small as cache envelopes, so don't cache them
+			tree = reader.decode(value, value_len);
+			inserted = tree && ad.InsertLiteral(attr, static_cast<classad::Literal*>(tree));
+		} else if (use_cache && attr[0] != '\'') {
+				// the encoded value is the key in the cache.  it starts with
+				// a byte that can't start an unparsed expression, so it won't
+				// collide with the keys of ads that were sent as text.
+			key.assign(1, '\x01');
+			key.append(value, value_len);
+			tree = classad::CachedExprEnvelope::check_hit(attr, key);
+			if ( ! tree) {
+				tree = reader.decode(value, value_len);
+				if (tree) {
+					tree = classad::CachedExprEnvelope::cache(attr, tree, key);
+				}
+			}
+			inserted = tree && ad.Insert(attr, tree);
+		} else {
+			tree = reader.decode(value, value_len);
+			inserted = tree && ad.Insert(attr, tree);
+		}
+		if ( ! inserted) {
+			dprintf(D_ALWAYS, "getClassAd FAILED to insert binary attribute %s\n", attr.c_str());
+			return false;
+		}
+	}
+	if ( ! reader.atEnd()) {
+		dprintf(D_ALWAYS, "getClassAd got extra bytes after the binary attributes\n");
+		return false;
+	}
+
+		// the secret attributes are sent as text, like in a text ad
+	for (int ii = 0; ii < numSecrets; ++ii) {
+		char *secret_line = NULL;
+		if ( ! sock->get_secret(secret_line) || ! secret_line) {
+			dprintf(D_FULLDEBUG, "getClassAd Failed to read encrypted ClassAd expression.\n");
+			free(secret_line);
+			return false;
+		}
+		if (rename_limits && strncmp(secret_line, "ConcurrencyLimit.", 17) == 0) {
+			secret_line[16] = '_';
+		}
+		bool inserted = InsertLongFormAttrValue(ad, secret_line, use_cache);
+		if ( ! inserted) {
+			dprintf(D_ALWAYS, "getClassAd FAILED to insert secret attribute\n");
+		}
+		free(secret_line);
+		if ( ! inserted) {
+			return false;
+		}
+	}
+
+	if (options & GET_CLASSAD_NO_TYPES) {
+		return true;
+	}
+
+		// we fetch but ignore MyType and TargetType
+	const char * strptr = NULL;
+	if ( ! sock->get_string_ptr(strptr) || ! sock->get_string_ptr(strptr)) {
+		dprintf(D_FULLDEBUG, "getClassAd FAILED to get MyType and TargetType\n");
+		return false;
+	}
+	return true;
+}
+
 compat_classad::ClassAd *
 getClassAd( Stream *sock )
 {
@@ -80,6 +193,9 @@ bool getClassAd( Stream *sock, classad::ClassAd& ad )
 	if( !sock->code( numExprs ) ) {
  		return false;
 	}
+	if( numExprs == CLASSAD_WIRE_BINARY_MARKER ) {
+		return _getClassAdBinary( sock, ad, 0 );
+	}
 
 	// at least numExprs are coming, but we may add
 	// my, target, and a couple extra right away
@@ -256,6 +372,9 @@ bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 	if( !sock->code( numExprs ) ) {
 		return false;
 	}
+	if (numExprs == CLASSAD_WIRE_BINARY_MARKER) {
+		return _getClassAdBinary(sock, ad, options);
+	}
 
 	// at least numExprs are coming, but we may add
 	// my, target, and a couple extra right away
@@ -438,6 +557,9 @@ getClassAdNoTypes( Stream *sock, classad::ClassAd& ad )
 	if( !sock->code( numExprs ) ) {
  		return false;
 	}
+	if( numExprs == CLASSAD_WIRE_BINARY_MARKER ) {
+		return _getClassAdBinary( sock, ad, GET_CLASSAD_NO_TYPES, true );
+	}
 
 		// pack exprs into classad
 	buffer = "[";
@@ -842,7 +964,7 @@ int _putClassAd_v0( Stream *sock, classad::ClassAd& ad, bool excludeTypes, bool
     {
         // Now, we always send empty strings for the special-case
         // MyType/TargetType values at the end of the ad.
-        if (!sock->put("") || !souck->put("")) {
+        if (!sock->put("") || !sock->put("")) {
             return false;
         }
     }
@@ -932,8 +1054,153 @@ static int _putClassAdTrailingInfo(Stream *sock, classad::ClassAd& /* ad */, boo
 	return true;
 }
 
+static bool enable_binary_classads = false;
+
+void ConfigClassAdWireEncoding()
+{
+	enable_binary_classads = param_boolean("ENABLE_BINARY_CLASSADS", false);
+}
+
+// true if the ad should be sent in the binary encoding
+static bool _putClassAdWantsBinary(Stream *sock, int options)
+{
+	if (options & PUT_CLASSAD_BINARY) {
+		return true;
+	}
+	if ( ! enable_binary_classads) {
+		return false;
+	}
+		// 8.7.4 and older only read the text encoding
+	CondorVersionInfo const *peer = sock->get_peer_version();
+	return peer && peer->built_since_version(8, 7, 5);
+}
+
+// true if the expression is a string literal that looks like a sinful string,
+// which ConvertDefaultIPToSocketIP() may want to rewrite.
+static bool _isSinfulLiteral(classad::ExprTree const *expr)
+{
+	if (expr->GetKind() == classad::ExprTree::EXPR_ENVELOPE) {
+		expr = ((classad::CachedExprEnvelope const *)expr)->get();
+	}
+	if ( ! expr || expr->GetKind() != classad::ExprTree::LITERAL_NODE) {
+		return false;
+	}
+	classad::Value::NumberFactor factor;
+	const char *str = NULL;
+	return ((classad::Literal const *)expr)->getValue(factor).IsStringValue(str) && str[0] == '<';
+}
+
+// send the ad in the binary encoding (see classad_wire.h).  the attributes
+// that are sent are chosen the same way as by _putClassAd(), the whitelist
+// is NULL to send all of them.
+static int _putClassAdBinary(Stream *sock, classad::ClassAd& ad, int options, const classad::References *whitelist)
+{
+	bool excludeTypes = (options & PUT_CLASSAD_NO_TYPES) == PUT_CLASSAD_NO_TYPES;
+	bool exclude_private = (options & PUT_CLASSAD_NO_PRIVATE) == PUT_CLASSAD_NO_PRIVATE;
+	bool send_secrets = ! sock->prepare_crypto_for_secret_is_noop();
+
+	std::vector< std::pair<const std::string *, classad::ExprTree *> > attrs;
+	if (whitelist) {
+		for (classad::References::const_iterator attr = whitelist->begin(); attr != whitelist->end(); ++attr) {
+			classad::ExprTree *expr = ad.Lookup(*attr);
+			if ( ! expr || (exclude_private && compat_classad::ClassAdAttributeIsPrivate(attr->c_str()))) {
+				continue;
+			}
+			if (publish_server_timeMangled && strcasecmp(attr->c_str(), ATTR_SERVER_TIME) == 0) {
+				continue;
+			}
+			attrs.push_back(std::make_pair(&*attr, expr));
+		}
+	} else {
+			// the chained attrs first, so the ad's own attrs override them
+		classad::ClassAd *chainedAd = ad.GetChainedParentAd();
+		for (int pass = chainedAd ? 0 : 1; pass < 2; pass++) {
+			classad::ClassAd *from = pass ? &ad : chainedAd;
+			for (classad::AttrList::const_iterator itor = from->begin(); itor != from->end(); ++itor) {
+				const char *attr = itor->first.c_str();
+				if (strcasecmp(ATTR_CURRENT_TIME, attr) == 0) {
+					continue;
+				}
+				if (exclude_private && compat_classad::ClassAdAttributeIsPrivate(attr)) {
+					continue;
+				}
+				if (excludeTypes && (strcasecmp(ATTR_MY_TYPE, attr) == 0 || strcasecmp(ATTR_TARGET_TYPE, attr) == 0)) {
+					continue;
+				}
+				attrs.push_back(std::make_pair(&itor->first, itor->second));
+			}
+		}
+	}
+
+	classad::ClassAdUnParser unp;
+	unp.SetOldClassAd( true, true );
+	classad::ClassAdParser parser;
+	parser.SetOldClassAd( true );
+
+	ClassAdWireWriter writer(sock->classad_wire_names());
+	std::vector<std::string> secrets;
+	std::string buf;
+	int numExprs = 0;
+	for (size_t ii = 0; ii < attrs.size(); ++ii) {
+		const std::string &attr = *attrs[ii].first;
+		classad::ExprTree *expr = attrs[ii].second;
+		bool secret = send_secrets && compat_classad::ClassAdAttributeIsPrivate(attr.c_str());
+
+		if (secret || _isSinfulLiteral(expr)) {
+			buf = attr;
+			buf += " = ";
+			size_t rhs = buf.size();
+			unp.Unparse( buf, expr );
+			ConvertDefaultIPToSocketIP(attr.c_str(), buf, *sock);
+			if (secret) {
+				secrets.push_back(buf);
+				continue;
+			}
+			classad::ExprTree *converted = parser.ParseExpression(buf.substr(rhs));
+			if (converted) {
+				writer.attribute(attr, converted);
+				delete converted;
+				++numExprs;
+				continue;
+			}
+		}
+		writer.attribute(attr, expr);
+		++numExprs;
+	}
+
+	if (publish_server_timeMangled) {
+		classad::Literal *now = classad::Literal::MakeLong((long long)time(NULL));
+		writer.attribute(ATTR_SERVER_TIME, now);
+		delete now;
+		++numExprs;
+	}
+
+	int marker = CLASSAD_WIRE_BINARY_MARKER;
+	int numSecrets = (int)secrets.size();
+	int cb = (int)writer.buffer().size();
+
+	sock->encode( );
+	if ( ! sock->code(marker) || ! sock->code(numExprs) || ! sock->code(numSecrets) || ! sock->code(cb)) {
+		return false;
+	}
+	if (cb > 0 && ! sock->code_bytes(const_cast<char*>(writer.buffer().data()), cb)) {
+		return false;
+	}
+	for (size_t ii = 0; ii < secrets.size(); ++ii) {
+		if ( ! sock->put_secret(secrets[ii].c_str())) {
+			return false;
+		}
+	}
+
+	return _putClassAdTrailingInfo(sock, ad, false, excludeTypes);
+}
+
 int _putClassAd( Stream *sock, classad::ClassAd& ad, int options)
 {
+	if (_putClassAdWantsBinary(sock, options)) {
+		return _putClassAdBinary(sock, ad, options, NULL);
+	}
+
 	bool excludeTypes = (options & PUT_CLASSAD_NO_TYPES) == PUT_CLASSAD_NO_TYPES;
 	bool exclude_private = (options & PUT_CLASSAD_NO_PRIVATE) == PUT_CLASSAD_NO_PRIVATE;
 
@@ -1067,6 +1334,10 @@ int _putClassAd( Stream *sock, classad::ClassAd& ad, int options)
 
 int _putClassAd( Stream *sock, classad::ClassAd& ad, int options, const classad::References &whitelist)
 {
+	if (_putClassAdWantsBinary(sock, options)) {
+		return _putClassAdBinary(sock, ad, options, &whitelist);
+	}
+
 	bool excludeTypes = (options & PUT_CLASSAD_NO_TYPES) == PUT_CLASSAD_NO_TYPES;
 	bool exclude_private = (options & PUT_CLASSAD_NO_PRIVATE) == PUT_CLASSAD_NO_PRIVATE;
 
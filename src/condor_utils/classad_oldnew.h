@@ -82,6 +82,11 @@ int putClassAd (Stream *sock, classad::ClassAd& ad, int options, const classad::
 #define PUT_CLASSAD_NO_TYPES            0x02 // exclude MyType and TargetType from output.
 #define PUT_CLASSAD_NON_BLOCKING        0x04 // use non-blocking sematics. returns 2 of this would have blocked.
 #define PUT_CLASSAD_NO_EXPAND_WHITELIST 0x08 // use the whitelist argument as-is, (default is to expand internal references before using it)
+#define PUT_CLASSAD_BINARY              0x10 // use the binary encoding (see classad_wire.h) even if the peer may not understand it
+
+// read ENABLE_BINARY_CLASSADS, which lets putClassAd() use the binary encoding
+// with peers whose version says they understand it.
+void ConfigClassAdWireEncoding();
 
 // fetch the given attribute from the queryAd and convert it into a set of attributes
 //   the attribute should be a string value containing a comma and/or space separated list of attributes (like StringList)
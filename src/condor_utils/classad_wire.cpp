@@ -0,0 +1,577 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "classad_wire.h"
+#include "classad/classadCache.h"
+
+using namespace classad;
+
+// the node types.  literals come first so isLiteral() can test for them.
+enum {
+	WIRE_UNDEFINED = 0,
+	WIRE_ERROR,
+	WIRE_TRUE,
+	WIRE_FALSE,
+	WIRE_INTEGER,
+	WIRE_REAL,
+	WIRE_STRING,
+	WIRE_ABSTIME,
+	WIRE_RELTIME,
+	WIRE_LAST_LITERAL = WIRE_RELTIME,
+
+	WIRE_ATTR = 16,     // name
+	WIRE_ATTR_ABS,      // .name
+	WIRE_ATTR_SCOPED,   // expr.name
+	WIRE_OPERATION,     // op, mask of operands present, operands
+	WIRE_FUNCTION,      // name, argument count, arguments
+	WIRE_CLASSAD,       // attribute count, (name, expr) pairs
+	WIRE_LIST,          // count, exprs
+	WIRE_TEXT           // anything else, as unparsed text
+};
+
+// deeper trees than this are refused by the reader
+static const int max_wire_depth = 1000;
+
+int
+ClassAdWireNames::ref(const std::string & name)
+{
+	std::map<std::string, int>::iterator it = m_ids.find(name);
+	if (it != m_ids.end()) {
+		return it->second;
+	}
+	int id = (int)m_ids.size() + 1;
+	m_ids.insert(std::make_pair(name, id));
+	return -id;
+}
+
+bool
+ClassAdWireNames::define(int id, const std::string & name)
+{
+		// ids are given out in order, so a gap means the sender and
+		// receiver disagree about what was sent.
+	if (id < 1 || id > (int)m_names.size() + 1) {
+		return false;
+	}
+	if (id == (int)m_names.size() + 1) {
+		m_names.push_back(name);
+	} else {
+		m_names[id - 1] = name;
+	}
+	return true;
+}
+
+const std::string *
+ClassAdWireNames::lookup(int id) const
+{
+	if (id < 1 || id > (int)m_names.size()) {
+		return NULL;
+	}
+	return &m_names[id - 1];
+}
+
+//
+// ClassAdWireWriter
+//
+
+void
+ClassAdWireWriter::uvarint(unsigned long long val)
+{
+	while (val >= 0x80) {
+		m_buf += (char)((val & 0x7f) | 0x80);
+		val >>= 7;
+	}
+	m_buf += (char)val;
+}
+
+void
+ClassAdWireWriter::svarint(long long val)
+{
+	uvarint(((unsigned long long)val << 1) ^ (unsigned long long)(val >> 63));
+}
+
+void
+ClassAdWireWriter::real(double val)
+{
+	unsigned long long bits;
+	memcpy(&bits, &val, sizeof(bits));
+	for (int i = 0; i < 8; i++) {
+		m_buf += (char)(bits & 0xff);
+		bits >>= 8;
+	}
+}
+
+void
+ClassAdWireWriter::str(const std::string & s)
+{
+	uvarint(s.size());
+	m_buf += s;
+}
+
+void
+ClassAdWireWriter::name(const std::string & name)
+{
+	int id = m_names.ref(name);
+	svarint(id);
+	if (id < 0) {
+		str(name);
+	}
+}
+
+void
+ClassAdWireWriter::attribute(const std::string & attr, const ExprTree * tree)
+{
+	name(attr);
+
+		// the value goes in its own buffer first, so its length can be
+		// sent in front of it.
+	m_value.clear();
+	m_buf.swap(m_value);
+	expr(tree);
+	m_buf.swap(m_value);
+	uvarint(m_value.size());
+	m_buf += m_value;
+}
+
+void
+ClassAdWireWriter::expr(const ExprTree * tree)
+{
+	if ( ! tree) {
+		m_buf += (char)WIRE_UNDEFINED;
+		return;
+	}
+
+	switch (tree->GetKind()) {
+	case ExprTree::LITERAL_NODE: {
+		Value::NumberFactor factor;
+		const Value & val = ((const Literal *)tree)->getValue(factor);
+		if (factor != Value::NO_FACTOR) {
+			break; // rare, send it as text
+		}
+		bool b;
+		long long i;
+		double d;
+		const char * s;
+		abstime_t at;
+		switch (val.GetType()) {
+		case Value::UNDEFINED_VALUE:
+			m_buf += (char)WIRE_UNDEFINED;
+			return;
+		case Value::ERROR_VALUE:
+			m_buf += (char)WIRE_ERROR;
+			return;
+		case Value::BOOLEAN_VALUE:
+			val.IsBooleanValue(b);
+			m_buf += (char)(b ? WIRE_TRUE : WIRE_FALSE);
+			return;
+		case Value::INTEGER_VALUE:
+			val.IsIntegerValue(i);
+			m_buf += (char)WIRE_INTEGER;
+			svarint(i);
+			return;
+		case Value::REAL_VALUE:
+			val.IsRealValue(d);
+			m_buf += (char)WIRE_REAL;
+			real(d);
+			return;
+		case Value::STRING_VALUE: {
+			int len = 0;
+			val.IsStringValue(s);
+			val.IsStringValue(len);
+			m_buf += (char)WIRE_STRING;
+			uvarint(len);
+			m_buf.append(s, len);
+			return;
+		}
+		case Value::ABSOLUTE_TIME_VALUE:
+			val.IsAbsoluteTimeValue(at);
+			m_buf += (char)WIRE_ABSTIME;
+			svarint(at.secs);
+			svarint(at.offset);
+			return;
+		case Value::RELATIVE_TIME_VALUE:
+			val.IsRelativeTimeValue(d);
+			m_buf += (char)WIRE_RELTIME;
+			real(d);
+			return;
+		default:
+			break;
+		}
+		break;
+	}
+
+	case ExprTree::ATTRREF_NODE: {
+		ExprTree * scope = NULL;
+		std::string attr;
+		bool absolute = false;
+		((const AttributeReference *)tree)->GetComponents(scope, attr, absolute);
+		if (scope) {
+			m_buf += (char)WIRE_ATTR_SCOPED;
+			expr(scope);
+		} else {
+			m_buf += (char)(absolute ? WIRE_ATTR_ABS : WIRE_ATTR);
+		}
+		str(attr);
+		return;
+	}
+
+	case ExprTree::OP_NODE: {
+		Operation::OpKind op;
+		ExprTree *e1 = NULL, *e2 = NULL, *e3 = NULL;
+		((const Operation *)tree)->GetComponents(op, e1, e2, e3);
+		m_buf += (char)WIRE_OPERATION;
+		m_buf += (char)op;
+		m_buf += (char)((e1 ? 1 : 0) | (e2 ? 2 : 0) | (e3 ? 4 : 0));
+		if (e1) expr(e1);
+		if (e2) expr(e2);
+		if (e3) expr(e3);
+		return;
+	}
+
+	case ExprTree::FN_CALL_NODE: {
+		std::string fn;
+		std::vector<ExprTree *> args;
+		((const FunctionCall *)tree)->GetComponents(fn, args);
+		m_buf += (char)WIRE_FUNCTION;
+		str(fn);
+		uvarint(args.size());
+		for (size_t i = 0; i < args.size(); i++) {
+			expr(args[i]);
+		}
+		return;
+	}
+
+	case ExprTree::CLASSAD_NODE: {
+		std::vector< std::pair<std::string, ExprTree *> > attrs;
+		((const ClassAd *)tree)->GetComponents(attrs);
+		m_buf += (char)WIRE_CLASSAD;
+		uvarint(attrs.size());
+		for (size_t i = 0; i < attrs.size(); i++) {
+			str(attrs[i].first);
+			expr(attrs[i].second);
+		}
+		return;
+	}
+
+	case ExprTree::EXPR_LIST_NODE: {
+		std::vector<ExprTree *> items;
+		((const ExprList *)tree)->GetComponents(items);
+		m_buf += (char)WIRE_LIST;
+		uvarint(items.size());
+		for (size_t i = 0; i < items.size(); i++) {
+			expr(items[i]);
+		}
+		return;
+	}
+
+	case ExprTree::EXPR_ENVELOPE:
+		expr(((const CachedExprEnvelope *)tree)->get());
+		return;
+
+	default:
+		break;
+	}
+
+	ClassAdUnParser unparser;
+	unparser.SetOldClassAd(true, true);
+	std::string text;
+	unparser.Unparse(text, tree);
+	m_buf += (char)WIRE_TEXT;
+	str(text);
+}
+
+//
+// ClassAdWireReader
+//
+
+bool
+ClassAdWireReader::uvarint(unsigned long long & val)
+{
+	val = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (m_ptr == m_end) {
+			return false;
+		}
+		unsigned char ch = (unsigned char)*m_ptr++;
+		val |= (unsigned long long)(ch & 0x7f) << shift;
+		if ( ! (ch & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+ClassAdWireReader::svarint(long long & val)
+{
+	unsigned long long u;
+	if ( ! uvarint(u)) {
+		return false;
+	}
+	val = (long long)(u >> 1) ^ -(long long)(u & 1);
+	return true;
+}
+
+bool
+ClassAdWireReader::real(double & val)
+{
+	if (m_end - m_ptr < 8) {
+		return false;
+	}
+	unsigned long long bits = 0;
+	for (int i = 7; i >= 0; i--) {
+		bits = (bits << 8) | (unsigned char)m_ptr[i];
+	}
+	m_ptr += 8;
+	memcpy(&val, &bits, sizeof(val));
+	return true;
+}
+
+bool
+ClassAdWireReader::str(std::string & s)
+{
+	unsigned long long len;
+	if ( ! uvarint(len) || len > (unsigned long long)(m_end - m_ptr)) {
+		return false;
+	}
+	s.assign(m_ptr, (size_t)len);
+	m_ptr += len;
+	return true;
+}
+
+bool
+ClassAdWireReader::name(std::string & name)
+{
+	long long id;
+	if ( ! svarint(id) || id == 0 || id > INT_MAX || id < -INT_MAX) {
+		return false;
+	}
+	if (id < 0) {
+		return str(name) && m_names.define((int)-id, name);
+	}
+	const std::string * known = m_names.lookup((int)id);
+	if ( ! known) {
+		return false;
+	}
+	name = *known;
+	return true;
+}
+
+bool
+ClassAdWireReader::attribute(std::string & attr, const char *& value, size_t & value_len)
+{
+	unsigned long long len;
+	if ( ! name(attr) || ! uvarint(len) || len == 0 || len > (unsigned long long)(m_end - m_ptr)) {
+		return false;
+	}
+	value = m_ptr;
+	value_len = (size_t)len;
+	m_ptr += len;
+	return true;
+}
+
+bool
+ClassAdWireReader::isLiteral(const char * value, size_t value_len)
+{
+	return value_len > 0 && (unsigned char)value[0] <= WIRE_LAST_LITERAL;
+}
+
+ExprTree *
+ClassAdWireReader::decode(const char * value, size_t value_len)
+{
+	const char * ptr = m_ptr;
+	const char * end = m_end;
+	m_ptr = value;
+	m_end = value + value_len;
+	m_depth = 0;
+
+	ExprTree * tree = expr();
+	if (tree && m_ptr != m_end) {
+		delete tree;
+		tree = NULL;
+	}
+
+	m_ptr = ptr;
+	m_end = end;
+	return tree;
+}
+
+ExprTree *
+ClassAdWireReader::expr()
+{
+	if (m_ptr == m_end || m_depth >= max_wire_depth) {
+		return NULL;
+	}
+	int type = (unsigned char)*m_ptr++;
+
+	long long i;
+	double d;
+	std::string s;
+	Value val;
+
+	switch (type) {
+	case WIRE_UNDEFINED:
+		return Literal::MakeUndefined();
+	case WIRE_ERROR:
+		return Literal::MakeError();
+	case WIRE_TRUE:
+		return Literal::MakeBool(true);
+	case WIRE_FALSE:
+		return Literal::MakeBool(false);
+	case WIRE_INTEGER:
+		if ( ! svarint(i)) return NULL;
+		return Literal::MakeLong(i);
+	case WIRE_REAL:
+		if ( ! real(d)) return NULL;
+		return Literal::MakeReal(d);
+	case WIRE_STRING:
+		if ( ! str(s)) return NULL;
+		return Literal::MakeString(s);
+	case WIRE_ABSTIME: {
+		long long offset;
+		if ( ! svarint(i) || ! svarint(offset)) return NULL;
+		abstime_t at;
+		at.secs = (time_t)i;
+		at.offset = (int)offset;
+		val.SetAbsoluteTimeValue(at);
+		return Literal::MakeLiteral(val);
+	}
+	case WIRE_RELTIME:
+		if ( ! real(d)) return NULL;
+		val.SetRelativeTimeValue(d);
+		return Literal::MakeLiteral(val);
+	default:
+		break;
+	}
+
+	ExprTree * tree = NULL;
+	++m_depth;
+	switch (type) {
+	case WIRE_ATTR:
+	case WIRE_ATTR_ABS:
+		if (str(s)) {
+			tree = AttributeReference::MakeAttributeReference(NULL, s, type == WIRE_ATTR_ABS);
+		}
+		break;
+
+	case WIRE_ATTR_SCOPED: {
+		ExprTree * scope = expr();
+		if (scope && str(s)) {
+			tree = AttributeReference::MakeAttributeReference(scope, s, false);
+		} else {
+			delete scope;
+		}
+		break;
+	}
+
+	case WIRE_OPERATION: {
+		if (m_end - m_ptr < 2) break;
+		int op = (unsigned char)*m_ptr++;
+		int mask = (unsigned char)*m_ptr++;
+		if (op < Operation::__FIRST_OP__ || op > Operation::__LAST_OP__ || (mask & ~7)) break;
+		ExprTree * e[3] = { NULL, NULL, NULL };
+		bool ok = true;
+		for (int ii = 0; ii < 3 && ok; ii++) {
+			if (mask & (1 << ii)) {
+				e[ii] = expr();
+				ok = e[ii] != NULL;
+			}
+		}
+		if (ok) {
+			tree = Operation::MakeOperation((Operation::OpKind)op, e[0], e[1], e[2]);
+		}
+		if ( ! tree) {
+			delete e[0]; delete e[1]; delete e[2];
+		}
+		break;
+	}
+
+	case WIRE_FUNCTION: {
+		unsigned long long count;
+		if ( ! str(s) || ! uvarint(count) || count > (unsigned long long)(m_end - m_ptr)) break;
+		std::vector<ExprTree *> args;
+		bool ok = true;
+		for (unsigned long long ii = 0; ii < count && ok; ii++) {
+			ExprTree * arg = expr();
+			ok = arg != NULL;
+			if (ok) args.push_back(arg);
+		}
+		if (ok) {
+			tree = FunctionCall::MakeFunctionCall(s, args);
+		}
+		if ( ! tree) {
+			for (size_t ii = 0; ii < args.size(); ii++) delete args[ii];
+		}
+		break;
+	}
+
+	case WIRE_CLASSAD: {
+		unsigned long long count;
+		if ( ! uvarint(count) || count > (unsigned long long)(m_end - m_ptr)) break;
+		ClassAd * ad = new ClassAd();
+		bool ok = true;
+		for (unsigned long long ii = 0; ii < count && ok; ii++) {
+			ExprTree * item = NULL;
+			ok = str(s) && (item = expr()) != NULL;
+			if (ok && ! ad->Insert(s, item)) {
+				delete item;
+				ok = false;
+			}
+		}
+		if (ok) {
+			tree = ad;
+		} else {
+			delete ad;
+		}
+		break;
+	}
+
+	case WIRE_LIST: {
+		unsigned long long count;
+		if ( ! uvarint(count) || count > (unsigned long long)(m_end - m_ptr)) break;
+		std::vector<ExprTree *> items;
+		bool ok = true;
+		for (unsigned long long ii = 0; ii < count && ok; ii++) {
+			ExprTree * item = expr();
+			ok = item != NULL;
+			if (ok) items.push_back(item);
+		}
+		if (ok) {
+			tree = ExprList::MakeExprList(items);
+		}
+		if ( ! tree) {
+			for (size_t ii = 0; ii < items.size(); ii++) delete items[ii];
+		}
+		break;
+	}
+
+	case WIRE_TEXT: {
+		if ( ! str(s)) break;
+		ClassAdParser parser;
+		parser.SetOldClassAd(true);
+		tree = parser.ParseExpression(s);
+		break;
+	}
+
+	default:
+		break;
+	}
+	--m_depth;
+	return tree;
+}
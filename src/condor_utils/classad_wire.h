@@ -0,0 +1,137 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _CLASSAD_WIRE_H
+#define _CLASSAD_WIRE_H
+
+/*
+  The binary encoding of ClassAds used by putClassAd() and getClassAd().
+
+  A binary ad is sent as CLASSAD_WIRE_BINARY_MARKER where a text ad has its
+  attribute count, so a receiver can tell the two apart; a sender only uses
+  it with peers whose version says they understand it.  After the marker
+  come the number of attributes and the number of secret attributes, then
+  the attributes as one block of bytes, then the secret attributes as text
+  (encrypted the same way as in a text ad), then the same trailer as a text
+  ad.
+
+  In the block each attribute is the reference to its name, the length of
+  its value and the value.  Literals are sent by type and value, and other
+  expressions as the tree the sender has, in prefix order, so the receiver
+  only has to build the nodes.  Integers are variable length.
+
+  The names of the attributes in the attribute list are sent once per CEDAR
+  message, after which they are sent as a number.  A new name is sent as the
+  negative of the number it is given followed by the name, so a receiver
+  that skips part of a message (and so misses some names) fails instead of
+  using the wrong names.  Names inside a value are sent as strings, so that
+  the encoded value does not depend on the message it is in and can be used
+  as the key of the ClassAd cache.
+*/
+
+#include "classad/classad_distribution.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// sent in place of the attribute count of a text ad
+#define CLASSAD_WIRE_BINARY_MARKER  (-0x43414431)
+
+// The attribute names sent or received in binary ads in the current message.
+class ClassAdWireNames
+{
+public:
+	void clear() { m_ids.clear(); m_names.clear(); }
+
+	// the number to send for a name.  a name that was not sent before
+	// is given the next number, and the negative of it is returned.
+	int ref(const std::string & name);
+
+	// remember a name that was received, or look one up.
+	bool define(int id, const std::string & name);
+	const std::string * lookup(int id) const;
+
+private:
+	std::map<std::string, int> m_ids;
+	std::vector<std::string> m_names; // by id - 1
+};
+
+class ClassAdWireWriter
+{
+public:
+	ClassAdWireWriter(ClassAdWireNames & names) : m_names(names) {}
+
+	// append an attribute to the block
+	void attribute(const std::string & name, const classad::ExprTree * expr);
+
+	const std::string & buffer() const { return m_buf; }
+	void clear() { m_buf.clear(); }
+
+	// append a string or a number, for formats that put other things
+	// in the block between the attributes
+	void str(const std::string & str);
+	void uvarint(unsigned long long val);
+
+private:
+	void expr(const classad::ExprTree * tree);
+	void name(const std::string & name);
+	void svarint(long long val);
+	void real(double val);
+
+	ClassAdWireNames & m_names;
+	std::string m_buf;
+	std::string m_value; // scratch for the value of an attribute
+};
+
+class ClassAdWireReader
+{
+public:
+	ClassAdWireReader(ClassAdWireNames & names, const char * data, size_t len)
+		: m_names(names), m_ptr(data), m_end(data + len), m_depth(0) {}
+
+	bool atEnd() const { return m_ptr == m_end; }
+
+	// the next attribute in the block.  value points at the encoded value,
+	// for the caller to decode or to look up in a cache.
+	bool attribute(std::string & name, const char *& value, size_t & value_len);
+
+	// decode a value returned by attribute()
+	classad::ExprTree * decode(const char * value, size_t value_len);
+
+	// true if the encoded value is a literal, which is not worth caching
+	static bool isLiteral(const char * value, size_t value_len);
+
+	// read what ClassAdWireWriter::str() and uvarint() appended
+	bool str(std::string & str);
+	bool uvarint(unsigned long long & val);
+
+private:
+	classad::ExprTree * expr();
+	bool name(std::string & name);
+	bool svarint(long long & val);
+	bool real(double & val);
+
+	ClassAdWireNames & m_names;
+	const char * m_ptr;
+	const char * m_end;
+	int m_depth;
+};
+
+#endif
@@ -187,6 +187,7 @@ const struct Translation DCTranslation[] = {
         { "UPDATE_JOBAD", UPDATE_JOBAD },
 	{ "DRAIN_JOBS", DRAIN_JOBS },
 	{ "CANCEL_DRAIN_JOBS", CANCEL_DRAIN_JOBS },
+	{ "REQUEST_FULL_STARTD_BATCH", REQUEST_FULL_STARTD_BATCH },
 	{ "DC_AUTHENTICATE", DC_AUTHENTICATE },
 	{ "DC_SEC_QUERY", DC_SEC_QUERY },
 	{ "DC_NOP", DC_NOP },
@@ -312,6 +313,7 @@ const struct Translation CollectorTranslation[] = {
 	{ "UPDATE_ACCOUNTING_AD", UPDATE_ACCOUNTING_AD },
 	{ "QUERY_ACCOUNTING_ADS", QUERY_ACCOUNTING_ADS },
 	{ "INVALIDATE_ACCOUNTING_ADS", INVALIDATE_ACCOUNTING_ADS },
+	{ "UPDATE_STARTD_ADS_BATCH", UPDATE_STARTD_ADS_BATCH },
 	{ "", 0 }
 };
 
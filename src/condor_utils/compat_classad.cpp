@@ -67,11 +67,13 @@ static void classad_debug_dprintf(const char *s);
 #if !defined(WIN32)
 classad::References ClassAdPrivateAttrs = { ATTR_CAPABILITY,
 		ATTR_CHILD_CLAIM_IDS, ATTR_CLAIM_ID, ATTR_CLAIM_ID_LIST,
-		ATTR_CLAIM_IDS, ATTR_PAIRED_CLAIM_ID, ATTR_TRANSFER_KEY };
+		ATTR_CLAIM_IDS, ATTR_PAIRED_CLAIM_ID, ATTR_STARTD_BATCH_PRIVATE_ADS,
+		ATTR_TRANSFER_KEY };
 #else
 static const std::string private_attrs[] = { ATTR_CAPABILITY,
 		ATTR_CHILD_CLAIM_IDS, ATTR_CLAIM_ID, ATTR_CLAIM_ID_LIST,
-		ATTR_CLAIM_IDS, ATTR_PAIRED_CLAIM_ID, ATTR_TRANSFER_KEY };
+		ATTR_CLAIM_IDS, ATTR_PAIRED_CLAIM_ID, ATTR_STARTD_BATCH_PRIVATE_ADS,
+		ATTR_TRANSFER_KEY };
 classad::References ClassAdPrivateAttrs( private_attrs, private_attrs + COUNTOF(private_attrs) );
 #endif
 
@@ -85,6 +87,8 @@ Reconfig()
 	classad::SetOldClassAdSemantics( !m_strictEvaluation );
 
 	classad::ClassAdSetExpressionCaching( param_boolean( "ENABLE_CLASSAD_CACHING", false ) );
+	classad::ClassAdSetExpressionCompiling( param_boolean( "ENABLE_CLASSAD_COMPILING", false ) );
+	classad::ClassAdSetRegexCacheSize( param_integer( "CLASSAD_REGEX_CACHE_SIZE", 100, 0 ) );
 
 	char *new_libs = param( "CLASSAD_USER_LIBS" );
 	if ( new_libs ) {
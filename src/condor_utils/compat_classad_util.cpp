@@ -22,12 +22,10 @@
 #include "classad_oldnew.h"
 #include "string_list.h"
 #include "condor_adtypes.h"
+#include "condor_attributes.h"
 #include "classad/classadCache.h" // for CachedExprEnvelope
 
 #include "compat_classad_list.h"
-#ifdef _OPENMP
-#include <omp.h>
-#endif
 
 /* TODO This function needs to be tested.
  */
@@ -496,6 +494,73 @@ int RewriteAttrRefs(classad::ExprTree * tree, const NOCASE_STRING_MAP & mapping)
 	return iret;
 }
 
+bool ExprTreeDependsOnTime(const classad::ExprTree * tree)
+{
+	if ( ! tree) return false;
+	switch (tree->GetKind()) {
+		case classad::ExprTree::LITERAL_NODE:
+			return false;
+
+		case classad::ExprTree::ATTRREF_NODE: {
+			classad::ExprTree *expr;
+			std::string ref;
+			bool absolute;
+			((const classad::AttributeReference*)tree)->GetComponents(expr, ref, absolute);
+			if (strcasecmp(ref.c_str(), ATTR_CURRENT_TIME) == 0 || strcasecmp(ref.c_str(), ATTR_SERVER_TIME) == 0) {
+				return true;
+			}
+			return ExprTreeDependsOnTime(expr);
+		}
+
+		case classad::ExprTree::OP_NODE: {
+			classad::Operation::OpKind	op;
+			classad::ExprTree *t1, *t2, *t3;
+			((const classad::Operation*)tree)->GetComponents( op, t1, t2, t3 );
+			return ExprTreeDependsOnTime(t1) || ExprTreeDependsOnTime(t2) || ExprTreeDependsOnTime(t3);
+		}
+
+		case classad::ExprTree::FN_CALL_NODE: {
+			std::string fnName;
+			std::vector<classad::ExprTree*> args;
+			((const classad::FunctionCall*)tree)->GetComponents( fnName, args );
+			if (strcasecmp(fnName.c_str(), "time") == 0 ||
+				strcasecmp(fnName.c_str(), "random") == 0 ||
+				strcasecmp(fnName.c_str(), "eval") == 0) {
+				return true;
+			}
+			for (std::vector<classad::ExprTree*>::iterator it = args.begin(); it != args.end(); ++it) {
+				if (ExprTreeDependsOnTime(*it)) return true;
+			}
+			return false;
+		}
+
+		case classad::ExprTree::CLASSAD_NODE: {
+			std::vector< std::pair<std::string, classad::ExprTree*> > attrs;
+			((const classad::ClassAd*)tree)->GetComponents(attrs);
+			for (std::vector< std::pair<std::string, classad::ExprTree*> >::iterator it = attrs.begin(); it != attrs.end(); ++it) {
+				if (ExprTreeDependsOnTime(it->second)) return true;
+			}
+			return false;
+		}
+
+		case classad::ExprTree::EXPR_LIST_NODE: {
+			std::vector<classad::ExprTree*> exprs;
+			((const classad::ExprList*)tree)->GetComponents( exprs );
+			for (std::vector<classad::ExprTree*>::iterator it = exprs.begin(); it != exprs.end(); ++it) {
+				if (ExprTreeDependsOnTime(*it)) return true;
+			}
+			return false;
+		}
+
+		case classad::ExprTree::EXPR_ENVELOPE:
+			return ExprTreeDependsOnTime(SkipExprEnvelope(const_cast<classad::ExprTree*>(tree)));
+
+		default:
+			// unknown node, assume the worst.
+			return true;
+	}
+}
+
 
 #define IS_DOUBLE_TRUE(val) (bool)(int)((val)*100000)
 
@@ -657,137 +722,6 @@ bool IsAMatch( compat_classad::ClassAd *ad1, compat_classad::ClassAd *ad2 )
 	return result;
 }
 
-static classad::MatchClassAd *match_pool = NULL;
-static compat_classad::ClassAd *target_pool = NULL;
-static std::vector<compat_classad::ClassAd*> *matched_ads = NULL;
-
-bool ParallelIsAMatch(compat_classad::ClassAd *ad1, std::vector<compat_classad::ClassAd*> &candidates, std::vector<compat_classad::ClassAd*> &matches, int threads, bool halfMatch)
-{
-	int adCount = candidates.size();
-	static int cpu_count = 0;
-	int current_cpu_count = threads;
-	int iterations = 0;
-	size_t matched = 0;
-
-	if(cpu_count != current_cpu_count)
-	{
-		cpu_count = current_cpu_count;
-		if(match_pool)
-		{
-			delete[] match_pool;
-			match_pool = NULL;
-		}
-		if(target_pool)
-		{
-			delete[] target_pool;
-			target_pool = NULL;
-		}
-		if(matched_ads)
-		{
-			delete[] matched_ads;
-			matched_ads = NULL;
-		}
-	}
-
-	if(!match_pool)
-		match_pool = new classad::MatchClassAd[cpu_count];
-	if(!target_pool)
-		target_pool = new compat_classad::ClassAd[cpu_count];
-	if(!matched_ads)
-		matched_ads = new std::vector<compat_classad::ClassAd*>[cpu_count];
-
-	if(!candidates.size())
-		return false;
-
-	for(int index = 0; index < cpu_count; index++)
-	{
-		target_pool[index].CopyFrom(*ad1);
-		match_pool[index].ReplaceLeftAd(&(target_pool[index]));
-		matched_ads[index].clear();
-	}
-
-	iterations = ((candidates.size() - 1) / cpu_count) + 1;
-
-#ifdef _OPENMP
-	omp_set_num_threads(cpu_count);
-#endif
-
-#pragma omp parallel
-	{
-
-#ifdef _OPENMP
-		int omp_id = omp_get_thread_num();
-#else
-		int omp_id = 0;
-#endif
-		for(int index = 0; index < iterations; index++)
-		{
-			bool result = false;
-			int offset = omp_id + index * cpu_count;
-			if(offset >= adCount)
-				break;
-			compat_classad::ClassAd *ad2 = candidates[offset];
-
-/*
-			if(halfMatch)
-			{
-				char const *my_target_type = target_pool[omp_id].GetTargetTypeName();
-				char const *target_type = ad2->GetMyTypeName();
-				if( !my_target_type ) {
-					my_target_type = "";
-				}
-				if( !target_type ) {
-					target_type = "";
-				}
-				if( strcasecmp(target_type,my_target_type) &&
-					strcasecmp(my_target_type,ANY_ADTYPE) )
-				{
-					result = false;
-					continue;
-				}
-			}
-*/
-
-
-			match_pool[omp_id].ReplaceRightAd(ad2);
-			if ( !compat_classad::ClassAd::m_strictEvaluation )
-			{
-				target_pool[omp_id].alternateScope = ad2;
-				ad2->alternateScope = &(target_pool[omp_id]);
-			}
-		
-			if(halfMatch)
-				result = match_pool[omp_id].rightMatchesLeft();
-			else
-				result = match_pool[omp_id].symmetricMatch();
-
-			match_pool[omp_id].RemoveRightAd();
-
-			if(result)
-			{
-				matched_ads[omp_id].push_back(ad2);
-			}
-		}
-	}
-
-	for(int index = 0; index < cpu_count; index++)
-	{
-		match_pool[index].RemoveLeftAd();
-		matched += matched_ads[index].size();
-	}
-
-	if(matches.capacity() < matched)
-		matches.reserve(matched);
-
-	for(int index = 0; index < cpu_count; index++)
-	{
-		if(matched_ads[index].size())
-			matches.insert(matches.end(), matched_ads[index].begin(), matched_ads[index].end());
-	}
-
-	return matches.size() > 0;
-}
-
 bool IsAHalfMatch( compat_classad::ClassAd *my, compat_classad::ClassAd *target )
 {
 		// The collector relies on this function to check the target type.
@@ -50,6 +50,11 @@ typedef std::map<std::string, std::string, classad::CaseIgnLTStr> NOCASE_STRING_
 // if mapping["TARGET"] = "", it will remove target prefixes.
 int RewriteAttrRefs(classad::ExprTree * expr, const NOCASE_STRING_MAP & mapping);
 
+// returns true if the value of the expression can change without any attribute changing,
+// because it calls time(), random() or eval(), or refers to CurrentTime or ServerTime.
+// this does not look into the expressions of the attributes that expr refers to.
+bool ExprTreeDependsOnTime(const classad::ExprTree * expr);
+
 
 classad::ExprTree * SkipExprEnvelope(classad::ExprTree * tree);
 classad::ExprTree * SkipExprParens(classad::ExprTree * tree);
@@ -74,8 +79,6 @@ bool IsAMatch( compat_classad::ClassAd *ad1, compat_classad::ClassAd *ad2 );
 
 bool IsAHalfMatch( compat_classad::ClassAd *my, compat_classad::ClassAd *target );
 
-bool ParallelIsAMatch(compat_classad::ClassAd *ad1, std::vector<compat_classad::ClassAd*> &candidates, std::vector<compat_classad::ClassAd*> &matches, int threads, bool halfMatch = false);
-
 void AttrList_setPublishServerTime( bool publish );
 
 void AddClassAdXMLFileHeader(std::string &buffer);
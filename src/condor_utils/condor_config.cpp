@@ -89,6 +89,7 @@
 #include "filename_tools.h"
 #include "which.h"
 #include "classad_helpers.h"
+#include "classad_oldnew.h"
 #include <algorithm> // for std::sort
 #include "CondorError.h"
 
@@ -1183,6 +1184,7 @@ real_config(const char* host, int wantsQuiet, int config_options)
 	condor_auth_config( false );
 
 	ConfigConvertDefaultIPToSocketIP();
+	ConfigClassAdWireEncoding();
 
 	//Configure condor_fsync
 	condor_fsync_on = param_boolean("CONDOR_FSYNC", true);
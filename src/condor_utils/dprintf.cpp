@@ -218,6 +218,9 @@ static pthread_mutex_t _condor_dprintf_critsec =
 #else
 						PTHREAD_RECURSIVE_MUTEX_INITIALIZER;
 #endif
+/* set by dprintf_make_thread_safe() when threads outside of the
+ * condor_threads pool may call dprintf, never cleared. */
+static int DebugThreadSafe = 0;
 #endif
 #ifdef WIN32
 static CRITICAL_SECTION	*_condor_dprintf_critsec = NULL;
@@ -920,7 +923,7 @@ _condor_dprintf_va( int cat_and_flags, DPF_IDENT ident, const char* fmt, va_list
 	 * with mutiple threads.  But on Unix, lets bother w/ mutexes if and only
 	 * if we are running w/ threads.
 	 */
-	if ( CondorThreads_pool_size() ) {  /* will == 0 if no threads running */
+	if ( DebugThreadSafe || CondorThreads_pool_size() ) {  /* will == 0 if no threads running */
 		pthread_mutex_lock(&_condor_dprintf_critsec);
 	}
 #endif
@@ -1047,7 +1050,7 @@ _condor_dprintf_va( int cat_and_flags, DPF_IDENT ident, const char* fmt, va_list
 #ifdef WIN32
 	LeaveCriticalSection(_condor_dprintf_critsec);
 #elif defined(HAVE_PTHREADS)
-	if ( CondorThreads_pool_size() ) {  /* will == 0 if no threads running */
+	if ( DebugThreadSafe || CondorThreads_pool_size() ) {  /* will == 0 if no threads running */
 		pthread_mutex_unlock(&_condor_dprintf_critsec);
 	}
 #endif
@@ -1217,6 +1220,27 @@ debug_open_lock(void)
 	}
 }
 
+#if !defined(WIN32) && defined(HAVE_PTHREADS)
+static void dprintf_atfork_prepare(void) {
+	pthread_mutex_lock(&_condor_dprintf_critsec);
+}
+
+static void dprintf_atfork_release(void) {
+	pthread_mutex_unlock(&_condor_dprintf_critsec);
+}
+#endif
+
+void dprintf_make_thread_safe(void) {
+#if !defined(WIN32) && defined(HAVE_PTHREADS)
+	if ( ! DebugThreadSafe) {
+		// hold the mutex across fork() so that the child doesn't inherit
+		// it locked by a thread that does not exist in the child.
+		pthread_atfork(dprintf_atfork_prepare, dprintf_atfork_release, dprintf_atfork_release);
+		DebugThreadSafe = 1;
+	}
+#endif
+}
+
 void dprintf_reset_lock_delay(void) {
 	DebugLockDelay = 0;
 	DebugLockDelayPeriodStarted = 0;
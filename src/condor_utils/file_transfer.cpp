@@ -41,6 +41,7 @@
 #include "condor_holdcodes.h"
 #include "file_transfer_db.h"
 #include "mk_cache_links.h"
+#include "sandbox_cache.h"
 #include "subsystem_info.h"
 #include "condor_url.h"
 #include "my_popen.h"
@@ -52,6 +53,17 @@ const char * const StderrRemapName = "_condor_stderr";
 
 #define COMMIT_FILENAME ".ccommit.con"
 
+// Most connections one transfer may use; see FILE_TRANSFER_STREAMS.
+const int MAX_FILE_TRANSFER_STREAMS = 16;
+
+// Size of the pieces files are cut into when they are spread across
+// several data streams.
+const filesize_t DATA_STREAM_CHUNK_SIZE = 1024 * 1024;
+
+// How long the server waits for all of a transfer's data streams to
+// connect before giving up on the transfer.
+const int DATA_STREAM_CONNECT_TIMEOUT = 60;
+
 // Filenames are case insensitive on Win32, but case sensitive on Unix
 #ifdef WIN32
 #	define file_strcmp _stricmp
@@ -67,6 +79,7 @@ TranskeyHashTable* FileTransfer::TranskeyTable = NULL;
 TransThreadHashTable *FileTransfer::TransThreadTable = NULL;
 int FileTransfer::CommandsRegistered = FALSE;
 int FileTransfer::SequenceNum = 0;
+int FileTransfer::StreamSetNum = 0;
 int FileTransfer::ReaperId = -1;
 bool FileTransfer::ServerShouldBlock = true;
 
@@ -137,6 +150,8 @@ FileTransfer::FileTransfer()
 	PeerDoesGoAhead = false;
 	PeerUnderstandsMkdir = false;
 	PeerDoesXferInfo = false;
+	PeerDoesDataStreams = false;
+	PeerSandboxCacheMinSize = -1;
 	TransferUserLog = false;
 	Iwd = NULL;
 	ExceptionFiles = NULL;
@@ -190,6 +205,13 @@ FileTransfer::FileTransfer()
 	plugin_table = NULL;
 	MaxUploadBytes = -1;  // no limit by default
 	MaxDownloadBytes = -1;
+	m_next_data_stream = 0;
+	m_pending_sock = NULL;
+	m_pending_command = 0;
+	m_pending_stream_set = 0;
+	m_pending_tid = -1;
+	m_sandbox_cache = NULL;
+	m_sandbox_cache_min_size = -1;
 }
 
 FileTransfer::~FileTransfer()
@@ -235,6 +257,8 @@ FileTransfer::~FileTransfer()
 	}
 	if (TransSock) free(TransSock);
 	stopServer();
+	ReleaseDataStreams();
+	delete m_sandbox_cache;
 	// Do not delete the TransThreadTable. There may be other FileTransfer
 	// objects out there planning to use it.
 	//if( TransThreadTable && TransThreadTable->getNumElements() == 0 ) {
@@ -954,7 +978,8 @@ FileTransfer::DownloadFiles(bool blocking)
 		sock.encode();
 
 		if ( !sock.put_secret(TransKey) ||
-			!sock.end_of_message() ) {
+			!sock.end_of_message() ||
+			!OpenDataStreams(d, FILETRANS_UPLOAD, sock) ) {
 			Info.success = 0;
 			Info.in_progress = false;
 			formatstr( Info.error_desc, "FileTransfer: Unable to start transfer with server %s",
@@ -1321,7 +1346,8 @@ FileTransfer::UploadFiles(bool blocking, bool final_transfer)
 		sock.encode();
 
 		if ( !sock.put_secret(TransKey) ||
-			!sock.end_of_message() ) {
+			!sock.end_of_message() ||
+			!OpenDataStreams(d, FILETRANS_DOWNLOAD, sock) ) {
 			Info.success = 0;
 			Info.in_progress = false;
 			formatstr( Info.error_desc, "FileTransfer: Unable to start transfer with server %s",
@@ -1385,6 +1411,74 @@ FileTransfer::HandleCommands(Service *, int command, Stream *s)
 		return FALSE;
 	}
 
+	if ( transobject->PeerDoesDataStreams ) {
+			// Our peer tells us whether this is the start of a new
+			// transfer (stream_set 0), in which case it also says how
+			// many streams it would like to use and which files to
+			// offer from its sandbox cache, or one of the extra data
+			// streams of a transfer we already agreed on.
+		int stream_set = 0;
+		int stream_arg = 0;
+		filesize_t cache_min_size = -1;
+		if ( !sock->code(stream_set) ||
+			 !sock->code(stream_arg) ||
+			 !sock->code(cache_min_size) ||
+			 !sock->end_of_message() ) {
+			dprintf(D_FULLDEBUG,
+					"FileTransfer::HandleCommands failed to read stream request\n");
+			return 0;
+		}
+		if ( stream_set != 0 ) {
+			return transobject->AddDataStream(sock,stream_set,stream_arg);
+		}
+
+			// A new transfer replaces one that never got all its
+			// streams, e.g. because our peer gave up on them.
+		transobject->DiscardPendingStreams();
+		transobject->PeerSandboxCacheMinSize = cache_min_size;
+
+		int max_streams = param_integer("FILE_TRANSFER_STREAMS",1,1,MAX_FILE_TRANSFER_STREAMS);
+		int streams = MAX( 1, MIN( stream_arg, max_streams ) );
+		if ( transobject->ActiveTransferTid != -1 ) {
+			streams = 1;
+		}
+		if ( streams > 1 ) {
+			stream_set = ++StreamSetNum;
+		}
+		sock->encode();
+		if ( !sock->code(streams) ||
+			 !sock->code(stream_set) ||
+			 !sock->end_of_message() ) {
+			dprintf(D_FULLDEBUG,
+					"FileTransfer::HandleCommands failed to send stream reply\n");
+			return 0;
+		}
+
+		if ( streams > 1 ) {
+				// Hold on to this socket until the other streams
+				// have connected.
+			dprintf(D_FULLDEBUG,
+					"FileTransfer::HandleCommands waiting for %d data streams\n",
+					streams - 1);
+			transobject->m_pending_sock = sock;
+			transobject->m_pending_command = command;
+			transobject->m_pending_stream_set = stream_set;
+			transobject->m_data_streams.resize(streams - 1, NULL);
+			transobject->m_pending_tid = daemonCore->Register_Timer(
+				DATA_STREAM_CONNECT_TIMEOUT,
+				(TimerHandlercpp)&FileTransfer::PendingStreamsTimeout,
+				"FileTransfer::PendingStreamsTimeout",
+				transobject);
+			return KEEP_STREAM;
+		}
+	}
+
+	return transobject->HandleTransferCommand(command,sock);
+}
+
+int
+FileTransfer::HandleTransferCommand(int command, ReliSock *sock)
+{
 	switch (command) {
 		case FILETRANS_UPLOAD:
 			// We want to upload all files listed as InputFiles,
@@ -1393,32 +1487,32 @@ FileTransfer::HandleCommands(Service *, int command, Stream *s)
 			// previous commit which may have been prematurely aborted.
 			{
 			const char *currFile;
-			transobject->CommitFiles();
-			Directory spool_space( transobject->SpoolSpace, 
-								   transobject->getDesiredPrivState() );
+			CommitFiles();
+			Directory spool_space( SpoolSpace, 
+								   getDesiredPrivState() );
 			while ( (currFile=spool_space.Next()) ) {
-				if (transobject->UserLogFile && 
-						!file_strcmp(transobject->UserLogFile,currFile)) 
+				if (UserLogFile && 
+						!file_strcmp(UserLogFile,currFile)) 
 				{
 						// Don't send the userlog from the shadow to starter
 					continue;
 				} else {
 						// We aren't looking at the userlog file... ship it!
 					const char *filename = spool_space.GetFullPath();
-					if ( !transobject->InputFiles->file_contains(filename) &&
-						 !transobject->InputFiles->file_contains(condor_basename(filename)) ) {
-						transobject->InputFiles->append(filename);
+					if ( !InputFiles->file_contains(filename) &&
+						 !InputFiles->file_contains(condor_basename(filename)) ) {
+						InputFiles->append(filename);
 					}
 				}
 			}
-			transobject->FilesToSend = transobject->InputFiles;
-			transobject->EncryptFiles = transobject->EncryptInputFiles;
-			transobject->DontEncryptFiles = transobject->DontEncryptInputFiles;
-			transobject->Upload(sock,ServerShouldBlock);
+			FilesToSend = InputFiles;
+			EncryptFiles = EncryptInputFiles;
+			DontEncryptFiles = DontEncryptInputFiles;
+			Upload(sock,ServerShouldBlock);
 			}
 			break;
 		case FILETRANS_DOWNLOAD:
-			transobject->Download(sock,ServerShouldBlock);
+			Download(sock,ServerShouldBlock);
 			break;
 		default:
 			dprintf(D_ALWAYS,
@@ -1433,6 +1527,188 @@ FileTransfer::HandleCommands(Service *, int command, Stream *s)
 }
 
 
+// Asks the server for data streams and tells us how many we get.
+// Also tells the server which files to offer from our sandbox cache.
+static bool
+RequestDataStreams(ReliSock &sock, int streams_wanted, filesize_t cache_min_size, int &streams, int &stream_set)
+{
+	stream_set = 0;
+	sock.encode();
+	if( !sock.code(stream_set) ||
+		!sock.code(streams_wanted) ||
+		!sock.code(cache_min_size) ||
+		!sock.end_of_message() )
+	{
+		return false;
+	}
+	sock.decode();
+	if( !sock.code(streams) ||
+		!sock.code(stream_set) ||
+		!sock.end_of_message() )
+	{
+		return false;
+	}
+	return true;
+}
+
+bool
+FileTransfer::OpenDataStreams(Daemon &d, int command, ReliSock &sock)
+{
+	ReleaseDataStreams();
+
+	if( !PeerDoesDataStreams ) {
+		return true;
+	}
+
+	int streams_wanted = param_integer("FILE_TRANSFER_STREAMS",1,1,MAX_FILE_TRANSFER_STREAMS);
+	int streams = 1;
+	int stream_set = 0;
+	filesize_t cache_min_size = -1;
+	if( command == FILETRANS_UPLOAD && m_sandbox_cache ) {
+		cache_min_size = m_sandbox_cache_min_size;
+	}
+	if( !RequestDataStreams(sock,streams_wanted,cache_min_size,streams,stream_set) ) {
+		dprintf(D_ALWAYS,"FileTransfer: failed to ask %s for data streams\n",
+				TransSock);
+		return false;
+	}
+	if( streams <= 1 ) {
+		return true;
+	}
+
+	dprintf(D_FULLDEBUG,"FileTransfer: opening %d data streams to %s\n",
+			streams - 1, TransSock);
+
+	for( int i = 1; i < streams; i++ ) {
+		ReliSock *data_sock = new ReliSock;
+		m_data_streams.push_back(data_sock);
+		data_sock->timeout(clientSockTimeout);
+
+		CondorError err_stack;
+		if( d.connectSock(data_sock,0) &&
+			d.startCommand(command, data_sock, clientSockTimeout, &err_stack, NULL, false, m_sec_session_id) )
+		{
+			data_sock->encode();
+			if( data_sock->put_secret(TransKey) &&
+				data_sock->code(stream_set) &&
+				data_sock->code(i) &&
+				data_sock->code(cache_min_size) &&
+				data_sock->end_of_message() )
+			{
+				continue;
+			}
+		}
+
+			// The server won't start until all of the streams are
+			// there, so start over on a new connection and ask for
+			// just the one this time.
+		dprintf(D_ALWAYS,"FileTransfer: failed to open data stream %d of %d to %s, "
+				"using a single stream instead: %s\n",
+				i, streams - 1, TransSock, err_stack.getFullText().c_str());
+		ReleaseDataStreams();
+		sock.close();
+
+		if( !d.connectSock(&sock,0) ||
+			!d.startCommand(command, &sock, clientSockTimeout, &err_stack, NULL, false, m_sec_session_id) )
+		{
+			return false;
+		}
+		sock.encode();
+		if( !sock.put_secret(TransKey) ||
+			!sock.end_of_message() ||
+			!RequestDataStreams(sock,1,cache_min_size,streams,stream_set) )
+		{
+			return false;
+		}
+		return true;
+	}
+
+	return true;
+}
+
+int
+FileTransfer::AddDataStream(ReliSock *sock, int stream_set, int stream_index)
+{
+	if( !m_pending_sock ||
+		stream_set != m_pending_stream_set ||
+		stream_index < 1 ||
+		stream_index > (int)m_data_streams.size() ||
+		m_data_streams[stream_index-1] )
+	{
+		dprintf(D_ALWAYS,"FileTransfer: ignoring unexpected data stream %d "
+				"of stream set %d from %s\n",
+				stream_index, stream_set, sock->peer_description());
+		return 0;
+	}
+
+	m_data_streams[stream_index-1] = sock;
+	for( size_t i = 0; i < m_data_streams.size(); i++ ) {
+		if( !m_data_streams[i] ) {
+			return KEEP_STREAM;
+		}
+	}
+
+	dprintf(D_FULLDEBUG,"FileTransfer: all %d data streams have connected\n",
+			(int)m_data_streams.size());
+
+	if( m_pending_tid != -1 ) {
+		daemonCore->Cancel_Timer(m_pending_tid);
+		m_pending_tid = -1;
+	}
+	ReliSock *pending_sock = m_pending_sock;
+	m_pending_sock = NULL;
+
+	HandleTransferCommand(m_pending_command,pending_sock);
+	delete pending_sock;
+
+		// we own the data streams now, including this one
+	return KEEP_STREAM;
+}
+
+void
+FileTransfer::PendingStreamsTimeout()
+{
+	m_pending_tid = -1;
+	if( m_pending_sock ) {
+		dprintf(D_ALWAYS,"FileTransfer: gave up waiting for the data streams "
+				"of the transfer from %s\n",
+				m_pending_sock->peer_description());
+	}
+	DiscardPendingStreams();
+}
+
+void
+FileTransfer::DiscardPendingStreams()
+{
+	if( m_pending_tid != -1 ) {
+		if( daemonCore ) {
+			daemonCore->Cancel_Timer(m_pending_tid);
+		}
+		m_pending_tid = -1;
+	}
+	if( m_pending_sock ) {
+		delete m_pending_sock;
+		m_pending_sock = NULL;
+		ReleaseDataStreams();
+	}
+}
+
+void
+FileTransfer::ReleaseDataStreams()
+{
+	for( size_t i = 0; i < m_data_streams.size(); i++ ) {
+		delete m_data_streams[i];
+	}
+	m_data_streams.clear();
+}
+
+ReliSock *
+FileTransfer::NextDataStream(ReliSock *s)
+{
+	size_t n = m_next_data_stream++ % (m_data_streams.size() + 1);
+	return n == 0 ? s : m_data_streams[n-1];
+}
+
 bool
 FileTransfer::SetServerShouldBlock( bool block )
 {
@@ -1451,6 +1727,7 @@ FileTransfer::Reaper(Service *, int pid, int exit_status)
 	}
 	transobject->ActiveTransferTid = -1;
 	TransThreadTable->remove(pid);
+	transobject->ReleaseDataStreams();
 
 	transobject->Info.duration = time(NULL)-transobject->TransferStart;
 	transobject->Info.in_progress = false;
@@ -1719,6 +1996,7 @@ FileTransfer::Download(ReliSock *s, bool blocking)
 	if (blocking) {
 
 		int status = DoDownload( &Info.bytes, (ReliSock *) s );
+		ReleaseDataStreams();
 		Info.duration = time(NULL)-TransferStart;
 		Info.success = ( status >= 0 );
 		Info.in_progress = false;
@@ -1765,6 +2043,10 @@ FileTransfer::Download(ReliSock *s, bool blocking)
 				ActiveTransferTid);
 		// daemonCore will free(info) when the thread exits
 		TransThreadTable->insert(ActiveTransferTid, this);
+#ifndef WIN32
+		// the transfer process has its own copies of the data streams
+		ReleaseDataStreams();
+#endif
 
 		downloadStartTime = _condor_debug_get_time_double();
 
@@ -1848,6 +2130,7 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 	*total_bytes = 0;
 
 	downloadStartTime = _condor_debug_get_time_double();
+	m_next_data_stream = 0;
 
 
 	// we want to tell get_file() to perform an fsync (i.e. flush to disk)
@@ -2102,8 +2385,26 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 //		dprintf(D_FULLDEBUG,"TODD filetransfer DoDownload fullname=%s\n",fullname.Value());
 		start = time(NULL);
 
+		bool cache_hit = false;
+		std::string cache_checksum;
+		bool cache_executable = false;
+		if( reply == 9 ) {
+				// don't bother with the cache for a file we are only
+				// reading to get past it
+			bool want_file = m_sandbox_cache && download_success &&
+				strcmp(fullname.Value(),NULL_FILE) != 0;
+			if( !ReceiveCachedFileOffer(s,fullname.Value(),want_file,reply,cache_checksum,cache_executable,cache_hit) ) {
+				dprintf(D_FULLDEBUG,"DoDownload: exiting at %d\n",__LINE__);
+				return_and_resetpriv( -1 );
+			}
+			if( !want_file ) {
+				cache_checksum.clear();
+			}
+		}
 
-		if (reply == 999) {
+		if( cache_hit ) {
+			rc = 0;
+		} else if (reply == 999) {
 			// filename already received:
 			// .  verify that it is the same as FileName attribute in following classad
 			// .  optimization: could be the version protocol instead
@@ -2284,6 +2585,8 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 						error_buf.Value());
 				}
 			}
+		} else if( reply == 8 ) {
+			rc = GetFileFromDataStreams( s, fullname.Value(), socket_default_crypto, this_file_max_bytes, &bytes, &xfer_queue );
 		} else if ( TransferFilePermissions ) {
 			rc = s->get_file_with_permissions( &bytes, fullname.Value(), false, this_file_max_bytes, &xfer_queue );
 		} else {
@@ -2354,7 +2657,7 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 			}
 		}
 
-		if ( ExecFile && !file_strcmp( condor_basename( ExecFile ), filename.Value() ) ) {
+		if ( !cache_hit && ExecFile && !file_strcmp( condor_basename( ExecFile ), filename.Value() ) ) {
 				// We're receiving the executable, make sure execute
 				// bit is set
 				// TODO How should we modify the permisions of the
@@ -2381,7 +2684,7 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 #endif
 		}
 
-		if ( want_fsync ) {
+		if ( want_fsync && !cache_hit ) {
 			struct utimbuf timewrap;
 
 			time_t current_time = time(NULL);
@@ -2391,7 +2694,11 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 			utime(fullname.Value(),&timewrap);
 		}
 
-		if( !s->end_of_message() ) {
+		if( !cache_checksum.empty() && rc == 0 && download_success ) {
+			m_sandbox_cache->Insert(cache_checksum.c_str(), cache_executable, fullname.Value());
+		}
+
+		if( reply != 8 && !cache_hit && !s->end_of_message() ) {
 			return_and_resetpriv( -1 );
 		}
 		*total_bytes += bytes;
@@ -2425,6 +2732,10 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 	// go back to the state we were in before file transfer
 	s->set_crypto_mode(socket_default_crypto);
 
+	if( m_sandbox_cache ) {
+		m_sandbox_cache->WriteStats();
+	}
+
 #ifdef WIN32
 		// unsigned __int64 to float is not implemented on Win32
 	bytesRcvd += (float)(signed __int64)(*total_bytes);
@@ -2732,6 +3043,7 @@ FileTransfer::Upload(ReliSock *s, bool blocking)
 
 	if (blocking) {
 		int status = DoUpload( &Info.bytes, (ReliSock *)s);
+		ReleaseDataStreams();
 		Info.duration = time(NULL)-TransferStart;
 		Info.success = (Info.bytes >= 0) && (status == 0);
 		Info.in_progress = false;
@@ -2777,6 +3089,10 @@ FileTransfer::Upload(ReliSock *s, bool blocking)
 				ActiveTransferTid);
 		// daemonCore will free(info) when the thread exits
 		TransThreadTable->insert(ActiveTransferTid, this);
+#ifndef WIN32
+		// the transfer process has its own copies of the data streams
+		ReleaseDataStreams();
+#endif
 
 		uploadStartTime = time(NULL);
 	}
@@ -2880,6 +3196,172 @@ FileTransfer::UploadThread(void *arg, Stream *s)
 
 
 
+int
+FileTransfer::GetFileFromDataStreams(ReliSock *s, char const *fullname, bool socket_default_crypto, filesize_t max_bytes, filesize_t *bytes, DCTransferQueue *xfer_q)
+{
+	int file_crypto = 1;
+	filesize_t file_size = 0;
+	filesize_t chunk_size = 0;
+	condor_mode_t file_mode = NULL_FILE_PERMISSIONS;
+
+	*bytes = 0;
+
+	s->decode();
+	if( !s->code(file_crypto) ||
+		!s->code(file_size) ||
+		!s->code(chunk_size) ||
+		!s->code(file_mode) ||
+		!s->end_of_message() )
+	{
+		dprintf(D_ALWAYS,"DoDownload: failed to receive header for %s\n",fullname);
+		return -1;
+	}
+	if( chunk_size <= 0 || file_size < 0 ) {
+		dprintf(D_ALWAYS,"DoDownload: bad header for %s: size " FILESIZE_T_FORMAT
+				", piece size " FILESIZE_T_FORMAT "\n",
+				fullname, file_size, chunk_size);
+		return -1;
+	}
+
+	bool crypto = socket_default_crypto;
+	if( file_crypto == 2 ) {
+		crypto = true;
+	}
+	else if( file_crypto == 3 ) {
+		crypto = false;
+	}
+
+	int result = 0;
+	int saved_errno = 0;
+	bool created = true;
+	int fd = safe_open_wrapper_follow(fullname, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE | _O_BINARY | _O_SEQUENTIAL, 0600);
+	if( fd < 0 ) {
+		saved_errno = errno;
+		created = false;
+		result = GET_FILE_OPEN_FAILED;
+		dprintf(D_ALWAYS,"DoDownload: failed to create %s: (errno %d) %s\n",
+				fullname, saved_errno, strerror(saved_errno));
+
+			// read and throw away the data, as get_file() does
+		fd = safe_open_wrapper_follow(NULL_FILE, O_WRONLY | _O_BINARY, 0);
+		if( fd < 0 ) {
+			return -1;
+		}
+	}
+
+	filesize_t offset = 0;
+	while( offset < file_size ) {
+		ReliSock *stream = NextDataStream(s);
+		filesize_t this_chunk = MIN(chunk_size, file_size - offset);
+		filesize_t this_max = -1;
+		if( max_bytes >= 0 ) {
+			this_max = max_bytes > offset ? max_bytes - offset : 0;
+		}
+		filesize_t received = 0;
+
+		stream->decode();
+		if( !stream->set_crypto_mode(crypto) ) {
+			dprintf(D_ALWAYS,"DoDownload: failed to set crypto mode on data stream\n");
+			result = -1;
+			break;
+		}
+		int rc = stream->get_file(&received, fd, false, false, this_max, xfer_q);
+		if( rc == GET_FILE_WRITE_FAILED ) {
+				// get_file() has read the rest of this piece; throw
+				// away the rest of the file too
+			if( result == 0 ) {
+				saved_errno = errno;
+				result = GET_FILE_WRITE_FAILED;
+			}
+			close(fd);
+			fd = safe_open_wrapper_follow(NULL_FILE, O_WRONLY | _O_BINARY, 0);
+			if( fd < 0 ) {
+				result = -1;
+				break;
+			}
+			received = this_chunk;
+		}
+		else if( rc < 0 ) {
+			result = rc;
+			break;
+		}
+		if( !stream->end_of_message() || received != this_chunk ) {
+			dprintf(D_ALWAYS,"DoDownload: failed to receive %s on data stream from %s\n",
+					fullname, stream->peer_description());
+			result = -1;
+			break;
+		}
+		offset += received;
+	}
+
+#ifndef WIN32
+	if( result == 0 && file_mode != NULL_FILE_PERMISSIONS ) {
+		if( fchmod(fd, (mode_t)file_mode) < 0 ) {
+			saved_errno = errno;
+			result = GET_FILE_WRITE_FAILED;
+		}
+	}
+#endif
+
+	if( fd >= 0 && close(fd) < 0 && result == 0 ) {
+		saved_errno = errno;
+		result = GET_FILE_WRITE_FAILED;
+	}
+
+	if( result < 0 && created ) {
+		unlink(fullname);
+	}
+	*bytes = offset;
+	if( result == GET_FILE_OPEN_FAILED || result == GET_FILE_WRITE_FAILED ) {
+		errno = saved_errno;
+	}
+	return result;
+}
+
+bool
+FileTransfer::ReceiveCachedFileOffer(ReliSock *s, char const *fullname, bool want_file, int &file_command, std::string &checksum, bool &executable, bool &hit)
+{
+	int exec_flag = 0;
+	filesize_t file_size = 0;
+
+	hit = false;
+	s->decode();
+	if( !s->code(file_command) ||
+		!s->code(checksum) ||
+		!s->code(exec_flag) ||
+		!s->code(file_size) ||
+		!s->end_of_message() )
+	{
+		dprintf(D_ALWAYS,"DoDownload: failed to receive cache offer for %s\n",fullname);
+		return false;
+	}
+	if( file_command != 1 && file_command != 3 && file_command != 8 ) {
+		dprintf(D_ALWAYS,"DoDownload: cache offer for %s has unexpected file command %d\n",
+				fullname, file_command);
+		return false;
+	}
+
+	executable = exec_flag != 0 ||
+		(ExecFile && !file_strcmp(condor_basename(ExecFile),condor_basename(fullname)));
+
+	if( want_file && !checksum.empty() ) {
+		hit = m_sandbox_cache->Fetch(checksum.c_str(), executable, file_size, fullname);
+	}
+
+	int reply = hit ? 1 : 0;
+	s->encode();
+	if( !s->code(reply) || !s->end_of_message() ) {
+		dprintf(D_ALWAYS,"DoDownload: failed to answer cache offer for %s\n",fullname);
+		return false;
+	}
+	s->decode();
+
+	if( !hit && file_command == 3 ) {
+		s->set_crypto_mode(false);
+	}
+	return true;
+}
+
 int
 FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 {
@@ -2924,6 +3406,7 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 	uploadStartTime = _condor_debug_get_time_double();
 
 	*total_bytes = 0;
+	m_next_data_stream = 0;
 	dprintf(D_FULLDEBUG,"entering FileTransfer::DoUpload\n");
 
 	priv_state saved_priv = PRIV_UNKNOWN;
@@ -3080,6 +3563,15 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 		//
 		// 999 subcommand 7:
 		// send information about a transfer performed using a transfer hook
+		//
+		// and, when we have extra data streams to our peer:
+		// 8 - send a file in pieces spread across all of the streams.
+		//     the 1 or 3 it would otherwise have been sent with
+		//     follows, to say whether to encrypt it.
+		//
+		// and, when our peer has a sandbox cache:
+		// 9 - offer a file by its checksum.  the 1, 3 or 8 it will be
+		//     sent with if our peer doesn't have it follows.
 
 
 		// default to the socket default
@@ -3141,10 +3633,31 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 			}
 		}
 
+			// files we were asked to encrypt stay on the main stream,
+			// so that their names go out encrypted as before
+		int file_crypto = file_command;
+		if( !m_data_streams.empty() && !filelist_it->is_directory &&
+			(file_command == 1 || file_command == 3) )
+		{
+			file_command = 8;
+		}
+
+			// files big enough to be worth it are first offered from
+			// our peer's sandbox cache, and only sent if it misses
+		bool offer_cached = false;
+		if( PeerSandboxCacheMinSize >= 0 && !filelist_it->is_directory &&
+			(file_command == 1 || file_command == 3 || file_command == 8) )
+		{
+			StatInfo this_file_stat(fullname.Value());
+			offer_cached = !this_file_stat.Error() &&
+				this_file_stat.GetFileSize() >= PeerSandboxCacheMinSize;
+		}
+		int wire_command = offer_cached ? 9 : file_command;
+
 		dprintf ( D_FULLDEBUG, "FILETRANSFER: outgoing file_command is %i for %s\n",
-				file_command, filename );
+				wire_command, filename );
 
-		if( !s->snd_int(file_command,FALSE) ) {
+		if( !s->snd_int(wire_command,FALSE) ) {
 			dprintf(D_FULLDEBUG,"DoUpload: exiting at %d\n",__LINE__);
 			return_and_resetpriv( -1 );
 		}
@@ -3154,9 +3667,9 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 		}
 
 		// now enable the crypto decision we made:
-		if (file_command == 2) {
+		if (wire_command == 2) {
 			s->set_crypto_mode(true);
-		} else if (file_command == 3) {
+		} else if (wire_command == 3) {
 			s->set_crypto_mode(false);
 		}
 		else {
@@ -3232,7 +3745,19 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 			this_file_max_bytes = 0;
 		}
 
-		if ( file_command == 999) {
+		bool cache_hit = false;
+		if( offer_cached ) {
+			if( !OfferCachedFile(s, file_command, fullname.Value(), cache_hit) ) {
+				dprintf(D_FULLDEBUG,"DoUpload: exiting at %d\n",__LINE__);
+				return_and_resetpriv( -1 );
+			}
+		}
+
+		if( cache_hit ) {
+				// nothing was sent, so nothing counts toward the bytes sent
+			bytes = 0;
+			rc = 0;
+		} else if ( file_command == 999) {
 			// new-style, send classad
 
 			ClassAd file_info;
@@ -3335,6 +3860,8 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 			else {
 				rc = 0;
 			}
+		} else if( file_command == 8 ) {
+			rc = PutFileOnDataStreams( s, fullname.Value(), file_crypto, socket_default_crypto, this_file_max_bytes, &bytes, &xfer_queue );
 		} else if( fail_because_mkdir_not_supported || fail_because_symlink_not_supported ) {
 			if( TransferFilePermissions ) {
 				rc = s->put_file_with_permissions( &bytes, NULL_FILE );
@@ -3431,7 +3958,9 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 			}
 		}
 
-		if( !s->end_of_message() ) {
+			// a file sent over the data streams, or found in our
+			// peer's cache, has already ended all of its messages
+		if( file_command != 8 && !cache_hit && !s->end_of_message() ) {
 			dprintf(D_FULLDEBUG,"DoUpload: exiting at %d\n",__LINE__);
 			return_and_resetpriv( -1 );
 		}
@@ -3477,11 +4006,184 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 	                    try_again,hold_code,hold_subcode,NULL,__LINE__);
 }
 
+int
+FileTransfer::PutFileOnDataStreams(ReliSock *s, char const *fullname, int file_crypto, bool socket_default_crypto, filesize_t max_bytes, filesize_t *bytes, DCTransferQueue *xfer_q)
+{
+	int result = 0;
+	int open_errno = 0;
+	filesize_t file_size = 0;
+	filesize_t chunk_size = DATA_STREAM_CHUNK_SIZE;
+	condor_mode_t file_mode = NULL_FILE_PERMISSIONS;
+
+	*bytes = 0;
+
+	int fd = safe_open_wrapper_follow(fullname, O_RDONLY | O_LARGEFILE | _O_BINARY | _O_SEQUENTIAL, 0);
+	if( fd < 0 ) {
+		open_errno = errno;
+		result = PUT_FILE_OPEN_FAILED;
+	}
+	else {
+		StatInfo file_stat(fd);
+		if( file_stat.Error() ) {
+			open_errno = file_stat.Errno();
+			result = PUT_FILE_OPEN_FAILED;
+			close(fd);
+			fd = -1;
+		}
+		else {
+			file_size = file_stat.GetFileSize();
+#ifndef WIN32
+			if( TransferFilePermissions ) {
+				file_mode = (condor_mode_t)file_stat.GetMode();
+			}
+#endif
+		}
+	}
+	if( result == PUT_FILE_OPEN_FAILED ) {
+		dprintf(D_ALWAYS,"DoUpload: failed to open %s: (errno %d) %s\n",
+				fullname, open_errno, strerror(open_errno));
+	}
+	else if( max_bytes >= 0 && file_size > max_bytes ) {
+		file_size = max_bytes;
+		result = PUT_FILE_MAX_BYTES_EXCEEDED;
+	}
+
+		// As with put_file(), a file we can't read goes out empty,
+		// and our peer hears about the failure in the final ack.
+	s->encode();
+	if( !s->code(file_crypto) ||
+		!s->code(file_size) ||
+		!s->code(chunk_size) ||
+		!s->code(file_mode) ||
+		!s->end_of_message() )
+	{
+		dprintf(D_ALWAYS,"DoUpload: failed to send header for %s\n",fullname);
+		if( fd >= 0 ) {
+			close(fd);
+		}
+		return -1;
+	}
+
+	bool crypto = socket_default_crypto;
+	if( file_crypto == 2 ) {
+		crypto = true;
+	}
+	else if( file_crypto == 3 ) {
+		crypto = false;
+	}
+
+	filesize_t offset = 0;
+	while( offset < file_size ) {
+		ReliSock *stream = NextDataStream(s);
+		filesize_t this_chunk = MIN(chunk_size, file_size - offset);
+		filesize_t sent = 0;
+
+		stream->encode();
+		if( !stream->set_crypto_mode(crypto) ) {
+			dprintf(D_ALWAYS,"DoUpload: failed to set crypto mode on data stream\n");
+			close(fd);
+			return -1;
+		}
+		int rc = stream->put_file(&sent, fd, offset, this_chunk, xfer_q);
+		if( rc == PUT_FILE_MAX_BYTES_EXCEEDED ) {
+			rc = 0;
+		}
+		else if( rc == 0 ) {
+				// the file ended before the piece did
+			sent -= offset;
+		}
+		if( rc < 0 || !stream->end_of_message() ) {
+			dprintf(D_ALWAYS,"DoUpload: failed to send %s on data stream to %s\n",
+					fullname, stream->peer_description());
+			close(fd);
+			return -1;
+		}
+		if( sent != this_chunk ) {
+			dprintf(D_ALWAYS,"DoUpload: %s changed size while it was being sent\n",
+					fullname);
+			close(fd);
+			return -1;
+		}
+		offset += sent;
+	}
+
+	if( fd >= 0 ) {
+		close(fd);
+	}
+	*bytes = file_size;
+	if( result == PUT_FILE_OPEN_FAILED ) {
+		errno = open_errno;
+	}
+	return result;
+}
+
+bool
+FileTransfer::OfferCachedFile(ReliSock *s, int file_command, char const *fullname, bool &hit)
+{
+		// a file we can't read goes out with no checksum, which our
+		// peer won't find, so the usual error handling takes over
+	std::string checksum;
+	int executable = 0;
+	filesize_t file_size = 0;
+	StatInfo file_stat(fullname);
+	if( !file_stat.Error() ) {
+		file_size = file_stat.GetFileSize();
+		executable = file_stat.IsExecutable() ? 1 : 0;
+		SandboxCache::ComputeChecksum(fullname,checksum);
+	}
+
+	hit = false;
+	s->encode();
+	if( !s->code(file_command) ||
+		!s->code(checksum) ||
+		!s->code(executable) ||
+		!s->code(file_size) ||
+		!s->end_of_message() )
+	{
+		dprintf(D_ALWAYS,"DoUpload: failed to send cache offer for %s\n",fullname);
+		return false;
+	}
+
+	int reply = 0;
+	s->decode();
+	if( !s->code(reply) || !s->end_of_message() ) {
+		dprintf(D_ALWAYS,"DoUpload: failed to receive answer to cache offer for %s\n",fullname);
+		return false;
+	}
+	s->encode();
+
+	hit = reply != 0;
+	if( hit ) {
+		dprintf(D_FULLDEBUG,"DoUpload: %s was in our peer's sandbox cache\n",fullname);
+	}
+	else if( file_command == 3 ) {
+		s->set_crypto_mode(false);
+	}
+	return true;
+}
+
 void
 FileTransfer::setTransferQueueContactInfo(char const *contact) {
 	m_xfer_queue_contact_info = TransferQueueContactInfo(contact);
 }
 
+void
+FileTransfer::setSandboxCache(char const *dir, filesize_t min_file_size)
+{
+	delete m_sandbox_cache;
+	m_sandbox_cache = NULL;
+
+		// files are only shared between the jobs of one user
+	std::string user;
+	if( !jobAd.LookupString(ATTR_USER,user) ) {
+		dprintf(D_ALWAYS,"FileTransfer: job has no %s, so not using the sandbox cache\n",
+				ATTR_USER);
+		return;
+	}
+	m_sandbox_cache = new SandboxCache(dir,user.c_str());
+	m_sandbox_cache_min_size = min_file_size;
+}
+
 bool
 FileTransfer::ObtainAndSendTransferGoAhead(DCTransferQueue &xfer_queue,bool downloading,Stream *s,filesize_t sandbox_size,char const *full_fname,bool &go_ahead_always)
 {
@@ -3925,6 +4627,7 @@ void
 FileTransfer::stopServer()
 {
 	abortActiveTransfer();
+	DiscardPendingStreams();
 	if (TransKey) {
 		// remove our key from the hash table
 		if ( TranskeyTable ) {
@@ -4102,6 +4805,16 @@ FileTransfer::setPeerVersion( const CondorVersionInfo &peer_version )
 	else {
 		PeerDoesXferInfo = false;
 	}
+
+		// 8.7.5 is the first release with FILE_TRANSFER_STREAMS, so the
+		// extra connections (and the sandbox cache offer sent with them)
+		// are used only when both ends are 8.7.5 or later.
+	if( peer_version.built_since_version(8,7,5) ) {
+		PeerDoesDataStreams = true;
+	}
+	else {
+		PeerDoesDataStreams = false;
+	}
 }
 
 
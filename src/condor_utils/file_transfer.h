@@ -32,6 +32,7 @@
 #include "condor_classad.h"
 #include "dc_transfer_queue.h"
 #include <list>
+#include <vector>
 
 
 extern const char * const StdoutRemapName;
@@ -39,6 +40,8 @@ extern const char * const StderrRemapName;
 
 class FileTransfer;	// forward declatation
 class FileTransferItem;
+class Daemon;
+class SandboxCache;
 typedef std::list<FileTransferItem> FileTransferList;
 
 
@@ -284,6 +287,13 @@ class FileTransfer: public Service {
 
 	void setTransferQueueContactInfo(char const *contact);
 
+		/** Use the execute node's cache of input files when
+			downloading (see SANDBOX_CACHE_DIR).  Our peer offers
+			files of at least min_file_size bytes from the cache
+			before sending them.
+		*/
+	void setSandboxCache(char const *dir, filesize_t min_file_size);
+
 	void InsertPluginMappings(MyString methods, MyString p);
 	MyString DeterminePluginMethods( CondorError &e, const char* path );
 	int InitializePlugins(CondorError &e);
@@ -335,6 +345,7 @@ class FileTransfer: public Service {
 
 	int Download(ReliSock *s, bool blocking);
 	int Upload(ReliSock *s, bool blocking);
+	int HandleTransferCommand(int command, ReliSock *sock);
 	static int DownloadThread(void *arg, Stream *s);
 	static int UploadThread(void *arg, Stream *s);
 	int TransferPipeHandler(int p);
@@ -366,6 +377,10 @@ class FileTransfer: public Service {
 	bool PeerDoesGoAhead;
 	bool PeerUnderstandsMkdir;
 	bool PeerDoesXferInfo;
+	bool PeerDoesDataStreams;
+	// smallest file our peer wants offered from its sandbox cache,
+	// or -1 if it has none
+	filesize_t PeerSandboxCacheMinSize;
 	bool TransferUserLog;
 	char* Iwd;
 	StringList* ExceptionFiles;
@@ -414,6 +429,7 @@ class FileTransfer: public Service {
 	static TransThreadHashTable* TransThreadTable;
 	static int CommandsRegistered;
 	static int SequenceNum;
+	static int StreamSetNum;
 	static int ReaperId;
 	static bool ServerShouldBlock;
 	int clientSockTimeout;
@@ -431,6 +447,47 @@ class FileTransfer: public Service {
 	// stores the path to the proxy after one is received
 	MyString LocalProxyName;
 
+	// Extra connections to our peer that file data is spread across,
+	// in addition to the socket the transfer was started on.  See
+	// FILE_TRANSFER_STREAMS.
+	std::vector<ReliSock *> m_data_streams;
+	size_t m_next_data_stream;
+
+	// On the server, the socket of a transfer that is waiting for
+	// the rest of its data streams to connect.
+	ReliSock *m_pending_sock;
+	int m_pending_command;
+	int m_pending_stream_set;
+	int m_pending_tid;
+
+	SandboxCache *m_sandbox_cache;
+	filesize_t m_sandbox_cache_min_size;
+
+	// Called by the client to ask the server for data streams and
+	// connect them.  Returns false if sock is no longer usable.
+	bool OpenDataStreams(Daemon &d, int command, ReliSock &sock);
+
+	// Called by the server for each data stream that connects.
+	int AddDataStream(ReliSock *sock, int stream_set, int stream_index);
+
+	void PendingStreamsTimeout();
+	void DiscardPendingStreams();
+	void ReleaseDataStreams();
+
+	// The stream the next piece of file data goes over.
+	ReliSock *NextDataStream(ReliSock *s);
+
+	// Send or receive one file spread across the data streams.
+	// Return codes are as for put_file() and get_file().
+	int PutFileOnDataStreams(ReliSock *s, char const *fullname, int file_crypto, bool socket_default_crypto, filesize_t max_bytes, filesize_t *bytes, DCTransferQueue *xfer_q);
+	int GetFileFromDataStreams(ReliSock *s, char const *fullname, bool socket_default_crypto, filesize_t max_bytes, filesize_t *bytes, DCTransferQueue *xfer_q);
+
+	// Before sending a file, ask whether our peer already has it in its
+	// sandbox cache; and the other side of that.  Return false if the
+	// connection fails.
+	bool OfferCachedFile(ReliSock *s, int file_command, char const *fullname, bool &hit);
+	bool ReceiveCachedFileOffer(ReliSock *s, char const *fullname, bool want_file, int &file_command, std::string &checksum, bool &executable, bool &hit);
+
 	// called to construct the catalog of files in a direcotry
 	bool BuildFileCatalog(time_t spool_time = 0, const char* iwd = NULL, FileCatalogHashTable **catalog = NULL);
 
@@ -0,0 +1,753 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "condor_fsync.h"
+#include "condor_blkng_full_disk_io.h"
+#include "stl_string_utils.h"
+#include "compat_classad_util.h"
+#include "classad_wire.h"
+#include "history_archive.h"
+
+#include <algorithm>
+
+#define ARCHIVE_MAGIC        "CHISTCOL"
+#define ARCHIVE_END_MAGIC    "CHISTEND"
+#define ARCHIVE_VERSION      1
+#define ARCHIVE_HEADER_SIZE  16
+#define ARCHIVE_INDEX_ENTRY  20
+#define ARCHIVE_TRAILER_SIZE 20
+
+// ads per block.  smaller blocks can be skipped more often, but repeat the
+// names of the attributes and the dictionaries more often.
+#define HISTORY_ARCHIVE_BLOCK_ADS 1000
+
+// column encodings
+enum {
+	COLUMN_INT = 1,    // integer literals, as differences
+	COLUMN_DICT = 2,   // string literals, as numbers in the dictionary
+	COLUMN_EXPR = 3,   // anything else, in the binary encoding
+	COLUMN_SPARSE = 0x10,  // the data starts with a bit per ad
+};
+
+static void put_u32(std::string & buf, unsigned int val)
+{
+	for (int ii = 0; ii < 4; ++ii) { buf += (char)((val >> (8*ii)) & 0xFF); }
+}
+
+static void put_u64(std::string & buf, unsigned long long val)
+{
+	for (int ii = 0; ii < 8; ++ii) { buf += (char)((val >> (8*ii)) & 0xFF); }
+}
+
+static unsigned int get_u32(const unsigned char * p)
+{
+	unsigned int val = 0;
+	for (int ii = 3; ii >= 0; --ii) { val = (val << 8) | p[ii]; }
+	return val;
+}
+
+static unsigned long long get_u64(const unsigned char * p)
+{
+	unsigned long long val = 0;
+	for (int ii = 7; ii >= 0; --ii) { val = (val << 8) | p[ii]; }
+	return val;
+}
+
+static void put_svarint(ClassAdWireWriter & out, long long val)
+{
+	out.uvarint(((unsigned long long)val << 1) ^ (unsigned long long)(val >> 63));
+}
+
+static bool get_svarint(ClassAdWireReader & in, long long & val)
+{
+	unsigned long long uval;
+	if ( ! in.uvarint(uval)) return false;
+	val = (long long)(uval >> 1) ^ -(long long)(uval & 1);
+	return true;
+}
+
+// the field of an index record that holds an attribute, or 0
+static int
+key_field(const std::string & attr)
+{
+	if (strcasecmp(attr.c_str(), ATTR_CLUSTER_ID) == MATCH) return HISTORY_INDEX_HAS_CLUSTER;
+	if (strcasecmp(attr.c_str(), ATTR_PROC_ID) == MATCH) return HISTORY_INDEX_HAS_PROC;
+	if (strcasecmp(attr.c_str(), ATTR_JOB_STATUS) == MATCH) return HISTORY_INDEX_HAS_STATUS;
+	if (strcasecmp(attr.c_str(), ATTR_COMPLETION_DATE) == MATCH) return HISTORY_INDEX_HAS_COMPLETION;
+	if (strcasecmp(attr.c_str(), ATTR_OWNER) == MATCH) return HISTORY_INDEX_HAS_OWNER;
+	return 0;
+}
+
+static void
+set_field(HistoryIndexRecord & rec, int field, long long val)
+{
+	switch (field) {
+	case HISTORY_INDEX_HAS_CLUSTER: rec.cluster = (int)val; break;
+	case HISTORY_INDEX_HAS_PROC: rec.proc = (int)val; break;
+	case HISTORY_INDEX_HAS_STATUS: rec.job_status = (int)val; break;
+	case HISTORY_INDEX_HAS_COMPLETION: rec.completion_date = val; break;
+	}
+	rec.flags |= field;
+}
+
+bool
+IsHistoryArchive(const char * filename)
+{
+	int fd = safe_open_wrapper_follow(filename, O_RDONLY | O_LARGEFILE | _O_BINARY);
+	if (fd < 0) {
+		return false;
+	}
+	char buf[8];
+	bool is_archive = full_read(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf) &&
+		memcmp(buf, ARCHIVE_MAGIC, 8) == 0;
+	close(fd);
+	return is_archive;
+}
+
+// --------------------------------------------------------------------------
+// writing an archive
+// --------------------------------------------------------------------------
+
+static void
+encode_block(std::vector<ClassAd*> & ads, std::string & block, unsigned int & dir_length)
+{
+	struct Column {
+		std::string name;
+		std::vector<classad::ExprTree*> cells;  // per ad, NULL if it doesn't have the attribute
+	};
+	std::map<std::string, int, classad::CaseIgnLTStr> ids;
+	std::vector<Column> cols;
+
+	size_t num_ads = ads.size();
+	for (size_t row = 0; row < num_ads; ++row) {
+		for (classad::ClassAd::iterator it = ads[row]->begin(); it != ads[row]->end(); ++it) {
+			std::map<std::string, int, classad::CaseIgnLTStr>::iterator id = ids.find(it->first);
+			if (id == ids.end()) {
+				id = ids.insert(std::make_pair(it->first, (int)cols.size())).first;
+				cols.push_back(Column());
+				cols.back().name = it->first;
+				cols.back().cells.resize(num_ads, NULL);
+			}
+			cols[id->second].cells[row] = it->second;
+		}
+	}
+
+	ClassAdWireNames dir_names;
+	ClassAdWireWriter dir(dir_names);
+	dir.uvarint(num_ads);
+	dir.uvarint(cols.size());
+	std::string data;
+
+	for (size_t ii = 0; ii < cols.size(); ++ii) {
+		Column & col = cols[ii];
+
+			// what kind of values does the column have?
+		size_t present = 0;
+		bool all_int = true, all_string = true;
+		std::map<std::string, unsigned int> dict_ids;
+		std::vector<std::string> dict;
+		std::vector<long long> ints(num_ads, 0);
+		std::string bitmap((num_ads + 7) / 8, '\0');
+		for (size_t row = 0; row < num_ads; ++row) {
+			if ( ! col.cells[row]) continue;
+			++present;
+			bitmap[row / 8] |= (char)(1 << (row % 8));
+			classad::Value val;
+			std::string str;
+			if ( ! ExprTreeIsLiteral(col.cells[row], val)) {
+				all_int = all_string = false;
+			} else if (val.IsIntegerValue(ints[row])) {
+				all_string = false;
+			} else if (val.IsStringValue(str)) {
+				all_int = false;
+				if (all_string && dict_ids.find(str) == dict_ids.end()) {
+					dict_ids[str] = (unsigned int)dict.size();
+					dict.push_back(str);
+				}
+			} else {
+				all_int = all_string = false;
+			}
+		}
+		int encoding = COLUMN_EXPR;
+		if (all_int) {
+			encoding = COLUMN_INT;
+		} else if (all_string && dict.size() * 2 <= present + 1) {
+			encoding = COLUMN_DICT;
+		}
+
+		ClassAdWireNames names;
+		ClassAdWireWriter out(names);
+		long long prev = 0, min = 0, max = 0;
+		bool first = true;
+		for (size_t row = 0; row < num_ads; ++row) {
+			if ( ! col.cells[row]) continue;
+			if (encoding == COLUMN_INT) {
+				put_svarint(out, ints[row] - prev);
+				prev = ints[row];
+				if (first || ints[row] < min) min = ints[row];
+				if (first || ints[row] > max) max = ints[row];
+				first = false;
+			} else if (encoding == COLUMN_DICT) {
+				std::string str;
+				classad::Value val;
+				ExprTreeIsLiteral(col.cells[row], val);
+				val.IsStringValue(str);
+				out.uvarint(dict_ids[str]);
+			} else {
+				out.attribute(col.name, col.cells[row]);
+			}
+		}
+
+		bool sparse = present < num_ads;
+		dir.str(col.name);
+		dir.uvarint(encoding | (sparse ? COLUMN_SPARSE : 0));
+		dir.uvarint(data.size());
+		dir.uvarint((sparse ? bitmap.size() : 0) + out.buffer().size());
+		if (encoding == COLUMN_INT) {
+			put_svarint(dir, min);
+			put_svarint(dir, max);
+		} else if (encoding == COLUMN_DICT) {
+			dir.uvarint(dict.size());
+			for (size_t jj = 0; jj < dict.size(); ++jj) {
+				dir.str(dict[jj]);
+			}
+		}
+		if (sparse) {
+			data += bitmap;
+		}
+		data += out.buffer();
+	}
+
+	dir_length = (unsigned int)dir.buffer().size();
+	block = dir.buffer();
+	block += data;
+}
+
+bool
+WriteHistoryArchive(const char * history_file, const char * archive_file, int & num_ads, std::string & errmsg)
+{
+	num_ads = 0;
+	FILE * fp = safe_fopen_wrapper_follow(history_file, "r");
+	if ( ! fp) {
+		formatstr(errmsg, "can't open %s: %s", history_file, strerror(errno));
+		return false;
+	}
+	int fd = safe_open_wrapper_follow(archive_file,
+		O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE | _O_NOINHERIT | _O_BINARY, 0644);
+	if (fd < 0) {
+		formatstr(errmsg, "can't create %s: %s", archive_file, strerror(errno));
+		fclose(fp);
+		return false;
+	}
+
+	std::string buf(ARCHIVE_MAGIC);
+	put_u32(buf, ARCHIVE_VERSION);
+	put_u32(buf, 0);
+	long long offset = 0;
+	bool ok = full_write(fd, buf.data(), buf.size()) == (ssize_t)buf.size();
+	offset += buf.size();
+
+	std::string index;
+	unsigned int num_blocks = 0;
+	int malformed = 0;
+	std::vector<ClassAd*> ads;
+	ClassAd * ad = new ClassAd();
+	bool bad_ad = false;
+	std::string line;
+	bool more = true;
+	while (ok && more) {
+		more = readLine(line, fp, false);
+		if (more) {
+			chomp(line);
+			if (line.compare(0, 4, "*** ") != 0) {
+				size_t ix = line.find_first_not_of(" \t");
+				if (ix != std::string::npos && line[ix] != '#' && ! ad->Insert(line)) {
+					bad_ad = true;
+				}
+				continue;
+			}
+		}
+
+			// a banner line, or the end of the file, ends an ad
+		if (bad_ad) {
+			++malformed;
+			delete ad;
+		} else if (ad->size() > 0) {
+			ads.push_back(ad);
+		} else {
+			delete ad;
+		}
+		ad = new ClassAd();
+		bad_ad = false;
+
+		if ( ! ads.empty() && ( ! more || ads.size() >= HISTORY_ARCHIVE_BLOCK_ADS)) {
+			unsigned int dir_length;
+			encode_block(ads, buf, dir_length);
+			put_u64(index, offset);
+			put_u32(index, dir_length);
+			put_u32(index, (unsigned int)buf.size());
+			put_u32(index, (unsigned int)ads.size());
+			ok = full_write(fd, buf.data(), buf.size()) == (ssize_t)buf.size();
+			offset += buf.size();
+			num_ads += (int)ads.size();
+			++num_blocks;
+			for (size_t ii = 0; ii < ads.size(); ++ii) {
+				delete ads[ii];
+			}
+			ads.clear();
+		}
+	}
+	delete ad;
+	for (size_t ii = 0; ii < ads.size(); ++ii) {
+		delete ads[ii];
+	}
+	fclose(fp);
+
+	if (ok) {
+		put_u32(index, num_blocks);
+		put_u64(index, offset);
+		index += ARCHIVE_END_MAGIC;
+		ok = full_write(fd, index.data(), index.size()) == (ssize_t)index.size();
+	}
+	if (ok && condor_fsync(fd, archive_file) < 0) {
+		ok = false;
+	}
+	if ( ! ok) {
+		formatstr(errmsg, "failed to write %s: %s", archive_file, strerror(errno));
+	}
+	if (close(fd) < 0 && ok) {
+		formatstr(errmsg, "failed to write %s: %s", archive_file, strerror(errno));
+		ok = false;
+	}
+	if (malformed) {
+		dprintf(D_ALWAYS, "Skipped %d malformed ads in %s\n", malformed, history_file);
+	}
+	return ok;
+}
+
+// --------------------------------------------------------------------------
+// reading an archive
+// --------------------------------------------------------------------------
+
+class HistoryArchiveBlock
+{
+public:
+	struct Column {
+		std::string name;
+		int encoding;
+		unsigned long long offset, length;
+		long long min, max;
+		std::vector<std::string> dict;
+
+		bool loaded;
+		std::string data;
+		std::vector<bool> present;      // per ad
+		std::vector<long long> values;  // per ad: integer, or dictionary entry
+		std::vector<size_t> cells;      // per ad: offset of the encoded expression
+		std::vector<size_t> cell_lengths;
+		std::vector<classad::ExprTree*> exprs;  // per ad, once decoded
+	};
+
+	HistoryArchiveBlock() : num_ads(0) {}
+	~HistoryArchiveBlock() {
+		for (size_t ii = 0; ii < cols.size(); ++ii) {
+			for (size_t jj = 0; jj < cols[ii].exprs.size(); ++jj) {
+				delete cols[ii].exprs[jj];
+			}
+		}
+	}
+
+	classad::ExprTree * expr(Column & col, int row) {
+		if ( ! col.exprs[row]) {
+			ClassAdWireNames names;
+			ClassAdWireReader in(names, col.data.data(), col.data.size());
+			col.exprs[row] = in.decode(col.data.data() + col.cells[row], col.cell_lengths[row]);
+		}
+		return col.exprs[row];
+	}
+
+	unsigned int num_ads;
+	std::vector<Column> cols;
+	std::map<std::string, int, classad::CaseIgnLTStr> ids;
+	std::vector<bool> maybe;  // per ad, false if it can't match
+};
+
+HistoryArchiveReader::HistoryArchiveReader()
+	: m_fd(-1)
+	, m_backwards(true)
+	, m_filter(NULL)
+	, m_project(false)
+	, m_next_block(0)
+	, m_block(NULL)
+	, m_row(0)
+{
+}
+
+HistoryArchiveReader::~HistoryArchiveReader()
+{
+	close();
+}
+
+void
+HistoryArchiveReader::close()
+{
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+	delete m_block;
+	m_block = NULL;
+	m_blocks.clear();
+	m_next_block = 0;
+	m_row = 0;
+}
+
+bool
+HistoryArchiveReader::open(const char * filename, std::string & errmsg)
+{
+	close();
+	m_filename = filename;
+	m_fd = safe_open_wrapper_follow(filename, O_RDONLY | O_LARGEFILE | _O_BINARY);
+	if (m_fd < 0) {
+		formatstr(errmsg, "can't open %s: %s", filename, strerror(errno));
+		return false;
+	}
+
+	unsigned char header[ARCHIVE_HEADER_SIZE];
+	unsigned char trailer[ARCHIVE_TRAILER_SIZE];
+	struct stat st;
+	if (fstat(m_fd, &st) < 0 || st.st_size < ARCHIVE_HEADER_SIZE + ARCHIVE_TRAILER_SIZE ||
+		full_read(m_fd, header, sizeof(header)) != (ssize_t)sizeof(header) ||
+		memcmp(header, ARCHIVE_MAGIC, 8) != 0 || get_u32(header + 8) != ARCHIVE_VERSION ||
+		lseek(m_fd, st.st_size - ARCHIVE_TRAILER_SIZE, SEEK_SET) < 0 ||
+		full_read(m_fd, trailer, sizeof(trailer)) != (ssize_t)sizeof(trailer) ||
+		memcmp(trailer + 12, ARCHIVE_END_MAGIC, 8) != 0) {
+		formatstr(errmsg, "%s is not a complete history archive", filename);
+		close();
+		return false;
+	}
+
+	unsigned int num_blocks = get_u32(trailer);
+	long long index_offset = (long long)get_u64(trailer + 4);
+	std::string index((size_t)num_blocks * ARCHIVE_INDEX_ENTRY, '\0');
+	if (index_offset + (long long)index.size() + ARCHIVE_TRAILER_SIZE != (long long)st.st_size ||
+		lseek(m_fd, index_offset, SEEK_SET) != index_offset ||
+		full_read(m_fd, &index[0], index.size()) != (ssize_t)index.size()) {
+		formatstr(errmsg, "%s has a bad block index", filename);
+		close();
+		return false;
+	}
+	const unsigned char * p = (const unsigned char *)index.data();
+	for (unsigned int ii = 0; ii < num_blocks; ++ii, p += ARCHIVE_INDEX_ENTRY) {
+		BlockIndex blk;
+		blk.offset = (long long)get_u64(p);
+		blk.dir_length = get_u32(p + 8);
+		blk.length = get_u32(p + 12);
+		blk.num_ads = get_u32(p + 16);
+		if (blk.dir_length > blk.length || blk.offset + blk.length > index_offset) {
+			formatstr(errmsg, "%s has a bad block index", filename);
+			close();
+			return false;
+		}
+		m_blocks.push_back(blk);
+	}
+	return true;
+}
+
+void
+HistoryArchiveReader::project(const char * attr)
+{
+	m_project = true;
+	m_projection.insert(attr);
+}
+
+void
+HistoryArchiveReader::projectReferences(classad::ExprTree * expr)
+{
+	m_project = true;
+	if ( ! expr) return;
+	classad::ClassAd scratch;
+	scratch.GetExternalReferences(expr, m_projection, false);
+	scratch.GetInternalReferences(expr, m_projection, false);
+}
+
+static bool
+load_column(int fd, long long data_offset, unsigned int num_ads, HistoryArchiveBlock::Column & col)
+{
+	col.loaded = true;
+	col.data.resize((size_t)col.length);
+	if (lseek(fd, data_offset + col.offset, SEEK_SET) != (off_t)(data_offset + col.offset) ||
+		full_read(fd, &col.data[0], col.data.size()) != (ssize_t)col.data.size()) {
+		return false;
+	}
+
+	size_t start = 0;
+	col.present.assign(num_ads, true);
+	if (col.encoding & COLUMN_SPARSE) {
+		start = (num_ads + 7) / 8;
+		if (start > col.data.size()) return false;
+		for (unsigned int row = 0; row < num_ads; ++row) {
+			col.present[row] = (col.data[row / 8] >> (row % 8)) & 1;
+		}
+	}
+
+	ClassAdWireNames names;
+	ClassAdWireReader in(names, col.data.data() + start, col.data.size() - start);
+	int encoding = col.encoding & ~COLUMN_SPARSE;
+	if (encoding == COLUMN_EXPR) {
+		col.cells.assign(num_ads, 0);
+		col.cell_lengths.assign(num_ads, 0);
+		col.exprs.assign(num_ads, NULL);
+	} else {
+		col.values.assign(num_ads, 0);
+	}
+	long long prev = 0;
+	for (unsigned int row = 0; row < num_ads; ++row) {
+		if ( ! col.present[row]) continue;
+		if (encoding == COLUMN_INT) {
+			long long delta;
+			if ( ! get_svarint(in, delta)) return false;
+			prev += delta;
+			col.values[row] = prev;
+		} else if (encoding == COLUMN_DICT) {
+			unsigned long long ix;
+			if ( ! in.uvarint(ix) || ix >= col.dict.size()) return false;
+			col.values[row] = (long long)ix;
+		} else {
+			std::string attr;
+			const char * value;
+			size_t value_len;
+			if ( ! in.attribute(attr, value, value_len)) return false;
+			col.cells[row] = value - col.data.data();
+			col.cell_lengths[row] = value_len;
+		}
+	}
+	return in.atEnd();
+}
+
+// read the directory of a block, and the columns of it that are needed.
+// returns false if there are no ads in the block that can match, setting
+// errmsg if that is because the block could not be read.
+bool
+HistoryArchiveReader::loadBlock(int ix, int & skipped, std::string & errmsg)
+{
+	const BlockIndex & blk = m_blocks[ix];
+	std::string dir(blk.dir_length, '\0');
+	if (lseek(m_fd, blk.offset, SEEK_SET) != blk.offset ||
+		full_read(m_fd, &dir[0], dir.size()) != (ssize_t)dir.size()) {
+		formatstr(errmsg, "failed to read %s: %s", m_filename.c_str(), strerror(errno));
+		return false;
+	}
+
+	HistoryArchiveBlock * block = new HistoryArchiveBlock();
+	ClassAdWireNames names;
+	ClassAdWireReader in(names, dir.data(), dir.size());
+	unsigned long long num_ads = 0, num_cols = 0;
+	bool ok = in.uvarint(num_ads) && in.uvarint(num_cols) && num_ads == blk.num_ads;
+	for (unsigned long long ii = 0; ok && ii < num_cols; ++ii) {
+		HistoryArchiveBlock::Column col;
+		unsigned long long encoding;
+		ok = in.str(col.name) && in.uvarint(encoding) && in.uvarint(col.offset) && in.uvarint(col.length);
+		col.encoding = (int)encoding;
+		col.min = col.max = 0;
+		col.loaded = false;
+		if (ok && (col.encoding & ~COLUMN_SPARSE) == COLUMN_INT) {
+			ok = get_svarint(in, col.min) && get_svarint(in, col.max);
+		} else if (ok && (col.encoding & ~COLUMN_SPARSE) == COLUMN_DICT) {
+			unsigned long long num_strings;
+			ok = in.uvarint(num_strings) && num_strings <= dir.size();
+			col.dict.resize(ok ? (size_t)num_strings : 0);
+			for (size_t jj = 0; ok && jj < col.dict.size(); ++jj) {
+				ok = in.str(col.dict[jj]);
+			}
+		}
+		if (ok && col.offset + col.length > blk.length - blk.dir_length) {
+			ok = false;
+		}
+		block->ids[col.name] = (int)block->cols.size();
+		block->cols.push_back(col);
+	}
+	if ( ! ok) {
+		formatstr(errmsg, "%s has a bad block at offset %lld", m_filename.c_str(), blk.offset);
+		delete block;
+		return false;
+	}
+	block->num_ads = (unsigned int)num_ads;
+
+		// skip the block if none of its ads can match
+	bool filtering = m_filter && ! m_filter->matchesAll();
+	std::vector<int> key_cols;
+	if (filtering) {
+		HistoryIndexRecord lo, hi;
+		memset(&lo, 0, sizeof(lo));
+		memset(&hi, 0, sizeof(hi));
+		std::vector<unsigned int> owners;
+		for (size_t ii = 0; ii < block->cols.size(); ++ii) {
+			HistoryArchiveBlock::Column & col = block->cols[ii];
+			int field = key_field(col.name);
+			if (field == HISTORY_INDEX_HAS_OWNER && col.encoding == COLUMN_DICT) {
+				for (size_t jj = 0; jj < col.dict.size(); ++jj) {
+					owners.push_back(HistoryIndexOwnerHash(col.dict[jj].c_str()));
+				}
+				lo.flags |= field;
+				key_cols.push_back((int)ii);
+			} else if (field && field != HISTORY_INDEX_HAS_OWNER && col.encoding == COLUMN_INT) {
+				set_field(lo, field, col.min);
+				set_field(hi, field, col.max);
+				key_cols.push_back((int)ii);
+			} else if (field && (col.encoding & ~COLUMN_SPARSE) != COLUMN_EXPR) {
+				key_cols.push_back((int)ii);
+			}
+		}
+		if ( ! m_filter->mayMatchRange(lo, hi, owners)) {
+			skipped += block->num_ads;
+			delete block;
+			return false;
+		}
+	}
+
+	long long data_offset = blk.offset + blk.dir_length;
+	for (size_t ii = 0; ok && ii < block->cols.size(); ++ii) {
+		HistoryArchiveBlock::Column & col = block->cols[ii];
+		if ( ! m_project || m_projection.count(col.name) ||
+			std::find(key_cols.begin(), key_cols.end(), (int)ii) != key_cols.end()) {
+			ok = load_column(m_fd, data_offset, block->num_ads, col);
+		}
+	}
+
+		// then the ads that can't match
+	block->maybe.assign(block->num_ads, true);
+	for (unsigned int row = 0; ok && filtering && row < block->num_ads; ++row) {
+		HistoryIndexRecord rec;
+		memset(&rec, 0, sizeof(rec));
+		for (size_t ii = 0; ii < key_cols.size(); ++ii) {
+			HistoryArchiveBlock::Column & col = block->cols[key_cols[ii]];
+			if ( ! col.present[row]) continue;
+			int field = key_field(col.name);
+			if (field == HISTORY_INDEX_HAS_OWNER) {
+				if ((col.encoding & ~COLUMN_SPARSE) == COLUMN_DICT) {
+					rec.owner_hash = HistoryIndexOwnerHash(col.dict[col.values[row]].c_str());
+					rec.flags |= field;
+				}
+			} else if ((col.encoding & ~COLUMN_SPARSE) == COLUMN_INT) {
+				set_field(rec, field, col.values[row]);
+			}
+		}
+		block->maybe[row] = m_filter->mayMatch(rec);
+	}
+
+		// with a projection, also read the attributes that the projected
+		// expressions refer to, in the ads that may match.
+	for (bool more = m_project; ok && more; ) {
+		more = false;
+		for (size_t ii = 0; ii < block->cols.size(); ++ii) {
+			HistoryArchiveBlock::Column & col = block->cols[ii];
+			if ( ! col.loaded || (col.encoding & ~COLUMN_SPARSE) != COLUMN_EXPR) continue;
+			classad::References refs;
+			classad::ClassAd scratch;
+			for (unsigned int row = 0; row < block->num_ads; ++row) {
+				if ( ! block->maybe[row] || ! col.present[row]) continue;
+				classad::ExprTree * tree = block->expr(col, row);
+				if (tree) {
+					scratch.GetExternalReferences(tree, refs, false);
+					scratch.GetInternalReferences(tree, refs, false);
+				}
+			}
+			for (classad::References::iterator it = refs.begin(); ok && it != refs.end(); ++it) {
+				std::map<std::string, int, classad::CaseIgnLTStr>::iterator id = block->ids.find(*it);
+				if (id != block->ids.end() && ! block->cols[id->second].loaded) {
+					ok = load_column(m_fd, data_offset, block->num_ads, block->cols[id->second]);
+					more = true;
+				}
+			}
+		}
+	}
+
+	if ( ! ok) {
+		formatstr(errmsg, "%s has a bad block at offset %lld", m_filename.c_str(), blk.offset);
+		delete block;
+		return false;
+	}
+	delete m_block;
+	m_block = block;
+	return true;
+}
+
+bool
+HistoryArchiveReader::nextAd(ClassAd & ad, int & skipped)
+{
+	skipped = 0;
+	if (m_fd < 0) {
+		return false;
+	}
+	for (;;) {
+		if ( ! m_block || m_row >= (int)m_block->num_ads) {
+			delete m_block;
+			m_block = NULL;
+			if (m_next_block >= (int)m_blocks.size()) {
+				return false;
+			}
+			int ix = m_backwards ? (int)m_blocks.size() - 1 - m_next_block : m_next_block;
+			++m_next_block;
+			m_row = 0;
+			std::string errmsg;
+			if ( ! loadBlock(ix, skipped, errmsg)) {
+				if ( ! errmsg.empty()) {
+					dprintf(D_ALWAYS, "%s\n", errmsg.c_str());
+					m_next_block = (int)m_blocks.size();
+					return false;
+				}
+				continue;
+			}
+		}
+
+		int row = m_backwards ? (int)m_block->num_ads - 1 - m_row : m_row;
+		++m_row;
+		if ( ! m_block->maybe[row]) {
+			++skipped;
+			continue;
+		}
+
+		ad.Clear();
+		for (size_t ii = 0; ii < m_block->cols.size(); ++ii) {
+			HistoryArchiveBlock::Column & col = m_block->cols[ii];
+			if ( ! col.loaded || ! col.present[row]) continue;
+			switch (col.encoding & ~COLUMN_SPARSE) {
+			case COLUMN_INT:
+				ad.InsertAttr(col.name, col.values[row]);
+				break;
+			case COLUMN_DICT:
+				ad.InsertAttr(col.name, col.dict[col.values[row]]);
+				break;
+			default: {
+				classad::ExprTree * tree = m_block->expr(col, row);
+				if (tree) {
+					col.exprs[row] = NULL; // the ad owns it now
+					ad.Insert(col.name, tree);
+				}
+				break;
+			}
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,124 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _HISTORY_ARCHIVE_H
+#define _HISTORY_ARCHIVE_H
+
+/*
+  Columnar archives of rotated history files.
+
+  With ROTATE_HISTORY_TO_ARCHIVE, a history file that is rotated is
+  rewritten as an archive under the same name, so the rotated files are
+  found, counted and deleted as before; readers tell an archive from a text
+  history file by its first bytes.  The current history file stays text.
+
+  The ads are stored in blocks of up to HISTORY_ARCHIVE_BLOCK_ADS ads, and
+  each attribute of the ads in a block is stored as a column.  A column of
+  integers is stored as the differences between one value and the next, a
+  column of strings with few distinct values as a dictionary and a number
+  per ad, and anything else as the binary ClassAd encoding (classad_wire.h).
+  Numbers are varints unless noted; fixed size numbers are little endian.
+
+      header:     "CHISTCOL", version (4 fixed), reserved (4 fixed)
+      block:      directory, then the data of each column
+      directory:  number of ads, number of columns, then for each column
+                  name, encoding, offset and length of its data,
+                  least and greatest value (integer columns),
+                  the strings (dictionary columns)
+      data:       a bit per ad saying which ads have the attribute (only if
+                  some do not), then the values of the ads that have it
+      index:      for each block, offset (8), length of the directory (4),
+                  length of the block (4), number of ads (4)
+      trailer:    number of blocks (4), offset of the index (8), "CHISTEND"
+
+  A reader reads the directory of a block first.  With a HistoryIndexFilter
+  it skips blocks whose ClusterId, ProcId, JobStatus, CompletionDate or
+  Owner can't match, and the ads in a block that can't match.  With a
+  projection it only reads and decodes the columns of the projected
+  attributes, and of the attributes they refer to.
+*/
+
+#include "condor_classad.h"
+#include "history_index.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// true if the file is a history archive rather than a text history file
+bool IsHistoryArchive(const char * filename);
+
+// write the ads of a text history file to an archive.
+bool WriteHistoryArchive(
+	const char * history_file,   // in
+	const char * archive_file,   // in
+	int & num_ads,               // out
+	std::string & errmsg);       // out
+
+class HistoryArchiveBlock;
+
+class HistoryArchiveReader
+{
+public:
+	HistoryArchiveReader();
+	~HistoryArchiveReader();
+
+	bool open(const char * filename, std::string & errmsg);
+	void close();
+
+	// read the newest ads first (the default), or the oldest
+	void setBackwards(bool backwards) { m_backwards = backwards; }
+
+	// skip the ads that can't match.  the filter must outlive the reader.
+	void setFilter(const HistoryIndexFilter * filter) { m_filter = filter; }
+
+	// read only the projected attributes.  with no projection, all of them
+	// are read.  the attributes an expression refers to can be added with
+	// projectReferences(), so that it evaluates the same as on the whole ad.
+	void project(const char * attr);
+	void projectReferences(classad::ExprTree * expr);
+
+	// the next ad that may match.  skipped is set to the number of ads
+	// before it (or before the end of the file) that did not.
+	bool nextAd(ClassAd & ad, int & skipped);
+
+private:
+	bool loadBlock(int ix, int & skipped, std::string & errmsg);
+
+	struct BlockIndex {
+		long long offset;
+		unsigned int dir_length;
+		unsigned int length;
+		unsigned int num_ads;
+	};
+
+	int m_fd;
+	std::string m_filename;
+	std::vector<BlockIndex> m_blocks;
+	bool m_backwards;
+	const HistoryIndexFilter * m_filter;
+	bool m_project;
+	classad::References m_projection;
+
+	int m_next_block;  // the next block to load, in reading order
+	HistoryArchiveBlock * m_block;
+	int m_row;  // the next ad in m_block, in reading order
+};
+
+#endif
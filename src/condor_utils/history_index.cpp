@@ -0,0 +1,907 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_config.h"
+#include "condor_attributes.h"
+#include "condor_blkng_full_disk_io.h"
+#include "basename.h"
+#include "sysapi.h"
+#include "stl_string_utils.h"
+#include "compat_classad_util.h"
+#include "history_index.h"
+
+#include <algorithm>
+
+#define HISTORY_INDEX_MAGIC       "CHISTIDX"
+#define HISTORY_INDEX_VERSION     1
+#define HISTORY_INDEX_HEADER_SIZE 16
+#define HISTORY_INDEX_RECORD_SIZE 40
+
+// how much of the ads in each file the read ahead threads read
+#define HISTORY_INDEX_READ_AHEAD  (8 * 1024 * 1024)
+
+static void put_u32(std::string & buf, unsigned int val)
+{
+	for (int ii = 0; ii < 4; ++ii) { buf += (char)((val >> (8*ii)) & 0xFF); }
+}
+
+static void put_u64(std::string & buf, unsigned long long val)
+{
+	for (int ii = 0; ii < 8; ++ii) { buf += (char)((val >> (8*ii)) & 0xFF); }
+}
+
+static unsigned int get_u32(const unsigned char * p)
+{
+	unsigned int val = 0;
+	for (int ii = 3; ii >= 0; --ii) { val = (val << 8) | p[ii]; }
+	return val;
+}
+
+static unsigned long long get_u64(const unsigned char * p)
+{
+	unsigned long long val = 0;
+	for (int ii = 7; ii >= 0; --ii) { val = (val << 8) | p[ii]; }
+	return val;
+}
+
+static void put_header(std::string & buf)
+{
+	buf.append(HISTORY_INDEX_MAGIC, 8);
+	put_u32(buf, HISTORY_INDEX_VERSION);
+	put_u32(buf, HISTORY_INDEX_RECORD_SIZE);
+}
+
+static bool check_header(const unsigned char * p)
+{
+	return memcmp(p, HISTORY_INDEX_MAGIC, 8) == 0
+		&& get_u32(p + 8) == HISTORY_INDEX_VERSION
+		&& get_u32(p + 12) == HISTORY_INDEX_RECORD_SIZE;
+}
+
+static void put_record(std::string & buf, const HistoryIndexRecord & rec)
+{
+	put_u64(buf, rec.offset);
+	put_u32(buf, rec.length);
+	put_u32(buf, (unsigned int)rec.cluster);
+	put_u32(buf, (unsigned int)rec.proc);
+	put_u32(buf, (unsigned int)rec.job_status);
+	put_u64(buf, rec.completion_date);
+	put_u32(buf, rec.owner_hash);
+	put_u32(buf, rec.flags);
+}
+
+static void get_record(const unsigned char * p, HistoryIndexRecord & rec)
+{
+	rec.offset = (long long)get_u64(p);
+	rec.length = get_u32(p + 8);
+	rec.cluster = (int)get_u32(p + 12);
+	rec.proc = (int)get_u32(p + 16);
+	rec.job_status = (int)get_u32(p + 20);
+	rec.completion_date = (long long)get_u64(p + 24);
+	rec.owner_hash = get_u32(p + 32);
+	rec.flags = get_u32(p + 36);
+}
+
+std::string
+HistoryIndexFileName(const char * history_file)
+{
+	const char * base = condor_basename(history_file);
+	std::string name(history_file, base - history_file);
+	name += '.';
+	name += base;
+	name += ".idx";
+	return name;
+}
+
+// FNV-1a.  Owner == "name" ignores case, so the hash does too.
+unsigned int
+HistoryIndexOwnerHash(const char * owner)
+{
+	unsigned int hash = 2166136261u;
+	for (const char * p = owner; *p; ++p) {
+		hash ^= (unsigned char)tolower((unsigned char)*p);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void
+RenameHistoryIndex(const char * from_history_file, const char * to_history_file)
+{
+	std::string from = HistoryIndexFileName(from_history_file);
+	std::string to = HistoryIndexFileName(to_history_file);
+	if (rename(from.c_str(), to.c_str()) < 0 && errno != ENOENT) {
+		dprintf(D_ALWAYS, "Failed to rename history index %s to %s: %s\n",
+			from.c_str(), to.c_str(), strerror(errno));
+	}
+}
+
+void
+RemoveHistoryIndex(const char * history_file)
+{
+	std::string name = HistoryIndexFileName(history_file);
+	if (unlink(name.c_str()) < 0 && errno != ENOENT) {
+		dprintf(D_ALWAYS, "Failed to delete history index %s: %s\n",
+			name.c_str(), strerror(errno));
+	}
+}
+
+// --------------------------------------------------------------------------
+// writing the index
+// --------------------------------------------------------------------------
+
+bool
+HistoryIndexWriter::open(const char * history_file, filesize_t history_size)
+{
+	close();
+	m_history_file = history_file;
+	std::string name = HistoryIndexFileName(history_file);
+	m_fd = safe_open_wrapper_follow(name.c_str(),
+		O_RDWR | O_CREAT | O_APPEND | O_LARGEFILE | _O_NOINHERIT | _O_BINARY, 0644);
+	if (m_fd < 0) {
+		dprintf(D_ALWAYS, "ERROR opening history index (%s): %s\n", name.c_str(), strerror(errno));
+		return false;
+	}
+
+		// the index is good if its last record ends where the history file does
+	struct stat st;
+	unsigned char buf[HISTORY_INDEX_RECORD_SIZE];
+	bool good = false;
+	if (fstat(m_fd, &st) == 0 && st.st_size >= HISTORY_INDEX_HEADER_SIZE &&
+		(st.st_size - HISTORY_INDEX_HEADER_SIZE) % HISTORY_INDEX_RECORD_SIZE == 0 &&
+		lseek(m_fd, 0, SEEK_SET) == 0 &&
+		full_read(m_fd, buf, HISTORY_INDEX_HEADER_SIZE) == HISTORY_INDEX_HEADER_SIZE &&
+		check_header(buf)) {
+		if (st.st_size == HISTORY_INDEX_HEADER_SIZE) {
+			good = (history_size == 0);
+			m_end = 0;
+		} else if (lseek(m_fd, st.st_size - HISTORY_INDEX_RECORD_SIZE, SEEK_SET) >= 0 &&
+			full_read(m_fd, buf, HISTORY_INDEX_RECORD_SIZE) == HISTORY_INDEX_RECORD_SIZE) {
+			HistoryIndexRecord rec;
+			get_record(buf, rec);
+			m_end = rec.offset + rec.length;
+			good = (m_end == history_size);
+		}
+	}
+	if ( ! good) {
+		return rebuild(history_size);
+	}
+	return true;
+}
+
+void
+HistoryIndexWriter::close()
+{
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+	m_end = 0;
+}
+
+bool
+HistoryIndexWriter::append(ClassAd & ad, filesize_t offset, filesize_t length)
+{
+	if (m_fd < 0) {
+		return false;
+	}
+	if (offset != m_end && ! rebuild(offset)) {
+		return false;
+	}
+
+	HistoryIndexRecord rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.offset = offset;
+	rec.length = (unsigned int)length;
+	long long val;
+	if (ad.LookupInteger(ATTR_CLUSTER_ID, rec.cluster)) { rec.flags |= HISTORY_INDEX_HAS_CLUSTER; }
+	if (ad.LookupInteger(ATTR_PROC_ID, rec.proc)) { rec.flags |= HISTORY_INDEX_HAS_PROC; }
+	if (ad.LookupInteger(ATTR_JOB_STATUS, rec.job_status)) { rec.flags |= HISTORY_INDEX_HAS_STATUS; }
+	if (ad.LookupInteger(ATTR_COMPLETION_DATE, val)) {
+		rec.completion_date = val;
+		rec.flags |= HISTORY_INDEX_HAS_COMPLETION;
+	}
+	std::string owner;
+	if (ad.LookupString(ATTR_OWNER, owner)) {
+		rec.owner_hash = HistoryIndexOwnerHash(owner.c_str());
+		rec.flags |= HISTORY_INDEX_HAS_OWNER;
+	}
+
+	std::vector<HistoryIndexRecord> recs(1, rec);
+	if ( ! write(recs)) {
+		return false;
+	}
+	m_end = offset + length;
+	return true;
+}
+
+bool
+HistoryIndexWriter::write(const std::vector<HistoryIndexRecord> & recs)
+{
+	std::string buf;
+	buf.reserve(recs.size() * HISTORY_INDEX_RECORD_SIZE);
+	for (size_t ii = 0; ii < recs.size(); ++ii) {
+		put_record(buf, recs[ii]);
+	}
+	if (full_write(m_fd, buf.data(), buf.size()) != (ssize_t)buf.size()) {
+		dprintf(D_ALWAYS, "ERROR writing history index for %s: %s, will not index it\n",
+			m_history_file.c_str(), strerror(errno));
+		close();
+		return false;
+	}
+	return true;
+}
+
+// the value after "name = " in a banner line
+static const char *
+banner_value(const char * line, const char * name)
+{
+	const char * p = strstr(line, name);
+	if ( ! p) return NULL;
+	p += strlen(name);
+	if (strncmp(p, " = ", 3) != 0) return NULL;
+	return p + 3;
+}
+
+// Make the index of the first history_size bytes of the history file from
+// the banner lines, which have everything but the JobStatus.
+bool
+HistoryIndexWriter::rebuild(filesize_t history_size)
+{
+	FILE * fp = safe_fopen_wrapper_follow(m_history_file.c_str(), "rb");
+	if ( ! fp) {
+		if (errno != ENOENT || history_size != 0) {
+			dprintf(D_ALWAYS, "ERROR reading history file %s to index it: %s\n",
+				m_history_file.c_str(), strerror(errno));
+			close();
+			return false;
+		}
+	}
+
+	std::vector<HistoryIndexRecord> recs;
+	long long start = 0, pos = 0;
+	std::string line;
+	while (fp && pos < history_size && readLine(line, fp, false)) {
+		pos += line.size();
+		if (pos > history_size || strncmp(line.c_str(), "*** ", 4) != 0) {
+			continue;
+		}
+		HistoryIndexRecord rec;
+		memset(&rec, 0, sizeof(rec));
+		rec.offset = start;
+		rec.length = (unsigned int)(pos - start);
+		const char * p;
+		if ((p = banner_value(line.c_str(), "ClusterId")) && (rec.cluster = atoi(p)) >= 0) {
+			rec.flags |= HISTORY_INDEX_HAS_CLUSTER;
+		}
+		if ((p = banner_value(line.c_str(), "ProcId")) && (rec.proc = atoi(p)) >= 0) {
+			rec.flags |= HISTORY_INDEX_HAS_PROC;
+		}
+		if ((p = banner_value(line.c_str(), "CompletionDate")) && (rec.completion_date = atoll(p)) >= 0) {
+			rec.flags |= HISTORY_INDEX_HAS_COMPLETION;
+		}
+		if ((p = banner_value(line.c_str(), "Owner")) && *p == '"') {
+			const char * end = strchr(p + 1, '"');
+			std::string owner(p + 1, end ? end - p - 1 : 0);
+			if (end && owner != "?") {
+				rec.owner_hash = HistoryIndexOwnerHash(owner.c_str());
+				rec.flags |= HISTORY_INDEX_HAS_OWNER;
+			}
+		}
+		recs.push_back(rec);
+		start = pos;
+	}
+	if (fp) {
+		fclose(fp);
+	}
+	if (start < history_size) {
+			// whatever is after the last banner is indexed as an ad that
+			// matches anything, so that readers see it as they would without
+			// the index
+		HistoryIndexRecord rec;
+		memset(&rec, 0, sizeof(rec));
+		rec.offset = start;
+		rec.length = (unsigned int)(history_size - start);
+		recs.push_back(rec);
+	}
+
+	std::string header;
+	put_header(header);
+	if (ftruncate(m_fd, 0) < 0 ||
+		full_write(m_fd, header.data(), header.size()) != (ssize_t)header.size()) {
+		dprintf(D_ALWAYS, "ERROR writing history index for %s: %s, will not index it\n",
+			m_history_file.c_str(), strerror(errno));
+		close();
+		return false;
+	}
+	if ( ! write(recs)) {
+		return false;
+	}
+	m_end = history_size;
+	dprintf(D_ALWAYS, "Rebuilt the index of history file %s (%d ads)\n",
+		m_history_file.c_str(), (int)recs.size());
+	return true;
+}
+
+// --------------------------------------------------------------------------
+// matching the records to a constraint
+// --------------------------------------------------------------------------
+
+void
+HistoryIndexFilter::init(classad::ExprTree * constraint)
+{
+	m_nodes.clear();
+	m_root = build(constraint);
+}
+
+// returns the node for the part of the expression that can be answered from
+// the index, or -1 if no part of it can.
+int
+HistoryIndexFilter::build(classad::ExprTree * tree)
+{
+	tree = SkipExprEnvelope(tree);
+	if ( ! tree || tree->GetKind() != classad::ExprTree::OP_NODE) {
+		return -1;
+	}
+	classad::Operation::OpKind op;
+	classad::ExprTree *e1 = NULL, *e2 = NULL, *e3 = NULL;
+	((classad::Operation*)tree)->GetComponents(op, e1, e2, e3);
+
+	Node node;
+	memset(&node, 0, sizeof(node));
+	node.op = op;
+	node.left = node.right = -1;
+
+	switch (op) {
+	case classad::Operation::PARENTHESES_OP:
+		return build(e1);
+
+	case classad::Operation::LOGICAL_AND_OP:
+		node.left = build(e1);
+		node.right = build(e2);
+		if (node.left < 0) return node.right;
+		if (node.right < 0) return node.left;
+		break;
+
+	case classad::Operation::LOGICAL_OR_OP:
+		if ((node.left = build(e1)) < 0) return -1;
+		if ((node.right = build(e2)) < 0) return -1;
+		break;
+
+	case classad::Operation::LESS_THAN_OP:
+	case classad::Operation::LESS_OR_EQUAL_OP:
+	case classad::Operation::NOT_EQUAL_OP:
+	case classad::Operation::EQUAL_OP:
+	case classad::Operation::GREATER_OR_EQUAL_OP:
+	case classad::Operation::GREATER_THAN_OP:
+	case classad::Operation::META_EQUAL_OP: {
+		std::string attr;
+		classad::ExprTree * value = SkipExprEnvelope(e2);
+		if ( ! ExprTreeIsAttrRef(SkipExprEnvelope(e1), attr)) {
+			if ( ! ExprTreeIsAttrRef(SkipExprEnvelope(e2), attr)) {
+				return -1;
+			}
+			value = SkipExprEnvelope(e1);
+			switch (op) {
+			case classad::Operation::LESS_THAN_OP: op = classad::Operation::GREATER_THAN_OP; break;
+			case classad::Operation::LESS_OR_EQUAL_OP: op = classad::Operation::GREATER_OR_EQUAL_OP; break;
+			case classad::Operation::GREATER_OR_EQUAL_OP: op = classad::Operation::LESS_OR_EQUAL_OP; break;
+			case classad::Operation::GREATER_THAN_OP: op = classad::Operation::LESS_THAN_OP; break;
+			default: break;
+			}
+			node.op = op;
+		}
+
+		if (strcasecmp(attr.c_str(), ATTR_CLUSTER_ID) == MATCH) {
+			node.field = HISTORY_INDEX_HAS_CLUSTER;
+		} else if (strcasecmp(attr.c_str(), ATTR_PROC_ID) == MATCH) {
+			node.field = HISTORY_INDEX_HAS_PROC;
+		} else if (strcasecmp(attr.c_str(), ATTR_JOB_STATUS) == MATCH) {
+			node.field = HISTORY_INDEX_HAS_STATUS;
+		} else if (strcasecmp(attr.c_str(), ATTR_COMPLETION_DATE) == MATCH) {
+			node.field = HISTORY_INDEX_HAS_COMPLETION;
+		} else if (strcasecmp(attr.c_str(), ATTR_OWNER) == MATCH) {
+			node.field = HISTORY_INDEX_HAS_OWNER;
+		} else {
+			return -1;
+		}
+
+			// the other side must not depend on the ad.  it may depend on the
+			// time, as in CompletionDate > time() - 86400, but only where
+			// using the time now lets through everything it will match later.
+		classad::ClassAd scratch;
+		classad::References refs;
+		scratch.GetExternalReferences(value, refs, true);
+		scratch.GetInternalReferences(value, refs, true);
+		if ( ! refs.empty()) {
+			return -1;
+		}
+		if (ExprTreeDependsOnTime(value) &&
+			op != classad::Operation::GREATER_THAN_OP && op != classad::Operation::GREATER_OR_EQUAL_OP) {
+			return -1;
+		}
+		classad::Value val;
+		if ( ! scratch.EvaluateExpr(value, val)) {
+			return -1;
+		}
+
+		if (node.field == HISTORY_INDEX_HAS_OWNER) {
+			std::string owner;
+			if ((op != classad::Operation::EQUAL_OP && op != classad::Operation::META_EQUAL_OP) ||
+				! val.IsStringValue(owner)) {
+				return -1;
+			}
+			node.ival = HistoryIndexOwnerHash(owner.c_str());
+		} else if (val.IsIntegerValue(node.ival)) {
+			node.is_real = false;
+		} else if (val.IsRealValue(node.rval)) {
+			node.is_real = true;
+		} else {
+			return -1;
+		}
+		break;
+	}
+
+	default:
+		return -1;
+	}
+
+	m_nodes.push_back(node);
+	return (int)m_nodes.size() - 1;
+}
+
+template <class T> static bool
+compare_op(int op, T lhs, T rhs)
+{
+	switch (op) {
+	case classad::Operation::LESS_THAN_OP: return lhs < rhs;
+	case classad::Operation::LESS_OR_EQUAL_OP: return lhs <= rhs;
+	case classad::Operation::NOT_EQUAL_OP: return lhs != rhs;
+	case classad::Operation::EQUAL_OP: return lhs == rhs;
+	case classad::Operation::GREATER_OR_EQUAL_OP: return lhs >= rhs;
+	case classad::Operation::GREATER_THAN_OP: return lhs > rhs;
+	case classad::Operation::META_EQUAL_OP: return lhs == rhs;
+	}
+	return true;
+}
+
+bool
+HistoryIndexFilter::eval(int ix, const HistoryIndexRecord & rec) const
+{
+	const Node & node = m_nodes[ix];
+	switch (node.op) {
+	case classad::Operation::LOGICAL_AND_OP:
+		return eval(node.left, rec) && eval(node.right, rec);
+	case classad::Operation::LOGICAL_OR_OP:
+		return eval(node.left, rec) || eval(node.right, rec);
+	}
+
+	if ( ! (rec.flags & node.field)) {
+		return true;
+	}
+	long long val = 0;
+	switch (node.field) {
+	case HISTORY_INDEX_HAS_OWNER: return rec.owner_hash == (unsigned int)node.ival;
+	case HISTORY_INDEX_HAS_CLUSTER: val = rec.cluster; break;
+	case HISTORY_INDEX_HAS_PROC: val = rec.proc; break;
+	case HISTORY_INDEX_HAS_STATUS: val = rec.job_status; break;
+	case HISTORY_INDEX_HAS_COMPLETION: val = rec.completion_date; break;
+	}
+	if (node.is_real) {
+		return compare_op(node.op, (double)val, node.rval);
+	}
+	return compare_op(node.op, val, node.ival);
+}
+
+template <class T> static bool
+range_op(int op, T lo, T hi, T val)
+{
+	switch (op) {
+	case classad::Operation::LESS_THAN_OP: return lo < val;
+	case classad::Operation::LESS_OR_EQUAL_OP: return lo <= val;
+	case classad::Operation::NOT_EQUAL_OP: return lo != val || hi != val;
+	case classad::Operation::EQUAL_OP: return lo <= val && val <= hi;
+	case classad::Operation::GREATER_OR_EQUAL_OP: return hi >= val;
+	case classad::Operation::GREATER_THAN_OP: return hi > val;
+	case classad::Operation::META_EQUAL_OP: return lo <= val && val <= hi;
+	}
+	return true;
+}
+
+static long long
+record_field(const HistoryIndexRecord & rec, int field)
+{
+	switch (field) {
+	case HISTORY_INDEX_HAS_CLUSTER: return rec.cluster;
+	case HISTORY_INDEX_HAS_PROC: return rec.proc;
+	case HISTORY_INDEX_HAS_STATUS: return rec.job_status;
+	case HISTORY_INDEX_HAS_COMPLETION: return rec.completion_date;
+	}
+	return 0;
+}
+
+bool
+HistoryIndexFilter::evalRange(int ix, const HistoryIndexRecord & lo, const HistoryIndexRecord & hi,
+	const std::vector<unsigned int> & owners) const
+{
+	const Node & node = m_nodes[ix];
+	switch (node.op) {
+	case classad::Operation::LOGICAL_AND_OP:
+		return evalRange(node.left, lo, hi, owners) && evalRange(node.right, lo, hi, owners);
+	case classad::Operation::LOGICAL_OR_OP:
+		return evalRange(node.left, lo, hi, owners) || evalRange(node.right, lo, hi, owners);
+	}
+
+	if ( ! (lo.flags & node.field)) {
+		return true;
+	}
+	if (node.field == HISTORY_INDEX_HAS_OWNER) {
+		return std::find(owners.begin(), owners.end(), (unsigned int)node.ival) != owners.end();
+	}
+	long long min = record_field(lo, node.field);
+	long long max = record_field(hi, node.field);
+	if (node.is_real) {
+		return range_op(node.op, (double)min, (double)max, node.rval);
+	}
+	return range_op(node.op, min, max, node.ival);
+}
+
+// --------------------------------------------------------------------------
+// reading the ads with the index
+// --------------------------------------------------------------------------
+
+enum { SCAN_PENDING, SCAN_BUSY, SCAN_DONE };
+
+class HistoryIndexScan
+{
+public:
+	struct Candidate {
+		long long offset;
+		unsigned int length;
+		int skipped;
+	};
+
+	HistoryIndexScan(const char * file)
+		: filename(file), state(SCAN_PENDING), indexed(false), fd(-1), next(0), trailing(0) {}
+	~HistoryIndexScan() { release(); }
+
+	void release() {
+		if (fd >= 0) { close(fd); fd = -1; }
+		std::vector<Candidate>().swap(cands);
+		std::vector<std::string>().swap(texts);
+	}
+
+	bool read(const Candidate & cand, std::string & text) {
+		text.resize(cand.length);
+		return lseek(fd, cand.offset, SEEK_SET) == cand.offset &&
+			full_read(fd, &text[0], cand.length) == (ssize_t)cand.length;
+	}
+
+	std::string filename;
+	int state;
+	bool indexed;
+	std::string error;  // why the index was not used
+	int fd;
+	std::vector<Candidate> cands;   // newest first
+	std::vector<std::string> texts; // of the first few candidates
+	size_t next;
+	int trailing;  // ads before the end of the file that did not match
+};
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+static void *
+history_index_read_ahead(void * arg)
+{
+	((HistoryIndexReader *)arg)->readAhead();
+	return NULL;
+}
+#endif
+
+void
+HistoryIndexReader::lock()
+{
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_mutex_lock(&m_mutex);
+#endif
+}
+
+void
+HistoryIndexReader::unlock()
+{
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_mutex_unlock(&m_mutex);
+#endif
+}
+
+void
+HistoryIndexReader::wait()
+{
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_cond_wait(&m_cond, &m_mutex);
+#endif
+}
+
+void
+HistoryIndexReader::broadcast()
+{
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_cond_broadcast(&m_cond);
+#endif
+}
+
+HistoryIndexReader::HistoryIndexReader(const char * const * files, int num_files, const HistoryIndexFilter & filter)
+	: m_filter(filter)
+	, m_current(-1)
+	, m_next_scan(0)
+	, m_window(0)
+	, m_stop(false)
+{
+	for (int ii = num_files - 1; ii >= 0; --ii) {
+		m_scans.push_back(new HistoryIndexScan(files[ii]));
+	}
+
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_cond, NULL);
+
+	int num_threads = param_integer("HISTORY_INDEX_READ_THREADS", 0, 0);
+	if (num_threads == 0) {
+		int num_cpus = 0, num_hyperthread_cpus = 0;
+		sysapi_ncpus_raw(&num_cpus, &num_hyperthread_cpus);
+		num_threads = num_hyperthread_cpus;
+	}
+	if (num_threads > num_files) {
+		num_threads = num_files;
+	}
+	m_window = num_threads + 1;
+
+	sigset_t all_signals, old_mask;
+	sigfillset(&all_signals);
+	pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+	for (int ii = 0; ii < num_threads; ++ii) {
+		pthread_t thread;
+		int rval = pthread_create(&thread, NULL, history_index_read_ahead, this);
+		if (rval != 0) {
+			dprintf(D_ALWAYS, "Failed to create history read ahead thread: %s (%d), using %d\n",
+				strerror(rval), rval, (int)m_threads.size());
+			break;
+		}
+		m_threads.push_back(thread);
+	}
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+#endif
+}
+
+HistoryIndexReader::~HistoryIndexReader()
+{
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	lock();
+	m_stop = true;
+	broadcast();
+	unlock();
+	for (size_t ii = 0; ii < m_threads.size(); ++ii) {
+		pthread_join(m_threads[ii], NULL);
+	}
+	pthread_cond_destroy(&m_cond);
+	pthread_mutex_destroy(&m_mutex);
+#endif
+	for (size_t ii = 0; ii < m_scans.size(); ++ii) {
+		delete m_scans[ii];
+	}
+}
+
+// the read ahead threads take the files in the order they will be read,
+// staying no more than m_window files ahead of the reader.
+void
+HistoryIndexReader::readAhead()
+{
+	lock();
+	for (;;) {
+		while ( ! m_stop && m_next_scan < (int)m_scans.size() && m_next_scan > m_current + m_window) {
+			wait();
+		}
+		if (m_stop || m_next_scan >= (int)m_scans.size()) {
+			break;
+		}
+		int ix = m_next_scan++;
+		m_scans[ix]->state = SCAN_BUSY;
+		unlock();
+		process(ix);
+		lock();
+		m_scans[ix]->state = SCAN_DONE;
+		broadcast();
+	}
+	unlock();
+}
+
+// read the index of a file, pick the ads that may match, and read the first
+// of them.  this runs on the read ahead threads, so it must not touch ClassAds
+// or write to the log.
+bool
+HistoryIndexReader::process(int ix)
+{
+	HistoryIndexScan & scan = *m_scans[ix];
+
+	scan.fd = safe_open_wrapper_follow(scan.filename.c_str(), O_RDONLY | O_LARGEFILE | _O_BINARY);
+	if (scan.fd < 0) {
+		formatstr(scan.error, "can't open: %s", strerror(errno));
+		return false;
+	}
+	struct stat st;
+	if (fstat(scan.fd, &st) < 0) {
+		formatstr(scan.error, "can't stat: %s", strerror(errno));
+		return false;
+	}
+	long long history_size = st.st_size;
+
+	std::string name = HistoryIndexFileName(scan.filename.c_str());
+	int idx_fd = safe_open_wrapper_follow(name.c_str(), O_RDONLY | O_LARGEFILE | _O_BINARY);
+	if (idx_fd < 0) {
+		formatstr(scan.error, "no index: %s", strerror(errno));
+		return false;
+	}
+	std::string buf;
+	if (fstat(idx_fd, &st) == 0 && st.st_size >= HISTORY_INDEX_HEADER_SIZE) {
+			// a record still being appended is left for the next reader
+		size_t len = st.st_size - (st.st_size - HISTORY_INDEX_HEADER_SIZE) % HISTORY_INDEX_RECORD_SIZE;
+		buf.resize(len);
+		if (full_read(idx_fd, &buf[0], len) != (ssize_t)len) {
+			buf.clear();
+		}
+	}
+	close(idx_fd);
+	const unsigned char * data = (const unsigned char *)buf.data();
+	if (buf.empty() || ! check_header(data)) {
+		scan.error = "index is not readable";
+		return false;
+	}
+
+	size_t num_recs = (buf.size() - HISTORY_INDEX_HEADER_SIZE) / HISTORY_INDEX_RECORD_SIZE;
+	std::vector<HistoryIndexRecord> recs(num_recs);
+	long long end = 0;
+	for (size_t ii = 0; ii < num_recs; ++ii) {
+		get_record(data + HISTORY_INDEX_HEADER_SIZE + ii * HISTORY_INDEX_RECORD_SIZE, recs[ii]);
+		if (recs[ii].offset != end) {
+			scan.error = "index has a gap";
+			return false;
+		}
+		end += recs[ii].length;
+	}
+	if (end != history_size) {
+		formatstr(scan.error, "index ends at %lld, file at %lld", end, history_size);
+		return false;
+	}
+	scan.indexed = true;
+
+	int skipped = 0;
+	for (size_t ii = num_recs; ii > 0; --ii) {
+		const HistoryIndexRecord & rec = recs[ii-1];
+		if (m_filter.mayMatch(rec)) {
+			HistoryIndexScan::Candidate cand;
+			cand.offset = rec.offset;
+			cand.length = rec.length;
+			cand.skipped = skipped;
+			scan.cands.push_back(cand);
+			skipped = 0;
+		} else {
+			++skipped;
+		}
+	}
+	scan.trailing = skipped;
+
+	size_t read_ahead = 0;
+	for (size_t ii = 0; ii < scan.cands.size() && read_ahead < HISTORY_INDEX_READ_AHEAD; ++ii) {
+		scan.texts.push_back(std::string());
+		if ( ! scan.read(scan.cands[ii], scan.texts.back())) {
+			scan.texts.pop_back();
+			break;
+		}
+		read_ahead += scan.cands[ii].length;
+	}
+	return true;
+}
+
+bool
+HistoryIndexReader::nextFile(const char *& filename, bool & indexed)
+{
+	lock();
+	if (m_current >= 0 && m_current < (int)m_scans.size()) {
+		m_scans[m_current]->release();
+	}
+	++m_current;
+	broadcast();
+	if (m_current >= (int)m_scans.size()) {
+		unlock();
+		return false;
+	}
+	HistoryIndexScan & scan = *m_scans[m_current];
+	if (m_next_scan <= m_current) {
+			// no thread has started on it, so do it here
+		m_next_scan = m_current + 1;
+		scan.state = SCAN_BUSY;
+		unlock();
+		process(m_current);
+		lock();
+		scan.state = SCAN_DONE;
+	}
+	while (scan.state != SCAN_DONE) {
+		wait();
+	}
+	unlock();
+
+	if ( ! scan.indexed) {
+		dprintf(D_FULLDEBUG, "Not using the index of history file %s: %s\n",
+			scan.filename.c_str(), scan.error.c_str());
+		scan.release();
+	}
+	filename = scan.filename.c_str();
+	indexed = scan.indexed;
+	return true;
+}
+
+bool
+HistoryIndexReader::nextAd(std::string & text, int & skipped)
+{
+	skipped = 0;
+	if (m_current < 0 || m_current >= (int)m_scans.size()) {
+		return false;
+	}
+	HistoryIndexScan & scan = *m_scans[m_current];
+	if (scan.next >= scan.cands.size()) {
+		skipped = scan.trailing;
+		scan.trailing = 0;
+		return false;
+	}
+	const HistoryIndexScan::Candidate & cand = scan.cands[scan.next];
+	if (scan.next < scan.texts.size()) {
+		text.swap(scan.texts[scan.next]);
+		std::string().swap(scan.texts[scan.next]);
+	} else if ( ! scan.read(cand, text)) {
+		dprintf(D_ALWAYS, "Failed to read history file %s at offset %lld: %s\n",
+			scan.filename.c_str(), cand.offset, strerror(errno));
+		scan.next = scan.cands.size();
+		return false;
+	}
+	skipped = cand.skipped;
+	++scan.next;
+	return true;
+}
+
+void
+HistoryIndexReader::adLines(const std::string & text, std::vector<std::string> & exprs)
+{
+	exprs.clear();
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t eol = text.find('\n', pos);
+		if (eol == std::string::npos) eol = text.size();
+		size_t end = eol;
+		if (end > pos && text[end-1] == '\r') --end;
+
+		size_t ix = pos;
+		while (ix < end && (text[ix] == ' ' || text[ix] == '\t')) ++ix;
+		if (end > pos && text[ix] != '#' && text.compare(pos, 4, "*** ") != 0) {
+			exprs.push_back(text.substr(pos, end - pos));
+		}
+		pos = eol + 1;
+	}
+	std::reverse(exprs.begin(), exprs.end());
+}
@@ -0,0 +1,198 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _HISTORY_INDEX_H
+#define _HISTORY_INDEX_H
+
+/*
+  The index of a history file.
+
+  AppendHistory() writes a record to the index of the history file for each
+  ad it appends, so that condor_history and the history helper can find
+  the ads that might match a query on ClusterId, Owner, CompletionDate or
+  JobStatus without parsing every ad in the file.  The index of "history"
+  is ".history.idx" in the same directory, and it is renamed and deleted
+  along with the history file when it is rotated.  The name starts with a
+  dot so that it is never taken for a rotated history file.
+
+  The index is a header followed by fixed size records, in the order of the
+  ads in the history file.  All numbers are little endian.
+
+      header:  "CHISTIDX", version (4), size of a record (4)
+      record:  offset of the ad (8), length of the ad and its banner (4),
+               ClusterId (4), ProcId (4), JobStatus (4),
+               CompletionDate (8), hash of the lower case Owner (4),
+               which of the attributes the ad had (4)
+
+  A reader only uses an index whose records cover the whole history file,
+  one after the other, and reads the file the old way otherwise.  The
+  schedd rebuilds an index that does not cover the history file from the
+  banner lines (which do not have the JobStatus) when it opens the file.
+*/
+
+#include "condor_classad.h"
+
+#include <string>
+#include <vector>
+
+#define HISTORY_INDEX_HAS_CLUSTER    0x01
+#define HISTORY_INDEX_HAS_PROC       0x02
+#define HISTORY_INDEX_HAS_STATUS     0x04
+#define HISTORY_INDEX_HAS_COMPLETION 0x08
+#define HISTORY_INDEX_HAS_OWNER      0x10
+
+struct HistoryIndexRecord {
+	long long    offset;
+	unsigned int length;
+	int          cluster;
+	int          proc;
+	int          job_status;
+	long long    completion_date;
+	unsigned int owner_hash;
+	unsigned int flags;
+};
+
+// the name of the index of a history file
+std::string HistoryIndexFileName(const char * history_file);
+
+// the hash of an Owner as it is kept in the index
+unsigned int HistoryIndexOwnerHash(const char * owner);
+
+// rename or delete the index along with its history file
+void RenameHistoryIndex(const char * from_history_file, const char * to_history_file);
+void RemoveHistoryIndex(const char * history_file);
+
+class HistoryIndexWriter
+{
+public:
+	HistoryIndexWriter() : m_fd(-1), m_end(0) {}
+	~HistoryIndexWriter() { close(); }
+
+	// open the index of a history file that has history_size bytes,
+	// rebuilding the index if it does not cover the file.
+	bool open(const char * history_file, filesize_t history_size);
+	void close();
+	bool isOpen() const { return m_fd >= 0; }
+
+	// add the record for an ad that was written at offset in the history file
+	bool append(ClassAd & ad, filesize_t offset, filesize_t length);
+
+private:
+	bool rebuild(filesize_t history_size);
+	bool write(const std::vector<HistoryIndexRecord> & recs);
+
+	int m_fd;
+	filesize_t m_end;  // end of the last ad in the index
+	std::string m_history_file;
+};
+
+// The part of a constraint that can be answered from the index records.
+// Whatever the index can't answer is taken to match, so an ad whose record
+// matches still has to be checked against the whole constraint.
+class HistoryIndexFilter
+{
+public:
+	HistoryIndexFilter() : m_root(-1) {}
+
+	void init(classad::ExprTree * constraint);
+
+	// true if every record matches, so the index can't rule anything out
+	bool matchesAll() const { return m_root < 0; }
+	bool mayMatch(const HistoryIndexRecord & rec) const { return m_root < 0 || eval(m_root, rec); }
+
+	// true if a set of records might have one that matches.  lo and hi are
+	// the least and greatest values of the fields in lo.flags, and if that
+	// has HISTORY_INDEX_HAS_OWNER, owners has the hashes of all the Owners.
+	bool mayMatchRange(const HistoryIndexRecord & lo, const HistoryIndexRecord & hi,
+		const std::vector<unsigned int> & owners) const
+	{
+		return m_root < 0 || evalRange(m_root, lo, hi, owners);
+	}
+
+private:
+	struct Node {
+		int op;     // classad::Operation::OpKind
+		int field;  // HISTORY_INDEX_HAS_* of the attribute compared, 0 for && and ||
+		long long ival;
+		double rval;
+		bool is_real;
+		int left, right;
+	};
+	int build(classad::ExprTree * tree);
+	bool eval(int ix, const HistoryIndexRecord & rec) const;
+	bool evalRange(int ix, const HistoryIndexRecord & lo, const HistoryIndexRecord & hi,
+		const std::vector<unsigned int> & owners) const;
+
+	std::vector<Node> m_nodes;
+	int m_root;
+};
+
+class HistoryIndexScan;
+
+// Reads the ads that may match a filter from a set of history files, newest
+// first, using their indexes.  The indexes of the files, and the first few
+// megabytes of the ads they pick, are read ahead by HISTORY_INDEX_READ_THREADS
+// threads.  Those threads only read files; the ads are parsed by the caller.
+class HistoryIndexReader
+{
+public:
+	// files are oldest first, as returned by findHistoryFiles()
+	HistoryIndexReader(const char * const * files, int num_files, const HistoryIndexFilter & filter);
+	~HistoryIndexReader();
+
+	// move to the next file, newest first.  indexed is false if the file
+	// has no usable index, in which case the caller must read the whole file.
+	bool nextFile(const char *& filename, bool & indexed);
+
+	// the next ad (with its banner line) in the current file that may match,
+	// newest first.  skipped is set to the number of ads before it (or before
+	// the end of the file) that did not match.
+	bool nextAd(std::string & text, int & skipped);
+
+	// split the text of an ad into the lines to insert into a ClassAd,
+	// last line first, which is the order the backward readers collect them in.
+	static void adLines(const std::string & text, std::vector<std::string> & exprs);
+
+	// used by the read ahead threads
+	void readAhead();
+
+private:
+	bool process(int ix);
+
+	// guard the state shared with the read ahead threads; these do
+	// nothing when there are no threads
+	void lock();
+	void unlock();
+	void wait();
+	void broadcast();
+
+	std::vector<HistoryIndexScan*> m_scans;
+	const HistoryIndexFilter & m_filter;
+	int m_current;   // the file nextAd() reads, newest first
+	int m_next_scan; // the next file for the read ahead threads
+	int m_window;    // how far ahead of m_current they may go
+	bool m_stop;
+#if defined(HAVE_PTHREADS) && ! defined(WIN32)
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond;
+	std::vector<pthread_t> m_threads;
+#endif
+};
+
+#endif
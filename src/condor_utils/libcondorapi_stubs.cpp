@@ -22,6 +22,7 @@
 #include "condor_classad.h"
 #include "generic_query.h"
 #include "condor_query.h"
+#include "classad_wire.h"
 
 #ifdef WIN32
 #if 1
@@ -286,6 +287,9 @@ void Stream::set_deadline_timeout(int){not_impl();}
 void Stream::set_deadline(time_t){not_impl();}
 time_t Stream::get_deadline() const{not_impl();return 0;}
 bool Stream::deadline_expired() const{not_impl();return false;}
+CondorVersionInfo const *Stream::get_peer_version() const{not_impl();return NULL;}
+ClassAdWireNames &Stream::classad_wire_names(){static ClassAdWireNames names; not_impl();return names;}
+void Stream::reset_classad_wire_names(){not_impl();}
 
 
 /* stubs for generic query object */
@@ -42,6 +42,7 @@ using std::string;
 #define CondorLogOp_BeginTransaction	105
 #define CondorLogOp_EndTransaction		106
 #define CondorLogOp_LogHistoricalSequenceNumber 107
+#define CondorLogOp_Snapshot            108
 #define CondorLogOp_Error               999
 
 class LogRecord {
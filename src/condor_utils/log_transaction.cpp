@@ -53,11 +53,12 @@ Transaction::~Transaction()
 		// No further lookups in this hash table should be performed.
 }
 
-void
+size_t
 Transaction::Commit(FILE* fp, const char *filename, LoggableClassAdTable *data_structure, bool nondurable)
 {
 	LogRecord *log;
 	int fd;
+	size_t bytes = 0;
 
 	if ( filename == NULL ) {
 		filename = "<null>";
@@ -73,9 +74,11 @@ Transaction::Commit(FILE* fp, const char *filename, LoggableClassAdTable *data_s
 
 	while( (log = ordered_op_log.Next()) ) {
 		if ( fp != NULL ) {
-			if ( log->Write( fp ) < 0 ) {
+			int len = log->Write( fp );
+			if ( len < 0 ) {
 				EXCEPT( "write to %s failed, errno = %d", filename, errno );
 			}
+			bytes += len;
 		}
 		log->Play(data_structure);
 	}
@@ -104,6 +107,7 @@ Transaction::Commit(FILE* fp, const char *filename, LoggableClassAdTable *data_s
 		}
 
 	}
+	return bytes;
 }
 
 void
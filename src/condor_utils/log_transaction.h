@@ -48,7 +48,8 @@ class Transaction {
 public:
 	Transaction();
 	~Transaction();
-	void Commit(FILE* fp, const char *filename, LoggableClassAdTable *data_structure, bool nondurable=false);
+	// returns the number of bytes written to the log
+	size_t Commit(FILE* fp, const char *filename, LoggableClassAdTable *data_structure, bool nondurable=false);
 	void AppendLog(LogRecord *);
 	LogRecord *FirstEntry(char const *key);
 	LogRecord *NextEntry();
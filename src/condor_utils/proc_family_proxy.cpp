@@ -482,6 +482,14 @@ ProcFamilyProxy::start_procd()
 		args.AppendArg(min_tracking_gid);
 		args.AppendArg(max_tracking_gid);
 	}
+
+	// have the ProcD follow the kernel's process events, and only
+	// look at every process once per reconcile interval
+	//
+	if (param_boolean("PROCD_USE_PROC_CONNECTOR", false)) {
+		args.AppendArg("-N");
+		args.AppendArg(param_integer("PROCD_RECONCILE_INTERVAL", 600, 1));
+	}
 #endif
 
 	// for the GLEXEC_JOB feature, we'll need to pass the ProcD paths
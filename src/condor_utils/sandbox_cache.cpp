@@ -0,0 +1,534 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_uid.h"
+#include "condor_md.h"
+#include "directory.h"
+#include "link.h"
+#include "safe_open.h"
+#include "basename.h"
+#include "sandbox_cache.h"
+
+#include <algorithm>
+#include <vector>
+
+// where starters leave their hits and misses for the startd
+//
+static const char *STATS_FILENAME = ".stats";
+
+// escape a string so that it is acceptable for use as a filename. any
+// character not in the regex [a-zA-Z0-9._@-] is replaced with %AA,
+// where AA is the character's two-hex-digit equivalent
+//
+static std::string
+escape_for_filename(const char *s)
+{
+	std::string out;
+	for ( ; *s; s++) {
+		if (isalnum((unsigned char)*s) || strchr("._@-", *s)) {
+			out += *s;
+		}
+		else {
+			char buf[4];
+			snprintf(buf, sizeof(buf), "%%%02x", (unsigned char)*s);
+			out += buf;
+		}
+	}
+	// don't let a user directory look like one of our own files
+	if (out.empty()) {
+		out = "%00";
+	}
+	else if (out[0] == '.') {
+		out.replace(0, 1, "%2e");
+	}
+	return out;
+}
+
+// checksums come from our peer, so make sure they can't be anything
+// but a checksum before we use them in a path
+//
+static bool
+valid_checksum(const char *checksum)
+{
+	size_t len = 0;
+	for ( ; checksum[len]; len++) {
+		if (!isxdigit((unsigned char)checksum[len]) || isupper((unsigned char)checksum[len])) {
+			return false;
+		}
+	}
+	return len == 2 * MAC_SIZE;
+}
+
+SandboxCache::SandboxCache(char const *dir, char const *user) :
+	m_dir(dir),
+	m_hits(0),
+	m_misses(0),
+	m_hit_bytes(0)
+{
+	m_user_dir = m_dir + DIR_DELIM_CHAR + escape_for_filename(user);
+}
+
+std::string
+SandboxCache::CacheFileName(char const *checksum, bool executable)
+{
+	// the same contents may be wanted both with and without execute
+	// permission, and a cached file's permissions are shared by every
+	// sandbox it is linked into
+	return m_user_dir + DIR_DELIM_CHAR + checksum + (executable ? ".x" : "");
+}
+
+// finish a checksum and write it out in hex
+//
+static bool
+finish_checksum(Condor_MD_MAC &md, std::string &checksum)
+{
+	unsigned char *md_raw = md.computeMD();
+	if (!md_raw) {
+		return false;
+	}
+	checksum.clear();
+	for (int i = 0; i < MAC_SIZE; i++) {
+		char buf[3];
+		snprintf(buf, sizeof(buf), "%02x", (int)md_raw[i]);
+		checksum += buf;
+	}
+	free(md_raw);
+	return true;
+}
+
+bool
+SandboxCache::ComputeChecksum(char const *path, std::string &checksum)
+{
+	Condor_MD_MAC md;
+	if (!md.addMDFile(path)) {
+		return false;
+	}
+	return finish_checksum(md, checksum);
+}
+
+#if defined(LINUX)
+
+// the checksum of the file open on fd
+//
+static bool
+checksum_fd(int fd, std::string &checksum)
+{
+	Condor_MD_MAC md;
+	std::vector<unsigned char> buf(1024 * 1024);
+	off_t offset = 0;
+	for (;;) {
+		ssize_t len = pread(fd, &buf[0], buf.size(), offset);
+		if (len < 0 && errno == EINTR) {
+			continue;
+		}
+		if (len < 0) {
+			return false;
+		}
+		if (len == 0) {
+			break;
+		}
+		md.addMD(&buf[0], len);
+		offset += len;
+	}
+	return finish_checksum(md, checksum);
+}
+
+// hard link the file open on fd to name in the directory dir_fd (or
+// AT_FDCWD), without looking up the file by a path the job could change
+//
+static int
+link_fd(int fd, int dir_fd, char const *name)
+{
+	std::string proc_path;
+	formatstr(proc_path, "/proc/self/fd/%d", fd);
+	return linkat(AT_FDCWD, proc_path.c_str(), dir_fd, name, AT_SYMLINK_FOLLOW);
+}
+
+#endif
+
+bool
+SandboxCache::Fetch(char const *checksum, bool executable, filesize_t size, char const *dest)
+{
+	bool hit = false;
+
+#if defined(LINUX)
+	if (valid_checksum(checksum)) {
+		std::string cache_file = CacheFileName(checksum, executable);
+		int cache_fd = -1;
+		int dir_fd = -1;
+		struct stat st;
+
+		// the cache side as condor
+		priv_state saved_priv = set_condor_priv();
+		cache_fd = open(cache_file.c_str(), O_RDONLY | O_NOFOLLOW);
+		if (cache_fd == -1 || fstat(cache_fd, &st) == -1) {
+			dprintf(D_FULLDEBUG, "SandboxCache: %s is not cached\n", dest);
+		}
+		else if (!S_ISREG(st.st_mode) || (can_switch_ids() && st.st_uid != get_condor_uid())) {
+			dprintf(D_ALWAYS, "SandboxCache: %s is not a file of ours; not using it\n",
+			        cache_file.c_str());
+		}
+		else if ((filesize_t)st.st_size != size) {
+			dprintf(D_ALWAYS,
+			        "SandboxCache: %s has size " FILESIZE_T_FORMAT
+			        " instead of " FILESIZE_T_FORMAT "; not using it\n",
+			        cache_file.c_str(),
+			        (filesize_t)st.st_size,
+			        size);
+		}
+		else {
+			// the sandbox side as the job's user.  the job can change
+			// its sandbox, so refuse a directory that is a symlink or
+			// isn't the job's own, and link relative to what we opened
+			set_user_priv();
+			char *dir = condor_dirname(dest);
+			dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+			if (dir_fd == -1 || fstat(dir_fd, &st) == -1) {
+				dprintf(D_ALWAYS,
+				        "SandboxCache: failed to open directory %s: %s (%d)\n",
+				        dir,
+				        strerror(errno),
+				        errno);
+			}
+			else if (can_switch_ids() && st.st_uid != get_user_uid()) {
+				dprintf(D_ALWAYS,
+				        "SandboxCache: %s does not belong to the job; not linking into it\n",
+				        dir);
+			}
+			else {
+				// only root may link a file into a directory that the
+				// file's owner can't write.  both ends are already open,
+				// so root looks up nothing the job could have changed
+				set_root_priv();
+				if (link_fd(cache_fd, dir_fd, condor_basename(dest)) == -1) {
+					dprintf(D_ALWAYS,
+					        "SandboxCache: failed to link %s to %s: %s (%d)\n",
+					        dest,
+					        cache_file.c_str(),
+					        strerror(errno),
+					        errno);
+				}
+				else {
+					dprintf(D_FULLDEBUG,
+					        "SandboxCache: linked %s to %s\n",
+					        dest,
+					        cache_file.c_str());
+					hit = true;
+				}
+			}
+			free(dir);
+		}
+		set_priv(saved_priv);
+
+		if (dir_fd != -1) {
+			close(dir_fd);
+		}
+		if (cache_fd != -1) {
+			close(cache_fd);
+		}
+	}
+#else
+	(void)checksum;
+	(void)executable;
+	(void)dest;
+#endif
+
+	if (hit) {
+		m_hits++;
+		m_hit_bytes += size;
+	}
+	else {
+		m_misses++;
+	}
+	return hit;
+}
+
+void
+SandboxCache::Insert(char const *checksum, bool executable, char const *path)
+{
+#if defined(LINUX)
+	if (!valid_checksum(checksum)) {
+		return;
+	}
+	std::string cache_file = CacheFileName(checksum, executable);
+
+	// the job can change its sandbox, so open the file once, without
+	// following a symlink, and do everything else to what we opened
+	priv_state saved_priv = set_user_priv();
+	int fd = open(path, O_RDONLY | O_NOFOLLOW);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		dprintf(D_ALWAYS,
+		        "SandboxCache: failed to open %s: %s (%d)\n",
+		        path,
+		        strerror(errno),
+		        errno);
+		if (fd != -1) {
+			close(fd);
+		}
+		set_priv(saved_priv);
+		return;
+	}
+
+	// we are about to give the file to condor, so it had better be the
+	// job's own, and not also somewhere else
+	if (!S_ISREG(st.st_mode) || st.st_nlink != 1 ||
+	    (can_switch_ids() && st.st_uid != get_user_uid()))
+	{
+		dprintf(D_ALWAYS, "SandboxCache: %s is not a file of the job's own; not caching it\n", path);
+		close(fd);
+		set_priv(saved_priv);
+		return;
+	}
+
+	// keep this job, and the ones that get this file later, from
+	// changing what is in the cache.  the checksum comes after that,
+	// so that what we check is what we cache
+	bool ok = true;
+	bool chowned = false;
+	if (fchmod(fd, executable ? 0555 : 0444) == -1) {
+		dprintf(D_ALWAYS,
+		        "SandboxCache: failed to make %s read-only: %s (%d)\n",
+		        path,
+		        strerror(errno),
+		        errno);
+		ok = false;
+	}
+	if (ok && can_switch_ids()) {
+		// only root can give a file away
+		set_root_priv();
+		if (fchown(fd, get_condor_uid(), get_condor_gid()) == -1) {
+			dprintf(D_ALWAYS,
+			        "SandboxCache: failed to give %s to condor: %s (%d)\n",
+			        path,
+			        strerror(errno),
+			        errno);
+			ok = false;
+		}
+		else {
+			chowned = true;
+		}
+		set_user_priv();
+	}
+
+	std::string actual;
+	if (ok && (!checksum_fd(fd, actual) || actual != checksum)) {
+		dprintf(D_ALWAYS,
+		        "SandboxCache: %s does not have the checksum %s our peer sent; not caching it\n",
+		        path,
+		        checksum);
+		ok = false;
+	}
+
+	if (ok) {
+		// the cache side as condor, so the startd can remove what we
+		// put there
+		set_condor_priv();
+		if (mkdir(m_user_dir.c_str(), 0700) == -1 && errno != EEXIST) {
+			dprintf(D_ALWAYS,
+			        "SandboxCache: failed to create %s: %s (%d)\n",
+			        m_user_dir.c_str(),
+			        strerror(errno),
+			        errno);
+			ok = false;
+		}
+		else if (link_fd(fd, AT_FDCWD, cache_file.c_str()) == -1) {
+			// EEXIST means another job got it into the cache first
+			if (errno != EEXIST) {
+				dprintf(D_ALWAYS,
+				        "SandboxCache: failed to link %s to %s: %s (%d)\n",
+				        cache_file.c_str(),
+				        path,
+				        strerror(errno),
+				        errno);
+			}
+			ok = false;
+		}
+		else {
+			dprintf(D_FULLDEBUG, "SandboxCache: cached %s as %s\n", path, cache_file.c_str());
+		}
+	}
+
+	if (!ok) {
+		// give the job back its file as it was
+		if (chowned) {
+			set_root_priv();
+			if (fchown(fd, st.st_uid, st.st_gid) == -1) {
+				dprintf(D_ALWAYS,
+				        "SandboxCache: failed to give %s back to the job: %s (%d)\n",
+				        path,
+				        strerror(errno),
+				        errno);
+			}
+		}
+		set_user_priv();
+		if (fchmod(fd, st.st_mode & 07777) == -1) {
+			dprintf(D_FULLDEBUG,
+			        "SandboxCache: failed to restore the mode of %s: %s (%d)\n",
+			        path,
+			        strerror(errno),
+			        errno);
+		}
+	}
+
+	close(fd);
+	set_priv(saved_priv);
+#else
+	(void)checksum;
+	(void)executable;
+	(void)path;
+#endif
+}
+
+void
+SandboxCache::WriteStats()
+{
+	if (m_hits == 0 && m_misses == 0) {
+		return;
+	}
+
+	std::string stats_file = m_dir + DIR_DELIM_CHAR + STATS_FILENAME;
+	std::string line;
+	formatstr(line, "%ld %ld " FILESIZE_T_FORMAT "\n", m_hits, m_misses, m_hit_bytes);
+
+	// a single short append is atomic, so starters don't need to lock
+	priv_state saved_priv = set_condor_priv();
+	int fd = safe_open_wrapper_follow(stats_file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (fd == -1 || write(fd, line.c_str(), line.size()) != (ssize_t)line.size()) {
+		dprintf(D_ALWAYS,
+		        "SandboxCache: failed to write %s: %s (%d)\n",
+		        stats_file.c_str(),
+		        strerror(errno),
+		        errno);
+	}
+	if (fd != -1) {
+		close(fd);
+	}
+	set_priv(saved_priv);
+
+	m_hits = m_misses = 0;
+	m_hit_bytes = 0;
+}
+
+void
+SandboxCache::ReadStats(char const *dir, long &hits, long &misses, filesize_t &hit_bytes)
+{
+	hits = misses = 0;
+	hit_bytes = 0;
+
+	// move the file out of the way first, so that starters appending
+	// while we read start a new one instead of losing their counts
+	std::string stats_file = std::string(dir) + DIR_DELIM_CHAR + STATS_FILENAME;
+	std::string reading_file = stats_file + ".reading";
+	if (rename(stats_file.c_str(), reading_file.c_str()) == -1) {
+		if (errno != ENOENT) {
+			dprintf(D_ALWAYS,
+			        "SandboxCache: failed to rename %s: %s (%d)\n",
+			        stats_file.c_str(),
+			        strerror(errno),
+			        errno);
+		}
+		return;
+	}
+
+	FILE *fp = safe_fopen_wrapper_follow(reading_file.c_str(), "r");
+	if (fp) {
+		long h, m;
+		filesize_t b;
+		while (fscanf(fp, "%ld %ld " FILESIZE_T_FORMAT, &h, &m, &b) == 3) {
+			hits += h;
+			misses += m;
+			hit_bytes += b;
+		}
+		fclose(fp);
+	}
+	unlink(reading_file.c_str());
+}
+
+struct SandboxCacheEntry {
+	time_t      last_use;
+	filesize_t  size;
+	std::string path;
+
+	bool operator<(const SandboxCacheEntry &other) const {
+		return last_use < other.last_use;
+	}
+};
+
+void
+SandboxCache::Clean(char const *dir, filesize_t max_bytes,
+                    filesize_t &cache_bytes, int &cache_files, int &evicted)
+{
+	cache_bytes = 0;
+	cache_files = 0;
+	evicted = 0;
+
+	std::vector<SandboxCacheEntry> unused;
+
+	Directory cache_dir(dir, PRIV_CONDOR);
+	while (cache_dir.Next()) {
+		if (!cache_dir.IsDirectory()) {
+			continue;
+		}
+		Directory user_dir(cache_dir.GetFullPath(), PRIV_CONDOR);
+		while (user_dir.Next()) {
+			if (user_dir.IsDirectory()) {
+				continue;
+			}
+			cache_bytes += user_dir.GetFileSize();
+			cache_files++;
+
+			// a file that is still linked into a sandbox wouldn't
+			// free any space. linking a file into a sandbox updates
+			// its ctime, so that tells us when it was last used
+			if (link_count(user_dir.GetFullPath()) == 1) {
+				SandboxCacheEntry entry;
+				entry.last_use = user_dir.GetCreateTime();
+				entry.size = user_dir.GetFileSize();
+				entry.path = user_dir.GetFullPath();
+				unused.push_back(entry);
+			}
+		}
+	}
+
+	if (cache_bytes <= max_bytes) {
+		return;
+	}
+
+	std::sort(unused.begin(), unused.end());
+
+	priv_state saved_priv = set_condor_priv();
+	for (size_t i = 0; i < unused.size() && cache_bytes > max_bytes; i++) {
+		if (unlink(unused[i].path.c_str()) == -1) {
+			dprintf(D_ALWAYS,
+			        "SandboxCache: failed to remove %s: %s (%d)\n",
+			        unused[i].path.c_str(),
+			        strerror(errno),
+			        errno);
+			continue;
+		}
+		dprintf(D_FULLDEBUG, "SandboxCache: evicted %s\n", unused[i].path.c_str());
+		cache_bytes -= unused[i].size;
+		cache_files--;
+		evicted++;
+	}
+	set_priv(saved_priv);
+}
@@ -0,0 +1,88 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _SANDBOX_CACHE_H
+#define _SANDBOX_CACHE_H
+
+#include <string>
+
+// A cache of job input files on an execute node (SANDBOX_CACHE_DIR).
+// The starters fill it while they download input files and the startd
+// keeps it under its size limit.  Files are kept under the checksum of
+// their contents, in a directory per user, so a job only ever gets
+// files that one of its own user's jobs transferred.  A cached file is
+// hard linked into the sandbox, so the cache has to be on the same
+// filesystem as EXECUTE, and cached files belong to condor and are
+// read-only to the job.  The job can change its sandbox under us, so a
+// file there is only used through a descriptor opened as the job's
+// user.  Linking by descriptor needs /proc/self/fd, so the cache is
+// Linux only; elsewhere Fetch() always misses and Insert() does nothing.
+//
+class SandboxCache {
+
+public:
+
+	// dir is the cache directory, user the job's user (owner@uid_domain)
+	//
+	SandboxCache(char const *dir, char const *user);
+
+	// the checksum a file is cached under; false if the file can't be read
+	//
+	static bool ComputeChecksum(char const *path, std::string &checksum);
+
+	// hard link the cached copy of a file into place at dest. returns
+	// false, and counts a miss, if there is no such file in the cache
+	//
+	bool Fetch(char const *checksum, bool executable, filesize_t size, char const *dest);
+
+	// add a file we just received, if it has the checksum our peer said
+	// it would. from now on the file belongs to condor and is read-only
+	//
+	void Insert(char const *checksum, bool executable, char const *path);
+
+	// add the hits and misses counted so far to the ones waiting for
+	// the startd, and start counting again
+	//
+	void WriteStats();
+
+	// for the startd: add up the hits and misses the starters wrote
+	// since the last call
+	//
+	static void ReadStats(char const *dir, long &hits, long &misses, filesize_t &hit_bytes);
+
+	// for the startd: remove the least recently used files that are
+	// not in any sandbox until the cache holds no more than max_bytes.
+	// reports what is left in the cache and how many files went
+	//
+	static void Clean(char const *dir, filesize_t max_bytes,
+	                  filesize_t &cache_bytes, int &cache_files, int &evicted);
+
+private:
+
+	std::string CacheFileName(char const *checksum, bool executable);
+
+	std::string m_dir;
+	std::string m_user_dir;
+
+	long       m_hits;
+	long       m_misses;
+	filesize_t m_hit_bytes;
+};
+
+#endif
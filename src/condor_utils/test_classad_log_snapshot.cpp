@@ -0,0 +1,335 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+/* Tests binary snapshots of a ClassAd log: that the ads written to a
+ * snapshot are the ads loaded from it, and that ClassAdLogParser expands
+ * a snapshot into the NewClassAd and SetAttribute entries of its ads.
+ */
+
+#include "condor_common.h"
+#include "condor_config.h"
+#include "condor_debug.h"
+#include "condor_distribution.h"
+#include "subsystem_info.h"
+#include "condor_attributes.h"
+#include "classad_log.h"
+#include "classad_log_snapshot.h"
+#include "ClassAdLogEntry.h"
+#include "ClassAdLogParser.h"
+
+#include <map>
+#include <string>
+
+bool verbose = false;
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+		return 1; \
+	} else if( verbose ) { \
+		fprintf( stdout, "Passed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+	}
+
+typedef std::map<std::string, std::string> AttrMap;
+typedef std::map<std::string, AttrMap> AdMap;
+
+// more ads than fit in one chunk of a snapshot
+static const int NUM_ADS = 4500;
+static const unsigned long SEQUENCE_NUMBER = 7;
+
+static std::string test_dir;
+
+static void
+make_ad(int ii, ClassAd & ad)
+{
+	SetMyTypeName(ad, JOB_ADTYPE);
+	SetTargetTypeName(ad, STARTD_ADTYPE);
+	ad.Assign(ATTR_CLUSTER_ID, 1 + ii / 10);
+	ad.Assign(ATTR_PROC_ID, ii % 10);
+	ad.Assign(ATTR_OWNER, (ii % 2) ? "alice" : "bob");
+	ad.Assign(ATTR_JOB_STATUS, 1 + ii % 5);
+	ad.Assign(ATTR_JOB_PRIO, ii % 3 - 1);
+	ad.Assign(ATTR_JOB_CMD, "/bin/sleep");
+	ad.Assign(ATTR_JOB_REMOTE_WALL_CLOCK, ii * 0.25);
+	ad.AssignExpr(ATTR_REQUIREMENTS, "TARGET.Memory >= RequestMemory && Arch == \"X86_64\"");
+	if (ii % 11 == 0) {
+		ad.Assign(ATTR_HOLD_REASON, "held for a test");
+	}
+}
+
+static std::string
+make_key(int ii)
+{
+	std::string key;
+	formatstr(key, "%d.%d", 1 + ii / 10, ii % 10);
+	return key;
+}
+
+// the attributes of an ad as the log writes them
+static void
+ad_to_attrs(ClassAd & ad, AttrMap & attrs)
+{
+	attrs.clear();
+	for (classad::ClassAd::iterator it = ad.begin(); it != ad.end(); ++it) {
+		attrs[it->first] = ExprTreeToString(it->second);
+	}
+}
+
+static void
+expected_ads(AdMap & ads)
+{
+	ads.clear();
+	for (int ii = 0; ii < NUM_ADS; ++ii) {
+		ClassAd ad;
+		make_ad(ii, ad);
+		ad_to_attrs(ad, ads[make_key(ii)]);
+	}
+}
+
+static void
+free_table(HashTable<HashKey, ClassAd*> & table)
+{
+	ClassAd * ad;
+	HashKey key;
+	table.startIterations();
+	while (table.iterate(key, ad) == 1) {
+		delete ad;
+	}
+	table.clear();
+}
+
+// write a log of the ads with the ads in a snapshot, and one change
+// appended as text after it
+static int
+write_log(const char * log_name)
+{
+	HashTable<HashKey, ClassAd*> table(CLASSAD_LOG_HASHTABLE_SIZE, HashKey::hash);
+	ClassAdLogTable<HashKey, ClassAd*> la(table);
+	for (int ii = 0; ii < NUM_ADS; ++ii) {
+		ClassAd * ad = new ClassAd;
+		make_ad(ii, *ad);
+		table.insert(HashKey(make_key(ii).c_str()), ad);
+	}
+
+	FILE * fp = safe_fopen_wrapper_follow(log_name, "w");
+	REQUIRE( fp != NULL );
+	MyString errmsg;
+	bool ok = WriteClassAdLogSnapshotState(fp, log_name, log_name,
+		SEQUENCE_NUMBER, 1500000000, la, errmsg);
+	free_table(table);
+	if ( ! ok) {
+		fprintf(stderr, "WriteClassAdLogSnapshotState: %s\n", errmsg.Value());
+	}
+	REQUIRE( ok );
+
+	LogSetAttribute change("1.0", ATTR_JOB_STATUS, "4");
+	REQUIRE( change.Write(fp) >= 0 );
+	REQUIRE( fclose(fp) == 0 );
+	return 0;
+}
+
+static int
+test_load(const char * log_name)
+{
+	HashTable<HashKey, ClassAd*> table(CLASSAD_LOG_HASHTABLE_SIZE, HashKey::hash);
+	ClassAdLogTable<HashKey, ClassAd*> la(table);
+	unsigned long sequence_number = 0;
+	time_t birthdate = 0;
+	bool is_clean = true, requires_successful_cleaning = false, loaded_snapshot = false;
+	MyString errmsg;
+
+	FILE * fp = LoadClassAdLog(log_name, la, DefaultMakeClassAdLogTableEntry,
+		sequence_number, birthdate,
+		is_clean, requires_successful_cleaning, loaded_snapshot, errmsg);
+	REQUIRE( fp != NULL );
+	fclose(fp);
+	REQUIRE( loaded_snapshot );
+	REQUIRE( sequence_number == SEQUENCE_NUMBER );
+	REQUIRE( birthdate == 1500000000 );
+	REQUIRE( table.getNumElements() == NUM_ADS );
+
+	AdMap expected;
+	expected_ads(expected);
+	expected["1.0"][ATTR_JOB_STATUS] = "4";
+
+	int mismatched = 0;
+	for (AdMap::iterator it = expected.begin(); it != expected.end(); ++it) {
+		ClassAd * ad = NULL;
+		AttrMap attrs;
+		if (table.lookup(HashKey(it->first.c_str()), ad) < 0) {
+			++mismatched;
+			continue;
+		}
+		ad_to_attrs(*ad, attrs);
+		if (attrs != it->second) {
+			++mismatched;
+		}
+	}
+	free_table(table);
+	REQUIRE( mismatched == 0 );
+	return 0;
+}
+
+// read the log through a parser that expands snapshots, stopping after
+// max_entries if it isn't negative.  what it saw goes in ads.
+static int
+parse_log(ClassAdLogParser & parser, int max_entries, AdMap & ads, bool & saw_snapshot, bool & saw_change)
+{
+	ads.clear();
+	saw_snapshot = false;
+	saw_change = false;
+	REQUIRE( parser.openFile() == FILE_OP_SUCCESS );
+
+	int entries = 0;
+	int op_type = 0;
+	while ((max_entries < 0 || entries < max_entries) &&
+		   parser.readLogEntry(op_type) == FILE_READ_SUCCESS) {
+		++entries;
+		ClassAdLogEntry * entry = parser.getCurCALogEntry();
+		switch (op_type) {
+		case CondorLogOp_NewClassAd:
+			REQUIRE( ! saw_snapshot );
+			REQUIRE( ads.count(entry->key) == 0 );
+			ads[entry->key];
+			break;
+		case CondorLogOp_SetAttribute:
+			REQUIRE( ads.count(entry->key) == 1 );
+			if (saw_snapshot) {
+					// the change after the snapshot
+				REQUIRE( strcmp(entry->key, "1.0") == 0 );
+				saw_change = true;
+			}
+			ads[entry->key][entry->name] = entry->value;
+			break;
+		case CondorLogOp_Snapshot:
+				// the ads come first, then the Snapshot command
+			REQUIRE( ! saw_snapshot );
+			REQUIRE( (int)ads.size() == NUM_ADS );
+			saw_snapshot = true;
+			break;
+		case CondorLogOp_LogHistoricalSequenceNumber:
+			REQUIRE( ads.empty() );
+			break;
+		default:
+			fprintf(stderr, "unexpected log entry type %d\n", op_type);
+			REQUIRE( false );
+		}
+	}
+	return 0;
+}
+
+static int
+test_parser(const char * log_name)
+{
+	AdMap expected;
+	expected_ads(expected);
+	expected["1.0"][ATTR_JOB_STATUS] = "4";
+
+	AdMap ads;
+	bool saw_snapshot = false, saw_change = false;
+	{
+			// the whole log, then the parser goes away after the
+			// snapshot it expanded
+		ClassAdLogParser parser;
+		parser.setJobQueueName(log_name);
+		parser.setExpandSnapshots(true);
+		if (parse_log(parser, -1, ads, saw_snapshot, saw_change)) {
+			return 1;
+		}
+		REQUIRE( saw_snapshot );
+		REQUIRE( saw_change );
+		REQUIRE( ads == expected );
+
+			// starting over after a snapshot, and in the middle of one
+		parser.setNextOffset(0);
+		if (parse_log(parser, 100, ads, saw_snapshot, saw_change)) {
+			return 1;
+		}
+		REQUIRE( ! saw_snapshot );
+		parser.setNextOffset(0);
+		if (parse_log(parser, -1, ads, saw_snapshot, saw_change)) {
+			return 1;
+		}
+		REQUIRE( saw_snapshot );
+		REQUIRE( ads == expected );
+
+			// and going away in the middle of one
+		parser.setNextOffset(0);
+		if (parse_log(parser, 10, ads, saw_snapshot, saw_change)) {
+			return 1;
+		}
+		REQUIRE( ! saw_snapshot );
+	}
+
+		// without expanding, only the Snapshot command is seen
+	ClassAdLogParser parser;
+	parser.setJobQueueName(log_name);
+	REQUIRE( parser.openFile() == FILE_OP_SUCCESS );
+	int op_type = 0;
+	int snapshots = 0, new_ads = 0;
+	while (parser.readLogEntry(op_type) == FILE_READ_SUCCESS) {
+		if (op_type == CondorLogOp_Snapshot) {
+			++snapshots;
+		} else if (op_type == CondorLogOp_NewClassAd) {
+			++new_ads;
+		}
+	}
+	REQUIRE( snapshots == 1 );
+	REQUIRE( new_ads == 0 );
+	return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+	set_mySubSystem( "TEST_CLASSAD_LOG_SNAPSHOT", SUBSYSTEM_TYPE_TOOL );
+	myDistro->Init( argc, argv );
+	config_ex(CONFIG_OPT_NO_EXIT);
+	dprintf_set_tool_debug("test_classad_log_snapshot", 0);
+
+	for (int ii = 1; ii < argc; ++ii) {
+		if (strcmp(argv[ii], "-v") == 0) {
+			verbose = true;
+		} else {
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	char dir_template[] = "/tmp/test_classad_log_snapshot.XXXXXX";
+	if ( ! mkdtemp(dir_template)) {
+		fprintf(stderr, "failed to create a directory to test in: %s\n", strerror(errno));
+		return 1;
+	}
+	test_dir = dir_template;
+	std::string log_name = test_dir + "/job_queue.log";
+
+	int failed = write_log(log_name.c_str());
+	if ( ! failed) failed = test_load(log_name.c_str());
+	if ( ! failed) failed = test_parser(log_name.c_str());
+
+	std::string snapshot = ClassAdLogSnapshotPath(log_name.c_str(),
+		ClassAdLogSnapshotName(log_name.c_str(), SEQUENCE_NUMBER).c_str());
+	unlink(snapshot.c_str());
+	unlink(log_name.c_str());
+	rmdir(test_dir.c_str());
+	if ( ! failed) {
+		fprintf(stdout, "All ClassAd log snapshot tests passed.\n");
+	}
+	return failed;
+}
@@ -0,0 +1,370 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+/* Measures how fast ClassAds are sent and received over a CEDAR
+ * connection in the text and binary encodings, and checks that the ads
+ * that are received are the ads that were sent.
+ *
+ * Encoding and decoding are timed separately: the ads are sent on a
+ * loopback connection that a thread drains as raw bytes, and those bytes
+ * are then written to another connection by a thread while the ads are
+ * received.  The 8.2 _putClassAd_v0() is timed as well when this and
+ * classad_oldnew.cpp are built with -DENABLE_V0_PUT_CLASSAD.
+ */
+
+#include "condor_common.h"
+#include "condor_config.h"
+#include "condor_debug.h"
+#include "condor_distribution.h"
+#include "subsystem_info.h"
+#include "condor_attributes.h"
+#include "compat_classad.h"
+#include "classad_oldnew.h"
+#include "reli_sock.h"
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#ifdef ENABLE_V0_PUT_CLASSAD
+int _putClassAd_v0( Stream *sock, classad::ClassAd& ad, bool excludeTypes, bool exclude_private );
+#endif
+
+// a job ad, roughly as the schedd sends it to the negotiator
+static const char * job_ad_lines[] = {
+	"MyType = \"Job\"",
+	"TargetType = \"Machine\"",
+	"ClusterId = 1234567",
+	"ProcId = 42",
+	"GlobalJobId = \"submit.example.org#1234567.42#1500000000\"",
+	"Owner = \"alice\"",
+	"User = \"alice@example.org\"",
+	"AcctGroup = \"physics\"",
+	"AccountingGroup = \"physics.alice\"",
+	"JobUniverse = 5",
+	"JobStatus = 1",
+	"JobPrio = 0",
+	"NiceUser = false",
+	"QDate = 1500000000",
+	"EnteredCurrentStatus = 1500000000",
+	"CompletionDate = 0",
+	"NumJobStarts = 0",
+	"NumRestarts = 0",
+	"NumShadowStarts = 0",
+	"JobRunCount = 0",
+	"ExitBySignal = false",
+	"ExitStatus = 0",
+	"Cmd = \"/home/alice/analysis/bin/run_analysis\"",
+	"Arguments = \"--input data_042.root --output out_042.root --events 100000\"",
+	"Iwd = \"/home/alice/analysis/run_2017_07\"",
+	"In = \"/dev/null\"",
+	"Out = \"run_042.out\"",
+	"Err = \"run_042.err\"",
+	"UserLog = \"/home/alice/analysis/run_2017_07/run.log\"",
+	"Environment = \"HOME=/home/alice PATH=/usr/bin:/bin ANALYSIS_ROOT=/home/alice/analysis\"",
+	"TransferInput = \"data_042.root,calib.db,config.json\"",
+	"TransferOutput = \"out_042.root\"",
+	"ShouldTransferFiles = \"YES\"",
+	"WhenToTransferOutput = \"ON_EXIT\"",
+	"RequestCpus = 1",
+	"RequestMemory = ifthenelse(MemoryUsage =!= undefined,MemoryUsage,2048)",
+	"RequestDisk = DiskUsage",
+	"DiskUsage = 250000",
+	"ImageSize = 100000",
+	"ExecutableSize = 1500",
+	"MemoryUsage = ((ResidentSetSize + 1023) / 1024)",
+	"ResidentSetSize = 0",
+	"RemoteUserCpu = 0.0",
+	"RemoteSysCpu = 0.0",
+	"CumulativeSlotTime = 0",
+	"CommittedTime = 0",
+	"MaxHosts = 1",
+	"MinHosts = 1",
+	"CurrentHosts = 0",
+	"WantRemoteSyscalls = false",
+	"WantCheckpoint = false",
+	"OnExitRemove = true",
+	"OnExitHold = false",
+	"PeriodicHold = false",
+	"PeriodicRelease = false",
+	"PeriodicRemove = (JobStatus == 5) && (time() - EnteredCurrentStatus > 7 * 24 * 60 * 60)",
+	"LeaveJobInQueue = false",
+	"Requirements = (TARGET.Arch == \"X86_64\") && (TARGET.OpSys == \"LINUX\") && (TARGET.Disk >= RequestDisk) && (TARGET.Memory >= RequestMemory) && (TARGET.HasFileTransfer) && regexp(\"^slot[0-9]+@node[0-9]+\\\\.example\\\\.org$\", TARGET.Name)",
+	"ConcurrencyLimits = \"db_license,scratch_io:2\"",
+	"x509userproxysubject = \"/DC=org/DC=example/OU=People/CN=Alice Example 1234\"",
+	"JobLeaseDuration = 2400",
+	"StreamOut = false",
+	"StreamErr = false",
+	"BufferSize = 524288",
+	"BufferBlockSize = 32768",
+	"CoreSize = 0",
+	"KillSig = \"SIGTERM\"",
+	"Rank = TARGET.Mips * 2 + TARGET.KFlops / 1000",
+	"AutoClusterAttrs = \"JobUniverse,LastCheckpointPlatform,NumCkpts,RequestCpus,RequestDisk,RequestMemory,Requirements,Rank\"",
+	"AutoClusterId = 17",
+	"LastJobLeaseRenewal = 1500000100",
+	"JobNotification = 0",
+	"NotifyUser = \"alice@example.org\"",
+	"DAGManJobId = 1234500",
+	"DAGNodeName = \"analysis_042\"",
+	"DAGParentNodeNames = \"prepare_042,calibrate\"",
+	"WantGlidein = false",
+	"SubmitEventNotes = \"\"",
+	"TotalSuspensions = 0",
+	"StartdPrincipal = \"unauthenticated@unmapped\"",
+	"MachineAttrCpus0 = 1",
+	"MachineAttrSlotWeight0 = 1",
+	"Tags = { \"analysis\", \"2017\", \"physics\" }",
+	"Resources = [ cpus = 1; memory = 2048; gpus = 0 ]",
+	"RemoteHost = \"slot1_3@node17.example.org\"",
+	"StartdIpAddr = \"<192.168.0.17:9618?addrs=192.168.0.17-9618&noUDP&sock=1234_abcd_5>\"",
+};
+
+struct drain_args {
+	int fd;
+	std::string bytes;
+};
+
+// read the connection to the end, and keep what was read
+static void *
+drain_thread(void *pv)
+{
+	drain_args *args = (drain_args *)pv;
+	char buf[65536];
+	for (;;) {
+		ssize_t cb = read(args->fd, buf, sizeof(buf));
+		if (cb < 0 && errno == EINTR) continue;
+		if (cb <= 0) break;
+		args->bytes.append(buf, cb);
+	}
+	return NULL;
+}
+
+struct feed_args {
+	int fd;
+	const std::string *bytes;
+};
+
+// write the bytes to the connection, then shut it down
+static void *
+feed_thread(void *pv)
+{
+	feed_args *args = (feed_args *)pv;
+	size_t off = 0;
+	while (off < args->bytes->size()) {
+		ssize_t cb = write(args->fd, args->bytes->data() + off, args->bytes->size() - off);
+		if (cb < 0 && errno == EINTR) continue;
+		if (cb <= 0) break;
+		off += cb;
+	}
+	shutdown(args->fd, SHUT_WR);
+	return NULL;
+}
+
+static bool
+make_connection(ReliSock &client, ReliSock *&server)
+{
+	ReliSock listener;
+	if ( ! listener.bind(CP_IPV4, false, 0, true) || ! listener.listen()) {
+		fprintf(stderr, "failed to listen on a loopback port\n");
+		return false;
+	}
+	if ( ! client.connect("127.0.0.1", listener.get_port())) {
+		fprintf(stderr, "failed to connect to port %d\n", listener.get_port());
+		return false;
+	}
+	server = listener.accept();
+	if ( ! server) {
+		fprintf(stderr, "failed to accept a connection\n");
+		return false;
+	}
+	return true;
+}
+
+enum { ENCODE_TEXT, ENCODE_BINARY, ENCODE_V0 };
+static const char * encode_names[] = { "text", "binary", "text v0" };
+
+// send the ad count times, and keep the bytes that were sent
+static bool
+time_encode(classad::ClassAd &ad, int count, int how, std::string &wire, double &secs)
+{
+	ReliSock client;
+	ReliSock *server = NULL;
+	if ( ! make_connection(client, server)) {
+		return false;
+	}
+
+	drain_args args;
+	args.fd = server->get_file_desc();
+	pthread_t thread;
+	pthread_create(&thread, NULL, drain_thread, &args);
+
+	bool ok = true;
+	double begin = _condor_debug_get_time_double();
+	for (int ii = 0; ii < count && ok; ++ii) {
+		client.encode();
+		switch (how) {
+		case ENCODE_TEXT: ok = putClassAd(&client, ad, 0); break;
+		case ENCODE_BINARY: ok = putClassAd(&client, ad, PUT_CLASSAD_BINARY); break;
+	#ifdef ENABLE_V0_PUT_CLASSAD
+		case ENCODE_V0: ok = _putClassAd_v0(&client, ad, false, false); break;
+	#endif
+		default: ok = false; break;
+		}
+		ok = ok && client.end_of_message();
+	}
+	secs = _condor_debug_get_time_double() - begin;
+
+	client.close();
+	pthread_join(thread, NULL);
+	delete server;
+
+	wire.swap(args.bytes);
+	return ok;
+}
+
+// receive count ads from the bytes sent by time_encode, and keep the last one
+static bool
+time_decode(const std::string &wire, int count, int options, classad::ClassAd &ad, double &secs)
+{
+	ReliSock client;
+	ReliSock *server = NULL;
+	if ( ! make_connection(client, server)) {
+		return false;
+	}
+
+	feed_args args;
+	args.fd = client.get_file_desc();
+	args.bytes = &wire;
+	pthread_t thread;
+	pthread_create(&thread, NULL, feed_thread, &args);
+
+	bool ok = true;
+	double begin = _condor_debug_get_time_double();
+	for (int ii = 0; ii < count && ok; ++ii) {
+		server->decode();
+		ok = (options < 0) ? getClassAd(server, ad) : getClassAdEx(server, ad, options);
+		ok = ok && server->end_of_message();
+	}
+	secs = _condor_debug_get_time_double() - begin;
+
+	pthread_join(thread, NULL);
+	delete server;
+	return ok;
+}
+
+// true if the received ad has the same attributes as the one that was sent
+static bool
+same_ad(classad::ClassAd &sent, classad::ClassAd &received, bool verbose)
+{
+	classad::ClassAdUnParser unp;
+	unp.SetOldClassAd(true, true);
+	bool same = true;
+	int num_sent = 0;
+	for (classad::AttrList::const_iterator it = sent.begin(); it != sent.end(); ++it) {
+		++num_sent;
+		std::string lhs, rhs;
+		unp.Unparse(lhs, it->second);
+		classad::ExprTree *tree = received.Lookup(it->first);
+		if (tree) {
+			unp.Unparse(rhs, tree);
+		}
+		if ( ! tree || lhs != rhs) {
+			if (verbose) {
+				fprintf(stderr, "  %s: sent %s, received %s\n", it->first.c_str(), lhs.c_str(), tree ? rhs.c_str() : "nothing");
+			}
+			same = false;
+		}
+	}
+	if (received.size() != num_sent) {
+		if (verbose) {
+			fprintf(stderr, "  sent %d attributes, received %d\n", num_sent, (int)received.size());
+		}
+		same = false;
+	}
+	return same;
+}
+
+int
+main(int argc, const char **argv)
+{
+	set_mySubSystem( "TEST_CLASSAD_WIRE", SUBSYSTEM_TYPE_TOOL );
+	myDistro->Init( argc, argv );
+	config();
+	dprintf_set_tool_debug("test_classad_wire", 0);
+
+	int count = 20000;
+	bool verbose = false;
+	for (int ii = 1; ii < argc; ++ii) {
+		if (strcmp(argv[ii], "-n") == 0 && ii+1 < argc) {
+			count = atoi(argv[++ii]);
+		} else if (strcmp(argv[ii], "-v") == 0) {
+			verbose = true;
+		} else {
+			fprintf(stderr, "usage: %s [-n ads] [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	classad::ClassAd ad;
+	for (size_t ii = 0; ii < sizeof(job_ad_lines)/sizeof(job_ad_lines[0]); ++ii) {
+		if ( ! InsertLongFormAttrValue(ad, job_ad_lines[ii], false)) {
+			fprintf(stderr, "failed to insert %s\n", job_ad_lines[ii]);
+			return 1;
+		}
+	}
+
+	struct { int options; const char * name; } decoders[] = {
+		{ -1, "getClassAd" },
+		{ GET_CLASSAD_FAST, "getClassAdEx(FAST)" },
+		{ GET_CLASSAD_FAST | GET_CLASSAD_NO_CACHE, "getClassAdEx(FAST|NO_CACHE)" },
+	};
+
+	printf("%d ads of %d attributes\n", count, (int)ad.size());
+	printf("%-8s %-28s %10s %12s %12s %8s\n", "encoding", "decoder", "bytes/ad", "encode ad/s", "decode ad/s", "same");
+
+	int failed = 0;
+	for (int how = ENCODE_TEXT; how <= ENCODE_V0; ++how) {
+	#ifndef ENABLE_V0_PUT_CLASSAD
+		if (how == ENCODE_V0) continue;
+	#endif
+		std::string wire;
+		double encode_secs = 0;
+		if ( ! time_encode(ad, count, how, wire, encode_secs)) {
+			fprintf(stderr, "failed to send %s ads\n", encode_names[how]);
+			++failed;
+			continue;
+		}
+		for (size_t jj = 0; jj < sizeof(decoders)/sizeof(decoders[0]); ++jj) {
+			classad::ClassAd received;
+			double decode_secs = 0;
+			bool ok = time_decode(wire, count, decoders[jj].options, received, decode_secs);
+			bool same = ok && same_ad(ad, received, verbose);
+			if ( ! same) ++failed;
+			printf("%-8s %-28s %10.1f %12.0f %12.0f %8s\n",
+				encode_names[how], decoders[jj].name,
+				(double)wire.size() / count,
+				count / encode_secs,
+				ok ? count / decode_secs : 0.0,
+				ok ? (same ? "yes" : "NO") : "FAILED");
+		}
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,518 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+/* Tests the index of a history file (.history.idx) and the columnar
+ * archives of rotated history files: the filter that both use to rule out
+ * ads, and that ads written to either come back as they went in.
+ */
+
+#include "condor_common.h"
+#include "condor_config.h"
+#include "condor_debug.h"
+#include "condor_distribution.h"
+#include "subsystem_info.h"
+#include "condor_attributes.h"
+#include "compat_classad.h"
+#include "compat_classad_util.h"
+#include "history_index.h"
+#include "history_archive.h"
+#include "stat_info.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+bool verbose = false;
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+		return 1; \
+	} else if( verbose ) { \
+		fprintf( stdout, "Passed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+	}
+
+static std::string test_dir;
+
+// the ad of the ii'th job in a history file
+static void
+make_ad(int ii, ClassAd & ad)
+{
+	ad.Clear();
+	ad.Assign(ATTR_CLUSTER_ID, 100 + ii);
+	ad.Assign(ATTR_PROC_ID, ii % 3);
+	ad.Assign(ATTR_OWNER, (ii % 2) ? "alice" : "Bob");
+	ad.Assign(ATTR_JOB_STATUS, (ii % 5) ? 4 : 3);
+	ad.Assign(ATTR_COMPLETION_DATE, 1500000000 + ii * 10);
+	ad.Assign(ATTR_JOB_CMD, "/bin/sleep");
+	ad.Assign(ATTR_JOB_REMOTE_WALL_CLOCK, ii * 1.5);
+	ad.AssignExpr(ATTR_RANK, "Memory * 2");
+	if (ii % 7 == 0) {
+			// an attribute that most ads don't have
+		ad.Assign("HoldReasonSubCode", ii);
+	}
+}
+
+// append ads to a history file the way AppendHistory() does, indexing them
+// if index is set
+static bool
+write_history(const char * file, int first, int count, bool index)
+{
+	FILE * fp = safe_fopen_wrapper_follow(file, "a");
+	if ( ! fp) {
+		return false;
+	}
+	HistoryIndexWriter writer;
+	if (index) {
+		fseek(fp, 0, SEEK_END);
+		writer.open(file, ftell(fp));
+	}
+	for (int ii = first; ii < first + count; ++ii) {
+		ClassAd ad;
+		make_ad(ii, ad);
+		fseek(fp, 0, SEEK_END);
+		long ad_start = ftell(fp);
+		fPrintAd(fp, ad);
+		fprintf(fp, "*** Offset = 0 ClusterId = %d ProcId = %d Owner = \"%s\" CompletionDate = %d\n",
+			100 + ii, ii % 3, (ii % 2) ? "alice" : "Bob", 1500000000 + ii * 10);
+		fflush(fp);
+		if (index && ! writer.append(ad, ad_start, ftell(fp) - ad_start)) {
+			fclose(fp);
+			return false;
+		}
+	}
+	fclose(fp);
+	return true;
+}
+
+// the ids of the ads make_ad() makes that match a constraint, newest first
+static void
+expected_ids(const char * constraint, int count, std::vector<int> & ids)
+{
+	ids.clear();
+	for (int ii = count - 1; ii >= 0; --ii) {
+		ClassAd ad;
+		make_ad(ii, ad);
+		if (EvalBool(&ad, constraint)) {
+			ids.push_back(100 + ii);
+		}
+	}
+}
+
+// true if two ads have the same attributes with the same values
+static bool
+same_ad(ClassAd & lhs, ClassAd & rhs)
+{
+	if (lhs.size() != rhs.size()) {
+		return false;
+	}
+	classad::ClassAdUnParser unparser;
+	for (classad::ClassAd::iterator it = lhs.begin(); it != lhs.end(); ++it) {
+		classad::ExprTree * other = rhs.Lookup(it->first);
+		if ( ! other) {
+			return false;
+		}
+		std::string lhs_text, rhs_text;
+		unparser.Unparse(lhs_text, it->second);
+		unparser.Unparse(rhs_text, other);
+		if (lhs_text != rhs_text) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+init_filter(HistoryIndexFilter & filter, const char * constraint)
+{
+	classad::ExprTree * tree = NULL;
+	ParseClassAdRvalExpr(constraint, tree);
+	filter.init(tree);
+	delete tree;
+}
+
+static HistoryIndexRecord
+make_record(int cluster, int proc, int status, long long completion, const char * owner)
+{
+	HistoryIndexRecord rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.cluster = cluster;
+	rec.proc = proc;
+	rec.job_status = status;
+	rec.completion_date = completion;
+	rec.owner_hash = HistoryIndexOwnerHash(owner);
+	rec.flags = HISTORY_INDEX_HAS_CLUSTER | HISTORY_INDEX_HAS_PROC | HISTORY_INDEX_HAS_STATUS |
+		HISTORY_INDEX_HAS_COMPLETION | HISTORY_INDEX_HAS_OWNER;
+	return rec;
+}
+
+static int
+test_filter()
+{
+	HistoryIndexFilter filter;
+	HistoryIndexRecord rec = make_record(5, 0, 4, 1000, "alice");
+	HistoryIndexRecord other = make_record(6, 1, 3, 2000, "bob");
+
+		// nothing the index can answer
+	init_filter(filter, "Cmd == \"/bin/sleep\"");
+	REQUIRE( filter.matchesAll() );
+	init_filter(filter, "ClusterId == 5 || Cmd == \"/bin/sleep\"");
+	REQUIRE( filter.matchesAll() );
+	init_filter(filter, "ClusterId == ProcId");
+	REQUIRE( filter.matchesAll() );
+	init_filter(filter, "Owner > \"alice\"");
+	REQUIRE( filter.matchesAll() );
+
+		// comparisons, either way around
+	init_filter(filter, "ClusterId == 5");
+	REQUIRE( ! filter.matchesAll() );
+	REQUIRE( filter.mayMatch(rec) );
+	REQUIRE( ! filter.mayMatch(other) );
+	init_filter(filter, "5 < ClusterId");
+	REQUIRE( ! filter.mayMatch(rec) );
+	REQUIRE( filter.mayMatch(other) );
+	init_filter(filter, "CompletionDate <= 1000.5");
+	REQUIRE( filter.mayMatch(rec) );
+	REQUIRE( ! filter.mayMatch(other) );
+	init_filter(filter, "JobStatus != 4");
+	REQUIRE( ! filter.mayMatch(rec) );
+	REQUIRE( filter.mayMatch(other) );
+	init_filter(filter, "(ProcId =?= 1)");
+	REQUIRE( ! filter.mayMatch(rec) );
+	REQUIRE( filter.mayMatch(other) );
+
+		// Owner by hash, ignoring case
+	init_filter(filter, "Owner == \"ALICE\"");
+	REQUIRE( filter.mayMatch(rec) );
+	REQUIRE( ! filter.mayMatch(other) );
+
+		// && and ||, where the part the index can't answer matches
+	init_filter(filter, "ClusterId == 5 && Cmd == \"/bin/sleep\"");
+	REQUIRE( filter.mayMatch(rec) );
+	REQUIRE( ! filter.mayMatch(other) );
+	init_filter(filter, "ClusterId == 5 && Owner == \"bob\"");
+	REQUIRE( ! filter.mayMatch(rec) );
+	REQUIRE( ! filter.mayMatch(other) );
+	init_filter(filter, "ClusterId == 5 || Owner == \"bob\"");
+	REQUIRE( filter.mayMatch(rec) );
+	REQUIRE( filter.mayMatch(other) );
+	init_filter(filter, "JobStatus == 3 && (ClusterId > 10 || ProcId == 1)");
+	REQUIRE( ! filter.mayMatch(rec) );
+	REQUIRE( filter.mayMatch(other) );
+
+		// a record without the attribute may match anything
+	init_filter(filter, "ClusterId == 7");
+	rec.flags &= ~HISTORY_INDEX_HAS_CLUSTER;
+	REQUIRE( filter.mayMatch(rec) );
+	rec.flags |= HISTORY_INDEX_HAS_CLUSTER;
+
+		// ranges of records, as in a block of an archive
+	HistoryIndexRecord lo = make_record(10, 0, 1, 1000, "");
+	HistoryIndexRecord hi = make_record(20, 2, 4, 2000, "");
+	lo.flags = hi.flags = HISTORY_INDEX_HAS_CLUSTER | HISTORY_INDEX_HAS_PROC |
+		HISTORY_INDEX_HAS_STATUS | HISTORY_INDEX_HAS_COMPLETION;
+	std::vector<unsigned int> owners;
+	init_filter(filter, "ClusterId == 15");
+	REQUIRE( filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "ClusterId == 25");
+	REQUIRE( ! filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "ClusterId < 10");
+	REQUIRE( ! filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "ClusterId <= 10");
+	REQUIRE( filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "CompletionDate > 2000");
+	REQUIRE( ! filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "CompletionDate >= 2000");
+	REQUIRE( filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "ClusterId != 10");
+	REQUIRE( filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "ClusterId == 25 || ProcId == 1");
+	REQUIRE( filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "ClusterId == 15 && JobStatus == 5");
+	REQUIRE( ! filter.mayMatchRange(lo, hi, owners) );
+
+		// the owners of a range are the hashes of all of them
+	owners.push_back(HistoryIndexOwnerHash("alice"));
+	owners.push_back(HistoryIndexOwnerHash("carol"));
+	init_filter(filter, "Owner == \"Carol\"");
+	REQUIRE( filter.mayMatchRange(lo, hi, owners) );
+	lo.flags |= HISTORY_INDEX_HAS_OWNER;
+	REQUIRE( filter.mayMatchRange(lo, hi, owners) );
+	init_filter(filter, "Owner == \"bob\"");
+	REQUIRE( ! filter.mayMatchRange(lo, hi, owners) );
+
+	return 0;
+}
+
+// read the ads of one history file through its index
+static int
+read_indexed(const char * file, const char * constraint, bool & indexed,
+	std::vector<int> & ids, int & skipped)
+{
+	HistoryIndexFilter filter;
+	init_filter(filter, constraint);
+	const char * files[] = { file };
+	HistoryIndexReader reader(files, 1, filter);
+
+	ids.clear();
+	skipped = 0;
+	const char * filename = NULL;
+	REQUIRE( reader.nextFile(filename, indexed) );
+	REQUIRE( strcmp(filename, file) == 0 );
+	if ( ! indexed) {
+		return 0;
+	}
+	std::string text;
+	int skip;
+	std::vector<std::string> exprs;
+	while (reader.nextAd(text, skip)) {
+		skipped += skip;
+		REQUIRE( text.compare(0, 4, "*** ") != 0 );
+		REQUIRE( text.find("\n*** ") != std::string::npos );
+		ClassAd ad;
+		HistoryIndexReader::adLines(text, exprs);
+		for (size_t ii = 0; ii < exprs.size(); ++ii) {
+			REQUIRE( ad.Insert(exprs[ii].c_str()) );
+		}
+		int cluster = -1;
+		REQUIRE( ad.LookupInteger(ATTR_CLUSTER_ID, cluster) );
+		ClassAd orig;
+		make_ad(cluster - 100, orig);
+		REQUIRE( same_ad(ad, orig) );
+		ids.push_back(cluster);
+	}
+	skipped += skip;
+	REQUIRE( ! reader.nextFile(filename, indexed) );
+	return 0;
+}
+
+static int
+test_index_round_trip()
+{
+	std::string file = test_dir + "/history";
+	REQUIRE( write_history(file.c_str(), 0, 50, true) );
+
+	const char * constraints[] = {
+		"true",
+		"Owner == \"alice\" && ClusterId >= 120",
+		"JobStatus == 3 || CompletionDate < 1500000050",
+		"ClusterId == 130",
+		"ClusterId == 1000",
+	};
+	for (size_t ii = 0; ii < sizeof(constraints)/sizeof(constraints[0]); ++ii) {
+		bool indexed = false;
+		std::vector<int> ids, expected;
+		int skipped = 0;
+		if (read_indexed(file.c_str(), constraints[ii], indexed, ids, skipped)) {
+			return 1;
+		}
+		expected_ids(constraints[ii], 50, expected);
+		REQUIRE( indexed );
+		REQUIRE( ids == expected );
+		REQUIRE( (int)ids.size() + skipped == 50 );
+	}
+
+		// an index that is lost is rebuilt from the banners, which have
+		// no JobStatus, so a JobStatus test no longer rules anything out
+	std::string index = HistoryIndexFileName(file.c_str());
+	REQUIRE( index == test_dir + "/.history.idx" );
+	REQUIRE( unlink(index.c_str()) == 0 );
+	{
+		StatInfo si(file.c_str());
+		HistoryIndexWriter writer;
+		REQUIRE( writer.open(file.c_str(), si.GetFileSize()) );
+	}
+	bool indexed = false;
+	std::vector<int> ids, expected;
+	int skipped = 0;
+	if (read_indexed(file.c_str(), "Owner == \"bob\" && ClusterId < 110", indexed, ids, skipped)) {
+		return 1;
+	}
+	expected_ids("Owner == \"bob\" && ClusterId < 110", 50, expected);
+	REQUIRE( indexed );
+	REQUIRE( ids == expected );
+	if (read_indexed(file.c_str(), "JobStatus == 3", indexed, ids, skipped)) {
+		return 1;
+	}
+	REQUIRE( indexed );
+	REQUIRE( ids.size() == 50 );
+
+		// ads appended without indexing them leave the index unused
+	REQUIRE( write_history(file.c_str(), 50, 1, false) );
+	if (read_indexed(file.c_str(), "true", indexed, ids, skipped)) {
+		return 1;
+	}
+	REQUIRE( ! indexed );
+
+		// until the writer catches up
+	{
+		StatInfo si(file.c_str());
+		HistoryIndexWriter writer;
+		REQUIRE( writer.open(file.c_str(), si.GetFileSize()) );
+	}
+	if (read_indexed(file.c_str(), "ClusterId >= 140", indexed, ids, skipped)) {
+		return 1;
+	}
+	expected_ids("ClusterId >= 140", 51, expected);
+	REQUIRE( indexed );
+	REQUIRE( ids == expected );
+
+	RemoveHistoryIndex(file.c_str());
+	unlink(file.c_str());
+	return 0;
+}
+
+// read the ads of an archive
+static int
+read_archive(const char * file, const char * constraint, bool backwards, const char * projection,
+	std::vector<int> & ids, int & skipped, int total)
+{
+	HistoryIndexFilter filter;
+	init_filter(filter, constraint);
+	HistoryArchiveReader reader;
+	std::string errmsg;
+	REQUIRE( reader.open(file, errmsg) );
+	reader.setBackwards(backwards);
+	reader.setFilter(&filter);
+	if (projection) {
+		reader.project(projection);
+	}
+
+	ids.clear();
+	skipped = 0;
+	ClassAd ad;
+	int skip = 0;
+	while (reader.nextAd(ad, skip)) {
+		skipped += skip;
+		int cluster = -1;
+		REQUIRE( ad.LookupInteger(ATTR_CLUSTER_ID, cluster) );
+		REQUIRE( cluster >= 100 && cluster < 100 + total );
+		ClassAd orig;
+		make_ad(cluster - 100, orig);
+		if (projection) {
+			REQUIRE( ad.Lookup(ATTR_JOB_CMD) == NULL );
+		} else {
+			REQUIRE( same_ad(ad, orig) );
+		}
+		if (EvalBool(&orig, constraint)) {
+			ids.push_back(cluster);
+		}
+	}
+	skipped += skip;
+	return 0;
+}
+
+static int
+test_archive_round_trip()
+{
+		// enough ads for a few blocks
+	const int total = 2500;
+	std::string file = test_dir + "/history.20170101T000000";
+	std::string archive = test_dir + "/history.20170101T000000.archive";
+	REQUIRE( write_history(file.c_str(), 0, total, false) );
+	REQUIRE( ! IsHistoryArchive(file.c_str()) );
+
+	int num_ads = 0;
+	std::string errmsg;
+	REQUIRE( WriteHistoryArchive(file.c_str(), archive.c_str(), num_ads, errmsg) );
+	REQUIRE( num_ads == total );
+	REQUIRE( IsHistoryArchive(archive.c_str()) );
+
+	std::vector<int> ids, expected;
+	int skipped = 0;
+
+		// every ad comes back as it went in, newest first or oldest first
+	if (read_archive(archive.c_str(), "true", true, NULL, ids, skipped, total)) {
+		return 1;
+	}
+	expected_ids("true", total, expected);
+	REQUIRE( ids == expected );
+	REQUIRE( skipped == 0 );
+	if (read_archive(archive.c_str(), "true", false, NULL, ids, skipped, total)) {
+		return 1;
+	}
+	std::reverse(expected.begin(), expected.end());
+	REQUIRE( ids == expected );
+
+		// the filter skips blocks and ads, and whatever is left still has
+		// to be checked against the constraint
+	const char * constraints[] = {
+		"ClusterId < 150",
+		"ClusterId >= 2550 && Owner == \"alice\"",
+		"Owner == \"BOB\" && JobStatus == 3",
+		"HoldReasonSubCode == 14 || ClusterId == 2000",
+		"CompletionDate > 1500024000 && Cmd == \"/bin/sleep\"",
+	};
+	for (size_t ii = 0; ii < sizeof(constraints)/sizeof(constraints[0]); ++ii) {
+		int constraint_skipped = 0;
+		if (read_archive(archive.c_str(), constraints[ii], true, NULL, ids, constraint_skipped, total)) {
+			return 1;
+		}
+		expected_ids(constraints[ii], total, expected);
+		REQUIRE( ids == expected );
+		skipped = constraint_skipped;
+	}
+	REQUIRE( skipped > 0 );
+
+		// a projection leaves out the other columns
+	if (read_archive(archive.c_str(), "ClusterId < 150", true, ATTR_CLUSTER_ID, ids, skipped, total)) {
+		return 1;
+	}
+	expected_ids("ClusterId < 150", total, expected);
+	REQUIRE( ids == expected );
+	REQUIRE( (int)ids.size() + skipped == total );
+
+	unlink(archive.c_str());
+	unlink(file.c_str());
+	return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+	set_mySubSystem( "TEST_HISTORY_INDEX", SUBSYSTEM_TYPE_TOOL );
+	myDistro->Init( argc, argv );
+	config_ex(CONFIG_OPT_NO_EXIT);
+	dprintf_set_tool_debug("test_history_index", 0);
+
+	for (int ii = 1; ii < argc; ++ii) {
+		if (strcmp(argv[ii], "-v") == 0) {
+			verbose = true;
+		} else {
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	char dir_template[] = "/tmp/test_history_index.XXXXXX";
+	if ( ! mkdtemp(dir_template)) {
+		fprintf(stderr, "failed to create a directory to test in: %s\n", strerror(errno));
+		return 1;
+	}
+	test_dir = dir_template;
+
+	int failed = test_filter();
+	if ( ! failed) failed = test_index_round_trip();
+	if ( ! failed) failed = test_archive_round_trip();
+
+	rmdir(test_dir.c_str());
+	if ( ! failed) {
+		fprintf(stdout, "All history index and archive tests passed.\n");
+	}
+	return failed;
+}
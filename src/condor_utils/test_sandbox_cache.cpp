@@ -0,0 +1,400 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2017, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+/* Tests the cache of job input files on an execute node: that the
+ * checksums and user names a peer sends can't name anything outside the
+ * user's directory in the cache, that the hits and misses the starters
+ * write add up for the startd, and that cleaning evicts the least
+ * recently used files that aren't in any sandbox.
+ */
+
+#include "condor_common.h"
+#include "condor_config.h"
+#include "condor_debug.h"
+#include "condor_distribution.h"
+#include "condor_uid.h"
+#include "condor_md.h"
+#include "subsystem_info.h"
+#include "directory.h"
+#include "sandbox_cache.h"
+
+#include <string>
+
+bool verbose = false;
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+		return 1; \
+	} else if( verbose ) { \
+		fprintf( stdout, "Passed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+	}
+
+static std::string test_dir;
+
+// a fresh directory under the test directory
+static std::string
+make_dir(const char * name)
+{
+	std::string dir = test_dir + DIR_DELIM_CHAR + name;
+	mkdir(dir.c_str(), 0700);
+	return dir;
+}
+
+// a file of size bytes that differs from the other files of that size
+// by its fill character
+static bool
+write_file(const std::string & path, int size, char fill = 'x')
+{
+	std::string contents(size, fill);
+	int fd = safe_open_wrapper_follow(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		return false;
+	}
+	bool ok = write(fd, contents.data(), contents.size()) == (ssize_t)contents.size();
+	close(fd);
+	return ok;
+}
+
+static bool
+exists(const std::string & path)
+{
+	struct stat st;
+	return lstat(path.c_str(), &st) == 0;
+}
+
+static nlink_t
+num_links(const std::string & path)
+{
+	struct stat st;
+	if (lstat(path.c_str(), &st) == -1) {
+		return 0;
+	}
+	return st.st_nlink;
+}
+
+static int
+test_rejected_checksums()
+{
+	std::string cache_dir = make_dir("rejected");
+	std::string sandbox = make_dir("rejected_sandbox");
+	std::string dest = sandbox + DIR_DELIM_CHAR + "input";
+	std::string outside = test_dir + DIR_DELIM_CHAR + "outside";
+	REQUIRE( write_file(outside, 10) );
+
+	std::string checksum;
+	REQUIRE( SandboxCache::ComputeChecksum(outside.c_str(), checksum) );
+	REQUIRE( checksum.size() == 2 * MAC_SIZE );
+
+	std::string upper = checksum;
+	for (size_t ii = 0; ii < upper.size(); ++ii) {
+		upper[ii] = toupper(upper[ii]);
+	}
+	const char * bad[] = {
+		"",
+		"../../outside",
+		"../outside",
+		upper.c_str(),
+		"0123456789abcdef0123456789abcde",
+		"0123456789abcdef0123456789abcdef0",
+		"0123456789abcdef0123456789abcdeg",
+		"0123456789abcdef/123456789abcdef",
+	};
+	const int num_bad = (int)(sizeof(bad) / sizeof(bad[0]));
+
+		// the files the bad checksums would name, if they were used
+	SandboxCache cache(cache_dir.c_str(), "alice@example.com");
+	std::string user_dir = cache_dir + DIR_DELIM_CHAR + "alice@example.com";
+	REQUIRE( mkdir(user_dir.c_str(), 0700) == 0 );
+	REQUIRE( write_file(user_dir + DIR_DELIM_CHAR + upper, 10) );
+
+	for (int ii = 0; ii < num_bad; ++ii) {
+		REQUIRE( ! cache.Fetch(bad[ii], false, 10, dest.c_str()) );
+		REQUIRE( ! exists(dest) );
+	}
+
+		// a good checksum that isn't cached is just a miss
+	REQUIRE( ! cache.Fetch(checksum.c_str(), false, 10, dest.c_str()) );
+	REQUIRE( ! exists(dest) );
+
+		// and nothing is cached under a bad checksum
+	std::string input = sandbox + DIR_DELIM_CHAR + "output";
+	REQUIRE( write_file(input, 10) );
+	for (int ii = 0; ii < num_bad; ++ii) {
+		cache.Insert(bad[ii], false, input.c_str());
+		REQUIRE( num_links(input) == 1 );
+	}
+	struct stat st;
+	REQUIRE( stat(input.c_str(), &st) == 0 );
+	REQUIRE( (st.st_mode & 07777) == 0644 );
+	REQUIRE( num_links(outside) == 1 );
+
+		// every one of them was counted as a miss
+	long hits = -1, misses = -1;
+	filesize_t hit_bytes = -1;
+	cache.WriteStats();
+	SandboxCache::ReadStats(cache_dir.c_str(), hits, misses, hit_bytes);
+	REQUIRE( hits == 0 );
+	REQUIRE( misses == num_bad + 1 );
+	REQUIRE( hit_bytes == 0 );
+	return 0;
+}
+
+#if defined(LINUX)
+static int
+test_user_dirs()
+{
+	std::string cache_dir = make_dir("users");
+	std::string sandbox = make_dir("users_sandbox");
+
+	struct {
+		const char * user;
+		const char * dir;
+	} users[] = {
+		{ "alice@example.com", "alice@example.com" },
+		{ "../../escaped", "%2e%2e%2f%2e%2e%2fescaped" },
+		{ "a/b", "a%2fb" },
+		{ ".stats", "%2estats" },
+		{ "", "%00" },
+		{ "bob smith@example.com", "bob%20smith@example.com" },
+	};
+	const int num_users = (int)(sizeof(users) / sizeof(users[0]));
+
+	for (int ii = 0; ii < num_users; ++ii) {
+			// each user's own file, or Insert() would find it already
+			// cached by the user before
+		std::string input = sandbox + DIR_DELIM_CHAR + "in";
+		REQUIRE( write_file(input, 100, 'a' + ii) );
+		std::string checksum;
+		REQUIRE( SandboxCache::ComputeChecksum(input.c_str(), checksum) );
+
+		SandboxCache cache(cache_dir.c_str(), users[ii].user);
+		cache.Insert(checksum.c_str(), false, input.c_str());
+		std::string cached = cache_dir + DIR_DELIM_CHAR + users[ii].dir + DIR_DELIM_CHAR + checksum;
+		if ( ! exists(cached)) {
+			fprintf(stderr, "user '%s' was not cached in %s\n", users[ii].user, cached.c_str());
+		}
+		REQUIRE( exists(cached) );
+		REQUIRE( num_links(input) == 2 );
+
+			// the cached file is read-only from now on
+		struct stat st;
+		REQUIRE( stat(input.c_str(), &st) == 0 );
+		REQUIRE( (st.st_mode & 0222) == 0 );
+
+			// and another job of the user gets it linked in
+		std::string dest = sandbox + DIR_DELIM_CHAR + "fetched";
+		REQUIRE( cache.Fetch(checksum.c_str(), false, 100, dest.c_str()) );
+		REQUIRE( num_links(cached) == 3 );
+
+			// but not if it wants it executable
+		std::string exec_dest = sandbox + DIR_DELIM_CHAR + "fetched.x";
+		REQUIRE( ! cache.Fetch(checksum.c_str(), true, 100, exec_dest.c_str()) );
+		REQUIRE( ! exists(exec_dest) );
+
+		REQUIRE( unlink(dest.c_str()) == 0 );
+		REQUIRE( unlink(input.c_str()) == 0 );
+	}
+
+		// nothing outside of the cache
+	REQUIRE( ! exists(test_dir + DIR_DELIM_CHAR + "escaped") );
+	REQUIRE( ! exists(cache_dir + DIR_DELIM_CHAR + "a") );
+	REQUIRE( ! exists(cache_dir + DIR_DELIM_CHAR + ".stats") );
+
+		// and every user's file is in the cache, but in no sandbox
+	filesize_t cache_bytes = 0;
+	int cache_files = 0, evicted = 0;
+	SandboxCache::Clean(cache_dir.c_str(), 1000000, cache_bytes, cache_files, evicted);
+	REQUIRE( cache_files == num_users );
+	REQUIRE( cache_bytes == 100 * num_users );
+	REQUIRE( evicted == 0 );
+	return 0;
+}
+#endif
+
+static int
+test_stats()
+{
+	std::string cache_dir = make_dir("stats");
+	std::string stats_file = cache_dir + DIR_DELIM_CHAR + ".stats";
+	std::string dest = cache_dir + DIR_DELIM_CHAR + "nowhere";
+	long hits = -1, misses = -1;
+	filesize_t hit_bytes = -1;
+
+		// nothing written yet
+	SandboxCache::ReadStats(cache_dir.c_str(), hits, misses, hit_bytes);
+	REQUIRE( hits == 0 );
+	REQUIRE( misses == 0 );
+	REQUIRE( hit_bytes == 0 );
+
+		// a starter that counted nothing writes nothing
+	SandboxCache idle(cache_dir.c_str(), "alice@example.com");
+	idle.WriteStats();
+	REQUIRE( ! exists(stats_file) );
+
+		// two starters
+	SandboxCache first(cache_dir.c_str(), "alice@example.com");
+	SandboxCache second(cache_dir.c_str(), "bob@example.com");
+	for (int ii = 0; ii < 3; ++ii) {
+		first.Fetch("", false, 0, dest.c_str());
+	}
+	second.Fetch("", false, 0, dest.c_str());
+	first.WriteStats();
+	second.WriteStats();
+	REQUIRE( exists(stats_file) );
+
+		// each counts again from nothing after writing
+	first.Fetch("", false, 0, dest.c_str());
+	first.WriteStats();
+	first.WriteStats();
+
+	SandboxCache::ReadStats(cache_dir.c_str(), hits, misses, hit_bytes);
+	REQUIRE( hits == 0 );
+	REQUIRE( misses == 5 );
+	REQUIRE( hit_bytes == 0 );
+	REQUIRE( ! exists(stats_file) );
+	REQUIRE( ! exists(stats_file + ".reading") );
+
+		// and the startd only sees them once
+	SandboxCache::ReadStats(cache_dir.c_str(), hits, misses, hit_bytes);
+	REQUIRE( misses == 0 );
+
+		// a line that isn't whole doesn't count, but the ones before do
+	FILE * fp = safe_fopen_wrapper_follow(stats_file.c_str(), "w");
+	REQUIRE( fp != NULL );
+	fprintf(fp, "2 3 4000\n1 1 100\n7 ");
+	fclose(fp);
+	SandboxCache::ReadStats(cache_dir.c_str(), hits, misses, hit_bytes);
+	REQUIRE( hits == 3 );
+	REQUIRE( misses == 4 );
+	REQUIRE( hit_bytes == 4100 );
+	return 0;
+}
+
+static int
+test_clean()
+{
+	std::string cache_dir = make_dir("clean");
+	std::string sandbox = make_dir("clean_sandbox");
+	std::string alice = cache_dir + DIR_DELIM_CHAR + "alice@example.com";
+	std::string bob = cache_dir + DIR_DELIM_CHAR + "bob@example.com";
+	REQUIRE( mkdir(alice.c_str(), 0700) == 0 );
+	REQUIRE( mkdir(bob.c_str(), 0700) == 0 );
+
+		// the stats aren't part of the cache
+	REQUIRE( write_file(cache_dir + DIR_DELIM_CHAR + ".stats", 1000) );
+
+		// from least to most recently used; a file's ctime is when it
+		// was last used, and that only changes once a second
+	std::string oldest = alice + DIR_DELIM_CHAR + "oldest";
+	std::string in_use = alice + DIR_DELIM_CHAR + "in_use";
+	std::string older = bob + DIR_DELIM_CHAR + "older";
+	std::string newest = bob + DIR_DELIM_CHAR + "newest";
+	REQUIRE( write_file(oldest, 100) );
+	sleep(1);
+	REQUIRE( write_file(in_use, 100) );
+	REQUIRE( link(in_use.c_str(), (sandbox + DIR_DELIM_CHAR + "in_use").c_str()) == 0 );
+	sleep(1);
+	REQUIRE( write_file(older, 100) );
+	sleep(1);
+	REQUIRE( write_file(newest, 100) );
+
+	filesize_t cache_bytes = 0;
+	int cache_files = 0, evicted = 0;
+
+		// under the limit, nothing goes
+	SandboxCache::Clean(cache_dir.c_str(), 400, cache_bytes, cache_files, evicted);
+	REQUIRE( cache_bytes == 400 );
+	REQUIRE( cache_files == 4 );
+	REQUIRE( evicted == 0 );
+
+		// the oldest files go first, skipping the one in a sandbox
+	SandboxCache::Clean(cache_dir.c_str(), 250, cache_bytes, cache_files, evicted);
+	REQUIRE( cache_bytes == 200 );
+	REQUIRE( cache_files == 2 );
+	REQUIRE( evicted == 2 );
+	REQUIRE( ! exists(oldest) );
+	REQUIRE( exists(in_use) );
+	REQUIRE( ! exists(older) );
+	REQUIRE( exists(newest) );
+
+		// a file in a sandbox never goes
+	SandboxCache::Clean(cache_dir.c_str(), 0, cache_bytes, cache_files, evicted);
+	REQUIRE( cache_bytes == 100 );
+	REQUIRE( cache_files == 1 );
+	REQUIRE( evicted == 1 );
+	REQUIRE( exists(in_use) );
+	REQUIRE( ! exists(newest) );
+
+		// until the sandbox is gone
+	REQUIRE( unlink((sandbox + DIR_DELIM_CHAR + "in_use").c_str()) == 0 );
+	SandboxCache::Clean(cache_dir.c_str(), 0, cache_bytes, cache_files, evicted);
+	REQUIRE( cache_bytes == 0 );
+	REQUIRE( cache_files == 0 );
+	REQUIRE( evicted == 1 );
+	REQUIRE( exists(cache_dir + DIR_DELIM_CHAR + ".stats") );
+	return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+	set_mySubSystem( "TEST_SANDBOX_CACHE", SUBSYSTEM_TYPE_TOOL );
+	myDistro->Init( argc, argv );
+	config_ex(CONFIG_OPT_NO_EXIT);
+	dprintf_set_tool_debug("test_sandbox_cache", 0);
+
+	for (int ii = 1; ii < argc; ++ii) {
+		if (strcmp(argv[ii], "-v") == 0) {
+			verbose = true;
+		} else {
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+		// the test plays both condor and the job's user, so that the
+		// cache can switch between them when run as root
+	if (can_switch_ids()) {
+		set_user_ids(get_condor_uid(), get_condor_gid());
+	}
+	priv_state saved_priv = set_condor_priv();
+
+	char dir_template[] = "/tmp/test_sandbox_cache.XXXXXX";
+	if ( ! mkdtemp(dir_template)) {
+		fprintf(stderr, "failed to create a directory to test in: %s\n", strerror(errno));
+		return 1;
+	}
+	test_dir = dir_template;
+
+	int failed = test_rejected_checksums();
+#if defined(LINUX)
+	if ( ! failed) failed = test_user_dirs();
+#endif
+	if ( ! failed) failed = test_stats();
+	if ( ! failed) failed = test_clean();
+
+	Directory dir(test_dir.c_str(), PRIV_CONDOR);
+	dir.Remove_Entire_Directory();
+	rmdir(test_dir.c_str());
+	set_priv(saved_priv);
+	if ( ! failed) {
+		fprintf(stdout, "All sandbox cache tests passed.\n");
+	}
+	return failed;
+}
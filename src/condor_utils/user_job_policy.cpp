@@ -443,6 +443,50 @@ void UserPolicy::ResetTriggers()
 	m_fire_expr = NULL;
 }
 
+bool UserPolicy::PeriodicPolicyReferences(ClassAd & ad, classad::References & refs)
+{
+	static const char * const attrs[] = {
+		ATTR_TIMER_REMOVE_CHECK, ATTR_PERIODIC_HOLD_CHECK, ATTR_PERIODIC_RELEASE_CHECK, ATTR_PERIODIC_REMOVE_CHECK,
+	};
+	ExprTree * exprs[COUNTOF(attrs) + 3];
+	int num_exprs = 0;
+	for (size_t ii = 0; ii < COUNTOF(attrs); ++ii) {
+		refs.insert(attrs[ii]);
+		exprs[num_exprs] = ad.LookupExpr(attrs[ii]);
+		if (exprs[num_exprs]) { ++num_exprs; }
+	}
+	if (m_sys_periodic_hold) { exprs[num_exprs++] = m_sys_periodic_hold; }
+	if (m_sys_periodic_release) { exprs[num_exprs++] = m_sys_periodic_release; }
+	if (m_sys_periodic_remove) { exprs[num_exprs++] = m_sys_periodic_remove; }
+
+	bool depends_on_time = false;
+	for (int ii = 0; ii < num_exprs; ++ii) {
+		if (ExprTreeDependsOnTime(exprs[ii])) {
+			depends_on_time = true;
+		}
+		classad::References internal_refs;
+		ad.GetExternalReferences(exprs[ii], refs, false);
+		ad.GetInternalReferences(exprs[ii], internal_refs, false);
+		for (classad::References::const_iterator it = internal_refs.begin(); it != internal_refs.end(); ++it) {
+			refs.insert(*it);
+			// internal references are followed, so the attributes they
+			// refer to are in refs, but their time dependence is not.
+			ExprTree * expr = ad.LookupExpr(it->c_str());
+			if (expr && ExprTreeDependsOnTime(expr)) {
+				depends_on_time = true;
+			}
+		}
+	}
+	return depends_on_time;
+}
+
+bool UserPolicy::SystemPeriodicPolicyDependsOnTime()
+{
+	return (m_sys_periodic_hold && ExprTreeDependsOnTime(m_sys_periodic_hold)) ||
+		(m_sys_periodic_release && ExprTreeDependsOnTime(m_sys_periodic_release)) ||
+		(m_sys_periodic_remove && ExprTreeDependsOnTime(m_sys_periodic_remove));
+}
+
 #else
 
 void UserPolicy::Init(ClassAd *ad)
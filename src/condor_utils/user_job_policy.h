@@ -199,6 +199,12 @@ class UserPolicy
 		void Init();
 		/* clear the 'policy has fired' variables */
 		void ResetTriggers();
+		/* add the names of the attributes that the periodic policy of the job
+			(including the system periodic policy) refers to to refs.  returns
+			true if the policy can change with the time alone. */
+		bool PeriodicPolicyReferences(ClassAd &ad, classad::References &refs);
+		/* true if the system periodic policy can change with the time alone */
+		bool SystemPeriodicPolicyDependsOnTime();
 	#else
 		/* This class NEVER owns this memory, it just has a reference to it.
 			It also makes sure the default policy expressions are set in the
@@ -446,6 +446,7 @@ WriteUserLog::Reset( void )
     freeLogs();
    	logs.clear();
     log_file_cache = NULL;
+	m_batch = NULL;
 
 	m_enable_fsync = true;
 	m_enable_locking = true;
@@ -1252,6 +1253,19 @@ WriteUserLog::doWriteEvent( ULogEvent *event,
 		}
 	}
 
+	if ( m_batch && !is_global_event && !is_header_event ) {
+		if ( !m_enable_locking && !log.user_priv_flag ) {
+			std::string output;
+			success = formatEvent( event, use_xml, output ) &&
+				m_batch->append( log.path, log.fd, output, m_enable_fsync );
+			set_priv( priv );
+			return success;
+		}
+			// an event written around the batch must come after the
+			// events already in it
+		m_batch->flush( log.path );
+	}
+
 		// We're seeing sporadic test suite failures where a daemon
 		// takes more than 10 seconds to write to the user log.
 		// This will help narrow down where the delay is coming from.
@@ -1338,6 +1352,20 @@ WriteUserLog::doWriteEvent( ULogEvent *event,
 
 bool
 WriteUserLog::doWriteEvent( int fd, ULogEvent *event, bool use_xml )
+{
+	std::string output;
+	bool success = formatEvent( event, use_xml, output );
+
+	if ( success && write( fd, output.c_str(), output.length() ) < 0 ) {
+		// TODO Should we print a '\n...\n' like in the older code?
+		success = false;
+	}
+
+	return success;
+}
+
+bool
+WriteUserLog::formatEvent( ULogEvent *event, bool use_xml, std::string &output )
 {
 	ClassAd* eventAd = NULL;
 	bool success = true;
@@ -1351,31 +1379,20 @@ WriteUserLog::doWriteEvent( int fd, ULogEvent *event, bool use_xml )
 					 event->eventNumber);
 			success = false;
 		} else {
-			std::string adXML;
 			classad::ClassAdXMLUnParser xmlunp;
 
 			eventAd->Delete( ATTR_TARGET_TYPE );
 			xmlunp.SetCompactSpacing(false);
-			xmlunp.Unparse(adXML, eventAd);
-			if ( adXML.length() < 1 ) {
+			xmlunp.Unparse(output, eventAd);
+			if ( output.length() < 1 ) {
 				dprintf( D_ALWAYS,
 						 "WriteUserLog Failed to convert event type # %d to XML.\n",
 						 event->eventNumber);
 			}
-			if ( write( fd, adXML.c_str(), adXML.length() ) < 0) {
-				success = false;
-			} else {
-				success = true;
-			}
 		}
 	} else {
-		std::string output;
 		success = event->formatEvent( output );
 		output += SynchDelimiter;
-		if ( success && write( fd, output.c_str(), output.length() ) < 0 ) {
-			// TODO Should we print a '\n...\n' like in the older code?
-			success = false;
-		}
 	}
 
 	if ( eventAd ) {
@@ -1648,3 +1665,98 @@ bool
 WriteUserLog::getEnableFsync() {
 	return m_enable_fsync;
 }
+
+
+// ***************************
+//  WriteUserLogBatch
+// ***************************
+bool
+WriteUserLogBatch::append( const std::string &path, int fd,
+						   const std::string &text, bool fsync )
+{
+	pending_file &pf = m_files[path];
+	if ( pf.fd < 0 ) {
+		pf.fd = dup( fd );
+		if ( pf.fd < 0 ) {
+			dprintf( D_ALWAYS,
+					 "WriteUserLogBatch: dup() of %s failed - errno %d (%s)\n",
+					 path.c_str(), errno, strerror(errno) );
+			m_files.erase( path );
+			return false;
+		}
+		pf.queued = UtcTime::getTimeDouble();
+	}
+	pf.text += text;
+	pf.fsync = pf.fsync || fsync;
+	pf.events++;
+	m_bytes += text.length();
+	return true;
+}
+
+int
+WriteUserLogBatch::flush( double *max_wait )
+{
+	int events = 0;
+	double now = UtcTime::getTimeDouble();
+	double wait = 0.0;
+	for ( std::map<std::string, pending_file>::iterator it = m_files.begin();
+		  it != m_files.end(); ++it ) {
+		events += it->second.events;
+		if ( now - it->second.queued > wait ) {
+			wait = now - it->second.queued;
+		}
+		writeFile( it->first, it->second );
+	}
+	m_files.clear();
+	m_bytes = 0;
+	if ( max_wait ) {
+		*max_wait = wait;
+	}
+	return events;
+}
+
+int
+WriteUserLogBatch::flush( const std::string &path )
+{
+	std::map<std::string, pending_file>::iterator it = m_files.find( path );
+	if ( it == m_files.end() ) {
+		return 0;
+	}
+	int events = it->second.events;
+	m_bytes -= it->second.text.length();
+	writeFile( it->first, it->second );
+	m_files.erase( it );
+	return events;
+}
+
+void
+WriteUserLogBatch::writeFile( const std::string &path, pending_file &pf )
+{
+		// the descriptor was opened with the priv the log needs, so there
+		// is no need to switch to it again (except on AFS, which the
+		// batch is not used for).
+	const char *ptr = pf.text.c_str();
+	size_t left = pf.text.length();
+	ssize_t len = 0;
+	while ( left > 0 && ( len = ::write( pf.fd, ptr, left ) ) > 0 ) {
+		ptr += len;
+		left -= len;
+	}
+	if ( left > 0 ) {
+		dprintf( D_ALWAYS,
+				 "WriteUserLogBatch: failed to write %d events to %s - "
+				 "errno %d (%s)\n",
+				 pf.events, path.c_str(), errno, strerror(errno) );
+	} else if ( pf.fsync && condor_fdatasync( pf.fd, path.c_str() ) != 0 ) {
+		dprintf( D_ALWAYS,
+				 "fsync() failed in WriteUserLogBatch::writeFile"
+				 " - errno %d (%s)\n",
+				 errno, strerror(errno) );
+	}
+	if ( close( pf.fd ) != 0 ) {
+		dprintf( D_ALWAYS,
+				 "WriteUserLogBatch: close() of %s failed - errno %d (%s)\n",
+				 path.c_str(), errno, strerror(errno) );
+	}
+	pf.fd = -1;
+}
@@ -46,6 +46,7 @@ class FileLock;
 class StatWrapper;
 class ReadUserLogHeader;
 class WriteUserLogState;
+class WriteUserLogBatch;
 
 
 /** API for writing a log file.  Since an API for reading a log file
@@ -208,6 +209,12 @@ class WriteUserLog
     void setLogFileCache(log_file_cache_map_t* cache) { log_file_cache = cache; }
     void freeLogs();
 
+	/** Queue the user log events in a batch rather than writing them.
+		The owner of the batch must flush it.  The global event log, and
+		user logs that are locked or written as the user, are not batched.
+	 */
+	void setBatch(WriteUserLogBatch* batch) { m_batch = batch; }
+
 
 	/** Verify that the event log is initialized
 		@return true on success
@@ -338,6 +345,7 @@ class WriteUserLog
 
 
 	bool doWriteEvent( int fd, ULogEvent *event, bool do_use_xml );
+	bool formatEvent( ULogEvent *event, bool do_use_xml, std::string &output );
 	void GenerateGlobalId( MyString &id );
 
 	bool checkGlobalLogRotation(void);
@@ -370,6 +378,7 @@ class WriteUserLog
 
 	std::vector<log_file*> logs;
     log_file_cache_map_t* log_file_cache;
+	/** Batch of events to write     */  WriteUserLogBatch *m_batch;
 
 	bool doWriteGlobalEvent( ULogEvent *event, ClassAd *ad);
     /** Enable locking?              */  bool		m_enable_locking;
@@ -410,6 +419,60 @@ class WriteUserLog
 	/** Mask for events              */  std::vector<ULogEventNumber> mask;
 };
 
+
+/** Events queued for the user logs, so that the events written to a log
+	file close together take one write and (at most) one fsync.  The schedd
+	flushes the batch from a timer, so an event waits in it for a bounded
+	time; writeEvent() returns once the event is queued.
+
+	The batch keeps its own descriptor for each log file with events in it,
+	so the WriteUserLog that queued them may close the file.
+*/
+class WriteUserLogBatch
+{
+  public:
+	WriteUserLogBatch() : m_bytes(0) {}
+	~WriteUserLogBatch() { flush(); }
+
+	/** Queue the text of an event for a log file
+		@param path the log file
+		@param fd the log file, open for appending
+		@param text the event
+		@param fsync sync the file when the event is written?
+		@return false if the event could not be queued
+	*/
+	bool append( const std::string &path, int fd, const std::string &text,
+				 bool fsync );
+
+	/** Write the queued events
+		@param max_wait set to the seconds the oldest event waited
+		@return the number of events written
+	*/
+	int flush( double *max_wait = NULL );
+
+	/** Write the events queued for one log file, so that an event
+		written to it without the batch comes after them
+	*/
+	int flush( const std::string &path );
+
+	bool empty( void ) const { return m_files.empty(); }
+	size_t pendingBytes( void ) const { return m_bytes; }
+
+  private:
+	struct pending_file {
+		pending_file() : fd(-1), fsync(false), events(0), queued(0.0) {}
+		int fd;
+		std::string text;
+		bool fsync;
+		int events;
+		double queued;		// when the first event was queued
+	};
+	void writeFile( const std::string &path, pending_file &pf );
+
+	std::map<std::string, pending_file> m_files;
+	size_t m_bytes;
+};
+
 #endif /* __cplusplus */
 
 #endif /* _CONDOR_USER_LOG_CPP_H */